@@ -528,6 +528,39 @@ void CAddrMan::Connected_(const CService& addr, int64_t nTime)
         info.nTime = nTime;
 }
 
+void CAddrMan::Snapshot_(CAddrMan& snapshot) const
+{
+    snapshot.nIdCount = nIdCount;
+    snapshot.mapInfo = mapInfo;
+    snapshot.mapAddr = mapAddr;
+    snapshot.vRandom = vRandom;
+    snapshot.nTried = nTried;
+    memcpy(snapshot.vvTried, vvTried, sizeof(vvTried));
+    snapshot.nNew = nNew;
+    memcpy(snapshot.vvNew, vvNew, sizeof(vvNew));
+    snapshot.nKey = nKey;
+}
+
+void CAddrMan::Adopt_(CAddrMan& loaded)
+{
+    for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+        const CAddrInfo& info = it->second;
+        loaded.Add_(info, info.source, 0);
+        if (info.fInTried)
+            loaded.Good_(info, info.nLastSuccess);
+    }
+
+    std::swap(nIdCount, loaded.nIdCount);
+    mapInfo.swap(loaded.mapInfo);
+    mapAddr.swap(loaded.mapAddr);
+    vRandom.swap(loaded.vRandom);
+    std::swap(nTried, loaded.nTried);
+    std::swap(vvTried, loaded.vvTried);
+    std::swap(nNew, loaded.nNew);
+    std::swap(vvNew, loaded.vvNew);
+    std::swap(nKey, loaded.nKey);
+}
+
 int CAddrMan::RandomInt(int nMax){
     return GetRandInt(nMax);
 }
@@ -264,6 +264,12 @@ protected:
     //! Mark an entry as currently-connected-to.
     void Connected_(const CService &addr, int64_t nTime);
 
+    //! Copy every table into snapshot.
+    void Snapshot_(CAddrMan &snapshot) const;
+
+    //! Add what we know to loaded and take its tables over.
+    void Adopt_(CAddrMan &loaded);
+
 public:
     /**
      * serialized format:
@@ -591,6 +597,31 @@ public:
         }
     }
 
+    /**
+     * Copy the tables into snapshot, so peers.dat can be serialized from the copy
+     * while everybody else keeps using this one.
+     */
+    void Snapshot(CAddrMan &snapshot) const
+    {
+        LOCK2(cs, snapshot.cs);
+        Snapshot_(snapshot);
+    }
+
+    /**
+     * Replace the tables with the ones loaded from peers.dat, adding back the
+     * addresses learned while it was being read. Their attempt counts go, tried
+     * entries stay tried. loaded is left with the old tables.
+     */
+    void Adopt(CAddrMan &loaded)
+    {
+        {
+            LOCK2(cs, loaded.cs);
+            Check();
+            Adopt_(loaded);
+            Check();
+        }
+    }
+
 };
 
 #endif // BITCOIN_ADDRMAN_H
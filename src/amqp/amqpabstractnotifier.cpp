@@ -19,3 +19,23 @@ bool AMQPAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
 {
     return true;
 }
+
+bool AMQPAbstractNotifier::NotifyBlockConnected(const CBlockIndex * /*CBlockIndex*/)
+{
+    return true;
+}
+
+bool AMQPAbstractNotifier::NotifyBlockDisconnected(const CBlockIndex * /*CBlockIndex*/)
+{
+    return true;
+}
+
+bool AMQPAbstractNotifier::NotifyTransactionAcceptance(const CTransaction &/*transaction*/)
+{
+    return true;
+}
+
+bool AMQPAbstractNotifier::NotifyTransactionRemoval(const uint256 &/*hash*/)
+{
+    return true;
+}
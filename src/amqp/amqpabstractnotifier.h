@@ -34,6 +34,10 @@ public:
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyBlockConnected(const CBlockIndex *pindex);
+    virtual bool NotifyBlockDisconnected(const CBlockIndex *pindex);
+    virtual bool NotifyTransactionAcceptance(const CTransaction &transaction);
+    virtual bool NotifyTransactionRemoval(const uint256 &hash);
 
 protected:
     std::string type;
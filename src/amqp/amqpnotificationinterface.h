@@ -26,6 +26,9 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added);
+    void TransactionAddedToMempool(const CTransaction &tx);
+    void TransactionRemovedFromMempool(const uint256 &hash);
 
 private:
     AMQPNotificationInterface();
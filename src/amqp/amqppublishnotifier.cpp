@@ -17,6 +17,11 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_SEQUENCE  = "sequence";
+static const char *MSG_SEQUENCEBATCH = "sequencebatch";
+
+static const size_t MAX_SEQUENCE_BATCH_RECORDS = 10000;
+static const size_t SEQUENCE_RECORD_SIZE = 33;
 
 // Invoke this method from a new thread to run the proton container event loop.
 void AMQPAbstractPublishNotifier::SpawnProtonContainer()
@@ -175,3 +180,54 @@ bool AMQPPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool AMQPPublishSequenceNotifier::NotifyBlockConnected(const CBlockIndex *pindex)
+{
+    LogPrint("amqp", "amqp: Publish sequence block connect %s\n", pindex->GetBlockHash().GetHex());
+    return SendSequence(pindex->GetBlockHash(), 'C');
+}
+
+bool AMQPPublishSequenceNotifier::NotifyBlockDisconnected(const CBlockIndex *pindex)
+{
+    LogPrint("amqp", "amqp: Publish sequence block disconnect %s\n", pindex->GetBlockHash().GetHex());
+    return SendSequence(pindex->GetBlockHash(), 'D');
+}
+
+bool AMQPPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction)
+{
+    LogPrint("amqp", "amqp: Publish sequence mempool accept %s\n", transaction.GetHash().GetHex());
+    return SendSequence(transaction.GetHash(), 'A');
+}
+
+bool AMQPPublishSequenceNotifier::NotifyTransactionRemoval(const uint256 &hash)
+{
+    LogPrint("amqp", "amqp: Publish sequence mempool removal %s\n", hash.GetHex());
+    return SendSequence(hash, 'R');
+}
+
+bool AMQPPublishSequenceNotifier::SendSequence(const uint256 &hash, char label)
+{
+    LOCK(cs_sequence);
+    char data[SEQUENCE_RECORD_SIZE];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    data[32] = label;
+    return SendMessage(MSG_SEQUENCE, data, SEQUENCE_RECORD_SIZE);
+}
+
+bool AMQPPublishSequenceBatchNotifier::SendSequence(const uint256 &hash, char label)
+{
+    LOCK(cs_sequence);
+    for (unsigned int i = 0; i < 32; i++)
+        vBatch.push_back(hash.begin()[31 - i]);
+    vBatch.push_back(label);
+
+    bool fTipChanged = (label == 'C' || label == 'D');
+    if (!fTipChanged && vBatch.size() < MAX_SEQUENCE_BATCH_RECORDS * SEQUENCE_RECORD_SIZE)
+        return true;
+
+    LogPrint("amqp", "amqp: Publish sequencebatch of %u events\n", vBatch.size() / SEQUENCE_RECORD_SIZE);
+    bool fSent = SendMessage(MSG_SEQUENCEBATCH, &vBatch[0], vBatch.size());
+    vBatch.clear();
+    return fSent;
+}
@@ -8,9 +8,11 @@
 #include "amqpabstractnotifier.h"
 #include "amqpconfig.h"
 #include "amqpsender.h"
+#include "sync.h"
 
 #include <memory>
 #include <thread>
+#include <vector>
 
 class CBlockIndex;
 
@@ -53,4 +55,29 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+/** Chain tip and mempool changes as the hash and a label, see CZMQPublishSequenceNotifier */
+class AMQPPublishSequenceNotifier : public AMQPAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnected(const CBlockIndex *pindex);
+    bool NotifyBlockDisconnected(const CBlockIndex *pindex);
+    bool NotifyTransactionAcceptance(const CTransaction &transaction);
+    bool NotifyTransactionRemoval(const uint256 &hash);
+
+protected:
+    CCriticalSection cs_sequence;
+
+    virtual bool SendSequence(const uint256 &hash, char label);
+};
+
+/** The sequence events coalesced per tip into one message */
+class AMQPPublishSequenceBatchNotifier : public AMQPPublishSequenceNotifier
+{
+private:
+    std::vector<unsigned char> vBatch;
+
+protected:
+    bool SendSequence(const uint256 &hash, char label);
+};
+
 #endif // ZCASH_AMQP_AMQPPUBLISHNOTIFIER_H
@@ -79,6 +79,13 @@ public:
     // Override this method to add data to the default status object.
     virtual UniValue getStatus() const;
 
+    // Operations with the same key are not run at the same time by the queue,
+    // as they would spend the same coins, and one with an empty key runs on its
+    // own. Override this method if your subclass spends from the wallet.
+    virtual std::string getInputsKey() const {
+        return id_;
+    }
+
     UniValue getError() const;
     
     UniValue getResult() const;
@@ -121,8 +128,8 @@ protected:
     // the AsyncRPCQueue, which in turn invokes cancel() on all operations.
     // The member variables below are protected rather than private in order to
     // allow subclasses of AsyncRPCOperation the ability to access and update
-    // internal state.  Currently, all operations are executed in a single-thread
-    // by a single worker.
+    // internal state.  An operation is executed by a single worker, but other
+    // operations may be running on other workers at the same time.
     mutable std::mutex lock_;   // lock on this when read/writing non-atomics
     UniValue result_;
     int error_code_;
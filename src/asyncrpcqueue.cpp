@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "asyncrpcqueue.h"
+#include "validationinterface.h"
 
 static std::atomic<size_t> workerCounter(0);
 
@@ -30,7 +31,7 @@ shared_ptr<AsyncRPCQueue> AsyncRPCQueue::sharedInstance() {
     return q;
 }
 
-AsyncRPCQueue::AsyncRPCQueue() : closed_(false), finish_(false) {
+AsyncRPCQueue::AsyncRPCQueue() : closed_(false), finish_(false), max_workers_(0), idle_workers_(0) {
 }
 
 AsyncRPCQueue::~AsyncRPCQueue() {
@@ -44,29 +45,30 @@ void AsyncRPCQueue::run(size_t workerId) {
 
     while (true) {
         AsyncRPCOperationId key;
+        std::string inputsKey;
         std::shared_ptr<AsyncRPCOperation> operation;
         {
             std::unique_lock<std::mutex> guard(lock_);
-            while (operation_id_queue_.empty() && !isClosed() && !isFinishing()) {
+            idle_workers_++;
+            while (!isClosed() && !next_operation_locked(key, inputsKey)) {
+                // Exit if the queue is empty and we are finishing up
+                if (isFinishing() && getOperationCount_locked() == 0 && executing_keys_.empty()) {
+                    break;
+                }
                 this->condition_.wait(guard);
             }
-
-            // Exit if the queue is empty and we are finishing up
-            if (isFinishing() && operation_id_queue_.empty()) {
-                break;
-            }
+            idle_workers_--;
 
             // Exit if the queue is closing.
             if (isClosed()) {
-                while (!operation_id_queue_.empty()) {
-                    operation_id_queue_.pop();
+                for (auto& q : operation_id_queue_) {
+                    q.clear();
                 }
                 break;
             }
-
-            // Get operation id
-            key = operation_id_queue_.front();
-            operation_id_queue_.pop();
+            if (key.empty()) {
+                break;
+            }
 
             // Search operation map
             AsyncRPCOperationMap::const_iterator iter = operation_map_.find(key);
@@ -81,8 +83,45 @@ void AsyncRPCQueue::run(size_t workerId) {
             // skip cancelled operation
         } else {
             operation->main();
+            if (!operation->isReady() && !operation->isExecuting()) {
+                GetMainSignals().AsyncOperationFinished(key, operation->getStatus().write());
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            executing_keys_.erase(executing_keys_.find(inputsKey));
+        }
+        // operations waiting for these inputs may start now
+        this->condition_.notify_all();
+    }
+}
+
+/**
+ * Take the next operation that may start, by priority class and then in the
+ * order they were added. An operation that has to wait for its inputs holds
+ * up the exclusive ones behind it, so those are not starved. Caller holds lock_.
+ */
+bool AsyncRPCQueue::next_operation_locked(AsyncRPCOperationId& key, std::string& inputsKey) {
+    bool fExclusiveRunning = executing_keys_.count("") > 0;
+    for (auto& q : operation_id_queue_) {
+        for (auto it = q.begin(); it != q.end(); ++it) {
+            AsyncRPCOperationMap::const_iterator iter = operation_map_.find(*it);
+            std::string opKey = iter != operation_map_.end() ? iter->second->getInputsKey() : std::string(" ");
+            if (fExclusiveRunning || (opKey.empty() && !executing_keys_.empty())) {
+                return false;
+            }
+            if (executing_keys_.count(opKey)) {
+                continue;
+            }
+            key = *it;
+            inputsKey = opKey;
+            executing_keys_.insert(opKey);
+            q.erase(it);
+            return true;
         }
     }
+    return false;
 }
 
 
@@ -96,7 +135,7 @@ void AsyncRPCQueue::run(size_t workerId) {
  *
  * Don't use std::make_shared<AsyncRPCOperation>().
  */
-void AsyncRPCQueue::addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOperation) {
+void AsyncRPCQueue::addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOperation, AsyncRPCPriority priority) {
     std::lock_guard<std::mutex> guard(lock_);
 
     // Don't add if queue is closed or finishing
@@ -106,8 +145,29 @@ void AsyncRPCQueue::addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOp
 
     AsyncRPCOperationId id = ptrOperation->getId();
     operation_map_.emplace(id, ptrOperation);
-    operation_id_queue_.push(id);
-    this->condition_.notify_one();
+    operation_id_queue_[priority].push_back(id);
+    if (idle_workers_ == 0 && workers_.size() < max_workers_) {
+        add_worker_locked();
+    }
+    // every idle worker checks, the first one may be waiting for other inputs
+    this->condition_.notify_all();
+}
+
+/**
+ * Move an operation that has not started yet to the end of another priority class.
+ */
+bool AsyncRPCQueue::setOperationPriority(AsyncRPCOperationId id, AsyncRPCPriority priority) {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (auto& q : operation_id_queue_) {
+        auto it = std::find(q.begin(), q.end(), id);
+        if (it != q.end()) {
+            q.erase(it);
+            operation_id_queue_[priority].push_back(id);
+            this->condition_.notify_all();
+            return true;
+        }
+    }
+    return false;
 }
 
 /**
@@ -183,7 +243,15 @@ void AsyncRPCQueue::cancelAllOperations() {
  */
 size_t AsyncRPCQueue::getOperationCount() const {
     std::lock_guard<std::mutex> guard(lock_);
-    return operation_id_queue_.size();
+    return getOperationCount_locked();
+}
+
+size_t AsyncRPCQueue::getOperationCount_locked() const {
+    size_t n = 0;
+    for (auto& q : operation_id_queue_) {
+        n += q.size();
+    }
+    return n;
 }
 
 /**
@@ -191,9 +259,21 @@ size_t AsyncRPCQueue::getOperationCount() const {
  */
 void AsyncRPCQueue::addWorker() {
     std::lock_guard<std::mutex> guard(lock_);
+    add_worker_locked();
+}
+
+void AsyncRPCQueue::add_worker_locked() {
     workers_.emplace_back( std::thread(&AsyncRPCQueue::run, this, ++workerCounter) );
 }
 
+/**
+ * Set how many workers addOperation() may spawn, existing workers stay
+ */
+void AsyncRPCQueue::setMaxWorkers(size_t n) {
+    std::lock_guard<std::mutex> guard(lock_);
+    max_workers_ = n;
+}
+
 /**
  * Return the number of worker threads spawned by the queue
  */
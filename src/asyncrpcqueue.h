@@ -22,10 +22,13 @@
 
 #include "asyncrpcoperation.h"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <chrono>
-#include <queue>
+#include <condition_variable>
+#include <deque>
+#include <set>
 #include <unordered_map>
 #include <vector>
 #include <future>
@@ -33,9 +36,25 @@
 #include <utility>
 #include <memory>
 
+/** -rpcasyncthreads default, 0 for one worker per core */
+static const int DEFAULT_RPC_ASYNC_THREADS = 0;
+
+/** Queued operations of a higher priority class are started first */
+enum AsyncRPCPriority {
+    ASYNC_RPC_PRIORITY_HIGH = 0,
+    ASYNC_RPC_PRIORITY_NORMAL,
+    ASYNC_RPC_PRIORITY_LOW,
+    ASYNC_RPC_PRIORITY_COUNT
+};
 
 typedef std::unordered_map<AsyncRPCOperationId, std::shared_ptr<AsyncRPCOperation> > AsyncRPCOperationMap; 
 
+/**
+ * Runs operations on worker threads that are added as operations wait, up to
+ * setMaxWorkers(), none by default. Operations with the same getInputsKey()
+ * never run at the same time, as they would select the same coins and notes,
+ * and an operation with an empty key runs on its own.
+ */
 
 class AsyncRPCQueue {
 public:
@@ -52,6 +71,7 @@ public:
 
     void addWorker();
     size_t getNumberOfWorkers() const;
+    void setMaxWorkers(size_t n);
     bool isClosed() const;
     bool isFinishing() const;
     void close(); // close queue and cancel all operations
@@ -62,13 +82,17 @@ public:
     size_t getOperationCount() const;
     std::shared_ptr<AsyncRPCOperation> getOperationForId(AsyncRPCOperationId) const;
     std::shared_ptr<AsyncRPCOperation> popOperationForId(AsyncRPCOperationId);
-    void addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOperation);
+    void addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOperation, AsyncRPCPriority priority = ASYNC_RPC_PRIORITY_NORMAL);
+    bool setOperationPriority(AsyncRPCOperationId id, AsyncRPCPriority priority); // false if the operation is not waiting
     std::vector<AsyncRPCOperationId> getAllOperationIds() const;
 
 private:
     // addWorker() will spawn a new thread on run())
     void run(size_t workerId);
     void wait_for_worker_threads();
+    void add_worker_locked();
+    bool next_operation_locked(AsyncRPCOperationId& key, std::string& inputsKey);
+    size_t getOperationCount_locked() const;
 
     // Why this is not a recursive lock: http://www.zaval.org/resources/library/butenhof1.html
     mutable std::mutex lock_;
@@ -76,8 +100,11 @@ private:
     std::atomic<bool> closed_;
     std::atomic<bool> finish_;
     AsyncRPCOperationMap operation_map_;
-    std::queue <AsyncRPCOperationId> operation_id_queue_;
+    std::deque<AsyncRPCOperationId> operation_id_queue_[ASYNC_RPC_PRIORITY_COUNT];
     std::vector<std::thread> workers_;
+    size_t max_workers_;
+    size_t idle_workers_;
+    std::multiset<std::string> executing_keys_; // getInputsKey() of the running operations
 };
 
 #endif
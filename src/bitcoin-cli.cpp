@@ -39,6 +39,8 @@ char ASSETCHAINS_SYMBOL[65];
 using namespace std;
 
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT=900;
+static const int DEFAULT_PIPELINE_BATCH=1;
+static const int MAX_PIPELINE_BATCH=1000;
 static const int CONTINUE_EXECUTION=-1;
 
 std::string HelpMessageCli()
@@ -58,6 +60,10 @@ std::string HelpMessageCli()
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcclienttimeout=<n>", strprintf(_("Timeout in seconds during HTTP requests, or 0 for no timeout. (default: %d)"), DEFAULT_HTTP_CLIENT_TIMEOUT));
     strUsage += HelpMessageOpt("-stdin", _("Read extra arguments from standard input, one per line until EOF/Ctrl-D (recommended for sensitive information such as passphrases)"));
+    strUsage += HelpMessageOpt("-pipeline", _("Read commands from standard input, one per line with shell style quoting, send them over a single connection "
+        "and print every JSON-RPC reply on a line of its own, its id being the line number of the command"));
+    strUsage += HelpMessageOpt("-pipelinebatch=<n>", strprintf(_("With -pipeline, send up to <n> commands per JSON-RPC batch, a batch goes out once full or at EOF (default: %d, maximum: %d)"),
+        DEFAULT_PIPELINE_BATCH, MAX_PIPELINE_BATCH));
 
     return strUsage;
 }
@@ -105,6 +111,7 @@ static int AppInitRPC(int argc, char* argv[])
         if (!mapArgs.count("-version")) {
             strUsage += "\n" + _("Usage:") + "\n" +
                   "  safecoin-cli [options] <command> [params]  " + _("Send command to Safecoin") + "\n" +
+                  "  safecoin-cli [options] -pipeline < file    " + _("Send the commands of file, one per line") + "\n" +
                   "  safecoin-cli [options] help                " + _("List commands") + "\n" +
                   "  safecoin-cli [options] help <command>      " + _("Get help for a command") + "\n";
 
@@ -147,11 +154,13 @@ static int AppInitRPC(int argc, char* argv[])
 /** Reply structure for request_done to fill in */
 struct HTTPReply
 {
-    HTTPReply(): status(0), error(-1) {}
+    HTTPReply(): status(0), error(-1), base(NULL) {}
 
     int status;
     int error;
     std::string body;
+    //! set on a kept alive connection, whose idle socket would keep the event loop running
+    struct event_base *base;
 };
 
 const char *http_errorstring(int code)
@@ -180,6 +189,9 @@ static void http_request_done(struct evhttp_request *req, void *ctx)
 {
     HTTPReply *reply = static_cast<HTTPReply*>(ctx);
 
+    if (reply->base)
+        event_base_loopbreak(reply->base);
+
     if (req == NULL) {
         /* If req is NULL, it means an error occurred while connecting: the
          * error code will have been passed to http_error_cb.
@@ -209,74 +221,105 @@ static void http_error_cb(enum evhttp_request_error err, void *ctx)
 }
 #endif
 
-UniValue CallRPC(const std::string& strMethod, const UniValue& params)
+/**
+ * A connection to the RPC server. With fKeepAlive it is reused for every request sent through it,
+ * otherwise the server closes it after the first reply.
+ */
+class CRPCConnection
 {
-    std::string host = GetArg("-rpcconnect", "127.0.0.1");
-    int port = GetArg("-rpcport", BaseParams().RPCPort());
-    BITCOIND_RPCPORT = port;
-    // Obtain event base
-    raii_event_base base = obtain_event_base();
-
-    // Synchronously look up hostname
-    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), host, port);
-    evhttp_connection_set_timeout(evcon.get(), GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
-
-    HTTPReply response;
-    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
-    if (req == NULL)
-        throw std::runtime_error("create http request failed");
-#if LIBEVENT_VERSION_NUMBER >= 0x02010300
-    evhttp_request_set_error_cb(req.get(), http_error_cb);
-#endif
-
-    // Get credentials
+private:
+    std::string host;
+    int port;
+    bool fKeepAlive;
     std::string strRPCUserColonPass;
-    if (mapArgs["-rpcpassword"] == "") {
-        // Try fall back to cookie-based authentication if no password is provided
-        if (!GetAuthCookie(&strRPCUserColonPass)) {
-            throw std::runtime_error(strprintf(
-                _("Could not locate RPC credentials. No authentication cookie could be found,\n"
-                  "and no rpcpassword is set in the configuration file (%s)."),
-                    GetConfigFile().string().c_str()));
+    raii_event_base base;
+    raii_evhttp_connection evcon;
 
+public:
+    explicit CRPCConnection(bool fKeepAliveIn) : fKeepAlive(fKeepAliveIn)
+    {
+        host = GetArg("-rpcconnect", "127.0.0.1");
+        port = GetArg("-rpcport", BaseParams().RPCPort());
+        BITCOIND_RPCPORT = port;
+        // Obtain event base
+        base = obtain_event_base();
+
+        // Synchronously look up hostname
+        evcon = obtain_evhttp_connection_base(base.get(), host, port);
+        evhttp_connection_set_timeout(evcon.get(), GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
+
+        // Get credentials
+        if (mapArgs["-rpcpassword"] == "") {
+            // Try fall back to cookie-based authentication if no password is provided
+            if (!GetAuthCookie(&strRPCUserColonPass)) {
+                throw std::runtime_error(strprintf(
+                    _("Could not locate RPC credentials. No authentication cookie could be found,\n"
+                      "and no rpcpassword is set in the configuration file (%s)."),
+                        GetConfigFile().string().c_str()));
+
+            }
+        } else {
+            strRPCUserColonPass = mapArgs["-rpcuser"] + ":" + mapArgs["-rpcpassword"];
         }
-    } else {
-        strRPCUserColonPass = mapArgs["-rpcuser"] + ":" + mapArgs["-rpcpassword"];
     }
 
-    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
-    assert(output_headers);
-    evhttp_add_header(output_headers, "Host", host.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
-    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
-
-    // Attach request data
-    std::string strRequest = JSONRPCRequest(strMethod, params, 1);
-    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
-    assert(output_buffer);
-    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
-
-    int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, "/");
-    req.release(); // ownership moved to evcon in above call
-    if (r != 0) {
-        throw CConnectionFailed("send http request failed");
+    /** Send a request, or a batch of them, and return the parsed reply */
+    UniValue Send(const std::string& strRequest)
+    {
+        HTTPReply response;
+        if (fKeepAlive) {
+            response.base = base.get();
+            // let libevent notice a server that closed the idle connection, it reconnects on the next request
+            event_base_loop(base.get(), EVLOOP_NONBLOCK);
+        }
+        raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
+        if (req == NULL)
+            throw std::runtime_error("create http request failed");
+#if LIBEVENT_VERSION_NUMBER >= 0x02010300
+        evhttp_request_set_error_cb(req.get(), http_error_cb);
+#endif
+
+        struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
+        assert(output_headers);
+        evhttp_add_header(output_headers, "Host", host.c_str());
+        if (!fKeepAlive)
+            evhttp_add_header(output_headers, "Connection", "close");
+        evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
+
+        // Attach request data
+        struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
+        assert(output_buffer);
+        evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
+
+        int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, "/");
+        req.release(); // ownership moved to evcon in above call
+        if (r != 0) {
+            throw CConnectionFailed("send http request failed");
+        }
+
+        event_base_dispatch(base.get());
+
+        if (response.status == 0)
+            throw CConnectionFailed(strprintf("couldn't connect to server: %s (code %d)\n(make sure server is running and you are connecting to the correct RPC port)", http_errorstring(response.error), response.error));
+        else if (response.status == HTTP_UNAUTHORIZED)
+            throw std::runtime_error("incorrect rpcuser or rpcpassword (authorization failed)");
+        else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
+            throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
+        else if (response.body.empty())
+            throw std::runtime_error("no response from server");
+
+        // Parse reply
+        UniValue valReply(UniValue::VSTR);
+        if (!valReply.read(response.body))
+            throw std::runtime_error("couldn't parse reply from server");
+        return valReply;
     }
+};
 
-    event_base_dispatch(base.get());
-
-    if (response.status == 0)
-        throw CConnectionFailed(strprintf("couldn't connect to server: %s (code %d)\n(make sure server is running and you are connecting to the correct RPC port)", http_errorstring(response.error), response.error));
-    else if (response.status == HTTP_UNAUTHORIZED)
-        throw std::runtime_error("incorrect rpcuser or rpcpassword (authorization failed)");
-    else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
-        throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
-    else if (response.body.empty())
-        throw std::runtime_error("no response from server");
-
-    // Parse reply
-    UniValue valReply(UniValue::VSTR);
-    if (!valReply.read(response.body))
-        throw std::runtime_error("couldn't parse reply from server");
+UniValue CallRPC(const std::string& strMethod, const UniValue& params)
+{
+    CRPCConnection connection(false);
+    UniValue valReply = connection.Send(JSONRPCRequest(strMethod, params, 1));
     const UniValue& reply = valReply.get_obj();
     if (reply.empty())
         throw std::runtime_error("expected reply to have result, error and id properties");
@@ -284,6 +327,156 @@ UniValue CallRPC(const std::string& strMethod, const UniValue& params)
     return reply;
 }
 
+/**
+ * Split a -pipeline line into its arguments. Blanks separate them, single quotes keep everything up to
+ * the next one as it is, within double quotes a backslash escapes the next character. False on an
+ * unterminated quote.
+ */
+static bool SplitPipelineLine(const std::string& line, std::vector<std::string>& args)
+{
+    std::string arg;
+    bool fInArg = false;
+    char chQuote = 0;
+    for (size_t i = 0; i < line.size(); i++) {
+        char ch = line[i];
+        if (chQuote == '\'') {
+            if (ch == '\'')
+                chQuote = 0;
+            else
+                arg += ch;
+        } else if (chQuote == '"') {
+            if (ch == '"')
+                chQuote = 0;
+            else if (ch == '\\' && i + 1 < line.size())
+                arg += line[++i];
+            else
+                arg += ch;
+        } else if (ch == '\'' || ch == '"') {
+            chQuote = ch;
+            fInArg = true;
+        } else if (ch == ' ' || ch == '\t' || ch == '\r') {
+            if (fInArg)
+                args.push_back(arg);
+            arg.clear();
+            fInArg = false;
+        } else {
+            arg += ch;
+            fInArg = true;
+        }
+    }
+    if (chQuote != 0)
+        return false;
+    if (fInArg)
+        args.push_back(arg);
+    return true;
+}
+
+/** A command read by -pipeline, either a request for the server or an error found before sending it */
+struct PipelineCommand
+{
+    int64_t nId;
+    std::string strRequest;
+    UniValue reply;
+};
+
+/** Send the queued commands, as one batch when there is more than one, and print a reply line for each */
+static bool SendPipelineCommands(CRPCConnection& connection, std::vector<PipelineCommand>& vCommands)
+{
+    std::string strBatch;
+    size_t nRequests = 0;
+    for (size_t i = 0; i < vCommands.size(); i++) {
+        if (vCommands[i].strRequest.empty())
+            continue;
+        strBatch += (nRequests++ == 0 ? "[" : ",") + vCommands[i].strRequest;
+    }
+
+    if (nRequests > 0) {
+        const bool fWait = GetBoolArg("-rpcwait", false);
+        UniValue valReply;
+        do {
+            try {
+                valReply = connection.Send(nRequests == 1 ? strBatch.substr(1) : strBatch + "]");
+                break;
+            }
+            catch (const CConnectionFailed&) {
+                if (fWait)
+                    MilliSleep(1000);
+                else
+                    throw;
+            }
+        } while (fWait);
+
+        std::map<int64_t, UniValue> mapReplies;
+        if (valReply.isArray()) {
+            for (size_t i = 0; i < valReply.size(); i++)
+                if (valReply[i].isObject() && find_value(valReply[i], "id").isNum())
+                    mapReplies[find_value(valReply[i], "id").get_int64()] = valReply[i];
+        }
+        for (size_t i = 0; i < vCommands.size(); i++) {
+            if (vCommands[i].strRequest.empty())
+                continue;
+            if (valReply.isObject()) {
+                // a single request, or a batch the server refused as a whole
+                vCommands[i].reply = valReply;
+                vCommands[i].reply.pushKV("id", vCommands[i].nId);
+            } else if (mapReplies.count(vCommands[i].nId)) {
+                vCommands[i].reply = mapReplies[vCommands[i].nId];
+            } else {
+                vCommands[i].reply = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_MISC_ERROR, "no reply from server"), vCommands[i].nId);
+            }
+        }
+    }
+
+    bool fSuccess = true;
+    for (size_t i = 0; i < vCommands.size(); i++) {
+        if (!find_value(vCommands[i].reply, "error").isNull())
+            fSuccess = false;
+        fprintf(stdout, "%s\n", vCommands[i].reply.write().c_str());
+    }
+    fflush(stdout);
+    vCommands.clear();
+    return fSuccess;
+}
+
+/**
+ * Run the commands of standard input over one kept alive connection, so a script pays for process
+ * start, connection and authentication once instead of once per command.
+ */
+static int PipelineRPC()
+{
+    const int nBatch = std::max(1, std::min((int)GetArg("-pipelinebatch", DEFAULT_PIPELINE_BATCH), MAX_PIPELINE_BATCH));
+    CRPCConnection connection(true);
+    std::vector<PipelineCommand> vCommands;
+    int nRet = 0;
+    int64_t nLine = 0;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        nLine++;
+        std::vector<std::string> args;
+        PipelineCommand command;
+        command.nId = nLine;
+        if (!SplitPipelineLine(line, args)) {
+            command.reply = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_PARSE_ERROR, "unterminated quote"), nLine);
+        } else if (args.empty() || args[0][0] == '#') {
+            // blank lines and comments keep their line number but get no reply
+            continue;
+        } else {
+            try {
+                UniValue params = RPCConvertValues(args[0], std::vector<std::string>(args.begin()+1, args.end()));
+                command.strRequest = JSONRPCRequest(args[0], params, nLine);
+            } catch (const std::exception& e) {
+                command.reply = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_PARSE_ERROR, e.what()), nLine);
+            }
+        }
+        vCommands.push_back(command);
+        if ((int)vCommands.size() >= nBatch && !SendPipelineCommands(connection, vCommands))
+            nRet = EXIT_FAILURE;
+    }
+    if (!vCommands.empty() && !SendPipelineCommands(connection, vCommands))
+        nRet = EXIT_FAILURE;
+    return nRet;
+}
+
 int CommandLineRPC(int argc, char *argv[])
 {
     std::string strPrint;
@@ -295,6 +488,11 @@ int CommandLineRPC(int argc, char *argv[])
             argv++;
         }
         std::vector<std::string> args = std::vector<std::string>(&argv[1], &argv[argc]);
+        if (GetBoolArg("-pipeline", false)) {
+            if (!args.empty() || GetBoolArg("-stdin", false))
+                throw std::runtime_error("-pipeline reads all of its commands from standard input");
+            return PipelineRPC();
+        }
         if (GetBoolArg("-stdin", false)) {
             // Read one arg per line from stdin and append
             std::string line;
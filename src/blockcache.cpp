@@ -0,0 +1,66 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+CBlockCache blockReadCache(DEFAULT_BLOCK_READ_CACHE << 20);
+
+// caller holds cs
+void CBlockCache::Trim()
+{
+    while (nBytes > nMaxBytes && !listBlocks.empty()) {
+        std::map<uint256, std::pair<BlockList::iterator, size_t> >::iterator it = mapBlocks.find(listBlocks.back().first);
+        nBytes -= it->second.second;
+        mapBlocks.erase(it);
+        listBlocks.pop_back();
+    }
+}
+
+CBlockRef CBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    std::map<uint256, std::pair<BlockList::iterator, size_t> >::iterator it = mapBlocks.find(hash);
+    if (it == mapBlocks.end())
+        return CBlockRef();
+    listBlocks.splice(listBlocks.begin(), listBlocks, it->second.first);
+    return it->second.first->second;
+}
+
+void CBlockCache::Insert(const uint256& hash, const CBlockRef& pblock, size_t nSize)
+{
+    LOCK(cs);
+    if (nSize > nMaxBytes || mapBlocks.count(hash))
+        return;
+    listBlocks.push_front(std::make_pair(hash, pblock));
+    mapBlocks[hash] = std::make_pair(listBlocks.begin(), nSize);
+    nBytes += nSize;
+    Trim();
+}
+
+void CBlockCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+void CBlockCache::Clear()
+{
+    LOCK(cs);
+    listBlocks.clear();
+    mapBlocks.clear();
+    nBytes = 0;
+}
+
+size_t CBlockCache::Size() const
+{
+    LOCK(cs);
+    return mapBlocks.size();
+}
+
+size_t CBlockCache::Bytes() const
+{
+    LOCK(cs);
+    return nBytes;
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_BLOCKCACHE_H
+#define SAFECOIN_BLOCKCACHE_H
+
+#include "primitives/block.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+
+/** -blockreadcache default (MiB) */
+static const unsigned int DEFAULT_BLOCK_READ_CACHE = 32;
+
+typedef std::shared_ptr<const CBlock> CBlockRef;
+
+/**
+ * Blocks recently read from disk, least recently used dropped first once
+ * their serialized size passes the limit. Block data never changes for a
+ * given hash, so entries stay valid until they are evicted.
+ */
+class CBlockCache
+{
+private:
+    typedef std::list<std::pair<uint256, CBlockRef> > BlockList;
+
+    mutable CCriticalSection cs;
+    //! most recently used first
+    BlockList listBlocks;
+    std::map<uint256, std::pair<BlockList::iterator, size_t> > mapBlocks;
+    size_t nBytes;
+    size_t nMaxBytes;
+
+    void Trim();
+
+public:
+    explicit CBlockCache(size_t nMaxBytesIn) : nBytes(0), nMaxBytes(nMaxBytesIn) {}
+
+    /** The cached block with this hash, NULL if there is none */
+    CBlockRef Get(const uint256& hash);
+    /** Cache pblock under hash, taking nSize bytes of the budget */
+    void Insert(const uint256& hash, const CBlockRef& pblock, size_t nSize);
+    void SetMaxBytes(size_t nMaxBytesIn);
+    void Clear();
+
+    size_t Size() const;
+    size_t Bytes() const;
+};
+
+/** Cache consulted by ReadBlockFromDisk(CBlock&, const CBlockIndex*, bool) */
+extern CBlockCache blockReadCache;
+
+#endif // SAFECOIN_BLOCKCACHE_H
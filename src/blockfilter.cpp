@@ -0,0 +1,248 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+
+namespace
+{
+/** Writes bits most significant first */
+class BitWriter
+{
+private:
+    std::vector<unsigned char>& data;
+    unsigned char buffer;
+    int nBits;
+
+public:
+    BitWriter(std::vector<unsigned char>& dataIn) : data(dataIn), buffer(0), nBits(0) {}
+
+    void Write(uint64_t value, int nCount)
+    {
+        while (nCount > 0) {
+            int nNow = std::min(8 - nBits, nCount);
+            buffer |= (unsigned char)(((value >> (nCount - nNow)) & ((1U << nNow) - 1)) << (8 - nBits - nNow));
+            nBits += nNow;
+            nCount -= nNow;
+            if (nBits == 8)
+                Flush();
+        }
+    }
+
+    void Flush()
+    {
+        if (nBits == 0)
+            return;
+        data.push_back(buffer);
+        buffer = 0;
+        nBits = 0;
+    }
+};
+
+/** Reads what BitWriter wrote, throws std::ios_base::failure past the end */
+class BitReader
+{
+private:
+    const std::vector<unsigned char>& data;
+    size_t nPos;
+    int nBits;
+
+public:
+    BitReader(const std::vector<unsigned char>& dataIn, size_t nPosIn) : data(dataIn), nPos(nPosIn), nBits(0) {}
+
+    uint64_t Read(int nCount)
+    {
+        uint64_t value = 0;
+        while (nCount > 0) {
+            if (nPos >= data.size())
+                throw std::ios_base::failure("end of filter data");
+            int nNow = std::min(8 - nBits, nCount);
+            value = (value << nNow) | ((data[nPos] >> (8 - nBits - nNow)) & ((1U << nNow) - 1));
+            nBits += nNow;
+            nCount -= nNow;
+            if (nBits == 8) {
+                nPos++;
+                nBits = 0;
+            }
+        }
+        return value;
+    }
+};
+
+void GolombRiceEncode(BitWriter& writer, int P, uint64_t value)
+{
+    // the quotient in unary, ones ended by a zero, then the P low bits
+    uint64_t q = value >> P;
+    while (q > 0) {
+        int nBits = (int)std::min<uint64_t>(q, 64);
+        writer.Write(~(uint64_t)0, nBits);
+        q -= nBits;
+    }
+    writer.Write(0, 1);
+    writer.Write(value, P);
+}
+
+uint64_t GolombRiceDecode(BitReader& reader, int P)
+{
+    uint64_t q = 0;
+    while (reader.Read(1) == 1)
+        q++;
+    return (q << P) + reader.Read(P);
+}
+
+/** (x * n) >> 64, maps a uniform 64 bit hash onto [0, n) without a division */
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * n) >> 64);
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    uint64_t ac = x_hi * n_hi, ad = x_hi * n_lo, bc = x_lo * n_hi, bd = x_lo * n_lo;
+    uint64_t mid34 = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    return ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+#endif
+}
+
+GCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockundo)
+{
+    GCSFilter::ElementSet elements;
+    CScript ccSubScript;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        for (size_t j = 0; j < block.vtx[i].vout.size(); j++) {
+            const CScript& script = block.vtx[i].vout[j].scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            elements.insert(GCSFilter::Element(script.begin(), script.end()));
+            if (script.IsPayToCryptoCondition(&ccSubScript) && ccSubScript.size() != script.size())
+                elements.insert(GCSFilter::Element(ccSubScript.begin(), ccSubScript.end()));
+        }
+    }
+    for (size_t i = 0; i < blockundo.vtxundo.size(); i++) {
+        for (size_t j = 0; j < blockundo.vtxundo[i].vprevout.size(); j++) {
+            const CScript& script = blockundo.vtxundo[i].vprevout[j].txout.scriptPubKey;
+            if (script.empty())
+                continue;
+            elements.insert(GCSFilter::Element(script.begin(), script.end()));
+        }
+    }
+    return elements;
+}
+} // namespace
+
+GCSFilter::GCSFilter(uint64_t k0In, uint64_t k1In) : k0(k0In), k1(k1In), N(0), F(0)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, 0);
+    encoded.assign(ss.begin(), ss.end());
+}
+
+GCSFilter::GCSFilter(uint64_t k0In, uint64_t k1In, const std::vector<unsigned char>& encodedIn) : k0(k0In), k1(k1In), encoded(encodedIn)
+{
+    CDataStream ss((const char*)encoded.data(), (const char*)encoded.data() + encoded.size(), SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t nElements = ReadCompactSize(ss);
+    if (nElements > 0xFFFFFFFF)
+        throw std::ios_base::failure("filter element count out of range");
+    N = (uint32_t)nElements;
+    F = (uint64_t)N * M;
+}
+
+GCSFilter::GCSFilter(uint64_t k0In, uint64_t k1In, const ElementSet& elements) : k0(k0In), k1(k1In)
+{
+    N = (uint32_t)elements.size();
+    F = (uint64_t)N * M;
+
+    std::vector<uint64_t> hashes;
+    hashes.reserve(elements.size());
+    for (ElementSet::const_iterator it = elements.begin(); it != elements.end(); it++)
+        hashes.push_back(HashToRange(*it));
+    std::sort(hashes.begin(), hashes.end());
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, N);
+    encoded.assign(ss.begin(), ss.end());
+    BitWriter writer(encoded);
+    uint64_t last = 0;
+    for (size_t i = 0; i < hashes.size(); i++) {
+        GolombRiceEncode(writer, P, hashes[i] - last);
+        last = hashes[i];
+    }
+    writer.Flush();
+}
+
+uint64_t GCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t hash = CSipHasher(k0, k1).Write(element.data(), element.size()).Finalize();
+    return MapIntoRange(hash, F);
+}
+
+bool GCSFilter::MatchSorted(const std::vector<uint64_t>& queries) const
+{
+    if (N == 0 || queries.empty())
+        return false;
+    // skip the element count, the coded deltas follow
+    CDataStream ss((const char*)encoded.data(), (const char*)encoded.data() + encoded.size(), SER_NETWORK, PROTOCOL_VERSION);
+    ReadCompactSize(ss);
+    BitReader reader(encoded, encoded.size() - ss.size());
+
+    uint64_t value = 0;
+    size_t q = 0;
+    for (uint32_t i = 0; i < N; i++) {
+        value += GolombRiceDecode(reader, P);
+        while (queries[q] < value) {
+            if (++q == queries.size())
+                return false;
+        }
+        if (queries[q] == value)
+            return true;
+    }
+    return false;
+}
+
+bool GCSFilter::Match(const Element& element) const
+{
+    return MatchSorted(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool GCSFilter::MatchAny(const ElementSet& elements) const
+{
+    std::vector<uint64_t> queries;
+    queries.reserve(elements.size());
+    for (ElementSet::const_iterator it = elements.begin(); it != elements.end(); it++)
+        queries.push_back(HashToRange(*it));
+    std::sort(queries.begin(), queries.end());
+    return MatchSorted(queries);
+}
+
+BlockFilter::BlockFilter(const CBlock& block, const CBlockUndo& blockundo) : filterType(BLOCK_FILTER_BASIC), blockHash(block.GetHash())
+{
+    filter = GCSFilter(ReadLE64(blockHash.begin()), ReadLE64(blockHash.begin() + 8), BasicFilterElements(block, blockundo));
+}
+
+BlockFilter::BlockFilter(uint8_t filterTypeIn, const uint256& blockHashIn, const std::vector<unsigned char>& encoded) :
+    filterType(filterTypeIn), blockHash(blockHashIn),
+    filter(ReadLE64(blockHashIn.begin()), ReadLE64(blockHashIn.begin() + 8), encoded)
+{
+}
+
+uint256 BlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& encoded = GetEncodedFilter();
+    return Hash(encoded.begin(), encoded.end());
+}
+
+uint256 BlockFilter::ComputeHeader(const uint256& prevHeader) const
+{
+    uint256 filterHash = GetHash();
+    return Hash(filterHash.begin(), filterHash.end(), prevHeader.begin(), prevHeader.end());
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_BLOCKFILTER_H
+#define SAFECOIN_BLOCKFILTER_H
+
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * Golomb-coded set (BIP158), a compact probabilistic set of byte strings. The
+ * elements are hashed into [0, N * M) with SipHash, sorted, and stored as the
+ * Golomb-Rice coded differences between them. A lookup never misses an element
+ * and has a false positive rate of 1 / M.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    //! Golomb-Rice parameter and inverse false positive rate of the basic filter
+    static const int P = 19;
+    static const uint64_t M = 784931;
+
+private:
+    uint64_t k0, k1;
+    uint32_t N;
+    uint64_t F;
+    std::vector<unsigned char> encoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    bool MatchSorted(const std::vector<uint64_t>& queries) const;
+
+public:
+    GCSFilter(uint64_t k0In = 0, uint64_t k1In = 0);
+    /** Decode the element count of a received filter, throws std::ios_base::failure when it is malformed */
+    GCSFilter(uint64_t k0In, uint64_t k1In, const std::vector<unsigned char>& encodedIn);
+    GCSFilter(uint64_t k0In, uint64_t k1In, const ElementSet& elements);
+
+    uint32_t GetN() const { return N; }
+    const std::vector<unsigned char>& GetEncoded() const { return encoded; }
+
+    bool Match(const Element& element) const;
+    /** Whether any of the elements is in the set, one pass over the filter for all of them */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+enum BlockFilterType
+{
+    BLOCK_FILTER_BASIC = 0,
+};
+
+/**
+ * The basic filter of a block: every output script except OP_RETURN ones, and every
+ * script the block spends, taken from its undo data. A CC output with parameters
+ * also adds its condition script, the part its CC address is derived from, so a
+ * light client can look for a CC address without knowing the parameters.
+ * The filter is keyed with the first 16 bytes of the block hash.
+ */
+class BlockFilter
+{
+private:
+    uint8_t filterType;
+    uint256 blockHash;
+    GCSFilter filter;
+
+public:
+    BlockFilter() : filterType(BLOCK_FILTER_BASIC) {}
+    BlockFilter(const CBlock& block, const CBlockUndo& blockundo);
+    BlockFilter(uint8_t filterTypeIn, const uint256& blockHashIn, const std::vector<unsigned char>& encoded);
+
+    uint8_t GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return blockHash; }
+    const GCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    /** Double SHA256 of the encoded filter */
+    uint256 GetHash() const;
+    /** The filter header, committing to this filter and every one before it */
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+};
+
+#endif // SAFECOIN_BLOCKFILTER_H
@@ -0,0 +1,116 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilterdb.h"
+
+#include "main.h"
+#include "undo.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+CBlockFilterDB *pblockfilterdb = NULL;
+
+static const char DB_BLOCK_FILTER = 'f';
+static const char DB_BUILT_HEIGHT = 'H';
+
+CBlockFilterDB::CBlockFilterDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "filters", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CBlockFilterDB::WriteFilter(const BlockFilter& filter, const uint256& header)
+{
+    CBlockFilterEntry entry;
+    entry.filter = filter.GetEncodedFilter();
+    entry.hash = filter.GetHash();
+    entry.header = header;
+    return Write(std::make_pair(DB_BLOCK_FILTER, filter.GetBlockHash()), entry);
+}
+
+bool CBlockFilterDB::ReadFilter(const uint256& blockHash, CBlockFilterEntry& entry) const
+{
+    return Read(std::make_pair(DB_BLOCK_FILTER, blockHash), entry);
+}
+
+bool CBlockFilterDB::HasFilter(const uint256& blockHash) const
+{
+    return Exists(std::make_pair(DB_BLOCK_FILTER, blockHash));
+}
+
+bool CBlockFilterDB::WriteBuiltHeight(int nHeight)
+{
+    return Write(DB_BUILT_HEIGHT, nHeight);
+}
+
+bool CBlockFilterDB::ReadBuiltHeight(int& nHeight) const
+{
+    return Read(DB_BUILT_HEIGHT, nHeight);
+}
+
+bool ConnectBlockFilter(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    uint256 prevHeader;
+    if (pindex->pprev != NULL) {
+        CBlockFilterEntry prev;
+        if (!pblockfilterdb->ReadFilter(pindex->pprev->GetBlockHash(), prev))
+            return true;
+        prevHeader = prev.header;
+    }
+    BlockFilter filter(block, blockundo);
+    return pblockfilterdb->WriteFilter(filter, filter.ComputeHeader(prevHeader));
+}
+
+static void ThreadBlockFilterBuilder()
+{
+    while (fImporting || fReindex)
+        MilliSleep(1000);
+
+    int nHeight = 0;
+    pblockfilterdb->ReadBuiltHeight(nHeight);
+    LogPrintf("%s: building block filters from height %d\n", __func__, nHeight);
+
+    int64_t nLastLog = GetTime();
+    while (true) {
+        boost::this_thread::interruption_point();
+        CBlock block;
+        CBlockUndo blockundo;
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            if (nHeight > chainActive.Height())
+                break;
+            pindex = chainActive[nHeight];
+            if (pblockfilterdb->HasFilter(pindex->GetBlockHash())) {
+                nHeight++;
+                continue;
+            }
+            // with cs_main held the parent's filter, written one round ago, is still in place
+            if (!ReadBlockFromDisk(block, pindex, false) || (pindex->pprev != NULL && !ReadBlockUndoFromDisk(blockundo, pindex))) {
+                LogPrintf("%s: cannot read block %d, block filters stop there until -reindex\n", __func__, nHeight);
+                return;
+            }
+            if (!ConnectBlockFilter(block, blockundo, pindex)) {
+                LogPrintf("%s: failed to write the filter of block %d\n", __func__, nHeight);
+                return;
+            }
+        }
+        if (nHeight % 1000 == 0)
+            pblockfilterdb->WriteBuiltHeight(nHeight);
+        if (GetTime() > nLastLog + 60) {
+            LogPrintf("%s: block filters built up to height %d\n", __func__, nHeight);
+            nLastLog = GetTime();
+        }
+        nHeight++;
+    }
+    pblockfilterdb->WriteBuiltHeight(nHeight - 1);
+    LogPrintf("%s: block filters complete at height %d\n", __func__, nHeight - 1);
+}
+
+void StartBlockFilterBuilder(boost::thread_group& threadGroup)
+{
+    if (pblockfilterdb == NULL)
+        return;
+    threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "filterbuild", boost::function<void()>(&ThreadBlockFilterBuilder)));
+}
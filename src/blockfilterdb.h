@@ -0,0 +1,73 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_BLOCKFILTERDB_H
+#define SAFECOIN_BLOCKFILTERDB_H
+
+#include "blockfilter.h"
+#include "dbwrapper.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+namespace boost {
+    class thread_group;
+} // namespace boost
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+/** Most filters a getcfilters may ask for, as in BIP157 */
+static const int MAX_GETCFILTERS_SIZE = 1000;
+/** Most filter hashes a getcfheaders may ask for */
+static const int MAX_GETCFHEADERS_SIZE = 2000;
+/** Spacing of the filter headers in a cfcheckpt */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/** A block's basic filter with its hash and header */
+struct CBlockFilterEntry
+{
+    std::vector<unsigned char> filter;
+    uint256 hash;
+    uint256 header;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(filter);
+        READWRITE(hash);
+        READWRITE(header);
+    }
+};
+
+/**
+ * Compact block filters (BIP158) of every block, by block hash, so blocks that
+ * leave the active chain keep theirs. A block only gets an entry once its parent
+ * has one, the header of a filter commits to all the filters before it.
+ */
+class CBlockFilterDB : public CDBWrapper
+{
+public:
+    CBlockFilterDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    bool WriteFilter(const BlockFilter& filter, const uint256& header);
+    bool ReadFilter(const uint256& blockHash, CBlockFilterEntry& entry) const;
+    bool HasFilter(const uint256& blockHash) const;
+    /** Active chain height the builder has indexed every block up to */
+    bool WriteBuiltHeight(int nHeight);
+    bool ReadBuiltHeight(int& nHeight) const;
+};
+
+extern CBlockFilterDB *pblockfilterdb;
+
+/** Index the filter of a connected block, skipped while its parent has no filter yet */
+bool ConnectBlockFilter(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+/** Index the blocks of the active chain that have no filter yet on a thread of its own, ConnectBlock does the rest */
+void StartBlockFilterBuilder(boost::thread_group& threadGroup);
+
+#endif // SAFECOIN_BLOCKFILTERDB_H
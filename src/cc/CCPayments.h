@@ -25,6 +25,8 @@
 #define PAYMENTS_MERGEOFSET 60 // 1H extra. 
 extern std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 extern int32_t lastSnapShotHeight;
+extern int32_t numSnapShots;
+bool safecoin_dailysnapshot_publish(bool fWait);
 
 bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
 
@@ -16,8 +16,18 @@
 #include "CCassets.h"
 #include "CCtokens.h"
 
+static UniValue AssetOrdersImpl(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode);
+
+// Orders are unspent outputs on the assets addresses, looked up with the mempool included
+static CCQueryCache assetsQueries;
 
 UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
+{
+    std::string key = refassetid.GetHex() + HexStr(pk) + strprintf(",%d", additionalEvalCode);
+    return assetsQueries.Get(key, [&]() { return AssetOrdersImpl(refassetid, pk, additionalEvalCode); });
+}
+
+static UniValue AssetOrdersImpl(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
 {
 	UniValue result(UniValue::VARR);  
 
@@ -347,6 +347,7 @@ uint256 OraclesBatontxid(uint256 oracletxid,CPubKey pk);
 uint8_t DecodeOraclesCreateOpRet(const CScript &scriptPubKey,std::string &name,std::string &description,std::string &format);
 uint8_t DecodeOraclesOpRet(const CScript &scriptPubKey,uint256 &oracletxid,CPubKey &pk,int64_t &num);
 uint8_t DecodeOraclesData(const CScript &scriptPubKey,uint256 &oracletxid,uint256 &batontxid,CPubKey &pk,std::vector <uint8_t>&data);
+uint8_t DecodeOraclesDataTx(uint256 txid,uint256 &oracletxid,uint256 &batontxid,CPubKey &pk,std::vector <uint8_t>&data,bool &marker);
 int32_t oracle_format(uint256 *hashp,int64_t *valp,char *str,uint8_t fmt,uint8_t *data,int32_t offset,int32_t datalen);
 /// \endcond
 
@@ -536,6 +537,14 @@ CC *MakeCCcond1(uint8_t evalcode,CPubKey pk);
 /// @returns cryptocondition object. Must be disposed with cc_free function when not used any more
 CC *MakeCCcond1of2(uint8_t evalcode,CPubKey pk1,CPubKey pk2);
 
+/// CCcondScript returns the scriptPubKey and address of the 1of1 (pk2 empty) or 1of2 cc made for the eval codes and pubkeys.
+/// Results are memoized, repeated calls for the same inputs do not rebuild the cryptocondition
+/// @param[out] scriptPubKey cc scriptPubKey
+/// @param[out] destaddr address of scriptPubKey, may be null. Should have at least 64 char buffer space
+/// @param fTokens make a token cc like MakeTokensCCcond1 or MakeTokensCCcond1of2 do, evalcode2 is ignored otherwise
+/// @returns true if the address could be made
+bool CCcondScript(CScript &scriptPubKey,char *destaddr,bool fTokens,uint8_t evalcode,uint8_t evalcode2,CPubKey pk1,CPubKey pk2);
+
 /// GetCryptoCondition retrieves the cryptocondition from a scriptSig object 
 /// @param scriptSig scriptSig object with a cryptocondition
 /// @returns cc object, must be disposed with cc_free when not used
@@ -788,6 +797,55 @@ bool Myprivkey(uint8_t myprivkey[]);
 /// @return duration in seconds since the block where the transaction with txid resides
 int64_t CCduration(int32_t &numblocks,uint256 txid);
 
+/// A snapshot of the chain tip for read-only CC queries, so that they can run without holding cs_main
+/// and concurrently with validation and other rpc calls. Only the constructor and LookupBlockIndex
+/// take cs_main, each for a single lookup; block index entries never move or go away once created.
+class CCChainView
+{
+public:
+    CCChainView();
+
+    /// @returns tip height when the view was taken, -1 before genesis
+    int32_t Height() const { return(nHeight); }
+    /// @returns tip block of the view or NULL
+    CBlockIndex *Tip() const { return(pindexTip); }
+
+    /// @returns the block index entry of hash or NULL if the block is unknown
+    CBlockIndex *LookupBlockIndex(const uint256 &hash) const;
+    /// @returns the block at height on the chain of the view or NULL above its tip
+    CBlockIndex *GetAncestor(int32_t height) const;
+    /// @returns true if pindex is on the chain of the view
+    bool Contains(const CBlockIndex *pindex) const;
+
+    /// Returns a transaction like myGetTransaction, plus the height of its block on the chain of the view
+    /// @param[out] height block height, 0 for mempool transactions and for blocks off the chain of the view
+    bool GetTransaction(const uint256 &txid,CTransaction &tx,uint256 &hashBlock,int32_t &height) const;
+
+private:
+    CBlockIndex *pindexTip;
+    int32_t nHeight;
+};
+
+/// Results of read-only CC queries that only depend on the chain and on the mempool, like the pending lists
+/// that gateway signers poll. A result is reused until the chain tip or the mempool changes.
+class CCQueryCache
+{
+public:
+    /// @param maxresults number of query results kept, all of them are dropped when it is reached
+    CCQueryCache(size_t maxresults = 1000) : nMaxResults(maxresults) {}
+
+    /// Returns the stored result for key or calls build for it and stores that
+    /// @param key query name and parameters, unique in this cache
+    /// @param build computes the result from the chain and mempool indexes
+    UniValue Get(const std::string &key,const std::function<UniValue()> &build);
+
+private:
+    CCriticalSection cs;
+    std::pair<uint256, unsigned int> stamp;  // tip hash and mempool update count of the stored results
+    std::map<std::string, UniValue> results;
+    size_t nMaxResults;
+};
+
 /// @private
 uint256 CCOraclesReverseScan(char const *logcategory,uint256 &txid,int32_t height,uint256 reforacletxid,uint256 batontxid);
 
@@ -917,6 +975,7 @@ int64_t CCutxovalue(char *coinaddr,uint256 utxotxid,int32_t utxovout,int32_t CCf
 
 /// @private
 int32_t CC_vinselect(int32_t *aboveip, int64_t *abovep, int32_t *belowip, int64_t *belowp, struct CC_utxo utxos[], int32_t numunspents, int64_t value);
+int64_t CC_vinselect_exact(CMutableTransaction &mtx, struct CC_utxo utxos[], int32_t n, int64_t total, int32_t maxinputs);
 
 /// @private
 bool NSPV_SignTx(CMutableTransaction &mtx,int32_t vini,int64_t utxovalue,const CScript scriptPubKey,uint32_t nTime);
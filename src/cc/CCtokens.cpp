@@ -16,6 +16,8 @@
 #include "CCtokens.h"
 #include "importcoin.h"
 
+#include <deque>
+
 /* TODO: correct this:
 -----------------------------
  The SetTokenFillamounts() and ValidateTokenRemainder() work in tandem to calculate the vouts for a fill and to validate the vouts, respectively.
@@ -267,12 +269,64 @@ void FilterOutNonCCOprets(const std::vector<std::pair<uint8_t, vscript_t>>  &opr
     }
 }
 
+// Token vouts already proven valid down to their inputs' inputs: (txid, vout, tokenid) -> amount.
+// A deep IsTokensvout() result only depends on the contents of tx and of the transactions it spends,
+// which the txids pin down, so an entry stays right across reorgs and needs no height.
+// Only positive results computed by validation with every lookup succeeding are stored.
+static CCriticalSection cs_tokenvouts;
+static std::map<std::pair<COutPoint, uint256>, int64_t> mapValidTokenvouts;
+static std::deque<std::pair<COutPoint, uint256> > dqValidTokenvouts;   // insertion order, oldest dropped first
+static const size_t MAX_VALID_TOKENVOUTS = 100000;
+
+static bool GetValidTokensvout(const COutPoint &outpoint, uint256 tokenid, int64_t &amount)
+{
+    LOCK(cs_tokenvouts);
+    std::map<std::pair<COutPoint, uint256>, int64_t>::const_iterator it = mapValidTokenvouts.find(std::make_pair(outpoint, tokenid));
+    if (it == mapValidTokenvouts.end())
+        return false;
+    amount = it->second;
+    return true;
+}
+
+static void AddValidTokensvout(const COutPoint &outpoint, uint256 tokenid, int64_t amount)
+{
+    LOCK(cs_tokenvouts);
+    std::pair<COutPoint, uint256> key = std::make_pair(outpoint, tokenid);
+    if (!mapValidTokenvouts.insert(std::make_pair(key, amount)).second)
+        return;
+    dqValidTokenvouts.push_back(key);
+    while (dqValidTokenvouts.size() > MAX_VALID_TOKENVOUTS) {
+        mapValidTokenvouts.erase(dqValidTokenvouts.front());
+        dqValidTokenvouts.pop_front();
+    }
+}
+
+static int64_t IsTokensvoutImpl(bool goDeeper, bool checkPubkeys, struct CCcontract_info *cp, Eval* eval, const CTransaction& tx, int32_t v, uint256 reftokenid);
+
 // Checks if the vout is a really Tokens CC vout
 // also checks tokenid in opret or txid if this is 'c' tx
 // goDeeper is true: the func also validates amounts of the passed transaction: 
 // it should be either sum(cc vins) == sum(cc vouts) or the transaction is the 'tokenbase' ('c') tx
 // checkPubkeys is true: validates if the vout is token vout1 or token vout1of2. Should always be true!
 int64_t IsTokensvout(bool goDeeper, bool checkPubkeys /*<--not used, always true*/, struct CCcontract_info *cp, Eval* eval, const CTransaction& tx, int32_t v, uint256 reftokenid)
+{
+    if (!goDeeper)  // the shallow check only looks at tx itself
+        return IsTokensvoutImpl(goDeeper, checkPubkeys, cp, eval, tx, v, reftokenid);
+
+    COutPoint outpoint(tx.GetHash(), v);
+    int64_t amount;
+    if (GetValidTokensvout(outpoint, reftokenid, amount))
+        return amount;
+
+    // a lookup that fails under eval marks its state, a result computed like that is not kept
+    bool fWasValid = eval != NULL && eval->state.IsValid();
+    amount = IsTokensvoutImpl(goDeeper, checkPubkeys, cp, eval, tx, v, reftokenid);
+    if (amount > 0 && fWasValid && eval->state.IsValid())
+        AddValidTokensvout(outpoint, reftokenid, amount);
+    return amount;
+}
+
+static int64_t IsTokensvoutImpl(bool goDeeper, bool checkPubkeys, struct CCcontract_info *cp, Eval* eval, const CTransaction& tx, int32_t v, uint256 reftokenid)
 {
 
 	// this is just for log messages indentation fur debugging recursive calls:
@@ -1042,6 +1096,15 @@ UniValue TokenList()
         }
     };
 
+    std::vector<std::pair<CCIndexKey, CCIndexValue> > ccIndex;
+    if (GetCCIndex(cp->evalcode, 'c', ccIndex)) {                                         // the create oprets, no tx reads
+        for (std::vector<std::pair<CCIndexKey, CCIndexValue> >::const_iterator it = ccIndex.begin(); it != ccIndex.end(); it++) {
+            if (DecodeTokenCreateOpRet(it->second.opret, origpubkey, name, description) != 0)
+                result.push_back(it->first.txhash.GetHex());
+        }
+        return(result);
+    }
+
 	SetCCtxids(txids, cp->normaladdr,false,cp->evalcode,zeroid,'c');                      // find by old normal addr marker
    	for (std::vector<uint256>::const_iterator it = txids.begin(); it != txids.end(); it++) 	{
         addTokenId(*it);
@@ -324,11 +324,9 @@ CC *MakeTokensCCcond1(uint8_t evalcode, CPubKey pk) {
 // make three-eval (token+evalcode+evalcode2) 1of2 cc vout:
 CTxOut MakeTokensCC1of2vout(uint8_t evalcode, uint8_t evalcode2, CAmount nValue, CPubKey pk1, CPubKey pk2)
 {
-    CTxOut vout;
-    CC *payoutCond = MakeTokensCCcond1of2(evalcode, evalcode2, pk1, pk2);
-    vout = CTxOut(nValue, CCPubKey(payoutCond));
-    cc_free(payoutCond);
-    return(vout);
+    CScript spk;
+    CCcondScript(spk, 0, true, evalcode, evalcode2, pk1, pk2);
+    return(CTxOut(nValue, spk));
 }
 // overload to make two-eval (token+evalcode) 1of2 cc vout:
 CTxOut MakeTokensCC1of2vout(uint8_t evalcode, CAmount nValue, CPubKey pk1, CPubKey pk2) {
@@ -338,11 +336,9 @@ CTxOut MakeTokensCC1of2vout(uint8_t evalcode, CAmount nValue, CPubKey pk1, CPubK
 // make three-eval (token+evalcode+evalcode2) cc vout:
 CTxOut MakeTokensCC1vout(uint8_t evalcode, uint8_t evalcode2, CAmount nValue, CPubKey pk)
 {
-    CTxOut vout;
-    CC *payoutCond = MakeTokensCCcond1(evalcode, evalcode2, pk);
-    vout = CTxOut(nValue, CCPubKey(payoutCond));
-    cc_free(payoutCond);
-    return(vout);
+    CScript spk;
+    CCcondScript(spk, 0, true, evalcode, evalcode2, pk, CPubKey());
+    return(CTxOut(nValue, spk));
 }
 // overload to make two-eval (token+evalcode) cc vout:
 CTxOut MakeTokensCC1vout(uint8_t evalcode, CAmount nValue, CPubKey pk) {
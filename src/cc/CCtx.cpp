@@ -15,6 +15,7 @@
 
 #include "CCinclude.h"
 #include "key_io.h"
+#include "wallet/coinselection.h"
 
 std::vector<CPubKey> NULL_pubkeys;
 struct NSPV_CCmtxinfo NSPV_U;
@@ -634,6 +635,19 @@ int32_t CC_vinselect(int32_t *aboveip,int64_t *abovep,int32_t *belowip,int64_t *
     else return(belowi);
 }
 
+// adds the utxos adding up to total exactly, if there are such, so there is no change output; returns their sum or 0
+int64_t CC_vinselect_exact(CMutableTransaction &mtx,struct CC_utxo utxos[],int32_t n,int64_t total,int32_t maxinputs)
+{
+    std::vector<CInputCoin> vInputs; std::vector<size_t> vSelected; int64_t totalinputs; int32_t i;
+    for (i=0; i<n; i++)
+        vInputs.push_back(CInputCoin(utxos[i].nValue,0));
+    if ( SelectCoinsBnB(vInputs,total,0,vSelected,totalinputs) == 0 || vSelected.size() > maxinputs )
+        return(0);
+    for (size_t j : vSelected)
+        mtx.vin.push_back(CTxIn(utxos[j].txid,utxos[j].vout,CScript()));
+    return(totalinputs);
+}
+
 int64_t AddNormalinputsLocal(CMutableTransaction &mtx,CPubKey mypk,int64_t total,int32_t maxinputs)
 {
     int32_t abovei,belowi,ind,vout,i,n = 0; int64_t sum,threshold,above,below; int64_t remains,nValue,totalinputs = 0; uint256 txid,hashBlock; std::vector<COutput> vecOutputs; CTransaction tx; struct CC_utxo *utxos,*up;
@@ -694,6 +708,11 @@ int64_t AddNormalinputsLocal(CMutableTransaction &mtx,CPubKey mypk,int64_t total
             }
         }
     }
+    if ( (totalinputs= CC_vinselect_exact(mtx,utxos,n,total,maxinputs)) != 0 )
+    {
+        free(utxos);
+        return(totalinputs);
+    }
     remains = total;
     for (i=0; i<maxinputs && n>0; i++)
     {
@@ -795,6 +814,11 @@ int64_t AddNormalinputsRemote(CMutableTransaction &mtx, CPubKey mypk, int64_t to
             }
         }
     }
+    if ( (totalinputs= CC_vinselect_exact(mtx,utxos,n,total,maxinputs)) != 0 )
+    {
+        free(utxos);
+        return(totalinputs);
+    }
     remains = total;
     for (i=0; i<maxinputs && n>0; i++)
     {
@@ -60,6 +60,58 @@ CC *MakeCCcond1(uint8_t evalcode,CPubKey pk)
     return CCNewThreshold(2, {condCC, Sig});
 }
 
+// cc scriptPubKeys and their addresses, keyed by (tokens flag, evalcodes, pubkeys). A condition only
+// depends on these, so entries never go stale; building one hashes the whole condition tree.
+static CCriticalSection cs_ccscripts;
+static std::map<std::vector<uint8_t>, std::pair<CScript, std::string> > mapCCscripts;
+static std::deque<std::vector<uint8_t> > dqCCscripts;   // insertion order, oldest dropped first
+static const size_t MAX_CCSCRIPTS = 100000;
+
+bool CCcondScript(CScript &scriptPubKey,char *destaddr,bool fTokens,uint8_t evalcode,uint8_t evalcode2,CPubKey pk1,CPubKey pk2)
+{
+    std::vector<uint8_t> key; CC *cond; char coinaddr[64];
+    if ( destaddr != 0 )
+        destaddr[0] = 0;
+    if ( fTokens == false )
+        evalcode2 = 0;
+    key.push_back(fTokens); key.push_back(evalcode); key.push_back(evalcode2);
+    key.push_back(pk1.size()); key.insert(key.end(),pk1.begin(),pk1.end());
+    key.push_back(pk2.size()); key.insert(key.end(),pk2.begin(),pk2.end());
+    {
+        LOCK(cs_ccscripts);
+        std::map<std::vector<uint8_t>, std::pair<CScript, std::string> >::const_iterator it = mapCCscripts.find(key);
+        if ( it != mapCCscripts.end() )
+        {
+            scriptPubKey = it->second.first;
+            if ( destaddr != 0 )
+                strcpy(destaddr,it->second.second.c_str());
+            return(true);
+        }
+    }
+    if ( pk2.size() == 0 )
+        cond = fTokens ? MakeTokensCCcond1(evalcode,evalcode2,pk1) : MakeCCcond1(evalcode,pk1);
+    else cond = fTokens ? MakeTokensCCcond1of2(evalcode,evalcode2,pk1,pk2) : MakeCCcond1of2(evalcode,pk1,pk2);
+    if ( cond == 0 )
+        return(false);
+    scriptPubKey = CCPubKey(cond);
+    cc_free(cond);
+    if ( Getscriptaddress(coinaddr,scriptPubKey) == false || coinaddr[0] == 0 )
+        return(false);
+    if ( destaddr != 0 )
+        strcpy(destaddr,coinaddr);
+    LOCK(cs_ccscripts);
+    if ( mapCCscripts.insert(std::make_pair(key,std::make_pair(scriptPubKey,std::string(coinaddr)))).second )
+    {
+        dqCCscripts.push_back(key);
+        while ( dqCCscripts.size() > MAX_CCSCRIPTS )
+        {
+            mapCCscripts.erase(dqCCscripts.front());
+            dqCCscripts.pop_front();
+        }
+    }
+    return(true);
+}
+
 int32_t has_opret(const CTransaction &tx, uint8_t evalcode)
 {
     int i = 0;
@@ -99,9 +151,9 @@ bool makeCCopret(CScript &opret, std::vector<std::vector<unsigned char>> &vData)
 
 CTxOut MakeCC1vout(uint8_t evalcode,CAmount nValue, CPubKey pk, std::vector<std::vector<unsigned char>>* vData)
 {
-    CTxOut vout;
-    CC *payoutCond = MakeCCcond1(evalcode,pk);
-    vout = CTxOut(nValue,CCPubKey(payoutCond));
+    CTxOut vout; CScript spk;
+    CCcondScript(spk,0,false,evalcode,0,pk,CPubKey());
+    vout = CTxOut(nValue,spk);
     if ( vData )
     {
         //std::vector<std::vector<unsigned char>> vtmpData = std::vector<std::vector<unsigned char>>(vData->begin(), vData->end());
@@ -110,15 +162,14 @@ CTxOut MakeCC1vout(uint8_t evalcode,CAmount nValue, CPubKey pk, std::vector<std:
         COptCCParams ccp = COptCCParams(COptCCParams::VERSION, evalcode, 1, 1, vPubKeys, ( * vData));
         vout.scriptPubKey << ccp.AsVector() << OP_DROP;
     }
-    cc_free(payoutCond);
     return(vout);
 }
 
 CTxOut MakeCC1of2vout(uint8_t evalcode,CAmount nValue,CPubKey pk1,CPubKey pk2, std::vector<std::vector<unsigned char>>* vData)
 {
-    CTxOut vout;
-    CC *payoutCond = MakeCCcond1of2(evalcode,pk1,pk2);
-    vout = CTxOut(nValue,CCPubKey(payoutCond));
+    CTxOut vout; CScript spk;
+    CCcondScript(spk,0,false,evalcode,0,pk1,pk2);
+    vout = CTxOut(nValue,spk);
     if ( vData )
     {
         //std::vector<std::vector<unsigned char>> vtmpData = std::vector<std::vector<unsigned char>>(vData->begin(), vData->end());
@@ -129,7 +180,6 @@ CTxOut MakeCC1of2vout(uint8_t evalcode,CAmount nValue,CPubKey pk1,CPubKey pk2, s
         COptCCParams ccp = COptCCParams(COptCCParams::VERSION, evalcode, 1, 2, vPubKeys, ( * vData));
         vout.scriptPubKey << ccp.AsVector() << OP_DROP;
     }
-    cc_free(payoutCond);
     return(vout);
 }
 
@@ -308,14 +358,8 @@ CPubKey CCCustomtxidaddr(char *txidaddr,uint256 txid,uint8_t taddr,uint8_t prefi
 
 bool _GetCCaddress(char *destaddr,uint8_t evalcode,CPubKey pk)
 {
-    CC *payoutCond;
-    destaddr[0] = 0;
-    if ( (payoutCond= MakeCCcond1(evalcode,pk)) != 0 )
-    {
-        Getscriptaddress(destaddr,CCPubKey(payoutCond));
-        cc_free(payoutCond);
-    }
-    return(destaddr[0] != 0);
+    CScript spk;
+    return(CCcondScript(spk,destaddr,false,evalcode,0,pk,CPubKey()));
 }
 
 bool GetCCaddress(struct CCcontract_info *cp,char *destaddr,CPubKey pk)
@@ -328,14 +372,8 @@ bool GetCCaddress(struct CCcontract_info *cp,char *destaddr,CPubKey pk)
 
 bool _GetTokensCCaddress(char *destaddr, uint8_t evalcode, uint8_t evalcode2, CPubKey pk)
 {
-	CC *payoutCond;
-	destaddr[0] = 0;
-	if ((payoutCond = MakeTokensCCcond1(evalcode, evalcode2, pk)) != 0)
-	{
-		Getscriptaddress(destaddr, CCPubKey(payoutCond));
-		cc_free(payoutCond);
-	}
-	return(destaddr[0] != 0);
+	CScript spk;
+	return(CCcondScript(spk, destaddr, true, evalcode, evalcode2, pk, CPubKey()));
 }
 
 // get scriptPubKey adddress for three/dual eval token cc vout
@@ -350,26 +388,14 @@ bool GetTokensCCaddress(struct CCcontract_info *cp, char *destaddr, CPubKey pk)
 
 bool GetCCaddress1of2(struct CCcontract_info *cp,char *destaddr,CPubKey pk,CPubKey pk2)
 {
-    CC *payoutCond;
-    destaddr[0] = 0;
-    if ( (payoutCond= MakeCCcond1of2(cp->evalcode,pk,pk2)) != 0 )
-    {
-        Getscriptaddress(destaddr,CCPubKey(payoutCond));
-        cc_free(payoutCond);
-    }
-    return(destaddr[0] != 0);
+    CScript spk;
+    return(CCcondScript(spk,destaddr,false,cp->evalcode,0,pk,pk2));
 }
 
 bool GetTokensCCaddress1of2(struct CCcontract_info *cp, char *destaddr, CPubKey pk, CPubKey pk2)
 {
-	CC *payoutCond;
-	destaddr[0] = 0;
-	if ((payoutCond = MakeTokensCCcond1of2(cp->evalcode, cp->additionalTokensEvalcode2, pk, pk2)) != 0)  //  if additionalTokensEvalcode2 not set then it is dual-eval cc else three-eval cc
-	{
-		Getscriptaddress(destaddr, CCPubKey(payoutCond));
-		cc_free(payoutCond);
-	}
-	return(destaddr[0] != 0);
+	CScript spk;
+	return(CCcondScript(spk, destaddr, true, cp->evalcode, cp->additionalTokensEvalcode2, pk, pk2));  //  if additionalTokensEvalcode2 not set then it is dual-eval cc else three-eval cc
 }
 
 bool ConstrainVout(CTxOut vout, int32_t CCflag, char *cmpaddr, int64_t nValue)
@@ -546,17 +572,88 @@ int64_t CCduration(int32_t &numblocks,uint256 txid)
     return(duration);
 }
 
+CCChainView::CCChainView()
+{
+    LOCK(cs_main);
+    pindexTip = chainActive.LastTip();
+    nHeight = pindexTip != 0 ? pindexTip->GetHeight() : -1;
+}
+
+CBlockIndex *CCChainView::LookupBlockIndex(const uint256 &hash) const
+{
+    LOCK(cs_main);
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    return(it != mapBlockIndex.end() ? it->second : 0);
+}
+
+CBlockIndex *CCChainView::GetAncestor(int32_t height) const
+{
+    // pprev and pskip are set when an entry is created and never change after
+    if ( pindexTip == 0 || height < 0 || height > nHeight )
+        return(0);
+    return(pindexTip->GetAncestor(height));
+}
+
+bool CCChainView::Contains(const CBlockIndex *pindex) const
+{
+    return(pindex != 0 && GetAncestor(pindex->GetHeight()) == pindex);
+}
+
+bool CCChainView::GetTransaction(const uint256 &txid,CTransaction &tx,uint256 &hashBlock,int32_t &height) const
+{
+    CBlockIndex *pindex;
+    height = 0;
+    if ( myGetTransaction(txid,tx,hashBlock) == 0 )
+        return(false);
+    if ( !hashBlock.IsNull() && (pindex= LookupBlockIndex(hashBlock)) != 0 && Contains(pindex) )
+        height = pindex->GetHeight();
+    return(true);
+}
+
+UniValue CCQueryCache::Get(const std::string &key,const std::function<UniValue()> &build)
+{
+    std::pair<uint256, unsigned int> current;
+    if ( SAFECOIN_NSPV_SUPERLITE )  // the chain and mempool are remote
+        return(build());
+    {
+        LOCK(cs_main);
+        CBlockIndex *tip = chainActive.LastTip();
+        current = std::make_pair(tip != 0 ? tip->GetBlockHash() : uint256(), mempool.GetTransactionsUpdated());
+    }
+    {
+        LOCK(cs);
+        if ( current == stamp )
+        {
+            std::map<std::string, UniValue>::const_iterator it = results.find(key);
+            if ( it != results.end() )
+                return(it->second);
+        }
+    }
+    // built unlocked, a change in between moves the stamp on so the next call builds again
+    UniValue result = build();
+    LOCK(cs);
+    if ( current != stamp )
+    {
+        results.clear();
+        stamp = current;
+    }
+    if ( results.size() >= nMaxResults )
+        results.clear();
+    results[key] = result;
+    return(result);
+}
+
 uint256 CCOraclesReverseScan(char const *logcategory,uint256 &txid,int32_t height,uint256 reforacletxid,uint256 batontxid)
 {
-    CTransaction tx; uint256 hash,mhash,bhash,hashBlock,oracletxid; int32_t len,len2,numvouts;
+    uint256 hash,mhash,bhash,oracletxid; int32_t len,len2; bool marker;
     int64_t val,merkleht; CPubKey pk; std::vector<uint8_t>data; char str[65],str2[65];
     
     txid = zeroid;
     LogPrint(logcategory,"start reverse scan %s\n",uint256_str(str,batontxid));
-    while ( myGetTransaction(batontxid,tx,hashBlock) != 0 && (numvouts= tx.vout.size()) > 0 )
+    while ( 1 )
     {
         LogPrint(logcategory,"check %s\n",uint256_str(str,batontxid));
-        if ( DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,bhash,pk,data) == 'D' && oracletxid == reforacletxid )
+        if ( DecodeOraclesDataTx(batontxid,oracletxid,bhash,pk,data,marker) == 'D' && oracletxid == reforacletxid )
         {
             LogPrint(logcategory,"decoded %s\n",uint256_str(str,batontxid));
             if ( oracle_format(&hash,&merkleht,0,'I',(uint8_t *)data.data(),0,(int32_t)data.size()) == sizeof(int32_t) && merkleht == height )
@@ -593,6 +690,19 @@ int32_t myIs_coinaddr_inmempoolvout(char const *logcategory,char *coinaddr)
     int32_t i,n; char destaddr[64];
     if ( SAFECOIN_NSPV_SUPERLITE )
         return(NSPV_coinaddr_inmempool(logcategory,coinaddr,1));
+    if ( fAddressIndex )
+    {
+        // the mempool address index has every output, CC ones under type 3
+        uint160 hashBytes; int type;
+        if ( !CBitcoinAddress(coinaddr).GetIndexKey(hashBytes,type,false) )
+            return(0);
+        if ( mempool.hasAddressDelta(hashBytes,type,false) || (type == 1 && mempool.hasAddressDelta(hashBytes,3,false)) )
+        {
+            LogPrint(logcategory,"found (%s) vout in mempool\n",coinaddr);
+            return(1);
+        }
+        return(0);
+    }
     BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
     {
         const CTransaction &tx = e.GetTx();
@@ -631,12 +741,8 @@ int32_t myGet_mempool_txs(std::vector<CTransaction> &txs,uint8_t evalcode,uint8_
         }
         return (NSPV_mempoolresult.numtxids);
     }
-    BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
-    {
-        txs.push_back(e.GetTx());
-        i++;
-    }
-    return(i);
+    mempool.queryCCOpRet(evalcode,funcid,txs);
+    return(txs.size());
 }
 
 int32_t CCCointxidExists(char const *logcategory,uint256 cointxid)
@@ -675,10 +781,25 @@ int32_t safecoin_get_current_height()
     else return chainActive.LastTip()->GetHeight();
 }
 
+/** The confirmation rule of safecoin_txnotarizedconfirmed, once the heights are known */
+static bool safecoin_notarizedconfirms(bool havestate,int32_t notarizedheight,int32_t txheight,int32_t confirms)
+{
+    int32_t notarized=0;
+    if (havestate && (notarized=notarizedheight) > 0 && txheight > notarizedheight)  notarized=0;
+#ifdef TESTMODE
+    notarized=0;
+#endif //TESTMODE
+    if (notarized>0 && confirms > 1)
+        return (true);
+    else if (notarized==0 && confirms >= MIN_NON_NOTARIZED_CONFIRMS)
+        return (true);
+    return (false);
+}
+
 bool safecoin_txnotarizedconfirmed(uint256 txid)
 {
     char str[65];
-    int32_t confirms,notarized=0,txheight=0,currentheight=0;;
+    int32_t confirms,txheight=0,currentheight=0;
     CTransaction tx;
     uint256 hashBlock;
     CBlockIndex *pindex;    
@@ -728,15 +849,41 @@ bool safecoin_txnotarizedconfirmed(uint256 txid)
         confirms=1 + pindex->GetHeight() - txheight;
     }
 
-    if ((sp= safecoin_stateptr(symbol,dest)) != 0 && (notarized=sp->NOTARIZED_HEIGHT) > 0 && txheight > sp->NOTARIZED_HEIGHT)  notarized=0;            
-#ifdef TESTMODE           
-    notarized=0;
-#endif //TESTMODE
-    if (notarized>0 && confirms > 1)
-        return (true);
-    else if (notarized==0 && confirms >= MIN_NON_NOTARIZED_CONFIRMS)
-        return (true);
-    return (false);
+    sp= safecoin_stateptr(symbol,dest);
+    return(safecoin_notarizedconfirms(sp != 0,sp != 0 ? sp->NOTARIZED_HEIGHT : 0,txheight,confirms));
+}
+
+void safecoin_txsnotarizedconfirmed(const std::vector<uint256> &txids,std::vector<bool> &confirmed)
+{
+    std::map<uint256,int> heights; std::map<uint256,int>::const_iterator it;
+    int32_t i,tipheight,notarizedheight=0; CBlockIndex *pindex;
+    char symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; struct safecoin_state *sp;
+
+    confirmed.assign(txids.size(),false);
+    if ( SAFECOIN_NSPV_SUPERLITE )
+    {
+        for (i=0; i<txids.size(); i++)
+            confirmed[i] = safecoin_txnotarizedconfirmed(txids[i]);
+        return;
+    }
+    // every block is read once from the txindex, the tip and the notarized height once for all of them
+    GetTxIndexHeights(txids,heights);
+    {
+        LOCK(cs_main);
+        if ( (pindex= chainActive.LastTip()) == 0 )
+            return;
+        tipheight = pindex->GetHeight();
+    }
+    if ( (sp= safecoin_stateptr(symbol,dest)) != 0 )
+        notarizedheight = sp->NOTARIZED_HEIGHT;
+    for (i=0; i<txids.size(); i++)
+    {
+        // mempool, archived or reorged out, the single lookup knows what to do with those
+        if ( (it= heights.find(txids[i])) == heights.end() )
+            confirmed[i] = safecoin_txnotarizedconfirmed(txids[i]);
+        else if ( it->second > 0 && it->second <= tipheight )
+            confirmed[i] = safecoin_notarizedconfirms(sp != 0,notarizedheight,it->second,1 + tipheight - it->second);
+    }
 }
 
 CPubKey check_signing_pubkey(CScript scriptSig)
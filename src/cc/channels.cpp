@@ -708,7 +708,19 @@ UniValue ChannelsList(const CPubKey& pk)
     return(result);
 }
 
+static UniValue _ChannelsInfo(const CPubKey& pk,uint256 channeltxid);
+
+// a channel's state is its open, payment, close and refund txs, so wallets polling channelsinfo
+// get the last result until a block or mempool tx changes it
+static CCQueryCache channelsQueries;
+
 UniValue ChannelsInfo(const CPubKey& pk,uint256 channeltxid)
+{
+    std::string key = HexStr(pk.IsValid()?pk:pubkey2pk(Mypubkey())) + channeltxid.GetHex();
+    return(channelsQueries.Get(key,[&]() { return(_ChannelsInfo(pk,channeltxid)); }));
+}
+
+static UniValue _ChannelsInfo(const CPubKey& pk,uint256 channeltxid)
 {
     UniValue result(UniValue::VOBJ),array(UniValue::VARR); CTransaction tx,opentx; uint256 txid,tmp_txid,hashBlock,param3,opentxid,hashchain,tokenid;
     struct CCcontract_info *cp,C; char CCaddr[65],addr[65],str[512]; int32_t vout,numvouts,param1,numpayments;
@@ -721,6 +733,8 @@ UniValue ChannelsInfo(const CPubKey& pk,uint256 channeltxid)
     if (myGetTransaction(channeltxid,tx,hashBlock) != 0 && (numvouts= tx.vout.size()) > 0 &&
         (DecodeChannelsOpRet(tx.vout[numvouts-1].scriptPubKey,tokenid,opentxid,srcpub,destpub,param1,param2,param3) == 'O'))
     {    
+        opentx = tx;
+        numpayments = param1, payment = param2, hashchain = param3;
         GetCCaddress1of2(cp,CCaddr,srcpub,destpub);
         Getscriptaddress(addr,CScript() << ParseHex(HexStr(destpub)) << OP_CHECKSIG);
         result.push_back(Pair("result","success"));
@@ -767,8 +781,7 @@ UniValue ChannelsInfo(const CPubKey& pk,uint256 channeltxid)
                 }
                 else if (DecodeChannelsOpRet(tx.vout[numvouts-1].scriptPubKey,tokenid,opentxid,srcpub,destpub,param1,param2,param3) == 'P' && opentxid==channeltxid)
                 {
-                    if (myGetTransaction(opentxid,opentx,hashBlock) != 0 && (numvouts=opentx.vout.size()) > 0 &&
-                            DecodeChannelsOpRet(opentx.vout[numvouts-1].scriptPubKey,tokenid,tmp_txid,srcpub,destpub,numpayments,payment,hashchain) == 'O')
+                    // opentxid == channeltxid, whose open tx was decoded above
                     {
                         Getscriptaddress(str,tx.vout[3].scriptPubKey);  
                         obj.push_back(Pair("Payment",tx.GetHash().GetHex().data()));
@@ -122,8 +122,17 @@ struct dicehash_entry
 {
     UT_hash_handle hh;
     uint256 bettxid;
+    uint64_t sbits;
+    int32_t iswin;
 } *DICEHASH_TABLE;
 
+// the confirmed unspents of the dealer's normal address, they only change with a new block
+struct dicefinish_unspents
+{
+    int32_t height;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > outputs;
+};
+
 struct dice_entropy
 {
     UT_hash_handle hh;
@@ -152,11 +161,13 @@ int32_t _dicehash_clear(uint256 bettxid)
     return(-1);
 }
 
-struct dicehash_entry *_dicehash_add(uint256 bettxid)
+struct dicehash_entry *_dicehash_add(uint256 bettxid,uint64_t sbits,int32_t iswin)
 {
     struct dicehash_entry *ptr;
     ptr = (struct dicehash_entry *)calloc(1,sizeof(*ptr));
     ptr->bettxid = bettxid;
+    ptr->sbits = sbits;
+    ptr->iswin = iswin;
     HASH_ADD(hh,DICEHASH_TABLE,bettxid,sizeof(bettxid),ptr);
     return(ptr);
 }
@@ -259,12 +270,22 @@ bool mySenddicetransaction(std::string res,uint256 entropyused,int32_t entropyvo
     return(false);
 }
 
-int32_t dicefinish_utxosget(int32_t &total,struct dicefinish_utxo *utxos,int32_t max,char *coinaddr)
+int32_t dicefinish_utxosget(int32_t &total,struct dicefinish_utxo *utxos,int32_t max,char *coinaddr,struct dicefinish_unspents *cache=0)
 {
     int32_t n = 0; int64_t threshold = 2 * 10000;
     total = 0;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    SetCCunspents(unspentOutputs,coinaddr,false);
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > _unspentOutputs;
+    if ( cache != 0 )
+    {
+        // the address index is only read once per block, what was used since is filtered out by the mempool check below
+        if ( cache->height == 0 || cache->height != SAFECOIN_INSYNC )
+        {
+            cache->outputs.clear();
+            SetCCunspents(cache->outputs,coinaddr,false);
+            cache->height = SAFECOIN_INSYNC;
+        }
+    } else SetCCunspents(_unspentOutputs,coinaddr,false);
+    const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs = (cache != 0) ? cache->outputs : _unspentOutputs;
     {
         LOCK(mempool.cs);
         for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
@@ -322,7 +343,8 @@ void dicefinish_delete(struct dicefinish_info *ptr)
 
 void *dicefinish(void *_ptr)
 {
-    std::vector<uint8_t> mypk; struct CCcontract_info *cp,C; char name[32],coinaddr[64],CCaddr[64]; std::string res; int32_t newht,newblock,entropyvout,numblocks,lastheight=0,vin0_needed,i,n,m,num,iter,result; struct dicefinish_info *ptr,*tmp; uint32_t now; struct dicefinish_utxo *utxos; uint256 hashBlock,entropyused; CPubKey dicepk; CTransaction betTx,finishTx,tx;
+    std::vector<uint8_t> mypk; struct CCcontract_info *cp,C; char name[32],coinaddr[64],CCaddr[64]; std::string res; int32_t newht,newblock,entropyvout,numblocks,lastheight=0,vin0_needed,i,n,m,num,iter,result; struct dicefinish_info *ptr,*tmp; uint32_t now; struct dicefinish_utxo *utxos; struct dicefinish_unspents unspents; uint256 hashBlock,entropyused; CPubKey dicepk; CTransaction betTx,finishTx,tx;
+    unspents.height = 0;
     mypk = Mypubkey();
     pubkey2addr(coinaddr,mypk.data());
     cp = CCinit(&C,EVAL_DICE);
@@ -429,7 +451,7 @@ void *dicefinish(void *_ptr)
                 num = 0;
 //fprintf(stderr,"iter.%d vin0_needed.%d\n",iter,vin0_needed);
                 utxos = (struct dicefinish_utxo *)calloc(vin0_needed,sizeof(*utxos));
-                if ( (n= dicefinish_utxosget(num,utxos,vin0_needed,coinaddr)) > 0 )
+                if ( (n= dicefinish_utxosget(num,utxos,vin0_needed,coinaddr,&unspents)) > 0 )
                 {
 //fprintf(stderr,"iter.%d vin0_needed.%d got %d, num 0.0002 %d\n",iter,vin0_needed,n,num);
                     m = 0;
@@ -519,7 +541,7 @@ void DiceQueue(int32_t iswin,uint64_t sbits,uint256 fundingtxid,uint256 bettxid,
     pthread_mutex_lock(&DICE_MUTEX);
     if ( _dicehash_find(bettxid) == 0 )
     {
-        _dicehash_add(bettxid);
+        _dicehash_add(bettxid,sbits,iswin);
         ptr = (struct dicefinish_info *)calloc(1,sizeof(*ptr));
         ptr->fundingtxid = fundingtxid;
         ptr->bettxid = bettxid;
@@ -539,6 +561,22 @@ void DiceQueue(int32_t iswin,uint64_t sbits,uint256 fundingtxid,uint256 bettxid,
     pthread_mutex_unlock(&DICE_MUTEX);
 }
 
+// a bet the dealer already queued has its outcome in DICEHASH_TABLE, so a status scan doesnt need to fetch and evaluate it again
+int32_t DiceQueued(int32_t &iswin,uint256 bettxid,uint64_t sbits)
+{
+    struct dicehash_entry *ptr; int32_t retval = 0;
+    if ( DICEHASH_TABLE == 0 )
+        return(0);
+    pthread_mutex_lock(&DICE_MUTEX);
+    if ( (ptr= _dicehash_find(bettxid)) != 0 && ptr->sbits == sbits )
+    {
+        iswin = ptr->iswin;
+        retval = 1;
+    }
+    pthread_mutex_unlock(&DICE_MUTEX);
+    return(retval);
+}
+
 CPubKey DiceFundingPk(CScript scriptPubKey)
 {
     CPubKey pk; uint8_t *ptr,*dest; int32_t i;
@@ -1782,6 +1820,15 @@ double DiceStatus(uint64_t txfee,char *planstr,uint256 fundingtxid,uint256 bettx
             if ( vout != 0 )
                 continue;
             sum += it->second.satoshis;
+            if ( SAFECOIN_DEALERNODE != 0 && scriptPubKey == fundingPubKey && DiceQueued(iswin,txid,refsbits) != 0 )
+            {
+                if ( iswin > 0 )
+                    win++;
+                else if ( iswin < 0 )
+                    loss++;
+                n++;
+                continue;
+            }
             if ( myGetTransaction(txid,betTx,hashBlock) != 0 && betTx.vout.size() >= 4 && betTx.vout[vout].scriptPubKey.IsPayToCryptoCondition() != 0 )
             {
                 if ( DecodeDiceOpRet(txid,betTx.vout[betTx.vout.size()-1].scriptPubKey,sbits,fundingtxid,hash,proof) == 'B' && sbits == refsbits )
@@ -26,6 +26,8 @@
 #include "chain.h"
 #include "core_io.h"
 #include "crosschain.h"
+#include "crypto/sha256.h"
+#include "trace.h"
 
 bool CClib_Dispatch(const CC *cond,Eval *eval,std::vector<uint8_t> paramsNull,const CTransaction &txTo,unsigned int nIn);
 char *CClib_name();
@@ -33,13 +35,37 @@ char *CClib_name();
 Eval* EVAL_TEST = 0;
 struct CCcontract_info CCinfos[0x100];
 extern pthread_mutex_t SAFECOIN_CC_mutex;
+static pthread_mutex_t CCinfos_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Validators that keep no state outside the Eval and the CCcontract_info copy they
+ * are handed. The script check threads run these side by side, every other eval
+ * code still runs one at a time under SAFECOIN_CC_mutex.
+ */
+static bool CCEvalIsReentrant(uint8_t ecode)
+{
+    switch ( ecode )
+    {
+        case EVAL_TOKENS:
+        case EVAL_ASSETS:
+        case EVAL_FAUCET:
+            return true;
+    }
+    return false;
+}
 
 bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn)
 {
     EvalRef eval;
-    pthread_mutex_lock(&SAFECOIN_CC_mutex);
+    bool fSerial = cond->codeLength == 0 || !CCEvalIsReentrant(cond->code[0]);
+    if ( fSerial )
+        pthread_mutex_lock(&SAFECOIN_CC_mutex);
+    uint8_t ecode = cond->codeLength == 0 ? 0 : cond->code[0];
+    TRACE3(cc, eval_start, ecode, tx.GetHash().begin(), nIn);
     bool out = eval->Dispatch(cond, tx, nIn);
-    pthread_mutex_unlock(&SAFECOIN_CC_mutex);
+    if ( fSerial )
+        pthread_mutex_unlock(&SAFECOIN_CC_mutex);
+    TRACE4(cc, eval_finish, ecode, tx.GetHash().begin(), nIn, out);
     if ( eval->state.IsValid() != out)
         fprintf(stderr,"out %d vs %d isValid\n",(int32_t)out,(int32_t)eval->state.IsValid());
     //assert(eval->state.IsValid() == out);
@@ -71,7 +97,7 @@ bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn)
  */
 bool Eval::Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn)
 {
-    struct CCcontract_info *cp;
+    struct CCcontract_info *cp,C;
     if (cond->codeLength == 0)
         return Invalid("empty-eval");
 
@@ -93,12 +119,16 @@ bool Eval::Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn)
             return CClib_Dispatch(cond,this,vparams,txTo,nIn);
         else return Invalid("mismatched -ac_cclib vs CClib_name");
     }
-    cp = &CCinfos[(int32_t)ecode];
-    if ( cp->didinit == 0 )
+    // validators scribble on cp, so each evaluation gets its own copy of the module info
+    pthread_mutex_lock(&CCinfos_mutex);
+    if ( CCinfos[(int32_t)ecode].didinit == 0 )
     {
-        CCinit(cp,ecode);
-        cp->didinit = 1;
+        CCinit(&CCinfos[(int32_t)ecode],ecode);
+        CCinfos[(int32_t)ecode].didinit = 1;
     }
+    C = CCinfos[(int32_t)ecode];
+    pthread_mutex_unlock(&CCinfos_mutex);
+    cp = &C;
 
     switch ( ecode )
     {
@@ -237,15 +267,20 @@ uint256 SafeCheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleB
         return uint256();
     for (auto it(vMerkleBranch.begin()); it != vMerkleBranch.end(); ++it)
     {
+        unsigned char buf[64];
         if (nIndex & 1) {
             if (*it == hash) {
                 // non canonical. hash may be equal to node but never on the right.
                 return uint256();
             }
-            hash = Hash(BEGIN(*it), END(*it), BEGIN(hash), END(hash));
+            memcpy(buf, it->begin(), 32);
+            memcpy(buf + 32, hash.begin(), 32);
+        }
+        else {
+            memcpy(buf, hash.begin(), 32);
+            memcpy(buf + 32, it->begin(), 32);
         }
-        else
-            hash = Hash(BEGIN(hash), END(hash), BEGIN(*it), END(*it));
+        SHA256D64(hash.begin(), buf, 1);
         nIndex >>= 1;
     }
     return hash;
@@ -173,6 +173,48 @@ int32_t games_replay2(uint8_t *newdata,uint64_t seed,gamesevent *keystrokes,int3
 
 void GAMEJSON(UniValue &obj,struct games_player *P);
 
+// Replaying the keystrokes is the expensive part of validating a finished game, and the info and finish rpcs
+// replay it once more. The engine is deterministic in (seed, starting player, keystrokes), so the end state of a
+// replay is kept under the hash of those inputs and each game is replayed once per node. The engine state in the
+// middle of a game lives in its globals and cant be saved, so a cached end state is as far as this goes.
+static CCriticalSection cs_gamesreplays;
+static std::map<uint256, std::vector<uint8_t> > mapGamesReplays;
+static std::deque<uint256> dqGamesReplays;   // insertion order, oldest dropped first
+static const size_t MAX_GAMES_REPLAYS = 1000;
+
+int32_t games_replay_cached(uint8_t *newdata,uint64_t seed,gamesevent *keystrokes,int32_t num,struct games_player *player)
+{
+    CSHA256 sha; uint256 key; uint8_t hasplayer = (player != 0); int32_t n;
+    sha.Write((const uint8_t *)&seed,sizeof(seed));
+    sha.Write(&hasplayer,sizeof(hasplayer));
+    if ( player != 0 )
+        sha.Write((const uint8_t *)player,sizeof(*player));
+    sha.Write((const uint8_t *)keystrokes,sizeof(*keystrokes) * num);
+    sha.Finalize(key.begin());
+    {
+        LOCK(cs_gamesreplays);
+        std::map<uint256, std::vector<uint8_t> >::const_iterator it = mapGamesReplays.find(key);
+        if ( it != mapGamesReplays.end() )
+        {
+            if ( newdata != 0 && it->second.size() > 0 )
+                memcpy(newdata,&it->second[0],it->second.size());
+            return((int32_t)it->second.size());
+        }
+    }
+    n = games_replay2(newdata,seed,keystrokes,num,player,0);
+    LOCK(cs_gamesreplays);
+    if ( newdata != 0 && n >= 0 && mapGamesReplays.insert(std::make_pair(key,std::vector<uint8_t>(newdata,newdata+n))).second )
+    {
+        dqGamesReplays.push_back(key);
+        while ( dqGamesReplays.size() > MAX_GAMES_REPLAYS )
+        {
+            mapGamesReplays.erase(dqGamesReplays.front());
+            dqGamesReplays.pop_front();
+        }
+    }
+    return(n);
+}
+
 /*
 ./c cclib rng 17 \"[%229433dc3749aece1bd568f374a45da3b0bc6856990d7da3cd175399577940a775%22,250]\"
 {
@@ -1390,7 +1432,7 @@ gamesevent *games_extractgame(int32_t makefiles,char *str,int32_t *numkeysp,std:
                         fclose(fp);
                     }
                 }
-                num = games_replay2(newplayer,seed,keystrokes,numkeys,playerdata.size()==0?0:&P,0);
+                num = games_replay_cached(newplayer,seed,keystrokes,numkeys,playerdata.size()==0?0:&P);
                 newdata.resize(num);
                 for (i=0; i<num; i++)
                 {
@@ -1544,7 +1586,7 @@ UniValue games_finish(uint64_t txfee,struct CCcontract_info *cp,cJSON *params,ch
                     }
                     if ( keystrokes != 0 )
                     {
-                        num = games_replay2(player,seed,keystrokes,numkeys,playerdata.size()==0?0:&P,0);
+                        num = games_replay_cached(player,seed,keystrokes,numkeys,playerdata.size()==0?0:&P);
                         if ( keystrokes != 0 )
                             free(keystrokes), keystrokes = 0;
                     } else num = 0;
@@ -1217,7 +1217,7 @@ UniValue GatewaysMarkDone(const CPubKey& pk, uint64_t txfee,uint256 completetxid
     CCERR_RESULT("gatewayscc",CCLOG_INFO, stream << "error adding funds for markdone");
 }
 
-UniValue GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
+static UniValue _GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
 {
     UniValue result(UniValue::VOBJ),pending(UniValue::VARR); CTransaction tx; std::string coin,hex,pub; 
     CPubKey mypk,gatewayspk,destpub; std::vector<CPubKey> pubkeys,publishers; std::vector<uint256> txids;
@@ -1272,7 +1272,7 @@ UniValue GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string
     return(result);
 }
 
-UniValue GatewaysPendingWithdraws(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
+static UniValue _GatewaysPendingWithdraws(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
 {
     UniValue result(UniValue::VOBJ),pending(UniValue::VARR); CTransaction tx; std::string coin,hex; CPubKey mypk,gatewayspk,withdrawpub,signerpk;
     std::vector<CPubKey> msigpubkeys; uint256 hashBlock,tokenid,txid,tmpbindtxid,tmptokenid,oracletxid,withdrawtxid; uint8_t K,M,N,taddr,prefix,prefix2,wiftype;
@@ -1360,7 +1360,7 @@ UniValue GatewaysPendingWithdraws(const CPubKey& pk, uint256 bindtxid,std::strin
     return(result);
 }
 
-UniValue GatewaysProcessedWithdraws(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
+static UniValue _GatewaysProcessedWithdraws(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
 {
     UniValue result(UniValue::VOBJ),processed(UniValue::VARR); CTransaction tx; std::string coin,hex; 
     CPubKey mypk,gatewayspk,withdrawpub; std::vector<CPubKey> msigpubkeys;
@@ -1426,6 +1426,28 @@ UniValue GatewaysProcessedWithdraws(const CPubKey& pk, uint256 bindtxid,std::str
     return(result);
 }
 
+// deposit, withdraw and signing states are the unspent markers on the gateways addresses,
+// signers polling the lists below get the last result until a block or mempool tx changes them
+static CCQueryCache gatewaysQueries;
+
+UniValue GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
+{
+    std::string key = "pendingdeposits" + HexStr(pk.IsValid()?pk:pubkey2pk(Mypubkey())) + bindtxid.GetHex() + refcoin;
+    return(gatewaysQueries.Get(key,[&]() { return(_GatewaysPendingDeposits(pk,bindtxid,refcoin)); }));
+}
+
+UniValue GatewaysPendingWithdraws(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
+{
+    std::string key = "pendingwithdraws" + HexStr(pk.IsValid()?pk:pubkey2pk(Mypubkey())) + bindtxid.GetHex() + refcoin;
+    return(gatewaysQueries.Get(key,[&]() { return(_GatewaysPendingWithdraws(pk,bindtxid,refcoin)); }));
+}
+
+UniValue GatewaysProcessedWithdraws(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
+{
+    std::string key = "processedwithdraws" + HexStr(pk.IsValid()?pk:pubkey2pk(Mypubkey())) + bindtxid.GetHex() + refcoin;
+    return(gatewaysQueries.Get(key,[&]() { return(_GatewaysProcessedWithdraws(pk,bindtxid,refcoin)); }));
+}
+
 UniValue GatewaysList()
 {
     UniValue result(UniValue::VARR); std::vector<uint256> txids; struct CCcontract_info *cp,C; uint256 txid,hashBlock,oracletxid,tokenid; CTransaction vintx; std::string coin; int64_t totalsupply; char str[65],depositaddr[64]; uint8_t M,N,taddr,prefix,prefix2,wiftype; std::vector<CPubKey> pubkeys;
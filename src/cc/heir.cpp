@@ -1059,7 +1059,18 @@ UniValue HeirClaimCaller(uint256 fundingtxid, int64_t txfee, std::string strAmou
  * plan name, owner and heir pubkeys, funds deposited and available, flag if spending is enabled for the heir
  * @return heir info data
  */
+static UniValue _HeirInfo(uint256 fundingtxid);
+
+// the plan's funding and spending txs and the tip time decide its state, wallets polling heirinfo
+// get the last result until a block or mempool tx changes it
+static CCQueryCache heirQueries;
+
 UniValue HeirInfo(uint256 fundingtxid)
+{
+    return(heirQueries.Get(fundingtxid.GetHex(),[&]() { return(_HeirInfo(fundingtxid)); }));
+}
+
+static UniValue _HeirInfo(uint256 fundingtxid)
 {
     UniValue result(UniValue::VOBJ);
     
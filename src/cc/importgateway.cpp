@@ -1017,7 +1017,7 @@ std::string ImportGatewayMarkDone(uint64_t txfee,uint256 completetxid,std::strin
     return("");
 }
 
-UniValue ImportGatewayPendingWithdraws(uint256 bindtxid,std::string refcoin)
+static UniValue _ImportGatewayPendingWithdraws(uint256 bindtxid,std::string refcoin)
 {
     UniValue result(UniValue::VOBJ),pending(UniValue::VARR); CTransaction tx; std::string coin,hex; CPubKey mypk,importgatewaypk,withdrawpub,signerpk;
     std::vector<CPubKey> msigpubkeys; uint256 hashBlock,txid,tmpbindtxid,tmptokenid,oracletxid,withdrawtxid; uint8_t K,M,N,taddr,prefix,prefix2,wiftype;
@@ -1104,7 +1104,7 @@ UniValue ImportGatewayPendingWithdraws(uint256 bindtxid,std::string refcoin)
     return(result);
 }
 
-UniValue ImportGatewayProcessedWithdraws(uint256 bindtxid,std::string refcoin)
+static UniValue _ImportGatewayProcessedWithdraws(uint256 bindtxid,std::string refcoin)
 {
     UniValue result(UniValue::VOBJ),processed(UniValue::VARR); CTransaction tx; std::string coin,hex; 
     CPubKey mypk,importgatewaypk,withdrawpub; std::vector<CPubKey> msigpubkeys;
@@ -1170,6 +1170,22 @@ UniValue ImportGatewayProcessedWithdraws(uint256 bindtxid,std::string refcoin)
     return(result);
 }
 
+// withdraw and signing states are the unspent markers on the importgateway address,
+// signers polling the lists below get the last result until a block or mempool tx changes them
+static CCQueryCache importgatewayQueries;
+
+UniValue ImportGatewayPendingWithdraws(uint256 bindtxid,std::string refcoin)
+{
+    std::string key = "pendingwithdraws" + HexStr(pubkey2pk(Mypubkey())) + bindtxid.GetHex() + refcoin;
+    return(importgatewayQueries.Get(key,[&]() { return(_ImportGatewayPendingWithdraws(bindtxid,refcoin)); }));
+}
+
+UniValue ImportGatewayProcessedWithdraws(uint256 bindtxid,std::string refcoin)
+{
+    std::string key = "processedwithdraws" + HexStr(pubkey2pk(Mypubkey())) + bindtxid.GetHex() + refcoin;
+    return(importgatewayQueries.Get(key,[&]() { return(_ImportGatewayProcessedWithdraws(bindtxid,refcoin)); }));
+}
+
 UniValue ImportGatewayList()
 {
     UniValue result(UniValue::VARR); std::vector<uint256> txids;
@@ -154,36 +154,94 @@ int32_t MarmaraGetcreatetxid(uint256 &createtxid,uint256 txid)
     return(-1);
 }
 
+// credit loops walked from their create tx: createtxid -> loop txids up to the baton. Spends confirmed at or
+// below the recorded tip stay put while that tip is on the active chain, so the next walk resumes after them
+// instead of following the whole loop again.
+struct marmara_loop
+{
+    std::vector<uint256> creditloop;
+    uint256 batontxid,tiphash;
+    unsigned int mempoolupdates;
+    int32_t n,numconfirmed;
+};
+static CCriticalSection cs_marmaraloops;
+static std::map<uint256,marmara_loop> mapMarmaraLoops;
+static std::deque<uint256> dqMarmaraLoops;   // insertion order, oldest dropped first
+static const size_t MAX_MARMARA_LOOPS = 10000;
+
+static int32_t MarmaraWalkloop(marmara_loop &loop,int32_t tipheight,uint256 txid)
+{
+    uint256 spenttxid; int64_t value; int32_t vini,height,vout = 0;
+    while ( CCgetspenttxid(spenttxid,vini,height,txid,vout) == 0 )
+    {
+        if ( loop.numconfirmed == (int32_t)loop.creditloop.size() && height > 0 && height <= tipheight )
+            loop.numconfirmed++;
+        loop.creditloop.push_back(txid);
+        //fprintf(stderr,"%d: %s\n",(int32_t)loop.creditloop.size(),txid.GetHex().c_str());
+        if ( (value= CCgettxout(spenttxid,vout,1,1)) == 10000 )
+        {
+            loop.batontxid = spenttxid;
+            //fprintf(stderr,"got baton %s %.8f\n",loop.batontxid.GetHex().c_str(),(double)value/COIN);
+            return((int32_t)loop.creditloop.size());
+        }
+        else if ( value > 0 )
+        {
+            loop.batontxid = spenttxid;
+            fprintf(stderr,"n.%d got false baton %s/v%d %.8f\n",(int32_t)loop.creditloop.size(),loop.batontxid.GetHex().c_str(),vout,(double)value/COIN);
+            return((int32_t)loop.creditloop.size());
+        }
+        // get funcid
+        txid = spenttxid;
+    }
+    return(-1);
+}
+
 int32_t MarmaraGetbatontxid(std::vector<uint256> &creditloop,uint256 &batontxid,uint256 txid)
 {
-    uint256 createtxid,spenttxid; int64_t value; int32_t vini,height,n=0,vout = 0;
+    uint256 createtxid; marmara_loop loop; bool found = false; CCChainView view; CBlockIndex *pindex;
     memset(&batontxid,0,sizeof(batontxid));
-    if ( MarmaraGetcreatetxid(createtxid,txid) == 0 )
+    if ( MarmaraGetcreatetxid(createtxid,txid) != 0 )
+        return(-1);
+    //fprintf(stderr,"txid.%s -> createtxid %s\n",txid.GetHex().c_str(),createtxid.GetHex().c_str());
+    unsigned int mempoolupdates = mempool.GetTransactionsUpdated();
+    uint256 tiphash = view.Tip() != 0 ? view.Tip()->GetBlockHash() : uint256();
+    {
+        LOCK(cs_marmaraloops);
+        std::map<uint256,marmara_loop>::const_iterator it = mapMarmaraLoops.find(createtxid);
+        if ( it != mapMarmaraLoops.end() )
+            loop = it->second, found = true;
+    }
+    if ( found == false || loop.tiphash != tiphash || loop.mempoolupdates != mempoolupdates )
     {
         txid = createtxid;
-        //fprintf(stderr,"txid.%s -> createtxid %s\n",txid.GetHex().c_str(),createtxid.GetHex().c_str());
-        while ( CCgetspenttxid(spenttxid,vini,height,txid,vout) == 0 )
+        if ( found != false && loop.numconfirmed > 0 && (pindex= view.LookupBlockIndex(loop.tiphash)) != 0 && view.Contains(pindex) )
         {
-            creditloop.push_back(txid);
-            //fprintf(stderr,"%d: %s\n",n,txid.GetHex().c_str());
-            n++;
-            if ( (value= CCgettxout(spenttxid,vout,1,1)) == 10000 )
-            {
-                batontxid = spenttxid;
-                //fprintf(stderr,"got baton %s %.8f\n",batontxid.GetHex().c_str(),(double)value/COIN);
-                return(n);
-            }
-            else if ( value > 0 )
+            // redo the last confirmed step, what its spender did with the baton may have changed
+            loop.numconfirmed--;
+            txid = loop.creditloop[loop.numconfirmed];
+            loop.creditloop.resize(loop.numconfirmed);
+        }
+        else loop.creditloop.clear(), loop.numconfirmed = 0;
+        loop.batontxid = zeroid;
+        loop.n = MarmaraWalkloop(loop,view.Height(),txid);
+        loop.tiphash = tiphash;
+        loop.mempoolupdates = mempoolupdates;
+        LOCK(cs_marmaraloops);
+        if ( mapMarmaraLoops.count(createtxid) == 0 )
+        {
+            dqMarmaraLoops.push_back(createtxid);
+            while ( dqMarmaraLoops.size() > MAX_MARMARA_LOOPS )
             {
-                batontxid = spenttxid;
-                fprintf(stderr,"n.%d got false baton %s/v%d %.8f\n",n,batontxid.GetHex().c_str(),vout,(double)value/COIN);
-                return(n);
+                mapMarmaraLoops.erase(dqMarmaraLoops.front());
+                dqMarmaraLoops.pop_front();
             }
-            // get funcid
-            txid = spenttxid;
         }
+        mapMarmaraLoops[createtxid] = loop;
     }
-    return(-1);
+    creditloop.insert(creditloop.end(),loop.creditloop.begin(),loop.creditloop.end());
+    if ( loop.n > 0 )
+        batontxid = loop.batontxid;
+    return(loop.n);
 }
 
 CScript Marmara_scriptPubKey(int32_t height,CPubKey pk)
@@ -661,9 +719,52 @@ UniValue MarmaraSettlement(uint64_t txfee,uint256 refbatontxid)
     return(result);
 }
 
+// what MarmaraGetCreditloops needs from the txs on the global address, keyed by txid. It only depends on
+// the tx itself, so entries never go stale and a repeated scan does no tx lookups for the txs it has seen.
+struct marmara_issuance
+{
+    bool fIssuance;
+    CPubKey senderpk;
+    int64_t amount;
+    int32_t matures;
+    std::string currency;
+};
+static CCriticalSection cs_marmaraissuances;
+static std::map<uint256,marmara_issuance> mapMarmaraIssuances;
+static std::deque<uint256> dqMarmaraIssuances;   // insertion order, oldest dropped first
+static const size_t MAX_MARMARA_ISSUANCES = 100000;
+
+static bool MarmaraGetIssuance(marmara_issuance &issuance,uint256 txid)
+{
+    CTransaction tx; uint256 createtxid,hashBlock; int32_t numvouts;
+    {
+        LOCK(cs_marmaraissuances);
+        std::map<uint256,marmara_issuance>::const_iterator it = mapMarmaraIssuances.find(txid);
+        if ( it != mapMarmaraIssuances.end() )
+        {
+            issuance = it->second;
+            return(true);
+        }
+    }
+    if ( myGetTransaction(txid,tx,hashBlock) == 0 )
+        return(false);
+    issuance.fIssuance = tx.IsCoinBase() == 0 && (numvouts= tx.vout.size()) > 2 && tx.vout[numvouts - 1].nValue == 0 && MarmaraDecodeLoopOpret(tx.vout[numvouts-1].scriptPubKey,createtxid,issuance.senderpk,issuance.amount,issuance.matures,issuance.currency) == 'I';
+    LOCK(cs_marmaraissuances);
+    if ( mapMarmaraIssuances.insert(std::make_pair(txid,issuance)).second )
+    {
+        dqMarmaraIssuances.push_back(txid);
+        while ( dqMarmaraIssuances.size() > MAX_MARMARA_ISSUANCES )
+        {
+            mapMarmaraIssuances.erase(dqMarmaraIssuances.front());
+            dqMarmaraIssuances.pop_front();
+        }
+    }
+    return(true);
+}
+
 int32_t MarmaraGetCreditloops(int64_t &totalamount,std::vector<uint256> &issuances,int64_t &totalclosed,std::vector<uint256> &closed,struct CCcontract_info *cp,int32_t firstheight,int32_t lastheight,int64_t minamount,int64_t maxamount,CPubKey refpk,std::string refcurrency)
 {
-    char coinaddr[64]; CPubKey Marmarapk,senderpk; int64_t amount; uint256 createtxid,txid,hashBlock; CTransaction tx; int32_t numvouts,vout,matures,n=0; std::string currency;
+    char coinaddr[64]; CPubKey Marmarapk; uint256 txid; int32_t vout,n=0; marmara_issuance issuance;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
     Marmarapk = GetUnspendable(cp,0);
     GetCCaddress(cp,coinaddr,Marmarapk);
@@ -675,18 +776,15 @@ int32_t MarmaraGetCreditloops(int64_t &totalamount,std::vector<uint256> &issuanc
         txid = it->first.txhash;
         vout = (int32_t)it->first.index;
         //fprintf(stderr,"txid.%s/v%d\n",txid.GetHex().c_str(),vout);
-        if ( vout == 1 && myGetTransaction(txid,tx,hashBlock) != 0 )
+        if ( vout == 1 && MarmaraGetIssuance(issuance,txid) != 0 )
         {
-            if ( tx.IsCoinBase() == 0 && (numvouts= tx.vout.size()) > 2 && tx.vout[numvouts - 1].nValue == 0 )
+            if ( issuance.fIssuance != 0 )
             {
-                if ( MarmaraDecodeLoopOpret(tx.vout[numvouts-1].scriptPubKey,createtxid,senderpk,amount,matures,currency) == 'I' )
+                n++;
+                if ( issuance.currency == refcurrency && issuance.matures >= firstheight && issuance.matures <= lastheight && issuance.amount >= minamount && issuance.amount <= maxamount && (refpk.size() == 0 || issuance.senderpk == refpk) )
                 {
-                    n++;
-                    if ( currency == refcurrency && matures >= firstheight && matures <= lastheight && amount >= minamount && amount <= maxamount && (refpk.size() == 0 || senderpk == refpk) )
-                    {
-                        issuances.push_back(txid);
-                        totalamount += amount;
-                    }
+                    issuances.push_back(txid);
+                    totalamount += issuance.amount;
                 }
             }
         } else fprintf(stderr,"error getting tx\n");
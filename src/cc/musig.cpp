@@ -219,11 +219,10 @@ struct musig_info
     secp256k1_pubkey *nonces; //[N_SIGNERS];
     secp256k1_musig_partial_signature *partial_sig; //[N_SIGNERS];
     int32_t myind,num,numcommits,numnonces,numpartials;
+    uint32_t lasttime;
     uint8_t msg[32],pkhash[32],combpk[33];
 };
 
-std::vector <struct musig_info *> MUSIG;
-
 struct musig_info *musig_infocreate(int32_t myind,int32_t num)
 {
     int32_t i; struct musig_info *mp = (struct musig_info *)calloc(1,sizeof(*mp));
@@ -269,6 +268,62 @@ void musig_infofree(struct musig_info *mp)
     free(mp);
 }
 
+// Signing sessions are kept under (pkhash, slot), the slot being the optional last param of each step, so any
+// number of sessions over the same or different signer sets can run side by side and each step finds its session
+// with one map lookup. A session that isnt touched for MUSIG_SESSION_EXPIRY seconds is dropped, and past
+// MAX_MUSIG_SESSIONS the least recently used one goes first. cs_musig is held for the whole of a step.
+typedef std::pair<uint256,int32_t> musig_key;
+static CCriticalSection cs_musig;
+static std::map<musig_key,struct musig_info *> mapMusigSessions;
+static const size_t MAX_MUSIG_SESSIONS = 1000;
+static const uint32_t MUSIG_SESSION_EXPIRY = 3600;
+
+musig_key musig_sessionkey(const uint8_t *pkhash,int32_t slot)
+{
+    uint256 hash;
+    memcpy(hash.begin(),pkhash,32);
+    return(std::make_pair(hash,slot));
+}
+
+struct musig_info *musig_sessionfind(const uint8_t *pkhash,int32_t slot)
+{
+    AssertLockHeld(cs_musig);
+    std::map<musig_key,struct musig_info *>::iterator it = mapMusigSessions.find(musig_sessionkey(pkhash,slot));
+    if ( it == mapMusigSessions.end() )
+        return(0);
+    it->second->lasttime = (uint32_t)time(NULL);
+    return(it->second);
+}
+
+void musig_sessionadd(struct musig_info *mp,int32_t slot)
+{
+    std::map<musig_key,struct musig_info *>::iterator it,oldest; uint32_t now = (uint32_t)time(NULL);
+    AssertLockHeld(cs_musig);
+    if ( (it= mapMusigSessions.find(musig_sessionkey(mp->pkhash,slot))) != mapMusigSessions.end() )
+    {
+        musig_infofree(it->second);
+        mapMusigSessions.erase(it);
+    }
+    for (it=mapMusigSessions.begin(); it!=mapMusigSessions.end(); )
+    {
+        if ( now > it->second->lasttime + MUSIG_SESSION_EXPIRY )
+        {
+            musig_infofree(it->second);
+            mapMusigSessions.erase(it++);
+        } else ++it;
+    }
+    while ( mapMusigSessions.size() >= MAX_MUSIG_SESSIONS )
+    {
+        for (oldest=it=mapMusigSessions.begin(); it!=mapMusigSessions.end(); ++it)
+            if ( it->second->lasttime < oldest->second->lasttime )
+                oldest = it;
+        musig_infofree(oldest->second);
+        mapMusigSessions.erase(oldest);
+    }
+    mp->lasttime = now;
+    mapMusigSessions[musig_sessionkey(mp->pkhash,slot)] = mp;
+}
+
 CScript musig_sendopret(uint8_t funcid,CPubKey pk)
 {
     CScript opret; uint8_t evalcode = EVAL_MUSIG;
@@ -413,7 +468,7 @@ UniValue musig_combine(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
 UniValue musig_session(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
 {
     static secp256k1_context *ctx;
-    UniValue result(UniValue::VOBJ); int32_t i,n,myind,num,musiglocation; char *pkstr,*pkhashstr,*msgstr; uint8_t session[32],msg[32],pkhash[32],privkey[32],pub33[33]; CPubKey pk; char str[67];
+    UniValue result(UniValue::VOBJ); int32_t i,n,myind,num,slot; char *pkstr,*pkhashstr,*msgstr; uint8_t session[32],msg[32],pkhash[32],privkey[32],pub33[33]; CPubKey pk; char str[67]; struct musig_info *mp;
     if ( ctx == 0 )
         ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
     if ( params != 0 && (n= cJSON_GetArraySize(params)) >= 5 )
@@ -423,24 +478,25 @@ UniValue musig_session(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
         if ( myind < 0 || myind >= num || num <= 0 )
             return(cclib_error(result,"illegal myindex and numsigners"));
         if ( n > 5 )
-            musiglocation = juint(jitem(params,5),0);
+            slot = juint(jitem(params,5),0);
         else if ( n == 5 )
-            musiglocation = 0;
-        //printf("number of params.%i musiglocation.%i\n",n,musiglocation);
-        if ( MUSIG.size() > musiglocation )
+            slot = 0;
+        mp = musig_infocreate(myind,num);
+        if ( musig_parsepubkey(ctx,mp->combined_pk,jitem(params,2)) < 0 )
         {
-            for (int i = 0; i < MUSIG.size()-1; i++)
-                musig_infofree(MUSIG[i]);
-            MUSIG.clear();
-        }
-        struct musig_info *temp_musig = musig_infocreate(myind,num);
-        MUSIG.push_back(temp_musig);
-        if ( musig_parsepubkey(ctx,MUSIG[musiglocation]->combined_pk,jitem(params,2)) < 0 )
+            musig_infofree(mp);
             return(cclib_error(result,"error parsing combined_pubkey"));
-        else if ( cclib_parsehash(MUSIG[musiglocation]->pkhash,jitem(params,3),32) < 0 )
+        }
+        else if ( cclib_parsehash(mp->pkhash,jitem(params,3),32) < 0 )
+        {
+            musig_infofree(mp);
             return(cclib_error(result,"error parsing pkhash"));
-        else if ( cclib_parsehash(MUSIG[musiglocation]->msg,jitem(params,4),32) < 0 )
+        }
+        else if ( cclib_parsehash(mp->msg,jitem(params,4),32) < 0 )
+        {
+            musig_infofree(mp);
             return(cclib_error(result,"error parsing msg"));
+        }
         Myprivkey(privkey);
         GetRandBytes(session,32);
             /** Initializes a signing session for a signer
@@ -469,17 +525,20 @@ UniValue musig_session(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
              *           my_index: index of this signer in the signers array
              *             seckey: the signer's 32-byte secret key (cannot be NULL)
              */
-        //fprintf(stderr, "SESSION: struct_size.%li using struct %i\n",MUSIG.size(), musiglocation);
-        if ( secp256k1_musig_session_initialize(ctx,&MUSIG[musiglocation]->session,MUSIG[musiglocation]->signer_data, &MUSIG[musiglocation]->nonce_commitments[MUSIG[musiglocation]->myind * 32],session,MUSIG[musiglocation]->msg,&MUSIG[musiglocation]->combined_pk,MUSIG[musiglocation]->pkhash,MUSIG[musiglocation]->num,MUSIG[musiglocation]->myind,privkey) > 0 )
+        if ( secp256k1_musig_session_initialize(ctx,&mp->session,mp->signer_data,&mp->nonce_commitments[mp->myind * 32],session,mp->msg,&mp->combined_pk,mp->pkhash,mp->num,mp->myind,privkey) > 0 )
         {
             memset(session,0,sizeof(session));
             result.push_back(Pair("myind",(int64_t)myind));
             result.push_back(Pair("numsigners",(int64_t)num));
             for (i=0; i<32; i++)
-                sprintf(&str[i<<1],"%02x",MUSIG[musiglocation]->nonce_commitments[MUSIG[musiglocation]->myind*32 + i]);
+                sprintf(&str[i<<1],"%02x",mp->nonce_commitments[mp->myind*32 + i]);
             str[64] = 0;
             if ( n == 5 )
-                MUSIG[musiglocation]->numcommits = 1;
+                mp->numcommits = 1;
+            {
+                LOCK(cs_musig);
+                musig_sessionadd(mp,slot);
+            }
             result.push_back(Pair("commitment",str));
             result.push_back(Pair("result","success"));
             memset(privkey,0,sizeof(privkey));
@@ -489,6 +548,7 @@ UniValue musig_session(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
         {
             memset(privkey,0,sizeof(privkey));
             memset(session,0,sizeof(session));
+            musig_infofree(mp);
             return(cclib_error(result,"couldnt initialize session"));
         }
     } else return(cclib_error(result,"wrong number of params, need 5: myindex, numsigners, combined_pk, pkhash, msg32"));
@@ -498,22 +558,23 @@ UniValue musig_commit(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
 {
     static secp256k1_context *ctx;
     size_t clen = CPubKey::PUBLIC_KEY_SIZE;
-    UniValue result(UniValue::VOBJ); int32_t i,n,ind,myind; uint8_t pkhash[32]; CPubKey pk; char str[67];
+    UniValue result(UniValue::VOBJ); int32_t i,n,ind,slot; uint8_t pkhash[32]; CPubKey pk; char str[67]; struct musig_info *mp;
     if ( ctx == 0 )
         ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
     if ( params != 0 && (n= cJSON_GetArraySize(params)) >= 3 )
     {
         if ( n > 3 )
-            myind = juint(jitem(params,3),0);
+            slot = juint(jitem(params,3),0);
         else if ( n == 3 )
-            myind = 0;
+            slot = 0;
+        LOCK(cs_musig);
         if ( cclib_parsehash(pkhash,jitem(params,0),32) < 0 )
             return(cclib_error(result,"error parsing pkhash"));
-        else if ( memcmp(MUSIG[myind]->pkhash,pkhash,32) != 0 )
-            return(cclib_error(result,"pkhash doesnt match session pkhash"));
-        else if ( (ind= juint(jitem(params,1),0)) < 0 || ind >= MUSIG[myind]->num )
+        else if ( (mp= musig_sessionfind(pkhash,slot)) == 0 )
+            return(cclib_error(result,"no session for pkhash"));
+        else if ( (ind= juint(jitem(params,1),0)) < 0 || ind >= mp->num )
             return(cclib_error(result,"illegal ind for session"));
-        else if ( cclib_parsehash(&MUSIG[myind]->nonce_commitments[ind*32],jitem(params,2),32) < 0 )
+        else if ( cclib_parsehash(&mp->nonce_commitments[ind*32],jitem(params,2),32) < 0 )
             return(cclib_error(result,"error parsing commitment"));
         /** Gets the signer's public nonce given a list of all signers' data with commitments
          *
@@ -531,18 +592,17 @@ UniValue musig_commit(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
          *                    number of signers participating in the MuSig.
          */
         result.push_back(Pair("added_index",ind));
-        //fprintf(stderr, "COMMIT: struct_size.%li using_struct.%i added_index.%i\n",MUSIG.size(), myind, ind);
-        MUSIG[myind]->numcommits++;
-        if ( MUSIG[myind]->numcommits >= MUSIG[myind]->num && secp256k1_musig_session_get_public_nonce(ctx,&MUSIG[myind]->session,MUSIG[myind]->signer_data,&MUSIG[myind]->nonces[MUSIG[myind]->myind],MUSIG[myind]->commitment_ptrs,MUSIG[myind]->num) > 0 )
+        mp->numcommits++;
+        if ( mp->numcommits >= mp->num && secp256k1_musig_session_get_public_nonce(ctx,&mp->session,mp->signer_data,&mp->nonces[mp->myind],mp->commitment_ptrs,mp->num) > 0 )
         {
-            if ( secp256k1_ec_pubkey_serialize(ctx,(uint8_t *)pk.begin(),&clen,&MUSIG[myind]->nonces[MUSIG[myind]->myind],SECP256K1_EC_COMPRESSED) > 0 && clen == 33 )
+            if ( secp256k1_ec_pubkey_serialize(ctx,(uint8_t *)pk.begin(),&clen,&mp->nonces[mp->myind],SECP256K1_EC_COMPRESSED) > 0 && clen == 33 )
             {
                 for (i=0; i<33; i++)
                     sprintf(&str[i<<1],"%02x",((uint8_t *)pk.begin())[i]);
                 str[66] = 0;
                 if ( n == 3 )
-                    MUSIG[myind]->numnonces = 1;
-                result.push_back(Pair("myind",MUSIG[myind]->myind));
+                    mp->numnonces = 1;
+                result.push_back(Pair("myind",mp->myind));
                 result.push_back(Pair("nonce",str));
                 result.push_back(Pair("result","success"));
             } else return(cclib_error(result,"error serializing nonce (pubkey)"));
@@ -559,22 +619,23 @@ UniValue musig_commit(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
 UniValue musig_nonce(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
 {
     static secp256k1_context *ctx;
-    UniValue result(UniValue::VOBJ); int32_t i,n,ind,myind; uint8_t pkhash[32],psig[32]; CPubKey pk; char str[67];
+    UniValue result(UniValue::VOBJ); int32_t i,n,ind,slot; uint8_t pkhash[32],psig[32]; CPubKey pk; char str[67]; struct musig_info *mp;
     if ( ctx == 0 )
         ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
     if ( params != 0 && (n= cJSON_GetArraySize(params)) >= 3 )
     {
         if ( n > 3 )
-            myind = juint(jitem(params,3),0);
+            slot = juint(jitem(params,3),0);
         else if ( n == 3 )
-            myind = 0;
+            slot = 0;
+        LOCK(cs_musig);
         if ( cclib_parsehash(pkhash,jitem(params,0),32) < 0 )
             return(cclib_error(result,"error parsing pkhash"));
-        else if ( memcmp(MUSIG[myind]->pkhash,pkhash,32) != 0 )
-            return(cclib_error(result,"pkhash doesnt match session pkhash"));
-        else if ( (ind= juint(jitem(params,1),0)) < 0 || ind >= MUSIG[myind]->num )
+        else if ( (mp= musig_sessionfind(pkhash,slot)) == 0 )
+            return(cclib_error(result,"no session for pkhash"));
+        else if ( (ind= juint(jitem(params,1),0)) < 0 || ind >= mp->num )
             return(cclib_error(result,"illegal ind for session"));
-        else if ( musig_parsepubkey(ctx,MUSIG[myind]->nonces[ind],jitem(params,2)) < 0 )
+        else if ( musig_parsepubkey(ctx,mp->nonces[ind],jitem(params,2)) < 0 )
             return(cclib_error(result,"error parsing nonce"));
         result.push_back(Pair("added_index",ind));
         /** Checks a signer's public nonce against a commitment to said nonce, and update
@@ -588,17 +649,16 @@ UniValue musig_nonce(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
          *                  with `musig_session_initialize_verifier`.
          *  In:     nonce: signer's alleged public nonce (cannot be NULL)
          */
-        MUSIG[myind]->numnonces++;
-        //fprintf(stderr, "NONCE: struct_size.%li using_struct.%i added_index.%i numnounces.%i num.%i\n",MUSIG.size(), myind, ind, MUSIG[myind]->numnonces, MUSIG[myind]->num);
-        if ( MUSIG[myind]->numnonces < MUSIG[myind]->num )
+        mp->numnonces++;
+        if ( mp->numnonces < mp->num )
         {
             result.push_back(Pair("status","not enough nonces"));
             result.push_back(Pair("result","success"));
             return(result);
         }
-        for (i=0; i<MUSIG[myind]->num; i++)
+        for (i=0; i<mp->num; i++)
         {
-            if ( secp256k1_musig_set_nonce(ctx,&MUSIG[myind]->signer_data[i],&MUSIG[myind]->nonces[i]) == 0 )
+            if ( secp256k1_musig_set_nonce(ctx,&mp->signer_data[i],&mp->nonces[i]) == 0 )
                 return(cclib_error(result,"error setting nonce"));
         }
         /** Updates a session with the combined public nonce of all signers. The combined
@@ -619,20 +679,20 @@ UniValue musig_nonce(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
          *           adaptor: point to add to the combined public nonce. If NULL, nothing is
          *                    added to the combined nonce.
          */
-        if ( secp256k1_musig_session_combine_nonces(ctx,&MUSIG[myind]->session,MUSIG[myind]->signer_data,MUSIG[myind]->num,NULL,NULL) > 0 )
+        if ( secp256k1_musig_session_combine_nonces(ctx,&mp->session,mp->signer_data,mp->num,NULL,NULL) > 0 )
         {
-            if ( secp256k1_musig_partial_sign(ctx,&MUSIG[myind]->session,&MUSIG[myind]->partial_sig[MUSIG[myind]->myind]) > 0 )
+            if ( secp256k1_musig_partial_sign(ctx,&mp->session,&mp->partial_sig[mp->myind]) > 0 )
             {
-                if ( secp256k1_musig_partial_signature_serialize(ctx,psig,&MUSIG[myind]->partial_sig[MUSIG[myind]->myind]) > 0 )
+                if ( secp256k1_musig_partial_signature_serialize(ctx,psig,&mp->partial_sig[mp->myind]) > 0 )
                 {
                     for (i=0; i<32; i++)
                         sprintf(&str[i<<1],"%02x",psig[i]);
                     str[64] = 0;
-                    result.push_back(Pair("myind",MUSIG[myind]->myind));
+                    result.push_back(Pair("myind",mp->myind));
                     result.push_back(Pair("partialsig",str));
                     result.push_back(Pair("result","success"));
                     if ( n == 3 )
-                        MUSIG[myind]->numpartials = 1;
+                        mp->numpartials = 1;
                     return(result);
                 } else return(cclib_error(result,"error serializing partial sig"));
             } else return(cclib_error(result,"error making partial sig"));
@@ -643,29 +703,29 @@ UniValue musig_nonce(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
 UniValue musig_partialsig(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
 {
     static secp256k1_context *ctx;
-    UniValue result(UniValue::VOBJ); int32_t i,ind,n,myind; uint8_t pkhash[32],psig[32],out64[64]; char str[129]; secp256k1_schnorrsig sig;
+    UniValue result(UniValue::VOBJ); int32_t i,ind,n,slot; uint8_t pkhash[32],psig[32],out64[64]; char str[129]; secp256k1_schnorrsig sig; struct musig_info *mp;
     if ( ctx == 0 )
         ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
     if ( params != 0 && (n= cJSON_GetArraySize(params)) >= 3 )
     {
         if ( n > 3 )
-            myind = juint(jitem(params,3),0);
+            slot = juint(jitem(params,3),0);
         else if ( n == 3 )
-            myind = 0;
+            slot = 0;
+        LOCK(cs_musig);
         if ( cclib_parsehash(pkhash,jitem(params,0),32) < 0 )
             return(cclib_error(result,"error parsing pkhash"));
-        else if ( memcmp(MUSIG[myind]->pkhash,pkhash,32) != 0 )
-            return(cclib_error(result,"pkhash doesnt match session pkhash"));
-        else if ( (ind= juint(jitem(params,1),0)) < 0 || ind >= MUSIG[myind]->num )
+        else if ( (mp= musig_sessionfind(pkhash,slot)) == 0 )
+            return(cclib_error(result,"no session for pkhash"));
+        else if ( (ind= juint(jitem(params,1),0)) < 0 || ind >= mp->num )
             return(cclib_error(result,"illegal ind for session"));
         else if ( cclib_parsehash(psig,jitem(params,2),32) < 0 )
             return(cclib_error(result,"error parsing psig"));
-        else if ( secp256k1_musig_partial_signature_parse(ctx,&MUSIG[myind]->partial_sig[ind],psig) == 0 )
+        else if ( secp256k1_musig_partial_signature_parse(ctx,&mp->partial_sig[ind],psig) == 0 )
             return(cclib_error(result,"error parsing partialsig"));
         result.push_back(Pair("added_index",ind));
-        //fprintf(stderr, "SIG: struct_size.%li using_struct.%i added_index.%i\n",MUSIG.size(), myind, ind);
-        MUSIG[myind]->numpartials++;
-        if ( MUSIG[myind]->numpartials >= MUSIG[myind]->num && secp256k1_musig_partial_sig_combine(ctx,&MUSIG[myind]->session,&sig,MUSIG[myind]->partial_sig,MUSIG[myind]->num) > 0 )
+        mp->numpartials++;
+        if ( mp->numpartials >= mp->num && secp256k1_musig_partial_sig_combine(ctx,&mp->session,&sig,mp->partial_sig,mp->num) > 0 )
         {
             if ( secp256k1_schnorrsig_serialize(ctx,out64,&sig) > 0 )
             {
@@ -678,7 +738,7 @@ UniValue musig_partialsig(uint64_t txfee,struct CCcontract_info *cp,cJSON *param
         }
         else
         {
-            if ( secp256k1_musig_partial_signature_serialize(ctx,psig,&MUSIG[myind]->partial_sig[MUSIG[myind]->myind]) > 0 )
+            if ( secp256k1_musig_partial_signature_serialize(ctx,psig,&mp->partial_sig[mp->myind]) > 0 )
             {
                 result.push_back(Pair("myind",ind));
                 for (i=0; i<32; i++)
@@ -166,6 +166,50 @@ uint8_t DecodeOraclesData(const CScript &scriptPubKey,uint256 &oracletxid,uint25
     return(0);
 }
 
+// Decoded samples of confirmed data txs, keyed by txid. The txid pins the contents and, as
+// myGetTransaction serves confirmed txs from the tx index, a confirmed sample stays readable,
+// so walks down a baton chain can skip the disk read and decode of the samples seen before.
+struct oracle_sample
+{
+    uint256 oracletxid,batontxid; CPubKey pk; std::vector<uint8_t> data; bool marker;
+};
+static CCriticalSection cs_oraclesamples;
+static std::map<uint256, oracle_sample> mapOracleSamples;
+static std::deque<uint256> dqOracleSamples;   // insertion order, oldest dropped first
+static const size_t MAX_ORACLE_SAMPLES = 100000;
+
+uint8_t DecodeOraclesDataTx(uint256 txid,uint256 &oracletxid,uint256 &batontxid,CPubKey &pk,std::vector <uint8_t>&data,bool &marker)
+{
+    CTransaction tx; uint256 hashBlock; int32_t numvouts; oracle_sample sample;
+    {
+        LOCK(cs_oraclesamples);
+        std::map<uint256, oracle_sample>::const_iterator it = mapOracleSamples.find(txid);
+        if ( it != mapOracleSamples.end() )
+        {
+            oracletxid = it->second.oracletxid, batontxid = it->second.batontxid, pk = it->second.pk;
+            data = it->second.data, marker = it->second.marker;
+            return('D');
+        }
+    }
+    if ( myGetTransaction(txid,tx,hashBlock) == 0 || (numvouts= tx.vout.size()) <= 0 || DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,batontxid,pk,data) != 'D' )
+        return(0);
+    marker = (numvouts > 1 && tx.vout[1].nValue == CC_MARKER_VALUE);
+    if ( hashBlock.IsNull() || SAFECOIN_NSPV_SUPERLITE )   // a mempool tx may never confirm
+        return('D');
+    sample.oracletxid = oracletxid, sample.batontxid = batontxid, sample.pk = pk, sample.data = data, sample.marker = marker;
+    LOCK(cs_oraclesamples);
+    if ( mapOracleSamples.insert(std::make_pair(txid,sample)).second )
+    {
+        dqOracleSamples.push_back(txid);
+        while ( dqOracleSamples.size() > MAX_ORACLE_SAMPLES )
+        {
+            mapOracleSamples.erase(dqOracleSamples.front());
+            dqOracleSamples.pop_front();
+        }
+    }
+    return('D');
+}
+
 CPubKey OracleBatonPk(char *batonaddr,struct CCcontract_info *cp)
 {
     static secp256k1_context *ctx;
@@ -1106,22 +1150,20 @@ UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num)
             {
                 for (std::vector<uint256>::const_iterator it=txids.end()-1; it!=txids.begin(); it--)
                 {
+                    bool marker;
                     txid=*it;
-                    if (myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts=tx.vout.size()) > 0 )
+                    if ( DecodeOraclesDataTx(txid,oracletxid,btxid,pk,data,marker) == 'D' && marker && reforacletxid == oracletxid )
                     {
-                        if ( tx.vout[1].nValue==CC_MARKER_VALUE && DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,btxid,pk,data) == 'D' && reforacletxid == oracletxid )
+                        if ( (formatstr= (char *)format.c_str()) == 0 )
+                            formatstr = (char *)"";
+                        UniValue a(UniValue::VOBJ);
+                        a.push_back(Pair("txid",txid.GetHex()));
+                        a.push_back(Pair("data",OracleFormat((uint8_t *)data.data(),(int32_t)data.size(),formatstr,(int32_t)format.size())));                            
+                        b.push_back(a);
+                        if ( ++n >= num && num != 0)
                         {
-                            if ( (formatstr= (char *)format.c_str()) == 0 )
-                                formatstr = (char *)"";
-                            UniValue a(UniValue::VOBJ);
-                            a.push_back(Pair("txid",txid.GetHex()));
-                            a.push_back(Pair("data",OracleFormat((uint8_t *)data.data(),(int32_t)data.size(),formatstr,(int32_t)format.size())));                            
-                            b.push_back(a);
-                            if ( ++n >= num && num != 0)
-                            {
-                                result.push_back(Pair("samples",b));
-                                return(result);
-                            }
+                            result.push_back(Pair("samples",b));
+                            return(result);
                         }
                     }
                 }
@@ -1214,6 +1256,16 @@ UniValue OraclesList()
 {
     UniValue result(UniValue::VARR); std::vector<uint256> txids; struct CCcontract_info *cp,C; uint256 txid,hashBlock; CTransaction createtx; std::string name,description,format; char str[65];
     cp = CCinit(&C,EVAL_ORACLES);
+    std::vector<std::pair<CCIndexKey, CCIndexValue> > ccIndex;
+    if ( GetCCIndex(EVAL_ORACLES,'C',ccIndex) )
+    {
+        for (std::vector<std::pair<CCIndexKey, CCIndexValue> >::const_iterator it=ccIndex.begin(); it!=ccIndex.end(); it++)
+        {
+            if ( DecodeOraclesCreateOpRet(it->second.opret,name,description,format) == 'C' )
+                result.push_back(uint256_str(str,it->first.txhash));
+        }
+        return(result);
+    }
     SetCCtxids(txids,cp->normaladdr,false,cp->evalcode,zeroid,'C');
     for (std::vector<uint256>::const_iterator it=txids.begin(); it!=txids.end(); it++)
     {
@@ -249,8 +249,8 @@ int64_t IsPaymentsvout(struct CCcontract_info *cp,const CTransaction& tx,int32_t
 
 bool payments_game(int32_t &top, int32_t &bottom)
 {
-    uint64_t x;
-    uint256 tmphash = chainActive[lastSnapShotHeight]->GetBlockHash();
+    uint64_t x; CCChainView view; CBlockIndex *pindex;
+    uint256 tmphash = (pindex= view.GetAncestor(lastSnapShotHeight)) != 0 ? pindex->GetBlockHash() : uint256();
     memcpy(&x,&tmphash,sizeof(x));
     bottom = ((x & 0xff) % 50);
     if ( bottom == 0 ) bottom = 1;
@@ -264,46 +264,86 @@ bool payments_game(int32_t &top, int32_t &bottom)
 
 bool payments_lockedblocks(uint256 blockhash,int32_t lockedblocks,int32_t &blocksleft)
 {
-    int32_t ht = chainActive.Height();
-    CBlockIndex* pblockindex = safecoin_blockindex(blockhash);
+    CCChainView view;
+    int32_t ht = view.Height();
+    CBlockIndex* pblockindex = view.LookupBlockIndex(blockhash);
     if ( pblockindex == 0 || pblockindex->GetHeight()+lockedblocks > ht)
     {
-        blocksleft = pblockindex->GetHeight()+lockedblocks - ht;
+        blocksleft = (pblockindex!=0?pblockindex->GetHeight():ht)+lockedblocks - ht;
         fprintf(stderr, "not elegible to be spent yet height.%i vs elegible_ht.%i blocksleft.%i\n",ht,(pblockindex!=0?pblockindex->GetHeight():0)+lockedblocks,blocksleft);
         return false; 
     }
     return true;
 }
 
+// Allocation tables resolved from the current address snapshot, keyed by (top, bottom, excluded scripts).
+// Every release, merge and validation of a snapshot plan asks for one and plans often share it;
+// the tables are dropped when safecoin_dailysnapshot rebuilds the snapshot.
+struct payments_allocations
+{
+    std::vector<CScript> scriptPubKeys; std::vector<int64_t> allocations;
+};
+typedef std::pair<std::pair<int32_t,int32_t>,std::vector<std::vector<uint8_t>>> payments_allocationskey;
+static CCriticalSection cs_paymentsallocations;
+static int32_t paymentsAllocationsSnapShot = -1;
+static std::map<payments_allocationskey,payments_allocations> mapPaymentsAllocations;
+static const size_t MAX_PAYMENTS_ALLOCATIONS = 100;
+
 int32_t payments_getallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
 {
-    mpz_t mpzAllocation; int32_t i =0;
-    for (int32_t j = bottom; j < vAddressSnapshot.size(); j++)
+    mpz_t mpzAllocation; int32_t i =0; payments_allocations entry;
+    payments_allocationskey key = std::make_pair(std::make_pair(top,bottom),excludeScriptPubKeys);
+    {
+        LOCK(cs_paymentsallocations);
+        if ( paymentsAllocationsSnapShot != numSnapShots )
+        {
+            mapPaymentsAllocations.clear();
+            paymentsAllocationsSnapShot = numSnapShots;
+        }
+        std::map<payments_allocationskey,payments_allocations>::const_iterator it = mapPaymentsAllocations.find(key);
+        if ( it != mapPaymentsAllocations.end() )
+            entry = it->second;
+        else i = -1;
+    }
+    if ( i < 0 )
     {
-        auto &address = vAddressSnapshot[j];
-        CScript scriptPubKey = GetScriptForDestination(address.second); 
-        bool skip = false;
-        // skip excluded addresses. 
+        std::vector<CScript> excluded;
         for ( auto skipkey : excludeScriptPubKeys ) 
+            excluded.push_back(CScript(skipkey.begin(), skipkey.end()));
+        i = 0;
+        for (int32_t j = bottom; j < vAddressSnapshot.size(); j++)
         {
-            if ( scriptPubKey == CScript(skipkey.begin(), skipkey.end()) )
-                skip = true;
+            auto &address = vAddressSnapshot[j];
+            CScript scriptPubKey = GetScriptForDestination(address.second); 
+            // skip excluded addresses. 
+            if ( std::find(excluded.begin(), excluded.end(), scriptPubKey) == excluded.end() )
+            {
+                i++;
+                //fprintf(stderr, "address: %s nValue.%li \n", CBitcoinAddress(address.second).ToString().c_str(), address.first);
+                entry.scriptPubKeys.push_back(scriptPubKey);
+                entry.allocations.push_back(address.first);
+            }
+            if ( i+bottom == top ) 
+                break; // we reached top amount to pay, it can be less than this, if less address exist on chain, return the number we got.
         }
-        if ( !skip )
+        LOCK(cs_paymentsallocations);
+        if ( paymentsAllocationsSnapShot == numSnapShots )
         {
-            mpz_init(mpzAllocation); 
-            i++;
-            //fprintf(stderr, "address: %s nValue.%li \n", CBitcoinAddress(address.second).ToString().c_str(), address.first);
-            scriptPubKeys.push_back(scriptPubKey);
-            allocations.push_back(address.first);
-            mpz_set_lli(mpzAllocation,address.first);
-            mpz_add(mpzTotalAllocations,mpzTotalAllocations,mpzAllocation); 
-            mpz_clear(mpzAllocation);
+            if ( mapPaymentsAllocations.size() >= MAX_PAYMENTS_ALLOCATIONS )
+                mapPaymentsAllocations.clear();
+            mapPaymentsAllocations[key] = entry;
         }
-        if ( i+bottom == top ) 
-            break; // we reached top amount to pay, it can be less than this, if less address exist on chain, return the number we got.
     }
-    return(i);
+    for ( auto allocation : entry.allocations )
+    {
+        mpz_init(mpzAllocation); 
+        mpz_set_lli(mpzAllocation,allocation);
+        mpz_add(mpzTotalAllocations,mpzTotalAllocations,mpzAllocation); 
+        mpz_clear(mpzAllocation);
+    }
+    scriptPubKeys.insert(scriptPubKeys.end(), entry.scriptPubKeys.begin(), entry.scriptPubKeys.end());
+    allocations.insert(allocations.end(), entry.allocations.begin(), entry.allocations.end());
+    return((int32_t)entry.allocations.size());
 }
 
 int32_t payments_gettokenallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, uint256 tokenid, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
@@ -809,6 +849,7 @@ UniValue PaymentsRelease(struct CCcontract_info *cp,char *jsonstr)
                 else if ( funcid == 'S' || funcid == 'O' )
                 {
                     // normal snapshot
+                    safecoin_dailysnapshot_publish(true);
                     if ( vAddressSnapshot.size() == 0 )
                     {
                         result.push_back(Pair("result","error"));
@@ -1518,7 +1559,7 @@ UniValue PaymentsInfo(struct CCcontract_info *cp,char *jsonstr)
                 // Blocks until minrelease can be released. 
                 elegiblefunds = AddPaymentsInputs(true,3,cp,mtx,txidpk,0,CC_MAXVINS,createtxid,lockedblocks,minrelease,blocksleft);
                 result.push_back(Pair("elegiblefunds",ValueFromAmount(elegiblefunds)));
-                result.push_back(Pair("min_release_height",chainActive.Height()+blocksleft));
+                result.push_back(Pair("min_release_height",CCChainView().Height()+blocksleft));
                 result.push_back(Pair("result","success"));
             }
         }
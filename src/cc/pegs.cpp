@@ -103,7 +103,7 @@ extern uint8_t DecodeGatewaysBindOpRet(char *depositaddr,const CScript &scriptPu
 extern int64_t GetTokenBalance(CPubKey pk, uint256 tokenid);
 extern int32_t safecoin_currentheight();
 extern int32_t prices_syntheticvec(std::vector<uint16_t> &vec, std::vector<std::string> synthetic);
-extern int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t minmax, int16_t leverage);
+extern int64_t prices_syntheticprice(const std::vector<uint16_t> &vec, int32_t height, int32_t minmax, int16_t leverage);
 
 CScript EncodePegsCreateOpRet(std::vector<uint256> bindtxids)
 {
@@ -1170,7 +1170,7 @@ UniValue PegsAccountInfo(const CPubKey& pk,uint256 pegstxid)
     return(result);
 }
 
-UniValue PegsWorstAccounts(uint256 pegstxid)
+static UniValue _PegsWorstAccounts(uint256 pegstxid)
 {
     char coinaddr[64]; int64_t nValue,amount; uint256 txid,accounttxid,hashBlock,tmppegstxid,tokenid,prev;
     CTransaction tx; int32_t numvouts,vout; char funcid; CPubKey pegspk,pk; double ratio; std::vector<uint256> bindtxids;
@@ -1224,6 +1224,14 @@ UniValue PegsWorstAccounts(uint256 pegstxid)
     return(result);
 }
 
+// accounts are the unspent markers on the pegs address, priced from oracle samples on chain
+static CCQueryCache pegsQueries;
+
+UniValue PegsWorstAccounts(uint256 pegstxid)
+{
+    return(pegsQueries.Get("worstaccounts" + pegstxid.GetHex(),[&]() { return(_PegsWorstAccounts(pegstxid)); }));
+}
+
 UniValue PegsInfo(uint256 pegstxid)
 {
     char coinaddr[64]; int64_t nValue,amount; uint256 txid,accounttxid,hashBlock,tmppegstxid,tokenid;
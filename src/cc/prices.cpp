@@ -132,7 +132,7 @@ typedef struct TotalFund {
 
 } TotalFund;
 
-int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, std::vector<uint16_t> vec, int64_t positionsize, int64_t &profits, int64_t &outprice);
+int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, const std::vector<uint16_t> &vec, int64_t positionsize, int64_t &profits, int64_t &outprice);
 static bool prices_isacceptableamount(const std::vector<uint16_t> &vecparsed, int64_t amount, int16_t leverage);
 
 // helpers:
@@ -966,11 +966,11 @@ int32_t prices_syntheticvec(std::vector<uint16_t> &vec, std::vector<std::string>
 }
 
 // calculates price for synthetic expression
-int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t minmax, int16_t leverage)
+int64_t prices_syntheticprice(const std::vector<uint16_t> &vec, int32_t height, int32_t minmax, int16_t leverage)
 {
     int32_t i, value, errcode, depth, retval = -1;
     uint16_t opcode;
-    int64_t *pricedata, pricestack[4], a, b, c;
+    int64_t pricedata[PRICES_MAXDATAPOINTS], pricestack[4], a, b, c;
 
     mpz_t mpzTotalPrice, mpzPriceValue, mpzDen, mpzA, mpzB, mpzC, mpzResult;
 
@@ -983,7 +983,6 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
     mpz_init(mpzC);
     mpz_init(mpzResult);
 
-    pricedata = (int64_t *)calloc(sizeof(*pricedata) * 3, 1 + PRICES_DAYWINDOW * 2 + PRICES_SMOOTHWIDTH);
     depth = errcode = 0;
     mpz_set_si(mpzTotalPrice, 0);
     mpz_set_si(mpzDen, 0);
@@ -1183,7 +1182,6 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
  //           std::cerr << "prices_syntheticprice pricestack empty" << std::endl;
 
     }
-    free(pricedata);
     mpz_clear(mpzResult);
     mpz_clear(mpzA);
     mpz_clear(mpzB);
@@ -1232,35 +1230,17 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
     return priceIndex;
 }
 
-// calculates costbasis and profit/loss for the bet
-int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, std::vector<uint16_t> vec, int64_t positionsize,  int64_t &profits, int64_t &outprice)
-{
-    int64_t price;
 #ifndef TESTMODE
-    const int32_t COSTBASIS_PERIOD = PRICES_DAYWINDOW;
+static const int32_t PRICES_COSTBASIS_PERIOD = PRICES_DAYWINDOW;
 #else
-    const int32_t COSTBASIS_PERIOD = 7;
+static const int32_t PRICES_COSTBASIS_PERIOD = 7;
 #endif
 
+// updates costbasis and calculates profit/loss for the bet at the synthetic price of some height
+static void prices_profitsatprice(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, int64_t price, int64_t positionsize, int64_t &profits)
+{
+    int32_t minmax = (height < firstheight + PRICES_COSTBASIS_PERIOD);  // if we are within 24h then use min or max value 
 
-    if (height < firstheight) {
-        fprintf(stderr, "requested height is lower than bet firstheight.%d\n", height);
-        return -1;
-    }
-
-    int32_t minmax = (height < firstheight + COSTBASIS_PERIOD);  // if we are within 24h then use min or max value 
-
-    if ((price = prices_syntheticprice(vec, height, minmax, leverage)) < 0)
-    {
-        fprintf(stderr, "error getting synthetic price at height.%d\n", height);
-        return -1;
-    }
-
-    // clear lowest positions:
-    //price /= PRICES_POINTFACTOR;
-    //price *= PRICES_POINTFACTOR;
-    outprice = price;
-   
     if (minmax)    { // if we are within day window, set temp costbasis to max (or min) price value
         if (leverage > 0 && price > costbasis) {
             costbasis = price;  // set temp costbasis
@@ -1339,6 +1319,31 @@ int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t
         profits = 0;
 
     //std::cerr << "prices_syntheticprofits() profits=" << profits << std::endl;
+}
+
+// calculates costbasis and profit/loss for the bet
+int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, const std::vector<uint16_t> &vec, int64_t positionsize,  int64_t &profits, int64_t &outprice)
+{
+    int64_t price;
+
+    if (height < firstheight) {
+        fprintf(stderr, "requested height is lower than bet firstheight.%d\n", height);
+        return -1;
+    }
+
+    int32_t minmax = (height < firstheight + PRICES_COSTBASIS_PERIOD);
+
+    if ((price = prices_syntheticprice(vec, height, minmax, leverage)) < 0)
+    {
+        fprintf(stderr, "error getting synthetic price at height.%d\n", height);
+        return -1;
+    }
+
+    // clear lowest positions:
+    //price /= PRICES_POINTFACTOR;
+    //price *= PRICES_POINTFACTOR;
+    outprice = price;
+    prices_profitsatprice(costbasis, firstheight, height, leverage, price, positionsize, profits);
     return 0; //  (positionsize + addedbets + profits);
 }
 
@@ -1600,36 +1605,35 @@ UniValue PricesAddFunding(int64_t txfee, uint256 bettxid, int64_t amount)
 }
 
 // scan chain from the initial bet's first position upto the chain tip and calculate bet's costbasises and profits, breaks if rekt detected 
-int32_t prices_scanchain(std::vector<OneBetData> &bets, int16_t leverage, std::vector<uint16_t> vec, int64_t &lastprice, int32_t &endheight) {
+int32_t prices_scanchain(std::vector<OneBetData> &bets, int16_t leverage, const std::vector<uint16_t> &vec, int64_t &lastprice, int32_t &endheight) {
 
     if (bets.size() == 0)
         return -1;
 
-    bool stop = false;
     for (int32_t height = bets[0].firstheight+1; ; height++)   // the last datum for 24h is the costbasis value
     {
         int64_t totalposition = 0;
         int64_t totalprofits = 0;
 
+        // all the bets share the synthetic, evaluate it once per height (bets[0] is always active)
+        int64_t price = prices_syntheticprice(vec, height, 0, leverage);
+        if (price < 0) {
+            std::cerr << "prices_scanchain() error getting synthetic price at height." << height << ", finishing..." << std::endl;
+            break;
+        }
+        lastprice = price;
+
         // scan upto the chain tip
         for (int i = 0; i < bets.size(); i++) {
 
             if (height > bets[i].firstheight) {
 
-                int32_t retcode = prices_syntheticprofits(bets[i].costbasis, bets[i].firstheight, height, leverage, vec, bets[i].positionsize, bets[i].profits, lastprice);
-                if (retcode < 0) {
-                    std::cerr << "prices_scanchain() prices_syntheticprofits returned -1, finishing..." << std::endl;
-                    stop = true;
-                    break;
-                }
+                prices_profitsatprice(bets[i].costbasis, bets[i].firstheight, height, leverage, price, bets[i].positionsize, bets[i].profits);
                 totalposition += bets[i].positionsize;
                 totalprofits += bets[i].profits;
             }
         }
 
-        if (stop)
-            break;
-
         endheight = height;
         int64_t equity = totalposition + totalprofits;
         if (equity <= (int64_t)((double)totalposition * prices_minmarginpercent(leverage)))
@@ -2151,47 +2155,58 @@ UniValue PricesList(uint32_t filter, CPubKey mypk)
     //pricespk = GetUnspendable(cp, 0);
 
     // filters and outputs prices bet txid
-    auto AddBetToList = [&](uint256 txid)
+    auto AddBetOpRet = [&](uint256 txid, const CScript &opret)
     {
         int64_t amount, firstprice; 
         int32_t height; 
         int16_t leverage; 
-        uint256 hashBlock, tokenid;
+        uint256 tokenid;
         CPubKey pk, pricespk;
         std::vector<uint16_t> vec;
-        CTransaction vintx;
 
-        if (myGetTransaction(txid, vintx, hashBlock) != 0)
-        {
+        // TODO: forget old tx
+        //CBlockIndex *bi = safecoin_getblockindex(hashBlock);
+        //if (bi && bi->GetHeight() < 5342)
+        //    return;
 
-            // TODO: forget old tx
-            //CBlockIndex *bi = safecoin_getblockindex(hashBlock);
-            //if (bi && bi->GetHeight() < 5342)
-            //    return;
+        bool bAppend = false;
+        if (prices_betopretdecode(opret, pk, height, amount, leverage, firstprice, vec, tokenid) == 'B' &&
+            (mypk == CPubKey() || mypk == pk))  // if only mypubkey to list
+        {
+            if (filter == 0)
+                bAppend = true;
+            else {
+                int32_t vini;
+                int32_t height;
+                uint256 finaltxid;
 
-            bool bAppend = false;
-            if (vintx.vout.size() > 0 && prices_betopretdecode(vintx.vout.back().scriptPubKey, pk, height, amount, leverage, firstprice, vec, tokenid) == 'B' &&
-                (mypk == CPubKey() || mypk == pk))  // if only mypubkey to list
-            {
-                if (filter == 0)
+                int32_t spent = CCgetspenttxid(finaltxid, vini, height, txid, NVOUT_CCMARKER);
+                if (filter == 1 && spent < 0 ||  // open positions
+                    filter == 2 && spent == 0)   // closed positions
                     bAppend = true;
-                else {
-                    int32_t vini;
-                    int32_t height;
-                    uint256 finaltxid;
-
-                    int32_t spent = CCgetspenttxid(finaltxid, vini, height, txid, NVOUT_CCMARKER);
-                    if (filter == 1 && spent < 0 ||  // open positions
-                        filter == 2 && spent == 0)   // closed positions
-                        bAppend = true;
-                }
-                if (bAppend)
-                    result.push_back(txid.GetHex());
             }
-            std::cerr << "PricesList() " << " bettxid=" << txid.GetHex() << " mypk=" << HexStr(mypk) << " opretpk=" << HexStr(pk) << " filter=" << filter << " bAppend=" << bAppend <<  std::endl;
+            if (bAppend)
+                result.push_back(txid.GetHex());
         }
+        std::cerr << "PricesList() " << " bettxid=" << txid.GetHex() << " mypk=" << HexStr(mypk) << " opretpk=" << HexStr(pk) << " filter=" << filter << " bAppend=" << bAppend <<  std::endl;
+    };
+    auto AddBetToList = [&](uint256 txid)
+    {
+        uint256 hashBlock;
+        CTransaction vintx;
+
+        if (myGetTransaction(txid, vintx, hashBlock) != 0 && vintx.vout.size() > 0)
+            AddBetOpRet(txid, vintx.vout.back().scriptPubKey);
     };
 
+    // the CC index has the bet oprets without reading every bet ever made
+    std::vector<std::pair<CCIndexKey, CCIndexValue> > ccIndex;
+    if (GetCCIndex(EVAL_PRICES, 'B', ccIndex))
+    {
+        for (std::vector<std::pair<CCIndexKey, CCIndexValue> >::const_iterator it = ccIndex.begin(); it != ccIndex.end(); it++)
+            AddBetOpRet(it->first.txhash, it->second.opret);
+        return(result);
+    }
 
     SetCCtxids(addressIndex, cp->normaladdr, false);        // old normal marker
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++)
@@ -2324,7 +2339,7 @@ static std::string findMatchedBook(const std::vector<uint16_t> &vecparsed, const
 }
 
 
-void prices_getorderbook(std::map<std::string, std::vector<BetInfo> > & bookmatched, std::map<std::string, MatchedBookTotal> &matchedTotals, TotalFund &fundTotals)
+static void prices_buildorderbook(std::map<std::string, std::vector<BetInfo> > & bookmatched, std::map<std::string, MatchedBookTotal> &matchedTotals, TotalFund &fundTotals)
 {
     std::vector<BetInfo> book;
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
@@ -2419,6 +2434,34 @@ void prices_getorderbook(std::map<std::string, std::vector<BetInfo> > & bookmatc
     }
 }
 
+// The book only depends on the chain and on the mempool (spent index and bet lookups see both),
+// so it is rebuilt when the tip or the mempool changes and polling callers share one build in between
+static CCriticalSection cs_pricesorderbook;
+static std::pair<uint256, unsigned int> orderbookStamp;
+static bool fOrderbookBuilt = false;
+static std::map<std::string, std::vector<BetInfo> > orderbookMatched;
+static std::map<std::string, MatchedBookTotal> orderbookTotals;
+static TotalFund orderbookFund;
+
+void prices_getorderbook(std::map<std::string, std::vector<BetInfo> > & bookmatched, std::map<std::string, MatchedBookTotal> &matchedTotals, TotalFund &fundTotals)
+{
+    LOCK2(cs_main, cs_pricesorderbook);
+    CBlockIndex *tip = chainActive.LastTip();
+    std::pair<uint256, unsigned int> stamp(tip != 0 ? tip->GetBlockHash() : uint256(), mempool.GetTransactionsUpdated());
+
+    if (!fOrderbookBuilt || stamp != orderbookStamp) {
+        orderbookMatched.clear();
+        orderbookTotals.clear();
+        orderbookFund = TotalFund();
+        prices_buildorderbook(orderbookMatched, orderbookTotals, orderbookFund);
+        orderbookStamp = stamp;
+        fOrderbookBuilt = true;
+    }
+    bookmatched = orderbookMatched;
+    matchedTotals = orderbookTotals;
+    fundTotals = orderbookFund;
+}
+
 static bool prices_isacceptableamount(const std::vector<uint16_t> &vecparsed, int64_t amount, int16_t leverage) {
 
     std::map<std::string, std::vector<BetInfo> > matchedBook;
@@ -343,6 +343,58 @@ bool RewardsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &t
     return(true);
 }
 
+// What the unlock and info paths need of a rewards plan output, decoded once: (txid, vout) -> position.
+// It only depends on the transaction the txid pins down, so an entry stays right across reorgs, whether
+// the output is still unspent always comes from the address index and the mempool.
+struct RewardsPosition
+{
+    uint8_t funcid;
+    uint64_t sbits;
+    uint256 fundingtxid;
+    int64_t nValue;
+    bool isCC,tounspendable;
+    CScript owner; // vout.1, where a lock unlocks to
+};
+static CCriticalSection cs_rewardspositions;
+static std::map<COutPoint, RewardsPosition> mapRewardsPositions;
+static std::deque<COutPoint> dqRewardsPositions;   // insertion order, oldest dropped first
+static const size_t MAX_REWARDS_POSITIONS = 100000;
+
+static bool GetRewardsPosition(RewardsPosition &pos,struct CCcontract_info *cp,uint256 txid,int32_t vout)
+{
+    COutPoint outpoint(txid,vout); CTransaction tx; uint256 hashBlock; char destaddr[64]; int32_t numvouts;
+    {
+        LOCK(cs_rewardspositions);
+        std::map<COutPoint, RewardsPosition>::const_iterator it = mapRewardsPositions.find(outpoint);
+        if ( it != mapRewardsPositions.end() )
+        {
+            pos = it->second;
+            return(true);
+        }
+    }
+    if ( myGetTransaction(txid,tx,hashBlock) == 0 || (numvouts= (int32_t)tx.vout.size()) <= vout || vout < 0 )
+        return(false);
+    pos.sbits = 0;
+    pos.fundingtxid = zeroid;
+    pos.funcid = DecodeRewardsOpRet(txid,tx.vout[numvouts-1].scriptPubKey,pos.sbits,pos.fundingtxid);
+    pos.nValue = tx.vout[vout].nValue;
+    pos.isCC = (tx.vout[vout].scriptPubKey.IsPayToCryptoCondition() != 0);
+    pos.tounspendable = (pos.isCC && Getscriptaddress(destaddr,tx.vout[vout].scriptPubKey) > 0 && strcmp(destaddr,cp->unspendableCCaddr) == 0);
+    if ( numvouts > 1 )
+        pos.owner = tx.vout[1].scriptPubKey;
+    LOCK(cs_rewardspositions);
+    if ( mapRewardsPositions.insert(std::make_pair(outpoint,pos)).second )
+    {
+        dqRewardsPositions.push_back(outpoint);
+        while ( dqRewardsPositions.size() > MAX_REWARDS_POSITIONS )
+        {
+            mapRewardsPositions.erase(dqRewardsPositions.front());
+            dqRewardsPositions.pop_front();
+        }
+    }
+    return(true);
+}
+
 static uint64_t myIs_unlockedtx_inmempool(uint256 &txid,int32_t &vout,uint64_t refsbits,uint256 reffundingtxid,uint64_t needed)
 {
     uint8_t funcid; uint64_t sbits,nValue; uint256 fundingtxid; char str[65];
@@ -374,7 +426,7 @@ static uint64_t myIs_unlockedtx_inmempool(uint256 &txid,int32_t &vout,uint64_t r
 // 'L' vs 'F' and 'A'
 int64_t AddRewardsInputs(CScript &scriptPubKey,uint64_t maxseconds,struct CCcontract_info *cp,CMutableTransaction &mtx,CPubKey pk,int64_t total,int32_t maxinputs,uint64_t refsbits,uint256 reffundingtxid)
 {
-    char coinaddr[64],str[65]; uint64_t threshold,sbits,nValue,totalinputs = 0; uint256 txid,hashBlock,fundingtxid; CTransaction tx; int32_t numblocks,j,vout,n = 0; uint8_t funcid;
+    char coinaddr[64],str[65]; uint64_t threshold,sbits,nValue,totalinputs = 0; uint256 txid,fundingtxid; RewardsPosition pos; int32_t numblocks,j,vout,n = 0; uint8_t funcid;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
     GetCCaddress(cp,coinaddr,pk);
     SetCCunspents(unspentOutputs,coinaddr,true);
@@ -395,9 +447,10 @@ int64_t AddRewardsInputs(CScript &scriptPubKey,uint64_t maxseconds,struct CCcont
                 break;
         if ( j != mtx.vin.size() )
             continue;
-        if ( myGetTransaction(txid,tx,hashBlock) != 0 && tx.vout.size() > 0 && tx.vout[vout].scriptPubKey.IsPayToCryptoCondition() != 0 && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0 )
+        if ( GetRewardsPosition(pos,cp,txid,vout) != 0 && pos.isCC && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0 )
         {
-            if ( (funcid= DecodeRewardsOpRet(txid,tx.vout[tx.vout.size()-1].scriptPubKey,sbits,fundingtxid)) != 0 )
+            sbits = pos.sbits, fundingtxid = pos.fundingtxid;
+            if ( (funcid= pos.funcid) != 0 )
             {
                 if ( sbits != refsbits || fundingtxid != reffundingtxid )
                     continue;
@@ -408,11 +461,11 @@ int64_t AddRewardsInputs(CScript &scriptPubKey,uint64_t maxseconds,struct CCcont
                     if ( CCduration(numblocks,txid) < maxseconds )
                         continue;
                 }
-                fprintf(stderr,"maxseconds.%d (%c) %.8f %.8f\n",(int32_t)maxseconds,funcid,(double)tx.vout[vout].nValue/COIN,(double)it->second.satoshis/COIN);
+                fprintf(stderr,"maxseconds.%d (%c) %.8f %.8f\n",(int32_t)maxseconds,funcid,(double)pos.nValue/COIN,(double)it->second.satoshis/COIN);
                 if ( total != 0 && maxinputs != 0 )
                 {
                     if ( maxseconds != 0 )
-                        scriptPubKey = tx.vout[1].scriptPubKey;
+                        scriptPubKey = pos.owner;
                     mtx.vin.push_back(CTxIn(txid,vout,CScript()));
                 }
                 totalinputs += it->second.satoshis;
@@ -438,7 +491,7 @@ int64_t AddRewardsInputs(CScript &scriptPubKey,uint64_t maxseconds,struct CCcont
 
 int64_t RewardsPlanFunds(uint64_t &lockedfunds,uint64_t refsbits,struct CCcontract_info *cp,CPubKey pk,uint256 reffundingtxid)
 {
-    char coinaddr[64]; uint64_t sbits; int64_t nValue,totalinputs = 0; uint256 txid,hashBlock,fundingtxid; CTransaction tx; int32_t vout; uint8_t funcid;
+    char coinaddr[64]; uint64_t sbits; int64_t nValue,totalinputs = 0; uint256 txid,fundingtxid; RewardsPosition pos; int32_t vout; uint8_t funcid;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
     lockedfunds = 0;
     GetCCaddress(cp,coinaddr,pk);
@@ -447,13 +500,14 @@ int64_t RewardsPlanFunds(uint64_t &lockedfunds,uint64_t refsbits,struct CCcontra
     {
         txid = it->first.txhash;
         vout = (int32_t)it->first.index;
-        if ( myGetTransaction(txid,tx,hashBlock) != 0 && tx.vout[vout].scriptPubKey.IsPayToCryptoCondition() != 0 )
+        if ( GetRewardsPosition(pos,cp,txid,vout) != 0 && pos.isCC )
         {
-            if ( (funcid= DecodeRewardsOpRet(txid,tx.vout[tx.vout.size()-1].scriptPubKey,sbits,fundingtxid)) == 'F' || funcid == 'A' || funcid == 'U' || funcid == 'L' )
+            sbits = pos.sbits, fundingtxid = pos.fundingtxid;
+            if ( (funcid= pos.funcid) == 'F' || funcid == 'A' || funcid == 'U' || funcid == 'L' )
             {
                 if ( refsbits == sbits && (funcid == 'F' && reffundingtxid == txid) || reffundingtxid == fundingtxid )
                 {
-                    if ( (nValue= IsRewardsvout(cp,tx,vout,sbits,fundingtxid)) > 0 )
+                    if ( (nValue= (pos.tounspendable ? pos.nValue : 0)) > 0 ) // IsRewardsvout() against its own opret
                     {
                         if ( funcid == 'L' )
                             lockedfunds += nValue;
@@ -461,7 +515,7 @@ int64_t RewardsPlanFunds(uint64_t &lockedfunds,uint64_t refsbits,struct CCcontra
                     }
                     else fprintf(stderr,"refsbits.%llx sbits.%llx nValue %.8f\n",(long long)refsbits,(long long)sbits,(double)nValue/COIN);
                 } //else fprintf(stderr,"else case\n");
-            } else fprintf(stderr,"funcid.%d %c skipped %.8f\n",funcid,funcid,(double)tx.vout[vout].nValue/COIN);
+            } else fprintf(stderr,"funcid.%d %c skipped %.8f\n",funcid,funcid,(double)pos.nValue/COIN);
         }
     }
     return(totalinputs);
@@ -971,6 +971,48 @@ UniValue rogue_keystrokes(uint64_t txfee,struct CCcontract_info *cp,cJSON *param
     } else return(cclib_error(result,"couldnt reparse params"));
 }
 
+// Replaying the keystrokes is the expensive part of validating a finished game, and the info and finish rpcs
+// replay it once more. The engine is deterministic in (seed, starting player, keystrokes), so the end state of a
+// replay is kept under the hash of those inputs and each game is replayed once per node. The engine state in the
+// middle of a game lives in its globals and cant be saved, so a cached end state is as far as this goes.
+static CCriticalSection cs_roguereplays;
+static std::map<uint256, std::vector<uint8_t> > mapRogueReplays;
+static std::deque<uint256> dqRogueReplays;   // insertion order, oldest dropped first
+static const size_t MAX_ROGUE_REPLAYS = 1000;
+
+int32_t rogue_replay_cached(uint8_t *newdata,uint64_t seed,char *keystrokes,int32_t num,struct rogue_player *player)
+{
+    CSHA256 sha; uint256 key; uint8_t hasplayer = (player != 0); int32_t n;
+    sha.Write((const uint8_t *)&seed,sizeof(seed));
+    sha.Write(&hasplayer,sizeof(hasplayer));
+    if ( player != 0 )
+        sha.Write((const uint8_t *)player,sizeof(*player));
+    sha.Write((const uint8_t *)keystrokes,sizeof(*keystrokes) * num);
+    sha.Finalize(key.begin());
+    {
+        LOCK(cs_roguereplays);
+        std::map<uint256, std::vector<uint8_t> >::const_iterator it = mapRogueReplays.find(key);
+        if ( it != mapRogueReplays.end() )
+        {
+            if ( newdata != 0 && it->second.size() > 0 )
+                memcpy(newdata,&it->second[0],it->second.size());
+            return((int32_t)it->second.size());
+        }
+    }
+    n = rogue_replay2(newdata,seed,keystrokes,num,player,0);
+    LOCK(cs_roguereplays);
+    if ( newdata != 0 && n >= 0 && mapRogueReplays.insert(std::make_pair(key,std::vector<uint8_t>(newdata,newdata+n))).second )
+    {
+        dqRogueReplays.push_back(key);
+        while ( dqRogueReplays.size() > MAX_ROGUE_REPLAYS )
+        {
+            mapRogueReplays.erase(dqRogueReplays.front());
+            dqRogueReplays.pop_front();
+        }
+    }
+    return(n);
+}
+
 char *rogue_extractgame(int32_t makefiles,char *str,int32_t *numkeysp,std::vector<uint8_t> &newdata,uint64_t &seed,uint256 &playertxid,struct CCcontract_info *cp,uint256 gametxid,char *rogueaddr)
 {
     CPubKey roguepk; int32_t i,num,retval,maxplayers,gameheight,batonht,batonvout,numplayers,regslot,numkeys,err; std::string symbol,pname; CTransaction gametx; int64_t buyin,batonvalue; char fname[64],*keystrokes = 0; std::vector<uint8_t> playerdata; uint256 batontxid; FILE *fp; uint8_t newplayer[10000]; struct rogue_player P,endP;
@@ -1013,7 +1055,7 @@ char *rogue_extractgame(int32_t makefiles,char *str,int32_t *numkeysp,std::vecto
                     }
                 }
                 //fprintf(stderr,"call replay2\n");
-                num = rogue_replay2(newplayer,seed,keystrokes,numkeys,playerdata.size()==0?0:&P,0);
+                num = rogue_replay_cached(newplayer,seed,keystrokes,numkeys,playerdata.size()==0?0:&P);
                 newdata.resize(num);
                 for (i=0; i<num; i++)
                 {
@@ -1257,7 +1299,7 @@ UniValue rogue_finishgame(uint64_t txfee,struct CCcontract_info *cp,cJSON *param
                     }
                     if ( keystrokes != 0 )
                     {
-                        num = rogue_replay2(player,seed,keystrokes,numkeys,playerdata.size()==0?0:&P,0);
+                        num = rogue_replay_cached(player,seed,keystrokes,numkeys,playerdata.size()==0?0:&P);
                         if ( keystrokes != 0 )
                             free(keystrokes), keystrokes = 0;
                     } else num = 0;
@@ -20,8 +20,39 @@
 
 #include "chain.h"
 
+#include "support/allocators/pool.h"
+#include "sync.h"
+
 using namespace std;
 
+typedef PoolResource<sizeof(CBlockIndex), alignof(CBlockIndex)> BlockIndexResource;
+
+//! 1 MiB chunks, some 2000 entries each
+static const size_t BLOCK_INDEX_CHUNK_SIZE = 1 << 20;
+
+static CCriticalSection csBlockIndexResource;
+
+// never destroyed, entries may still be deleted by static destructors at exit
+static BlockIndexResource& GetBlockIndexResource()
+{
+    static BlockIndexResource* resource = new BlockIndexResource(BLOCK_INDEX_CHUNK_SIZE);
+    return *resource;
+}
+
+void* CBlockIndex::operator new(size_t nSize)
+{
+    LOCK(csBlockIndexResource);
+    return GetBlockIndexResource().Allocate(nSize, alignof(CBlockIndex));
+}
+
+void CBlockIndex::operator delete(void* p, size_t nSize)
+{
+    if (p == NULL)
+        return;
+    LOCK(csBlockIndexResource);
+    GetBlockIndexResource().Deallocate(p, nSize, alignof(CBlockIndex));
+}
+
 /**
  * CChain implementation
  */
@@ -76,6 +107,20 @@ const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const {
     return pindex;
 }
 
+CBlockIndex* CChain::FindEarliestAtLeast(int64_t nTime) const
+{
+    std::vector<CBlockIndex*>::const_iterator lower = std::lower_bound(vChain.begin(), vChain.end(), nTime,
+        [](const CBlockIndex* pBlock, const int64_t& time) -> bool { return pBlock->GetBlockTimeMax() < time; });
+    return (lower == vChain.end() ? NULL : *lower);
+}
+
+CBlockIndex* CChain::FindEarliestLogicalAtLeast(int64_t nTime) const
+{
+    std::vector<CBlockIndex*>::const_iterator lower = std::lower_bound(vChain.begin(), vChain.end(), nTime,
+        [](const CBlockIndex* pBlock, const int64_t& time) -> bool { return (int64_t)pBlock->nTimeLogical < time; });
+    return (lower == vChain.end() ? NULL : *lower);
+}
+
 CChainPower::CChainPower(CBlockIndex *pblockIndex)
 {
      nHeight = pblockIndex->GetHeight();
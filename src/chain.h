@@ -29,6 +29,7 @@ class CChainPower;
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <algorithm>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -124,7 +125,8 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_ACTIVATES_UPGRADE  =   128, //! block activates a network upgrade
-    BLOCK_IN_TMPFILE         =   256 
+    BLOCK_IN_TMPFILE         =   256,
+    BLOCK_HAVE_SUPPLY        =   512, //! nChainSupply, nChainZfunds and nChainSproutfunds are set
 };
 
 //! Short-hand for the highest consensus validity we implement.
@@ -234,6 +236,9 @@ class CChainPower
 class CBlockIndex
 {
 public:
+    // Fields read by chain walks (pprev, heights, status, times, difficulty) come first, so a walk
+    // only touches the first 128 bytes of each entry. Everything after nVersion is cold.
+
     //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
     const uint256* phashBlock;
 
@@ -243,19 +248,23 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
-    //! height of the entry in the chain. The genesis block has height 0
-    int64_t newcoins,zfunds,sproutfunds,nNotaryPay; int8_t segid; // jl777 fields
-    //! Which # file this block is stored in (blk?????.dat)
-    int nFile;
+    //! (memory only) Height of the entry in the chain (the genesis block has height 0) and the
+    //! total amount of work (expected number of hashes) and stake in the chain up to and including this block
+    CChainPower chainPower;
 
-    //! Byte offset within blk?????.dat where this block's data is stored
-    unsigned int nDataPos;
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
 
-    //! Byte offset within rev?????.dat where this block's undo data is stored
-    unsigned int nUndoPos;
+    //! block header, the fields walks need
+    unsigned int nTime;
+    unsigned int nBits;
 
-    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
-    CChainPower chainPower;
+    //! (memory only) Maximum nTime in the chain up to and including this block.
+    unsigned int nTimeMax;
+
+    //! (memory only) Timestamp index time of this block, nTime raised to one past the previous
+    //! block's when it is not later, so it grows strictly along a chain.
+    unsigned int nTimeLogical;
 
     //! Number of transactions in this block.
     //! Note: in a potential headers-first mode, this number cannot be relied upon
@@ -266,8 +275,21 @@ public:
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
+    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
+    uint32_t nSequenceId;
+
+    int nVersion;
+
+    //! Which # file this block is stored in (blk?????.dat)
+    int nFile;
+
+    //! Byte offset within blk?????.dat where this block's data is stored
+    unsigned int nDataPos;
+
+    //! Byte offset within rev?????.dat where this block's undo data is stored
+    unsigned int nUndoPos;
+
+    int64_t newcoins,zfunds,sproutfunds,nNotaryPay; int8_t segid; // jl777 fields
 
     //! Branch ID corresponding to the consensus rules used to validate this block.
     //! Only cached if block validity is BLOCK_VALID_CONSENSUS.
@@ -298,17 +320,29 @@ public:
     //! Will be boost::none if nChainTx is zero.
     boost::optional<CAmount> nChainSaplingValue;
 
-    //! block header
-    int nVersion;
+    //! Coin supply, value held by the shielded pools and value held by Sprout up to and including
+    //! this block, as reported by coinsupply. Only valid with BLOCK_HAVE_SUPPLY set, which blocks
+    //! connected by older versions get on the first coinsupply call that reaches them.
+    CAmount nChainSupply;
+    CAmount nChainZfunds;
+    CAmount nChainSproutfunds;
+
+    //! block header, the rest
     uint256 hashMerkleRoot;
     uint256 hashFinalSaplingRoot;
-    unsigned int nTime;
-    unsigned int nBits;
     uint256 nNonce;
     std::vector<unsigned char> nSolution;
 
-    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
-    uint32_t nSequenceId;
+    //! (memory only) pubkey paid by the coinbase, valid once fMinerPubkey is set (see safecoin_pindex2pubkey33)
+    uint8_t minerPubkey33[33];
+    bool fMinerPubkey;
+
+    /**
+     * Entries are carved from large chunks instead of one malloc each, which keeps the
+     * entries of a chain close together and saves the allocator overhead on every block.
+     */
+    static void* operator new(size_t nSize);
+    static void operator delete(void* p, size_t nSize);
     
     void SetNull()
     {
@@ -329,10 +363,13 @@ public:
         hashSproutAnchor = uint256();
         hashFinalSproutRoot = uint256();
         nSequenceId = 0;
+        nTimeMax = 0;
+        nTimeLogical = 0;
         nSproutValue = boost::none;
         nChainSproutValue = boost::none;
         nSaplingValue = 0;
         nChainSaplingValue = boost::none;
+        nChainSupply = nChainZfunds = nChainSproutfunds = 0;
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
@@ -341,6 +378,9 @@ public:
         nBits          = 0;
         nNonce         = uint256();
         nSolution.clear();
+
+        memset(minerPubkey33, 0, sizeof(minerPubkey33));
+        fMinerPubkey = false;
     }
 
     CBlockIndex()
@@ -414,6 +454,18 @@ public:
         return (int64_t)nTime;
     }
 
+    int64_t GetBlockTimeMax() const
+    {
+        return (int64_t)nTimeMax;
+    }
+
+    //! Set nTimeMax and nTimeLogical from pprev's, which must have been set first
+    void BuildTimeMax()
+    {
+        nTimeMax = pprev ? std::max(pprev->nTimeMax, nTime) : nTime;
+        nTimeLogical = pprev && nTime <= pprev->nTimeLogical ? pprev->nTimeLogical + 1 : nTime;
+    }
+
     enum { nMedianTimeSpan=11 };
 
     int64_t GetMedianTimePast() const
@@ -560,6 +612,13 @@ public:
         {
             READWRITE(segid);
         }
+
+        // Kept last, older versions that do not know BLOCK_HAVE_SUPPLY leave the trailing bytes unread.
+        if ((s.GetType() & SER_DISK) && (nStatus & BLOCK_HAVE_SUPPLY)) {
+            READWRITE(nChainSupply);
+            READWRITE(nChainZfunds);
+            READWRITE(nChainSproutfunds);
+        }
         
         /*if ( (s.GetType() & SER_DISK) && (is_STAKED(ASSETCHAINS_SYMBOL) != 0) && ASSETCHAINS_NOTARY_PAY[0] != 0 )
         {
@@ -655,6 +714,12 @@ public:
 
     /** Find the last common block between this chain and a block index entry. */
     const CBlockIndex *FindFork(const CBlockIndex *pindex) const;
+
+    /** Find the earliest block with a timestamp equal or greater than the given one, or NULL, by binary search on nTimeMax. */
+    CBlockIndex* FindEarliestAtLeast(int64_t nTime) const;
+
+    /** Find the earliest block whose nTimeLogical is equal or greater than the given one, or NULL. */
+    CBlockIndex* FindEarliestLogicalAtLeast(int64_t nTime) const;
 };
 
 #endif // BITCOIN_CHAIN_H
@@ -21,12 +21,15 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 template <typename T>
 class CCheckQueueControl;
@@ -40,12 +43,41 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread has a job deque of its own. The master pushes onto its
+  * deque, a thread takes batches from the back of its own deque, and one
+  * that runs out steals half of another's from the front, so no lock is
+  * shared by all the threads. An idle thread spins for a little while
+  * before it parks, as the next batch is usually only a transaction away.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Number of job deques, the first is the master's and workers past the rest share theirs
+    static const int MAX_DEQUES = 64;
+
+    //! Rounds an idle thread looks for work before it parks
+    static const int SPIN_ROUNDS = 64;
+
+    /** A job deque, guarded by a spinlock of its own that is only held to move jobs in or out. */
+    struct JobDeque
+    {
+        std::atomic_flag flag;
+        std::deque<T> jobs;
+
+        JobDeque() { flag.clear(); }
+        void Lock()
+        {
+            while (flag.test_and_set(std::memory_order_acquire))
+                boost::this_thread::yield();
+        }
+        void Unlock() { flag.clear(std::memory_order_release); }
+    };
+
+    JobDeque deques[MAX_DEQUES];
+
+    //! Mutex for parking, idle threads block on the condition variables under it
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -54,96 +86,144 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of threads that are parked
+    std::atomic<int> nIdle;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of worker threads (excluding the master)
+    std::atomic<int> nWorkers;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Number of verifications still in one of the deques, or being moved between them
+    std::atomic<unsigned int> nQueued;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    /** The next batch from the back of the thread's own deque. */
+    bool Take(JobDeque& own, std::vector<T>& vChecks)
+    {
+        own.Lock();
+        if (own.jobs.empty()) {
+            own.Unlock();
+            return false;
+        }
+        // aim for increasingly smaller batches so all threads finish approximately simultaneously
+        unsigned int nNow = std::max(1U, std::min(nBatchSize, (unsigned int)own.jobs.size() / (nWorkers + 1)));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            vChecks[i].swap(own.jobs.back());
+            own.jobs.pop_back();
+        }
+        own.Unlock();
+        nQueued -= nNow;
+        return true;
+    }
+
+    /** Half the jobs of the first other deque that has any, a batch of them to run and the rest onto our own. */
+    bool Steal(int nSelf, std::vector<T>& vChecks)
+    {
+        int nDeques = std::min(MAX_DEQUES, nWorkers + 1);
+        for (int i = 1; i < nDeques; i++) {
+            JobDeque& victim = deques[(nSelf + i) % nDeques];
+            if (&victim == &deques[nSelf])
+                continue;
+            victim.Lock();
+            if (victim.jobs.empty()) {
+                victim.Unlock();
+                continue;
+            }
+            unsigned int nSteal = (victim.jobs.size() + 1) / 2;
+            std::vector<T> vStolen(nSteal);
+            for (unsigned int j = 0; j < nSteal; j++) {
+                vStolen[j].swap(victim.jobs.front());
+                victim.jobs.pop_front();
+            }
+            victim.Unlock();
+
+            // never hold two deque locks at once, two thieves may be robbing each other
+            unsigned int nNow = std::min(nBatchSize, nSteal);
+            vChecks.resize(nNow);
+            for (unsigned int j = 0; j < nNow; j++)
+                vChecks[j].swap(vStolen[nSteal - 1 - j]);
+            if (nSteal > nNow) {
+                JobDeque& own = deques[nSelf];
+                own.Lock();
+                for (unsigned int j = 0; j < nSteal - nNow; j++) {
+                    own.jobs.push_back(T());
+                    own.jobs.back().swap(vStolen[j]);
+                }
+                own.Unlock();
+            }
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        int nSelf = fMaster ? 0 : 1 + (nWorkers++ % (MAX_DEQUES - 1));
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        int nSpin = 0;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
+            if (Take(deques[nSelf], vChecks) || Steal(nSelf, vChecks)) {
+                nSpin = 0;
                 // Check whether we need to do work at all
-                fOk = fAllOk;
+                bool fOk = fAllOk;
+                BOOST_FOREACH (T& check, vChecks)
+                    if (fOk)
+                        fOk = check();
+                if (!fOk)
+                    fAllOk = false;
+                unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if ((nTodo -= nNow) == 0 && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
+                }
+                continue;
+            }
+            if (fMaster && nTodo == 0) {
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                return fRet;
+            }
+            if (++nSpin < SPIN_ROUNDS) {
+                boost::this_thread::yield();
+                continue;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            nSpin = 0;
+            // nIdle goes up before nQueued is read and Add raises nQueued before it reads nIdle,
+            // so one of the two sides always sees the other and no wakeup is lost
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nIdle++;
+            if (fMaster) {
+                while (nQueued == 0 && nTodo != 0)
+                    condMaster.wait(lock);
+            } else {
+                while (nQueued == 0)
+                    condWorker.wait(lock); // wait
+            }
+            nIdle--;
         } while (true);
     }
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nWorkers(0), fAllOk(true), nTodo(0), nQueued(0), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -160,16 +240,25 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
+        if (vChecks.empty())
+            return;
+        // counted before they can be taken, so neither count ever goes below zero
+        nTodo += vChecks.size();
+        nQueued += vChecks.size();
+        JobDeque& own = deques[0];
+        own.Lock();
         BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+            own.jobs.push_back(T());
+            check.swap(own.jobs.back());
+        }
+        own.Unlock();
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
     }
 
     ~CCheckQueue()
@@ -178,8 +267,7 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nTodo == 0 && nQueued == 0 && fAllOk == true);
     }
 
 };
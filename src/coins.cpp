@@ -19,8 +19,10 @@
 
 #include "coins.h"
 
+#include "crypto/muhash.h"
 #include "memusage.h"
 #include "random.h"
+#include "streams.h"
 #include "version.h"
 #include "policy/fees.h"
 #include "safecoin_defs.h"
@@ -64,6 +66,14 @@ bool CCoinsView::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree)
 bool CCoinsView::GetNullifier(const uint256 &nullifier, ShieldedType type) const { return false; }
 bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) const { return false; }
 bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
+void CCoinsView::GetCoinsBatch(const std::vector<uint256> &vTxids, std::vector<std::pair<uint256, CCoins> > &vCoins) const
+{
+    CCoins coins;
+    for (std::vector<uint256>::const_iterator it = vTxids.begin(); it != vTxids.end(); ++it) {
+        if (GetCoins(*it, coins))
+            vCoins.push_back(std::make_pair(*it, coins));
+    }
+}
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 uint256 CCoinsView::GetBestAnchor(ShieldedType type) const { return uint256(); };
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins,
@@ -75,8 +85,20 @@ bool CCoinsView::BatchWrite(CCoinsMap &mapCoins,
                             CNullifiersMap &mapSproutNullifiers,
                             CNullifiersMap &mapSaplingNullifiers) { return false; }
 bool CCoinsView::GetStats(CCoinsStats &stats) const { return false; }
+bool CCoinsView::GetStatsMuHash(CCoinsStats &stats, MuHash3072 *muhash) const { return false; }
+bool CCoinsView::DumpSnapshot(CAutoFile &file, const CTxOutSetSnapshotHeader &header, CCoinsStats &stats) const { return false; }
 
 
+void MuHashTxOut(MuHash3072 &muhash, const uint256 &txid, uint32_t n, const CTxOut &out, bool fRemove)
+{
+    CDataStream ss(SER_DISK, 0);
+    ss << COutPoint(txid, n) << out;
+    if (fRemove)
+        muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    else
+        muhash.Insert((const unsigned char*)&ss[0], ss.size());
+}
+
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 
 bool CCoinsViewBacked::GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree) const { return base->GetSproutAnchorAt(rt, tree); }
@@ -96,10 +118,18 @@ bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins,
                                   CNullifiersMap &mapSproutNullifiers,
                                   CNullifiersMap &mapSaplingNullifiers) { return base->BatchWrite(mapCoins, hashBlock, hashSproutAnchor, hashSaplingAnchor, mapSproutAnchors, mapSaplingAnchors, mapSproutNullifiers, mapSaplingNullifiers); }
 bool CCoinsViewBacked::GetStats(CCoinsStats &stats) const { return base->GetStats(stats); }
+bool CCoinsViewBacked::GetStatsMuHash(CCoinsStats &stats, MuHash3072 *muhash) const { return base->GetStatsMuHash(stats, muhash); }
+bool CCoinsViewBacked::DumpSnapshot(CAutoFile &file, const CTxOutSetSnapshotHeader &header, CCoinsStats &stats) const { return base->DumpSnapshot(file, header, stats); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false),
+    cacheCoins(CCoinsMap::allocator_type(&cacheCoinsPool)),
+    cacheSproutAnchors(CAnchorsSproutMap::allocator_type(&cacheSproutAnchorsPool)),
+    cacheSaplingAnchors(CAnchorsSaplingMap::allocator_type(&cacheSaplingAnchorsPool)),
+    cacheSproutNullifiers(CNullifiersMap::allocator_type(&cacheSproutNullifiersPool)),
+    cacheSaplingNullifiers(CNullifiersMap::allocator_type(&cacheSaplingNullifiersPool)),
+    cachedCoinsUsage(0), nCacheHits(0), nCacheMisses(0) { }
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -117,17 +147,22 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
     CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        nCacheHits++;
+        it->second.flags |= CCoinsCacheEntry::USED;
         return it;
+    }
+    nCacheMisses++;
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
     tmp.swap(ret->second.coins);
+    ret->second.flags = CCoinsCacheEntry::USED;
     if (ret->second.coins.IsPruned()) {
         // The parent only has an empty entry for this txid; we can consider our
         // version as fresh.
-        ret->second.flags = CCoinsCacheEntry::FRESH;
+        ret->second.flags |= CCoinsCacheEntry::FRESH;
     }
     cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
     return ret;
@@ -347,6 +382,38 @@ void CCoinsViewCache::SetNullifiers(const CTransaction& tx, bool spent) {
     }
 }
 
+void CCoinsViewCache::Prefetch(const std::vector<uint256> &vTxids) const {
+    std::vector<uint256> vMissing;
+    for (std::vector<uint256>::const_iterator it = vTxids.begin(); it != vTxids.end(); ++it) {
+        if (!cacheCoins.count(*it))
+            vMissing.push_back(*it);
+    }
+    if (vMissing.empty())
+        return;
+    nCacheMisses += vMissing.size();
+    std::vector<std::pair<uint256, CCoins> > vFetched;
+    base->GetCoinsBatch(vMissing, vFetched);
+    for (std::vector<std::pair<uint256, CCoins> >::iterator it = vFetched.begin(); it != vFetched.end(); ++it) {
+        std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(it->first, CCoinsCacheEntry()));
+        if (!ret.second)
+            continue; // listed twice
+        ret.first->second.coins.swap(it->second);
+        ret.first->second.flags = CCoinsCacheEntry::USED;
+        if (ret.first->second.coins.IsPruned())
+            ret.first->second.flags |= CCoinsCacheEntry::FRESH;
+        cachedCoinsUsage += ret.first->second.coins.DynamicMemoryUsage();
+    }
+}
+
+void CCoinsViewCache::GetCoinsBatch(const std::vector<uint256> &vTxids, std::vector<std::pair<uint256, CCoins> > &vCoins) const {
+    Prefetch(vTxids);
+    for (std::vector<uint256>::const_iterator it = vTxids.begin(); it != vTxids.end(); ++it) {
+        CCoinsMap::const_iterator itCoins = cacheCoins.find(*it);
+        if (itCoins != cacheCoins.end())
+            vCoins.push_back(std::make_pair(*it, itCoins->second.coins));
+    }
+}
+
 bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) const {
     CCoinsMap::const_iterator it = FetchCoins(txid);
     if (it != cacheCoins.end()) {
@@ -361,6 +428,7 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
     std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
     size_t cachedCoinUsage = 0;
     if (ret.second) {
+        nCacheMisses++;
         if (!base->GetCoins(txid, ret.first->second.coins)) {
             // The parent view does not have this entry; mark it as fresh.
             ret.first->second.coins.Clear();
@@ -370,10 +438,11 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
             ret.first->second.flags = CCoinsCacheEntry::FRESH;
         }
     } else {
+        nCacheHits++;
         cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
-    ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    ret.first->second.flags |= CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::USED;
     return CCoinsModifier(*this, ret.first, cachedCoinUsage);
 }
 
@@ -509,7 +578,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
                     entry.coins.swap(it->second.coins);
                     cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
-                    entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+                    entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH | CCoinsCacheEntry::USED;
                 }
             } else {
                 if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
@@ -523,7 +592,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.coins.swap(it->second.coins);
                     cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
-                    itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.flags |= CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::USED;
                 }
             }
         }
@@ -543,17 +612,128 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
     return true;
 }
 
+/** Empty a cache map and hand the memory of its pool back to the system. */
+template<typename Map>
+static void ReleaseCacheMap(Map& map)
+{
+    // the old nodes go back to the pool when the temporary is destroyed
+    Map(map.get_allocator()).swap(map);
+    map.get_allocator().GetResource()->Release();
+}
+
 bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock, hashSproutAnchor, hashSaplingAnchor, cacheSproutAnchors, cacheSaplingAnchors, cacheSproutNullifiers, cacheSaplingNullifiers);
-    cacheCoins.clear();
-    cacheSproutAnchors.clear();
-    cacheSaplingAnchors.clear();
-    cacheSproutNullifiers.clear();
-    cacheSaplingNullifiers.clear();
+    ReleaseCacheMap(cacheCoins);
+    ReleaseCacheMap(cacheSproutAnchors);
+    ReleaseCacheMap(cacheSaplingAnchors);
+    ReleaseCacheMap(cacheSproutNullifiers);
+    ReleaseCacheMap(cacheSaplingNullifiers);
     cachedCoinsUsage = 0;
     return fOk;
 }
 
+bool CCoinsViewCache::Sync(size_t nKeepUsage) {
+    assert(!hasModifier);
+    // What a kept entry costs on top of its coins: a pool node and a bucket.
+    const size_t nEntryUsage = sizeof(CCoinsMap::value_type) + sizeof(void*) * 3;
+    size_t nKept = 0;
+    bool fEvicted = false;
+    CCoinsMap mapWrite;
+    // The first pass keeps coins used since the last Sync, the second the rest
+    // while there is room. Dirty coins that stay are copied to the batch,
+    // the others are moved there.
+    for (int nPass = 0; nPass < 2; nPass++) {
+        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+            CCoinsCacheEntry& entry = it->second;
+            bool fUsed = (entry.flags & CCoinsCacheEntry::USED) != 0;
+            if (fUsed != (nPass == 0)) {
+                // kept by the first pass, start over for the next Sync
+                entry.flags &= ~CCoinsCacheEntry::USED;
+                ++it;
+                continue;
+            }
+            size_t nUsage = nEntryUsage + entry.coins.DynamicMemoryUsage();
+            bool fKeep = !entry.coins.IsPruned() && nKept + nUsage <= nKeepUsage;
+            if (entry.flags & CCoinsCacheEntry::DIRTY) {
+                CCoinsCacheEntry& written = mapWrite[it->first];
+                written.flags = entry.flags;
+                if (fKeep)
+                    written.coins = entry.coins;
+                else
+                    written.coins.swap(entry.coins);
+            }
+            if (fKeep) {
+                // the base now has this version of the entry
+                entry.flags &= CCoinsCacheEntry::USED;
+                nKept += nUsage;
+                ++it;
+            } else {
+                cacheCoins.erase(it++);
+                fEvicted = true;
+            }
+        }
+    }
+    bool fOk = base->BatchWrite(mapWrite, hashBlock, hashSproutAnchor, hashSaplingAnchor, cacheSproutAnchors, cacheSaplingAnchors, cacheSproutNullifiers, cacheSaplingNullifiers);
+    ReleaseCacheMap(cacheSproutAnchors);
+    ReleaseCacheMap(cacheSaplingAnchors);
+    ReleaseCacheMap(cacheSproutNullifiers);
+    ReleaseCacheMap(cacheSaplingNullifiers);
+    if (fEvicted) {
+        // Evicted nodes only went back to the free lists, move the kept entries
+        // to fresh chunks so the pool shrinks to what is still cached.
+        std::vector<std::pair<uint256, CCoinsCacheEntry> > vKept(cacheCoins.size());
+        size_t i = 0;
+        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it, ++i) {
+            vKept[i].first = it->first;
+            vKept[i].second.coins.swap(it->second.coins);
+            vKept[i].second.flags = it->second.flags;
+        }
+        ReleaseCacheMap(cacheCoins);
+        cacheCoins.reserve(vKept.size());
+        for (i = 0; i < vKept.size(); i++) {
+            CCoinsCacheEntry& entry = cacheCoins[vKept[i].first];
+            entry.coins.swap(vKept[i].second.coins);
+            entry.flags = vKept[i].second.flags;
+        }
+    }
+    cachedCoinsUsage = 0;
+    for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it)
+        cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+    return fOk;
+}
+
+void CCoinsViewCache::UpdateMuHash(MuHash3072 &muhash, CCoinsStats &stats) const {
+    for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+            continue;
+        const CCoins &coins = it->second.coins;
+        CCoins old;
+        if (!(it->second.flags & CCoinsCacheEntry::FRESH))
+            base->GetCoins(it->first, old);
+        for (size_t i = 0; i < std::max(old.vout.size(), coins.vout.size()); i++) {
+            const CTxOut *pold = i < old.vout.size() && !old.vout[i].IsNull() ? &old.vout[i] : NULL;
+            const CTxOut *pnew = i < coins.vout.size() && !coins.vout[i].IsNull() ? &coins.vout[i] : NULL;
+            if (pold && pnew && *pold == *pnew)
+                continue;
+            if (pold) {
+                MuHashTxOut(muhash, it->first, i, *pold, true);
+                stats.nTransactionOutputs--;
+                stats.nTotalAmount -= pold->nValue;
+            }
+            if (pnew) {
+                MuHashTxOut(muhash, it->first, i, *pnew, false);
+                stats.nTransactionOutputs++;
+                stats.nTotalAmount += pnew->nValue;
+            }
+        }
+    }
+}
+
+void CCoinsViewCache::GetCacheStats(uint64_t& nHits, uint64_t& nMisses) const {
+    nHits = nCacheHits;
+    nMisses = nCacheMisses;
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
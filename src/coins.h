@@ -300,6 +300,7 @@ struct CCoinsCacheEntry
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
+        USED = (1 << 2), // This cache entry was looked up or modified since the last Sync.
     };
 
     CCoinsCacheEntry() : coins(), flags(0) {}
@@ -349,10 +350,28 @@ enum ShieldedType
     SAPLING,
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
-typedef boost::unordered_map<uint256, CAnchorsSproutCacheEntry, CCoinsKeyHasher> CAnchorsSproutMap;
-typedef boost::unordered_map<uint256, CAnchorsSaplingCacheEntry, CCoinsKeyHasher> CAnchorsSaplingMap;
-typedef boost::unordered_map<uint256, CNullifiersCacheEntry, CCoinsKeyHasher> CNullifiersMap;
+/**
+ * Cache maps allocate their nodes from a PoolResource owned by the cache, so
+ * -dbcache accounting sees the real memory use and a flush hands it all back
+ * at once. Blocks of up to a node plus a few pointers come from the pool.
+ */
+template<typename Entry>
+struct CCoinsCacheMap
+{
+    typedef std::pair<const uint256, Entry> value_type;
+    typedef boost::unordered_map<uint256, Entry, CCoinsKeyHasher, std::equal_to<uint256>,
+                                 PoolAllocator<value_type, sizeof(value_type) + sizeof(void*) * 4> > type;
+};
+
+typedef CCoinsCacheMap<CCoinsCacheEntry>::type CCoinsMap;
+typedef CCoinsCacheMap<CAnchorsSproutCacheEntry>::type CAnchorsSproutMap;
+typedef CCoinsCacheMap<CAnchorsSaplingCacheEntry>::type CAnchorsSaplingMap;
+typedef CCoinsCacheMap<CNullifiersCacheEntry>::type CNullifiersMap;
+
+class MuHash3072;
+
+/** Add an unspent output to, or with fRemove take it out of, the MuHash3072 of the UTXO set */
+void MuHashTxOut(MuHash3072 &muhash, const uint256 &txid, uint32_t n, const CTxOut &out, bool fRemove);
 
 struct CCoinsStats
 {
@@ -362,11 +381,45 @@ struct CCoinsStats
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
     uint256 hashSerialized;
+    uint256 hashMuHash;
     CAmount nTotalAmount;
 
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
 };
 
+/**
+ * Header of a dumptxoutset file. The coin database records follow it, then the
+ * CCoinsStats totals of the coins and a double-SHA256 of everything before.
+ */
+struct CTxOutSetSnapshotHeader
+{
+    static const uint32_t SNAPSHOT_MAGIC = 0x78747573;
+    static const uint32_t CURRENT_VERSION = 1;
+
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint256 hashBlock;          //! the coins are the state after this block
+    int32_t nHeight;
+    uint256 hashNotarized;      //! latest notarization the dumping node knew, hashBlock has to build on it
+    int32_t nNotarizedHeight;
+
+    CTxOutSetSnapshotHeader() : nMagic(SNAPSHOT_MAGIC), nVersion(CURRENT_VERSION), nHeight(0), nNotarizedHeight(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nMagic);
+        READWRITE(nVersion);
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(hashNotarized);
+        READWRITE(nNotarizedHeight);
+    }
+};
+
+class CAutoFile;
+
 
 /** Abstract view on the open txout dataset. */
 class CCoinsView
@@ -384,6 +437,10 @@ public:
     //! Retrieve the CCoins (unspent transaction outputs) for a given txid
     virtual bool GetCoins(const uint256 &txid, CCoins &coins) const;
 
+    //! Retrieve the CCoins of several txids at once, vCoins receives those that exist.
+    //! Views that can read in bulk override this, the default asks GetCoins for each.
+    virtual void GetCoinsBatch(const std::vector<uint256> &vTxids, std::vector<std::pair<uint256, CCoins> > &vCoins) const;
+
     //! Just check whether we have data for a given txid.
     //! This may (but cannot always) return true for fully spent transactions
     virtual bool HaveCoins(const uint256 &txid) const;
@@ -408,6 +465,12 @@ public:
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats &stats) const;
 
+    //! Count the unspent transaction output set and, unless muhash is NULL, hash it with MuHash3072; hashSerialized is left unset
+    virtual bool GetStatsMuHash(CCoinsStats &stats, MuHash3072 *muhash) const;
+
+    //! Write the whole set, with anchors and nullifiers, to file as described by CTxOutSetSnapshotHeader
+    virtual bool DumpSnapshot(CAutoFile &file, const CTxOutSetSnapshotHeader &header, CCoinsStats &stats) const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 };
@@ -438,6 +501,8 @@ public:
                     CNullifiersMap &mapSproutNullifiers,
                     CNullifiersMap &mapSaplingNullifiers);
     bool GetStats(CCoinsStats &stats) const;
+    bool GetStatsMuHash(CCoinsStats &stats, MuHash3072 *muhash) const;
+    bool DumpSnapshot(CAutoFile &file, const CTxOutSetSnapshotHeader &header, CCoinsStats &stats) const;
 };
 
 
@@ -501,6 +566,13 @@ protected:
     /* Whether this cache has an active modifier. */
     bool hasModifier;
 
+    /* Pools the cache maps below allocate from, declared first so they outlive them. */
+    CCoinsMap::allocator_type::ResourceType cacheCoinsPool;
+    CAnchorsSproutMap::allocator_type::ResourceType cacheSproutAnchorsPool;
+    CAnchorsSaplingMap::allocator_type::ResourceType cacheSaplingAnchorsPool;
+    CNullifiersMap::allocator_type::ResourceType cacheSproutNullifiersPool;
+    CNullifiersMap::allocator_type::ResourceType cacheSaplingNullifiersPool;
+
     /**
      * Make mutable so that we can "fill the cache" even from Get-methods
      * declared as "const". 
@@ -517,6 +589,10 @@ protected:
     /* Cached dynamic memory usage for the inner CCoins objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Coin lookups answered from the cache, and those that went to the base view. */
+    mutable uint64_t nCacheHits;
+    mutable uint64_t nCacheMisses;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
     ~CCoinsViewCache();
@@ -527,6 +603,7 @@ public:
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const;
     bool GetNullifier(const uint256 &nullifier, ShieldedType type) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    void GetCoinsBatch(const std::vector<uint256> &vTxids, std::vector<std::pair<uint256, CCoins> > &vCoins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     uint256 GetBestAnchor(ShieldedType type) const;
@@ -566,6 +643,12 @@ public:
      */
     CCoinsModifier ModifyCoins(const uint256 &txid);
 
+    /**
+     * Load the coins of vTxids that are not cached yet with one GetCoinsBatch
+     * on the base, so later lookups of them are served from memory.
+     */
+    void Prefetch(const std::vector<uint256> &vTxids) const;
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -573,6 +656,23 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, like Flush,
+     * but only write the dirty coins and keep up to nKeepUsage bytes of them
+     * cached. Coins used since the previous Sync are kept first.
+     */
+    bool Sync(size_t nKeepUsage);
+
+    /**
+     * Move a MuHash3072 of the base's output set, with its output count and
+     * amount, to the set this cache will have after Flush. Only the outputs of
+     * the dirty entries that differ from the base are hashed.
+     */
+    void UpdateMuHash(MuHash3072 &muhash, CCoinsStats &stats) const;
+
+    //! Coin lookups served from the cache and from the base view since creation
+    void GetCacheStats(uint64_t& nHits, uint64_t& nMisses) const;
+
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
@@ -108,8 +108,15 @@ typedef u_int SOCKET;
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
+// kernel event queues used instead of select() by the p2p socket loop
+#if !defined(_WIN32) && defined(__linux__)
+#define USE_EPOLL 1
+#elif !defined(_WIN32) && (defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__))
+#define USE_KQUEUE 1
+#endif
+
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef _WIN32
+#if defined(_WIN32) || defined(USE_EPOLL) || defined(USE_KQUEUE)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -24,6 +24,9 @@
 #include "pubkey.h"
 #include "script/standard.h"
 
+#include <algorithm>
+#include <string.h>
+
 bool CScriptCompressor::IsToKeyID(CKeyID &hash) const
 {
     if (script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160
@@ -198,3 +201,115 @@ uint64_t CTxOutCompressor::DecompressAmount(uint64_t x)
     }
     return n;
 }
+
+static const size_t LZ_MIN_MATCH = 4;
+static const size_t LZ_MAX_OFFSET = 0xFFFF;
+static const int LZ_HASH_BITS = 16;
+
+static uint32_t ReadSeq(const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void WriteLength(std::vector<unsigned char>& vOut, size_t nLen)
+{
+    while (nLen >= 255) {
+        vOut.push_back(255);
+        nLen -= 255;
+    }
+    vOut.push_back(nLen);
+}
+
+static bool ReadLength(const std::vector<unsigned char>& vIn, size_t& nPos, size_t& nLen)
+{
+    unsigned char ch;
+    do {
+        if (nPos >= vIn.size())
+            return false;
+        ch = vIn[nPos++];
+        nLen += ch;
+    } while (ch == 255);
+    return true;
+}
+
+// a match of nMatch bytes nOffset back follows the literals, nMatch 0 ends the data
+static void WriteSequence(std::vector<unsigned char>& vOut, const unsigned char* pLiterals, size_t nLiterals, size_t nOffset, size_t nMatch)
+{
+    size_t nMatchCode = nMatch ? nMatch - LZ_MIN_MATCH : 0;
+    vOut.push_back((std::min<size_t>(nLiterals, 15) << 4) | std::min<size_t>(nMatchCode, 15));
+    if (nLiterals >= 15)
+        WriteLength(vOut, nLiterals - 15);
+    vOut.insert(vOut.end(), pLiterals, pLiterals + nLiterals);
+    if (nMatch == 0)
+        return;
+    vOut.push_back(nOffset & 0xFF);
+    vOut.push_back(nOffset >> 8);
+    if (nMatchCode >= 15)
+        WriteLength(vOut, nMatchCode - 15);
+}
+
+void CompressData(const std::vector<unsigned char>& vIn, std::vector<unsigned char>& vOut)
+{
+    vOut.clear();
+    vOut.reserve(vIn.size() / 2);
+    const unsigned char* data = vIn.empty() ? NULL : &vIn[0];
+    const size_t n = vIn.size();
+    // last position each 4 byte sequence was seen at, plus one
+    std::vector<uint32_t> vTable(1 << LZ_HASH_BITS, 0);
+    size_t nAnchor = 0, i = 0;
+    while (i + LZ_MIN_MATCH <= n) {
+        uint32_t seq = ReadSeq(data + i);
+        uint32_t h = (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+        size_t nCandidate = vTable[h];
+        vTable[h] = i + 1;
+        if (nCandidate != 0 && i - (nCandidate - 1) <= LZ_MAX_OFFSET && ReadSeq(data + nCandidate - 1) == seq) {
+            size_t nFrom = nCandidate - 1, nMatch = LZ_MIN_MATCH;
+            while (i + nMatch < n && data[nFrom + nMatch] == data[i + nMatch])
+                nMatch++;
+            WriteSequence(vOut, data + nAnchor, i - nAnchor, i - nFrom, nMatch);
+            i += nMatch;
+            nAnchor = i;
+        } else {
+            i++;
+        }
+    }
+    WriteSequence(vOut, data + nAnchor, n - nAnchor, 0, 0);
+}
+
+bool DecompressData(const std::vector<unsigned char>& vIn, size_t nSize, std::vector<unsigned char>& vOut)
+{
+    vOut.clear();
+    vOut.reserve(nSize);
+    size_t nPos = 0;
+    while (nPos < vIn.size()) {
+        unsigned char token = vIn[nPos++];
+        size_t nLiterals = token >> 4;
+        if (nLiterals == 15 && !ReadLength(vIn, nPos, nLiterals))
+            return false;
+        if (nLiterals > vIn.size() - nPos || nLiterals > nSize - vOut.size())
+            return false;
+        vOut.insert(vOut.end(), vIn.begin() + nPos, vIn.begin() + nPos + nLiterals);
+        nPos += nLiterals;
+        if (nPos == vIn.size())
+            break; // the last sequence
+        if (vIn.size() - nPos < 2)
+            return false;
+        size_t nOffset = vIn[nPos] | (vIn[nPos + 1] << 8);
+        nPos += 2;
+        size_t nMatch = token & 15;
+        if (nMatch == 15 && !ReadLength(vIn, nPos, nMatch))
+            return false;
+        nMatch += LZ_MIN_MATCH;
+        if (nOffset == 0 || nOffset > vOut.size() || nMatch > nSize - vOut.size())
+            return false;
+        // the match may overlap the bytes it produces
+        size_t nFrom = vOut.size() - nOffset;
+        for (size_t j = 0; j < nMatch; j++) {
+            unsigned char ch = vOut[nFrom + j];
+            vOut.push_back(ch);
+        }
+    }
+    return vOut.size() == nSize;
+}
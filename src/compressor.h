@@ -133,4 +133,15 @@ public:
     }
 };
 
+/**
+ * Byte oriented LZ77 compression for block file records. Each sequence is a
+ * token (literal count << 4 | match length - 4, 15 meaning more follows in
+ * 255 steps), the literals, then a 2 byte offset and the rest of the match
+ * length; the last sequence has literals only. Fast enough to run on every
+ * block written, and with no dependency beyond this file.
+ */
+void CompressData(const std::vector<unsigned char>& vIn, std::vector<unsigned char>& vOut);
+/** Undo CompressData, false unless vIn expands to exactly nSize bytes */
+bool DecompressData(const std::vector<unsigned char>& vIn, size_t nSize, std::vector<unsigned char>& vOut);
+
 #endif // BITCOIN_COMPRESSOR_H
@@ -22,6 +22,9 @@
 
 #include "cc/CCinclude.h"
 
+#include <list>
+#include <memory>
+
 /*
  * The crosschain workflow.
  *
@@ -46,8 +49,86 @@ int NOTARISATION_SCAN_LIMIT_BLOCKS = 1440;
 CBlockIndex *safecoin_getblockindex(uint256 hash);
 
 
+/*
+ * Merkle trees of recent proofs, the MoM trees over the merkle roots of a notarised range and
+ * the MoMoM trees over the MoMs of a backnotarisation. Every tx proven against the same
+ * notarisation takes its branch from one tree instead of collecting and hashing the leaves
+ * again. Keyed by the block at the top of the range, so a reorg only leaves unused entries.
+ */
+struct ProofTree
+{
+    uint256 key;
+    std::vector<uint256> leaves;
+    std::vector<uint256> tree;
+    uint256 txid; // MoMoM trees: the notarisation the range ends at
+
+    uint256 Root() const { return tree.empty() ? uint256() : tree.back(); }
+    std::vector<uint256> Branch(int nIndex) const { return GetMerkleBranch(nIndex, leaves.size(), tree); }
+};
+
+static const size_t PROOF_TREE_CACHE_SIZE = 16;
+static CCriticalSection cs_proofTrees;
+static std::list<std::shared_ptr<const ProofTree> > proofTrees;
+
+static std::shared_ptr<const ProofTree> GetCachedProofTree(const uint256 &key)
+{
+    LOCK(cs_proofTrees);
+    for (std::list<std::shared_ptr<const ProofTree> >::iterator it = proofTrees.begin(); it != proofTrees.end(); ++it) {
+        if ((*it)->key == key) {
+            proofTrees.splice(proofTrees.begin(), proofTrees, it);
+            return proofTrees.front();
+        }
+    }
+    return std::shared_ptr<const ProofTree>();
+}
+
+/* Builds the tree over pTree's leaves and takes ownership */
+static std::shared_ptr<const ProofTree> AddCachedProofTree(ProofTree *pTree)
+{
+    bool fMutated;
+    BuildMerkleTree(&fMutated, pTree->leaves, pTree->tree);
+    std::shared_ptr<const ProofTree> entry(pTree);
+    LOCK(cs_proofTrees);
+    proofTrees.push_front(entry);
+    if (proofTrees.size() > PROOF_TREE_CACHE_SIZE)
+        proofTrees.pop_back();
+    return entry;
+}
+
+/*
+ * MoM tree over the merkle roots of the depth blocks ending at height, leaf i being the
+ * block at height - i. Null if the range is not on the active chain.
+ */
+static std::shared_ptr<const ProofTree> GetMoMTree(int height, int depth)
+{
+    if (depth <= 0 || depth >= height || height > chainActive.Height())
+        return std::shared_ptr<const ProofTree>();
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << std::string("MoM") << chainActive[height]->GetBlockHash() << depth;
+    uint256 key = ss.GetHash();
+    std::shared_ptr<const ProofTree> cached = GetCachedProofTree(key);
+    if (cached)
+        return cached;
+
+    ProofTree *pTree = new ProofTree();
+    pTree->key = key;
+    pTree->leaves.reserve(depth);
+    for (int i=0; i<depth; i++)
+        pTree->leaves.push_back(chainActive[height - i]->hashMerkleRoot);
+    return AddCachedProofTree(pTree);
+}
+
+
+uint256 GetMoM(int height, int depth)
+{
+    std::shared_ptr<const ProofTree> pTree = GetMoMTree(height, depth);
+    return pTree ? pTree->Root() : uint256();
+}
+
+
 /* On SAFE */
-uint256 CalculateProofRoot(const char* symbol, uint32_t targetCCid, int safeHeight,
+static uint256 ScanProofRoot(const char* symbol, uint32_t targetCCid, int safeHeight,
         std::vector<uint256> &moms, uint256 &destNotarisationTxid)
 {
     /*
@@ -117,6 +198,44 @@ end:
 }
 
 
+/* On SAFE, the MoMoM tree of the backnotarisation range for symbol found back from safeHeight */
+static std::shared_ptr<const ProofTree> GetProofRootTree(const char* symbol, uint32_t targetCCid, int safeHeight)
+{
+    if (targetCCid < 2 || safeHeight < 0 || safeHeight > chainActive.Height())
+        return std::shared_ptr<const ProofTree>();
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << std::string("MoMoM") << std::string(symbol) << targetCCid << chainActive[safeHeight]->GetBlockHash();
+    uint256 key = ss.GetHash();
+    std::shared_ptr<const ProofTree> cached = GetCachedProofTree(key);
+    if (cached)
+        return cached;
+
+    ProofTree *pTree = new ProofTree();
+    pTree->key = key;
+    if (ScanProofRoot(symbol, targetCCid, safeHeight, pTree->leaves, pTree->txid).IsNull()) {
+        delete pTree;
+        return std::shared_ptr<const ProofTree>();
+    }
+    return AddCachedProofTree(pTree);
+}
+
+
+uint256 CalculateProofRoot(const char* symbol, uint32_t targetCCid, int safeHeight,
+        std::vector<uint256> &moms, uint256 &destNotarisationTxid)
+{
+    std::shared_ptr<const ProofTree> pTree = GetProofRootTree(symbol, targetCCid, safeHeight);
+    if (!pTree) {
+        destNotarisationTxid = uint256();
+        moms.clear();
+        return uint256();
+    }
+    moms = pTree->leaves;
+    destNotarisationTxid = pTree->txid;
+    return pTree->Root();
+}
+
+
 /*
  * Get a notarisation from a given height
  *
@@ -186,11 +305,10 @@ TxProof GetCrossChainProof(const uint256 txid, const char* targetSymbol, uint32_
         safeHeight += offset;
 
     // Get MoMs for safe height and symbol
-    std::vector<uint256> moms;
-    uint256 targetChainNotarisationTxid;
-    uint256 MoMoM = CalculateProofRoot(targetSymbol, targetCCid, safeHeight, moms, targetChainNotarisationTxid);
-    if (MoMoM.IsNull())
+    std::shared_ptr<const ProofTree> pMoMoMTree = GetProofRootTree(targetSymbol, targetCCid, safeHeight);
+    if (!pMoMoMTree)
         throw std::runtime_error("No MoMs found");
+    const std::vector<uint256> &moms = pMoMoMTree->leaves;
 
     // Find index of source MoM in MoMoM
     int nIndex;
@@ -201,28 +319,15 @@ TxProof GetCrossChainProof(const uint256 txid, const char* targetSymbol, uint32_
     throw std::runtime_error("Couldn't find MoM within MoMoM set");
 cont:
 
-    // Create a branch
-    std::vector<uint256> vBranch;
-    {
-        CBlock fakeBlock;
-        for (int i=0; i<moms.size(); i++) {
-            CTransaction fakeTx;
-            // first value in CTransaction memory is it's hash
-            memcpy((void*)&fakeTx, moms[i].begin(), 32);
-            fakeBlock.vtx.push_back(fakeTx);
-        }
-        vBranch = fakeBlock.GetMerkleBranch(nIndex);
-    }
-
     // Concatenate branches
     MerkleBranch newBranch = assetChainProof.second;
-    newBranch << MerkleBranch(nIndex, vBranch);
+    newBranch << MerkleBranch(nIndex, pMoMoMTree->Branch(nIndex));
 
     // Check proof
-    if (newBranch.Exec(txid) != MoMoM)
+    if (newBranch.Exec(txid) != pMoMoMTree->Root())
         throw std::runtime_error("Proof check failed");
 
-    return std::make_pair(targetChainNotarisationTxid,newBranch);
+    return std::make_pair(pMoMoMTree->txid,newBranch);
 }
 
 
@@ -457,14 +562,10 @@ TxProof GetAssetchainProof(uint256 hash,CTransaction burnTx)
 
     // build merkle chain from blocks to MoM
     {
-        std::vector<uint256> leaves, tree;
-        for (int i=0; i<nota.second.MoMDepth; i++) {
-            uint256 mRoot = chainActive[nota.second.height - i]->hashMerkleRoot;
-            leaves.push_back(mRoot);
-        }
-        bool fMutated;
-        BuildMerkleTree(&fMutated, leaves, tree);
-        branch = GetMerkleBranch(nIndex, leaves.size(), tree);
+        std::shared_ptr<const ProofTree> pMoMTree = GetMoMTree(nota.second.height, nota.second.MoMDepth);
+        if (!pMoMTree || nIndex >= (int)pMoMTree->leaves.size())
+            throw std::runtime_error("MoM range not on the active chain");
+        branch = pMoMTree->Branch(nIndex);
 
         // Check branch
         uint256 ourResult = SafeCheckMerkleBranch(blockIndex->hashMerkleRoot, branch, nIndex);
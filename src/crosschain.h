@@ -34,6 +34,9 @@ bool CheckTxAuthority(const CTransaction &tx, CrosschainAuthority auth);
 /* On assetchain */
 TxProof GetAssetchainProof(uint256 hash,CTransaction burnTx);
 
+/* MoM over the merkle roots of the depth blocks ending at height, null if they are not all on the active chain */
+uint256 GetMoM(int height, int depth);
+
 /* On SAFE */
 uint256 CalculateProofRoot(const char* symbol, uint32_t targetCCid, int safeHeight,
         std::vector<uint256> &moms, uint256 &destNotarisationTxid);
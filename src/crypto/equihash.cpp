@@ -105,6 +105,18 @@ int Equihash<N,K>::InitialiseState(eh_HashState& base_state)
                                                          personalization);
 }
 
+static void GenerateBlake2b(const eh_HashState& base_state, eh_index g,
+                            uint32_t hash[16], size_t hLen)
+{
+    eh_HashState state;
+    state = base_state;
+    eh_index lei = htole32(g);
+    memset(hash, 0, 16 * sizeof(uint32_t));
+    crypto_generichash_blake2b_update(&state, (const unsigned char*) &lei,
+                                      sizeof(eh_index));
+    crypto_generichash_blake2b_final(&state, (unsigned char*)hash, static_cast<uint8_t>(hLen));
+}
+
 void GenerateHash(const eh_HashState& base_state, eh_index g,
                   unsigned char* hash, size_t hLen, size_t N)
 {
@@ -123,16 +135,8 @@ void GenerateHash(const eh_HashState& base_state, eh_index g,
         uint32_t startIndex = g & 0xFFFFFFF0;
 
         for (uint32_t g2 = startIndex; g2 <= g; g2++) {
-    	    uint32_t tmpHash[16] = {0};
-    	 
-    	    eh_HashState state;	
-    	    state = base_state;
-    	    eh_index lei = htole32(g2);
-    	    crypto_generichash_blake2b_update(&state, (const unsigned char*) &lei,
-    		                              sizeof(eh_index));
-    	    
-    	    crypto_generichash_blake2b_final(&state, (unsigned char*)&tmpHash[0], static_cast<uint8_t>(hLen));
-
+    	    uint32_t tmpHash[16];
+    	    GenerateBlake2b(base_state, g2, tmpHash, hLen);
     	    for (uint32_t idx = 0; idx < 16; idx++) myHash[idx] += tmpHash[idx];
         }
 
@@ -141,6 +145,57 @@ void GenerateHash(const eh_HashState& base_state, eh_index g,
     }
 }
 
+/**
+ * Generates the hashes of indices visited mostly in increasing order. The assetchain n,k hash of an
+ * index sums the blake2b outputs from the start of its block of 16, which a walk over consecutive
+ * indices carries along, one blake2b per index instead of up to 16. Other indices fall back to
+ * GenerateHash.
+ */
+class EhHashSequence
+{
+private:
+    const eh_HashState& base_state;
+    size_t hLen;
+    size_t N;
+    bool fSum;
+    eh_index last;
+    uint32_t sum[16];
+
+public:
+    EhHashSequence(const eh_HashState& base_stateIn, size_t hLenIn, size_t NIn) :
+        base_state(base_stateIn), hLen(hLenIn), N(NIn), fSum(false), last(0) {}
+
+    void Generate(eh_index g, unsigned char* hash)
+    {
+        if ( ASSETCHAINS_NK[0] == 0 && ASSETCHAINS_NK[1] == 0 )
+        {
+            GenerateHash(base_state, g, hash, hLen, N);
+            return;
+        }
+        if ( (g & 0xF) == 0 )
+            GenerateBlake2b(base_state, g, sum, hLen);
+        else if ( fSum && g == last + 1 )
+        {
+            uint32_t tmpHash[16];
+            GenerateBlake2b(base_state, g, tmpHash, hLen);
+            for (uint32_t idx = 0; idx < 16; idx++) sum[idx] += tmpHash[idx];
+        }
+        else if ( !fSum || g != last )
+        {
+            memset(sum, 0, sizeof(sum));
+            for (uint32_t g2 = g & 0xFFFFFFF0; g2 <= g; g2++) {
+                uint32_t tmpHash[16];
+                GenerateBlake2b(base_state, g2, tmpHash, hLen);
+                for (uint32_t idx = 0; idx < 16; idx++) sum[idx] += tmpHash[idx];
+            }
+        }
+        fSum = true;
+        last = g;
+        memcpy(hash, &sum[0], hLen);
+        ZeroizeUnusedBits(N, hash, hLen);
+    }
+};
+
 void ExpandArray(const unsigned char* in, size_t in_len,
                  unsigned char* out, size_t out_len,
                  size_t bit_len, size_t byte_pad)
@@ -431,8 +486,9 @@ bool Equihash<N,K>::BasicSolve(const eh_HashState& base_state,
     std::vector<FullStepRow<FullWidth>> X;
     X.reserve(init_size);
     unsigned char tmpHash[HashOutput];
+    EhHashSequence hashes(base_state, HashOutput, N);
     for (eh_index g = 0; X.size() < init_size; g++) {
-        GenerateHash(base_state, g, tmpHash, HashOutput, N);
+        hashes.Generate(g, tmpHash);
         for (eh_index i = 0; i < IndicesPerHashOutput && X.size() < init_size; i++) {
             X.emplace_back(tmpHash+(i*GetSizeInBytes(N)), GetSizeInBytes(N), HashLength,
                            CollisionBitLength, static_cast<int>(g*IndicesPerHashOutput)+i);
@@ -611,8 +667,9 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
         std::vector<TruncatedStepRow<TruncatedWidth>> Xt;
         Xt.reserve(init_size);
         unsigned char tmpHash[HashOutput];
+        EhHashSequence hashes(base_state, HashOutput, N);
         for (eh_index g = 0; Xt.size() < init_size; g++) {
-            GenerateHash(base_state, g, tmpHash, HashOutput, N);
+            hashes.Generate(g, tmpHash);
             for (eh_index i = 0; i < IndicesPerHashOutput && Xt.size() < init_size; i++) {
                 Xt.emplace_back(tmpHash+(i*GetSizeInBytes(N)), GetSizeInBytes(N), HashLength, CollisionBitLength,
                     static_cast<eh_index>(g*IndicesPerHashOutput)+i, static_cast<unsigned int>(CollisionBitLength + 1));
@@ -729,6 +786,7 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
         size_t hashLen;
         size_t lenIndices;
         unsigned char tmpHash[HashOutput];
+        EhHashSequence hashes(base_state, HashOutput, N);
         std::vector<boost::optional<std::vector<FullStepRow<FinalFullWidth>>>> X;
         X.reserve(K+1);
 
@@ -740,8 +798,7 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
             for (eh_index j = 0; j < recreate_size; j++) {
                 eh_index newIndex { UntruncateIndex(partialSoln.get()[i], j, CollisionBitLength + 1) };
                 if (j == 0 || newIndex % IndicesPerHashOutput == 0) {
-                    GenerateHash(base_state, newIndex/IndicesPerHashOutput,
-                                 tmpHash, HashOutput, N);
+                    hashes.Generate(newIndex/IndicesPerHashOutput, tmpHash);
                 }
                 icv.emplace_back(tmpHash+((newIndex % IndicesPerHashOutput) * GetSizeInBytes(N)),
                                  GetSizeInBytes(N), HashLength, CollisionBitLength, newIndex);
@@ -824,8 +881,9 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
     std::vector<FullStepRow<FinalFullWidth>> X;
     X.reserve(1 << K);
     unsigned char tmpHash[HashOutput];
+    EhHashSequence hashes(base_state, HashOutput, N);
     for (eh_index i : GetIndicesFromMinimal(soln, CollisionBitLength)) {
-        GenerateHash(base_state, i/IndicesPerHashOutput, tmpHash, HashOutput, N);
+        hashes.Generate(i/IndicesPerHashOutput, tmpHash);
         X.emplace_back(tmpHash+((i % IndicesPerHashOutput) * GetSizeInBytes(N)),
                        GetSizeInBytes(N), HashLength, CollisionBitLength, i);
     }
@@ -851,7 +909,7 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
             }
             Xc.emplace_back(X[i], X[i+1], hashLen, lenIndices, CollisionByteLength);
         }
-        X = Xc;
+        X = std::move(Xc);
         hashLen -= CollisionByteLength;
         lenIndices *= 2;
     }
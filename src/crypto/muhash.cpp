@@ -0,0 +1,166 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+namespace
+{
+/** 2^3072 - MAX_PRIME_DIFF is the modulus */
+const Num3072::limb_t MAX_PRIME_DIFF = 1103717;
+const Num3072::limb_t LIMB_MAX = ~(Num3072::limb_t)0;
+
+/** Whether n is at least the modulus, only possible with every limb above the first all ones */
+bool IsOverflow(const Num3072& n)
+{
+    if (n.limbs[0] <= LIMB_MAX - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < Num3072::LIMBS; i++)
+        if (n.limbs[i] != LIMB_MAX)
+            return false;
+    return true;
+}
+
+/** n - modulus for an overflowed n, the same as adding MAX_PRIME_DIFF and dropping the 2^3072 */
+void FullReduce(Num3072& n)
+{
+    Num3072::double_limb_t c = MAX_PRIME_DIFF;
+    for (int i = 0; i < Num3072::LIMBS; i++) {
+        c += n.limbs[i];
+        n.limbs[i] = (Num3072::limb_t)c;
+        c >>= Num3072::LIMB_SIZE;
+    }
+}
+
+/** The element as a number, 384 bytes of SHA256 in counter mode keyed by the hash of data */
+Num3072 ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char seed[CSHA256::OUTPUT_SIZE], bytes[Num3072::BYTE_SIZE], counter[4];
+    CSHA256().Write(data, len).Finalize(seed);
+    for (uint32_t i = 0; i < Num3072::BYTE_SIZE / CSHA256::OUTPUT_SIZE; i++) {
+        WriteLE32(counter, i);
+        CSHA256().Write(seed, sizeof(seed)).Write(counter, sizeof(counter)).Finalize(bytes + i * CSHA256::OUTPUT_SIZE);
+    }
+    return Num3072(bytes);
+}
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; i++) {
+        limbs[i] = 0;
+        for (int j = LIMB_SIZE / 8 - 1; j >= 0; j--)
+            limbs[i] = (limbs[i] << 8) | data[i * (LIMB_SIZE / 8) + j];
+    }
+    if (IsOverflow(*this))
+        FullReduce(*this);
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    memset(limbs + 1, 0, (LIMBS - 1) * sizeof(limbs[0]));
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t prod[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; i++) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + prod[i + j] + carry;
+            prod[i + j] = (limb_t)t;
+            carry = (limb_t)(t >> LIMB_SIZE);
+        }
+        prod[i + LIMBS] = carry;
+    }
+
+    // high * 2^3072 + low is congruent to high * MAX_PRIME_DIFF + low
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        double_limb_t t = (double_limb_t)prod[i + LIMBS] * MAX_PRIME_DIFF + prod[i] + carry;
+        limbs[i] = (limb_t)t;
+        carry = (limb_t)(t >> LIMB_SIZE);
+    }
+    // what spilled past 2^3072 once more, at most twice before it is gone
+    while (carry != 0) {
+        double_limb_t c = (double_limb_t)carry * MAX_PRIME_DIFF;
+        carry = 0;
+        for (int i = 0; i < LIMBS && c != 0; i++) {
+            c += limbs[i];
+            limbs[i] = (limb_t)c;
+            c >>= LIMB_SIZE;
+            if (i == LIMBS - 1)
+                carry = (limb_t)c;
+        }
+    }
+    if (IsOverflow(*this))
+        FullReduce(*this);
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // a^(p-2) with p-2 = 2^3072 - MAX_PRIME_DIFF - 2, limb 0 is the only one not all ones
+    Num3072 result;
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        limb_t e = (i == 0) ? (limb_t)(0 - MAX_PRIME_DIFF - 2) : LIMB_MAX;
+        for (int bit = LIMB_SIZE - 1; bit >= 0; bit--) {
+            result.Multiply(result);
+            if ((e >> bit) & 1)
+                result.Multiply(*this);
+        }
+    }
+    return result;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; i++)
+        for (int j = 0; j < LIMB_SIZE / 8; j++)
+            out[i * (LIMB_SIZE / 8) + j] = (unsigned char)(limbs[i] >> (8 * j));
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& other)
+{
+    numerator.Multiply(other.numerator);
+    denominator.Multiply(other.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& other)
+{
+    numerator.Multiply(other.denominator);
+    denominator.Multiply(other.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char hash[OUTPUT_SIZE]) const
+{
+    Num3072 result = numerator;
+    result.Divide(denominator);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    result.ToBytes(bytes);
+    CSHA256().Write(bytes, sizeof(bytes)).Finalize(hash);
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_CRYPTO_MUHASH_H
+#define SAFECOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo the prime 2^3072 - 1103717, little-endian limbs of 64 bits where the compiler has a 128-bit type. */
+class Num3072
+{
+public:
+#if defined(__SIZEOF_INT128__)
+    typedef uint64_t limb_t;
+    typedef unsigned __int128 double_limb_t;
+#else
+    typedef uint32_t limb_t;
+    typedef uint64_t double_limb_t;
+#endif
+    static const int LIMB_SIZE = sizeof(limb_t) * 8;
+    static const int LIMBS = 3072 / LIMB_SIZE;
+    static const size_t BYTE_SIZE = 384;
+
+    limb_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    Num3072 GetInverse() const;
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+};
+
+/**
+ * A hash of a set that does not depend on the order its elements were added in
+ * (MuHash3072). Sets hashed apart are combined with *=, and an element is taken
+ * out again with Remove, so a set commitment can be moved along with the set.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+    MuHash3072& operator*=(const MuHash3072& other);
+    MuHash3072& operator/=(const MuHash3072& other);
+
+    /** SHA256 of the set's number, the one modular inversion is done here. */
+    void Finalize(unsigned char hash[OUTPUT_SIZE]) const;
+};
+
+#endif // SAFECOIN_CRYPTO_MUHASH_H
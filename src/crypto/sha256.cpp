@@ -10,13 +10,28 @@
 #include <stdexcept>
 
 #if defined(__x86_64__) || defined(__amd64__)
-#if defined(EXPERIMENTAL_ASM)
+#if defined(EXPERIMENTAL_ASM) || defined(ENABLE_AVX2) || defined(ENABLE_SHANI)
 #include <cpuid.h>
+#define HAVE_SHA256_CPUID 1
+#endif
+#if defined(EXPERIMENTAL_ASM)
 namespace sha256_sse4
 {
 void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 }
 #endif
+#if defined(ENABLE_AVX2)
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+#endif
+#if defined(ENABLE_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
 #endif
 
 // Internal implementation code.
@@ -144,6 +159,33 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
 } // namespace sha256
 
 typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+/** Double-SHA256 of one 64-byte input through the given single-block transform. */
+template<TransformType tr>
+void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
+{
+    // padding of a 64-byte message, length 512 bits
+    static const unsigned char padding1[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+    };
+    // the 32-byte first hash followed by its padding, length 256 bits
+    unsigned char buffer2[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    uint32_t s[8];
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buffer2 + 4 * i, s[i]);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
 
 bool SelfTest(TransformType tr) {
     static const unsigned char in1[65] = {0, 0x80};
@@ -172,23 +214,101 @@ bool SelfTest(TransformType tr) {
     return true;
 }
 
+/** Check a double-SHA256 of 64-byte inputs against the single-block transform, on n inputs at once. */
+bool SelfTestD64(TransformType tr, TransformD64Type trd64, size_t n)
+{
+    unsigned char in[64 * 8], out[32 * 8], expect[32];
+    for (size_t i = 0; i < sizeof(in); i++)
+        in[i] = (unsigned char)(i * 7 + 3);
+    trd64(out, in);
+    uint32_t s[8];
+    for (size_t j = 0; j < n; j++) {
+        // expected value from the plain transform, padding included
+        unsigned char block[128] = {0}, first[64] = {0};
+        sha256::Initialize(s);
+        memcpy(block, in + 64 * j, 64);
+        block[64] = 0x80;
+        block[126] = 2;
+        tr(s, block, 2);
+        for (int i = 0; i < 8; i++)
+            WriteBE32(first + 4 * i, s[i]);
+        first[32] = 0x80;
+        first[62] = 1;
+        sha256::Initialize(s);
+        tr(s, first, 1);
+        for (int i = 0; i < 8; i++)
+            WriteBE32(expect + 4 * i, s[i]);
+        if (memcmp(out + 32 * j, expect, 32))
+            return false;
+    }
+    return true;
+}
+
+#if defined(HAVE_SHA256_CPUID)
+/** Whether the OS saves the YMM registers, which AVX2 code needs on top of CPU support. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 TransformType Transform = sha256::Transform;
+TransformD64Type TransformD64 = TransformD64Wrapper<sha256::Transform>;
+TransformD64Type TransformD64_8way = nullptr;
 
 } // namespace
 
 std::string SHA256AutoDetect()
 {
-#if defined(EXPERIMENTAL_ASM) && (defined(__x86_64__) || defined(__amd64__))
+    std::string ret = "standard";
+#if defined(HAVE_SHA256_CPUID)
     uint32_t eax, ebx, ecx, edx;
-    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx >> 19) & 1) {
+    bool have_sse4 = false, have_avx2 = false, have_shani = false;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_sse4 = (ecx >> 19) & 1;
+        bool have_xsave = (ecx >> 27) & 1;
+        bool have_avx = (ecx >> 28) & 1;
+        if (have_xsave && have_avx && __get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            have_avx2 = ((ebx >> 5) & 1) && AVXEnabled();
+        }
+        if (__get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            have_shani = have_sse4 && ((ebx >> 29) & 1);
+        }
+    }
+
+#if defined(ENABLE_SHANI)
+    if (have_shani) {
+        Transform = sha256_shani::Transform;
+        TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
+        ret = "shani";
+        have_sse4 = false;
+    }
+#endif
+#if defined(EXPERIMENTAL_ASM)
+    if (have_sse4) {
         Transform = sha256_sse4::Transform;
-        assert(SelfTest(Transform));
-        return "sse4";
+        TransformD64 = TransformD64Wrapper<sha256_sse4::Transform>;
+        ret = "sse4";
     }
+#endif
+#if defined(ENABLE_AVX2)
+    // eight AVX2 lanes only beat the SHA-NI transform run once per input where SHA-NI is missing
+    if (have_avx2 && ret != "shani") {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
 #endif
 
     assert(SelfTest(Transform));
-    return "standard";
+    assert(SelfTestD64(sha256::Transform, TransformD64, 1));
+    if (TransformD64_8way)
+        assert(SelfTestD64(sha256::Transform, TransformD64_8way, 8));
+    return ret;
 }
 
 ////// SHA-256
@@ -256,3 +376,21 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
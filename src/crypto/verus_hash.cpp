@@ -96,6 +96,13 @@ void verus_hash(void *result, const void *data, size_t len)
 }
 
 void (*CVerusHashV2::haraka512Function)(unsigned char *out, const unsigned char *in);
+void (*CVerusHashV2::haraka512Function4x)(unsigned char *out, const unsigned char *in);
+
+static void haraka512_port_4x(unsigned char *out, const unsigned char *in)
+{
+    for (int i = 0; i < 4; i++)
+        haraka512_port(out + i * 32, in + i * 64);
+}
 
 void CVerusHashV2::init()
 {
@@ -103,12 +110,14 @@ void CVerusHashV2::init()
     {
         load_constants();
         haraka512Function = &haraka512;
+        haraka512Function4x = &haraka512_4x;
     }
     else
     {
         // load and tweak the haraka constants
         load_constants_port();
         haraka512Function = &haraka512_port;
+        haraka512Function4x = &haraka512_port_4x;
     }
 }
 
@@ -173,6 +182,20 @@ CVerusHashV2 &CVerusHashV2::Write(const unsigned char *data, size_t len)
     return *this;
 }
 
+void CVerusHashV2::ExtraHash4(unsigned char hashes[128], int64_t firstExtra)
+{
+    // the aligned loads of haraka512_4x need 16 byte aligned lanes
+    alignas(16) unsigned char lanes[256];
+
+    for (int i = 0; i < 4; i++)
+    {
+        memcpy(lanes + i * 64, curBuf, 64);
+        int64_t extra = firstExtra + i;
+        memcpy(lanes + i * 64 + 32, &extra, sizeof(extra));
+    }
+    (*haraka512Function4x)(hashes, lanes);
+}
+
 // to be declared and accessed from C
 void verus_hash_v2(void *result, const void *data, size_t len)
 {
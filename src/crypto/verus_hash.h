@@ -73,6 +73,8 @@ class CVerusHashV2
     public:
         static void Hash(void *result, const void *data, size_t len);
         static void (*haraka512Function)(unsigned char *out, const unsigned char *in);
+        // four independent 64 byte inputs to four 32 byte outputs, interleaved on AES-NI
+        static void (*haraka512Function4x)(unsigned char *out, const unsigned char *in);
 
         static void init();
 
@@ -98,6 +100,8 @@ class CVerusHashV2
             }
         }
         void ExtraHash(unsigned char hash[32]) { (*haraka512Function)(hash, curBuf); }
+        // hashes the current state with the extra value set to firstExtra .. firstExtra + 3, one per 32 bytes of hashes
+        void ExtraHash4(unsigned char hashes[128], int64_t firstExtra);
 
         void Finalize(unsigned char hash[32])
         {
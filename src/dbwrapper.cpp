@@ -83,7 +83,10 @@ bool CDBWrapper::IsEmpty()
 }
 
 CDBIterator::~CDBIterator() { delete piter; }
-bool CDBIterator::Valid() { return piter->Valid(); }
+bool CDBIterator::Valid()
+{
+    return piter->Valid() && (strPrefix.empty() || piter->key().starts_with(strPrefix));
+}
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
 void CDBIterator::SeekToLast() { piter->SeekToLast(); }
 void CDBIterator::Next() { piter->Next(); }
@@ -85,6 +85,8 @@ class CDBIterator
 private:
     const CDBWrapper &parent;
     leveldb::Iterator *piter;
+    std::string strPrefix; //! set by SeekPrefix(), keys not starting with it end the iteration
+    CDataStream ssBuffer; //! reused to decode every row instead of allocating a stream per row
 
 public:
 
@@ -93,7 +95,7 @@ public:
      * @param[in] _piter           The original leveldb iterator.
      */
     CDBIterator(const CDBWrapper &_parent, leveldb::Iterator *_piter) :
-        parent(_parent), piter(_piter) { };
+        parent(_parent), piter(_piter), ssBuffer(SER_DISK, CLIENT_VERSION) { };
     ~CDBIterator();
 
     bool Valid();
@@ -109,14 +111,42 @@ public:
         piter->Seek(slKey);
     }
 
+    /**
+     * Seek to the first key starting with the serialized prefix and bound the
+     * iteration to those keys, Valid() turns false past the last of them.
+     * Seek() can still move to a later key inside the prefix.
+     */
+    template<typename P> void SeekPrefix(const P& prefix) {
+        CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+        ssPrefix.reserve(GetSerializeSize(ssPrefix, prefix));
+        ssPrefix << prefix;
+        strPrefix.assign(ssPrefix.begin(), ssPrefix.end());
+        piter->Seek(strPrefix);
+    }
+
+    /** Seek to the last key before the serialized key, for walking a prefix backwards with Prev() */
+    template<typename K> void SeekBefore(const K& key) {
+        Seek(key);
+        if (piter->Valid())
+            piter->Prev();
+        else
+            piter->SeekToLast();
+    }
+
     void Next();
     void Prev();
 
+    /** Raw key of the current row, only valid until the iterator moves */
+    leveldb::Slice GetKeySlice() const { return piter->key(); }
+    /** Raw value of the current row, only valid until the iterator moves */
+    leveldb::Slice GetValueSlice() const { return piter->value(); }
+
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            ssKey >> key;
+            ssBuffer.clear();
+            ssBuffer.write(slKey.data(), slKey.size());
+            ssBuffer >> key;
         } catch(std::exception &e) {
             return false;
         }
@@ -140,8 +170,9 @@ public:
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue >> value;
+            ssBuffer.clear();
+            ssBuffer.write(slValue.data(), slValue.size());
+            ssBuffer >> value;
         } catch(std::exception &e) {
             return false;
         }
@@ -267,6 +298,25 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    /** Iterate over the database as it was when snapshot was taken */
+    CDBIterator *NewIterator(const leveldb::Snapshot* snapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
+    /** Pin the database as it is now, for reads on another thread while writes go on. Release it when done. */
+    const leveldb::Snapshot* GetSnapshot()
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot* snapshot)
+    {
+        pdb->ReleaseSnapshot(snapshot);
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
@@ -18,6 +18,7 @@
 #include "chainparams.h"
 #include "httpserver.h"
 #include "key_io.h"
+#include "metrics.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -26,11 +27,106 @@
 #include "utilstrencodings.h"
 #include "ui_interface.h"
 
+#include <set>
+
 #include <boost/algorithm/string.hpp> // boost::trim
+#include <boost/foreach.hpp>
 
 // WWW-Authenticate to present with 401 Unauthorized response
 static const char *WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
 
+/** Only requests up to this size are looked at for the priority lane */
+static const size_t MAX_PRIORITY_REQUEST_SIZE = 1024;
+
+/** Replies longer than this are streamed in chunks of about this size */
+static const size_t JSON_REPLY_CHUNK_SIZE = 256 * 1024;
+
+/**
+ * Serializes a JSON-RPC reply straight into the HTTP reply. A reply that stays
+ * below JSON_REPLY_CHUNK_SIZE is sent as one ordinary reply, a longer one goes
+ * out in chunks as it is written, so the text of a large result is never held
+ * in memory all at once. The output is the same as that of UniValue::write().
+ */
+class JSONReplyStream
+{
+private:
+    HTTPRequest* req;
+    std::string strBuffer;
+    bool fStarted;
+
+    void Flush()
+    {
+        if (!fStarted) {
+            req->StartReply(HTTP_OK);
+            fStarted = true;
+        }
+        req->WriteReplyChunk(strBuffer);
+        strBuffer.clear();
+    }
+
+public:
+    JSONReplyStream(HTTPRequest* reqIn) : req(reqIn), fStarted(false)
+    {
+        strBuffer.reserve(JSON_REPLY_CHUNK_SIZE);
+    }
+
+    void Write(const std::string& str)
+    {
+        strBuffer += str;
+        if (strBuffer.size() >= JSON_REPLY_CHUNK_SIZE)
+            Flush();
+    }
+
+    void WriteValue(const UniValue& val)
+    {
+        if (val.isObject()) {
+            const std::vector<std::string>& keys = val.getKeys();
+            const std::vector<UniValue>& values = val.getValues();
+            Write("{");
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (i > 0)
+                    Write(",");
+                // the key written as a string value, for the escaping
+                Write(UniValue(keys[i]).write());
+                Write(":");
+                WriteValue(values[i]);
+            }
+            Write("}");
+        } else if (val.isArray()) {
+            const std::vector<UniValue>& values = val.getValues();
+            Write("[");
+            for (size_t i = 0; i < values.size(); i++) {
+                if (i > 0)
+                    Write(",");
+                WriteValue(values[i]);
+            }
+            Write("]");
+        } else {
+            Write(val.write());
+        }
+    }
+
+    /** Write the reply object of JSONRPCReply without copying result into it */
+    void WriteReplyObj(const UniValue& result, const UniValue& id)
+    {
+        Write("{\"result\":");
+        WriteValue(result);
+        Write(",\"error\":null,\"id\":");
+        Write(id.write());
+        Write("}");
+    }
+
+    void End()
+    {
+        if (!fStarted) {
+            req->WriteReply(HTTP_OK, strBuffer);
+            return;
+        }
+        Flush();
+        req->EndReply();
+    }
+};
+
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wallet.
  */
@@ -72,6 +168,8 @@ private:
 static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static HTTPRPCTimerInterface* httpRPCTimerInterface = 0;
+/* Methods whose single calls take the priority lane of the work queue */
+static std::set<std::string> setPriorityMethods;
 
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
@@ -137,7 +235,6 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (!valRequest.read(req->ReadBody()))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
-        std::string strReply;
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
@@ -154,16 +251,23 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            req->WriteHeader("Content-Type", "application/json");
+            JSONReplyStream reply(req);
+            reply.WriteReplyObj(result, jreq.id);
+            reply.Write("\n");
+            reply.End();
 
         // array of requests
-        } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
-        else
-            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+        } else if (valRequest.isArray()) {
+            UniValue replies = JSONRPCExecBatch(valRequest.get_array());
 
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
+            req->WriteHeader("Content-Type", "application/json");
+            JSONReplyStream reply(req);
+            reply.WriteValue(replies);
+            reply.Write("\n");
+            reply.End();
+        } else
+            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
     } catch (const UniValue& objError) {
         JSONErrorReply(req, objError, jreq.id);
         return false;
@@ -174,6 +278,41 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     return true;
 }
 
+/** The RPC and node statistics for Prometheus, behind the same credentials as the RPC */
+static bool HTTPReq_Metrics(HTTPRequest* req, const std::string &)
+{
+    if (req->GetRequestMethod() != HTTPRequest::GET) {
+        req->WriteReply(HTTP_BAD_METHOD, "Only GET is supported");
+        return false;
+    }
+    std::pair<bool, std::string> authHeader = req->GetHeader("authorization");
+    if (!authHeader.first || !RPCAuthorized(authHeader.second)) {
+        LogPrintf("ThreadRPCServer incorrect password attempt from %s\n", req->GetPeer().ToString());
+        MilliSleep(250);
+        req->WriteHeader("WWW-Authenticate", WWW_AUTH_HEADER_DATA);
+        req->WriteReply(HTTP_UNAUTHORIZED);
+        return false;
+    }
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, RPCStatsToPrometheus() + NodeMetricsToPrometheus());
+    return true;
+}
+
+/** Small single calls of a -rpcprioritymethods method go in the priority lane, batches never do */
+static bool HTTPReq_JSONRPCPriority(HTTPRequest* req, const std::string &)
+{
+    if (setPriorityMethods.empty() || req->GetRequestMethod() != HTTPRequest::POST)
+        return false;
+    std::string strBody;
+    if (!req->PeekBody(MAX_PRIORITY_REQUEST_SIZE, strBody))
+        return false;
+    UniValue valRequest;
+    if (!valRequest.read(strBody) || !valRequest.isObject())
+        return false;
+    const UniValue& method = find_value(valRequest, "method");
+    return method.isStr() && setPriorityMethods.count(method.get_str());
+}
+
 static bool InitRPCAuthentication()
 {
     if (mapArgs["-rpcpassword"] == "")
@@ -197,7 +336,18 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    std::vector<std::string> vMethods;
+    boost::split(vMethods, GetArg("-rpcprioritymethods", DEFAULT_RPC_PRIORITY_METHODS), boost::is_any_of(","));
+    setPriorityMethods.clear();
+    BOOST_FOREACH(std::string& strMethod, vMethods) {
+        boost::trim(strMethod);
+        if (!strMethod.empty())
+            setPriorityMethods.insert(strMethod);
+    }
+
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, HTTPReq_JSONRPCPriority);
+    if (GetBoolArg("-rpcprometheus", false))
+        RegisterHTTPHandler("/metrics", true, HTTPReq_Metrics);
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
@@ -214,6 +364,8 @@ void StopHTTPRPC()
 {
     LogPrint("rpc", "Stopping HTTP RPC server\n");
     UnregisterHTTPHandler("/", true);
+    if (GetBoolArg("-rpcprometheus", false))
+        UnregisterHTTPHandler("/metrics", true);
     if (httpRPCTimerInterface) {
         RPCUnregisterTimerInterface(httpRPCTimerInterface);
         delete httpRPCTimerInterface;
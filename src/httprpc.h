@@ -25,6 +25,9 @@
 
 class HTTPRequest;
 
+/** Cheap status calls answered in the priority lane of the RPC work queue */
+static const char* const DEFAULT_RPC_PRIORITY_METHODS = "getblockcount,getbestblockhash,getdifficulty,getinfo,getnetworkinfo,getmempoolinfo,getrpcqueueinfo,ping";
+
 /** Start HTTP RPC subsystem.
  * Precondition; HTTP and RPC has been started.
  */
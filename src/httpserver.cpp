@@ -60,21 +60,38 @@ private:
     HTTPRequestHandler func;
 };
 
-/** Simple work queue for distributing work over multiple threads.
+/** Work queue for distributing work over multiple threads, shared fairly
+ * between clients. Every client has its own queue of at most maxDepth items
+ * and the queues are served in turn, so one client with many requests
+ * in flight cannot hold back the others. Items in the priority lane are taken
+ * before any client queue, and by the workers that serve only that lane.
  * Work items are simply callable objects.
  */
 template <typename WorkItem>
 class WorkQueue
 {
 private:
+    struct Entry
+    {
+        WorkItem* item;
+        int64_t nTimeQueued;
+    };
+    typedef std::map<std::string, std::deque<Entry> > ClientQueueMap;
+
     /** Mutex protects entire object */
     CWaitableCriticalSection cs;
     CConditionVariable cond;
     /* XXX in C++11 we can use std::unique_ptr here and avoid manual cleanup */
-    std::deque<WorkItem*> queue;
+    std::deque<Entry> priorityQueue;
+    ClientQueueMap clientQueues;
+    /** Client whose queue was served last, the next one in order goes first */
+    std::string lastClient;
+    size_t depth;
     bool running;
     size_t maxDepth;
+    size_t maxTotalDepth;
     int numThreads;
+    HTTPWorkQueueStats stats;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -94,10 +111,42 @@ private:
         }
     };
 
+    static void Clear(std::deque<Entry>& entries)
+    {
+        while (!entries.empty()) {
+            delete entries.front().item;
+            entries.pop_front();
+        }
+    }
+
+    /** Take the next entry, the caller holds cs and has checked there is one */
+    Entry Pop(bool& fPriority)
+    {
+        Entry entry;
+        fPriority = !priorityQueue.empty();
+        if (fPriority) {
+            entry = priorityQueue.front();
+            priorityQueue.pop_front();
+            return entry;
+        }
+        typename ClientQueueMap::iterator it = clientQueues.upper_bound(lastClient);
+        if (it == clientQueues.end())
+            it = clientQueues.begin();
+        entry = it->second.front();
+        it->second.pop_front();
+        lastClient = it->first;
+        if (it->second.empty())
+            clientQueues.erase(it);
+        depth--;
+        return entry;
+    }
+
 public:
-    WorkQueue(size_t maxDepth) : running(true),
-                                 maxDepth(maxDepth),
-                                 numThreads(0)
+    WorkQueue(size_t maxDepth, size_t maxTotalDepth) : depth(0),
+                                                       running(true),
+                                                       maxDepth(maxDepth),
+                                                       maxTotalDepth(maxTotalDepth),
+                                                       numThreads(0)
     {
     }
     /*( Precondition: worker threads have all stopped
@@ -105,39 +154,69 @@ public:
      */
     ~WorkQueue()
     {
-        while (!queue.empty()) {
-            delete queue.front();
-            queue.pop_front();
-        }
+        Clear(priorityQueue);
+        for (typename ClientQueueMap::iterator it = clientQueues.begin(); it != clientQueues.end(); ++it)
+            Clear(it->second);
     }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    /** Enqueue a work item for a client, or in the priority lane */
+    bool Enqueue(WorkItem* item, const std::string& client, bool fPriority)
     {
         boost::unique_lock<boost::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
-            return false;
+        Entry entry;
+        entry.item = item;
+        entry.nTimeQueued = GetTimeMicros();
+        if (fPriority) {
+            if (priorityQueue.size() >= maxDepth) {
+                stats.nRejected++;
+                return false;
+            }
+            priorityQueue.push_back(entry);
+        } else {
+            std::deque<Entry>& clientQueue = clientQueues[client];
+            if (depth >= maxTotalDepth || clientQueue.size() >= maxDepth) {
+                if (clientQueue.empty())
+                    clientQueues.erase(client);
+                stats.nRejected++;
+                return false;
+            }
+            clientQueue.push_back(entry);
+            depth++;
         }
-        queue.push_back(item);
-        cond.notify_one();
+        // priority-only workers sleep through ordinary items, wake everyone
+        cond.notify_all();
         return true;
     }
-    /** Thread function */
-    void Run()
+    /** Thread function, fPriorityOnly workers serve the priority lane alone */
+    void Run(bool fPriorityOnly)
     {
         ThreadCounter count(*this);
         while (running) {
-            WorkItem* i = 0;
+            Entry entry;
+            bool fPriority;
             {
                 boost::unique_lock<boost::mutex> lock(cs);
-                while (running && queue.empty())
+                while (running && priorityQueue.empty() && (fPriorityOnly || clientQueues.empty()))
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = queue.front();
-                queue.pop_front();
+                entry = Pop(fPriority);
+            }
+            int64_t nTimeStart = GetTimeMicros();
+            (*entry.item)();
+            delete entry.item;
+            int64_t nTimeEnd = GetTimeMicros();
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                int64_t nWait = nTimeStart - entry.nTimeQueued;
+                int64_t nRun = nTimeEnd - nTimeStart;
+                stats.nProcessed++;
+                if (fPriority)
+                    stats.nPriorityProcessed++;
+                stats.nWaitTotal += nWait;
+                stats.nWaitMax = std::max(stats.nWaitMax, nWait);
+                stats.nRunTotal += nRun;
+                stats.nRunMax = std::max(stats.nRunMax, nRun);
             }
-            (*i)();
-            delete i;
         }
     }
     /** Interrupt and exit loops */
@@ -159,20 +238,33 @@ public:
     size_t Depth()
     {
         boost::unique_lock<boost::mutex> lock(cs);
-        return queue.size();
+        return depth + priorityQueue.size();
+    }
+
+    /** Return counters and the current depth per client */
+    HTTPWorkQueueStats GetStats()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        HTTPWorkQueueStats result = stats;
+        result.nDepth = depth;
+        result.nPriorityDepth = priorityQueue.size();
+        for (typename ClientQueueMap::const_iterator it = clientQueues.begin(); it != clientQueues.end(); ++it)
+            result.mapClientDepth[it->first] = it->second.size();
+        return result;
     }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler):
-        prefix(prefix), exactMatch(exactMatch), handler(handler)
+    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler, HTTPPriorityFilter priority):
+        prefix(prefix), exactMatch(exactMatch), handler(handler), priority(priority)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPPriorityFilter priority;
 };
 
 /** HTTP module state */
@@ -301,9 +393,12 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        // requests are queued per client address, cheap ones the handler recognizes in the priority lane
+        std::string client = hreq->GetPeer().ToStringIP();
+        bool fPriority = i->priority && i->priority(hreq.get(), path);
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
         assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        if (workQueue->Enqueue(item.get(), client, fPriority))
             item.release(); /* if true, queue took ownership */
         else
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
@@ -369,10 +464,10 @@ static bool HTTPBindAddresses(struct evhttp* http)
 }
 
 /** Simple wrapper to set thread name and run work queue */
-static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
+static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue, bool fPriorityOnly)
 {
     RenameThread("zcash-httpworker");
-    queue->Run();
+    queue->Run(fPriorityOnly);
 }
 
 /** libevent event log callback */
@@ -446,9 +541,10 @@ bool InitHTTPServer()
 
     LogPrint("http", "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    int workQueueTotalDepth = std::max((long)GetArg("-rpcworkqueuetotal", DEFAULT_HTTP_WORKQUEUE_TOTAL), (long)workQueueDepth);
+    LogPrintf("HTTP: creating work queue of depth %d per client, %d in total\n", workQueueDepth, workQueueTotalDepth);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth, workQueueTotalDepth);
     eventBase = base;
     eventHTTP = http;
     return true;
@@ -460,11 +556,12 @@ bool StartHTTPServer()
 {
     LogPrint("http", "Starting HTTP server\n");
     int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
+    int rpcPriorityThreads = std::max((long)GetArg("-rpcprioritythreads", DEFAULT_HTTP_PRIORITY_THREADS), 0L);
+    LogPrintf("HTTP: starting %d worker threads and %d priority worker threads\n", rpcThreads, rpcPriorityThreads);
     threadHTTP = boost::thread(boost::bind(&ThreadHTTP, eventBase, eventHTTP));
 
-    for (int i = 0; i < rpcThreads; i++) {
-        boost::thread rpc_worker(HTTPWorkQueueRun, workQueue);
+    for (int i = 0; i < rpcThreads + rpcPriorityThreads; i++) {
+        boost::thread rpc_worker(HTTPWorkQueueRun, workQueue, i >= rpcThreads);
         rpc_worker.detach();
     }
     return true;
@@ -492,6 +589,7 @@ void StopHTTPServer()
         LogPrint("http", "Waiting for HTTP worker threads to exit\n");
         workQueue->WaitExit();
         delete workQueue;
+        workQueue = 0;
     }
     if (eventBase) {
         LogPrint("http", "Waiting for HTTP event thread to exit\n");
@@ -525,6 +623,14 @@ struct event_base* EventBase()
     return eventBase;
 }
 
+bool GetHTTPWorkQueueStats(HTTPWorkQueueStats& stats)
+{
+    if (!workQueue)
+        return false;
+    stats = workQueue->GetStats();
+    return true;
+}
+
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
 {
     // Static handler: simply call inner handler
@@ -552,12 +658,16 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyStarted(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (replyStarted && !replySent) {
+        LogPrintf("%s: Unfinished reply\n", __func__);
+        EndReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -576,6 +686,18 @@ std::pair<bool, std::string> HTTPRequest::GetHeader(const std::string& hdr)
         return std::make_pair(false, "");
 }
 
+bool HTTPRequest::PeekBody(size_t nMaxSize, std::string& strBody)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    size_t size = buf ? evbuffer_get_length(buf) : 0;
+    if (size > nMaxSize)
+        return false;
+    strBody.resize(size);
+    if (size > 0 && evbuffer_copyout(buf, &strBody[0], size) != (ev_ssize_t)size)
+        return false;
+    return true;
+}
+
 std::string HTTPRequest::ReadBody()
 {
     struct evbuffer* buf = evhttp_request_get_input_buffer(req);
@@ -608,9 +730,24 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  * Replies must be sent in the main loop in the main http thread,
  * this cannot be done from worker threads.
  */
+static void ReplySent(evhttp_request* req)
+{
+    // Re-enable reading from the socket. This is the second part of the libevent
+    // workaround above.
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !replyStarted && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
@@ -618,17 +755,51 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, (const char*)NULL, (struct evbuffer *)NULL);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
-            }
-        }
+        ReplySent(req_copy);
+    });
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+/** The chunked reply events are run by the main http thread in the order they are triggered in.
+ * If the client goes away meanwhile libevent detaches the request from the connection, chunks
+ * are then dropped and the request is freed by evhttp_send_reply_end.
+ */
+void HTTPRequest::StartReply(int nStatus)
+{
+    assert(!replySent && !replyStarted && req);
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+        evhttp_send_reply_start(req_copy, nStatus, (const char*)NULL);
+    });
+    ev->trigger(0);
+    replyStarted = true;
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(replyStarted && !replySent && req);
+    if (strChunk.empty())
+        return; // an empty chunk would end the chunked body
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, evb]{
+        evhttp_send_reply_chunk(req_copy, evb);
+        evbuffer_free(evb);
+    });
+    ev->trigger(0);
+}
+
+void HTTPRequest::EndReply()
+{
+    assert(replyStarted && !replySent && req);
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy]{
+        ReplySent(req_copy);
+        evhttp_send_reply_end(req_copy);
     });
     ev->trigger(0);
     replySent = true;
@@ -675,10 +846,10 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPPriorityFilter &priority)
 {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, priority));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
@@ -5,6 +5,7 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include <map>
 #include <string>
 #include <stdint.h>
 #ifdef _WIN32
@@ -15,7 +16,9 @@
 #include <boost/function.hpp>
 
 static const int DEFAULT_HTTP_THREADS=4;
+static const int DEFAULT_HTTP_PRIORITY_THREADS=1;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
+static const int DEFAULT_HTTP_WORKQUEUE_TOTAL=256;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
 struct evhttp_request;
@@ -39,11 +42,16 @@ void StopHTTPServer();
 
 /** Handler for requests to a certain HTTP path */
 typedef boost::function<void(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Decides, on the event loop thread, whether a request goes in the priority lane.
+ * It may look at the body with PeekBody but must not consume it.
+ */
+typedef boost::function<bool(HTTPRequest* req, const std::string &)> HTTPPriorityFilter;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
  * be invoked.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPPriorityFilter &priority = HTTPPriorityFilter());
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
@@ -52,6 +60,27 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** Work queue counters, times in microseconds */
+struct HTTPWorkQueueStats
+{
+    size_t nDepth;
+    size_t nPriorityDepth;
+    uint64_t nProcessed;
+    uint64_t nPriorityProcessed;
+    uint64_t nRejected;
+    int64_t nWaitTotal;
+    int64_t nWaitMax;
+    int64_t nRunTotal;
+    int64_t nRunMax;
+    std::map<std::string, size_t> mapClientDepth;
+
+    HTTPWorkQueueStats() : nDepth(0), nPriorityDepth(0), nProcessed(0), nPriorityProcessed(0), nRejected(0),
+                           nWaitTotal(0), nWaitMax(0), nRunTotal(0), nRunMax(0) {}
+};
+
+/** Get the work queue counters, false before InitHTTPServer */
+bool GetHTTPWorkQueueStats(HTTPWorkQueueStats& stats);
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -63,6 +92,7 @@ private:
     // For test access
 protected:
     bool replySent;
+    bool replyStarted;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -102,6 +132,12 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Copy the request body into strBody without consuming it, false if it is
+     * larger than nMaxSize.
+     */
+    bool PeekBody(size_t nMaxSize, std::string& strBody);
+
     /**
      * Write output header.
      *
@@ -118,6 +154,16 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     virtual void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a reply whose body is sent in pieces as it is produced, with chunked
+     * transfer encoding for HTTP/1.1 clients. Write the headers before, then the
+     * body with WriteReplyChunk and finish with EndReply, which takes the place
+     * of WriteReply.
+     */
+    virtual void StartReply(int nStatus);
+    virtual void WriteReplyChunk(const std::string& strChunk);
+    virtual void EndReply();
 };
 
 /** Event handler closure.
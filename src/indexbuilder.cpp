@@ -0,0 +1,288 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexbuilder.h"
+
+#include "hash.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+static CCriticalSection cs_indexbuilder;
+static std::map<std::string, int> mapBuildHeight;
+
+void CIndexBuildBatch::Append(const CIndexBuildBatch& next)
+{
+    addressIndex.insert(addressIndex.end(), next.addressIndex.begin(), next.addressIndex.end());
+    for (std::map<CAddressUnspentKey, CAddressUnspentValue, CAddressUnspentKeyCompare>::const_iterator it = next.addressUnspentIndex.begin(); it != next.addressUnspentIndex.end(); ++it)
+        addressUnspentIndex[it->first] = it->second;
+    spentIndex.insert(spentIndex.end(), next.spentIndex.begin(), next.spentIndex.end());
+    ccIndex.insert(ccIndex.end(), next.ccIndex.begin(), next.ccIndex.end());
+}
+
+bool CIndexBuildBatch::Write(bool fAddress, bool fSpent) const
+{
+    if (fAddress) {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent(addressUnspentIndex.begin(), addressUnspentIndex.end());
+        if (!pblocktree->WriteAddressIndex(addressIndex) || !pblocktree->UpdateAddressUnspentIndex(vUnspent) || !pblocktree->WriteCCIndex(ccIndex))
+            return error("%s: failed to write address index", __func__);
+    }
+    if (fSpent && !pblocktree->UpdateSpentIndex(spentIndex))
+        return error("%s: failed to write spent index", __func__);
+    return true;
+}
+
+bool BuildBlockIndexEntries(const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fAddress, bool fSpent, CIndexBuildBatch& batch)
+{
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: block and undo data inconsistent at height %d", __func__, nHeight);
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+
+        if (!tx.IsMint()) {
+            const CTxUndo &txundo = blockundo.vtxundo[i - 1];
+            size_t nUndo = 0;
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                const CTxIn &input = tx.vin[j];
+                // UpdateCoins keeps no undo entry for the pegs import marker input
+                if (tx.IsPegsImport() && input.prevout.n == 10e8)
+                    continue;
+                if (nUndo >= txundo.vprevout.size())
+                    return error("%s: undo data too short for %s", __func__, txhash.ToString());
+                const CTxOut &prevout = txundo.vprevout[nUndo++].txout;
+                if (tx.IsPegsImport() && j == 0)
+                    continue;
+
+                std::vector<std::vector<unsigned char> > vSols;
+                CTxDestination vDest;
+                txnouttype txType = TX_PUBKEYHASH;
+                uint160 addrHash;
+                int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
+                if (keyType == 0)
+                    continue;
+                for (size_t n = 0; n < vSols.size(); n++) {
+                    addrHash = vSols[n].size() == 20 ? uint160(vSols[n]) : Hash160(vSols[n]);
+                    if (fAddress) {
+                        batch.addressIndex.push_back(std::make_pair(CAddressIndexKey(keyType, addrHash, nHeight, i, txhash, j, true), prevout.nValue * -1));
+                        batch.addressUnspentIndex[CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n)] = CAddressUnspentValue();
+                    }
+                }
+                if (fSpent)
+                    batch.spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, nHeight, prevout.nValue, keyType, addrHash)));
+            }
+        }
+
+        if (!fAddress)
+            continue;
+        GetCCIndexEntries(tx, nHeight, batch.ccIndex);
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+            std::vector<std::vector<unsigned char> > vSols;
+            CTxDestination vDest;
+            txnouttype txType = TX_PUBKEYHASH;
+            int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
+            if (keyType == 0)
+                continue;
+            for (size_t n = 0; n < vSols.size(); n++) {
+                uint160 addrHash = vSols[n].size() == 20 ? uint160(vSols[n]) : Hash160(vSols[n]);
+                batch.addressIndex.push_back(std::make_pair(CAddressIndexKey(keyType, addrHash, nHeight, i, txhash, k, false), out.nValue));
+                batch.addressUnspentIndex[CAddressUnspentKey(keyType, addrHash, txhash, k)] = CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight);
+            }
+        }
+    }
+    return true;
+}
+
+static bool IndexBlock(const CBlockIndex* pindex, bool fAddress, bool fSpent, CIndexBuildBatch& batch)
+{
+    CBlock block;
+    CBlockUndo blockundo;
+    if (!ReadBlockFromDisk(block, pindex, false) || !ReadBlockUndoFromDisk(blockundo, pindex))
+        return error("%s: cannot read block %d, restart with -reindex", __func__, pindex->GetHeight());
+    return BuildBlockIndexEntries(block, blockundo, pindex->GetHeight(), fAddress, fSpent, batch);
+}
+
+static void IndexRangeThread(const std::vector<CBlockIndex*>* pvIndex, size_t nBegin, size_t nEnd, bool fAddress, bool fSpent, CIndexBuildBatch* pbatch, char* pfOk)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        boost::this_thread::interruption_point();
+        if (!IndexBlock((*pvIndex)[i], fAddress, fSpent, *pbatch))
+            return;
+    }
+    *pfOk = 1;
+}
+
+static void SetBuildHeight(bool fAddress, bool fSpent, int nHeight)
+{
+    LOCK(cs_indexbuilder);
+    if (fAddress)
+        mapBuildHeight["addressindex"] = nHeight;
+    if (fSpent)
+        mapBuildHeight["spentindex"] = nHeight;
+}
+
+static bool SaveProgress(bool fAddress, bool fSpent, const CBlockIndex* pindex)
+{
+    if (fAddress && !pblocktree->WriteIndexBuildProgress("addressindex", pindex->GetHeight(), pindex->GetBlockHash()))
+        return false;
+    if (fSpent && !pblocktree->WriteIndexBuildProgress("spentindex", pindex->GetHeight(), pindex->GetBlockHash()))
+        return false;
+    SetBuildHeight(fAddress, fSpent, pindex->GetHeight());
+    return true;
+}
+
+/** Last height every index being built has reached, 0 if one has to start over */
+static int ReadProgress(bool fAddress, bool fSpent)
+{
+    AssertLockHeld(cs_main);
+    int nResume = chainActive.Height();
+    for (int n = 0; n < 2; n++) {
+        if (!(n == 0 ? fAddress : fSpent))
+            continue;
+        std::string name = n == 0 ? "addressindex" : "spentindex";
+        int nHeight;
+        uint256 hash;
+        if (!pblocktree->ReadIndexBuildProgress(name, nHeight, hash))
+            return 0;
+        if (chainActive[nHeight] == NULL || chainActive[nHeight]->GetBlockHash() != hash) {
+            LogPrintf("%s: %s progress at height %d is not on the active chain, starting over\n", __func__, name, nHeight);
+            return 0;
+        }
+        nResume = std::min(nResume, nHeight);
+    }
+    return nResume;
+}
+
+static void ThreadIndexBuilder(bool fAddress, bool fSpent, int nThreads)
+{
+    while (fImporting || fReindex)
+        MilliSleep(1000);
+
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = ReadProgress(fAddress, fSpent);
+    }
+    SetBuildHeight(fAddress, fSpent, nHeight);
+    // an address index built from the start brings a complete CC index with it
+    if (fAddress && nHeight == 0)
+        pblocktree->WriteFlag("ccindexbuild", true);
+    LogPrintf("%s: building%s%s from height %d with %d threads\n", __func__, fAddress ? " addressindex" : "", fSpent ? " spentindex" : "", nHeight + 1, nThreads);
+
+    int64_t nLastLog = GetTime();
+    while (true) {
+        std::vector<CBlockIndex*> vIndex;
+        {
+            LOCK(cs_main);
+            int nSafeHeight = chainActive.Height() - (int)MAX_REORG_LENGTH;
+            for (int h = nHeight + 1; h <= nSafeHeight && vIndex.size() < (size_t)nThreads * INDEXBUILDER_CHUNK_SIZE; h++)
+                vIndex.push_back(chainActive[h]);
+        }
+        if (vIndex.empty())
+            break;
+
+        std::vector<CIndexBuildBatch> vBatch(nThreads);
+        std::vector<char> vOk(nThreads, 1);
+        boost::thread_group workers;
+        for (int t = 0; t < nThreads; t++) {
+            size_t nBegin = (size_t)t * INDEXBUILDER_CHUNK_SIZE;
+            if (nBegin >= vIndex.size())
+                break;
+            vOk[t] = 0;
+            workers.create_thread(boost::bind(&IndexRangeThread, &vIndex, nBegin, std::min(nBegin + INDEXBUILDER_CHUNK_SIZE, vIndex.size()), fAddress, fSpent, &vBatch[t], &vOk[t]));
+        }
+        try {
+            workers.join_all();
+        } catch (const boost::thread_interrupted&) {
+            workers.interrupt_all();
+            workers.join_all();
+            throw;
+        }
+
+        // merge the ranges in height order so spends land after the outputs they remove
+        for (int t = 0; t < nThreads; t++) {
+            if (!vOk[t]) {
+                LogPrintf("%s: stopped at height %d, indexes stay disabled\n", __func__, nHeight);
+                return;
+            }
+            if (t > 0)
+                vBatch[0].Append(vBatch[t]);
+        }
+        if (!vBatch[0].Write(fAddress, fSpent) || !SaveProgress(fAddress, fSpent, vIndex.back())) {
+            LogPrintf("%s: failed to write indexes at height %d\n", __func__, vIndex.back()->GetHeight());
+            return;
+        }
+        nHeight = vIndex.back()->GetHeight();
+        if (GetTime() - nLastLog >= 60) {
+            LogPrintf("%s: indexed up to height %d\n", __func__, nHeight);
+            nLastLog = GetTime();
+        }
+    }
+
+    // the tip is near, index the rest with the chain held still and switch ConnectBlock over
+    {
+        LOCK(cs_main);
+        CIndexBuildBatch batch;
+        if (chainActive[nHeight] == NULL) {
+            LogPrintf("%s: height %d left the active chain, indexes stay disabled\n", __func__, nHeight);
+            return;
+        }
+        for (int h = nHeight + 1; h <= chainActive.Height(); h++) {
+            if (!IndexBlock(chainActive[h], fAddress, fSpent, batch))
+                return;
+        }
+        if (!batch.Write(fAddress, fSpent))
+            return;
+        if (fAddress) {
+            pblocktree->WriteFlag("addressindex", true);
+            pblocktree->EraseIndexBuildProgress("addressindex");
+            bool fCCIndexBuild = false;
+            if (pblocktree->ReadFlag("ccindexbuild", fCCIndexBuild) && fCCIndexBuild) {
+                pblocktree->WriteFlag("ccindex", true);
+                pblocktree->WriteFlag("ccindexbuild", false);
+                fCCIndex = true;
+            }
+            fAddressIndex = true;
+        }
+        if (fSpent) {
+            pblocktree->WriteFlag("spentindex", true);
+            pblocktree->EraseIndexBuildProgress("spentindex");
+            fSpentIndex = true;
+        }
+        nHeight = chainActive.Height();
+    }
+    {
+        LOCK(cs_indexbuilder);
+        mapBuildHeight.clear();
+    }
+    LogPrintf("%s: indexes complete at height %d\n", __func__, nHeight);
+}
+
+void StartIndexBuilder(boost::thread_group& threadGroup, bool fAddress, bool fSpent)
+{
+    if (!fAddress && !fSpent)
+        return;
+    int nThreads = GetArg("-indexbuilderthreads", DEFAULT_INDEXBUILDER_THREADS);
+    if (nThreads <= 0)
+        nThreads = boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(nThreads, MAX_INDEXBUILDER_THREADS));
+    SetBuildHeight(fAddress, fSpent, 0);
+    threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "indexbuild", boost::function<void()>(boost::bind(&ThreadIndexBuilder, fAddress, fSpent, nThreads))));
+}
+
+bool GetIndexBuildHeight(const std::string& name, int& nHeight)
+{
+    LOCK(cs_indexbuilder);
+    std::map<std::string, int>::const_iterator it = mapBuildHeight.find(name);
+    if (it == mapBuildHeight.end())
+        return false;
+    nHeight = it->second;
+    return true;
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_INDEXBUILDER_H
+#define SAFECOIN_INDEXBUILDER_H
+
+#include "main.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+namespace boost {
+    class thread_group;
+} // namespace boost
+
+/** Blocks one builder thread reads and indexes per round */
+static const int INDEXBUILDER_CHUNK_SIZE = 100;
+/** -indexbuilderthreads default, 0 means one thread per core */
+static const int DEFAULT_INDEXBUILDER_THREADS = 0;
+static const int MAX_INDEXBUILDER_THREADS = 8;
+
+struct CAddressUnspentKeyCompare
+{
+    bool operator()(const CAddressUnspentKey& a, const CAddressUnspentKey& b) const {
+        if (a.type != b.type)
+            return a.type < b.type;
+        if (a.hashBytes != b.hashBytes)
+            return a.hashBytes < b.hashBytes;
+        if (a.txhash != b.txhash)
+            return a.txhash < b.txhash;
+        return a.index < b.index;
+    }
+};
+
+/**
+ * Index records for a run of consecutive blocks, in the form ConnectBlock
+ * hands them to the block tree. Unspent records are keyed so an output created
+ * and spent inside the run nets out to a single erase.
+ */
+struct CIndexBuildBatch
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::map<CAddressUnspentKey, CAddressUnspentValue, CAddressUnspentKeyCompare> addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CCIndexKey, CCIndexValue> > ccIndex;
+
+    /** Append the records of a later run */
+    void Append(const CIndexBuildBatch& next);
+    /** Write everything to pblocktree, in the order ConnectBlock would have */
+    bool Write(bool fAddress, bool fSpent) const;
+};
+
+/**
+ * Add the address, CC and spent index records ConnectBlock writes for block at
+ * nHeight, taken from the block and its undo data instead of the coins view.
+ */
+bool BuildBlockIndexEntries(const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fAddress, bool fSpent, CIndexBuildBatch& batch);
+
+/**
+ * Build -addressindex and/or -spentindex for a chain that was synced without
+ * them, instead of forcing a -reindex. Blocks deeper than MAX_REORG_LENGTH are
+ * indexed by a pool of threads in height ranges and written in height order,
+ * with the progress saved in the block tree so a restart resumes where it
+ * stopped. The last blocks are indexed under cs_main, after which the index
+ * is switched on and ConnectBlock takes over.
+ */
+void StartIndexBuilder(boost::thread_group& threadGroup, bool fAddress, bool fSpent);
+/** Height the builder reached for index name ("addressindex", "spentindex"), false if it is not building it */
+bool GetIndexBuildHeight(const std::string& name, int& nHeight);
+
+#endif // SAFECOIN_INDEXBUILDER_H
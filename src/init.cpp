@@ -27,33 +27,45 @@
 #include "primitives/block.h"
 #include "addrman.h"
 #include "amount.h"
+#include "asyncrpcqueue.h"
+#include "blockcache.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
+#include "blockfilterdb.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "jsoncache.h"
 #include "key.h"
 #include "notarisationdb.h"
+#include "safenodesdb.h"
 
 #ifdef ENABLE_MINING
 #include "key_io.h"
 #endif
+#include "indexbuilder.h"
 #include "main.h"
 #include "metrics.h"
 #include "miner.h"
 #include "net.h"
+#include "nspvqueue.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
 #include "txdb.h"
 #include "torcontrol.h"
+#ifdef ENABLE_MINING
+#include "stratum.h"
+#endif
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 #ifdef ENABLE_WALLET
+#include "wallet/stakingset.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 
@@ -95,11 +107,15 @@ using namespace std;
 #include "safecoin_defs.h"
 extern void ThreadSendAlert();
 extern bool safecoin_dailysnapshot(int32_t height);
+extern bool safecoin_dailysnapshot_publish(bool fWait);
+extern void safecoin_dailysnapshot_stop();
 extern int32_t SAFECOIN_LOADINGBLOCKS;
 extern bool VERUS_MINTBLOCKS;
 extern char ASSETCHAINS_SYMBOL[];
 extern int32_t SAFECOIN_SNAPSHOT_INTERVAL;
 extern void safecoin_init(int32_t height);
+extern void safecoin_statesnap_flush();
+extern void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request);
 
 ZCJoinSplit* pzcashParams = NULL;
 
@@ -190,6 +206,15 @@ public:
             abort();
         }
     }
+    void GetCoinsBatch(const std::vector<uint256> &vTxids, std::vector<std::pair<uint256, CCoins> > &vCoins) const {
+        try {
+            base->GetCoinsBatch(vTxids, vCoins);
+        } catch(const std::runtime_error& e) {
+            uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
+            LogPrintf("Error reading from database: %s\n", e.what());
+            abort();
+        }
+    }
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
@@ -204,6 +229,9 @@ void Interrupt(boost::thread_group& threadGroup)
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+#ifdef ENABLE_MINING
+    InterruptStratumServer();
+#endif
     threadGroup.interrupt_all();
 }
 
@@ -239,6 +267,7 @@ void Shutdown()
  #else
     GenerateBitcoins(false, 0);
  #endif
+    StopStratumServer();
 #endif
     StopNode();
     StopTorControl();
@@ -255,10 +284,12 @@ void Shutdown()
         fFeeEstimatesInitialized = false;
     }
 
+    safecoin_dailysnapshot_stop();
     {
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
+            safecoin_statesnap_flush();
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
@@ -268,6 +299,10 @@ void Shutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete psafenodes;
+        psafenodes = NULL;
+        delete pblockfilterdb;
+        pblockfilterdb = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -276,6 +311,7 @@ void Shutdown()
 
 #if ENABLE_ZMQ
     if (pzmqNotificationInterface) {
+        UnregisterValidationInterfaceAsync(pzmqNotificationInterface);
         UnregisterValidationInterface(pzmqNotificationInterface);
         delete pzmqNotificationInterface;
         pzmqNotificationInterface = NULL;
@@ -284,6 +320,7 @@ void Shutdown()
 
 #if ENABLE_PROTON
     if (pAMQPNotificationInterface) {
+        UnregisterValidationInterfaceAsync(pAMQPNotificationInterface);
         UnregisterValidationInterface(pAMQPNotificationInterface);
         delete pAMQPNotificationInterface;
         pAMQPNotificationInterface = NULL;
@@ -372,9 +409,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("This help message"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-assumevalid=<hex>", _("If this block is in the chain assume that it and its ancestors are valid and skip their script and proof verification (0 to verify all but checkpointed history, default: the last checkpoint)"));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
+    strUsage += HelpMessageOpt("-asyncnotify", strprintf(_("Deliver ZMQ and AMQP notifications from a thread of their own instead of the validation thread (default: %u)"), DEFAULT_ASYNC_NOTIFY));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 288));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), 3));
+    strUsage += HelpMessageOpt("-verifyinbackground", strprintf(_("Run the -checkblocks verification in a background thread after startup, up to -checklevel 3; mining and staking stop if it fails (default: %u)"), DEFAULT_VERIFYINBACKGROUND));
     strUsage += HelpMessageOpt("-clientname=<SomeName>", _("Full node client name, default 'MagicBean'"));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "safecoin.conf"));
     if (mode == HMM_BITCOIND)
@@ -385,19 +425,34 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-exportdir=<dir>", _("Specify directory to be used when exporting data"));
+    strUsage += HelpMessageOpt("-blockreadcache=<n>", strprintf(_("Keep up to <n> megabytes of recently read blocks in memory, separate from -dbcache (default: %u)"), DEFAULT_BLOCK_READ_CACHE));
+    strUsage += HelpMessageOpt("-compressblocks", strprintf(_("Store newly written blocks compressed in the block files, older versions cannot read them (default: %u)"), DEFAULT_COMPRESSBLOCKS));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-addressindexdbcache=<n>", _("Part of -dbcache in megabytes given to the address index database (default: most of it with -addressindex)"));
+    strUsage += HelpMessageOpt("-spentindexdbcache=<n>", _("Part of -dbcache in megabytes given to the spent index database (default: a quarter of the index share with -spentindex)"));
+    strUsage += HelpMessageOpt("-timestampindexdbcache=<n>", strprintf(_("Part of -dbcache in megabytes given to the timestamp index database (default: %u with -timestampindex)"), 8));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-loadtxoutset=<file>", _("Fill an empty chainstate from a dumptxoutset file instead of connecting every block again, the blocks up to the snapshot have to be on disk and notarized") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-lazyzcparams", _("Load the Sapling and Sprout Groth16 parameters when the first shielded proof is created or verified instead of at startup, that first use then waits for them (default: 0)"));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
+    strUsage += HelpMessageOpt("-maxorphansize=<n>", strprintf(_("Keep at most <n> kilobytes of unconnectable transactions in memory, a quarter of that from any one peer (default: %u)"), DEFAULT_MAX_ORPHAN_SIZE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-mempooltxinputlimit=<n>", _("[DEPRECATED FROM OVERWINTER] Set the maximum number of transparent inputs in a transaction that the mempool will accept (default: 0 = no limit applied)"));
+    strUsage += HelpMessageOpt("-multichainhost", _("Run as one of many chain daemons on the host: caches of a few megabytes, one thread per pool and -lazyzcparams, each can still be set explicitly (default: 0)"));
+    strUsage += HelpMessageOpt("-nspvqueue=<n>", strprintf(_("Keep at most <n> nSPV requests waiting for -nspvthreads, further ones are dropped (default: %u)"), DEFAULT_NSPV_QUEUE));
+    strUsage += HelpMessageOpt("-nspvthreads=<n>", strprintf(_("Answer nSPV requests on <n> threads apart from block and transaction relay, 0 = on the message handler thread (default: %d)"), DEFAULT_NSPV_THREADS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef _WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "safecoind.pid"));
 #endif
-    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables wallet support and is incompatible with -txindex. "
+    strUsage += HelpMessageOpt("-schedulerthreads=<n>", strprintf(_("Run background tasks on <n> threads, low priority ones never take the last (default: %d)"), DEFAULT_SCHEDULER_THREADS));
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables wallet support and is incompatible with -txindex unless -prunetxarchive is set. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+    strUsage += HelpMessageOpt("-prunetxarchive", strprintf(_("With -prune, keep the transactions of pruned blocks in the block index database, so -txindex, -addressindex, -spentindex and -timestampindex queries still get their transactions. Headers, solutions and undo data are still deleted (default: %u)"), DEFAULT_PRUNETXARCHIVE));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files on startup"));
+    strUsage += HelpMessageOpt("-shareparams", _("Let the kernel share the memory of the loaded Sapling and Sprout Groth16 parameters with the other daemons on the host that load them, needs KSM turned on in /sys/kernel/mm/ksm/run (default: 1 with -multichainhost, otherwise 0)"));
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
@@ -407,6 +462,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain the basic compact block filters of BIP158 and serve them to light clients over BIP157, built in the background for an already synced chain (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-indexbuilderthreads=<n>", strprintf(_("Number of threads building -addressindex/-spentindex in the background when they are turned on for an already synced chain, 0 = one per core, up to %d (default: %d)"), MAX_INDEXBUILDER_THREADS, DEFAULT_INDEXBUILDER_THREADS));
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), 100));
@@ -423,6 +480,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), 5000));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), 1000));
+    strUsage += HelpMessageOpt("-msghandlerthreads=<n>", strprintf(_("Number of threads handling peer messages, the first one handles consensus messages in order (default: %d, max: %d)"), DEFAULT_MSGHANDLER_THREADS, MAX_MSGHANDLER_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), 1));
@@ -438,17 +496,26 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
     strUsage += HelpMessageOpt("-tlsforce=<0 or 1>", _("Only connect to peers who are also using TLS (default: 0)"));
+    strUsage += HelpMessageOpt("-tlsktls=<0 or 1>", _("Use kernel TLS offload for peer connections where supported (default: 0)"));
     strUsage += HelpMessageOpt("-tlsvalidate=<0 or 1>", _("Connect to peers only with valid certificates (default: 0)"));
     strUsage += HelpMessageOpt("-tlskeypath=<path>", _("Full path to a private key"));
     strUsage += HelpMessageOpt("-tlskeypwd=<password>", _("Password for a private key encryption (default: not set, i.e. private key will be stored unencrypted)"));
     strUsage += HelpMessageOpt("-tlscertpath=<path>", _("Full path to a certificate"));
     strUsage += HelpMessageOpt("-tlstrustdir=<path>", _("Full path to a trusted certificates directory"));
+    strUsage += HelpMessageOpt("-txpreverify", strprintf(_("Verify the signatures and proofs of relayed transactions on separate threads before adding them to the mempool (default: %u)"), DEFAULT_TXPREVERIFY));
+    strUsage += HelpMessageOpt("-txrecon", strprintf(_("Reconcile transaction announcements with peers that support it instead of sending an inv for each (default: %u)"), DEFAULT_TXRECON));
     strUsage += HelpMessageOpt("-whitebind=<addr>", _("Bind to given address and whitelist peers connecting to it. Use [host]:port notation for IPv6"));
     strUsage += HelpMessageOpt("-whitelist=<netmask>", _("Whitelist peers connecting from the given netmask or IP address. Can be specified multiple times.") +
         " " + _("Whitelisted peers cannot be DoS banned and their transactions are always relayed, even if they are already in the mempool, useful e.g. for a gateway"));
 
 #ifdef ENABLE_WALLET
     strUsage += HelpMessageGroup(_("Wallet options:"));
+    strUsage += HelpMessageOpt("-consolidatedust", strprintf(_("Sweep small transparent utxos into one when there are at least %u of them (default: %u)"),
+        CONSOLIDATE_DUST_MIN_INPUTS, DEFAULT_CONSOLIDATE_DUST));
+    strUsage += HelpMessageOpt("-consolidatedustthreshold=<amt>", strprintf(_("Utxos (in %s) smaller than this are swept by -consolidatedust (default: %s)"),
+        CURRENCY_UNIT, FormatMoney(DEFAULT_CONSOLIDATE_DUST_THRESHOLD)));
+    strUsage += HelpMessageOpt("-consolidatemaxfee=<amt>", strprintf(_("Most fee (in %s) a -consolidatedust sweep pays, on staked chains the sweep goes to the least staked segid (default: %s)"),
+        CURRENCY_UNIT, FormatMoney(DEFAULT_CONSOLIDATE_MAX_FEE)));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), 100));
     if (showDebug)
@@ -457,7 +524,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
         CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Set the number of threads reading and decrypting blocks during a rescan (0 = auto, <0 = leave that many cores free, default: %d)"), DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet.dat") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-saplingdecryptthreads=<n>", strprintf(_("Set the number of threads trial decrypting the Sapling outputs of a new block (0 = auto, <0 = leave that many cores free, default: %d)"), DEFAULT_SAPLING_DECRYPT_THREADS));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), 0));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), 1));
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), DEFAULT_TX_CONFIRM_TARGET));
@@ -479,6 +548,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubsequence=<address>", _("Enable publish block connects and disconnects and mempool additions and removals in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubsequencebatch=<address>", _("Enable publish of the sequence events coalesced per chain tip in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubopstatus=<address>", _("Enable publish of the status of finished async RPC operations in <address>"));
 #endif
 
 #if ENABLE_PROTON
@@ -487,6 +559,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-amqppubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-amqppubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-amqppubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-amqppubsequence=<address>", _("Enable publish block connects and disconnects and mempool additions and removals in <address>"));
+    strUsage += HelpMessageOpt("-amqppubsequencebatch=<address>", _("Enable publish of the sequence events coalesced per chain tip in <address>"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -512,9 +586,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), 1));
     if (showDebug)
     {
+        strUsage += HelpMessageOpt("-lockprofile", strprintf("Record wait and hold times of every LOCK site, reported by getlockprofile (default: %u)", 0));
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", 0));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (default: %u)", 50000));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying (default: %s)"),
@@ -549,6 +624,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin mining if enabled (-1 = all cores, default: %d)"), 0));
     strUsage += HelpMessageOpt("-equihashsolver=<name>", _("Specify the Equihash solver to be used if enabled (default: \"default\")"));
     strUsage += HelpMessageOpt("-mineraddress=<addr>", _("Send mined coins to a specific single address"));
+    strUsage += HelpMessageOpt("-stratum", strprintf(_("Serve block templates to pool miners over stratum (default: %u)"), DEFAULT_STRATUM));
+    strUsage += HelpMessageOpt("-stratumbind=<addr>", _("Bind the stratum server to the given address. Use [host]:port notation for IPv6. This option can be specified multiple times (default: 127.0.0.1)"));
+    strUsage += HelpMessageOpt("-stratumport=<port>", _("Listen for stratum connections on <port> (default: the RPC port plus one)"));
+    strUsage += HelpMessageOpt("-stratumallowip=<ip>", _("Allow stratum connections from the specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
+    strUsage += HelpMessageOpt("-stratumdifficulty=<n>", strprintf(_("Share difficulty sent to stratum miners, the share target is the proof-of-work limit divided by <n> (default: %d)"), DEFAULT_STRATUM_DIFFICULTY));
+    strUsage += HelpMessageOpt("-stratumjobinterval=<n>", strprintf(_("Seconds before a stratum job is rebuilt for new mempool transactions (default: %d)"), DEFAULT_STRATUM_JOB_INTERVAL));
     strUsage += HelpMessageOpt("-minetolocalwallet", strprintf(
             _("Require that mined blocks use a coinbase address in the local wallet (default: %u)"),
  #ifdef ENABLE_WALLET
@@ -568,13 +649,20 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 8771, 18771));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcprioritythreads=<n>", strprintf(_("Set the number of threads serving only the priority lane of RPC calls (default: %d)"), DEFAULT_HTTP_PRIORITY_THREADS));
+    strUsage += HelpMessageOpt("-rpcprioritymethods=<list>", strprintf(_("Comma separated RPC methods whose calls go ahead of other queued calls, empty for none (default: %s)"), DEFAULT_RPC_PRIORITY_METHODS));
+    strUsage += HelpMessageOpt("-rpcjsoncache=<n>", strprintf(_("Keep up to <n> megabytes of getblock and getrawtransaction results, 0 to disable (default: %u)"), DEFAULT_RPC_JSON_CACHE));
+    strUsage += HelpMessageOpt("-rpcslowcall=<ms>", strprintf(_("Log RPC calls that take at least <ms> milliseconds, 0 to log none (default: %d)"), DEFAULT_RPC_SLOW_CALL));
+    strUsage += HelpMessageOpt("-rpcprometheus", strprintf(_("Serve the RPC and node statistics at /metrics in the Prometheus text format, with the RPC credentials (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf(_("Set the number of threads running read-only calls of batch requests concurrently, 0 runs batches in order on the RPC thread (default: %d)"), DEFAULT_RPC_BATCH_THREADS));
     if (showDebug) {
-        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls, per client address (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcworkqueuetotal=<n>", strprintf("Set the depth of the work queue to service RPC calls, over all clients (default: %d)", DEFAULT_HTTP_WORKQUEUE_TOTAL));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
 
     // Disabled until we can lock notes and also tune performance of libsnark which by default uses multiple threads
-    //strUsage += HelpMessageOpt("-rpcasyncthreads=<n>", strprintf(_("Set the number of threads to service Async RPC calls (default: %d)"), 1));
+    strUsage += HelpMessageOpt("-rpcasyncthreads=<n>", strprintf(_("Run up to <n> async RPC operations at the same time, 0 for one per core (default: %d)"), DEFAULT_RPC_ASYNC_THREADS));
 
     if (mode == HMM_BITCOIND) {
         strUsage += HelpMessageGroup(_("Metrics Options (only if -daemon and -printtoconsole are not set):"));
@@ -846,6 +934,8 @@ bool InitSanityCheck(void)
 }
 
 
+static void ZC_LoadSaplingParams();
+
 static void ZC_LoadParams(
     const CChainParams& chainparams
 )
@@ -885,6 +975,23 @@ static void ZC_LoadParams(
     elapsed = float(tv_end.tv_sec-tv_start.tv_sec) + (tv_end.tv_usec-tv_start.tv_usec)/float(1000000);
     LogPrintf("Loaded verifying key in %fs seconds.\n", elapsed);
 
+    if (GetBoolArg("-lazyzcparams", false)) {
+        LogPrintf("Loading Sapling parameters when they are first needed\n");
+        ZCSetParamsLoader(ZC_LoadSaplingParams);
+    } else {
+        ZC_LoadSaplingParams();
+    }
+}
+
+static void ZC_LoadSaplingParams()
+{
+    struct timeval tv_start, tv_end;
+    float elapsed;
+
+    boost::filesystem::path sapling_spend = ZC_GetParamsDir() / "sapling-spend.params";
+    boost::filesystem::path sapling_output = ZC_GetParamsDir() / "sapling-output.params";
+    boost::filesystem::path sprout_groth16 = ZC_GetParamsDir() / "sprout-groth16.params";
+
     static_assert(
         sizeof(boost::filesystem::path::value_type) == sizeof(codeunit),
         "librustzcash not configured correctly");
@@ -897,6 +1004,13 @@ static void ZC_LoadParams(
     LogPrintf("Loading Sapling (Sprout Groth16) parameters from %s\n", sprout_groth16.string().c_str());
     gettimeofday(&tv_start, 0);
 
+    // The parameters are read into memory laid out the same in every daemon, without
+    // pointers of their own, so identical pages can be shared between the processes.
+    bool fShareParams = GetBoolArg("-shareparams", false);
+    std::set<std::pair<uintptr_t, uintptr_t> > mappingsBefore;
+    if (fShareParams)
+        mappingsBefore = GetAnonymousMappings();
+
     librustzcash_init_zksnark_params(
         reinterpret_cast<const codeunit*>(sapling_spend_str.c_str()),
         sapling_spend_str.length(),
@@ -912,12 +1026,16 @@ static void ZC_LoadParams(
     gettimeofday(&tv_end, 0);
     elapsed = float(tv_end.tv_sec-tv_start.tv_sec) + (tv_end.tv_usec-tv_start.tv_usec)/float(1000000);
     LogPrintf("Loaded Sapling parameters in %fs seconds.\n", elapsed);
+    if (fShareParams)
+        LogPrintf("Marked %u MB of parameter memory as mergeable\n", (unsigned int)(MarkMappingsMergeable(mappingsBefore) >> 20));
 }
 
 bool AppInitServers(boost::thread_group& threadGroup)
 {
     RPCServer::OnStopped(&OnRPCStopped);
     RPCServer::OnPreCommand(&OnRPCPreCommand);
+    // the RPC statistics report the time calls wait for cs_main
+    pLockWaitTracked = &cs_main;
     if (!InitHTTPServer())
         return false;
     if (!StartRPC())
@@ -1018,6 +1136,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     fPrintToConsole = GetBoolArg("-printtoconsole", false);
     fLogTimestamps = GetBoolArg("-logtimestamps", true);
     fLogIPs = GetBoolArg("-logips", false);
+    fLockProfile = GetBoolArg("-lockprofile", false);
 
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("Zcash version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
@@ -1076,6 +1195,27 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             LogPrintf("%s: parameter interaction: -zapwallettxes=<mode> -> setting -rescan=1\n", __func__);
     }
 
+    if (GetBoolArg("-multichainhost", false)) {
+        // dozens of assetchain daemons on one box each keep their own caches and pools,
+        // so each gets a small share unless the operator sized it
+        static const char* const vHostArgs[][2] = {
+            {"-dbcache", "64"},
+            {"-maxsigcachesize", "4"},
+            {"-maxmempool", "50"},
+            {"-blockreadcache", "4"},
+            {"-rpcjsoncache", "2"},
+            {"-par", "1"},
+            {"-rpcthreads", "2"},
+            {"-nspvthreads", "0"},
+            {"-schedulerthreads", "1"},
+            {"-lazyzcparams", "1"},
+            {"-shareparams", "1"},
+        };
+        for (size_t i = 0; i < sizeof(vHostArgs) / sizeof(vHostArgs[0]); i++)
+            if (SoftSetArg(vHostArgs[i][0], vHostArgs[i][1]))
+                LogPrintf("%s: parameter interaction: -multichainhost=1 -> setting %s=%s\n", __func__, vHostArgs[i][0], vHostArgs[i][1]);
+    }
+
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
@@ -1091,8 +1231,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // if using block pruning, then disable txindex
     // also disable the wallet (for now, until SPV support is implemented in wallet)
     if (GetArg("-prune", 0)) {
-        if (GetBoolArg("-txindex", true))
-            return InitError(_("Prune mode is incompatible with -txindex."));
+        if (GetBoolArg("-txindex", true) && !GetBoolArg("-prunetxarchive", DEFAULT_PRUNETXARCHIVE))
+            return InitError(_("Prune mode is incompatible with -txindex unless -prunetxarchive is set."));
 #ifdef ENABLE_WALLET
         if (!GetBoolArg("-disablewallet", false)) {
             if (SoftSetBoolArg("-disablewallet", true))
@@ -1140,6 +1280,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = GetBoolArg("-checkpoints", true);
+    // the checkpoints are dPoW notarized blocks, a later notarized block can be given to skip more of the history
+    if (mapArgs.count("-assumevalid"))
+        hashAssumeValid = uint256S(GetArg("-assumevalid", ""));
+    else if (fCheckpointsEnabled && !chainparams.Checkpoints().mapCheckpoints.empty())
+        hashAssumeValid = chainparams.Checkpoints().mapCheckpoints.rbegin()->second;
 
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
@@ -1149,6 +1294,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         nScriptCheckThreads = 0;
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    InitSignatureCache();
 
     fServer = GetBoolArg("-server", false);
 
@@ -1164,6 +1310,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
         LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
         fPruneMode = true;
+        fPruneTxArchive = GetBoolArg("-prunetxarchive", DEFAULT_PRUNETXARCHIVE);
+        if (fPruneTxArchive)
+            LogPrintf("Prune keeps the transactions of pruned blocks for the indexes.\n");
     }
 
     RegisterAllCoreRPCCommands(tableRPC);
@@ -1234,6 +1383,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                                        mapArgs["-maxtxfee"], ::minRelayTxFee.ToString()));
         }
     }
+    if (mapArgs.count("-consolidatemaxfee"))
+    {
+        CAmount nMaxFee = 0;
+        if (!ParseMoney(mapArgs["-consolidatemaxfee"], nMaxFee))
+            return InitError(strprintf(_("Invalid amount for -consolidatemaxfee=<amount>: '%s'"), mapArgs["-consolidatemaxfee"]));
+    }
+    if (mapArgs.count("-consolidatedustthreshold"))
+    {
+        CAmount nThreshold = 0;
+        if (!ParseMoney(mapArgs["-consolidatedustthreshold"], nThreshold) || nThreshold <= 0)
+            return InitError(strprintf(_("Invalid amount for -consolidatedustthreshold=<amount>: '%s'"), mapArgs["-consolidatedustthreshold"]));
+    }
     nTxConfirmTarget = GetArg("-txconfirmtarget", DEFAULT_TX_CONFIRM_TARGET);
     expiryDelta = GetArg("-txexpirydelta", DEFAULT_TX_EXPIRY_DELTA);
     bSpendZeroConfChange = GetBoolArg("-spendzeroconfchange", true);
@@ -1401,11 +1562,23 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadEquihashCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadShieldedCheck);
+    }
+    if (GetBoolArg("-txpreverify", DEFAULT_TXPREVERIFY)) {
+        nTxPreVerifyThreads = std::max(nScriptCheckThreads - 1, 1);
+        LogPrintf("Using %u threads for relayed transaction pre-verification\n", nTxPreVerifyThreads);
+        for (int i=0; i<nTxPreVerifyThreads; i++)
+            threadGroup.create_thread(&ThreadTxPreVerify);
     }
 
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads
+    int nSchedulerThreads = std::max(1, (int)GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS));
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
-    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    for (int i = 0; i < nSchedulerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
 
     // Count uptime
     MarkStartTime();
@@ -1602,7 +1775,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     pzmqNotificationInterface = CZMQNotificationInterface::CreateWithArguments(mapArgs);
 
     if (pzmqNotificationInterface) {
-        RegisterValidationInterface(pzmqNotificationInterface);
+        if (GetBoolArg("-asyncnotify", DEFAULT_ASYNC_NOTIFY))
+            RegisterValidationInterfaceAsync(pzmqNotificationInterface);
+        else
+            RegisterValidationInterface(pzmqNotificationInterface);
     }
 #endif
 
@@ -1617,7 +1793,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             return InitError(_("AMQP support requires -experimentalfeatures."));
         }
 
-        RegisterValidationInterface(pAMQPNotificationInterface);
+        if (GetBoolArg("-asyncnotify", DEFAULT_ASYNC_NOTIFY))
+            RegisterValidationInterfaceAsync(pAMQPNotificationInterface);
+        else
+            RegisterValidationInterface(pAMQPNotificationInterface);
     }
 #endif
 
@@ -1652,46 +1831,42 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greated than nMaxDbcache
     int64_t nBlockTreeDBCache = nTotalCache / 8;
-
-    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-        // enable 3/4 of the cache if addressindex and/or spentindex is enabled
-        nBlockTreeDBCache = nTotalCache * 3 / 4;
-    } else {
-        if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", false)) {
-            nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
-        }
-    }
-    nTotalCache -= nBlockTreeDBCache;
+    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", false)) {
+        nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
+    }
+
+    // the address and spent indexes have databases of their own, by default they share
+    // the 3/4 of the cache the block tree db used to get when they were enabled
+    bool fAddressIndexArg = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    bool fSpentIndexArg = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    int64_t nAddressIndexCache = 0, nSpentIndexCache = 0;
+    if (fAddressIndexArg || fSpentIndexArg) {
+        int64_t nIndexCache = std::max(nTotalCache * 3 / 4 - nBlockTreeDBCache, (int64_t)0);
+        nAddressIndexCache = fAddressIndexArg ? (fSpentIndexArg ? nIndexCache * 3 / 4 : nIndexCache) : 0;
+        nSpentIndexCache = nIndexCache - nAddressIndexCache;
+    }
+    nAddressIndexCache = GetArg("-addressindexdbcache", nAddressIndexCache >> 20) << 20;
+    nSpentIndexCache = GetArg("-spentindexdbcache", nSpentIndexCache >> 20) << 20;
+    int64_t nTimestampIndexCache = GetArg("-timestampindexdbcache", GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX) ? 8 : 0) << 20;
+    nAddressIndexCache = std::min(std::max(nAddressIndexCache, nDefaultIndexDbCache << 20), nTotalCache / 2);
+    nSpentIndexCache = std::min(std::max(nSpentIndexCache, nDefaultIndexDbCache << 20), nTotalCache / 4);
+    nTimestampIndexCache = std::min(std::max(nTimestampIndexCache, nDefaultIndexDbCache << 20), nTotalCache / 8);
+    nTotalCache -= nBlockTreeDBCache + nAddressIndexCache + nSpentIndexCache + nTimestampIndexCache;
+    nTotalCache = std::max(nTotalCache, nMinDbCache << 20);
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Max cache setting possible %.1fMiB\n", nMaxDbCache);
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for address index database\n", nAddressIndexCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for spent index database\n", nSpentIndexCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for timestamp index database\n", nTimestampIndexCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
-
-    if ( fReindex == 0 )
-    {
-        bool checkval,fAddressIndex,fSpentIndex;
-        pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
-        fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
-        pblocktree->ReadFlag("addressindex", checkval);
-        if ( checkval != fAddressIndex && fAddressIndex != 0 )
-        {
-            pblocktree->WriteFlag("addressindex", fAddressIndex);
-            fprintf(stderr,"set addressindex, will reindex. could take a while.\n");
-            fReindex = true;
-        }
-        fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
-        pblocktree->ReadFlag("spentindex", checkval);
-        if ( checkval != fSpentIndex && fSpentIndex != 0 )
-        {
-            pblocktree->WriteFlag("spentindex", fSpentIndex);
-            fprintf(stderr,"set spentindex, will reindex. could take a while.\n");
-            fReindex = true;
-        }
-    }
+    rpcJSONCache.SetMaxBytes(std::max<int64_t>(0, GetArg("-rpcjsoncache", DEFAULT_RPC_JSON_CACHE)) << 20);
+    blockReadCache.SetMaxBytes(std::max<int64_t>(0, GetArg("-blockreadcache", DEFAULT_BLOCK_READ_CACHE)) << 20);
+    fCompressBlocks = GetBoolArg("-compressblocks", DEFAULT_COMPRESSBLOCKS);
 
     bool clearWitnessCaches = false;
 
@@ -1711,12 +1886,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinscatcher;
                 delete pblocktree;
                 delete pnotarisations;
+                delete psafenodes;
+                delete pblockfilterdb;
+                pblockfilterdb = NULL;
 
-                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
+                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles, nAddressIndexCache, nSpentIndexCache, nTimestampIndexCache);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
                 pnotarisations = new NotarisationDB(100*1024*1024, false, fReindex);
+                psafenodes = new CSafeNodesDB(8*1024*1024, false, fReindex);
+                if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+                    pblockfilterdb = new CBlockFilterDB(8*1024*1024, false, fReindex);
+                safenodeRegistry.Clear();
+                psafenodes->LoadRegistry(safenodeRegistry);
 
 
                 if (fReindex) {
@@ -1737,6 +1920,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 // (we're likely using a testnet datadir, or the other way around).
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(chainparams.GetConsensus().hashGenesisBlock) == 0)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
+
+                // an empty coin database can start from a UTXO snapshot instead of replaying every block
+                if (mapArgs.count("-loadtxoutset") && !fReindex && pcoinsdbview->GetBestBlock().IsNull() && !mapBlockIndex.empty()) {
+                    if (!LoadTxOutSetSnapshot(pcoinsdbview, GetArg("-loadtxoutset", ""), strLoadError))
+                        break;
+                    // reload so the chain tip is set from the coin database like on a normal start
+                    UnloadBlockIndex();
+                    if (!LoadBlockIndex()) {
+                        strLoadError = _("Error loading block database");
+                        break;
+                    }
+                }
                 
                 safecoin_init(1);
                 // Initialize the block index (no-op if non-empty database was already loaded)
@@ -1760,7 +1955,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 
                 if ( ASSETCHAINS_CC != 0 && SAFECOIN_SNAPSHOT_INTERVAL != 0 && chainActive.Height() >= SAFECOIN_SNAPSHOT_INTERVAL )
                 {
-                    if ( !safecoin_dailysnapshot(chainActive.Height()) )
+                    if ( !safecoin_dailysnapshot(chainActive.Height()) || !safecoin_dailysnapshot_publish(true) )
                     {
                         strLoadError = _("daily snapshot failed, please reindex your chain.");
                         break;
@@ -1780,7 +1975,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     LogPrintf("Prune: pruned datadir may not have more than %d blocks; -checkblocks=%d may fail\n",
                         MIN_BLOCKS_TO_KEEP, GetArg("-checkblocks", 288));
                 }
-                if ( SAFECOIN_REWIND == 0 )
+                if ( SAFECOIN_REWIND == 0 && !GetBoolArg("-verifyinbackground", DEFAULT_VERIFYINBACKGROUND) )
                 {
                     if (!CVerifyDB().VerifyDB(pcoinsdbview, GetArg("-checklevel", 3),
                                               GetArg("-checkblocks", 288))) {
@@ -1926,6 +2121,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         LogPrintf(" wallet      %15dms\n", GetTimeMillis() - nStart);
 
         RegisterValidationInterface(pwalletMain);
+        if (ASSETCHAINS_STAKED != 0)
+            RegisterValidationInterface(&stakingSet);
 
         CBlockIndex *pindexRescan = chainActive.Tip();
         if (clearWitnessCaches || GetBoolArg("-rescan", false))
@@ -2027,7 +2224,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             nLocalServices |= NODE_ADDRINDEX;
         if ( GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) != 0 )
             nLocalServices |= NODE_SPENTINDEX;
+        if ( pblockfilterdb != NULL )
+            nLocalServices |= NODE_COMPACT_FILTERS;
         fprintf(stderr,"nLocalServices %llx %d, %d\n",(long long)nLocalServices,GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX),GetBoolArg("-spentindex", DEFAULT_SPENTINDEX));
+        int nNSPVThreads = GetArg("-nspvthreads", DEFAULT_NSPV_THREADS);
+        LogPrintf("Using %d threads for nSPV requests\n", std::max(nNSPVThreads, 0));
+        StartNSPVWorkers(threadGroup, nNSPVThreads, std::max<int64_t>(1, GetArg("-nspvqueue", DEFAULT_NSPV_QUEUE)), safecoin_nSPVreq);
     }
     // ********************************************************* Step 10: import blocks
 
@@ -2048,6 +2250,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             vImportFiles.push_back(strFile);
     }
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    if ( SAFECOIN_REWIND == 0 && GetBoolArg("-verifyinbackground", DEFAULT_VERIFYINBACKGROUND) )
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "verifydb", boost::function<void()>(boost::bind(&ThreadVerifyDB, GetArg("-checklevel", 3), GetArg("-checkblocks", 288)))));
+    // -addressindex/-spentindex turned on for a chain synced without them, the builder reads every block
+    if (fHavePruned && ((fAddressIndexArg && !fAddressIndex) || (fSpentIndexArg && !fSpentIndex)))
+        return InitError(_("Blocks were pruned, turning on -addressindex or -spentindex needs -reindex"));
+    StartIndexBuilder(threadGroup, fAddressIndexArg && !fAddressIndex, fSpentIndexArg && !fSpentIndex);
+    StartBlockFilterBuilder(threadGroup);
     if (chainActive.Tip() == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
         while (!fRequestShutdown && chainActive.Tip() == NULL)
@@ -2097,6 +2306,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
  #else
     GenerateBitcoins(GetBoolArg("-gen", false), GetArg("-genproclimit", -1));
  #endif
+    if (GetBoolArg("-stratum", DEFAULT_STRATUM) && !StartStratumServer())
+        return false;
 #endif
 
     // ********************************************************* Step 11: finished
@@ -0,0 +1,91 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsoncache.h"
+
+CJSONCache rpcJSONCache(DEFAULT_RPC_JSON_CACHE << 20);
+
+UniValue RawJSON(const std::string& strJSON)
+{
+    return UniValue(UniValue::VNUM, strJSON);
+}
+
+// caller holds cs
+void CJSONCache::Trim()
+{
+    while (nBytes > nMaxBytes && !listEntries.empty()) {
+        nBytes -= listEntries.back().first.size() + listEntries.back().second.size();
+        mapEntries.erase(listEntries.back().first);
+        listEntries.pop_back();
+    }
+}
+
+// caller holds cs
+void CJSONCache::SetTip(const uint256& hashTipIn)
+{
+    if (hashTipIn == hashTip)
+        return;
+    listEntries.clear();
+    mapEntries.clear();
+    nBytes = 0;
+    hashTip = hashTipIn;
+}
+
+bool CJSONCache::Get(const uint256& hashTipIn, const std::string& strKey, UniValue& result)
+{
+    LOCK(cs);
+    SetTip(hashTipIn);
+    std::map<std::string, EntryList::iterator>::iterator it = mapEntries.find(strKey);
+    if (it == mapEntries.end())
+        return false;
+    listEntries.splice(listEntries.begin(), listEntries, it->second);
+    result = RawJSON(it->second->second);
+    return true;
+}
+
+void CJSONCache::Insert(const uint256& hashTipIn, const std::string& strKey, const UniValue& value)
+{
+    if (nMaxBytes == 0)
+        return;
+    // serialized outside the lock, it is the expensive part
+    std::string strJSON = value.write();
+    size_t nSize = strKey.size() + strJSON.size();
+
+    LOCK(cs);
+    // made for a tip that a lookup has already moved past
+    if (hashTipIn != hashTip || nSize > nMaxBytes || mapEntries.count(strKey))
+        return;
+    listEntries.push_front(std::make_pair(strKey, std::string()));
+    listEntries.front().second.swap(strJSON);
+    mapEntries[strKey] = listEntries.begin();
+    nBytes += nSize;
+    Trim();
+}
+
+void CJSONCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+void CJSONCache::Clear()
+{
+    LOCK(cs);
+    listEntries.clear();
+    mapEntries.clear();
+    nBytes = 0;
+}
+
+size_t CJSONCache::Size() const
+{
+    LOCK(cs);
+    return mapEntries.size();
+}
+
+size_t CJSONCache::Bytes() const
+{
+    LOCK(cs);
+    return nBytes;
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_JSONCACHE_H
+#define SAFECOIN_JSONCACHE_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <string>
+
+#include <univalue.h>
+
+/** -rpcjsoncache default (MiB) */
+static const unsigned int DEFAULT_RPC_JSON_CACHE = 16;
+
+/**
+ * Serialized JSON of the blocks and transactions recently returned by the
+ * RPC, least recently used dropped first once the text passes the limit.
+ * Confirmations, the next block and interest all follow from the chain tip,
+ * so every entry belongs to the tip it was made at and the whole cache is
+ * dropped when a lookup sees another tip, which covers reorgs too.
+ */
+class CJSONCache
+{
+private:
+    typedef std::list<std::pair<std::string, std::string> > EntryList;
+
+    mutable CCriticalSection cs;
+    uint256 hashTip;
+    //! most recently used first
+    EntryList listEntries;
+    std::map<std::string, EntryList::iterator> mapEntries;
+    size_t nBytes;
+    size_t nMaxBytes;
+
+    void Trim();
+    void SetTip(const uint256& hashTipIn);
+
+public:
+    explicit CJSONCache(size_t nMaxBytesIn) : nBytes(0), nMaxBytes(nMaxBytesIn) {}
+
+    /** Sets result to the JSON stored under strKey at tip hashTipIn, false if there is none */
+    bool Get(const uint256& hashTipIn, const std::string& strKey, UniValue& result);
+    /** Stores the serialized value under strKey, unless the cache has moved on from tip hashTipIn */
+    void Insert(const uint256& hashTipIn, const std::string& strKey, const UniValue& value);
+    void SetMaxBytes(size_t nMaxBytesIn);
+    void Clear();
+
+    size_t Size() const;
+    size_t Bytes() const;
+};
+
+/**
+ * A value that writes the given JSON text as it is. UniValue::write() puts
+ * out the text of a number unchanged, so this splices a serialized fragment
+ * into a reply without parsing it back.
+ */
+UniValue RawJSON(const std::string& strJSON);
+
+/** Cache of the getblock and getrawtransaction JSON results */
+extern CJSONCache rpcJSONCache;
+
+#endif // SAFECOIN_JSONCACHE_H
@@ -24,21 +24,32 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockcache.h"
+#include "blockencodings.h"
+#include "blockfilterdb.h"
+#include "compressor.h"
 #include "importcoin.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
+#include "core_memusage.h"
+#include "crypto/muhash.h"
 #include "deprecation.h"
 #include "init.h"
 #include "merkleblock.h"
 #include "metrics.h"
 #include "notarisationdb.h"
+#include "nspvqueue.h"
+#include "safenodesdb.h"
 #include "net.h"
 #include "pow.h"
+#include "script/cc.h"
 #include "script/interpreter.h"
+#include "script/sigcache.h"
 #include "txdb.h"
+#include "trace.h"
 #include "txmempool.h"
 #include "ui_interface.h"
 #include "undo.h"
@@ -47,6 +58,7 @@
 #include "validationinterface.h"
 #include "wallet/asyncrpcoperation_sendmany.h"
 #include "wallet/asyncrpcoperation_shieldcoinbase.h"
+#include "wallet/stakingset.h"
 #include "notaries_staked.h"
 
 #include <cstring>
@@ -94,6 +106,9 @@ int32_t safecoin_block2pubkey33(uint8_t *pubkey33,CBlock *block);
 bool Getscriptaddress(char *destaddr,const CScript &scriptPubKey);
 void safecoin_setactivation(int32_t height);
 void safecoin_pricesupdate(int32_t height,CBlock *pblock);
+void NSPV_merklecache_add(const CBlock &block);
+void NSPV_notifytx(const CTransaction &tx);
+void NSPV_notifytxs(const std::vector<CTransaction> &txs,int32_t height);
 
 BlockMap mapBlockIndex;
 CChain chainActive;
@@ -102,18 +117,24 @@ static int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nTxPreVerifyThreads = 0;
 bool fExperimentalMode = true;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
+bool fCompressBlocks = DEFAULT_COMPRESSBLOCKS;
 bool fAddressIndex = false;
+bool fCCIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
+bool fPruneTxArchive = DEFAULT_PRUNETXARCHIVE;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = true;
+uint256 hashAssumeValid;
+std::atomic<bool> fBlockDBCorrupt(false);
 bool fCoinbaseEnforcedProtectionEnabled = true;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -133,9 +154,15 @@ CTxMemPool tmpmempool(::minRelayTxFee);
 struct COrphanTx {
     CTransaction tx;
     NodeId fromPeer;
+    int64_t nTimeExpire;
+    size_t nUsage;
 };
 map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);;
-map<uint256, set<uint256> > mapOrphanTransactionsByPrev GUARDED_BY(cs_main);;
+/** Orphans by the outpoints they spend, usually outputs of the missing parents */
+map<COutPoint, set<uint256> > mapOrphanTransactionsByPrev GUARDED_BY(cs_main);;
+/** Memory used by orphan transactions, in total and by the peer each came from */
+size_t nOrphanUsage GUARDED_BY(cs_main) = 0;
+map<NodeId, size_t> mapOrphanUsageByPeer GUARDED_BY(cs_main);
 void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /**
@@ -331,6 +358,24 @@ namespace {
         int nBlocksInFlightValidHeaders;
         //! Whether we consider this a preferred download peer.
         bool fPreferredDownload;
+        //! How many blocks we let this peer have in flight, adapted to its delivery latency.
+        int nBlocksInFlightLimit;
+        //! Blocks this peer delivered on request, and their total size.
+        uint64_t nBlocksDownloaded;
+        uint64_t nBlockBytesDownloaded;
+        //! Moving average of the time from getdata to block, in microseconds, or 0.
+        int64_t nAvgBlockLatency;
+        //! Time spent with blocks in flight from this peer (in microseconds), and since when the current stretch runs.
+        int64_t nDownloadTime;
+        int64_t nDownloadingSince;
+        //! How often this peer held up the block download window.
+        int nStalls;
+        //! Whether this peer understands compact blocks (it sent sendcmpct).
+        bool fSupportsCompact;
+        //! Whether this peer wants new blocks pushed as cmpctblock instead of announced with an inv.
+        bool fPreferCompact;
+        //! The block being rebuilt from this peer's cmpctblock, waiting for its blocktxn.
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock;
 
         CNodeState() {
             fCurrentlyConnected = false;
@@ -344,12 +389,24 @@ namespace {
             nBlocksInFlight = 0;
             nBlocksInFlightValidHeaders = 0;
             fPreferredDownload = false;
+            nBlocksInFlightLimit = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+            nBlocksDownloaded = 0;
+            nBlockBytesDownloaded = 0;
+            nAvgBlockLatency = 0;
+            nDownloadTime = 0;
+            nDownloadingSince = 0;
+            nStalls = 0;
+            fSupportsCompact = false;
+            fPreferCompact = false;
         }
     };
 
     /** Map maintaining per-node state. Requires cs_main. */
     map<NodeId, CNodeState> mapNodeState;
 
+    /** The block download window in use, see BLOCK_DOWNLOAD_WINDOW. Requires cs_main. */
+    unsigned int nBlockDownloadWindow = BLOCK_DOWNLOAD_WINDOW;
+
     // Requires cs_main.
     CNodeState *State(NodeId pnode) {
         map<NodeId, CNodeState>::iterator it = mapNodeState.find(pnode);
@@ -408,35 +465,68 @@ namespace {
         mapNodeState.erase(nodeid);
     }
 
-    void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
+    // Expiry stays height based (removeExpired), this only enforces -maxmempool
+    void LimitMempoolSize(CTxMemPool& pool, size_t limit)
     {
-        /*    int expired = pool.Expire(GetTime() - age);
-         if (expired != 0)
-         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+        unsigned int nEvicted = pool.TrimToSize(limit);
+        if (nEvicted != 0)
+            LogPrint("mempool", "Evicted %u transactions to keep the memory pool under %u bytes\n", nEvicted, limit);
+    }
 
-         std::vector<uint256> vNoSpendsRemaining;
-         pool.TrimToSize(limit, &vNoSpendsRemaining);
-         BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
-         pcoinsTip->Uncache(removed);*/
+    // Requires cs_main.
+    // Adapts the in-flight limit of a peer that delivered a requested block: a peer that answers quickly although
+    // its limit is reached gets one more slot, a slow one loses a quarter of them.
+    void UpdateBlockDownloadStats(CNodeState *state, const QueuedBlock& queued, bool fWasFull, size_t nBytes, int64_t nNow) {
+        int64_t nLatency = nNow - queued.nTime;
+        state->nBlocksDownloaded++;
+        state->nBlockBytesDownloaded += nBytes;
+        state->nAvgBlockLatency = state->nAvgBlockLatency == 0 ? nLatency : (state->nAvgBlockLatency * 7 + nLatency) / 8;
+        if (nLatency < BLOCK_DOWNLOAD_TARGET_LATENCY) {
+            if (fWasFull && state->nBlocksInFlightLimit < MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER)
+                state->nBlocksInFlightLimit++;
+        } else if (state->nAvgBlockLatency > 4 * BLOCK_DOWNLOAD_TARGET_LATENCY) {
+            state->nBlocksInFlightLimit = std::max(MIN_BLOCKS_IN_TRANSIT_PER_PEER, state->nBlocksInFlightLimit * 3 / 4);
+        }
     }
 
     // Requires cs_main.
-    // Returns a bool indicating whether we requested this block.
-    bool MarkBlockAsReceived(const uint256& hash) {
+    // Returns a bool indicating whether we requested this block. When the peer we requested it from
+    // delivered it (nodeFrom), its download stats are updated.
+    bool MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1, size_t nBytes = 0) {
         map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
         if (itInFlight != mapBlocksInFlight.end()) {
             CNodeState *state = State(itInFlight->second.first);
+            int64_t nNow = GetTimeMicros();
+            if (itInFlight->second.first == nodeFrom)
+                UpdateBlockDownloadStats(state, *itInFlight->second.second, state->nBlocksInFlight >= state->nBlocksInFlightLimit, nBytes, nNow);
             nQueuedValidatedHeaders -= itInFlight->second.second->fValidatedHeaders;
             state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
             state->vBlocksInFlight.erase(itInFlight->second.second);
             state->nBlocksInFlight--;
             state->nStallingSince = 0;
+            if (state->nBlocksInFlight == 0)
+                state->nDownloadTime += nNow - state->nDownloadingSince;
             mapBlocksInFlight.erase(itInFlight);
             return true;
         }
         return false;
     }
 
+    // Requires cs_main.
+    // Forgets the blocks in flight from a stalling peer, so the next getdata round asks other peers for them.
+    // Returns the number of blocks released.
+    int ReleaseBlocksInFlight(NodeId nodeid) {
+        CNodeState *state = State(nodeid);
+        assert(state != NULL);
+
+        std::vector<uint256> vRelease;
+        BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight)
+            vRelease.push_back(entry.hash);
+        BOOST_FOREACH(const uint256& hash, vRelease)
+            MarkBlockAsReceived(hash);
+        return vRelease.size();
+    }
+
     // Requires cs_main.
     void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL) {
         CNodeState *state = State(nodeid);
@@ -449,6 +539,8 @@ namespace {
         QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams)};
         nQueuedValidatedHeaders += newentry.fValidatedHeaders;
         list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
+        if (state->nBlocksInFlight == 0)
+            state->nDownloadingSince = nNow;
         state->nBlocksInFlight++;
         state->nBlocksInFlightValidHeaders += newentry.fValidatedHeaders;
         mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
@@ -544,8 +636,8 @@ namespace {
         // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
         // download that next block if the window were 1 larger.
         if ( ASSETCHAINS_CBOPRET != 0 && IsInitialBlockDownload() == 0 )
-            BLOCK_DOWNLOAD_WINDOW = 1;
-        int nWindowEnd = state->pindexLastCommonBlock->GetHeight() + BLOCK_DOWNLOAD_WINDOW;
+            nBlockDownloadWindow = 1;
+        int nWindowEnd = state->pindexLastCommonBlock->GetHeight() + nBlockDownloadWindow;
         int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->GetHeight(), nWindowEnd + 1);
         NodeId waitingfor = -1;
         while (pindexWalk->GetHeight() < nMaxHeight) {
@@ -608,6 +700,12 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->GetHeight());
     }
+    stats.nBlocksInFlightLimit = state->nBlocksInFlightLimit;
+    stats.nBlocksDownloaded = state->nBlocksDownloaded;
+    stats.nAvgBlockLatency = state->nAvgBlockLatency;
+    int64_t nDownloadTime = state->nDownloadTime + (state->nBlocksInFlight > 0 ? GetTimeMicros() - state->nDownloadingSince : 0);
+    stats.nBlockBytesPerSec = nDownloadTime > 0 ? state->nBlockBytesDownloaded * 1000000 / nDownloadTime : 0;
+    stats.nStalls = state->nStalls;
     return true;
 }
 
@@ -655,12 +753,17 @@ CBlockTreeDB *pblocktree = NULL;
 #define SAFECOIN_ZCASH
 #include "safecoin.h"
 
+bool safecoin_dailysnapshot_publish(bool fWait);
+
 UniValue safecoin_snapshot(int top)
 {
     LOCK(cs_main);
     int64_t total = -1;
     UniValue result(UniValue::VOBJ);
 
+    if ( top < 0 )
+        safecoin_dailysnapshot_publish(true);
+
     if (fAddressIndex) {
 	    if ( pblocktree != 0 ) {
 		result = pblocktree->Snapshot(top);
@@ -683,47 +786,43 @@ bool safecoin_snapshot2(std::map <std::string, CAmount> &addressAmounts)
 }
 
 int32_t lastSnapShotHeight = 0;
+int32_t numSnapShots = 0;   // bumped on every rebuild of vAddressSnapshot
 std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 
-bool safecoin_dailysnapshot(int32_t height)
+/**
+ * A daily snapshot being computed on its own thread. The address index is pinned and the
+ * blocks to undo are picked when the snapshot block is connected, so the result is the same
+ * as computing it right there. It is published by safecoin_dailysnapshot_publish().
+ */
+struct CDailySnapshotJob
+{
+    int32_t height,undo_height;
+    std::vector<CBlockIndex*> vUndo; // height down to undo_height+1
+    const leveldb::Snapshot* dbsnapshot;
+    bool fDone,fOK;
+    std::vector <std::pair<CAmount, CTxDestination>> vResult;
+
+    CDailySnapshotJob() : height(0), undo_height(0), dbsnapshot(NULL), fDone(false), fOK(false) {}
+};
+
+static boost::mutex csDailySnapshot;
+static boost::condition_variable condDailySnapshot;
+static std::unique_ptr<CDailySnapshotJob> pDailySnapshotJob;
+static boost::thread threadDailySnapshot;
+
+static bool safecoin_dailysnapshot_compute(CDailySnapshotJob &job)
 {
-    int reorglimit = 100; 
-    uint256 notarized_hash,notarized_desttxid; int32_t prevMoMheight,notarized_height,undo_height,extraoffset;
-    // NOTE: To make this 100% safe under all sync conditions, it should be using a notarized notarization, from the DB. 
-    // Under heavy reorg attack, its possible `safecoin_notarized_height` can return a height that can't be found on chain sync.
-    // However, the DB can reorg the last notarization. By using 2 deep, we know 100% that the previous notarization cannot be reorged by online nodes,
-    // and as such will always be notarizing the same height. May need to check heights on scan back to make sure they are confirmed in correct order.
-    if ( (extraoffset= height % SAFECOIN_SNAPSHOT_INTERVAL) != 0 )
-    {
-        // we are on chain init, and need to scan all the way back to the correct height, other wise our node will have a diffrent snapshot to online nodes.
-        // use the notarizationsDB to scan back from the consesnus height to get the offset we need.
-        std::string symbol; Notarisation nota;
-        symbol.assign(ASSETCHAINS_SYMBOL);
-        if ( ScanNotarisationsDB(height-extraoffset, symbol, 100, nota) == 0 )
-            undo_height = height-extraoffset-reorglimit; 
-        else undo_height = nota.second.height;
-        //fprintf(stderr, "height.%i-extraoffset.%i = startscanfrom.%i to get undo_height.%i\n", height, extraoffset, height-extraoffset, undo_height);
-    }
-    else 
-    {
-        // we are at the right height in connect block to scan back to last notarized height. 
-        notarized_height = safecoin_notarized_height(&prevMoMheight,&notarized_hash,&notarized_desttxid);
-        notarized_height > height-reorglimit ? undo_height = notarized_height : undo_height = height-reorglimit; 
-    }
-    fprintf(stderr, "doing snapshot for height.%i undo_height.%i\n", height, undo_height);
-    // if we already did this height dont bother doing it again, this is just a reorg. The actual snapshot height cannot be reorged.
-    if ( undo_height == lastSnapShotHeight )
-        return true;
     std::map <std::string, int64_t> addressAmounts;
-    if ( !safecoin_snapshot2(addressAmounts) )
+    if ( !pblocktree->Snapshot2(addressAmounts, 0, job.dbsnapshot) )
         return false;
 
     // undo blocks in reverse order
-    for (int32_t n = height; n > undo_height; n--) 
+    for (int32_t n = 0; n < job.vUndo.size(); n++)
     {
-        //fprintf(stderr, "undoing block.%i\n",n);
-        CBlockIndex *pindex; CBlock block;
-        if ( (pindex= safecoin_chainactive(n)) == 0 || safecoin_blockload(block, pindex) != 0 ) 
+        boost::this_thread::interruption_point();
+        //fprintf(stderr, "undoing block.%i\n",job.height-n);
+        CBlock block;
+        if ( safecoin_blockload(block, job.vUndo[n]) != 0 )
             return false;
         // undo transactions in reverse order
         for (int32_t i = block.vtx.size() - 1; i >= 0; i--) 
@@ -759,27 +858,148 @@ bool safecoin_dailysnapshot(int32_t height)
             }
         }
     }
-    vAddressSnapshot.clear(); // clear existing snapshot
     // convert address string to destination for easier conversion to what ever is required, eg, scriptPubKey. 
     for ( auto element : addressAmounts)
-        vAddressSnapshot.push_back(make_pair(element.second, DecodeDestination(element.first)));
+        job.vResult.push_back(make_pair(element.second, DecodeDestination(element.first)));
     // sort the vector by amount, highest at top.
-    std::sort(vAddressSnapshot.rbegin(), vAddressSnapshot.rend());
-    //for (int j = 0; j < 50; j++) 
-    //    fprintf(stderr, "j.%i address.%s nValue.%li\n",j, CBitcoinAddress(vAddressSnapshot[j].second).ToString().c_str(), vAddressSnapshot[j].first );
+    std::sort(job.vResult.rbegin(), job.vResult.rend());
     // include only top 3999 address.
-    if ( vAddressSnapshot.size() > 3999 ) vAddressSnapshot.resize(3999);
-    lastSnapShotHeight = undo_height; 
+    if ( job.vResult.size() > 3999 ) job.vResult.resize(3999);
+    return true;
+}
+
+static void ThreadDailySnapshot(CDailySnapshotJob *job)
+{
+    RenameThread("safecoin-snapshot");
+    int64_t nStart = GetTimeMicros();
+    bool fOK = false, fInterrupted = false;
+    try {
+        fOK = safecoin_dailysnapshot_compute(*job);
+    } catch (const boost::thread_interrupted&) {
+        fInterrupted = true;
+    }
+    pblocktree->UnpinAddressIndex(job->dbsnapshot);
+    job->dbsnapshot = NULL;
+    fprintf(stderr, "snapshot for height.%i %s in %.3f seconds\n", job->height, fOK ? "computed" : "failed", (GetTimeMicros() - nStart) * 0.000001);
+    if ( !fOK && !fInterrupted )
+    {
+        fprintf(stderr, "daily snapshot failed, please reindex your chain\n");
+        StartShutdown();
+    }
+    boost::unique_lock<boost::mutex> lock(csDailySnapshot);
+    job->fOK = fOK;
+    job->fDone = true;
+    condDailySnapshot.notify_all();
+}
+
+/**
+ * Make a finished daily snapshot the current one, waiting for it with fWait. Callers hold
+ * cs_main, like everything reading vAddressSnapshot. False if the snapshot failed.
+ */
+bool safecoin_dailysnapshot_publish(bool fWait)
+{
+    std::unique_ptr<CDailySnapshotJob> job;
+    {
+        boost::unique_lock<boost::mutex> lock(csDailySnapshot);
+        if ( !pDailySnapshotJob || (!fWait && !pDailySnapshotJob->fDone) )
+            return true;
+        while ( !pDailySnapshotJob->fDone )
+            condDailySnapshot.wait(lock);
+        job.swap(pDailySnapshotJob);
+    }
+    threadDailySnapshot.join();
+    if ( !job->fOK )
+        return false;
+    vAddressSnapshot.swap(job->vResult);
+    lastSnapShotHeight = job->undo_height;
+    numSnapShots++;
     fprintf(stderr, "vAddressSnapshot.size.%d\n", (int32_t)vAddressSnapshot.size());
     return true;
 }
 
+/** Abandon a snapshot still being computed, at shutdown before the block tree goes away */
+void safecoin_dailysnapshot_stop()
+{
+    threadDailySnapshot.interrupt();
+    if ( threadDailySnapshot.joinable() )
+        threadDailySnapshot.join();
+    boost::unique_lock<boost::mutex> lock(csDailySnapshot);
+    pDailySnapshotJob.reset();
+}
+
+bool safecoin_dailysnapshot(int32_t height)
+{
+    int reorglimit = 100; 
+    uint256 notarized_hash,notarized_desttxid; int32_t prevMoMheight,notarized_height,undo_height,extraoffset;
+    // NOTE: To make this 100% safe under all sync conditions, it should be using a notarized notarization, from the DB. 
+    // Under heavy reorg attack, its possible `safecoin_notarized_height` can return a height that can't be found on chain sync.
+    // However, the DB can reorg the last notarization. By using 2 deep, we know 100% that the previous notarization cannot be reorged by online nodes,
+    // and as such will always be notarizing the same height. May need to check heights on scan back to make sure they are confirmed in correct order.
+    if ( (extraoffset= height % SAFECOIN_SNAPSHOT_INTERVAL) != 0 )
+    {
+        // we are on chain init, and need to scan all the way back to the correct height, other wise our node will have a diffrent snapshot to online nodes.
+        // use the notarizationsDB to scan back from the consesnus height to get the offset we need.
+        std::string symbol; Notarisation nota;
+        symbol.assign(ASSETCHAINS_SYMBOL);
+        if ( ScanNotarisationsDB(height-extraoffset, symbol, 100, nota) == 0 )
+            undo_height = height-extraoffset-reorglimit; 
+        else undo_height = nota.second.height;
+        //fprintf(stderr, "height.%i-extraoffset.%i = startscanfrom.%i to get undo_height.%i\n", height, extraoffset, height-extraoffset, undo_height);
+    }
+    else 
+    {
+        // we are at the right height in connect block to scan back to last notarized height. 
+        notarized_height = safecoin_notarized_height(&prevMoMheight,&notarized_hash,&notarized_desttxid);
+        notarized_height > height-reorglimit ? undo_height = notarized_height : undo_height = height-reorglimit; 
+    }
+    fprintf(stderr, "doing snapshot for height.%i undo_height.%i\n", height, undo_height);
+    // one snapshot at a time, a reorg across a snapshot block is rare enough to wait for the last one
+    if ( !safecoin_dailysnapshot_publish(true) )
+        return false;
+    // if we already did this height dont bother doing it again, this is just a reorg. The actual snapshot height cannot be reorged.
+    if ( undo_height == lastSnapShotHeight )
+        return true;
+    if ( !fAddressIndex || pblocktree == 0 )
+        return false;
+
+    std::unique_ptr<CDailySnapshotJob> job(new CDailySnapshotJob());
+    job->height = height;
+    job->undo_height = undo_height;
+    for (int32_t n = height; n > undo_height; n--)
+    {
+        CBlockIndex *pindex;
+        if ( (pindex= safecoin_chainactive(n)) == 0 )
+            return false;
+        job->vUndo.push_back(pindex);
+    }
+    if ( (job->dbsnapshot= pblocktree->PinAddressIndex()) == NULL )
+        return false;
+    boost::unique_lock<boost::mutex> lock(csDailySnapshot);
+    pDailySnapshotJob.swap(job);
+    threadDailySnapshot = boost::thread(&ThreadDailySnapshot, pDailySnapshotJob.get());
+    return true;
+}
+
+/**
+ * Wait for a snapshot being computed if validating tx may read it. The payments CC only gets
+ * to the snapshot for a transaction with a CC output, everything else goes ahead without it.
+ */
+static bool safecoin_dailysnapshot_wait(const CTransaction &tx)
+{
+    if ( ASSETCHAINS_CC == 0 || SAFECOIN_SNAPSHOT_INTERVAL == 0 )
+        return true;
+    BOOST_FOREACH(const CTxOut &txout, tx.vout)
+        if ( txout.scriptPubKey.IsPayToCryptoCondition() )
+            return safecoin_dailysnapshot_publish(true);
+    return true;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool AddOrphanTx(const CTransaction& tx, NodeId peer, size_t nMaxPeerUsage) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     uint256 hash = tx.GetHash();
     if (mapOrphanTransactions.count(hash))
@@ -790,22 +1010,37 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
     // large transaction with a missing parent then we assume
     // it will rebroadcast it later, after the parent transaction(s)
     // have been mined or received.
-    // 10,000 orphans, each of which is at most 5,000 bytes big is
-    // at most 500 megabytes of orphans:
-    unsigned int sz = GetSerializeSize(tx, SER_NETWORK, tx.nVersion);
-    if (sz > 5000)
+    unsigned int sz = tx.GetTotalSize();
+    if (sz > MAX_ORPHAN_TX_SIZE)
     {
         LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = tx;
-    mapOrphanTransactions[hash].fromPeer = peer;
+    // A peer that already filled its share of the pool only pushes out its own orphans' chances,
+    // not those of the other peers
+    size_t nUsage = RecursiveDynamicUsage(tx);
+    size_t& nPeerUsage = mapOrphanUsageByPeer[peer];
+    if (nPeerUsage + nUsage > nMaxPeerUsage)
+    {
+        LogPrint("mempool", "ignoring orphan tx %s, peer=%d is over its orphan quota (%u bytes)\n", hash.ToString(), peer, nPeerUsage);
+        if (nPeerUsage == 0)
+            mapOrphanUsageByPeer.erase(peer);
+        return false;
+    }
+    nPeerUsage += nUsage;
+    nOrphanUsage += nUsage;
+
+    COrphanTx& orphan = mapOrphanTransactions[hash];
+    orphan.tx = tx;
+    orphan.fromPeer = peer;
+    orphan.nTimeExpire = GetTime() + ORPHAN_TX_EXPIRE_TIME;
+    orphan.nUsage = nUsage;
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
-    mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
+        mapOrphanTransactionsByPrev[txin.prevout].insert(hash);
 
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u outsz %u usage %u)\n", hash.ToString(),
+             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size(), nOrphanUsage);
     return true;
 }
 
@@ -816,13 +1051,21 @@ void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         return;
     BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
     {
-        map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
+        map<COutPoint, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
         if (itPrev == mapOrphanTransactionsByPrev.end())
             continue;
         itPrev->second.erase(hash);
         if (itPrev->second.empty())
             mapOrphanTransactionsByPrev.erase(itPrev);
     }
+    map<NodeId, size_t>::iterator itPeer = mapOrphanUsageByPeer.find(it->second.fromPeer);
+    if (itPeer != mapOrphanUsageByPeer.end())
+    {
+        itPeer->second -= it->second.nUsage;
+        if (itPeer->second == 0)
+            mapOrphanUsageByPeer.erase(itPeer);
+    }
+    nOrphanUsage -= it->second.nUsage;
     mapOrphanTransactions.erase(it);
 }
 
@@ -843,18 +1086,37 @@ void EraseOrphansFor(NodeId peer)
 }
 
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxUsage) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
+    static int64_t nNextSweep;
+    int64_t nNow = GetTime();
+    if (nNextSweep <= nNow)
+    {
+        // Sweep out expired orphans, their parents are not coming
+        int nErased = 0;
+        map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
+        while (iter != mapOrphanTransactions.end())
+        {
+            map<uint256, COrphanTx>::iterator maybeErase = iter++;
+            if (maybeErase->second.nTimeExpire <= nNow)
+            {
+                EraseOrphanTx(maybeErase->first);
+                ++nErased;
+            }
+        }
+        nNextSweep = nNow + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (nErased > 0) LogPrint("mempool", "Erased %d expired orphan tx\n", nErased);
+    }
+    while (mapOrphanTransactions.size() > nMaxOrphans || nOrphanUsage > nMaxUsage)
     {
         // Evict a random orphan:
         uint256 randomhash = GetRandHash();
         map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
         if (it == mapOrphanTransactions.end())
             it = mapOrphanTransactions.begin();
-            EraseOrphanTx(it->first);
-            ++nEvicted;
+        EraseOrphanTx(it->first);
+        ++nEvicted;
     }
     return nEvicted;
 }
@@ -1177,6 +1439,145 @@ bool ContextualCheckCoinbaseTransaction(int32_t slowflag,const CBlock *block,CBl
     return(true);
 }
 
+/**
+ * Transactions whose shielded signatures and proofs verified, by txid and consensus branch id: the txid
+ * commits to the proofs and signatures, the branch id to the signed data. Lets a transaction pre-verified
+ * by ThreadTxPreVerify skip the work when it is accepted, and again when it is mined.
+ */
+class CShieldedVerifyCache
+{
+private:
+    typedef std::pair<uint256, uint32_t> verified_type;
+    std::set<verified_type> setValid;
+    CCriticalSection cs_shieldedcache;
+
+public:
+    bool Get(const uint256& txid, uint32_t consensusBranchId)
+    {
+        LOCK(cs_shieldedcache);
+        return setValid.count(verified_type(txid, consensusBranchId)) != 0;
+    }
+
+    void Set(const uint256& txid, uint32_t consensusBranchId)
+    {
+        // an eighth of the signature cache budget, at around 128 bytes per set node
+        int64_t nMaxCacheSize = std::min(GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE), MAX_MAX_SIG_CACHE_SIZE) * ((int64_t)1 << 20) / 1024;
+        if (nMaxCacheSize <= 0)
+            return;
+
+        LOCK(cs_shieldedcache);
+        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
+        {
+            // Evict a random entry, as the signature cache does
+            std::set<verified_type>::iterator it = setValid.lower_bound(verified_type(GetRandHash(), 0));
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+        setValid.insert(verified_type(txid, consensusBranchId));
+    }
+};
+
+static CShieldedVerifyCache shieldedVerifyCache;
+
+/**
+ * Check the joinsplit signature and the Sapling proofs and binding signature of a transaction for the
+ * block at nHeight, the expensive part of ContextualCheckTransaction. Successes are cached.
+ */
+static bool ContextualCheckShieldedTransaction(const CTransaction& tx, CValidationState &state, const int nHeight, bool (*isInitBlockDownload)())
+{
+    if (tx.IsMint() || (tx.vjoinsplit.empty() && tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty()))
+        return true;
+
+    auto consensusBranchId = CurrentEpochBranchId(nHeight, Params().GetConsensus());
+    if (shieldedVerifyCache.Get(tx.GetHash(), consensusBranchId))
+        return true;
+
+    uint256 dataToBeSigned;
+
+    // Empty output script.
+    CScript scriptCode;
+    try {
+        dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, consensusBranchId);
+    } catch (std::logic_error ex) {
+        return state.DoS(100, error("CheckTransaction(): error computing signature hash"),
+                         REJECT_INVALID, "error-computing-signature-hash");
+    }
+
+    if (!tx.vjoinsplit.empty())
+    {
+        BOOST_STATIC_ASSERT(crypto_sign_PUBLICKEYBYTES == 32);
+
+        // We rely on libsodium to check that the signature is canonical.
+        // https://github.com/jedisct1/libsodium/commit/62911edb7ff2275cccd74bf1c8aefcc4d76924e0
+        if (crypto_sign_verify_detached(&tx.joinSplitSig[0],
+                                        dataToBeSigned.begin(), 32,
+                                        tx.joinSplitPubKey.begin()
+                                        ) != 0) {
+            return state.DoS(isInitBlockDownload() ? 0 : 100,
+                                error("CheckTransaction(): invalid joinsplit signature"),
+                                REJECT_INVALID, "bad-txns-invalid-joinsplit-signature");
+        }
+    }
+
+    if (!tx.vShieldedSpend.empty() ||
+        !tx.vShieldedOutput.empty())
+    {
+        ZCEnsureParamsLoaded();
+        auto ctx = librustzcash_sapling_verification_ctx_init();
+
+        for (const SpendDescription &spend : tx.vShieldedSpend) {
+            if (!librustzcash_sapling_check_spend(
+                ctx,
+                spend.cv.begin(),
+                spend.anchor.begin(),
+                spend.nullifier.begin(),
+                spend.rk.begin(),
+                spend.zkproof.begin(),
+                spend.spendAuthSig.begin(),
+                dataToBeSigned.begin()
+            ))
+            {
+                librustzcash_sapling_verification_ctx_free(ctx);
+                return state.DoS(100, error("ContextualCheckTransaction(): Sapling spend description invalid"),
+                                      REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
+            }
+        }
+
+        for (const OutputDescription &output : tx.vShieldedOutput) {
+            if (!librustzcash_sapling_check_output(
+                ctx,
+                output.cv.begin(),
+                output.cm.begin(),
+                output.ephemeralKey.begin(),
+                output.zkproof.begin()
+            ))
+            {
+                librustzcash_sapling_verification_ctx_free(ctx);
+                return state.DoS(100, error("ContextualCheckTransaction(): Sapling output description invalid"),
+                                      REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
+            }
+        }
+
+        if (!librustzcash_sapling_final_check(
+            ctx,
+            tx.valueBalance,
+            tx.bindingSig.begin(),
+            dataToBeSigned.begin()
+        ))
+        {
+            librustzcash_sapling_verification_ctx_free(ctx);
+            return state.DoS(100, error("ContextualCheckTransaction(): Sapling binding signature invalid"),
+                                  REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
+        }
+
+        librustzcash_sapling_verification_ctx_free(ctx);
+    }
+
+    shieldedVerifyCache.Set(tx.GetHash(), consensusBranchId);
+    return true;
+}
+
 /**
  * Check a transaction contextually against a set of consensus rules valid at a given block height.
  *
@@ -1285,46 +1686,11 @@ bool ContextualCheckTransaction(int32_t slowflag,const CBlock *block, CBlockInde
     if (!saplingActive) {
         // Size limits
         //BOOST_STATIC_ASSERT(MAX_BLOCK_SIZE(chainActive.LastTip()->GetHeight()+1) > MAX_TX_SIZE_BEFORE_SAPLING); // sanity
-        if (::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION) > MAX_TX_SIZE_BEFORE_SAPLING)
+        if (tx.GetTotalSize() > MAX_TX_SIZE_BEFORE_SAPLING)
             return state.DoS(100, error("ContextualCheckTransaction(): size limits failed"),
                             REJECT_INVALID, "bad-txns-oversize");
     }
 
-    uint256 dataToBeSigned;
-
-    if (!tx.IsMint() &&
-        (!tx.vjoinsplit.empty() ||
-         !tx.vShieldedSpend.empty() ||
-         !tx.vShieldedOutput.empty()))
-    {
-        auto consensusBranchId = CurrentEpochBranchId(nHeight, Params().GetConsensus());
-        // Empty output script.
-        CScript scriptCode;
-        try {
-            dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, consensusBranchId);
-        } catch (std::logic_error ex) {
-            return state.DoS(100, error("CheckTransaction(): error computing signature hash"),
-                             REJECT_INVALID, "error-computing-signature-hash");
-        }
-
-    }
-
-    if (!(tx.IsMint() || tx.vjoinsplit.empty()))
-    {
-        BOOST_STATIC_ASSERT(crypto_sign_PUBLICKEYBYTES == 32);
-
-        // We rely on libsodium to check that the signature is canonical.
-        // https://github.com/jedisct1/libsodium/commit/62911edb7ff2275cccd74bf1c8aefcc4d76924e0
-        if (crypto_sign_verify_detached(&tx.joinSplitSig[0],
-                                        dataToBeSigned.begin(), 32,
-                                        tx.joinSplitPubKey.begin()
-                                        ) != 0) {
-            return state.DoS(isInitBlockDownload() ? 0 : 100,
-                                error("CheckTransaction(): invalid joinsplit signature"),
-                                REJECT_INVALID, "bad-txns-invalid-joinsplit-signature");
-        }
-    }
-
     if (tx.IsCoinBase())
     {
         if (!ContextualCheckCoinbaseTransaction(slowflag,block,previndex,tx, nHeight,validateprices))
@@ -1332,59 +1698,7 @@ bool ContextualCheckTransaction(int32_t slowflag,const CBlock *block, CBlockInde
                                 REJECT_INVALID, "bad-txns-invalid-script-data-for-coinbase-time-lock");
     }
 
-    if (!tx.vShieldedSpend.empty() ||
-        !tx.vShieldedOutput.empty())
-    {
-        auto ctx = librustzcash_sapling_verification_ctx_init();
-
-        for (const SpendDescription &spend : tx.vShieldedSpend) {
-            if (!librustzcash_sapling_check_spend(
-                ctx,
-                spend.cv.begin(),
-                spend.anchor.begin(),
-                spend.nullifier.begin(),
-                spend.rk.begin(),
-                spend.zkproof.begin(),
-                spend.spendAuthSig.begin(),
-                dataToBeSigned.begin()
-            ))
-            {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                return state.DoS(100, error("ContextualCheckTransaction(): Sapling spend description invalid"),
-                                      REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
-            }
-        }
-
-        for (const OutputDescription &output : tx.vShieldedOutput) {
-            if (!librustzcash_sapling_check_output(
-                ctx,
-                output.cv.begin(),
-                output.cm.begin(),
-                output.ephemeralKey.begin(),
-                output.zkproof.begin()
-            ))
-            {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                return state.DoS(100, error("ContextualCheckTransaction(): Sapling output description invalid"),
-                                      REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
-            }
-        }
-
-        if (!librustzcash_sapling_final_check(
-            ctx,
-            tx.valueBalance,
-            tx.bindingSig.begin(),
-            dataToBeSigned.begin()
-        ))
-        {
-            librustzcash_sapling_verification_ctx_free(ctx);
-            return state.DoS(100, error("ContextualCheckTransaction(): Sapling binding signature invalid"),
-                                  REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
-        }
-
-        librustzcash_sapling_verification_ctx_free(ctx);
-    }
-    return true;
+    return ContextualCheckShieldedTransaction(tx, state, nHeight, isInitBlockDownload);
 }
 
 bool CheckTransaction(uint32_t tiptime,const CTransaction& tx, CValidationState &state,
@@ -1430,6 +1744,8 @@ bool CheckTransaction(uint32_t tiptime,const CTransaction& tx, CValidationState
         return false;
     } else {
         // Ensure that zk-SNARKs v|| y
+        if (!tx.vjoinsplit.empty())
+            ZCEnsureParamsLoaded();
         BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
             if (!joinsplit.Verify(*pzcashParams, verifier, tx.joinSplitPubKey)) {
                 return state.DoS(100, error("CheckTransaction(): joinsplit does not verify"),
@@ -1524,7 +1840,7 @@ bool CheckTransactionWithoutProofVerification(uint32_t tiptime,const CTransactio
     // Size limits
     //BOOST_STATIC_ASSERT(MAX_BLOCK_SIZE(chainActive.LastTip()->GetHeight()+1) >= MAX_TX_SIZE_AFTER_SAPLING); // sanity
     BOOST_STATIC_ASSERT(MAX_TX_SIZE_AFTER_SAPLING > MAX_TX_SIZE_BEFORE_SAPLING); // sanity
-    if (::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION) > MAX_TX_SIZE_AFTER_SAPLING)
+    if (tx.GetTotalSize() > MAX_TX_SIZE_AFTER_SAPLING)
         return state.DoS(100, error("CheckTransaction(): size limits failed"),
                          REJECT_INVALID, "bad-txns-oversize");
 
@@ -1799,7 +2115,7 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,bool* pfMissingInputs, bool fRejectAbsurdFee, int dosLevel)
+static bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,bool* pfMissingInputs, bool fRejectAbsurdFee, int dosLevel)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -2034,6 +2350,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
             }
         }
 
+        // A full pool only takes transactions paying more than what it last evicted
+        CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+        if (fLimitFree && mempoolRejectFee > 0 && nFees < mempoolRejectFee && !tx.IsCoinImport() && !tx.IsPegsImport())
+        {
+            return state.DoS(0, error("AcceptToMemoryPool: mempool min fee not met %s, %d < %d", hash.ToString(), nFees, mempoolRejectFee), REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+        }
+
         // Require that free transactions have sufficient priority to be mined in the next block.
         if (GetBoolArg("-relaypriority", false) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
             fprintf(stderr,"accept failure.6\n");
@@ -2078,7 +2401,10 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        PrecomputedTransactionData txdata(tx);
+        std::shared_ptr<PrecomputedTransactionData> ptxdata = std::make_shared<PrecomputedTransactionData>(tx);
+        PrecomputedTransactionData& txdata = *ptxdata;
+        if (!safecoin_dailysnapshot_wait(tx))
+            return state.Error("AcceptToMemoryPool: daily snapshot failed");
         if (!ContextualCheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, txdata, Params().GetConsensus(), consensusBranchId))
         {
             //fprintf(stderr,"accept failure.9\n");
@@ -2110,6 +2436,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         }
         if ( flag != 0 )
             SAFECOIN_CONNECTING = -1;
+        entry.SetTxData(ptxdata);
 
         {
             LOCK(pool.cs);
@@ -2129,11 +2456,29 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         }
     }
     }
+    // Relayed transactions keep the pool at its size limit, which may evict this one. Transactions
+    // re-added on a reorg are trimmed once the reorg is done.
+    if (fLimitFree)
+    {
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+    }
     // This should be here still? 
     //SyncWithWallets(tx, NULL); 
+    if ( SAFECOIN_NSPV_FULLNODE )
+        NSPV_notifytx(tx);
     return true;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,bool* pfMissingInputs, bool fRejectAbsurdFee, int dosLevel)
+{
+    TRACE1(mempool, accept_start, tx.GetHash().begin());
+    bool fAccepted = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fRejectAbsurdFee, dosLevel);
+    TRACE5(mempool, accept_finish, tx.GetHash().begin(), fAccepted, pfMissingInputs != NULL && *pfMissingInputs, state.GetRejectCode(), state.GetRejectReason().c_str());
+    return fAccepted;
+}
+
 bool CCTxFixAcceptToMemPoolUnchecked(CTxMemPool& pool, const CTransaction &tx)
 {
     // called from CheckBlock which is in cs_main and mempool.cs locks already. 
@@ -2149,6 +2494,15 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
     if (!fTimestampIndex)
         return error("Timestamp index not enabled");
 
+    if (fActiveOnly) {
+        // The logical timestamps grow along the chain, so the active blocks in range
+        // are found in memory without reading the index.
+        LOCK(cs_main);
+        for (CBlockIndex *pindex = chainActive.FindEarliestLogicalAtLeast(low); pindex && pindex->nTimeLogical < high; pindex = chainActive.Next(pindex))
+            hashes.push_back(std::make_pair(pindex->GetBlockHash(), pindex->nTimeLogical));
+        return true;
+    }
+
     if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
 
@@ -2163,31 +2517,97 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value))
-        return false;
+    if (!pblocktree->ReadSpentIndex(key, value))
+        return false;
+
+    return true;
+}
+
+bool GetAddressIndex(uint160 addressHash, int type,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool GetCCIndex(uint8_t evalcode, uint8_t funcid, std::vector<std::pair<CCIndexKey, CCIndexValue> > &ccIndex)
+{
+    // the callers fall back to scanning the contract's addresses
+    if (!fAddressIndex || !fCCIndex)
+        return false;
+
+    if (!pblocktree->ReadCCIndex(evalcode, funcid, ccIndex))
+        return error("unable to get txids for eval code %02x", evalcode);
+
+    return true;
+}
+
+void GetCCIndexEntries(const CTransaction &tx, int nHeight, std::vector<std::pair<CCIndexKey, CCIndexValue> > &ccIndex)
+{
+    if (tx.vout.empty() || tx.vout.back().scriptPubKey.size() == 0 || tx.vout.back().scriptPubKey[0] != OP_RETURN)
+        return;
+    bool fCC = false;
+    for (const CTxOut &out : tx.vout) {
+        if (out.scriptPubKey.IsPayToCryptoCondition()) {
+            fCC = true;
+            break;
+        }
+    }
+    std::vector<unsigned char> vopret;
+    if (!fCC || !GetOpReturnData(tx.vout.back().scriptPubKey, vopret) || vopret.size() < 2 || vopret[0] == 0)
+        return;
+    ccIndex.push_back(make_pair(CCIndexKey(vopret[0], vopret[1], tx.GetHash()), CCIndexValue(nHeight, tx.vout.back().scriptPubKey)));
+}
+
+bool GetAddressUnspent(uint160 addressHash, int type,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool GetAddressUnspent(const std::vector<std::pair<int, uint160> > &addresses,
+                       std::map<std::pair<int, uint160>, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > &unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressUnspentIndex(addresses, unspentOutputs))
+        return error("unable to get txids for addresses");
 
     return true;
 }
 
-bool GetAddressIndex(uint160 addressHash, int type,
-                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
+bool GetAddressIndex(uint160 addressHash, int type, const CAddressIndexKey *pAfter, size_t nMax,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, bool &fMore,
+                     bool fReverse, int start, int end)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!pblocktree->ReadAddressIndex(addressHash, type, pAfter, nMax, addressIndex, fMore, fReverse, start, end))
         return error("unable to get txids for address");
 
     return true;
 }
 
-bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+bool GetAddressUnspent(uint160 addressHash, int type, const CAddressUnspentKey *pAfter, size_t nMax,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, bool &fMore)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, pAfter, nMax, unspentOutputs, fMore))
         return error("unable to get txids for address");
 
     return true;
@@ -2235,6 +2655,163 @@ bool myAddtomempool(CTransaction &tx, CValidationState *pstate, bool fSkipExpiry
     else return(true);
 }
 
+/**
+ * Transactions myGetTransaction() read from disk while one block is connected. The
+ * CC validators of a block keep asking for the same funding, baton and token create
+ * transactions, so a hit here saves the txindex read, the seek and the deserialization.
+ * Only confirmed transactions go in, they cannot change before the block is done.
+ */
+class CBlockTxLookupCache
+{
+private:
+    CCriticalSection cs;
+    bool fActive;
+    boost::unordered_map<uint256, std::pair<CTransaction, uint256>, CCoinsKeyHasher> mapTx;
+
+public:
+    CBlockTxLookupCache() : fActive(false) {}
+
+    void Start()
+    {
+        LOCK(cs);
+        mapTx.clear();
+        fActive = true;
+    }
+
+    void Stop()
+    {
+        LOCK(cs);
+        fActive = false;
+        mapTx.clear();
+    }
+
+    bool Get(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock)
+    {
+        LOCK(cs);
+        boost::unordered_map<uint256, std::pair<CTransaction, uint256>, CCoinsKeyHasher>::const_iterator it = mapTx.find(hash);
+        if (it == mapTx.end())
+            return false;
+        txOut = it->second.first;
+        hashBlock = it->second.second;
+        return true;
+    }
+
+    void Add(const uint256 &hash, const CTransaction &tx, const uint256 &hashBlock)
+    {
+        LOCK(cs);
+        if (fActive)
+            mapTx.insert(std::make_pair(hash, std::make_pair(tx, hashBlock)));
+    }
+};
+
+static CBlockTxLookupCache blocktxlookupcache;
+
+/** Keeps blocktxlookupcache filled for as long as ConnectBlock() runs */
+class CBlockTxLookupScope
+{
+public:
+    CBlockTxLookupScope() { blocktxlookupcache.Start(); }
+    ~CBlockTxLookupScope() { blocktxlookupcache.Stop(); }
+};
+
+/**
+ * Expand a compressed blk*.dat record of nRecordSize (the size field, flag
+ * included) read from filein into ssBlock. Throws on corrupt data, like the
+ * stream reads it stands in for.
+ */
+static void ReadCompressedBlockRecord(CAutoFile& filein, unsigned int nRecordSize, CDataStream& ssBlock)
+{
+    nRecordSize &= ~BLOCK_RECORD_COMPRESSED;
+    unsigned char buf[4];
+    if (nRecordSize < sizeof(buf) || nRecordSize > MAX_BLOCK_SIZE(10000000))
+        throw std::ios_base::failure("ReadCompressedBlockRecord: bad record size");
+    filein.read((char*)buf, sizeof(buf));
+    uint32_t nRawSize = ReadLE32(buf);
+    if (nRawSize > MAX_BLOCK_SIZE(10000000))
+        throw std::ios_base::failure("ReadCompressedBlockRecord: bad block size");
+    std::vector<unsigned char> vCompressed(nRecordSize - sizeof(buf)), vRaw;
+    if (!vCompressed.empty())
+        filein.read((char*)&vCompressed[0], vCompressed.size());
+    if (!DecompressData(vCompressed, nRawSize, vRaw))
+        throw std::ios_base::failure("ReadCompressedBlockRecord: corrupt block data");
+    ssBlock.write((const char*)&vRaw[0], vRaw.size());
+}
+
+/** Open the blk*.dat record of the block at pos, positioned just before its size field */
+static FILE* OpenBlockRecord(const CDiskBlockPos& pos)
+{
+    if (pos.nPos < sizeof(unsigned int))
+        return NULL;
+    return OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(unsigned int)), true);
+}
+
+/** Read the header and the transaction at postx, whether the block is stored raw or compressed */
+static void ReadTxFromDisk(CAutoFile& file, const CDiskTxPos& postx, CBlockHeader& header, CTransaction& txOut)
+{
+    unsigned int nRecordSize;
+    file >> nRecordSize;
+    if (nRecordSize & BLOCK_RECORD_COMPRESSED) {
+        CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+        ReadCompressedBlockRecord(file, nRecordSize, ssBlock);
+        ssBlock >> header;
+        ssBlock.ignore(postx.nTxOffset);
+        ssBlock >> txOut;
+    } else {
+        file >> header;
+        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+        file >> txOut;
+    }
+}
+
+/** Read only the header of a block record, a compressed one still has to be inflated whole */
+static void ReadHeaderFromDisk(CAutoFile& file, CBlockHeader& header)
+{
+    unsigned int nRecordSize;
+    file >> nRecordSize;
+    if (nRecordSize & BLOCK_RECORD_COMPRESSED) {
+        CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+        ReadCompressedBlockRecord(file, nRecordSize, ssBlock);
+        ssBlock >> header;
+    } else {
+        file >> header;
+    }
+}
+
+void GetTxIndexHeights(const std::vector<uint256> &vTxids, std::map<uint256, int> &mapHeights)
+{
+    if (!fTxIndex || vTxids.empty())
+        return;
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    if (!pblocktree->ReadTxIndex(vTxids, vPos))
+        return;
+
+    LOCK(cs_main);
+    // height of each block by its position on disk, -1 when it is not in the active chain
+    std::map<std::pair<int, unsigned int>, int> mapBlockHeights;
+    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = vPos.begin(); it != vPos.end(); it++) {
+        std::pair<int, unsigned int> blockPos(it->second.nFile, it->second.nPos);
+        std::map<std::pair<int, unsigned int>, int>::iterator mi = mapBlockHeights.find(blockPos);
+        if (mi == mapBlockHeights.end()) {
+            int nHeight = -1;
+            CAutoFile file(OpenBlockRecord(it->second), SER_DISK, CLIENT_VERSION);
+            if (!file.IsNull()) {
+                try {
+                    CBlockHeader header;
+                    ReadHeaderFromDisk(file, header);
+                    BlockMap::iterator bi = mapBlockIndex.find(header.GetHash());
+                    if (bi != mapBlockIndex.end() && chainActive.Contains(bi->second))
+                        nHeight = bi->second->GetHeight();
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: deserialize or I/O error - %s\n", __func__, e.what());
+                }
+            }
+            mi = mapBlockHeights.insert(std::make_pair(blockPos, nHeight)).first;
+        }
+        if (mi->second >= 0)
+            mapHeights[it->first] = mi->second;
+    }
+}
+
 bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock)
 {
     memset(&hashBlock,0,sizeof(hashBlock));
@@ -2260,21 +2837,21 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
         }
     }
     //fprintf(stderr,"check disk %s\n",hash.GetHex().c_str());
+    if (blocktxlookupcache.Get(hash, txOut, hashBlock))
+        return true;
 
     if (fTxIndex) {
         CDiskTxPos postx;
         //fprintf(stderr,"ReadTxIndex\n");
         if (pblocktree->ReadTxIndex(hash, postx)) {
             //fprintf(stderr,"OpenBlockFile\n");
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+            CAutoFile file(OpenBlockRecord(postx), SER_DISK, CLIENT_VERSION);
             if (file.IsNull())
                 return error("%s: OpenBlockFile failed", __func__);
             CBlockHeader header;
             //fprintf(stderr,"seek and read\n");
             try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
+                ReadTxFromDisk(file, postx, header, txOut);
             } catch (const std::exception& e) {
                 return error("%s: Deserialize or I/O error - %s", __func__, e.what());
             }
@@ -2282,9 +2859,15 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
             if (txOut.GetHash() != hash)
                 return error("%s: txid mismatch", __func__);
             //fprintf(stderr,"found on disk %s\n",hash.GetHex().c_str());
+            blocktxlookupcache.Add(hash, txOut, hashBlock);
             return true;
         }
     }
+    // archived when its block was pruned
+    if (fHavePruned && pblocktree->ReadTxArchive(hash, txOut, hashBlock)) {
+        blocktxlookupcache.Add(hash, txOut, hashBlock);
+        return true;
+    }
     //fprintf(stderr,"not found on disk %s\n",hash.GetHex().c_str());
     return false;
 }
@@ -2323,14 +2906,12 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
     if (fTxIndex) {
         CDiskTxPos postx;
         if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+            CAutoFile file(OpenBlockRecord(postx), SER_DISK, CLIENT_VERSION);
             if (file.IsNull())
                 return error("%s: OpenBlockFile failed", __func__);
             CBlockHeader header;
             try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
+                ReadTxFromDisk(file, postx, header, txOut);
             } catch (const std::exception& e) {
                 return error("%s: Deserialize or I/O error - %s", __func__, e.what());
             }
@@ -2341,6 +2922,10 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         }
     }
 
+    // archived when its block was pruned
+    if (fHavePruned && pblocktree->ReadTxArchive(hash, txOut, hashBlock))
+        return true;
+
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
         int nHeight = -1;
         {
@@ -2389,7 +2974,26 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
 // CBlock and CBlockIndex
 //
 
-bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+unsigned int SerializeBlockRecord(const CBlock& block, std::vector<unsigned char>& vRecord)
+{
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << block;
+    vRecord.assign(ssBlock.begin(), ssBlock.end());
+    if (!fCompressBlocks)
+        return vRecord.size();
+
+    std::vector<unsigned char> vCompressed;
+    CompressData(vRecord, vCompressed);
+    uint32_t nRawSize = vRecord.size();
+    if (vCompressed.size() + sizeof(nRawSize) >= vRecord.size())
+        return vRecord.size();
+    vRecord.resize(sizeof(nRawSize));
+    WriteLE32(&vRecord[0], nRawSize);
+    vRecord.insert(vRecord.end(), vCompressed.begin(), vCompressed.end());
+    return vRecord.size() | BLOCK_RECORD_COMPRESSED;
+}
+
+bool WriteBlockToDisk(const std::vector<unsigned char>& vRecord, unsigned int nRecordSize, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -2397,26 +3001,32 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
+    fileout << FLATDATA(messageStart) << nRecordSize;
 
     // Write block
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    fileout.write((const char*)&vRecord[0], vRecord.size());
 
     return true;
 }
 
+bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    std::vector<unsigned char> vRecord;
+    unsigned int nRecordSize = SerializeBlockRecord(block, vRecord);
+    return WriteBlockToDisk(vRecord, nRecordSize, pos, messageStart);
+}
+
 bool ReadBlockFromDisk(int32_t height,CBlock& block, const CDiskBlockPos& pos,bool checkPOW)
 {
     uint8_t pubkey33[33];
     block.SetNull();
 
     // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    CAutoFile filein(OpenBlockRecord(pos), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
     {
         //fprintf(stderr,"readblockfromdisk err A\n");
@@ -2425,7 +3035,15 @@ bool ReadBlockFromDisk(int32_t height,CBlock& block, const CDiskBlockPos& pos,bo
 
     // Read block
     try {
-        filein >> block;
+        unsigned int nRecordSize;
+        filein >> nRecordSize;
+        if (nRecordSize & BLOCK_RECORD_COMPRESSED) {
+            CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+            ReadCompressedBlockRecord(filein, nRecordSize, ssBlock);
+            ssBlock >> block;
+        } else {
+            filein >> block;
+        }
     }
     catch (const std::exception& e) {
         fprintf(stderr,"readblockfromdisk err B\n");
@@ -2451,11 +3069,67 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW)
 {
     if ( pindex == 0 )
         return false;
+    CBlockRef pcached = blockReadCache.Get(pindex->GetBlockHash());
+    if (pcached) {
+        block = *pcached;
+        return true;
+    }
     if (!ReadBlockFromDisk(pindex->GetHeight(),block, pindex->GetBlockPos(),checkPOW))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
                      pindex->ToString(), pindex->GetBlockPos().ToString());
+    blockReadCache.Insert(pindex->GetBlockHash(), std::make_shared<const CBlock>(block), ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+    return true;
+}
+
+/** Decode the header, the coinbase and with fLastTx the last transaction, the ones in between into one scratch tx */
+template <typename Stream>
+static void ReadBlockEnds(Stream& s, CBlock& block, bool fLastTx)
+{
+    s >> *(CBlockHeader*)&block;
+    uint64_t nTx = ReadCompactSize(s);
+    if (nTx == 0)
+        throw std::ios_base::failure("ReadBlockEnds: block without transactions");
+    block.vtx.resize(fLastTx && nTx > 1 ? 2 : 1);
+    s >> block.vtx[0];
+    if (block.vtx.size() > 1) {
+        for (uint64_t i = 1; i < nTx; i++)
+            s >> block.vtx[1];
+    }
+}
+
+bool ReadBlockEndsFromDisk(CBlock& block, const CBlockIndex* pindex, bool fLastTx)
+{
+    block.SetNull();
+    if ( pindex == 0 )
+        return false;
+    CBlockRef pcached = blockReadCache.Get(pindex->GetBlockHash());
+    if (pcached) {
+        *(CBlockHeader*)&block = pcached->GetBlockHeader();
+        block.vtx.push_back(pcached->vtx[0]);
+        if (fLastTx && pcached->vtx.size() > 1)
+            block.vtx.push_back(pcached->vtx.back());
+        return true;
+    }
+
+    CAutoFile filein(OpenBlockRecord(pindex->GetBlockPos()), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadBlockEndsFromDisk: OpenBlockFile failed for %s", pindex->GetBlockPos().ToString());
+    try {
+        unsigned int nRecordSize;
+        filein >> nRecordSize;
+        if (nRecordSize & BLOCK_RECORD_COMPRESSED) {
+            CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+            ReadCompressedBlockRecord(filein, nRecordSize, ssBlock);
+            ReadBlockEnds(ssBlock, block, fLastTx);
+        } else {
+            ReadBlockEnds(filein, block, fLastTx);
+        }
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pindex->GetBlockPos().ToString());
+    }
     return true;
 }
 
@@ -3152,28 +3826,77 @@ void ConnectNotarisations(const CBlock &block, int height)
     if (notarisations.size() > 0) {
         CDBBatch batch = CDBBatch(*pnotarisations);
         batch.Write(block.GetHash(), notarisations);
-        WriteBackNotarisations(notarisations, batch);
+        WriteBackNotarisations(notarisations, height, batch);
         pnotarisations->WriteBatch(batch, true);
+        AddNotarisationIndex(notarisations, height);
         LogPrintf("ConnectBlock: wrote %i block notarisations in block: %s\n",
                 notarisations.size(), block.GetHash().GetHex().data());
     }
 }
 
 
-void DisconnectNotarisations(const CBlock &block)
+/**
+ * Index updates of the blocks a reorg disconnects, written once the fork point is reached
+ * instead of once per block. The rows are kept in disconnect order, so a row that a later
+ * block's disconnect writes again ends up as that block left it.
+ */
+struct CDisconnectBatch
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CCIndexKey, CCIndexValue> > ccIndex;
+    CDBBatch notarisations;
+    int nBlocks;
+
+    CDisconnectBatch() : notarisations(*pnotarisations), nBlocks(0) {}
+};
+
+/** Write the index updates of the blocks disconnected so far, must be done before a block is connected */
+static bool WriteDisconnectBatch(CValidationState &state, CDisconnectBatch &batch)
+{
+    if (batch.nBlocks == 0)
+        return true;
+    int64_t nStart = GetTimeMicros();
+    if (fAddressIndex && !pblocktree->EraseDisconnectedAddressIndex(batch.addressIndex, batch.addressUnspentIndex, batch.ccIndex))
+        return AbortNode(state, "Failed to delete address index");
+    if (fSpentIndex && !pblocktree->UpdateSpentIndex(batch.spentIndex))
+        return AbortNode(state, "Failed to delete spent index");
+    pnotarisations->WriteBatch(batch.notarisations, true);
+    LogPrint("bench", "- Write indexes of %d disconnected blocks: %.2fms\n", batch.nBlocks, (GetTimeMicros() - nStart) * 0.001);
+    batch.addressIndex.clear();
+    batch.addressUnspentIndex.clear();
+    batch.spentIndex.clear();
+    batch.ccIndex.clear();
+    batch.nBlocks = 0;
+    return true;
+}
+
+void DisconnectNotarisations(const CBlock &block, int height, CDisconnectBatch *pbatch = NULL)
 {
     // Delete from notarisations cache
     NotarisationsInBlock nibs;
     if (GetBlockNotarisations(block.GetHash(), nibs)) {
         CDBBatch batch = CDBBatch(*pnotarisations);
-        batch.Erase(block.GetHash());
-        EraseBackNotarisations(nibs, batch);
-        pnotarisations->WriteBatch(batch, true);
+        CDBBatch &batchUsed = pbatch ? pbatch->notarisations : batch;
+        batchUsed.Erase(block.GetHash());
+        EraseBackNotarisations(nibs, height, batchUsed);
+        if (!pbatch)
+            pnotarisations->WriteBatch(batch, true);
+        EraseNotarisationIndex(height);
         LogPrintf("DisconnectTip: deleted %i block notarisations in block: %s\n",
             nibs.size(), block.GetHash().GetHex().data());
     }
 }
 
+bool ReadBlockUndoFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull() || pindex->pprev == NULL)
+        return error("%s: no undo data available for %s", __func__, pindex->GetBlockHash().ToString());
+    return UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
 int8_t GetAddressType(const CScript &scriptPubKey, CTxDestination &vDest, txnouttype &txType, vector<vector<unsigned char>> &vSols)
 {
     int8_t keyType = 0;
@@ -3202,7 +3925,7 @@ int8_t GetAddressType(const CScript &scriptPubKey, CTxDestination &vDest, txnout
     return keyType;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, CDisconnectBatch* pbatch)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
@@ -3223,12 +3946,14 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CCIndexKey, CCIndexValue> > ccIndex;
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = block.vtx[i];
         uint256 hash = tx.GetHash();
         if (fAddressIndex) {
+            GetCCIndexEntries(tx, pindex->GetHeight(), ccIndex);
 
             for (unsigned int k = tx.vout.size(); k-- > 0;) {
                 const CTxOut &out = tx.vout[k];
@@ -3340,12 +4065,23 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         return true;
     }
 
+    if (pbatch) {
+        pbatch->addressIndex.insert(pbatch->addressIndex.end(), addressIndex.begin(), addressIndex.end());
+        pbatch->addressUnspentIndex.insert(pbatch->addressUnspentIndex.end(), addressUnspentIndex.begin(), addressUnspentIndex.end());
+        pbatch->spentIndex.insert(pbatch->spentIndex.end(), spentIndex.begin(), spentIndex.end());
+        pbatch->ccIndex.insert(pbatch->ccIndex.end(), ccIndex.begin(), ccIndex.end());
+        pbatch->nBlocks++;
+        return fClean;
+    }
+
     if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
+        if (!pblocktree->EraseDisconnectedAddressIndex(addressIndex, addressUnspentIndex, ccIndex)) {
             return AbortNode(state, "Failed to delete address index");
         }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
+    }
+    if (fSpentIndex) {
+        if (!pblocktree->UpdateSpentIndex(spentIndex)) {
+            return AbortNode(state, "Failed to delete spent index");
         }
     }
 
@@ -3379,11 +4115,110 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
+/** Script checks of a block are handed to the queue in groups of at least this many, instead of one Add per transaction */
+static const size_t SCRIPT_CHECK_ADD_BATCH = 128;
+
 void ThreadScriptCheck() {
     RenameThread("safecoin-scriptch");
     scriptcheckqueue.Thread();
 }
 
+/** Equihash solution check of a received header, run on the header check threads */
+class CEquihashCheck
+{
+private:
+    const CBlockHeader *pblock;
+
+public:
+    CEquihashCheck(): pblock(NULL) {}
+    CEquihashCheck(const CBlockHeader *pblockIn): pblock(pblockIn) {}
+
+    bool operator()() { return CheckEquihashSolution(pblock, Params()); }
+
+    void swap(CEquihashCheck &check) { std::swap(pblock, check.pblock); }
+};
+
+static CCheckQueue<CEquihashCheck> equihashcheckqueue(8);
+
+void ThreadEquihashCheck() {
+    RenameThread("safecoin-eqhcheck");
+    equihashcheckqueue.Thread();
+}
+
+/** Shielded signature and proof check of a block transaction, run on the shielded check threads */
+class CShieldedCheck
+{
+private:
+    const CTransaction *ptx;
+    int nHeight;
+
+public:
+    CShieldedCheck(): ptx(NULL), nHeight(0) {}
+    CShieldedCheck(const CTransaction *ptxIn, int nHeightIn): ptx(ptxIn), nHeight(nHeightIn) {}
+
+    bool operator()()
+    {
+        CValidationState state;
+        return ContextualCheckShieldedTransaction(*ptx, state, nHeight, IsInitialBlockDownload);
+    }
+
+    void swap(CShieldedCheck &check) { std::swap(ptx, check.ptx); std::swap(nHeight, check.nHeight); }
+};
+
+static CCheckQueue<CShieldedCheck> shieldedcheckqueue(1);
+
+void ThreadShieldedCheck() {
+    RenameThread("safecoin-zcheck");
+    shieldedcheckqueue.Thread();
+}
+
+/**
+ * Checks the shielded transactions of a block on the shielded check threads ahead of the serial checks in
+ * ContextualCheckBlock. A valid transaction is remembered by shieldedVerifyCache, an invalid one is checked
+ * again by the serial pass, which sets the validation state. Callers hold cs_main, so there is one master.
+ */
+static void CheckShieldedTransactions(const CBlock& block, int nHeight)
+{
+    if (nScriptCheckThreads <= 1)
+        return;
+    auto consensusBranchId = CurrentEpochBranchId(nHeight, Params().GetConsensus());
+    std::vector<CShieldedCheck> vChecks;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        if (!tx.IsMint() && !(tx.vjoinsplit.empty() && tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty()) &&
+            !shieldedVerifyCache.Get(tx.GetHash(), consensusBranchId))
+            vChecks.push_back(CShieldedCheck(&tx, nHeight));
+    }
+    if (vChecks.size() < 2)
+        return;
+    CCheckQueueControl<CShieldedCheck> control(&shieldedcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
+/**
+ * Checks the Equihash solutions of the unknown headers of a headers message on the header check threads.
+ * CheckEquihashSolution remembers the valid ones, a failing one is found again by the serial checks in
+ * AcceptBlockHeader, which punish the peer.
+ */
+static void CheckEquihashSolutions(const std::vector<CBlockHeader>& headers)
+{
+    std::vector<CEquihashCheck> vChecks;
+    std::set<uint256> hashes;
+    {
+        LOCK(cs_main);
+        BOOST_FOREACH(const CBlockHeader& header, headers) {
+            uint256 hash = header.GetHash();
+            if (mapBlockIndex.count(hash) == 0 && hashes.insert(hash).second)
+                vChecks.push_back(CEquihashCheck(&header));
+        }
+    }
+    if (vChecks.size() < 2)
+        return;
+    CCheckQueueControl<CEquihashCheck> control(&equihashcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -3458,6 +4293,22 @@ static int64_t nTimeTotal = 0;
 bool FindBlockPos(int32_t tmpflag,CValidationState &state, CDiskBlockPos &pos, unsigned int nAddSize, unsigned int nHeight, uint64_t nTime, bool fKnown = false);
 bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos);
 
+/** Load the coins of the outputs block spends from before it into view. */
+static void PrefetchBlockInputs(const CBlock& block, const CCoinsViewCache& view)
+{
+    std::set<uint256> setCreated, setSpent;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        if (!tx.IsMint()) {
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                if (!setCreated.count(txin.prevout.hash))
+                    setSpent.insert(txin.prevout.hash);
+            }
+        }
+        setCreated.insert(tx.GetHash());
+    }
+    view.Prefetch(std::vector<uint256>(setSpent.begin(), setSpent.end()));
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck,bool fCheckPOW)
 {
     CDiskBlockPos blockPos;
@@ -3476,6 +4327,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             fExpensiveChecks = false;
         }
     }
+    if (fExpensiveChecks && !hashAssumeValid.IsNull()) {
+        // Ancestors of the assumed valid block skip the signature, CC and proof checks once the best header is
+        // known to build on it. Amounts, the UTXO set and the other consensus rules are still validated.
+        BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+        if (it != mapBlockIndex.end() && it->second->GetAncestor(pindex->GetHeight()) == pindex &&
+            pindexBestHeader != NULL && pindexBestHeader->GetAncestor(it->second->GetHeight()) == it->second)
+            fExpensiveChecks = false;
+    }
     auto verifier = libzcash::ProofVerifier::Strict();
     auto disabledVerifier = libzcash::ProofVerifier::Disabled();
     int32_t futureblock;
@@ -3530,10 +4389,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Move the block to the main block file, we need this to create the TxIndex in the following loop.
     if ( (pindex->nStatus & BLOCK_IN_TMPFILE) != 0 )
     {
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
-        if (!FindBlockPos(0,state, blockPos, nBlockSize+8, pindex->GetHeight(), block.GetBlockTime(),false))
+        std::vector<unsigned char> vRecord;
+        unsigned int nRecordSize = SerializeBlockRecord(block, vRecord);
+        if (!FindBlockPos(0,state, blockPos, vRecord.size()+8, pindex->GetHeight(), block.GetBlockTime(),false))
             return error("ConnectBlock(): FindBlockPos failed");
-        if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+        if (!WriteBlockToDisk(vRecord, nRecordSize, blockPos, chainparams.MessageStart()))
             return error("ConnectBlock(): FindBlockPos failed");
         pindex->nStatus &= (~BLOCK_IN_TMPFILE);
         pindex->nFile = blockPos.nFile;
@@ -3593,6 +4453,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             sleep(1);
         }
     }
+    // declared before control, so the script check threads are done with the cache when it is emptied
+    CBlockTxLookupScope blocktxlookupscope;
+    // before any CC code runs on the script check threads, only cs_main holders may publish a snapshot
+    BOOST_FOREACH(const CTransaction &tx, block.vtx)
+        if (!safecoin_dailysnapshot_wait(tx))
+            return AbortNode(state, "Daily snapshot failed, please reindex your chain");
     CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
@@ -3600,6 +4466,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int nInputs = 0;
     uint64_t valueout;
     int64_t voutsum = 0, prevsum = 0, interest, sum = 0, stakeTxValue = 0;
+    int64_t supplyin = 0, supplyout = 0, zfunds = 0, sproutfunds = 0; // for the coinsupply totals
     unsigned int nSigOps = 0;
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
@@ -3608,6 +4475,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CCIndexKey, CCIndexValue> > ccIndex;
     // Construct the incremental merkle tree at the current
     // block position,
     auto old_sprout_tree_root = view.GetBestAnchor(SPROUT);
@@ -3634,8 +4502,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Grab the consensus branch ID for the block's height
     auto consensusBranchId = CurrentEpochBranchId(pindex->GetHeight(), Params().GetConsensus());
 
+    // One batched read for the coins spent by the block instead of a database
+    // read per input in the loop below.
+    PrefetchBlockInputs(block, view);
+
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    // checks of consecutive transactions are gathered here, so the queue is locked and its workers woken once per group
+    std::vector<CScriptCheck> vPendingChecks;
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
@@ -3658,6 +4532,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             if (!view.HaveJoinSplitRequirements(tx))
                 return state.DoS(100, error("ConnectBlock(): JoinSplit requirements not met"),
                                  REJECT_INVALID, "bad-txns-joinsplit-requirements-not-met");
+            for (size_t j = 0; j < tx.vin.size(); j++)
+            {
+                if (tx.IsPegsImport() && j==0) continue;
+                supplyin += view.GetOutputFor(tx.vin[j]).nValue;
+            }
 
             if (fAddressIndex || fSpentIndex)
             {
@@ -3701,7 +4580,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                  REJECT_INVALID, "bad-blk-sigops");
         }
 
-        txdata.emplace_back(tx);
+        // a tx seen in the mempool already had its sighash midstates computed there
+        std::shared_ptr<const PrecomputedTransactionData> ptxdata;
+        if (!tx.IsCoinBase() && mempool.lookupTxData(tx.GetHash(), ptxdata))
+            txdata.push_back(*ptxdata);
+        else
+            txdata.emplace_back(tx);
+
+        supplyout += safecoin_supplyvouts(tx);
+        zfunds += safecoin_supplyzfunds(&sproutfunds,tx);
 
         valueout = tx.GetValueOut();
         if ( SAFECOIN_VALUETOOBIG(valueout) != 0 )
@@ -3728,10 +4615,18 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             std::vector<CScriptCheck> vChecks;
             if (!ContextualCheckInputs(tx, state, view, fExpensiveChecks, flags, false, txdata[i], chainparams.GetConsensus(), consensusBranchId, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
-            control.Add(vChecks);
+            for (std::vector<CScriptCheck>::iterator it = vChecks.begin(); it != vChecks.end(); ++it) {
+                vPendingChecks.push_back(CScriptCheck());
+                it->swap(vPendingChecks.back());
+            }
+            if (vPendingChecks.size() >= SCRIPT_CHECK_ADD_BATCH) {
+                control.Add(vPendingChecks);
+                vPendingChecks.clear();
+            }
         }
 
         if (fAddressIndex) {
+            GetCCIndexEntries(tx, pindex->GetHeight(), ccIndex);
             for (unsigned int k = 0; k < tx.vout.size(); k++) {
                 const CTxOut &out = tx.vout[k];
 
@@ -3777,13 +4672,19 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        pos.nTxOffset += tx.GetTotalSize();
     }
 
     // This is moved from CheckBlock for staking chains, so we can enforce the staking tx value was indeed paid to the coinbase.
     //fprintf(stderr, "blockReward.%li stakeTxValue.%li sum.%li\n",blockReward,stakeTxValue,sum);
-    if ( ASSETCHAINS_STAKED != 0 && fCheckPOW && safecoin_checkPOW(blockReward+stakeTxValue-notarypaycheque,1,(CBlock *)&block,pindex->GetHeight()) < 0 ) 
-        return state.DoS(100, error("ConnectBlock: ac_staked chain failed slow safecoin_checkPOW"),REJECT_INVALID, "failed-slow_checkPOW");
+    if ( ASSETCHAINS_STAKED != 0 && fCheckPOW )
+    {
+        int64_t nTimePOW = GetTimeMicros();
+        if ( safecoin_checkPOW(blockReward+stakeTxValue-notarypaycheque,1,(CBlock *)&block,pindex->GetHeight()) < 0 )
+            return state.DoS(100, error("ConnectBlock: ac_staked chain failed slow safecoin_checkPOW"),REJECT_INVALID, "failed-slow_checkPOW");
+        if ( !fJustCheck )
+            validationPhaseTimes[VALIDATION_CHECKPOW].add(GetTimeMicros() - nTimePOW);
+    }
 
     view.PushAnchor(sprout_tree);
     view.PushAnchor(sapling_tree);
@@ -3834,6 +4735,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         } else if ( IS_SAFECOIN_NOTARY != 0 )
             fprintf(stderr,"allow nHeight.%d coinbase %.8f vs %.8f interest %.8f\n",(int32_t)pindex->GetHeight(),dstr(block.vtx[0].GetValueOut()),dstr(blockReward),dstr(sum));
     }
+    control.Add(vPendingChecks);
     if (!control.Wait())
         return state.DoS(100, false);
     int64_t nTime2 = GetTimeMicros(); nTimeVerify += nTime2 - nTimeStart;
@@ -3841,6 +4743,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (fJustCheck)
         return true;
+    validationPhaseTimes[VALIDATION_CONNECT].add(nTime1 - nTimeStart);
+    validationPhaseTimes[VALIDATION_VERIFY].add(nTime2 - nTime1);
 
     // Write undo information to disk
     //fprintf(stderr,"nFile.%d isNull %d vs isvalid %d nStatus %x\n",(int32_t)pindex->nFile,pindex->GetUndoPos().IsNull(),pindex->IsValid(BLOCK_VALID_SCRIPTS),(uint32_t)pindex->nStatus);
@@ -3875,8 +4779,24 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
+    // coinsupply totals, carried over from the parent so any height is a lookup
+    pindex->newcoins = safecoin_blocknewcoins(supplyout, supplyin);
+    pindex->zfunds = zfunds;
+    pindex->sproutfunds = sproutfunds;
+    if ( (pindex->nStatus & BLOCK_HAVE_SUPPLY) == 0 && pindex->pprev != 0 && (pindex->pprev->GetHeight() == 0 || (pindex->pprev->nStatus & BLOCK_HAVE_SUPPLY) != 0) )
+    {
+        pindex->nChainSupply = (pindex->pprev->GetHeight() == 0 ? 0 : pindex->pprev->nChainSupply) + pindex->newcoins;
+        pindex->nChainZfunds = (pindex->pprev->GetHeight() == 0 ? 0 : pindex->pprev->nChainZfunds) + zfunds;
+        pindex->nChainSproutfunds = (pindex->pprev->GetHeight() == 0 ? 0 : pindex->pprev->nChainSproutfunds) + sproutfunds;
+        pindex->nStatus |= BLOCK_HAVE_SUPPLY;
+        setDirtyBlockIndex.insert(pindex);
+    }
+
     ConnectNotarisations(block, pindex->GetHeight()); // MoMoM notarisation DB.
 
+    if (pblockfilterdb != NULL && !ConnectBlockFilter(block, blockundo, pindex))
+        return AbortNode(state, "Failed to write block filter");
+
     if (fTxIndex)
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
@@ -3884,6 +4804,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteAddressIndex(addressIndex)) {
             return AbortNode(state, "Failed to write address index");
         }
+        if (!pblocktree->WriteCCIndex(ccIndex)) {
+            return AbortNode(state, "Failed to write CC index");
+        }
 
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
@@ -3921,6 +4844,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     int64_t nTime3 = GetTimeMicros(); nTimeIndex += nTime3 - nTime2;
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2), nTimeIndex * 0.000001);
+    validationPhaseTimes[VALIDATION_INDEX].add(nTime3 - nTime2);
 
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
@@ -3929,9 +4853,18 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     int64_t nTime4 = GetTimeMicros(); nTimeCallbacks += nTime4 - nTime3;
     LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeCallbacks * 0.000001);
+    validationPhaseTimes[VALIDATION_CALLBACKS].add(nTime4 - nTime3);
 
     //FlushStateToDisk();
+    safecoin_pindex_setpubkey33(pindex,(CBlock *)&block);
     safecoin_connectblock(false,pindex,*(CBlock *)&block);  // dPoW state update.
+    safecoin_kvexpire(pindex->GetHeight());
+    if ( psafenodes != 0 && !psafenodes->WriteBlock(safenodeRegistry, pindex->GetHeight(), MAX_REORG_LENGTH) )
+        return AbortNode(state, "Failed to write safenode registry");
+    int64_t nTime5 = GetTimeMicros();
+    validationPhaseTimes[VALIDATION_SAFECOIN].add(nTime5 - nTime4);
+    TRACE8(validation, block_connected, pindex->GetBlockHash().begin(), pindex->GetHeight(), block.vtx.size(), nInputs,
+           nTime1 - nTimeStart, nTime2 - nTime1, nTime3 - nTime2, nTime5 - nTime4);
     if ( ASSETCHAINS_NOTARY_PAY[0] != 0 )
     {
       // Update the notary pay with the latest payment.
@@ -4036,8 +4969,16 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // Outside of shutdown only the dirty coins are written, and recently
+            // used ones stay cached so block validation keeps hitting memory.
+            bool fFlushed = mode == FLUSH_STATE_ALWAYS ? pcoinsTip->Flush() : pcoinsTip->Sync(nCoinCacheUsage / 100 * COINS_CACHE_KEEP_PERCENT);
+            if (!fFlushed)
                 return AbortNode(state, "Failed to write to coin database");
+            uint64_t nHits, nMisses;
+            pcoinsTip->GetCacheStats(nHits, nMisses);
+            LogPrint("coindb", "%s: coins cache %u entries, %.1fMiB, hit rate %.1f%%\n", __func__,
+                pcoinsTip->GetCacheSize(), pcoinsTip->DynamicMemoryUsage() * (1.0 / 1024 / 1024),
+                nHits + nMisses ? 100.0 * nHits / (nHits + nMisses) : 0.0);
             nLastFlush = nNow;
         }
         if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
@@ -4063,10 +5004,90 @@ void PruneAndFlush() {
     FlushStateToDisk(state, FLUSH_STATE_NONE);
 }
 
+/** MuHash3072 of the coins at statsMuHash.hashBlock, set up by the first GetUTXOMuHashStats, protected by cs_main */
+static MuHash3072 muhashCoins;
+static CCoinsStats statsMuHash;
+
+/** Move the coins hash from hashFrom to the set view will flush to its base, or drop it if it is elsewhere */
+static void UpdateUTXOMuHash(const CCoinsViewCache &view, const uint256 &hashFrom, const uint256 &hashTo)
+{
+    AssertLockHeld(cs_main);
+    if (statsMuHash.hashBlock.IsNull())
+        return;
+    if (statsMuHash.hashBlock != hashFrom) {
+        statsMuHash.hashBlock.SetNull();
+        return;
+    }
+    view.UpdateMuHash(muhashCoins, statsMuHash);
+    statsMuHash.hashBlock = hashTo;
+}
+
+bool GetUTXOMuHashStats(CCoinsStats &stats, bool &fScanned)
+{
+    MuHash3072 muhash;
+    {
+        LOCK(cs_main);
+        if (!statsMuHash.hashBlock.IsNull() && statsMuHash.hashBlock == pcoinsTip->GetBestBlock()) {
+            stats = statsMuHash;
+            stats.nHeight = mapBlockIndex[stats.hashBlock]->GetHeight();
+            muhash = muhashCoins;
+        }
+    }
+    if (!stats.hashBlock.IsNull()) {
+        // the inversion in Finalize is done outside cs_main
+        unsigned char hash[MuHash3072::OUTPUT_SIZE];
+        muhash.Finalize(hash);
+        stats.hashMuHash = uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
+        fScanned = false;
+        return true;
+    }
+    if (!pcoinsTip->GetStatsMuHash(stats, &muhash))
+        return false;
+    fScanned = true;
+    LOCK(cs_main);
+    if (stats.hashBlock == pcoinsTip->GetBestBlock()) {
+        muhashCoins = muhash;
+        statsMuHash.hashBlock = stats.hashBlock;
+        statsMuHash.nTransactionOutputs = stats.nTransactionOutputs;
+        statsMuHash.nTotalAmount = stats.nTotalAmount;
+    }
+    return true;
+}
+
 /** Update chainActive and related internal data structures. */
+static std::shared_ptr<const CChainTipSnapshot> pchainTipSnapshot;
+
+std::shared_ptr<const CChainTipSnapshot> GetChainTipSnapshot()
+{
+    return std::atomic_load(&pchainTipSnapshot);
+}
+
+/** Replace the tip snapshot, readers holding the previous one keep it until they let go. */
+void static PublishChainTipSnapshot(const CBlockIndex* pindex, const Consensus::Params& params) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    std::shared_ptr<CChainTipSnapshot> snapshot;
+    if (pindex != NULL)
+    {
+        snapshot = std::make_shared<CChainTipSnapshot>();
+        snapshot->pindex = pindex;
+        snapshot->nHeight = pindex->GetHeight();
+        snapshot->hashBlock = pindex->GetBlockHash();
+        snapshot->nTime = pindex->GetBlockTime();
+        snapshot->nMedianTimePast = pindex->GetMedianTimePast();
+        snapshot->nBits = pindex->nBits;
+        snapshot->nBitsNext = GetNextWorkRequired(pindex, NULL, params);
+        snapshot->nChainTx = pindex->nChainTx;
+        snapshot->nNotarizedHeight = safecoin_notarized_height(&snapshot->nPrevMoMHeight, &snapshot->hashNotarized, &snapshot->txidNotarized);
+        snapshot->nChainSproutValue = pindex->nChainSproutValue;
+        snapshot->nChainSaplingValue = pindex->nChainSaplingValue;
+    }
+    std::atomic_store(&pchainTipSnapshot, std::shared_ptr<const CChainTipSnapshot>(snapshot));
+}
+
 void static UpdateTip(CBlockIndex *pindexNew) {
     const CChainParams& chainParams = Params();
     chainActive.SetTip(pindexNew);
+    PublishChainTipSnapshot(pindexNew, chainParams.GetConsensus());
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -4124,7 +5145,7 @@ void static UpdateTip(CBlockIndex *pindexNew) {
  * Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and
  * mempool.removeWithoutBranchId after this, with cs_main held.
  */
-bool static DisconnectTip(CValidationState &state, bool fBare = false) {
+bool static DisconnectTip(CValidationState &state, bool fBare = false, CDisconnectBatch *pbatch = NULL) {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
     // Read block from disk.
@@ -4148,10 +5169,15 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        if (!DisconnectBlock(block, state, pindexDelete, view, NULL, pbatch))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        UpdateUTXOMuHash(view, pindexDelete->GetBlockHash(), pindexDelete->pprev->GetBlockHash());
         assert(view.Flush());
-        DisconnectNotarisations(block);
+        DisconnectNotarisations(block, pindexDelete->GetHeight(), pbatch);
+        safecoin_kvunexpire(pindexDelete->GetHeight());
+        safecoin_segids_disconnect(pindexDelete->GetHeight());
+        if (psafenodes != NULL && !psafenodes->DisconnectBlock(pindexDelete->GetHeight()))
+            return AbortNode(state, "Failed to rewind safenode registry");
     }
     pindexDelete->segid = -2;
     pindexDelete->nNotaryPay = 0; 
@@ -4325,6 +5351,7 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    validationPhaseTimes[VALIDATION_READBLOCK].add(nTime2 - nTime1);
     {
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, true);
@@ -4346,10 +5373,14 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         if ( SAFECOIN_NSPV_FULLNODE )
-        assert(view.Flush());
+        {
+            UpdateUTXOMuHash(view, pindexNew->pprev->GetBlockHash(), pindexNew->GetBlockHash());
+            assert(view.Flush());
+        }
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
+    validationPhaseTimes[VALIDATION_FLUSH].add(nTime4 - nTime3);
     // Write the chain state to disk, if necessary.
     if ( SAFECOIN_NSPV_FULLNODE )
     {
@@ -4358,6 +5389,7 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     }
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
+    validationPhaseTimes[VALIDATION_CHAINSTATE].add(nTime5 - nTime4);
     // Remove conflicting transactions from the mempool.
     list<CTransaction> txConflicted;
     mempool.removeForBlock(pblock->vtx, pindexNew->GetHeight(), txConflicted, !IsInitialBlockDownload());
@@ -4367,6 +5399,12 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
 
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    safecoin_segids_connect(pindexNew,pblock);
+    if ( SAFECOIN_NSPV_FULLNODE && !IsInitialBlockDownload() )
+    {
+        NSPV_merklecache_add(*pblock);
+        NSPV_notifytxs(pblock->vtx,pindexNew->GetHeight());
+    }
     if ( SAFECOIN_NSPV_FULLNODE )
     {
         // Tell wallet about transactions that went from mempool
@@ -4387,6 +5425,7 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    validationPhaseTimes[VALIDATION_POSTCONNECT].add(nTime6 - nTime5);
     
     if ( SAFECOIN_LONGESTCHAIN != 0 && (pindexNew->GetHeight() == SAFECOIN_LONGESTCHAIN || pindexNew->GetHeight() == SAFECOIN_LONGESTCHAIN+1) )
     {
@@ -4406,7 +5445,9 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     
         if ( ASSETCHAINS_CBOPRET != 0 )
         {
+           int64_t nTimePrices = GetTimeMicros();
            safecoin_pricesupdate(pindexNew->GetHeight(),pblock); 
+           validationPhaseTimes[VALIDATION_PRICES].add(GetTimeMicros() - nTimePrices);
         }
         
         if ( ASSETCHAINS_SAPLING <= 0 && pindexNew->nTime > SAFECOIN_SAPLING_ACTIVATION - 24*3600 )
@@ -4414,17 +5455,22 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
             safecoin_activate_sapling(pindexNew);
         }
         
-        if ( ASSETCHAINS_CC != 0 && SAFECOIN_SNAPSHOT_INTERVAL != 0 && (pindexNew->GetHeight() % SAFECOIN_SNAPSHOT_INTERVAL) == 0 && pindexNew->GetHeight() >= SAFECOIN_SNAPSHOT_INTERVAL )
+        if ( ASSETCHAINS_CC != 0 && SAFECOIN_SNAPSHOT_INTERVAL != 0 )
         {
-            uint64_t start = time(NULL);
-            if ( !safecoin_dailysnapshot(pindexNew->GetHeight()) )
+            // the snapshot is computed in the background, this only starts it and picks up a finished one
+            int64_t nTimeSnapshot = GetTimeMicros();
+            if ( !safecoin_dailysnapshot_publish(false) || ((pindexNew->GetHeight() % SAFECOIN_SNAPSHOT_INTERVAL) == 0 && pindexNew->GetHeight() >= SAFECOIN_SNAPSHOT_INTERVAL && !safecoin_dailysnapshot(pindexNew->GetHeight())) )
             {
                 fprintf(stderr, "daily snapshot failed, please reindex your chain\n");
                 StartShutdown();
             }
-            fprintf(stderr, "snapshot completed in: %d seconds\n", (int32_t)(time(NULL)-start));
+            validationPhaseTimes[VALIDATION_SNAPSHOT].add(GetTimeMicros() - nTimeSnapshot);
         }
     }
+    int64_t nTimeTip = GetTimeMicros() - nTime1;
+    validationPhaseTimes[VALIDATION_TOTAL].add(nTimeTip);
+    TRACE6(validation, tip_connected, pindexNew->GetBlockHash().begin(), pindexNew->GetHeight(),
+           nTime2 - nTime1, nTime3 - nTime2, nTime5 - nTime3, nTimeTip);
     return true;
 }
 
@@ -4498,6 +5544,8 @@ static void PruneBlockIndexCandidates() {
     assert(!setBlockIndexCandidates.empty());
 }
 
+static void PrefetchBlockFiles(const std::vector<CBlockIndex*>& vpindex);
+
 /**
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either NULL or a pointer to a CBlock corresponding to pindexMostWork.
@@ -4578,10 +5626,17 @@ static bool ActivateBestChainStep(bool fSkipdpow, CValidationState &state, CBloc
     // Disconnect active blocks which are no longer in the best chain.
     bool fBlocksDisconnected = false;
 
-    while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
-        if (!DisconnectTip(state))
+    {
+        CDisconnectBatch batch;
+        while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
+            if (!DisconnectTip(state, false, &batch)) {
+                WriteDisconnectBatch(state, batch);
+                return false;
+            }
+            fBlocksDisconnected = true;
+        }
+        if (!WriteDisconnectBatch(state, batch))
             return false;
-        fBlocksDisconnected = true;
     }
     if ( SAFECOIN_REWIND != 0 )
     {
@@ -4617,6 +5672,8 @@ static bool ActivateBestChainStep(bool fSkipdpow, CValidationState &state, CBloc
             pindexIter = pindexIter->pprev;
         }
         nHeight = nTargetHeight;
+        if (IsInitialBlockDownload())
+            PrefetchBlockFiles(vpindexToConnect);
 
         // Connect new blocks.
         BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
@@ -4698,10 +5755,24 @@ bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock)
             // Don't relay blocks if pruning -- could cause a peer to try to download, resulting
             // in a stalled download if the block file is pruned before the request.
             if (nLocalServices & NODE_NETWORK) {
-                LOCK(cs_vNodes);
+                // Peers that asked for it get the new tip straight away as a compact block,
+                // saving them the getdata round trip and most of the transactions.
+                std::unique_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
+                if (pblock != NULL && pblock->GetHash() == hashNewTip)
+                    pcmpctblock.reset(new CBlockHeaderAndShortTxIDs(*pblock, ASSETCHAINS_STAKED != 0));
+                LOCK2(cs_main, cs_vNodes);
                 BOOST_FOREACH(CNode* pnode, vNodes)
                 if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                    pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                {
+                    CNodeState *nodestate = State(pnode->GetId());
+                    if (pcmpctblock && nodestate != NULL && nodestate->fPreferCompact && pnode->fSuccessfullyConnected)
+                    {
+                        pnode->AddInventoryKnown(CInv(MSG_BLOCK, hashNewTip));
+                        pnode->PushMessage("cmpctblock", *pcmpctblock);
+                    }
+                    else
+                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                }
             }
             // Notify external listeners about the new tip.
             GetMainSignals().UpdatedBlockTip(pindexNewTip);
@@ -4726,6 +5797,7 @@ bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex) {
     setDirtyBlockIndex.insert(pindex);
     setBlockIndexCandidates.erase(pindex);
 
+    CDisconnectBatch batch;
     while (chainActive.Contains(pindex)) {
         CBlockIndex *pindexWalk = chainActive.Tip();
         pindexWalk->nStatus |= BLOCK_FAILED_CHILD;
@@ -4733,14 +5805,17 @@ bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex) {
         setBlockIndexCandidates.erase(pindexWalk);
         // ActivateBestChain considers blocks already in chainActive
         // unconditionally valid already, so force disconnect away from it.
-        if (!DisconnectTip(state)) {
+        if (!DisconnectTip(state, false, &batch)) {
+            WriteDisconnectBatch(state, batch);
             mempool.removeForReorg(pcoinsTip, chainActive.Tip()->GetHeight() + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
             mempool.removeWithoutBranchId(
                                           CurrentEpochBranchId(chainActive.Tip()->GetHeight() + 1, Params().GetConsensus()));
             return false;
         }
     }
-    //LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    if (!WriteDisconnectBatch(state, batch))
+        return false;
+    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
 
     // The resulting new best tip may not be in setBlockIndexCandidates anymore, so
     // add it again.
@@ -4844,6 +5919,7 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         pindexNew->BuildSkip();
     }
     pindexNew->chainPower = (pindexNew->pprev ? CChainPower(pindexNew) + pindexNew->pprev->chainPower : CChainPower(pindexNew)) + GetBlockProof(*pindexNew);
+    pindexNew->BuildTimeMax();
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == NULL || pindexBestHeader->chainPower < pindexNew->chainPower)
         pindexBestHeader = pindexNew;
@@ -5506,6 +6582,8 @@ bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState
     const Consensus::Params& consensusParams = Params().GetConsensus();
     bool sapling = NetworkUpgradeActive(nHeight, consensusParams, Consensus::UPGRADE_SAPLING);
 
+    CheckShieldedTransactions(block, nHeight);
+
     // Check that all transactions are finalized
     for (uint32_t i = 0; i < block.vtx.size(); i++) {
         const CTransaction& tx = block.vtx[i];
@@ -5616,6 +6694,7 @@ bool AcceptBlockHeader(int32_t *futureblockp,const CBlockHeader& block, CValidat
     {
         if ( (pindex= AddToBlockIndex(block)) != 0 )
         {
+            TRACE2(validation, header_accepted, hash.begin(), pindex->GetHeight());
             miSelf = mapBlockIndex.find(hash);
             if (miSelf != mapBlockIndex.end())
                 miSelf->second = pindex;
@@ -5666,7 +6745,7 @@ bool AcceptBlock(int32_t *futureblockp,CBlock& block, CValidationState& state, C
     // blocks which are too close in height to the tip.  Apply this test
     // regardless of whether pruning is enabled; it should generally be safe to
     // not process unrequested blocks.
-    bool fTooFarAhead = (pindex->GetHeight() > int(chainActive.Height() + BLOCK_DOWNLOAD_WINDOW)); //MIN_BLOCKS_TO_KEEP));
+    bool fTooFarAhead = (pindex->GetHeight() > int(chainActive.Height() + nBlockDownloadWindow)); //MIN_BLOCKS_TO_KEEP));
 
     // TODO: deal better with return value and error conditions for duplicate
     // and unrequested blocks.
@@ -5730,14 +6809,22 @@ bool AcceptBlock(int32_t *futureblockp,CBlock& block, CValidationState& state, C
 
     // Write block to history file
     try {
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        // a block already on disk (reindex) keeps its record, the raw size only bounds it
+        std::vector<unsigned char> vRecord;
+        unsigned int nRecordSize = 0;
+        unsigned int nBlockSize;
+        if (dbp == NULL) {
+            nRecordSize = SerializeBlockRecord(block, vRecord);
+            nBlockSize = vRecord.size();
+        } else
+            nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
         CDiskBlockPos blockPos;
         if (dbp != NULL)
             blockPos = *dbp;
         if (!FindBlockPos(usetmp,state, blockPos, nBlockSize+8, nHeight, block.GetBlockTime(), dbp != NULL))
             return error("AcceptBlock(): FindBlockPos failed");
         if (dbp == NULL)
-            if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+            if (!WriteBlockToDisk(vRecord, nRecordSize, blockPos, chainparams.MessageStart()))
                 AbortNode(state, "Failed to write block");
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
             return error("AcceptBlock(): ReceivedBlockTransactions failed");
@@ -5861,7 +6948,7 @@ bool ProcessNewBlock(bool from_miner,int32_t height,CValidationState &state, CNo
         if ( chainActive.LastTip() != 0 )
             safecoin_currentheight_set(chainActive.LastTip()->GetHeight());
         checked = CheckBlock(&futureblock,height!=0?height:safecoin_block2height(pblock),0,*pblock, state, verifier,0);
-        bool fRequested = MarkBlockAsReceived(hash);
+        bool fRequested = MarkBlockAsReceived(hash, pfrom ? pfrom->GetId() : -1, ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
         fRequested |= fForceProcessing;
         if ( checked != 0 && safecoin_checkPOW(0,0,pblock,height) < 0 ) //from_miner && ASSETCHAINS_STAKED == 0
         {
@@ -5957,6 +7044,29 @@ uint64_t CalculateCurrentUsage()
     return retval;
 }
 
+/**
+ * Copy the transactions of the main chain blocks in a block file about to be pruned to the
+ * transaction archive (-prunetxarchive). The archive reaches the disk with the block index
+ * write that comes before the files are unlinked, both are in the block tree database.
+ */
+static bool ArchiveBlockFile(int fileNumber)
+{
+    int nBlocks = 0;
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex == NULL || pindex->nFile != fileNumber || !(pindex->nStatus & BLOCK_HAVE_DATA) || !chainActive.Contains(pindex))
+            continue;
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, false))
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        if (!pblocktree->WriteTxArchive(pindex->GetBlockHash(), block.vtx))
+            return error("%s: failed to archive the transactions of block %s", __func__, pindex->GetBlockHash().ToString());
+        nBlocks++;
+    }
+    LogPrint("prune", "Prune: archived the transactions of %d blocks of blk%05u.dat\n", nBlocks, fileNumber);
+    return true;
+}
+
 /* Prune a block file (modify associated database entries)*/
 bool PruneOneBlockFile(bool tempfile, const int fileNumber)
 {
@@ -6061,6 +7171,10 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune)
             if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
                 continue;
 
+            // a file whose transactions could not be archived is kept, pruning goes on next time
+            if (fPruneTxArchive && !ArchiveBlockFile(fileNumber))
+                break;
+
             PruneOneBlockFile(false, fileNumber);
             // Queue up the files for removal
             setFilesToPrune.insert(fileNumber);
@@ -6088,7 +7202,6 @@ bool CheckDiskSpace(uint64_t nAdditionalBytes)
 
 FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly)
 {
-    static int32_t didinit[256];
     if (pos.IsNull())
         return NULL;
     boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
@@ -6100,11 +7213,6 @@ FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly)
         LogPrintf("Unable to open file %s\n", path.string());
         return NULL;
     }
-    if ( pos.nFile < sizeof(didinit)/sizeof(*didinit) && didinit[pos.nFile] == 0 && strcmp(prefix,(char *)"blk") == 0 )
-    {
-        safecoin_prefetch(file);
-        didinit[pos.nFile] = 1;
-    }
     if (pos.nPos) {
         if (fseek(file, pos.nPos, SEEK_SET)) {
             LogPrintf("Unable to seek to position %u of %s\n", pos.nPos, path.string());
@@ -6115,6 +7223,36 @@ FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly)
     return file;
 }
 
+/**
+ * Ask for the block data of the next blocks to be connected to be read in the background, one
+ * hint per blk file covering the positions of the blocks in it, so that ConnectTip finds them
+ * in the page cache instead of waiting on a seek for each one.
+ */
+static void PrefetchBlockFiles(const std::vector<CBlockIndex*>& vpindex)
+{
+    std::map<int, std::pair<unsigned int, unsigned int> > mapRanges;
+    BOOST_FOREACH(const CBlockIndex* pindex, vpindex) {
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            continue;
+        CDiskBlockPos pos = pindex->GetBlockPos();
+        unsigned int nEnd = pos.nPos + MAX_BLOCK_SIZE(pindex->GetHeight());
+        std::map<int, std::pair<unsigned int, unsigned int> >::iterator it = mapRanges.find(pos.nFile);
+        if (it == mapRanges.end())
+            mapRanges.insert(std::make_pair(pos.nFile, std::make_pair(pos.nPos, nEnd)));
+        else {
+            it->second.first = std::min(it->second.first, pos.nPos);
+            it->second.second = std::max(it->second.second, nEnd);
+        }
+    }
+    for (std::map<int, std::pair<unsigned int, unsigned int> >::iterator it = mapRanges.begin(); it != mapRanges.end(); it++) {
+        FILE* file = OpenDiskFile(CDiskBlockPos(it->first, 0), "blk", true);
+        if (!file)
+            continue;
+        FileReadAhead(file, it->second.first, it->second.second - it->second.first);
+        fclose(file);
+    }
+}
+
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly) {
     return OpenDiskFile(pos, "blk", fReadOnly);
 }
@@ -6176,6 +7314,7 @@ bool static LoadBlockIndexDB()
     {
         CBlockIndex* pindex = item.second;
         pindex->chainPower = (pindex->pprev ? CChainPower(pindex) + pindex->pprev->chainPower : CChainPower(pindex)) + GetBlockProof(*pindex);
+        pindex->BuildTimeMax();
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -6282,6 +7421,8 @@ bool static LoadBlockIndexDB()
     // Check whether we have an address index
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("ccindex", fCCIndex);
+    LogPrintf("%s: CC index %s\n", __func__, fAddressIndex && fCCIndex ? "enabled" : "disabled");
 
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
@@ -6438,6 +7579,95 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
     return true;
 }
 
+bool VerifyDBInBackground(int nCheckLevel, int nCheckDepth)
+{
+    CBlockIndex* pindexStart;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        pindexStart = chainActive.Tip();
+        nHeight = chainActive.Height();
+    }
+    if (pindexStart == NULL || pindexStart->pprev == NULL)
+        return true;
+
+    if (nCheckDepth <= 0 || nCheckDepth > nHeight)
+        nCheckDepth = nHeight;
+    nCheckLevel = std::max(0, std::min(3, nCheckLevel));
+    LogPrintf("Verifying last %i blocks at level %i in the background\n", nCheckDepth, nCheckLevel);
+    // disconnecting on top of pcoinsTip is only meaningful while the tip is where we started
+    std::unique_ptr<CCoinsViewCache> coins;
+    CBlockIndex* pindexState = pindexStart;
+    CBlockIndex* pindexFailure = NULL;
+    int nGoodTransactions = 0;
+    int nChecked = 0;
+    CValidationState state;
+    auto verifier = libzcash::ProofVerifier::Disabled();
+    for (CBlockIndex* pindex = pindexStart; pindex && pindex->pprev && pindex->GetHeight() >= nHeight - nCheckDepth; pindex = pindex->pprev)
+    {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            return true;
+        LOCK(cs_main);
+        // pruned since we started, nothing left to check
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            break;
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex,0))
+            return error("%s: *** ReadBlockFromDisk failed at %d, hash=%s", __func__, pindex->GetHeight(), pindex->GetBlockHash().ToString());
+        int32_t futureblock;
+        if (nCheckLevel >= 1 && !CheckBlock(&futureblock,pindex->GetHeight(),pindex,block, state, verifier,0) )
+            return error("%s: *** found bad block at %d, hash=%s", __func__, pindex->GetHeight(), pindex->GetBlockHash().ToString());
+        if (nCheckLevel >= 2) {
+            CBlockUndo undo;
+            CDiskBlockPos pos = pindex->GetUndoPos();
+            if (!pos.IsNull()) {
+                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
+                    return error("%s: *** found bad undo data at %d, hash=%s", __func__, pindex->GetHeight(), pindex->GetBlockHash().ToString());
+            }
+        }
+        if (nCheckLevel >= 3 && pindex == pindexState) {
+            if (chainActive.Tip() != pindexStart) {
+                LogPrintf("%s: tip moved, coin database checked down to height %d\n", __func__, pindexState->GetHeight());
+                coins.reset();
+                nCheckLevel = 2;
+            } else if (!coins || coins->DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage() <= nCoinCacheUsage) {
+                if (!coins)
+                    coins.reset(new CCoinsViewCache(pcoinsTip));
+                bool fClean = true;
+                if (!DisconnectBlock(block, state, pindex, *coins, &fClean))
+                    return error("%s: *** irrecoverable inconsistency in block data at %d, hash=%s", __func__, pindex->GetHeight(), pindex->GetBlockHash().ToString());
+                pindexState = pindex->pprev;
+                if (!fClean) {
+                    nGoodTransactions = 0;
+                    pindexFailure = pindex;
+                } else
+                    nGoodTransactions += block.vtx.size();
+            }
+        }
+        nChecked++;
+    }
+    if (pindexFailure)
+        return error("%s: *** coin database inconsistencies found (last %i blocks, %i good transactions before that)", __func__, pindexStart->GetHeight() - pindexFailure->GetHeight() + 1, nGoodTransactions);
+
+    LogPrintf("No block database inconsistencies in last %i blocks\n", nChecked);
+    return true;
+}
+
+void ThreadVerifyDB(int nCheckLevel, int nCheckDepth)
+{
+    RenameThread("zcash-verifydb");
+    SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    if (VerifyDBInBackground(nCheckLevel, nCheckDepth))
+        return;
+
+    fBlockDBCorrupt = true;
+    // strMiscWarning is read by GetWarnings(), called by the JSON-RPC code to warn the user:
+    strMiscWarning = _("Error: Corrupted block database detected, mining and staking are disabled. Restart with -reindex");
+    LogPrintf("*** %s\n", strMiscWarning);
+    CAlert::Notify(strMiscWarning, true);
+}
+
 bool RewindBlockIndex(const CChainParams& params, bool& clearWitnessCaches)
 {
     LOCK(cs_main);
@@ -6588,11 +7818,14 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    PublishChainTipSnapshot(NULL, Params().GetConsensus());
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool.clear();
     mapOrphanTransactions.clear();
     mapOrphanTransactionsByPrev.clear();
+    mapOrphanUsageByPeer.clear();
+    nOrphanUsage = 0;
     nSyncStarted = 0;
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
@@ -6615,6 +7848,62 @@ void UnloadBlockIndex()
     fHavePruned = false;
 }
 
+bool LoadTxOutSetSnapshot(CCoinsViewDB *pcoinsdb, const boost::filesystem::path &path, std::string &strError)
+{
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = strprintf(_("Cannot open UTXO snapshot %s"), path.string());
+        return false;
+    }
+    CTxOutSetSnapshotHeader header;
+    try {
+        file >> header;
+    } catch (const std::exception& e) {
+        header.nMagic = 0;
+    }
+    if (header.nMagic != CTxOutSetSnapshotHeader::SNAPSHOT_MAGIC || header.nVersion != CTxOutSetSnapshotHeader::CURRENT_VERSION) {
+        strError = strprintf(_("%s is not a UTXO snapshot this version can load"), path.string());
+        return false;
+    }
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(header.hashBlock);
+        if (it == mapBlockIndex.end() || it->second->GetHeight() != header.nHeight || it->second->nChainTx == 0) {
+            strError = _("The block of the UTXO snapshot and the blocks before it have to be on disk");
+            return false;
+        }
+        CBlockIndex *pindexBase = it->second;
+        // the snapshot block has to extend the notarization the dumping node saw
+        BlockMap::const_iterator itn = mapBlockIndex.find(header.hashNotarized);
+        if (header.nNotarizedHeight <= 0 || itn == mapBlockIndex.end() || pindexBase->GetAncestor(header.nNotarizedHeight) != itn->second) {
+            strError = _("The block of the UTXO snapshot does not build on a notarized block");
+            return false;
+        }
+        // and be on one chain with the latest notarization this node knows about
+        int32_t prevMoMheight; uint256 notarized_hash, notarized_desttxid;
+        int32_t notarized_height = safecoin_notarized_height(&prevMoMheight, &notarized_hash, &notarized_desttxid);
+        if (notarized_height > 0) {
+            itn = mapBlockIndex.find(notarized_hash);
+            bool fOnChain = itn != mapBlockIndex.end() && (notarized_height <= header.nHeight ?
+                pindexBase->GetAncestor(notarized_height) == itn->second : itn->second->GetAncestor(header.nHeight) == pindexBase);
+            if (!fOnChain) {
+                strError = _("The UTXO snapshot is not on the notarized chain");
+                return false;
+            }
+        }
+    }
+
+    LogPrintf("Loading UTXO snapshot %s at height %d (%s)\n", path.string(), header.nHeight, header.hashBlock.ToString());
+    CCoinsStats stats;
+    if (!pcoinsdb->LoadSnapshot(file, header, stats)) {
+        strError = _("Error loading the UTXO snapshot, remove the chainstate directory before trying again");
+        return false;
+    }
+    LogPrintf("Loaded %u transactions with %u outputs from the UTXO snapshot, hash_serialized %s\n",
+              (unsigned int)stats.nTransactions, (unsigned int)stats.nTransactionOutputs, stats.hashSerialized.ToString());
+    return true;
+}
+
 bool LoadBlockIndex()
 {
     // Load block index from databases
@@ -6649,6 +7938,9 @@ bool InitBlockIndex() {
     // Use the provided setting for -addressindex in the new database
     fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
     pblocktree->WriteFlag("addressindex", fAddressIndex);
+    // the CC index is kept with the address index, complete as it starts with it
+    fCCIndex = fAddressIndex;
+    pblocktree->WriteFlag("ccindex", fCCIndex);
 
     // Use the provided setting for -timestampindex in the new database
     fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
@@ -6664,12 +7956,13 @@ bool InitBlockIndex() {
         try {
             CBlock &block = const_cast<CBlock&>(Params().GenesisBlock());
             // Start new block file
-            unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            std::vector<unsigned char> vRecord;
+            unsigned int nRecordSize = SerializeBlockRecord(block, vRecord);
             CDiskBlockPos blockPos;
             CValidationState state;
-            if (!FindBlockPos(0,state, blockPos, nBlockSize+8, 0, block.GetBlockTime()))
+            if (!FindBlockPos(0,state, blockPos, vRecord.size()+8, 0, block.GetBlockTime()))
                 return error("LoadBlockIndex(): FindBlockPos failed");
-            if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+            if (!WriteBlockToDisk(vRecord, nRecordSize, blockPos, chainparams.MessageStart()))
                 return error("LoadBlockIndex(): writing genesis block to disk failed");
             CBlockIndex *pindex = AddToBlockIndex(block);
             if ( pindex == 0 )
@@ -6692,9 +7985,111 @@ bool InitBlockIndex() {
 
 
 
-bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
+/** An external file is read ahead a batch at a time, while the batch before it is submitted */
+static const unsigned int IMPORT_BATCH_BLOCKS = 64;
+static const uint64_t IMPORT_BATCH_BYTES = 64 * 1000000;
+
+/** A block read from an external file and where it was read from */
+struct CImportedBlock
+{
+    CBlock block;
+    CDiskBlockPos pos;
+};
+
+/**
+ * Checks the Equihash solutions of a batch of imported blocks on threads of its own while the batch before
+ * it is submitted. CheckEquihashSolution remembers the valid ones, so the serial checks in ProcessNewBlock
+ * find them done, and a failing one is found again there and rejected as before.
+ */
+class CImportSolutionCheck
+{
+private:
+    const std::vector<CImportedBlock> *pvBlocks;
+    std::atomic<size_t> nNext;
+    boost::thread_group threads;
+
+    void Thread()
+    {
+        size_t i;
+        while ((i = nNext++) < pvBlocks->size())
+            CheckEquihashSolution(&(*pvBlocks)[i].block, Params());
+    }
+
+public:
+    CImportSolutionCheck(): pvBlocks(NULL), nNext(0) {}
+    ~CImportSolutionCheck() { Wait(); }
+
+    void Start(const std::vector<CImportedBlock> *pvBlocksIn, int nThreads)
+    {
+        Wait();
+        pvBlocks = pvBlocksIn;
+        nNext = 0;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CImportSolutionCheck::Thread, this));
+    }
+
+    void Wait() { threads.join_all(); }
+};
+
+/** Submits one block of an external file, and the blocks read earlier that were waiting for it. Returns false on a state error. */
+static bool ImportExternalBlock(CBlock& block, CDiskBlockPos *dbp, std::multimap<uint256, CDiskBlockPos>& mapBlocksUnknownParent, int& nLoaded)
 {
     const CChainParams& chainparams = Params();
+    try {
+        // detect out of order blocks, and store them for later
+        uint256 hash = block.GetHash();
+        if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+            LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                     block.hashPrevBlock.ToString());
+            if (dbp)
+                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+            CValidationState state;
+            if (ProcessNewBlock(0,0,state, NULL, &block, true, dbp))
+                nLoaded++;
+            if (state.IsError())
+                return false;
+        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && safecoin_blockheight(hash) % 1000 == 0) {
+            LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), safecoin_blockheight(hash));
+        }
+
+        // Recursively process earlier encountered successors of this block
+        deque<uint256> queue;
+        queue.push_back(hash);
+        while (!queue.empty()) {
+            uint256 head = queue.front();
+            queue.pop_front();
+            std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+            while (range.first != range.second) {
+                std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                
+                if (ReadBlockFromDisk(mapBlockIndex.count(hash)!=0?mapBlockIndex[hash]->GetHeight():0,block, it->second,1))
+                {
+                    LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                              head.ToString());
+                    CValidationState dummy;
+                    if (ProcessNewBlock(0,0,dummy, NULL, &block, true, &it->second))
+                    {
+                        nLoaded++;
+                        queue.push_back(block.GetHash());
+                    }
+                }
+                range.first++;
+                mapBlocksUnknownParent.erase(it);
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+    }
+    return true;
+}
+
+bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
+{
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
@@ -6705,89 +8100,83 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
         //CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE(10000000), MAX_BLOCK_SIZE(10000000)+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
-
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE(10000000))
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                CBlock block;
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                blkdat >> block;
-                
-                nRewind = blkdat.GetPos();
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                             block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
+        // the batch being submitted and the one read ahead, whose solutions are checked in the meantime
+        std::vector<CImportedBlock> vBatch[2];
+        CImportSolutionCheck solutions;
+        bool fParallel = nScriptCheckThreads > 1 && ASSETCHAINS_ALGO == ASSETCHAINS_EQUIHASH;
+        bool fEnd = false, fError = false;
+        int nRead = 0;
+        while (!fError && !(fEnd && vBatch[nRead ^ 1].empty())) {
+            std::vector<CImportedBlock>& vRead = vBatch[nRead];
+            uint64_t nBatchBytes = 0;
+            // have the kernel read the batch after this one while this one is parsed and the last one connected
+            FileReadAhead(fileIn, nRewind + IMPORT_BATCH_BYTES, IMPORT_BATCH_BYTES);
+            while (!fEnd && vRead.size() < IMPORT_BATCH_BLOCKS && nBatchBytes < IMPORT_BATCH_BYTES) {
+                if (blkdat.eof()) {
+                    fEnd = true;
+                    break;
                 }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(0,0,state, NULL, &block, true, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && safecoin_blockheight(hash) % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), safecoin_blockheight(hash));
+                boost::this_thread::interruption_point();
+
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[MESSAGE_START_SIZE];
+                    blkdat.FindByte(Params().MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if ((nSize & ~BLOCK_RECORD_COMPRESSED) < 80 || (nSize & ~BLOCK_RECORD_COMPRESSED) > MAX_BLOCK_SIZE(10000000))
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    fEnd = true;
+                    break;
                 }
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        
-                        if (ReadBlockFromDisk(mapBlockIndex.count(hash)!=0?mapBlockIndex[hash]->GetHeight():0,block, it->second,1))
-                        {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                      head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(0,0,dummy, NULL, &block, true, &it->second))
-                            {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
+                try {
+                    // read block
+                    vRead.push_back(CImportedBlock());
+                    CImportedBlock& imported = vRead.back();
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    if (dbp) {
+                        dbp->nPos = nBlockPos;
+                        imported.pos = *dbp;
                     }
+                    blkdat.SetLimit(nBlockPos + (nSize & ~BLOCK_RECORD_COMPRESSED));
+                    blkdat.SetPos(nBlockPos);
+                    if (nSize & BLOCK_RECORD_COMPRESSED) {
+                        std::vector<unsigned char> vRecord(nSize & ~BLOCK_RECORD_COMPRESSED), vRaw;
+                        blkdat.read((char*)&vRecord[0], vRecord.size());
+                        std::vector<unsigned char> vCompressed(vRecord.begin() + 4, vRecord.end());
+                        if (!DecompressData(vCompressed, ReadLE32(&vRecord[0]), vRaw))
+                            throw std::ios_base::failure("corrupt compressed block");
+                        CDataStream ssBlock(vRaw, SER_DISK, CLIENT_VERSION);
+                        ssBlock >> imported.block;
+                    } else
+                        blkdat >> imported.block;
+                    
+                    nRewind = blkdat.GetPos();
+                    nBatchBytes += (nSize & ~BLOCK_RECORD_COMPRESSED);
+                } catch (const std::exception& e) {
+                    vRead.pop_back();
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+
+            solutions.Wait();
+            if (fParallel && vRead.size() > 1)
+                solutions.Start(&vRead, nScriptCheckThreads);
+            std::vector<CImportedBlock>& vSubmit = vBatch[nRead ^ 1];
+            for (size_t i = 0; i < vSubmit.size() && !fError; i++)
+                fError = !ImportExternalBlock(vSubmit[i].block, dbp ? &vSubmit[i].pos : NULL, mapBlocksUnknownParent, nLoaded);
+            vSubmit.clear();
+            nRead ^= 1;
         }
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
@@ -7085,6 +8474,36 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/**
+ * Recent blocks as ready "block" messages. A new block is asked for by most peers within
+ * seconds, they all share one buffer rather than each getting it read from disk and
+ * serialized again. Requires cs_main.
+ */
+static const size_t MAX_BLOCKMSG_CACHE = 8;
+static std::map<uint256, CSendBuffer> mapBlockMsgCache;
+static std::deque<uint256> vBlockMsgCacheOrder;
+
+static CSendBuffer GetBlockMessage(const CBlockIndex* pindex)
+{
+    std::map<uint256, CSendBuffer>::iterator it = mapBlockMsgCache.find(pindex->GetBlockHash());
+    return it == mapBlockMsgCache.end() ? CSendBuffer() : it->second;
+}
+
+static void CacheBlockMessage(const CBlockIndex* pindex, const CSendBuffer& msg)
+{
+    // older blocks are served to syncing peers, each at its own height
+    if (!chainActive.Contains(pindex) || chainActive.Height() - pindex->GetHeight() > MAX_BLOCKTXN_DEPTH)
+        return;
+    if (!mapBlockMsgCache.insert(std::make_pair(pindex->GetBlockHash(), msg)).second)
+        return;
+    vBlockMsgCacheOrder.push_back(pindex->GetBlockHash());
+    while (vBlockMsgCacheOrder.size() > MAX_BLOCKMSG_CACHE)
+    {
+        mapBlockMsgCache.erase(vBlockMsgCacheOrder.front());
+        vBlockMsgCacheOrder.pop_front();
+    }
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -7103,7 +8522,7 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -7128,9 +8547,14 @@ void static ProcessGetData(CNode* pfrom)
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
+                    // Send block from disk, or the shared message of a recent block
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second,1))
+                    CSendBuffer msg;
+                    if (inv.type == MSG_BLOCK && (msg = GetBlockMessage(mi->second)))
+                    {
+                        pfrom->PushBuffer(msg);
+                    }
+                    else if (!ReadBlockFromDisk(block, (*mi).second,1))
                     {
                         assert(!"cannot load block from disk");
                     }
@@ -7143,7 +8567,17 @@ void static ProcessGetData(CNode* pfrom)
                             //for (z=31; z>=0; z--)
                             //    fprintf(stderr,"%02x",((uint8_t *)&hash)[z]);
                             //fprintf(stderr," send block %d\n",safecoin_block2height(&block));
-                            pfrom->PushMessage("block", block);
+                            msg = MakeSendBuffer("block", block);
+                            CacheBlockMessage(mi->second, msg);
+                            pfrom->PushBuffer(msg);
+                        }
+                        else if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            // The peer will be missing most transactions of an older block anyway
+                            if (chainActive.Contains(mi->second) && chainActive.Height() - mi->second->GetHeight() <= MAX_CMPCTBLOCK_DEPTH)
+                                pfrom->PushMessage("cmpctblock", CBlockHeaderAndShortTxIDs(block, ASSETCHAINS_STAKED != 0));
+                            else
+                                pfrom->PushMessage("block", block);
                         }
                         else // MSG_FILTERED_BLOCK)
                         {
@@ -7186,9 +8620,9 @@ void static ProcessGetData(CNode* pfrom)
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<CInv, CSendBuffer>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        pfrom->PushBuffer((*mi).second);
                         pushed = true;
                     }
                 }
@@ -7210,30 +8644,311 @@ void static ProcessGetData(CNode* pfrom)
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
 
-    pfrom->vRecvGetData.erase(pfrom->vRecvGetData.begin(), it);
+    pfrom->vRecvGetData.erase(pfrom->vRecvGetData.begin(), it);
+
+    if (!vNotFound.empty()) {
+        // Let the peer know that we didn't find what it asked for, so it doesn't
+        // have to wait around forever. Currently only SPV clients actually care
+        // about this message: it's needed when they are recursively walking the
+        // dependencies of relevant unconfirmed transactions. SPV clients want to
+        // do that because they want to know about (and store and rebroadcast and
+        // risk analyze) the dependencies of transactions relevant to them, without
+        // having to download the entire memory pool.
+        pfrom->PushMessage("notfound", vNotFound);
+    }
+}
+
+#include "safecoin_nSPV_defs.h"
+#include "safecoin_nSPV.h"            // shared defines, structs, serdes, purge functions
+#include "safecoin_nSPV_fullnode.h"   // nSPV fullnode handling of the getnSPV request messages
+#include "safecoin_nSPV_superlite.h"  // nSPV superlite client, issuing requests and handling nSPV responses
+#include "safecoin_nSPV_wallet.h"     // nSPV_send and support functions, really all the rest is to support this
+
+/** Hand a block rebuilt from a compact block to validation, as if it came in a "block" message */
+void static ProcessReconstructedBlock(CNode* pfrom, const string& strCommand, CBlock& block)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    LogPrint("net", "reconstructed block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+
+    CValidationState state;
+    bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
+    ProcessNewBlock(0,0,state, pfrom, &block, forceProcessing, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+}
+
+/** Try to add a transaction relayed by pfrom to the mempool, then any orphans waiting on it. */
+void static ProcessTransaction(CNode* pfrom, const CTransaction& tx)
+{
+    CInv inv(MSG_TX, tx.GetHash());
+
+    LOCK(cs_main);
+
+    bool fMissingInputs = false;
+    CValidationState state;
+
+    pfrom->setAskFor.erase(inv.hash);
+    mapAlreadyAskedFor.erase(inv);
+
+    if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs))
+    {
+        mempool.check(pcoinsTip);
+        RelayTransaction(tx);
+
+        LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s: accepted %s (poolsz %u)\n",
+                 pfrom->id, pfrom->cleanSubVer,
+                 tx.GetHash().ToString(),
+                 mempool.mapTx.size());
+
+        // Process the orphans spending outputs of this transaction, then those spending outputs of the
+        // orphans accepted, a generation at a time so an orphan waiting on several of them is tried once
+        set<NodeId> setMisbehaving;
+        vector<CTransaction> vAccepted(1, tx);
+        while (!vAccepted.empty())
+        {
+            set<uint256> setOrphans;
+            BOOST_FOREACH(const CTransaction& txParent, vAccepted)
+            {
+                for (uint32_t i = 0; i < txParent.vout.size(); i++)
+                {
+                    map<COutPoint, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(COutPoint(txParent.GetHash(), i));
+                    if (itByPrev != mapOrphanTransactionsByPrev.end())
+                        setOrphans.insert(itByPrev->second.begin(), itByPrev->second.end());
+                }
+            }
+            vAccepted.clear();
+
+            BOOST_FOREACH(const uint256& orphanHash, setOrphans)
+            {
+                map<uint256, COrphanTx>::iterator itOrphan = mapOrphanTransactions.find(orphanHash);
+                if (itOrphan == mapOrphanTransactions.end())
+                    continue;
+                const CTransaction orphanTx = itOrphan->second.tx;
+                NodeId fromPeer = itOrphan->second.fromPeer;
+                bool fMissingInputs2 = false;
+                // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+                // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+                // anyone relaying LegitTxX banned)
+                CValidationState stateDummy;
+
+                if (setMisbehaving.count(fromPeer))
+                    continue;
+                if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2))
+                {
+                    LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
+                    RelayTransaction(orphanTx);
+                    vAccepted.push_back(orphanTx);
+                    EraseOrphanTx(orphanHash);
+                }
+                else if (!fMissingInputs2)
+                {
+                    int nDos = 0;
+                    if (stateDummy.IsInvalid(nDos) && nDos > 0)
+                    {
+                        // Punish peer that gave us an invalid orphan tx
+                        Misbehaving(fromPeer, nDos);
+                        setMisbehaving.insert(fromPeer);
+                        LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
+                    }
+                    // Has inputs but not accepted to mempool
+                    // Probably non-standard or insufficient fee/priority
+                    LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
+                    EraseOrphanTx(orphanHash);
+                    assert(recentRejects);
+                    recentRejects->insert(orphanHash);
+                }
+                mempool.check(pcoinsTip);
+            }
+        }
+    }
+    // TODO: currently, prohibit joinsplits and shielded spends/outputs from entering mapOrphans
+    else if (fMissingInputs &&
+             tx.vjoinsplit.empty() &&
+             tx.vShieldedSpend.empty() &&
+             tx.vShieldedOutput.empty())
+    {
+        // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+        unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+        size_t nMaxOrphanUsage = (size_t)std::max((int64_t)0, GetArg("-maxorphansize", DEFAULT_MAX_ORPHAN_SIZE)) * 1000;
+
+        // valid stake transactions end up in the orphan tx bin
+        AddOrphanTx(tx, pfrom->GetId(), nMaxOrphanUsage / ORPHAN_PEER_SHARE);
+        unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx, nMaxOrphanUsage);
+        if (nEvicted > 0)
+            LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
+    } else {
+        assert(recentRejects);
+        recentRejects->insert(tx.GetHash());
+
+        if (pfrom->fWhitelisted) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were already in the mempool or rejected from it due
+            // to policy, allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            //
+            // Never relay transactions that we would assign a non-zero DoS
+            // score for, as we expect peers to do the same with us in that
+            // case.
+            int nDoS = 0;
+            if (!state.IsInvalid(nDoS) || nDoS == 0) {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
+                RelayTransaction(tx);
+            } else {
+                LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s (code %d))\n",
+                          tx.GetHash().ToString(), pfrom->id, state.GetRejectReason(), state.GetRejectCode());
+            }
+        }
+    }
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS))
+    {
+        LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
+                 pfrom->id, pfrom->cleanSubVer,
+                 state.GetRejectReason());
+        pfrom->PushMessage("reject", string("tx"), state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        if (nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS);
+    }
+}
+
+/**
+ * Check the scripts and shielded proofs of a relayed transaction without holding cs_main, so that the
+ * signature and shielded verification caches already hold the results when AcceptToMemoryPool runs.
+ * Failures are not acted on here; AcceptToMemoryPool finds them again and rejects the transaction.
+ */
+void static PreVerifyTransaction(const CTransaction& tx)
+{
+    if (tx.IsCoinBase() || tx.IsCoinImport() || tx.IsPegsImport())
+        return;
+
+    std::vector<CTxOut> vSpent;
+    int nHeight;
+    {
+        LOCK2(cs_main, mempool.cs);
+        if (AlreadyHave(CInv(MSG_TX, tx.GetHash())))
+            return;
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            CCoins coins;
+            if (!viewMemPool.GetCoins(txin.prevout.hash, coins) || !coins.IsAvailable(txin.prevout.n))
+                return; // orphan or double spend, left to AcceptToMemoryPool
+            vSpent.push_back(coins.vout[txin.prevout.n]);
+        }
+        nHeight = chainActive.Height() + 1;
+    }
+
+    auto consensusBranchId = CurrentEpochBranchId(nHeight, Params().GetConsensus());
+    PrecomputedTransactionData txdata(tx);
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        // crypto-condition evaluation reads chain state, so it stays under cs_main
+        if (vSpent[i].scriptPubKey.IsPayToCryptoCondition())
+            continue;
+        ServerTransactionSignatureChecker checker(&tx, i, vSpent[i].nValue, true, txdata);
+        if (!VerifyScript(tx.vin[i].scriptSig, vSpent[i].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, checker, consensusBranchId))
+            return;
+    }
+
+    CValidationState state;
+    ContextualCheckShieldedTransaction(tx, state, nHeight, IsInitialBlockDownload);
+}
+
+static boost::mutex csTxPreVerify;
+static boost::condition_variable condTxPreVerify;
+static std::deque<std::pair<CNode*, CTransaction> > queueTxPreVerify;
+
+/** Hand a relayed transaction to the pre-verification threads, false if it must be processed by the caller. */
+bool static QueueTxPreVerify(CNode* pfrom, const CTransaction& tx)
+{
+    if (nTxPreVerifyThreads == 0)
+        return false;
+    {
+        boost::unique_lock<boost::mutex> lock(csTxPreVerify);
+        if (queueTxPreVerify.size() >= MAX_TXPREVERIFY_QUEUE)
+            return false;
+        {
+            LOCK(cs_vNodes);
+            pfrom->AddRef();
+        }
+        queueTxPreVerify.push_back(std::make_pair(pfrom, tx));
+    }
+    condTxPreVerify.notify_one();
+    return true;
+}
+
+void ThreadTxPreVerify()
+{
+    RenameThread("safecoin-txverify");
+    while (true)
+    {
+        std::pair<CNode*, CTransaction> item;
+        {
+            boost::unique_lock<boost::mutex> lock(csTxPreVerify);
+            while (queueTxPreVerify.empty())
+                condTxPreVerify.wait(lock); // interruption point
+            item = queueTxPreVerify.front();
+            queueTxPreVerify.pop_front();
+        }
 
-    if (!vNotFound.empty()) {
-        // Let the peer know that we didn't find what it asked for, so it doesn't
-        // have to wait around forever. Currently only SPV clients actually care
-        // about this message: it's needed when they are recursively walking the
-        // dependencies of relevant unconfirmed transactions. SPV clients want to
-        // do that because they want to know about (and store and rebroadcast and
-        // risk analyze) the dependencies of transactions relevant to them, without
-        // having to download the entire memory pool.
-        pfrom->PushMessage("notfound", vNotFound);
+        CNode* pfrom = item.first;
+        try {
+            if (!pfrom->fDisconnect)
+            {
+                PreVerifyTransaction(item.second);
+                ProcessTransaction(pfrom, item.second);
+            }
+        } catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "ThreadTxPreVerify()");
+        }
+        {
+            LOCK(cs_vNodes);
+            pfrom->Release();
+        }
     }
 }
 
-#include "safecoin_nSPV_defs.h"
-#include "safecoin_nSPV.h"            // shared defines, structs, serdes, purge functions
-#include "safecoin_nSPV_fullnode.h"   // nSPV fullnode handling of the getnSPV request messages
-#include "safecoin_nSPV_superlite.h"  // nSPV superlite client, issuing requests and handling nSPV responses
-#include "safecoin_nSPV_wallet.h"     // nSPV_send and support functions, really all the rest is to support this
+/**
+ * The blocks a BIP157 request asks the filters of, nStartHeight up to stopHash and at most nMaxCount,
+ * false when there is nothing to answer. A peer asking for a filter type we do not serve is dropped.
+ */
+static bool GetBlockFilterRequestBlocks(CNode* pfrom, uint8_t filterType, uint32_t nStartHeight, const uint256& stopHash, uint32_t nMaxCount, std::vector<const CBlockIndex*>& vIndex)
+{
+    if (pblockfilterdb == NULL || filterType != BLOCK_FILTER_BASIC) {
+        LogPrint("net", "peer %d requested unsupported block filter type %d\n", pfrom->id, (int)filterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(stopHash);
+    if (mi == mapBlockIndex.end() || mi->second == NULL) {
+        LogPrint("net", "peer %d requested block filters up to unknown block %s\n", pfrom->id, stopHash.ToString());
+        return false;
+    }
+    const CBlockIndex* pstop = mi->second;
+    if (nStartHeight > (uint32_t)pstop->GetHeight() || (uint32_t)pstop->GetHeight() - nStartHeight >= nMaxCount) {
+        LogPrint("net", "peer %d requested block filters %u to %d, more than %u\n", pfrom->id, nStartHeight, pstop->GetHeight(), nMaxCount);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    vIndex.resize(pstop->GetHeight() - nStartHeight + 1);
+    for (const CBlockIndex* pindex = pstop; pindex != NULL && (uint32_t)pindex->GetHeight() >= nStartHeight; pindex = pindex->pprev)
+        vIndex[pindex->GetHeight() - nStartHeight] = pindex;
+    return true;
+}
 
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
@@ -7427,6 +9142,19 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Ask our outbound peers to push new blocks as compact blocks, inbound ones
+            // only announce them and are asked for a compact block when we want it.
+            bool fAnnounceUsingCMPCTBLOCK = !pfrom->fInbound;
+            uint64_t nCMPCTBLOCKVersion = 1;
+            pfrom->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        }
+
+        if (pfrom->nVersion >= TXRECON_VERSION && GetBoolArg("-txrecon", DEFAULT_TXRECON)) {
+            uint32_t nReconVersion = 1;
+            pfrom->PushMessage("sendrecon", nReconVersion, pfrom->nReconSalt);
+        }
     }
 
 
@@ -7617,7 +9345,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         {
             std::vector<uint8_t> payload;
             vRecv >> payload;
-            safecoin_nSPVreq(pfrom,payload);
+            if ( !QueueNSPVRequest(pfrom,payload) )
+                safecoin_nSPVreq(pfrom,payload);
         }
         return(true);
     }
@@ -7674,8 +9403,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (chainActive.Tip()->GetBlockTime() > GetTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
-                        nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        nodestate->nBlocksInFlight < nodestate->nBlocksInFlightLimit) {
+                        if (nodestate->fSupportsCompact)
+                            vToFetch.push_back(CInv(MSG_CMPCT_BLOCK, inv.hash));
+                        else
+                            vToFetch.push_back(inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -7820,135 +9552,15 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (IsInitialBlockDownload())
             return true;
 
-        vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
         CTransaction tx;
         vRecv >> tx;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
-
-        bool fMissingInputs = false;
-        CValidationState state;
-
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv);
-
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs))
-        {
-            mempool.check(pcoinsTip);
-            RelayTransaction(tx);
-            vWorkQueue.push_back(inv.hash);
-
-            LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s: accepted %s (poolsz %u)\n",
-                     pfrom->id, pfrom->cleanSubVer,
-                     tx.GetHash().ToString(),
-                     mempool.mapTx.size());
-
-            // Recursively process any orphan transactions that depended on this one
-            set<NodeId> setMisbehaving;
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-            {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (set<uint256>::iterator mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
-                {
-                    const uint256& orphanHash = *mi;
-                    const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
-                    NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if (setMisbehaving.count(fromPeer))
-                        continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2))
-                    {
-                        LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx);
-                        vWorkQueue.push_back(orphanHash);
-                        vEraseQueue.push_back(orphanHash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        int nDos = 0;
-                        if (stateDummy.IsInvalid(nDos) && nDos > 0)
-                        {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee/priority
-                        LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                        assert(recentRejects);
-                        recentRejects->insert(orphanHash);
-                    }
-                    mempool.check(pcoinsTip);
-                }
-            }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-            EraseOrphanTx(hash);
-        }
-        // TODO: currently, prohibit joinsplits and shielded spends/outputs from entering mapOrphans
-        else if (fMissingInputs &&
-                 tx.vjoinsplit.empty() &&
-                 tx.vShieldedSpend.empty() &&
-                 tx.vShieldedOutput.empty())
-        {
-            // valid stake transactions end up in the orphan tx bin
-            AddOrphanTx(tx, pfrom->GetId());
-
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-            if (nEvicted > 0)
-                LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
-        } else {
-            assert(recentRejects);
-            recentRejects->insert(tx.GetHash());
-
-            if (pfrom->fWhitelisted) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were already in the mempool or rejected from it due
-                // to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that we would assign a non-zero DoS
-                // score for, as we expect peers to do the same with us in that
-                // case.
-                int nDoS = 0;
-                if (!state.IsInvalid(nDoS) || nDoS == 0) {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
-                    RelayTransaction(tx);
-                } else {
-                    LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s (code %d))\n",
-                              tx.GetHash().ToString(), pfrom->id, state.GetRejectReason(), state.GetRejectCode());
-                }
-            }
-        }
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS))
-        {
-            LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
-                     pfrom->id, pfrom->cleanSubVer,
-                     state.GetRejectReason());
-            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0)
-                Misbehaving(pfrom->GetId(), nDoS);
-        }
+        if (QueueTxPreVerify(pfrom, tx))
+            return true;
+        ProcessTransaction(pfrom, tx);
     }
 
     else if (strCommand == "headers" && !fImporting && !fReindex) // Ignore headers received while importing
@@ -7967,6 +9579,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // the solutions are the expensive part of a header, check them on all cores before taking cs_main
+        if (nScriptCheckThreads && nCount > 1 && ASSETCHAINS_ALGO == ASSETCHAINS_EQUIHASH)
+            CheckEquihashSolutions(headers);
+
         LOCK(cs_main);
 
         if (nCount == 0) {
@@ -8038,6 +9654,346 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CheckBlockIndex();
     }
 
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == 1) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fSupportsCompact = true;
+            State(pfrom->GetId())->fPreferCompact = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == "sendrecon")
+    {
+        uint32_t nReconVersion = 0;
+        uint64_t nRemoteSalt = 0;
+        vRecv >> nReconVersion >> nRemoteSalt;
+        if (nReconVersion == 1 && pfrom->nVersion >= TXRECON_VERSION && GetBoolArg("-txrecon", DEFAULT_TXRECON)) {
+            // both sides derive the same short id keys from the two salts
+            uint64_t nSalt1 = std::min(pfrom->nReconSalt, nRemoteSalt), nSalt2 = std::max(pfrom->nReconSalt, nRemoteSalt);
+            uint256 hashKeys = Hash(BEGIN(nSalt1), END(nSalt1), BEGIN(nSalt2), END(nSalt2));
+            LOCK(pfrom->cs_inventory);
+            pfrom->nReconK0 = ReadLE64(hashKeys.begin());
+            pfrom->nReconK1 = ReadLE64(hashKeys.begin() + 8);
+            pfrom->fTxRecon = true;
+        }
+    }
+
+
+    else if (strCommand == "reqrecon")
+    {
+        // The short ids of the transactions our outbound peer would announce to us. Ours that
+        // it lacks are announced to it, the ones we lack are asked for with reconcildiff, and
+        // the ones we both have are not announced at all.
+        vector<uint32_t> vShortIDs;
+        vRecv >> vShortIDs;
+        if (!pfrom->fTxRecon || !pfrom->fInbound)
+            return true;
+        if (vShortIDs.size() > MAX_RECON_SET_SIZE)
+        {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            return error("peer %d sent an oversized reqrecon, size = %u", pfrom->id, vShortIDs.size());
+        }
+
+        std::set<uint32_t> setTheirs(vShortIDs.begin(), vShortIDs.end());
+        vector<CInv> vInv;
+        vector<uint32_t> vWant;
+        {
+            LOCK(pfrom->cs_inventory);
+            std::set<uint32_t> setOurs;
+            BOOST_FOREACH(const uint256& hash, pfrom->setReconTx) {
+                CInv inv(MSG_TX, hash);
+                uint32_t nShortID = pfrom->GetReconShortID(hash);
+                setOurs.insert(nShortID);
+                if (pfrom->setInventoryKnown.insert(inv).second && setTheirs.count(nShortID) == 0)
+                    vInv.push_back(inv);
+            }
+            pfrom->setReconTx.clear();
+            BOOST_FOREACH(uint32_t nShortID, setTheirs) {
+                if (setOurs.count(nShortID) == 0)
+                    vWant.push_back(nShortID);
+            }
+        }
+        LogPrint("net", "reconciled %u txs with peer=%d, announcing %u, asking for %u\n", vShortIDs.size(), pfrom->id, vInv.size(), vWant.size());
+        if (!vInv.empty())
+            pfrom->PushMessage("inv", vInv);
+        pfrom->PushMessage("reconcildiff", vWant);
+    }
+
+
+    else if (strCommand == "reconcildiff")
+    {
+        // The short ids of our last reqrecon the peer does not have, the rest it has
+        vector<uint32_t> vShortIDs;
+        vRecv >> vShortIDs;
+        if (vShortIDs.size() > MAX_RECON_SET_SIZE)
+        {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            return error("peer %d sent an oversized reconcildiff, size = %u", pfrom->id, vShortIDs.size());
+        }
+
+        vector<CInv> vInv;
+        {
+            LOCK(pfrom->cs_inventory);
+            BOOST_FOREACH(uint32_t nShortID, vShortIDs) {
+                std::map<uint32_t, uint256>::iterator it = pfrom->mapReconSent.find(nShortID);
+                if (it == pfrom->mapReconSent.end())
+                    continue;
+                CInv inv(MSG_TX, it->second);
+                if (pfrom->setInventoryKnown.insert(inv).second)
+                    vInv.push_back(inv);
+                pfrom->mapReconSent.erase(it);
+            }
+            for (std::map<uint32_t, uint256>::iterator it = pfrom->mapReconSent.begin(); it != pfrom->mapReconSent.end(); ++it)
+                pfrom->setInventoryKnown.insert(CInv(MSG_TX, it->second));
+            pfrom->mapReconSent.clear();
+            pfrom->nReconSentTime = 0;
+        }
+        if (!vInv.empty())
+            pfrom->PushMessage("inv", vInv);
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        TRACE3(net, cmpctblock_received, cmpctblock.header.GetHash().begin(), pfrom->id, cmpctblock.BlockTxCount());
+
+        CBlock block;
+        bool fBlockReconstructed = false;
+        {
+            LOCK(cs_main);
+
+            if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+                // Doesn't connect, ask for the headers in between. Its block comes after them.
+                if (!IsInitialBlockDownload())
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256());
+                return true;
+            }
+
+            CBlockIndex *pindex = NULL;
+            CValidationState state;
+            int32_t futureblock;
+            if (!AcceptBlockHeader(&futureblock, cmpctblock.header, state, &pindex) || pindex == NULL) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && futureblock == 0) {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS);
+                    return error("invalid header received in cmpctblock");
+                }
+                return true;
+            }
+
+            const uint256 hash = pindex->GetBlockHash();
+            UpdateBlockAvailability(pfrom->GetId(), hash);
+            pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hash));
+
+            // Only a block that would become our new tip is worth rebuilding
+            if ((pindex->nStatus & BLOCK_HAVE_DATA) || IsInitialBlockDownload() || !(pindex->chainPower > chainActive.Tip()->chainPower))
+                return true;
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+            bool fInFlightFromOther = (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first != pfrom->GetId());
+
+            std::shared_ptr<PartiallyDownloadedBlock> partialBlock(new PartiallyDownloadedBlock(&mempool));
+            ReadStatus status = partialBlock->InitData(cmpctblock);
+            if (status == READ_STATUS_INVALID) {
+                if (!fInFlightFromOther)
+                    MarkBlockAsReceived(hash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us an invalid cmpctblock", pfrom->id);
+            }
+
+            BlockTransactionsRequest req;
+            if (status == READ_STATUS_OK) {
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!partialBlock->IsTxAvailable(i))
+                        req.indexes.push_back(i);
+                }
+                if (req.indexes.empty())
+                    status = partialBlock->FillBlock(block, std::vector<CTransaction>());
+            }
+
+            if (status == READ_STATUS_OK && req.indexes.empty()) {
+                // Everything was in our mempool, this is as good as a received block
+                MarkBlockAsInFlight(pfrom->GetId(), hash, chainparams.GetConsensus(), pindex);
+                fBlockReconstructed = true;
+            } else if (!fInFlightFromOther) {
+                MarkBlockAsInFlight(pfrom->GetId(), hash, chainparams.GetConsensus(), pindex);
+                if (status == READ_STATUS_OK) {
+                    req.blockhash = hash;
+                    State(pfrom->GetId())->partialBlock = partialBlock;
+                    pfrom->PushMessage("getblocktxn", req);
+                } else {
+                    // Short id collision, fall back to the full block
+                    pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hash)));
+                }
+            }
+        }
+
+        if (fBlockReconstructed)
+            ProcessReconstructedBlock(pfrom, strCommand, block);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+        if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        if (!chainActive.Contains(mi->second) || chainActive.Height() - mi->second->GetHeight() > MAX_BLOCKTXN_DEPTH) {
+            // Not worth it for an older block, send it in full with the checks of a getdata
+            LogPrint("net", "peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            ProcessGetData(pfrom);
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, mi->second, 1))
+            assert(!"cannot load block from disk");
+
+        BlockTransactions resp(req.blockhash, req.indexes.size());
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "getcfilters")
+    {
+        uint8_t filterType;
+        uint32_t nStartHeight;
+        uint256 stopHash;
+        vRecv >> filterType >> nStartHeight >> stopHash;
+
+        std::vector<const CBlockIndex*> vIndex;
+        if (!GetBlockFilterRequestBlocks(pfrom, filterType, nStartHeight, stopHash, MAX_GETCFILTERS_SIZE, vIndex))
+            return true;
+        BOOST_FOREACH(const CBlockIndex* pindex, vIndex) {
+            CBlockFilterEntry entry;
+            if (!pblockfilterdb->ReadFilter(pindex->GetBlockHash(), entry)) {
+                LogPrint("net", "peer %d requested the filter of %s, which is not indexed yet\n", pfrom->id, pindex->GetBlockHash().ToString());
+                return true;
+            }
+            pfrom->PushMessage("cfilter", filterType, pindex->GetBlockHash(), entry.filter);
+        }
+    }
+
+
+    else if (strCommand == "getcfheaders")
+    {
+        uint8_t filterType;
+        uint32_t nStartHeight;
+        uint256 stopHash;
+        vRecv >> filterType >> nStartHeight >> stopHash;
+
+        std::vector<const CBlockIndex*> vIndex;
+        if (!GetBlockFilterRequestBlocks(pfrom, filterType, nStartHeight, stopHash, MAX_GETCFHEADERS_SIZE, vIndex))
+            return true;
+        uint256 prevHeader;
+        CBlockFilterEntry entry;
+        if (vIndex[0]->pprev != NULL) {
+            if (!pblockfilterdb->ReadFilter(vIndex[0]->pprev->GetBlockHash(), entry))
+                return true;
+            prevHeader = entry.header;
+        }
+        std::vector<uint256> vFilterHashes;
+        vFilterHashes.reserve(vIndex.size());
+        BOOST_FOREACH(const CBlockIndex* pindex, vIndex) {
+            if (!pblockfilterdb->ReadFilter(pindex->GetBlockHash(), entry))
+                return true;
+            vFilterHashes.push_back(entry.hash);
+        }
+        pfrom->PushMessage("cfheaders", filterType, stopHash, prevHeader, vFilterHashes);
+    }
+
+
+    else if (strCommand == "getcfcheckpt")
+    {
+        uint8_t filterType;
+        uint256 stopHash;
+        vRecv >> filterType >> stopHash;
+
+        // the stop block alone passes the checks, the headers are of every CFCHECKPT_INTERVAL-th block below it
+        const CBlockIndex* pstop = NULL;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(stopHash);
+            if (mi != mapBlockIndex.end())
+                pstop = mi->second;
+        }
+        std::vector<const CBlockIndex*> vIndex;
+        if (!GetBlockFilterRequestBlocks(pfrom, filterType, pstop != NULL ? pstop->GetHeight() : 0, stopHash, 1, vIndex))
+            return true;
+        std::vector<uint256> vHeaders;
+        CBlockFilterEntry entry;
+        for (int h = CFCHECKPT_INTERVAL; h <= pstop->GetHeight(); h += CFCHECKPT_INTERVAL) {
+            if (!pblockfilterdb->ReadFilter(pstop->GetAncestor(h)->GetBlockHash(), entry))
+                return true;
+            vHeaders.push_back(entry.header);
+        }
+        pfrom->PushMessage("cfcheckpt", filterType, stopHash, vHeaders);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        bool fBlockRead = false;
+        {
+            LOCK(cs_main);
+
+            CNodeState *nodestate = State(pfrom->GetId());
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(resp.blockhash);
+            if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId() ||
+                !nodestate->partialBlock || nodestate->partialBlock->header.GetHash() != resp.blockhash) {
+                LogPrint("net", "peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            std::shared_ptr<PartiallyDownloadedBlock> partialBlock;
+            partialBlock.swap(nodestate->partialBlock);
+            ReadStatus status = partialBlock->FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us invalid compact block/non-matching block transactions", pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Short id collision, fall back to the full block. It stays in flight from this peer.
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, resp.blockhash)));
+            } else
+                fBlockRead = true;
+        }
+
+        if (fBlockRead)
+            ProcessReconstructedBlock(pfrom, strCommand, block);
+    }
+
+
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         CBlock block;
@@ -8045,6 +10001,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         CInv inv(MSG_BLOCK, block.GetHash());
         LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+        TRACE3(net, block_received, inv.hash.begin(), pfrom->id, block.vtx.size());
 
         pfrom->AddInventoryKnown(inv);
 
@@ -8480,33 +10437,39 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         // Message: inventory
         //
+        int64_t nNow = GetTimeMicros();
         vector<CInv> vInv;
         vector<CInv> vInvWait;
         {
             LOCK(pto->cs_inventory);
+            // tx invs go out in batches at exponentially distributed times per peer, which hides
+            // where a transaction came from and saves the many small inv messages of a busy mempool
+            bool fSendTxInv = pto->fWhitelisted;
+            if (pto->nNextInvSend < nNow) {
+                fSendTxInv = true;
+                pto->nNextInvSend = PoissonNextSend(nNow, pto->fInbound ? INVENTORY_BROADCAST_INTERVAL : OUTBOUND_INVENTORY_BROADCAST_INTERVAL);
+            }
             vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
             BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
             {
                 if (pto->setInventoryKnown.count(inv))
                     continue;
 
-                // trickle out tx inv to protect privacy
-                if (inv.type == MSG_TX && !fSendTrickle)
+                if (inv.type == MSG_TX)
                 {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = ArithToUint256(UintToArith256(inv.hash) ^ UintToArith256(hashSalt));
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((UintToArith256(hashRand) & 3) != 0);
-
-                    if (fTrickleWait)
+                    if (!fSendTxInv)
                     {
                         vInvWait.push_back(inv);
                         continue;
                     }
+                    // not worth announcing when mined or evicted since it was queued
+                    if (!mempool.exists(inv.hash))
+                        continue;
+                    if (pto->fTxRecon && pto->setReconTx.size() < MAX_RECON_SET_SIZE)
+                    {
+                        pto->setReconTx.insert(inv.hash);
+                        continue;
+                    }
                 }
 
                 // returns true if wasn't already contained in the set
@@ -8520,19 +10483,68 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                     }
                 }
             }
-            pto->vInventoryToSend = vInvWait;
+            pto->vInventoryToSend.swap(vInvWait);
+
+            // An unanswered reqrecon falls back to announcing its transactions
+            if (pto->nReconSentTime && pto->nReconSentTime < nNow - 1000000LL * RECON_TIMEOUT)
+            {
+                for (std::map<uint32_t, uint256>::iterator it = pto->mapReconSent.begin(); it != pto->mapReconSent.end(); ++it)
+                {
+                    CInv inv(MSG_TX, it->second);
+                    if (pto->setInventoryKnown.insert(inv).second)
+                        vInv.push_back(inv);
+                }
+                pto->mapReconSent.clear();
+                pto->nReconSentTime = 0;
+            }
+
+            // Outbound peers are sent our set of short ids at each batch, see "reqrecon". Suspected
+            // collisions are announced with inv.
+            if (fSendTxInv && pto->fTxRecon && !pto->fInbound && pto->nReconSentTime == 0)
+            {
+                vector<uint32_t> vShortIDs;
+                vShortIDs.reserve(pto->setReconTx.size());
+                BOOST_FOREACH(const uint256& hash, pto->setReconTx)
+                {
+                    CInv inv(MSG_TX, hash);
+                    if (pto->setInventoryKnown.count(inv))
+                        continue;
+                    uint32_t nShortID = pto->GetReconShortID(hash);
+                    if (pto->mapReconSent.insert(std::make_pair(nShortID, hash)).second)
+                        vShortIDs.push_back(nShortID);
+                    else if (pto->setInventoryKnown.insert(inv).second)
+                        vInv.push_back(inv);
+                }
+                pto->setReconTx.clear();
+                pto->nReconSentTime = nNow;
+                pto->PushMessage("reqrecon", vShortIDs);
+            }
         }
         if (!vInv.empty())
             pto->PushMessage("inv", vInv);
 
         // Detect whether we're stalling
-        int64_t nNow = GetTimeMicros();
         if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
             // Stalling only triggers when the block download window cannot move. During normal steady state,
-            // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
-            // should only happen during initial block download.
-            LogPrintf("Peer=%d is stalling block download, disconnecting\n", pto->id);
-            pto->fDisconnect = true;
+            // the download window should be much larger than the to-be-downloaded set of blocks, so this
+            // should only happen during initial block download. The stalled blocks are asked from other peers
+            // right away and the staller gets fewer slots; one that keeps stalling with the fewest is dropped.
+            state.nStalls++;
+            if (state.nBlocksInFlightLimit > MIN_BLOCKS_IN_TRANSIT_PER_PEER) {
+                state.nBlocksInFlightLimit = std::max(MIN_BLOCKS_IN_TRANSIT_PER_PEER, state.nBlocksInFlightLimit / 2);
+                int nReleased = ReleaseBlocksInFlight(pto->GetId());
+                state.nStallingSince = 0;
+                LogPrint("net", "Peer=%d is stalling block download, re-requesting %d blocks elsewhere, limit now %d\n", pto->id, nReleased, state.nBlocksInFlightLimit);
+            } else {
+                LogPrintf("Peer=%d is stalling block download, disconnecting\n", pto->id);
+                pto->fDisconnect = true;
+            }
+            // A window held up by one slow peer while validation keeps up with the others is too small
+            if (IsInitialBlockDownload() && nBlockDownloadWindow < MAX_BLOCK_DOWNLOAD_WINDOW &&
+                pcoinsTip->DynamicMemoryUsage() < nCoinCacheUsage / 2) {
+                nBlockDownloadWindow = std::min(MAX_BLOCK_DOWNLOAD_WINDOW, nBlockDownloadWindow * 2);
+                LogPrint("net", "Block download window grown to %u\n", nBlockDownloadWindow);
+            }
         }
         // In case there is a block that has been in flight from this peer for (2 + 0.5 * N) times the block interval
         // (with N the number of validated blocks that were in flight at the time it was requested), disconnect due to
@@ -8562,10 +10574,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         static uint256 zero;
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < state.nBlocksInFlightLimit) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            FindNextBlocksToDownload(pto->GetId(), state.nBlocksInFlightLimit - state.nBlocksInFlight, vToDownload, staller);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
                 vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
@@ -45,8 +45,10 @@
 #include "uint256.h"
 
 #include <algorithm>
+#include <atomic>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -57,6 +59,8 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
+class CCoinsViewDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
@@ -86,7 +90,19 @@ static const unsigned int MAX_STANDARD_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 /** Default for -minrelaytxfee, minimum relay fee for transactions */
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 100;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
-static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 1000;
+/** Default for -maxorphansize, maximum kilobytes of memory used by orphan transactions */
+static const unsigned int DEFAULT_MAX_ORPHAN_SIZE = 5000;
+/** Largest orphan transaction kept, in serialized bytes */
+static const unsigned int MAX_ORPHAN_TX_SIZE = 5000;
+/** A single peer's orphans may use at most 1/ORPHAN_PEER_SHARE of -maxorphansize */
+static const unsigned int ORPHAN_PEER_SHARE = 4;
+/** Seconds an orphan transaction waits for its parents before it is dropped */
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum seconds between sweeps for expired orphan transactions */
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
 /** Default for -txexpirydelta, in number of blocks */
 static const unsigned int DEFAULT_TX_EXPIRY_DELTA = 20;
 /** The maximum size of a blk?????.dat file (since 0.8) */
@@ -100,9 +116,19 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Default for -txpreverify, checking relayed transactions' signatures and proofs before taking cs_main */
+static const bool DEFAULT_TXPREVERIFY = true;
+/** Relayed transactions waiting for pre-verification, past which they are handled on the message thread */
+static const unsigned int MAX_TXPREVERIFY_QUEUE = 1000;
+/** Number of blocks that can be requested at any given time from a single peer, before its download speed is known. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
-/** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
+/** Bounds of the per-peer in-flight limit, which adapts to how fast the peer delivers the blocks it is asked for. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER = 64;
+/** A peer delivering requested blocks within this many microseconds with its in-flight limit reached gets a higher limit. */
+static const int64_t BLOCK_DOWNLOAD_TARGET_LATENCY = 2 * 1000000;
+/** Timeout in seconds during which a peer must stall block download progress before its blocks are requested elsewhere.
+ *  A peer that keeps stalling at the minimum in-flight limit is disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
@@ -110,12 +136,16 @@ static const unsigned int MAX_HEADERS_RESULTS = 160;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
- *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
-static unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+ *  harder). The window starts here and grows during initial block download when a stall holds it up
+ *  while the coins cache still has room, up to MAX_BLOCK_DOWNLOAD_WINDOW. */
+static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+static const unsigned int MAX_BLOCK_DOWNLOAD_WINDOW = 8192;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Share (in percent) of the coins cache that stays resident when it is written to disk. */
+static const unsigned int COINS_CACHE_KEEP_PERCENT = 50;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
@@ -127,7 +157,11 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
+static const bool DEFAULT_COMPRESSBLOCKS = false;
+/** Set in the size field of a blk*.dat record whose block is stored compressed */
+static const unsigned int BLOCK_RECORD_COMPRESSED = 0x80000000;
 static const bool DEFAULT_FIXIBD = true;
+static const bool DEFAULT_VERIFYINBACKGROUND = false;
 
 // Sanity check the magic numbers when we change them
 //BOOST_STATIC_ASSERT(DEFAULT_BLOCK_MAX_SIZE <= MAX_BLOCK_SIZE());
@@ -157,10 +191,20 @@ extern bool fExperimentalMode;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nTxPreVerifyThreads;
 extern bool fTxIndex;
+extern bool fCompressBlocks;
+extern bool fAddressIndex;
+/** Whether the CC index, kept along with the address index, covers the whole chain */
+extern bool fCCIndex;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Block whose ancestors have their script and proof checks skipped in ConnectBlock, null for none (-assumevalid) */
+extern uint256 hashAssumeValid;
+/** Set when the background block database check found corruption; mining and staking stop */
+extern std::atomic<bool> fBlockDBCorrupt;
 // TODO: remove this flag by structuring our code such that
 // it is unneeded for testing
 extern bool fCoinbaseEnforcedProtectionEnabled;
@@ -180,6 +224,10 @@ static const uint64_t nMinDiskSpace = 52428800;
 extern bool fHavePruned;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
+/** Default for -prunetxarchive */
+static const bool DEFAULT_PRUNETXARCHIVE = false;
+/** True if the transactions of pruned blocks are kept for the indexes (-prunetxarchive). */
+extern bool fPruneTxArchive;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
@@ -229,6 +277,12 @@ bool InitBlockIndex();
 bool LoadBlockIndex();
 /** Unload database information */
 void UnloadBlockIndex();
+/**
+ * Fill the empty coin database pcoinsdb from a dumptxoutset file. The blocks up
+ * to the snapshot have to be on disk, and the snapshot block has to build on the
+ * notarization recorded in the file and agree with the latest one this node knows.
+ */
+bool LoadTxOutSetSnapshot(CCoinsViewDB *pcoinsdb, const boost::filesystem::path &path, std::string &strError);
 /** Process protocol messages received from a given node */
 bool ProcessMessages(CNode* pfrom);
 /**
@@ -240,6 +294,14 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the thread checking the Equihash solutions of received headers */
+void ThreadEquihashCheck();
+/** Run an instance of the thread checking the shielded transactions of a block */
+void ThreadShieldedCheck();
+/** Run an instance of the relayed transaction pre-verification thread */
+void ThreadTxPreVerify();
+/** Run the -checkblocks verification of a node started with -verifyinbackground */
+void ThreadVerifyDB(int nCheckLevel, int nCheckDepth);
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -252,6 +314,11 @@ int IsNotInSync();
 std::string GetWarnings(const std::string& strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock, bool fAllowSlow = false);
+/**
+ * Active chain heights of the transactions in vTxids, through the txindex. Every block is read once, however many
+ * of the transactions it holds, the ones the txindex does not place in the active chain are left out of mapHeights.
+ */
+void GetTxIndexHeights(const std::vector<uint256> &vTxids, std::map<uint256, int> &mapHeights);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock = NULL);
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
@@ -288,6 +355,12 @@ void Misbehaving(NodeId nodeid, int howmuch);
 void FlushStateToDisk();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
+/**
+ * Output count, amount and MuHash3072 of the unspent output set at the tip. The first call
+ * scans the coin database, later ones finalize the hash that ConnectTip and DisconnectTip
+ * keep up to date. fScanned tells whether nTransactions and nSerializedSize were counted.
+ */
+bool GetUTXOMuHashStats(CCoinsStats &stats, bool &fScanned);
 
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
@@ -299,6 +372,11 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlocksInFlightLimit;
+    uint64_t nBlocksDownloaded;
+    int64_t nAvgBlockLatency;  //! microseconds from getdata to block
+    uint64_t nBlockBytesPerSec;
+    int nStalls;
 };
 
 struct CTimestampIndexIteratorKey {
@@ -499,6 +577,97 @@ struct  CAddressUnspentValue {
     }
 };
 
+/** CC index key, the transactions of a contract by the eval code and function id opening their opret */
+struct CCIndexKey {
+    uint8_t evalcode;
+    uint8_t funcid;
+    uint256 txhash;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 34;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, evalcode);
+        ser_writedata8(s, funcid);
+        txhash.Serialize(s);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        evalcode = ser_readdata8(s);
+        funcid = ser_readdata8(s);
+        txhash.Unserialize(s);
+    }
+
+    CCIndexKey(uint8_t evalcodeIn, uint8_t funcidIn, uint256 txid) {
+        evalcode = evalcodeIn;
+        funcid = funcidIn;
+        txhash = txid;
+    }
+
+    CCIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        evalcode = 0;
+        funcid = 0;
+        txhash.SetNull();
+    }
+};
+
+struct CCIndexIteratorKey {
+    uint8_t evalcode;
+    uint8_t funcid;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 2;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, evalcode);
+        ser_writedata8(s, funcid);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        evalcode = ser_readdata8(s);
+        funcid = ser_readdata8(s);
+    }
+
+    CCIndexIteratorKey(uint8_t evalcodeIn, uint8_t funcidIn) {
+        evalcode = evalcodeIn;
+        funcid = funcidIn;
+    }
+};
+
+/** The opret of a CC index entry, so listing a contract's transactions needs none of them read */
+struct CCIndexValue {
+    int blockHeight;
+    CScript opret;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(blockHeight);
+        READWRITE(*(CScriptBase*)(&opret));
+    }
+
+    CCIndexValue(int height, CScript opretIn) {
+        blockHeight = height;
+        opret = opretIn;
+    }
+
+    CCIndexValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        blockHeight = 0;
+        opret.clear();
+    }
+};
+
 struct CAddressIndexKey {
     unsigned int type;
     uint160 hashBytes;
@@ -633,6 +802,77 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** Running total of an address, the sum of its address index deltas */
+struct CAddressBalanceValue {
+    CAmount nBalance;
+    int64_t nUtxos; //! unspent outputs with a non-zero value
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nBalance);
+        READWRITE(nUtxos);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nBalance = 0;
+        nUtxos = 0;
+    }
+
+    bool IsNull() const {
+        return nBalance == 0 && nUtxos == 0;
+    }
+};
+
+/** Addresses ordered by balance, largest first */
+struct CAddressBalanceRankKey {
+    CAmount nBalance;
+    unsigned int type;
+    uint160 hashBytes;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 29;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        // big endian complement, so iterating the keys forward meets the largest balance first
+        uint64_t inverted = ~(uint64_t)nBalance;
+        ser_writedata32be(s, inverted >> 32);
+        ser_writedata32be(s, inverted & 0xffffffff);
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        uint64_t inverted = (uint64_t)ser_readdata32be(s) << 32;
+        inverted |= ser_readdata32be(s);
+        nBalance = (CAmount)~inverted;
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s);
+    }
+
+    CAddressBalanceRankKey(CAmount balance, unsigned int addressType, uint160 addressHash) {
+        nBalance = balance;
+        type = addressType;
+        hashBytes = addressHash;
+    }
+
+    CAddressBalanceRankKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nBalance = 0;
+        type = 0;
+        hashBytes.SetNull();
+    }
+};
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -803,20 +1043,50 @@ bool GetAddressIndex(uint160 addressHash, int type,
                      int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+bool GetAddressUnspent(const std::vector<std::pair<int, uint160> > &addresses,
+                       std::map<std::pair<int, uint160>, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > &unspentOutputs);
+bool GetAddressIndex(uint160 addressHash, int type, const CAddressIndexKey *pAfter, size_t nMax,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, bool &fMore,
+                     bool fReverse = false, int start = 0, int end = 0);
+bool GetAddressUnspent(uint160 addressHash, int type, const CAddressUnspentKey *pAfter, size_t nMax,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, bool &fMore);
+/** The chain's transactions of a contract with the given opret eval code and function id, false if there is no complete CC index */
+bool GetCCIndex(uint8_t evalcode, uint8_t funcid, std::vector<std::pair<CCIndexKey, CCIndexValue> > &ccIndex);
+/** Add the CC index entry of tx, one if it has CC outputs and an opret naming a contract */
+void GetCCIndexEntries(const CTransaction &tx, int nHeight, std::vector<std::pair<CCIndexKey, CCIndexValue> > &ccIndex);
+/** Address index type of scriptPubKey (0 if it has none), with the solutions to hash into index keys */
+int8_t GetAddressType(const CScript &scriptPubKey, CTxDestination &vDest, txnouttype &txType, std::vector<std::vector<unsigned char> > &vSols);
 
 /** Functions for disk access for blocks */
+/**
+ * Payload of the blk*.dat record for block: its serialization or, with
+ * -compressblocks and if that is smaller, the uncompressed size followed by
+ * the CompressData output. Returns the record's size field value.
+ */
+unsigned int SerializeBlockRecord(const CBlock& block, std::vector<unsigned char>& vRecord);
+bool WriteBlockToDisk(const std::vector<unsigned char>& vRecord, unsigned int nRecordSize, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos,bool checkPOW);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW);
+/**
+ * Read only the header, the coinbase and with fLastTx the last transaction of the block at
+ * pindex, for the helpers that look at nothing else. block.vtx holds one or two transactions.
+ */
+bool ReadBlockEndsFromDisk(CBlock& block, const CBlockIndex* pindex, bool fLastTx);
+/** Read the undo data ConnectBlock wrote for pindex */
+bool ReadBlockUndoFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 bool PruneOneBlockFile(bool tempfile, const int fileNumber);
 
 /** Functions for validating blocks and updating the block tree */
 
+struct CDisconnectBatch;
+
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. With pbatch the address, CC and
+ *  spent index updates are added to it instead of being written. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, CDisconnectBatch* pbatch = NULL);
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins */
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck = false,bool fCheckPOW = false);
@@ -918,6 +1188,12 @@ public:
     bool VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
 };
 
+/**
+ * VerifyDB for a node that is already running: cs_main is only held per block, and the coins
+ * check of level 3 stops once the tip moves. Level 4 would write to the indexes and is not run.
+ */
+bool VerifyDBInBackground(int nCheckLevel, int nCheckDepth);
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
@@ -930,6 +1206,31 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/**
+ * The tip of chainActive and what the status RPCs report about it, published whole
+ * by UpdateTip so that they can be answered without waiting for cs_main.
+ */
+struct CChainTipSnapshot
+{
+    const CBlockIndex* pindex;  //! block index entries stay allocated while running
+    int nHeight;
+    uint256 hashBlock;
+    int64_t nTime;
+    int64_t nMedianTimePast;
+    uint32_t nBits;
+    uint32_t nBitsNext;         //! work required of the next block
+    uint64_t nChainTx;
+    int nNotarizedHeight;
+    int nPrevMoMHeight;
+    uint256 hashNotarized;
+    uint256 txidNotarized;
+    boost::optional<CAmount> nChainSproutValue;
+    boost::optional<CAmount> nChainSaplingValue;
+};
+
+/** The snapshot of the last tip set by UpdateTip, NULL before the first one */
+std::shared_ptr<const CChainTipSnapshot> GetChainTipSnapshot();
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
@@ -75,6 +75,12 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+CMerkleBlock::CMerkleBlock(const CBlockHeader& header, const std::vector<uint256>& vMerkleTree, unsigned int nTransactions, unsigned int nMatch) : header(header)
+{
+    vMatchedTxn.push_back(make_pair(nMatch, vMerkleTree[nMatch]));
+    txn = CPartialMerkleTree(vMerkleTree, nTransactions, nMatch);
+}
+
 uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid) {
     if (height == 0) {
         // hash at height 0 is the txid itself
@@ -110,6 +116,19 @@ void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const st
     }
 }
 
+void CPartialMerkleTree::TraverseAndBuildSingle(int height, unsigned int pos, const std::vector<uint256> &vMerkleTree, const std::vector<unsigned int> &vLevelStart, unsigned int nMatch) {
+    // only the nodes on the path from the root to the matched leaf are parents of a match
+    bool fParentOfMatch = (pos == (nMatch >> height));
+    vBits.push_back(fParentOfMatch);
+    if (height==0 || !fParentOfMatch) {
+        vHash.push_back(vMerkleTree[vLevelStart[height] + pos]);
+    } else {
+        TraverseAndBuildSingle(height-1, pos*2, vMerkleTree, vLevelStart, nMatch);
+        if (pos*2+1 < CalcTreeWidth(height-1))
+            TraverseAndBuildSingle(height-1, pos*2+1, vMerkleTree, vLevelStart, nMatch);
+    }
+}
+
 uint256 CPartialMerkleTree::TraverseAndExtract(int height, unsigned int pos, unsigned int &nBitsUsed, unsigned int &nHashUsed, std::vector<uint256> &vMatch) {
     if (nBitsUsed >= vBits.size()) {
         // overflowed the bits array - failure
@@ -160,6 +179,23 @@ CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const
     TraverseAndBuild(nHeight, 0, vTxid, vMatch);
 }
 
+CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vMerkleTree, unsigned int nTransactions, unsigned int nMatch) : nTransactions(nTransactions), fBad(false) {
+    // reset state
+    vBits.clear();
+    vHash.clear();
+
+    // calculate height of tree and where each level starts in vMerkleTree
+    std::vector<unsigned int> vLevelStart(1, 0);
+    int nHeight = 0;
+    while (CalcTreeWidth(nHeight) > 1) {
+        vLevelStart.push_back(vLevelStart.back() + CalcTreeWidth(nHeight));
+        nHeight++;
+    }
+
+    // traverse the path to the matched leaf
+    TraverseAndBuildSingle(nHeight, 0, vMerkleTree, vLevelStart, nMatch);
+}
+
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
 
 uint256 CPartialMerkleTree::ExtractMatches(std::vector<uint256> &vMatch) {
@@ -88,6 +88,9 @@ protected:
     /** recursive function that traverses tree nodes, storing the data as bits and hashes */
     void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /** same traversal for a single matched leaf, reading node hashes from a complete tree as built by BuildMerkleTree */
+    void TraverseAndBuildSingle(int height, unsigned int pos, const std::vector<uint256> &vMerkleTree, const std::vector<unsigned int> &vLevelStart, unsigned int nMatch);
+
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
      * it returns the hash of the respective node.
@@ -122,6 +125,9 @@ public:
     /** Construct a partial merkle tree from a list of transaction ids, and a mask that selects a subset of them */
     CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /** Construct a partial merkle tree matching only the leaf at nMatch, from a complete tree as built by BuildMerkleTree, in O(log n) */
+    CPartialMerkleTree(const std::vector<uint256> &vMerkleTree, unsigned int nTransactions, unsigned int nMatch);
+
     CPartialMerkleTree();
 
     /**
@@ -157,6 +163,9 @@ public:
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids);
 
+    // Create from a block header and its complete merkle tree, matching the single transaction at nMatch
+    CMerkleBlock(const CBlockHeader& header, const std::vector<uint256>& vMerkleTree, unsigned int nTransactions, unsigned int nMatch);
+
     CMerkleBlock() {}
 
     ADD_SERIALIZE_METHODS;
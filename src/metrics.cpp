@@ -21,7 +21,11 @@
 
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "httpserver.h"
 #include "main.h"
+#include "net.h"
+#include "script/sigcache.h"
+#include "txmempool.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utiltime.h"
@@ -91,10 +95,22 @@ boost::synchronized_value<int64_t> nNodeStartTime;
 boost::synchronized_value<int64_t> nNextRefresh;
 int64_t nHashCount;
 AtomicCounter transactionsValidated;
+AtomicCounter nspvRequests;
 AtomicCounter ehSolverRuns;
 AtomicCounter solutionTargetChecks;
+AtomicCounter minerThreadTargetChecks[MAX_MINER_THREAD_METRICS];
 static AtomicCounter minedBlocks;
 AtomicTimer miningTimer;
+ValidationPhaseTimer validationPhaseTimes[MAX_VALIDATION_PHASES];
+
+const char* ValidationPhaseName(int phase)
+{
+    static const char* const names[MAX_VALIDATION_PHASES] = {
+        "readblock", "connect", "checkpow", "verify", "index", "callbacks", "safecoin",
+        "flush", "chainstate", "postconnect", "prices", "snapshot", "total"
+    };
+    return phase >= 0 && phase < MAX_VALIDATION_PHASES ? names[phase] : "unknown";
+}
 CCriticalSection cs_metrics;
 
 double AtomicTimer::rate(const int64_t count)
@@ -117,6 +133,76 @@ static bool loaded = false;
 
 extern int64_t GetNetworkHashPS(int lookup, int height);
 
+std::string NodeMetricsToPrometheus()
+{
+    std::string strOut;
+    std::shared_ptr<const CChainTipSnapshot> tip = GetChainTipSnapshot();
+    if (tip) {
+        strOut += "# TYPE safecoin_block_height gauge\n";
+        strOut += strprintf("safecoin_block_height %d\n", tip->nHeight);
+        strOut += "# TYPE safecoin_block_time_seconds gauge\n";
+        strOut += strprintf("safecoin_block_time_seconds %d\n", tip->nTime);
+        strOut += "# TYPE safecoin_notarized_height gauge\n";
+        strOut += strprintf("safecoin_notarized_height %d\n", tip->nNotarizedHeight);
+    }
+
+    strOut += "# TYPE safecoin_mempool_transactions gauge\n";
+    strOut += strprintf("safecoin_mempool_transactions %u\n", mempool.size());
+    strOut += "# TYPE safecoin_mempool_bytes gauge\n";
+    strOut += strprintf("safecoin_mempool_bytes %u\n", mempool.GetTotalTxSize());
+    strOut += "# TYPE safecoin_mempool_usage_bytes gauge\n";
+    strOut += strprintf("safecoin_mempool_usage_bytes %u\n", mempool.DynamicMemoryUsage());
+
+    size_t nInbound = 0, nOutbound = 0;
+    {
+        LOCK(cs_vNodes);
+        for (size_t i = 0; i < vNodes.size(); i++)
+            (vNodes[i]->fInbound ? nInbound : nOutbound)++;
+    }
+    strOut += "# TYPE safecoin_peers gauge\n";
+    strOut += strprintf("safecoin_peers{direction=\"inbound\"} %u\n", nInbound);
+    strOut += strprintf("safecoin_peers{direction=\"outbound\"} %u\n", nOutbound);
+
+    strOut += "# TYPE safecoin_validation_phase_microseconds_total counter\n";
+    for (int i = 0; i < MAX_VALIDATION_PHASES; i++)
+        strOut += strprintf("safecoin_validation_phase_microseconds_total{phase=\"%s\"} %d\n", ValidationPhaseName(i), validationPhaseTimes[i].nTotal.load());
+    strOut += "# TYPE safecoin_validation_phase_last_microseconds gauge\n";
+    for (int i = 0; i < MAX_VALIDATION_PHASES; i++)
+        strOut += strprintf("safecoin_validation_phase_last_microseconds{phase=\"%s\"} %d\n", ValidationPhaseName(i), validationPhaseTimes[i].nLast.load());
+    strOut += "# TYPE safecoin_blocks_connected_total counter\n";
+    strOut += strprintf("safecoin_blocks_connected_total %u\n", validationPhaseTimes[VALIDATION_TOTAL].count.get());
+
+    uint64_t nHits, nMisses;
+    GetSignatureCacheStats(nHits, nMisses);
+    strOut += "# TYPE safecoin_sigcache_lookups_total counter\n";
+    strOut += strprintf("safecoin_sigcache_lookups_total{result=\"hit\"} %u\n", nHits);
+    strOut += strprintf("safecoin_sigcache_lookups_total{result=\"miss\"} %u\n", nMisses);
+
+    HTTPWorkQueueStats queue;
+    if (GetHTTPWorkQueueStats(queue)) {
+        strOut += "# TYPE safecoin_http_queue_depth gauge\n";
+        strOut += strprintf("safecoin_http_queue_depth{lane=\"normal\"} %u\n", queue.nDepth);
+        strOut += strprintf("safecoin_http_queue_depth{lane=\"priority\"} %u\n", queue.nPriorityDepth);
+        strOut += "# TYPE safecoin_http_requests_total counter\n";
+        strOut += strprintf("safecoin_http_requests_total{lane=\"normal\"} %u\n", queue.nProcessed);
+        strOut += strprintf("safecoin_http_requests_total{lane=\"priority\"} %u\n", queue.nPriorityProcessed);
+        strOut += "# TYPE safecoin_http_requests_rejected_total counter\n";
+        strOut += strprintf("safecoin_http_requests_rejected_total %u\n", queue.nRejected);
+        strOut += "# TYPE safecoin_http_queue_wait_microseconds_total counter\n";
+        strOut += strprintf("safecoin_http_queue_wait_microseconds_total %d\n", queue.nWaitTotal);
+    }
+
+    strOut += "# TYPE safecoin_transactions_validated_total counter\n";
+    strOut += strprintf("safecoin_transactions_validated_total %u\n", transactionsValidated.get());
+    strOut += "# TYPE safecoin_nspv_requests_total counter\n";
+    strOut += strprintf("safecoin_nspv_requests_total %u\n", nspvRequests.get());
+    strOut += "# TYPE safecoin_mining_solver_runs_total counter\n";
+    strOut += strprintf("safecoin_mining_solver_runs_total %u\n", ehSolverRuns.get());
+    strOut += "# TYPE safecoin_mining_target_checks_total counter\n";
+    strOut += strprintf("safecoin_mining_target_checks_total %u\n", solutionTargetChecks.get());
+    return strOut;
+}
+
 void TrackMinedBlock(uint256 hash)
 {
     LOCK(cs_metrics);
@@ -281,6 +367,13 @@ int printMiningStatus(bool mining)
         if (nThreads > 0) {
             std::cout << strprintf(_("You are mining with the %s solver on %d threads."),
                                    GetArg("-equihashsolver", "default"), nThreads) << std::endl;
+            if (nThreads > 1 && ASSETCHAINS_ALGO == ASSETCHAINS_EQUIHASH) {
+                std::string strRates;
+                for (uint64_t i = 0; i < nThreads && i < MAX_MINER_THREAD_METRICS; i++)
+                    strRates += strprintf(" %.4f", miningTimer.rate(minerThreadTargetChecks[i]));
+                std::cout << strprintf(_("Solution rate per thread (Sol/s):%s"), strRates) << std::endl;
+                lines++;
+            }
         } else {
             bool fvNodesEmpty;
             {
@@ -345,6 +438,13 @@ int printMetrics(size_t cols, bool mining)
       std::cout << "- " << _("You have validated no transactions.") << std::endl;
     }
 
+    const ValidationPhaseTimer& lastBlock = validationPhaseTimes[VALIDATION_TOTAL];
+    if (lastBlock.count.get() > 0) {
+        std::cout << "- " << strprintf(_("The last block took %.1f ms to connect, %.1f ms of it verifying scripts."),
+                                       lastBlock.nLast * 0.001, validationPhaseTimes[VALIDATION_VERIFY].nLast * 0.001) << std::endl;
+        lines++;
+    }
+
     if (mining && loaded) {
         std::cout << "- " << strprintf(_("You have completed %d Equihash solver runs."), ehSolverRuns.get()) << std::endl;
         lines++;
@@ -74,10 +74,52 @@ public:
 };
 
 extern AtomicCounter transactionsValidated;
+extern AtomicCounter nspvRequests;
 extern AtomicCounter ehSolverRuns;
 extern AtomicCounter solutionTargetChecks;
+/** Solution target checks of each internal miner thread, by the index the thread got when it was started */
+static const int MAX_MINER_THREAD_METRICS = 64;
+extern AtomicCounter minerThreadTargetChecks[MAX_MINER_THREAD_METRICS];
 extern AtomicTimer miningTimer;
 
+/** Phases of connecting a block to the tip, timed for getvalidationstats and the metrics screen */
+enum ValidationPhase {
+    VALIDATION_READBLOCK,   //! loading the block from disk
+    VALIDATION_CONNECT,     //! the transaction loop of ConnectBlock, queueing the script checks
+    VALIDATION_CHECKPOW,    //! safecoin_checkPOW of staked chains, part of connect
+    VALIDATION_VERIFY,      //! waiting for the script and CC checks
+    VALIDATION_INDEX,       //! undo data and index writes
+    VALIDATION_CALLBACKS,
+    VALIDATION_SAFECOIN,    //! safecoin_connectblock, the notarisation state, KV and SafeNode registry
+    VALIDATION_FLUSH,       //! flushing the block's coins into pcoinsTip
+    VALIDATION_CHAINSTATE,  //! FlushStateToDisk
+    VALIDATION_POSTCONNECT, //! mempool, wallet and ChainTip updates
+    VALIDATION_PRICES,
+    VALIDATION_SNAPSHOT,    //! the daily address snapshot
+    VALIDATION_TOTAL,
+    MAX_VALIDATION_PHASES
+};
+
+struct ValidationPhaseTimer {
+    std::atomic<int64_t> nLast; //! microseconds, the last time the phase ran
+    std::atomic<int64_t> nTotal;
+    AtomicCounter count;
+
+    ValidationPhaseTimer() : nLast {0}, nTotal {0} { }
+
+    void add(int64_t nMicros) {
+        nLast = nMicros;
+        nTotal += nMicros;
+        count.increment();
+    }
+};
+
+extern ValidationPhaseTimer validationPhaseTimes[MAX_VALIDATION_PHASES];
+const char* ValidationPhaseName(int phase);
+
+/** Node gauges and counters in the Prometheus text format, for /metrics; does not take cs_main */
+std::string NodeMetricsToPrometheus();
+
 void TrackMinedBlock(uint256 hash);
 
 void MarkStartTime();
@@ -61,6 +61,7 @@
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #ifdef ENABLE_MINING
+#include <atomic>
 #include <functional>
 #endif
 #include <mutex>
@@ -93,6 +94,25 @@ public:
     }
 };
 
+//
+// What the input scan of CreateNewBlock found for a mempool transaction. It only
+// depends on the tip the template is built on, so templates built on the same tip
+// (getblocktemplate polls) only scan the transactions that arrived since the last one.
+//
+class CTemplateTxInputs
+{
+public:
+    double dPriority;                // sum(valuein * age), before ComputePriority
+    CAmount nTotalIn;
+    std::vector<uint256> vDependsOn; // in-mempool parent of each input that spends one
+
+    CTemplateTxInputs() : dPriority(0), nTotalIn(0) {}
+};
+
+// guarded by cs_main
+static uint256 hashTemplateInputsTip;
+static map<uint256, CTemplateTxInputs> mapTemplateInputs;
+
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
@@ -190,6 +210,11 @@ int32_t safecoin_waituntilelegible(uint32_t blocktime, int32_t stakeHeight, uint
 
 CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32_t gpucount, bool isStake)
 {
+    if (fBlockDBCorrupt)
+    {
+        LogPrintf("CreateNewBlock(): block database is corrupt, not creating a block\n");
+        return NULL;
+    }
     CScript scriptPubKeyIn(_scriptPubKeyIn);
 
     CPubKey pk;
@@ -306,11 +331,26 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
         vector<TxPriority> vecPriority;
         vecPriority.reserve(mempool.mapTx.size() + 1);
 
+        // input scans of the previous template, only valid on the same tip
+        if ( hashTemplateInputsTip != pindexPrev->GetBlockHash() )
+        {
+            mapTemplateInputs.clear();
+            hashTemplateInputsTip = pindexPrev->GetBlockHash();
+        }
+        map<uint256, CTemplateTxInputs> mapTemplateInputsNew;
+
         // now add transactions from the mem pool
         int32_t Notarisations = 0; uint64_t txvalue;
-        for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi)
+        // with pure fee ordering the ancestor feerate index meets the best candidates first, so
+        // the scan can stop once it has collected a few blocks worth of them. Notary pay chains
+        // still look at every transaction, the notarisation has to be found wherever it sorts.
+        bool fScanByFee = (nBlockPrioritySize <= 0 && ASSETCHAINS_NOTARY_PAY[0] == 0);
+        uint64_t nCandidateSize = 0;
+        for (CTxMemPool::indexed_transaction_set::nth_index<2>::type::iterator mi = mempool.mapTx.get<2>().begin();
+             mi != mempool.mapTx.get<2>().end(); ++mi)
         {
+            if ( fScanByFee && nCandidateSize >= 4 * (uint64_t)nBlockMaxSize )
+                break;
             //break; // dont add any tx to block.. debug for SAFE fix. Disabled. 
             const CTransaction& tx = mi->GetTx();
 
@@ -352,7 +392,26 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                 if ( numSN != 0 && notarypubkeys[0][0] != 0 && safecoin_is_notarytx(tx) == 1 )
                     fToCryptoAddress = true;
 
-                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                // notarisations collect their signers in the scan, they are always scanned
+                CTemplateTxInputs inputs;
+                map<uint256, CTemplateTxInputs>::iterator itinputs = fToCryptoAddress ? mapTemplateInputs.end() : mapTemplateInputs.find(tx.GetHash());
+                if ( itinputs != mapTemplateInputs.end() )
+                {
+                    dPriority = itinputs->second.dPriority;
+                    nTotalIn = itinputs->second.nTotalIn;
+                    if ( !itinputs->second.vDependsOn.empty() )
+                    {
+                        vOrphan.push_back(COrphan(&tx));
+                        porphan = &vOrphan.back();
+                        BOOST_FOREACH(const uint256 &hashParent, itinputs->second.vDependsOn)
+                        {
+                            mapDependers[hashParent].push_back(porphan);
+                            porphan->setDependsOn.insert(hashParent);
+                        }
+                    }
+                    mapTemplateInputsNew.insert(*itinputs);
+                }
+                else BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 {
                     if (tx.IsPegsImport() && txin.prevout.n==10e8)
                     {
@@ -386,6 +445,7 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                         }
                         mapDependers[txin.prevout.hash].push_back(porphan);
                         porphan->setDependsOn.insert(txin.prevout.hash);
+                        inputs.vDependsOn.push_back(txin.prevout.hash);
                         nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
                         continue;
                     }
@@ -423,13 +483,22 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                         fprintf(stderr, "possible notarisation is signed multiple times by same notary, passed as normal transaction.\n");
                     } else fNotarisation = true;
                 }
-                nTotalIn += tx.GetShieldedValueIn();
+                if ( itinputs == mapTemplateInputs.end() )
+                {
+                    nTotalIn += tx.GetShieldedValueIn();
+                    if ( !fMissingInputs && !fToCryptoAddress )
+                    {
+                        inputs.dPriority = dPriority;
+                        inputs.nTotalIn = nTotalIn;
+                        mapTemplateInputsNew.insert(std::make_pair(tx.GetHash(), inputs));
+                    }
+                }
             }
 
             if (fMissingInputs) continue;
 
             // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nTxSize = tx.GetTotalSize();
             dPriority = tx.ComputePriority(dPriority, nTxSize);
 
             uint256 hash = tx.GetHash();
@@ -478,8 +547,12 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
             }
             else
                 vecPriority.push_back(TxPriority(dPriority, feeRate, &(mi->GetTx())));
+            nCandidateSize += mi->GetTxSize();
         }
 
+        // whatever left the mempool since the last template drops out here
+        mapTemplateInputs.swap(mapTemplateInputsNew);
+
         // Collect transactions into block
         uint64_t nBlockSize = 1000;
         uint64_t nBlockTx = 0;
@@ -501,7 +574,7 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
             vecPriority.pop_back();
 
             // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nTxSize = tx.GetTotalSize();
 
             // Opret spam limits
             if (mapArgs.count("-opretmintxfee"))
@@ -514,7 +587,7 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                     opretMinFeeRate = CFeeRate(400000); // default opretMinFeeRate (1 SAFE per 250 Kb = 0.004 per 1 Kb = 400000 sat per 1 Kb)
 
                 bool fSpamTx = false;
-                unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+                unsigned int nTxSize = tx.GetTotalSize();
                 unsigned int nTxOpretSize = 0;
 
                 // calc total oprets size
@@ -1575,6 +1648,9 @@ void static BitcoinMiner_noeq()
                 //else if ( ASSETCHAINS_ADAPTIVEPOW > 0 && ASSETCHAINS_STAKED == 0 )
                 //    hashTarget = HASHTarget_POW;
                 
+                // v2 nonces are hashed four at a time on interleaved haraka lanes, count is a multiple of 4
+                unsigned char hashes4[128];
+
                 // for speed check NONCEMASK at a time
                 for (i = 0; i < count; i++)
                 {
@@ -1582,7 +1658,11 @@ void static BitcoinMiner_noeq()
                     if ( ASSETCHAINS_ALGO == ASSETCHAINS_VERUSHASH )
                         vh.ExtraHash((unsigned char *)&hashResult);
                     else if ( ASSETCHAINS_ALGO == ASSETCHAINS_VERUSHASHV1_1 )
-                        vh2.ExtraHash((unsigned char *)&hashResult);
+                    {
+                        if ( (i & 3) == 0 )
+                            vh2.ExtraHash4(hashes4, i);
+                        memcpy(&hashResult, hashes4 + (i & 3) * 32, 32);
+                    }
 
                     if ( UintToArith256(hashResult) <= hashTarget )
                     {
@@ -1694,7 +1774,38 @@ void static BitcoinMiner_noeq()
 int32_t gotinvalid;
 extern int32_t getkmdseason(int32_t height);
 
+// index of each Equihash miner thread, it fills the top 16 bits of the nonce so threads never search the same nonces
+static std::atomic<int> nMinerThreads(0);
+
 #ifdef ENABLE_WALLET
+// The Equihash miner threads share one template while the tip, the mempool and the notary gpu count stay the same,
+// the first thread that needs a new one builds it and the others copy it. Only when the coinbase pays to -pubkey,
+// otherwise every thread pays to a key of its own.
+static CCriticalSection cs_minertemplate;
+static std::unique_ptr<CBlockTemplate> pMinerTemplate;
+static unsigned int nMinerTemplateUpdates;
+static int32_t nMinerTemplateGpucount;
+static int64_t nMinerTemplateTime;
+
+static CBlockTemplate *GetMinerTemplate(CReserveKey& reservekey, CBlockIndex *pindexPrev, int32_t gpucount, bool isStake)
+{
+    if ( USE_EXTERNAL_PUBKEY == 0 || isStake || ASSETCHAINS_MARMARA != 0 )
+        return CreateNewBlockWithKey(reservekey, pindexPrev->GetHeight()+1, gpucount, isStake);
+    LOCK(cs_minertemplate);
+    unsigned int nUpdates = mempool.GetTransactionsUpdated();
+    if ( !pMinerTemplate || pMinerTemplate->block.hashPrevBlock != pindexPrev->GetBlockHash() || nMinerTemplateUpdates != nUpdates || nMinerTemplateGpucount != gpucount || GetTime() > nMinerTemplateTime + 60 )
+    {
+        CBlockTemplate *ptr = CreateNewBlockWithKey(reservekey, pindexPrev->GetHeight()+1, gpucount, isStake);
+        if ( ptr == 0 )
+            return(0);
+        pMinerTemplate.reset(ptr);
+        nMinerTemplateUpdates = nUpdates;
+        nMinerTemplateGpucount = gpucount;
+        nMinerTemplateTime = GetTime();
+    }
+    return(new CBlockTemplate(*pMinerTemplate));
+}
+
 void static BitcoinMiner(CWallet *pwallet)
 #else
 void static BitcoinMiner()
@@ -1712,6 +1823,7 @@ void static BitcoinMiner()
 
     // Each thread has its own counter
     unsigned int nExtraNonce = 0;
+    int nThreadIndex = nMinerThreads++;
 
     unsigned int n = chainparams.EquihashN();
     unsigned int k = chainparams.EquihashK();
@@ -1813,7 +1925,7 @@ void static BitcoinMiner()
 
 #ifdef ENABLE_WALLET
             // notaries always default to staking
-            CBlockTemplate *ptr = CreateNewBlockWithKey(reservekey, pindexPrev->GetHeight()+1, gpucount, ASSETCHAINS_STAKED != 0 && SAFECOIN_MININGTHREADS == 0);
+            CBlockTemplate *ptr = GetMinerTemplate(reservekey, pindexPrev, gpucount, ASSETCHAINS_STAKED != 0 && SAFECOIN_MININGTHREADS == 0);
 #else
             CBlockTemplate *ptr = CreateNewBlockWithKey();
 #endif
@@ -1863,6 +1975,8 @@ void static BitcoinMiner()
             if ( (ASSETCHAINS_SYMBOL[0] == 0 && notaryid >= 0 && Mining_height > nDecemberHardforkHeight ) || (ASSETCHAINS_STAKED != 0 && safecoin_newStakerActive(Mining_height, pblock->nTime) != 0) ) //December 2019 hardfork
                 nExtraNonce = 0;
             IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
+            // the template leaves the top 16 bits of the nonce clear for the thread
+            pblock->nNonce = ArithToUint256(UintToArith256(pblock->nNonce) | (arith_uint256(nThreadIndex & 0xffff) << 240));
             //fprintf(stderr,"Running SafecoinMiner.%s with %u transactions in block\n",solver.c_str(),(int32_t)pblock->vtx.size());
             LogPrintf("Running SafecoinMiner.%s with %u transactions in block (%u bytes)\n",solver.c_str(),pblock->vtx.size(),::GetSerializeSize(*pblock,SER_NETWORK,PROTOCOL_VERSION));
             //
@@ -1974,9 +2088,9 @@ void static BitcoinMiner()
                 else hashTarget = HASHTarget;
                 std::function<bool(std::vector<unsigned char>)> validBlock =
 #ifdef ENABLE_WALLET
-                [&pblock, &hashTarget, &pwallet, &reservekey, &m_cs, &cancelSolver, &chainparams, &hashTarget_POW]
+                [&pblock, &hashTarget, &pwallet, &reservekey, &m_cs, &cancelSolver, &chainparams, &hashTarget_POW, nThreadIndex]
 #else
-                [&pblock, &hashTarget, &m_cs, &cancelSolver, &chainparams, &hashTarget_POW]
+                [&pblock, &hashTarget, &m_cs, &cancelSolver, &chainparams, &hashTarget_POW, nThreadIndex]
 #endif
                 (std::vector<unsigned char> soln) {
                     int32_t z; arith_uint256 h; CBlock B;
@@ -1984,6 +2098,7 @@ void static BitcoinMiner()
                     LogPrint("pow", "- Checking solution against target\n");
                     pblock->nSolution = soln;
                     solutionTargetChecks.increment();
+                    minerThreadTargetChecks[nThreadIndex % MAX_MINER_THREAD_METRICS].increment();
                     B = *pblock;
                     h = UintToArith256(B.GetHash());
                     /*for (z=31; z>=16; z--)
@@ -2243,6 +2358,7 @@ void static BitcoinMiner()
             return;
 
         minerThreads = new boost::thread_group();
+        nMinerThreads = 0;
 
 #ifdef ENABLE_WALLET
         if (ASSETCHAINS_LWMAPOS != 0 && VERUS_MINTBLOCKS)
@@ -35,13 +35,21 @@
 #include "crypto/common.h"
 #include "safe/utiltls.h"
 
+#include <math.h>
+
 #ifdef _WIN32
 #include <string.h>
 #else
 #include <fcntl.h>
 #endif
+#if defined(USE_EPOLL)
+#include <sys/epoll.h>
+#elif defined(USE_KQUEUE)
+#include <sys/event.h>
+#endif
 
 #include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 #include <openssl/conf.h>
@@ -106,13 +114,16 @@ uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
 CAddrMan addrman;
 int nMaxConnections = DEFAULT_MAX_PEER_CONNECTIONS;
-bool fAddressesInitialized = false;
+//! set once peers.dat is loaded, before that a dump would overwrite it with a few seeds
+std::atomic<bool> fAddressesInitialized(false);
+//! peers.dat is being read in the background
+static std::atomic<bool> fLoadingAddresses(false);
 std::string strSubVersion;
 
 TLSManager tlsmanager = TLSManager();
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, CSendBuffer> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -131,6 +142,74 @@ CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
 static boost::condition_variable messageHandlerCondition;
+static boost::mutex messageHandlerMutex;
+
+/** Smallest receive buffer worth keeping, and the number of power of two size classes above it */
+static const size_t RECV_POOL_MIN_SIZE = 4 * 1024;
+static const int RECV_POOL_CLASSES = 11;
+/** Most free buffers kept per size class, and in bytes over all of them */
+static const size_t RECV_POOL_MAX_PER_CLASS = 32;
+static const size_t RECV_POOL_MAX_BYTES = 32 * 1024 * 1024;
+/** Messages with less than this left to receive are parsed from the read buffer, larger ones are read in place */
+static const unsigned int RECV_DIRECT_MIN = 16 * 1024;
+static const unsigned int RECV_DIRECT_MAX = 256 * 1024;
+
+/**
+ * Data buffers of messages that were handled, by size class, for the next messages to be received
+ * into. Saves growing a fresh buffer by reallocation (and zeroing it on free) for every block or
+ * transaction relayed by every peer. Defined before instance_of_cnetcleanup, which outlives it.
+ */
+class CRecvBufferPool
+{
+private:
+    CCriticalSection cs;
+    std::vector<CSerializeData> vFree[RECV_POOL_CLASSES];
+    size_t nFreeBytes;
+
+public:
+    CRecvBufferPool() : nFreeBytes(0) {}
+
+    /** Give vchOut (empty) room for at least nSize bytes, from a pooled buffer if there is one large enough */
+    void Get(size_t nSize, CSerializeData& vchOut)
+    {
+        int nClass = 0;
+        while (nClass < RECV_POOL_CLASSES && (RECV_POOL_MIN_SIZE << nClass) < nSize)
+            nClass++;
+        {
+            LOCK(cs);
+            // the classes above are worth taking too rather than allocating
+            for (int i = nClass; i < RECV_POOL_CLASSES && i <= nClass + 1; i++) {
+                if (!vFree[i].empty()) {
+                    vchOut.swap(vFree[i].back());
+                    vFree[i].pop_back();
+                    nFreeBytes -= vchOut.capacity();
+                    return;
+                }
+            }
+        }
+        // the declared size is not trusted with more than readData would grow to for the first bytes
+        vchOut.reserve(std::min(nSize, (size_t)RECV_DIRECT_MAX));
+    }
+
+    /** Take the allocation of vch, leaving it empty */
+    void Put(CSerializeData& vch)
+    {
+        size_t nCapacity = vch.capacity();
+        if (nCapacity < RECV_POOL_MIN_SIZE)
+            return;
+        int nClass = 0;
+        while (nClass + 1 < RECV_POOL_CLASSES && (RECV_POOL_MIN_SIZE << (nClass + 1)) <= nCapacity)
+            nClass++;
+        LOCK(cs);
+        if (vFree[nClass].size() >= RECV_POOL_MAX_PER_CLASS || nFreeBytes + nCapacity > RECV_POOL_MAX_BYTES)
+            return;
+        vch.clear();
+        vFree[nClass].push_back(CSerializeData());
+        vFree[nClass].back().swap(vch);
+        nFreeBytes += nCapacity;
+    }
+};
+static CRecvBufferPool recvBufferPool;
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -724,7 +803,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, nRecvVersion));
+            vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, nRecvVersion);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -748,13 +827,44 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            messageHandlerCondition.notify_all();
         }
     }
 
     return true;
 }
 
+char *CNode::GetRecvDataSpace(unsigned int& nSpace)
+{
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data || vRecvMsg.back().complete())
+        return NULL;
+    CNetMessage& msg = vRecvMsg.back();
+    if (msg.hdr.nMessageSize > MAX_PROTOCOL_MESSAGE_LENGTH)
+        return NULL;
+    unsigned int nRemaining = msg.hdr.nMessageSize - msg.nDataPos;
+    if (nRemaining < RECV_DIRECT_MIN)
+        return NULL;
+    nSpace = std::min(nRemaining, RECV_DIRECT_MAX);
+    return msg.GetDataSpace(nSpace);
+}
+
+void CNode::ReceivedMsgData(unsigned int nBytes)
+{
+    CNetMessage& msg = vRecvMsg.back();
+    msg.nDataPos += nBytes;
+    if (msg.complete()) {
+        msg.nTime = GetTimeMicros();
+        messageHandlerCondition.notify_all();
+    }
+}
+
+CNetMessage::~CNetMessage()
+{
+    CSerializeData vch;
+    vRecv.SwapBuffer(vch);
+    recvBufferPool.Put(vch);
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -780,8 +890,13 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     if (hdr.nMessageSize > MAX_SIZE)
             return -1;
 
-    // switch state to reading message data
+    // switch state to reading message data, into a buffer that was used before where possible
     in_data = true;
+    if (hdr.nMessageSize <= MAX_PROTOCOL_MESSAGE_LENGTH) {
+        CSerializeData vch;
+        recvBufferPool.Get(hdr.nMessageSize, vch);
+        vRecv.SwapBuffer(vch);
+    }
 
     return nCopy;
 }
@@ -791,25 +906,34 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
-
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    memcpy(GetDataSpace(nCopy), pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+char *CNetMessage::GetDataSpace(unsigned int nBytes)
+{
+    if (vRecv.size() < nDataPos + nBytes) {
+        // Allocate up to 256 KiB ahead, but never more than the total message size.
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nBytes + 256 * 1024));
+    }
+    return &vRecv[nDataPos];
+}
+
 // requires LOCK(cs_vSend)
+#ifndef _WIN32
+/** Most queued messages to hand to one sendmsg() call */
+static const int SEND_IOV_MAX = 64;
+#endif
+
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSendBuffer>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end())
     {
-        const CSerializeData &data = *it;
+        const CSerializeData &data = **it;
         assert(data.size() > pnode->nSendOffset);
 
         bool bIsSSL = false;
@@ -834,7 +958,24 @@ void SocketSendData(CNode *pnode)
             }
             else
             {
+#ifdef _WIN32
                 nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+                // gather the queued messages straight from their buffers into one call
+                struct iovec iov[SEND_IOV_MAX];
+                int nIov = 0;
+                for (std::deque<CSendBuffer>::iterator itIov = it; itIov != pnode->vSendMsg.end() && nIov < SEND_IOV_MAX; itIov++, nIov++)
+                {
+                    size_t nOffset = (itIov == it ? pnode->nSendOffset : 0);
+                    iov[nIov].iov_base = (void*)&(**itIov)[nOffset];
+                    iov[nIov].iov_len = (*itIov)->size() - nOffset;
+                }
+                struct msghdr msg;
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_iov = iov;
+                msg.msg_iovlen = nIov;
+                nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
                 nRet = WSAGetLastError();
             }
         }
@@ -842,18 +983,21 @@ void SocketSendData(CNode *pnode)
         {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
 
-            if (pnode->nSendOffset == data.size())
+            // step over the messages that went out completely
+            size_t nSent = nBytes;
+            while (it != pnode->vSendMsg.end() && nSent >= (*it)->size() - pnode->nSendOffset)
             {
+                nSent -= (*it)->size() - pnode->nSendOffset;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= (*it)->size();
                 it++;
             }
-            else
+            if (nSent > 0)
             {
                 // could not send full message; stop sending more
+                pnode->nSendOffset += nSent;
                 break;
             }
         }
@@ -1257,9 +1401,245 @@ void ThreadNonTLSPoolsCleaner()
 
 #endif // USE_TLS && COMPAT_NON_TLS
 
+/**
+ * Socket readiness for ThreadSocketHandler. With epoll (Linux) or kqueue (BSD,
+ * macOS) the kernel keeps the set of watched sockets and only the changes are
+ * passed each loop, a wait costs O(ready sockets) and sockets are not limited
+ * to FD_SETSIZE. Both are used level triggered, as a socket whose lock was
+ * busy is simply serviced on the next loop. Falls back to select().
+ */
+class CSocketEvents
+{
+public:
+    enum { RECV = 1, SEND = 2, ERR = 4 };
+
+    CSocketEvents() : fdQueue(-1)
+    {
+#if defined(USE_EPOLL)
+        fdQueue = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(USE_KQUEUE)
+        fdQueue = kqueue();
+#endif
+#if defined(USE_EPOLL)
+        const char *name = "epoll";
+#else
+        const char *name = "kqueue";
+#endif
+        LogPrintf("Using %s for p2p socket events\n", fdQueue >= 0 ? name : "select");
+    }
+
+    ~CSocketEvents()
+    {
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+        if (fdQueue >= 0)
+            close(fdQueue);
+#endif
+    }
+
+    /** Watch hSocket for nEvents in the next Wait(). pOwner tells a reused socket number apart. */
+    void Watch(SOCKET hSocket, const void *pOwner, int nEvents)
+    {
+        if (hSocket == INVALID_SOCKET)
+            return;
+        WatchedSocket &w = mapWanted[hSocket];
+        w.pOwner = pOwner;
+        w.nEvents = nEvents;
+    }
+
+    /** Wait up to nTimeout milliseconds, then Ready() tells what happened to each watched socket */
+    void Wait(int64_t nTimeout)
+    {
+        mapReady.clear();
+        if (fdQueue < 0)
+            WaitSelect(nTimeout);
+        else
+            WaitQueue(nTimeout);
+        mapWanted.clear();
+    }
+
+    int Ready(SOCKET hSocket) const
+    {
+        std::map<SOCKET, int>::const_iterator it = mapReady.find(hSocket);
+        return it == mapReady.end() ? 0 : it->second;
+    }
+
+private:
+    struct WatchedSocket
+    {
+        const void *pOwner;
+        int nEvents;
+    };
+
+    int fdQueue;
+    std::map<SOCKET, WatchedSocket> mapWanted;
+    std::map<SOCKET, WatchedSocket> mapWatched; // as registered with the kernel
+    std::map<SOCKET, int> mapReady;
+
+    void WaitSelect(int64_t nTimeout)
+    {
+        struct timeval timeout = MillisToTimeval(nTimeout);
+        fd_set fdsetRecv, fdsetSend, fdsetError;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        SOCKET hSocketMax = 0;
+        bool have_fds = false;
+
+        for (const std::pair<SOCKET, WatchedSocket>& item : mapWanted) {
+            if (!IsSelectableSocketForSelect(item.first))
+                continue;
+            if (item.second.nEvents & RECV)
+                FD_SET(item.first, &fdsetRecv);
+            if (item.second.nEvents & SEND)
+                FD_SET(item.first, &fdsetSend);
+            if (item.second.nEvents & ERR)
+                FD_SET(item.first, &fdsetError);
+            hSocketMax = max(hSocketMax, item.first);
+            have_fds = true;
+        }
+
+        int nSelect = select(have_fds ? hSocketMax + 1 : 0, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        if (nSelect == SOCKET_ERROR)
+        {
+            if (have_fds)
+            {
+                int nErr = WSAGetLastError();
+                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+                for (const std::pair<SOCKET, WatchedSocket>& item : mapWanted)
+                    mapReady[item.first] = RECV;
+            }
+            MilliSleep(nTimeout);
+            return;
+        }
+        for (const std::pair<SOCKET, WatchedSocket>& item : mapWanted) {
+            if (!IsSelectableSocketForSelect(item.first))
+                continue;
+            int nReady = (FD_ISSET(item.first, &fdsetRecv) ? RECV : 0) | (FD_ISSET(item.first, &fdsetSend) ? SEND : 0) | (FD_ISSET(item.first, &fdsetError) ? ERR : 0);
+            if (nReady != 0)
+                mapReady[item.first] = nReady;
+        }
+    }
+
+    static bool IsSelectableSocketForSelect(SOCKET hSocket)
+    {
+#ifdef _WIN32
+        return true;
+#else
+        return hSocket < FD_SETSIZE;
+#endif
+    }
+
+#if defined(USE_EPOLL)
+    void Register(SOCKET hSocket, int nEvents, bool fNew)
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = ((nEvents & RECV) ? EPOLLIN : 0) | ((nEvents & SEND) ? EPOLLOUT : 0); // EPOLLERR and EPOLLHUP are always reported
+        ev.data.fd = hSocket;
+        if (epoll_ctl(fdQueue, fNew ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, hSocket, &ev) != 0) {
+            // the kernel drops a socket when it is closed, and a new one may get the same number
+            if (errno == (fNew ? EEXIST : ENOENT))
+                epoll_ctl(fdQueue, fNew ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, hSocket, &ev);
+        }
+    }
+
+    void Unregister(SOCKET hSocket, int nEvents)
+    {
+        epoll_ctl(fdQueue, EPOLL_CTL_DEL, hSocket, NULL);
+    }
+
+    void WaitQueue(int64_t nTimeout)
+    {
+        UpdateQueue();
+        std::vector<struct epoll_event> vEvents(std::max<size_t>(64, mapWatched.size()));
+        int n = epoll_wait(fdQueue, &vEvents[0], vEvents.size(), nTimeout);
+        for (int i = 0; i < n; i++) {
+            int nReady = 0;
+            if (vEvents[i].events & EPOLLIN)
+                nReady |= RECV;
+            if (vEvents[i].events & EPOLLOUT)
+                nReady |= SEND;
+            if (vEvents[i].events & (EPOLLERR | EPOLLHUP))
+                nReady |= ERR;
+            mapReady[vEvents[i].data.fd] |= nReady;
+        }
+        if (n < 0 && errno != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            MilliSleep(nTimeout);
+        }
+    }
+#elif defined(USE_KQUEUE)
+    std::vector<struct kevent> vChanges;
+
+    void Register(SOCKET hSocket, int nEvents, bool fNew)
+    {
+        struct kevent ev;
+        EV_SET(&ev, hSocket, EVFILT_READ, (nEvents & RECV) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+        vChanges.push_back(ev);
+        EV_SET(&ev, hSocket, EVFILT_WRITE, (nEvents & SEND) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+        vChanges.push_back(ev);
+    }
+
+    void Unregister(SOCKET hSocket, int nEvents)
+    {
+        Register(hSocket, 0, false);
+    }
+
+    void WaitQueue(int64_t nTimeout)
+    {
+        vChanges.clear();
+        UpdateQueue();
+        struct timespec timeout;
+        timeout.tv_sec = nTimeout / 1000;
+        timeout.tv_nsec = (nTimeout % 1000) * 1000000;
+        // errors of the changes (deleting a filter that was not there) come back as EV_ERROR events and are ignored
+        std::vector<struct kevent> vEvents(std::max<size_t>(64, 2 * mapWatched.size()) + vChanges.size());
+        int n = kevent(fdQueue, vChanges.empty() ? NULL : &vChanges[0], vChanges.size(), &vEvents[0], vEvents.size(), &timeout);
+        for (int i = 0; i < n; i++) {
+            if (vEvents[i].flags & EV_ERROR)
+                continue;
+            int nReady = (vEvents[i].filter == EVFILT_READ) ? RECV : SEND;
+            if (vEvents[i].flags & EV_EOF)
+                nReady |= ERR;
+            mapReady[(SOCKET)vEvents[i].ident] |= nReady;
+        }
+        if (n < 0 && errno != EINTR) {
+            LogPrintf("socket kevent error %s\n", NetworkErrorString(errno));
+            MilliSleep(nTimeout);
+        }
+    }
+#else
+    void WaitQueue(int64_t nTimeout) { WaitSelect(nTimeout); }
+#endif
+
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    /** pass the difference between the wanted and the registered events to the kernel */
+    void UpdateQueue()
+    {
+        std::map<SOCKET, WatchedSocket>::iterator it = mapWatched.begin();
+        while (it != mapWatched.end()) {
+            if (mapWanted.count(it->first) == 0) {
+                Unregister(it->first, it->second.nEvents);
+                mapWatched.erase(it++);
+            } else
+                it++;
+        }
+        for (const std::pair<SOCKET, WatchedSocket>& item : mapWanted) {
+            std::map<SOCKET, WatchedSocket>::iterator w = mapWatched.find(item.first);
+            bool fNew = (w == mapWatched.end() || w->second.pOwner != item.second.pOwner);
+            if (fNew || w->second.nEvents != item.second.nEvents) {
+                Register(item.first, item.second.nEvents, fNew);
+                mapWatched[item.first] = item.second;
+            }
+        }
+    }
+#endif
+};
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    CSocketEvents socketEvents;
     while (true)
     {
         //
@@ -1328,24 +1708,10 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        const int64_t nTimeout = 50; // frequency to poll pnode->vSend
 
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
+        for (const ListenSocket& hListenSocket : vhListenSocket)
+            socketEvents.Watch(hListenSocket.socket, &hListenSocket, CSocketEvents::RECV);
 
         {
             LOCK(cs_vNodes);
@@ -1356,18 +1722,16 @@ void ThreadSocketHandler()
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
 
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
+                int nEvents = CSocketEvents::ERR;
 
                 // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
+                // * If there is data to send, wait for sending data. As this only
                 //   happens when optimistic write failed, we choose to first drain the
                 //   write buffer in this case before receiving more. This avoids
                 //   needlessly queueing received data, if the remote peer is not themselves
                 //   receiving data. This means properly utilizing TCP flow control signalling.
                 // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
+                //   or there is space left in the buffer, wait for receiving data.
                 // * (if neither of the above applies, there is certainly one message
                 //   in the receiver buffer ready to be processed).
                 // Together, that means that at least one of the following is always possible,
@@ -1377,45 +1741,30 @@ void ThreadSocketHandler()
                 // * We process a message in the buffer (message handler thread).
                 {
                     TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
+                    if (lockSend && !pnode->vSendMsg.empty())
+                        nEvents |= CSocketEvents::SEND;
                 }
+                if (!(nEvents & CSocketEvents::SEND))
                 {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                     if (lockRecv && (
                         pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
                         pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
+                        nEvents |= CSocketEvents::RECV;
                 }
+                socketEvents.Watch(pnode->hSocket, pnode, nEvents);
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        socketEvents.Wait(nTimeout);
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
-        }
-
         //
         // Accept new connections
         //
         for (const ListenSocket& hListenSocket : vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && (socketEvents.Ready(hListenSocket.socket) & CSocketEvents::RECV))
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1435,7 +1784,13 @@ void ThreadSocketHandler()
         {
             boost::this_thread::interruption_point();
 			
-            if (tlsmanager.threadSocketHandler(pnode,fdsetRecv,fdsetSend,fdsetError)==-1){
+            int nReady = 0;
+            {
+                LOCK(pnode->cs_hSocket);
+                if (pnode->hSocket != INVALID_SOCKET)
+                    nReady = socketEvents.Ready(pnode->hSocket);
+            }
+            if (tlsmanager.threadSocketHandler(pnode, nReady & CSocketEvents::RECV, nReady & CSocketEvents::SEND, nReady & CSocketEvents::ERR)==-1){
                 continue;
             }
 
@@ -1478,7 +1833,7 @@ void ThreadSocketHandler()
 void ThreadDNSAddressSeed()
 {
     // goal: only query DNS seeds if address need is acute
-    if ((addrman.size() > 0) &&
+    if ((addrman.size() > 0 || fLoadingAddresses) &&
         (!GetBoolArg("-forcednsseed", false))) {
         MilliSleep(11 * 1000);
 
@@ -1525,13 +1880,42 @@ void ThreadDNSAddressSeed()
 
 void DumpAddresses()
 {
+    if (!fAddressesInitialized)
+        return;
     int64_t nStart = GetTimeMillis();
 
+    // serialize a copy, so relay and connection threads only wait for the copy to be made
+    // (on the heap, the bucket tables are too big for a thread stack)
+    boost::scoped_ptr<CAddrMan> snapshot(new CAddrMan());
+    addrman.Snapshot(*snapshot);
+    int64_t nCopied = GetTimeMillis();
+
     CAddrDB adb;
-    adb.Write(addrman);
+    adb.Write(*snapshot);
+
+    LogPrint("net", "Flushed %d addresses to peers.dat  %dms (%dms copying)\n",
+           snapshot->size(), GetTimeMillis() - nStart, nCopied - nStart);
+}
 
-    LogPrint("net", "Flushed %d addresses to peers.dat  %dms\n",
-           addrman.size(), GetTimeMillis() - nStart);
+/**
+ * Read peers.dat while the node already connects out to seeds and -addnode peers,
+ * then take the loaded tables over together with whatever was learned meanwhile.
+ */
+void ThreadLoadAddresses()
+{
+    int64_t nStart = GetTimeMillis();
+    boost::scoped_ptr<CAddrMan> loaded(new CAddrMan());
+    CAddrDB adb;
+    if (adb.Read(*loaded)) {
+        size_t nLearned = addrman.size();
+        addrman.Adopt(*loaded);
+        LogPrintf("Loaded %i addresses from peers.dat, added %i learned while loading  %dms\n",
+               addrman.size(), nLearned, GetTimeMillis() - nStart);
+    } else {
+        LogPrintf("Invalid or missing peers.dat; recreating\n");
+    }
+    fAddressesInitialized = true;
+    fLoadingAddresses = false;
 }
 
 void static ProcessOneShot()
@@ -1785,10 +2169,36 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
-void ThreadMessageHandler()
+/**
+ * Messages whose handlers only serve the peer from our own state (taking cs_main
+ * themselves to read it), or only touch the peer. With -msghandlerthreads they
+ * are handled by the worker threads, everything else stays on the first thread
+ * so consensus handling remains serialized.
+ */
+static bool IsParallelMessage(const std::string& strCommand)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
+    static const std::set<std::string> setParallel = {
+        "addr", "getaddr", "ping", "pong", "getdata", "getblocks", "getheaders", "getblocktxn", "getnSPV"
+    };
+    return setParallel.count(strCommand) != 0;
+}
+
+/** Which thread handles the next message of a peer, requires pnode->cs_vRecvMsg */
+static bool IsParallelWork(CNode* pnode)
+{
+    if (!pnode->fSuccessfullyConnected)
+        return false;
+    // ProcessMessages serves queued getdata and then goes on with the next message
+    if (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())
+        return IsParallelMessage(pnode->vRecvMsg[0].hdr.GetCommand());
+    return !pnode->vRecvGetData.empty();
+}
+
+void ThreadMessageHandler(int nThread, int nThreads)
+{
+    // the first thread handles everything when it is alone, else all but the parallel messages
+    const bool fSerial = (nThread == 0);
+    const bool fWorkers = (nThreads > 1);
 
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true)
@@ -1814,10 +2224,10 @@ void ThreadMessageHandler()
             if (pnode->fDisconnect)
                 continue;
 
-            // Receive messages
+            // Receive messages. A peer is handled by one thread at a time, in order.
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
+                if (lockRecv && (!fWorkers || IsParallelWork(pnode) != fSerial))
                 {
                     if (!g_signals.ProcessMessages(pnode))
                         pnode->CloseSocketDisconnect();
@@ -1826,17 +2236,20 @@ void ThreadMessageHandler()
                     {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
                         {
-                            fSleep = false;
+                            if (!fWorkers || IsParallelWork(pnode) != fSerial)
+                                fSleep = false;
                         }
                     }
                 }
             }
             boost::this_thread::interruption_point();
 
-            // Send messages
+            // Send messages, not while another thread is handling a message of this peer
+            if (fSerial)
             {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
+                if (lockRecv && lockSend)
                     g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
             }
             boost::this_thread::interruption_point();
@@ -1849,7 +2262,10 @@ void ThreadMessageHandler()
         }
 
         if (fSleep)
+        {
+            boost::unique_lock<boost::mutex> lock(messageHandlerMutex);
             messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+        }
     }
 }
 
@@ -2012,16 +2428,14 @@ void static Discover(boost::thread_group& threadGroup)
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 {
     uiInterface.InitMessage(_("Loading addresses..."));
-    // Load addresses for peers.dat
-    int64_t nStart = GetTimeMillis();
-    {
-        CAddrDB adb;
-        if (!adb.Read(addrman))
-            LogPrintf("Invalid or missing peers.dat; recreating\n");
+    // Load addresses for peers.dat, in the background once there is anything to load
+    if (boost::filesystem::exists(GetDataDir() / "peers.dat")) {
+        fLoadingAddresses = true;
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "loadaddr", &ThreadLoadAddresses));
+    } else {
+        LogPrintf("Invalid or missing peers.dat; recreating\n");
+        fAddressesInitialized = true;
     }
-    LogPrintf("Loaded %i addresses from peers.dat  %dms\n",
-           addrman.size(), GetTimeMillis() - nStart);
-    fAddressesInitialized = true;
 
     if (semOutbound == NULL) {
         // initialize semaphore
@@ -2076,7 +2490,10 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMsgHandlerThreads = std::max(1, std::min((int)GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS), MAX_MSGHANDLER_THREADS));
+    for (int i = 0; i < nMsgHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&ThreadMessageHandler, i, nMsgHandlerThreads))));
+    LogPrintf("Using %d threads for p2p message handling\n", nMsgHandlerThreads);
 
 #if defined(USE_TLS) && defined(COMPAT_NON_TLS)
     // Clean pools of addresses for non-TLS connections
@@ -2084,7 +2501,7 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 #endif
 
     // Dump network addresses
-    scheduler.scheduleEvery(&DumpAddresses, DUMP_ADDRESSES_INTERVAL);
+    scheduler.scheduleEvery(&DumpAddresses, DUMP_ADDRESSES_INTERVAL, CScheduler::PRIORITY_LOW, "dumpaddresses");
 }
 
 bool StopNode()
@@ -2160,8 +2577,9 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        // Save original serialized message so newer versions are preserved, ready to send so
+        // that every peer asking for it gets the same buffer
+        mapRelay.insert(std::make_pair(inv, MakeSendBuffer("tx", ss)));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
     LOCK(cs_vNodes);
@@ -2342,6 +2760,16 @@ bool CAddrDB::Read(CAddrMan& addr)
 unsigned int ReceiveFloodSize() { return 1000*GetArg("-maxreceivebuffer", 5*1000); }
 unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", 1*1000); }
 
+int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds)
+{
+    return nNow + (int64_t)(log1p(GetRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) * average_interval_seconds * -1000000.0 + 0.5);
+}
+
+uint32_t CNode::GetReconShortID(const uint256& txid) const
+{
+    return SipHashUint256(nReconK0, nReconK1, txid) & 0xffffffff;
+}
+
 CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNameIn, bool fInboundIn, SSL *sslIn) :
     ssSend(SER_NETWORK, INIT_PROTO_VERSION),
     addrKnown(5000, 0.001),
@@ -2382,6 +2810,12 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nPingUsecTime = 0;
     fPingQueued = false;
     nMinPingUsecTime = std::numeric_limits<int64_t>::max();
+    nNextInvSend = 0;
+    fTxRecon = false;
+    nReconSalt = GetRand(std::numeric_limits<uint64_t>::max());
+    nReconK0 = 0;
+    nReconK1 = 0;
+    nReconSentTime = 0;
 
     {
         LOCK(cs_nLastNodeId);
@@ -2491,22 +2925,10 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
         LEAVE_CRITICAL_SECTION(cs_vSend);
         return;
     }
-    // Set the size
-    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    WriteLE32((uint8_t*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
-
-    // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-    unsigned int nChecksum = 0;
-    memcpy(&nChecksum, &hash, sizeof(nChecksum));
-    assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
-
-    LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
+    LogPrint("net", "(%d bytes) peer=%d\n", ssSend.size() - CMessageHeader::HEADER_SIZE, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    std::deque<CSendBuffer>::iterator it = vSendMsg.insert(vSendMsg.end(), EndSendBuffer(ssSend));
+    nSendSize += (*it)->size();
 
     // If write queue empty, attempt "optimistic write"
     if (it == vSendMsg.begin())
@@ -2514,3 +2936,42 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
+
+void CNode::PushBuffer(const CSendBuffer& buf)
+{
+    LOCK(cs_vSend);
+    if (buf->empty())
+        return;
+    LogPrint("net", "sending shared buffer (%d bytes) peer=%d\n", buf->size() - CMessageHeader::HEADER_SIZE, id);
+
+    vSendMsg.push_back(buf);
+    nSendSize += buf->size();
+
+    // If write queue empty, attempt "optimistic write"
+    if (vSendMsg.size() == 1)
+        SocketSendData(this);
+}
+
+void BeginSendBuffer(CDataStream& ss, const char* pszCommand)
+{
+    assert(ss.size() == 0);
+    ss << CMessageHeader(Params().MessageStart(), pszCommand, 0);
+}
+
+CSendBuffer EndSendBuffer(CDataStream& ss)
+{
+    // Set the size
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    WriteLE32((uint8_t*)&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
+
+    // Set the checksum
+    uint256 hash = Hash(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    assert(ss.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+
+    std::shared_ptr<CSerializeData> buf(new CSerializeData());
+    ss.GetAndClear(*buf);
+    return buf;
+}
@@ -36,6 +36,7 @@
 #include "util.h"
 
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef _WIN32
@@ -79,12 +80,27 @@ static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 384;
+/** -msghandlerthreads default, the first one handles consensus messages and the others serve peers */
+static const int DEFAULT_MSGHANDLER_THREADS = 3;
+static const int MAX_MSGHANDLER_THREADS = 16;
+/** Average delay between the batched transaction announcements to an inbound and to an outbound peer (in seconds). */
+static const int INVENTORY_BROADCAST_INTERVAL = 5;
+static const int OUTBOUND_INVENTORY_BROADCAST_INTERVAL = 2;
+/** -txrecon default, reconcile transaction announcements with peers that support it instead of flooding invs */
+static const bool DEFAULT_TXRECON = true;
+/** The most transactions kept for reconciliation with one peer, more are announced with inv. */
+static const size_t MAX_RECON_SET_SIZE = 4000;
+/** Time after which an unanswered reqrecon is given up and its transactions announced with inv (in seconds). */
+static const int RECON_TIMEOUT = 30;
 /** The period before a network upgrade activates, where connections to upgrading peers are preferred (in blocks). */
 static const int NETWORK_UPGRADE_PEER_PREFERENCE_BLOCK_PERIOD = 24 * 24 * 3;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
 
+/** Return a timestamp in the future (in microseconds) for exponentially distributed events. */
+int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds);
+
 void AddOneShot(const std::string& strDest);
 void AddressCurrentlyConnected(const CService& addr);
 CNode* FindNode(const CNetAddr& ip);
@@ -181,7 +197,23 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+/** A complete message (header and payload) ready to go out, shared by the send queues of all peers it is queued to */
+typedef std::shared_ptr<const CSerializeData> CSendBuffer;
+
+/** Build a message once, for CNode::PushBuffer to queue to any number of peers without serializing or copying it again */
+void BeginSendBuffer(CDataStream& ss, const char* pszCommand);
+CSendBuffer EndSendBuffer(CDataStream& ss);
+
+template<typename T1>
+CSendBuffer MakeSendBuffer(const char* pszCommand, const T1& a1)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    BeginSendBuffer(ss, pszCommand);
+    ss << a1;
+    return EndSendBuffer(ss);
+}
+
+extern std::map<CInv, CSendBuffer> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
@@ -253,6 +285,8 @@ public:
         nDataPos = 0;
         nTime = 0;
     }
+    /** Hands the data buffer back to the receive buffer pool */
+    ~CNetMessage();
 
     bool complete() const
     {
@@ -269,6 +303,9 @@ public:
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    /** Room for the next nBytes of data (at most what is left of the message), at &vRecv[nDataPos] */
+    char *GetDataSpace(unsigned int nBytes);
 };
 
 
@@ -290,7 +327,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSendBuffer> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
@@ -364,6 +401,17 @@ public:
     mruset<CInv> setInventoryKnown;
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
+    // time of the next batch of tx invs (or reqrecon), in microseconds
+    int64_t nNextInvSend;
+
+    // reconciliation of tx announcements (sendrecon): instead of an inv per tx both sides
+    // compare short ids of what they would announce, and only announce the difference
+    bool fTxRecon;
+    uint64_t nReconSalt; // ours, sent with sendrecon
+    uint64_t nReconK0, nReconK1; // short id keys, from both salts
+    std::set<uint256> setReconTx; // txs to reconcile at the next round, guarded by cs_inventory
+    std::map<uint32_t, uint256> mapReconSent; // our set of the reqrecon waiting for its reconcildiff
+    int64_t nReconSentTime; // when that reqrecon was sent, or 0
     std::set<uint256> setAskFor;
     std::multimap<int64_t, CInv> mapAskFor;
 
@@ -416,6 +464,16 @@ public:
     // requires LOCK(cs_vRecvMsg)
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes);
 
+    // requires LOCK(cs_vRecvMsg)
+    /**
+     * Where the socket can be read to directly when the rest of a large message is expected, so it does not
+     * have to be copied in from a read buffer. NULL when the next bytes are for ReceiveMsgBytes to parse
+     */
+    char *GetRecvDataSpace(unsigned int& nSpace);
+    // requires LOCK(cs_vRecvMsg)
+    /** Account for nBytes read into the space from GetRecvDataSpace */
+    void ReceivedMsgData(unsigned int nBytes);
+
     // requires LOCK(cs_vRecvMsg)
     void SetRecvVersion(int nVersionIn)
     {
@@ -476,6 +534,8 @@ public:
 
     void AskFor(const CInv& inv);
 
+    uint32_t GetReconShortID(const uint256& txid) const;
+
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?
     void BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend);
 
@@ -485,6 +545,9 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    /** Queue a message built with MakeSendBuffer, the buffer is shared rather than copied */
+    void PushBuffer(const CSendBuffer& buf);
+
     void PushVersion();
 
 
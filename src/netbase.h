@@ -222,5 +222,11 @@ bool SetSocketNonBlocking(SOCKET& hSocket, bool fNonBlocking);
  * Convert milliseconds to a struct timeval for e.g. select.
  */
 struct timeval MillisToTimeval(int64_t nTimeout);
+/**
+ * Wait up to nTimeout milliseconds for hSocket to become readable (or writable
+ * if fWrite). Like select() on the one socket, but not limited to FD_SETSIZE.
+ * Returns > 0 when ready, 0 on timeout and SOCKET_ERROR on failure.
+ */
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeout);
 
 #endif // BITCOIN_NETBASE_H
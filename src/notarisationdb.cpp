@@ -7,12 +7,54 @@
 #include "notaries_staked.h"
 
 #include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
 
 
 NotarisationDB *pnotarisations;
 
 
-NotarisationDB::NotarisationDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "notarisations", nCacheSize, fMemory, fWipe, false, 64) { }
+static const char DB_NOTARISATION_HEIGHT = 'N';
+static const char DB_NOTARISATION_FLAG = 'F';
+
+
+/*
+ * (symbol, height) -> first notarisation for symbol in the block at height.
+ * Heights are stored big-endian so a symbol's entries sort by height.
+ */
+struct CNotarisationHeightKey
+{
+    std::string symbol;
+    int height;
+
+    CNotarisationHeightKey(std::string symbolIn="", int heightIn=0) : symbol(symbolIn), height(heightIn) { }
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, DB_NOTARISATION_HEIGHT);
+        ::Serialize(s, symbol);
+        ser_writedata32be(s, height);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        if (ser_readdata8(s) != DB_NOTARISATION_HEIGHT)
+            throw std::ios_base::failure("not a notarisation height key");
+        ::Unserialize(s, symbol);
+        height = ser_readdata32be(s);
+    }
+};
+
+
+NotarisationDB::NotarisationDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "notarisations", nCacheSize, fMemory, fWipe, false, 64)
+{
+    std::pair<char, std::string> flagKey = std::make_pair(DB_NOTARISATION_FLAG, std::string("heightindex"));
+    fHeightIndex = false;
+    if (!Read(flagKey, fHeightIndex) && IsEmpty()) {
+        fHeightIndex = true;
+        Write(flagKey, fHeightIndex);
+    }
+    if (!fHeightIndex)
+        LogPrintf("NotarisationDB: no height index, notarisation lookups scan block by block until -reindex\n");
+}
 
 
 NotarisationsInBlock ScanBlockNotarisations(const CBlock &block, int nHeight)
@@ -86,30 +128,61 @@ bool GetBackNotarisation(uint256 notarisationHash, Notarisation &n)
 
 
 /*
- * Write an index of SAFE notarisation id -> backnotarisation
+ * Write an index of SAFE notarisation id -> backnotarisation, and of
+ * (symbol, height) -> the block's first notarisation for that symbol
  */
-void WriteBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &batch)
+void WriteBackNotarisations(const NotarisationsInBlock notarisations, int nHeight, CDBBatch &batch)
 {
     int wrote = 0;
+    std::set<std::string> symbols;
     BOOST_FOREACH(const Notarisation &n, notarisations)
     {
         if (!n.second.txHash.IsNull()) {
             batch.Write(n.second.txHash, n);
             wrote++;
         }
+        if (symbols.insert(n.second.symbol).second)
+            batch.Write(CNotarisationHeightKey(n.second.symbol, nHeight), n);
     }
 }
 
 
-void EraseBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &batch)
+void EraseBackNotarisations(const NotarisationsInBlock notarisations, int nHeight, CDBBatch &batch)
 {
     BOOST_FOREACH(const Notarisation &n, notarisations)
     {
         if (!n.second.txHash.IsNull())
             batch.Erase(n.second.txHash);
+        batch.Erase(CNotarisationHeightKey(n.second.symbol, nHeight));
     }
 }
 
+/*
+ * Position it on the height index entry for symbol at or after height
+ * (fForward) or at or before it. False if there is no such entry.
+ */
+static bool SeekNotarisationHeight(CDBIterator &it, std::string symbol, int height, bool fForward, Notarisation& out, int &outHeight)
+{
+    CNotarisationHeightKey key;
+    if (fForward) {
+        it.Seek(CNotarisationHeightKey(symbol, height));
+    } else {
+        it.Seek(CNotarisationHeightKey(symbol, height + 1));
+        if (it.Valid())
+            it.Prev();
+        else
+            it.SeekToLast();
+    }
+    if (!it.Valid() || !it.GetKey(key) || key.symbol != symbol)
+        return false;
+    if (fForward ? key.height < height : key.height > height)
+        return false;
+    if (!it.GetValue(out))
+        return false;
+    outHeight = key.height;
+    return true;
+}
+
 /*
  * Scan notarisationsdb backwards for blocks containing a notarisation
  * for given symbol. Return height of matched notarisation or 0.
@@ -119,6 +192,14 @@ int ScanNotarisationsDB(int height, std::string symbol, int scanLimitBlocks, Not
     if (height < 0 || height > chainActive.Height())
         return false;
 
+    if (pnotarisations->HasHeightIndex()) {
+        boost::scoped_ptr<CDBIterator> it(pnotarisations->NewIterator());
+        int matchedHeight;
+        if (SeekNotarisationHeight(*it, symbol, height, false, out, matchedHeight) && matchedHeight > height - scanLimitBlocks)
+            return matchedHeight;
+        return 0;
+    }
+
     for (int i=0; i<scanLimitBlocks; i++) {
         if (i > height) break;
         NotarisationsInBlock notarisations;
@@ -142,6 +223,13 @@ int ScanNotarisationsDB2(int height, std::string symbol, int scanLimitBlocks, No
     maxheight = chainActive.Height();
     if ( height < 0 || height > maxheight )
         return false;
+    if ( pnotarisations->HasHeightIndex() )
+    {
+        boost::scoped_ptr<CDBIterator> it(pnotarisations->NewIterator());
+        if ( SeekNotarisationHeight(*it,symbol,height,true,out,ht) && ht < height+scanLimitBlocks && ht <= maxheight )
+            return(ht);
+        return 0;
+    }
     for (i=0; i<scanLimitBlocks; i++)
     {
         ht = height+i;
@@ -162,3 +250,106 @@ int ScanNotarisationsDB2(int height, std::string symbol, int scanLimitBlocks, No
     }
     return 0;
 }
+
+
+static CCriticalSection cs_notarisationIndex;
+static std::vector<NotarisationIndexEntry> vNotarisationIndex;
+static std::string strNotarisationIndexSymbol;
+static bool fNotarisationIndexLoaded = false;
+
+static bool CompareNotarisedHeight(const NotarisationIndexEntry &a, const NotarisationIndexEntry &b)
+{
+    return a.notarisedHeight < b.notarisedHeight;
+}
+
+static void InsertNotarisationIndex(const Notarisation &n, int nHeight)
+{
+    NotarisationIndexEntry entry;
+    entry.notarisedHeight = n.second.height;
+    entry.txHeight = nHeight;
+    entry.txid = n.first;
+    entry.destTxid = n.second.txHash;
+    // notarised heights only go up on a sane chain, so this is nearly always an append
+    vNotarisationIndex.insert(std::upper_bound(vNotarisationIndex.begin(), vNotarisationIndex.end(), entry, CompareNotarisedHeight), entry);
+}
+
+/*
+ * Rebuild the index for symbol from the height index entries. Needs
+ * cs_notarisationIndex held.
+ */
+static bool LoadNotarisationIndex(std::string symbol)
+{
+    vNotarisationIndex.clear();
+    strNotarisationIndexSymbol = symbol;
+    fNotarisationIndexLoaded = false;
+    if (pnotarisations == NULL || !pnotarisations->HasHeightIndex())
+        return false;
+
+    boost::scoped_ptr<CDBIterator> it(pnotarisations->NewIterator());
+    CNotarisationHeightKey key;
+    Notarisation n;
+    for (it->Seek(CNotarisationHeightKey(symbol, 0)); it->Valid(); it->Next()) {
+        if (!it->GetKey(key) || key.symbol != symbol || !it->GetValue(n))
+            break;
+        InsertNotarisationIndex(n, key.height);
+    }
+    fNotarisationIndexLoaded = true;
+    LogPrintf("NotarisationDB: indexed %u %s notarisations\n", vNotarisationIndex.size(), symbol);
+    return true;
+}
+
+/*
+ * prev is the last notarisation of a height at or below height, next the
+ * first one above it. False if there is no prev, an empty next means height
+ * is not notarised yet.
+ */
+bool FindNotarisationBracket(const std::vector<NotarisationIndexEntry> &index, int height, NotarisationIndexEntry &prev, NotarisationIndexEntry &next)
+{
+    NotarisationIndexEntry entry;
+    entry.notarisedHeight = height;
+    std::vector<NotarisationIndexEntry>::const_iterator it = std::upper_bound(index.begin(), index.end(), entry, CompareNotarisedHeight);
+
+    prev = next = NotarisationIndexEntry();
+    if (it != index.end())
+        next = *it;
+    if (it == index.begin())
+        return false;
+    prev = *(it - 1);
+    return prev.notarisedHeight > 0;
+}
+
+bool GetNotarisationBracket(std::string symbol, int height, NotarisationIndexEntry &prev, NotarisationIndexEntry &next)
+{
+    LOCK(cs_notarisationIndex);
+    if ((!fNotarisationIndexLoaded || symbol != strNotarisationIndexSymbol) && !LoadNotarisationIndex(symbol))
+        return false;
+    return FindNotarisationBracket(vNotarisationIndex, height, prev, next);
+}
+
+void AddNotarisationIndex(const NotarisationsInBlock &notarisations, int nHeight)
+{
+    LOCK(cs_notarisationIndex);
+    if (!fNotarisationIndexLoaded)
+        return;
+    BOOST_FOREACH(const Notarisation &n, notarisations)
+    {
+        if (strNotarisationIndexSymbol != n.second.symbol)
+            continue;
+        // already there if the block was written before the index was loaded
+        if (vNotarisationIndex.empty() || vNotarisationIndex.back().txHeight < nHeight)
+            InsertNotarisationIndex(n, nHeight);
+        return;
+    }
+}
+
+void EraseNotarisationIndex(int nHeight)
+{
+    LOCK(cs_notarisationIndex);
+    std::vector<NotarisationIndexEntry>::iterator it = vNotarisationIndex.begin();
+    while (it != vNotarisationIndex.end()) {
+        if (it->txHeight >= nHeight)
+            it = vNotarisationIndex.erase(it);
+        else
+            it++;
+    }
+}
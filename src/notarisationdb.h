@@ -8,8 +8,11 @@
 
 class NotarisationDB : public CDBWrapper
 {
+    //! true once every connected block has its (symbol, height) entries, i.e. the db was started empty
+    bool fHeightIndex;
 public:
     NotarisationDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    bool HasHeightIndex() const { return fHeightIndex; }
 };
 
 
@@ -21,10 +24,30 @@ typedef std::vector<Notarisation> NotarisationsInBlock;
 NotarisationsInBlock ScanBlockNotarisations(const CBlock &block, int nHeight);
 bool GetBlockNotarisations(uint256 blockHash, NotarisationsInBlock &nibs);
 bool GetBackNotarisation(uint256 notarisationHash, Notarisation &n);
-void WriteBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &batch);
-void EraseBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &batch);
+void WriteBackNotarisations(const NotarisationsInBlock notarisations, int nHeight, CDBBatch &batch);
+void EraseBackNotarisations(const NotarisationsInBlock notarisations, int nHeight, CDBBatch &batch);
 int ScanNotarisationsDB(int height, std::string symbol, int scanLimitBlocks, Notarisation& out);
 int ScanNotarisationsDB2(int height, std::string symbol, int scanLimitBlocks, Notarisation& out);
 bool IsTXSCL(const char* symbol);
 
+/*
+ * In memory index of one symbol's notarisations (the first per block, as in
+ * the height index), ordered by notarised height, for bracketing a height
+ * between the notarisations before and after it without scanning the db.
+ */
+struct NotarisationIndexEntry
+{
+    int notarisedHeight;
+    int txHeight;
+    uint256 txid;
+    uint256 destTxid;
+
+    NotarisationIndexEntry() : notarisedHeight(0), txHeight(0) { }
+};
+
+bool FindNotarisationBracket(const std::vector<NotarisationIndexEntry> &index, int height, NotarisationIndexEntry &prev, NotarisationIndexEntry &next);
+bool GetNotarisationBracket(std::string symbol, int height, NotarisationIndexEntry &prev, NotarisationIndexEntry &next);
+void AddNotarisationIndex(const NotarisationsInBlock &notarisations, int nHeight);
+void EraseNotarisationIndex(int nHeight);
+
 #endif  /* NOTARISATIONDB_H */
@@ -0,0 +1,52 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "notaryset.h"
+
+#include "sync.h"
+#include "utilstrencodings.h"
+
+#include <map>
+#include <string.h>
+
+CNotarySet::CNotarySet(const std::vector<std::vector<unsigned char> >& vPubkeysIn) : vPubkeys(vPubkeysIn)
+{
+    for (size_t i = 0; i < vPubkeys.size(); i++) {
+        vHexkeys.push_back(HexStr(vPubkeys[i]));
+        setHexkeys.insert(vHexkeys.back());
+    }
+}
+
+bool CNotarySet::IsNotary(const uint8_t *pubkey33) const
+{
+    for (size_t i = 0; i < vPubkeys.size(); i++) {
+        if (memcmp(&vPubkeys[i][0], pubkey33, 33) == 0)
+            return true;
+    }
+    return false;
+}
+
+static CCriticalSection cs_notarysets;
+//! raw concatenated pubkeys -> set; only a handful of seasons and eras ever exist
+static std::map<std::string, CNotarySetRef> mapNotarySets;
+
+CNotarySetRef GetSharedNotarySet(const uint8_t pubkeys[][33], int32_t n)
+{
+    static const CNotarySetRef emptySet = std::make_shared<const CNotarySet>();
+    if (n <= 0)
+        return emptySet;
+
+    std::string key((const char *)pubkeys[0], (size_t)n * 33);
+    LOCK(cs_notarysets);
+    std::map<std::string, CNotarySetRef>::const_iterator it = mapNotarySets.find(key);
+    if (it != mapNotarySets.end())
+        return it->second;
+
+    std::vector<std::vector<unsigned char> > vPubkeys;
+    for (int32_t i = 0; i < n; i++)
+        vPubkeys.push_back(std::vector<unsigned char>(pubkeys[i], pubkeys[i] + 33));
+    CNotarySetRef set = std::make_shared<const CNotarySet>(vPubkeys);
+    mapNotarySets.insert(std::make_pair(key, set));
+    return set;
+}
@@ -0,0 +1,49 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_NOTARYSET_H
+#define SAFECOIN_NOTARYSET_H
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * An immutable set of notary pubkeys as returned by safecoin_notaries() for
+ * one season (or era), in binary and hex form. Shared between callers, so
+ * membership tests no longer rebuild and hex encode the list every time.
+ */
+class CNotarySet
+{
+private:
+    std::vector<std::vector<unsigned char> > vPubkeys;
+    std::vector<std::string> vHexkeys;
+    std::unordered_set<std::string> setHexkeys;
+
+public:
+    CNotarySet() {}
+    explicit CNotarySet(const std::vector<std::vector<unsigned char> >& vPubkeysIn);
+
+    /** Notary pubkeys (33 bytes) in notary id order */
+    const std::vector<std::vector<unsigned char> >& Pubkeys() const { return vPubkeys; }
+    /** The same pubkeys hex encoded */
+    const std::vector<std::string>& Hexkeys() const { return vHexkeys; }
+
+    bool IsNotary(const std::string& hexkey) const { return setHexkeys.count(hexkey) != 0; }
+    /** Same test on a binary pubkey; a plain scan, there are at most 64 notaries */
+    bool IsNotary(const uint8_t *pubkey33) const;
+    size_t Size() const { return vPubkeys.size(); }
+};
+
+typedef std::shared_ptr<const CNotarySet> CNotarySetRef;
+
+/** Shared set for these notary pubkeys, built once and reused for every later lookup of the same set */
+CNotarySetRef GetSharedNotarySet(const uint8_t pubkeys[][33], int32_t n);
+
+/** Notaries at height (or timestamp on assetchains), empty if they can't be determined. Defined with safecoin_notaries() */
+CNotarySetRef safecoin_notaryset(int32_t height, uint32_t timestamp);
+
+#endif // SAFECOIN_NOTARYSET_H
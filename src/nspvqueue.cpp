@@ -0,0 +1,112 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "nspvqueue.h"
+
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+static CNSPVRequestQueue *pnspvqueue = NULL;
+
+bool CNSPVRequestQueue::Push(CNode *pfrom, const std::vector<uint8_t> &request)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        std::map<NodeId, std::pair<CNode*, RequestList> >::iterator it = mapPending.find(pfrom->id);
+        if (nPending >= nMaxPending || (it != mapPending.end() && it->second.second.size() >= NSPV_QUEUE_PER_PEER))
+            return false;
+        if (it == mapPending.end()) {
+            {
+                LOCK(cs_vNodes);
+                pfrom->AddRef();
+            }
+            it = mapPending.insert(std::make_pair(pfrom->id, std::make_pair(pfrom, RequestList()))).first;
+            if (!setBusy.count(pfrom->id))
+                queueReady.push_back(pfrom->id);
+        }
+        it->second.second.push_back(request);
+        nPending++;
+    }
+    condWorker.notify_one();
+    return true;
+}
+
+void CNSPVRequestQueue::Thread()
+{
+    while (true) {
+        CNode *pfrom;
+        std::vector<uint8_t> request;
+        bool fLast;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queueReady.empty())
+                condWorker.wait(lock); // interruption point
+            NodeId id = queueReady.front();
+            queueReady.pop_front();
+            std::map<NodeId, std::pair<CNode*, RequestList> >::iterator it = mapPending.find(id);
+            pfrom = it->second.first;
+            request.swap(it->second.second.front());
+            it->second.second.pop_front();
+            nPending--;
+            fLast = it->second.second.empty();
+            if (fLast)
+                mapPending.erase(it);
+            setBusy.insert(id);
+        }
+
+        if (!pfrom->fDisconnect) {
+            try {
+                handler(pfrom, request);
+            } catch (const std::exception& e) {
+                PrintExceptionContinue(&e, "CNSPVRequestQueue::Thread()");
+            }
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            setBusy.erase(pfrom->id);
+            // requests left, or new ones that came in meanwhile
+            if (mapPending.count(pfrom->id)) {
+                queueReady.push_back(pfrom->id);
+                condWorker.notify_one();
+            }
+        }
+        // the reference came with the peer's last queued request, later requests hold their own
+        if (fLast) {
+            LOCK(cs_vNodes);
+            pfrom->Release();
+        }
+    }
+}
+
+size_t CNSPVRequestQueue::Size()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nPending;
+}
+
+static void ThreadNSPVWorker()
+{
+    RenameThread("safecoin-nspv");
+    pnspvqueue->Thread();
+}
+
+void StartNSPVWorkers(boost::thread_group &threadGroup, int nThreads, size_t nMaxPending, CNSPVRequestQueue::Handler handler)
+{
+    if (nThreads <= 0 || pnspvqueue != NULL)
+        return;
+    pnspvqueue = new CNSPVRequestQueue(handler, nMaxPending);
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(&ThreadNSPVWorker);
+}
+
+bool QueueNSPVRequest(CNode *pfrom, const std::vector<uint8_t> &request)
+{
+    if (pnspvqueue == NULL)
+        return false;
+    if (!pnspvqueue->Push(pfrom, request))
+        LogPrint("net", "nSPV request queue full, dropping request from peer=%d\n", pfrom->id);
+    return true;
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_NSPVQUEUE_H
+#define SAFECOIN_NSPVQUEUE_H
+
+#include "net.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** -nspvthreads default, 0 answers nSPV requests on the message handler thread */
+static const int DEFAULT_NSPV_THREADS = 2;
+/** -nspvqueue default, requests waiting for a worker before new ones are dropped */
+static const unsigned int DEFAULT_NSPV_QUEUE = 1024;
+/** Requests one peer may have waiting */
+static const unsigned int NSPV_QUEUE_PER_PEER = 16;
+
+/**
+ * nSPV requests waiting for the worker threads. Each peer has its own queue
+ * and peers take turns, one request at a time, so a peer sending a burst
+ * only delays itself. A peer's requests are never answered concurrently,
+ * they keep their order and the per peer rate limiting state is only
+ * touched by one thread.
+ */
+class CNSPVRequestQueue
+{
+public:
+    typedef void (*Handler)(CNode *pfrom, std::vector<uint8_t> request);
+
+private:
+    typedef std::deque<std::vector<uint8_t> > RequestList;
+
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    Handler handler;
+    size_t nMaxPending;
+    size_t nPending;
+    //! requests and their peer, which holds a reference for each
+    std::map<NodeId, std::pair<CNode*, RequestList> > mapPending;
+    //! peers with requests waiting and none being answered, in turn order
+    std::deque<NodeId> queueReady;
+    std::set<NodeId> setBusy;
+
+public:
+    CNSPVRequestQueue(Handler handlerIn, size_t nMaxPendingIn) : handler(handlerIn), nMaxPending(nMaxPendingIn), nPending(0) {}
+
+    /** Queue request from pfrom, false if it was dropped because the queue is full */
+    bool Push(CNode *pfrom, const std::vector<uint8_t> &request);
+    /** Worker thread body, answers requests until interrupted */
+    void Thread();
+    size_t Size();
+};
+
+/** Start nThreads workers answering nSPV requests with handler */
+void StartNSPVWorkers(boost::thread_group &threadGroup, int nThreads, size_t nMaxPending, CNSPVRequestQueue::Handler handler);
+/** Hand request to the workers, false if there are none and the caller has to answer it */
+bool QueueNSPVRequest(CNode *pfrom, const std::vector<uint8_t> &request);
+
+#endif // SAFECOIN_NSPVQUEUE_H
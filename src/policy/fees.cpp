@@ -85,9 +85,8 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
     if (blocksToConfirm < 1)
         return;
     unsigned int bucketindex = FindBucketIndex(val);
-    for (size_t i = blocksToConfirm; i <= curBlockConf.size(); i++) {
-        curBlockConf[i - 1][bucketindex]++;
-    }
+    if ((size_t)blocksToConfirm <= curBlockConf.size())
+        curBlockConf[blocksToConfirm - 1][bucketindex]++;
     curBlockTxCt[bucketindex]++;
     curBlockVal[bucketindex] += val;
 }
@@ -95,8 +94,12 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
 void TxConfirmStats::UpdateMovingAverages()
 {
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay + curBlockConf[i][j];
+        // a tx confirmed in Y blocks was also confirmed within every count above Y
+        int confirmed = 0;
+        for (unsigned int i = 0; i < confAvg.size(); i++) {
+            confirmed += curBlockConf[i][j];
+            confAvg[i][j] = confAvg[i][j] * decay + confirmed;
+        }
         avg[j] = avg[j] * decay + curBlockVal[j];
         txCtAvg[j] = txCtAvg[j] * decay + curBlockTxCt[j];
     }
@@ -348,6 +351,11 @@ CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee)
     feeLikely = CFeeRate(INF_FEERATE);
     priUnlikely = 0;
     priLikely = INF_PRIORITY;
+
+    for (unsigned int i = 0; i < MAX_BLOCK_CONFIRMS; i++) {
+        feeEstimates[i] = 0;
+        priEstimates[i] = -1;
+    }
 }
 
 bool CBlockPolicyEstimator::isFeeDataPoint(const CFeeRate &fee, double pri)
@@ -474,8 +482,11 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     // Only want to be updating estimates when our blockchain is synced,
     // otherwise we'll miscalculate how many blocks its taking to get included.
-    if (!fCurrentEstimate)
+    if (!fCurrentEstimate) {
+        // the mempool counts are looked up by height, so the answers still move on
+        UpdateEstimates();
         return;
+    }
 
     // Update the dynamic cutoffs
     // a fee/priority is "likely" the reason your tx was included in a block if >85% of such tx's
@@ -513,31 +524,47 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     feeStats.UpdateMovingAverages();
     priStats.UpdateMovingAverages();
 
+    UpdateEstimates();
+
     LogPrint("estimatefee", "Blockpolicy after updating estimates for %u confirmed entries, new mempool map size %u\n",
              entries.size(), mapMemPoolTxs.size());
 }
 
-CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
+void CBlockPolicyEstimator::UpdateEstimates()
 {
-    // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > feeStats.GetMaxConfirms())
-        return CFeeRate(0);
+    for (unsigned int i = 0; i < MAX_BLOCK_CONFIRMS; i++) {
+        int confTarget = i + 1;
+        CAmount nFee = 0;
+        if ((unsigned int)confTarget <= feeStats.GetMaxConfirms()) {
+            double median = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+            if (median >= 0)
+                nFee = CFeeRate(median).GetFeePerK();
+        }
+        feeEstimates[i] = nFee;
 
-    double median = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+        double dPriority = -1;
+        if ((unsigned int)confTarget <= priStats.GetMaxConfirms())
+            dPriority = priStats.EstimateMedianVal(confTarget, SUFFICIENT_PRITXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+        priEstimates[i] = dPriority;
+    }
+}
 
-    if (median < 0)
+CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
+{
+    // Return failure if trying to analyze a target we're not tracking
+    if (confTarget <= 0 || (unsigned int)confTarget > MAX_BLOCK_CONFIRMS)
         return CFeeRate(0);
 
-    return CFeeRate(median);
+    return CFeeRate(feeEstimates[confTarget - 1].load());
 }
 
-double CBlockPolicyEstimator::estimatePriority(int confTarget)
+double CBlockPolicyEstimator::estimatePriority(int confTarget) const
 {
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > priStats.GetMaxConfirms())
+    if (confTarget <= 0 || (unsigned int)confTarget > MAX_BLOCK_CONFIRMS)
         return -1;
 
-    return priStats.EstimateMedianVal(confTarget, SUFFICIENT_PRITXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    return priEstimates[confTarget - 1].load();
 }
 
 void CBlockPolicyEstimator::Write(CAutoFile& fileout)
@@ -554,4 +581,5 @@ void CBlockPolicyEstimator::Read(CAutoFile& filein)
     feeStats.Read(filein);
     priStats.Read(filein);
     nBestSeenHeight = nFileBestSeenHeight;
+    UpdateEstimates();
 }
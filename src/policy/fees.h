@@ -24,6 +24,7 @@
 #include "amount.h"
 #include "uint256.h"
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <vector>
@@ -80,6 +81,10 @@ class CTxMemPoolEntry;
  * the number of transactions we've seen in that fee bucket when calculating
  * an estimate for any number of confirmations below the number of blocks
  * they've been outstanding.
+ *
+ * The answers for every confirmation target are worked out once per block,
+ * when the moving averages change, and kept in atomics so estimateFee and
+ * estimatePriority never have to take the mempool lock.
  */
 
 /** Decay of .998 is a half-life of 346 blocks or about 2.4 days */
@@ -113,7 +118,8 @@ private:
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
     std::vector<std::vector<double> > confAvg; // confAvg[Y][X]
-    // and calcuate the totals for the current block to update the moving averages
+    // and count the txs confirmed in exactly Y blocks for the current block, the
+    // running totals for "within Y" are summed up when the moving averages are
     std::vector<std::vector<int> > curBlockConf; // curBlockConf[Y][X]
 
     // Sum the total priority/fee of all txs in each bucket
@@ -240,7 +246,10 @@ public:
     /** Create new BlockPolicyEstimator and initialize stats tracking classes with default values */
     CBlockPolicyEstimator(const CFeeRate& minRelayFee);
 
-    /** Process all the transactions that have been included in a block */
+    /**
+     * Process all the transactions that have been included in a block and
+     * refresh the estimates for every target
+     */
     void processBlock(unsigned int nBlockHeight,
                       std::vector<CTxMemPoolEntry>& entries, bool fCurrentEstimate);
 
@@ -259,11 +268,11 @@ public:
     /** Is this transaction likely included in a block because of its priority?*/
     bool isPriDataPoint(const CFeeRate &fee, double pri);
 
-    /** Return a fee estimate */
-    CFeeRate estimateFee(int confTarget);
+    /** Return the fee estimate of the last block, safe to call without holding any lock */
+    CFeeRate estimateFee(int confTarget) const;
 
-    /** Return a priority estimate */
-    double estimatePriority(int confTarget);
+    /** Return the priority estimate of the last block, safe to call without holding any lock */
+    double estimatePriority(int confTarget) const;
 
     /** Write estimation data to a file */
     void Write(CAutoFile& fileout);
@@ -292,5 +301,12 @@ private:
     /** Breakpoints to help determine whether a transaction was confirmed by priority or Fee */
     CFeeRate feeLikely, feeUnlikely;
     double priLikely, priUnlikely;
+
+    /** Estimates for targets 1 to MAX_BLOCK_CONFIRMS, 0 and -1 where there is none */
+    std::atomic<CAmount> feeEstimates[MAX_BLOCK_CONFIRMS];
+    std::atomic<double> priEstimates[MAX_BLOCK_CONFIRMS];
+
+    /** Recompute the estimates for every target from the current stats */
+    void UpdateEstimates();
 };
 #endif /*BITCOIN_POLICYESTIMATOR_H */
@@ -27,9 +27,14 @@
 #include "crypto/equihash.h"
 #include "primitives/block.h"
 #include "streams.h"
+#include "sync.h"
 #include "uint256.h"
 #include "util.h"
 
+#include <deque>
+#include <map>
+#include <set>
+
 #include "sodium.h"
 
 #ifdef ENABLE_RUST
@@ -295,7 +300,42 @@ arith_uint256 zawy_TSA_EMA(int32_t height,int32_t tipdiff,arith_uint256 prevTarg
     return(bnTarget);
 }
 
+// nBits of the block after a known block. Unless the adaptive PoW looks at the new block's time, the
+// target only depends on the window ending at its parent, which the parent hash pins down for good.
+// Headers, blocks and templates at the same height all ask for it.
+static CCriticalSection cs_nextwork;
+static std::map<uint256, unsigned int> mapNextWork;
+static std::deque<uint256> dqNextWork;   // insertion order, oldest dropped first
+static const size_t MAX_NEXTWORK = 1000;
+
+static unsigned int _GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params);
+
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
+{
+    bool fLwma = (ASSETCHAINS_ALGO != ASSETCHAINS_EQUIHASH && ASSETCHAINS_STAKED == 0);
+    if (pindexLast == NULL || pindexLast->phashBlock == NULL || (ASSETCHAINS_ADAPTIVEPOW > 0 && !fLwma) || &params != &Params().GetConsensus())
+        return _GetNextWorkRequired(pindexLast, pblock, params);
+
+    uint256 hash = pindexLast->GetBlockHash();
+    {
+        LOCK(cs_nextwork);
+        std::map<uint256, unsigned int>::const_iterator it = mapNextWork.find(hash);
+        if (it != mapNextWork.end())
+            return it->second;
+    }
+    unsigned int nbits = _GetNextWorkRequired(pindexLast, pblock, params);
+    LOCK(cs_nextwork);
+    if (mapNextWork.insert(std::make_pair(hash, nbits)).second) {
+        dqNextWork.push_back(hash);
+        while (dqNextWork.size() > MAX_NEXTWORK) {
+            mapNextWork.erase(dqNextWork.front());
+            dqNextWork.pop_front();
+        }
+    }
+    return nbits;
+}
+
+static unsigned int _GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
     if (ASSETCHAINS_ALGO != ASSETCHAINS_EQUIHASH && ASSETCHAINS_STAKED == 0)
         return lwmaGetNextWorkRequired(pindexLast, pblock, params);
@@ -764,10 +804,41 @@ uint32_t lwmaGetNextPOSRequired(const CBlockIndex* pindexLast, const Consensus::
     return nextTarget.GetCompact();
 }
 
+// blocks go through CheckBlockHeader, safecoin_checkPOW and CheckBlock, each of which checks the solution
+static CCriticalSection cs_equihashvalid;
+static std::set<uint256> setEquihashValid;
+static std::deque<uint256> dqEquihashValid;   // insertion order, oldest dropped first
+static const size_t MAX_EQUIHASHVALID = 10000;
+
+static bool _CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params);
+
 bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
 {
     if (ASSETCHAINS_ALGO != ASSETCHAINS_EQUIHASH)
         return true;
+
+    // the block hash commits to the solution, so a hash that was valid once stays valid
+    uint256 hash = pblock->GetHash();
+    {
+        LOCK(cs_equihashvalid);
+        if (setEquihashValid.count(hash) != 0)
+            return true;
+    }
+    if (!_CheckEquihashSolution(pblock, params))
+        return false;
+    LOCK(cs_equihashvalid);
+    if (setEquihashValid.insert(hash).second) {
+        dqEquihashValid.push_back(hash);
+        while (dqEquihashValid.size() > MAX_EQUIHASHVALID) {
+            setEquihashValid.erase(dqEquihashValid.front());
+            dqEquihashValid.pop_front();
+        }
+    }
+    return true;
+}
+
+static bool _CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
+{
     
     if ( ASSETCHAINS_NK[0] != 0 && ASSETCHAINS_NK[1] != 0 && pblock->GetHash().ToString() == "027e3758c3a65b12aa1046462b486d0a63bfa1beae327897f56c5cfb7daaae71" )
         return true;
@@ -527,6 +527,7 @@ class CTransaction
 private:
     /** Memory only. */
     const uint256 hash;
+    const unsigned int nTotalSize = 0;
     void UpdateHash() const;
 
 protected:
@@ -660,6 +661,12 @@ public:
         return hash;
     }
 
+    // Serialized size, cached alongside the hash. The encoding of a transaction
+    // does not depend on the stream type or version, so it holds for all of them.
+    unsigned int GetTotalSize() const {
+        return nTotalSize;
+    }
+
     uint32_t GetHeader() const {
         // When serializing v1 and v2, the 4 byte header is nVersion
         uint32_t header = this->nVersion;
@@ -32,7 +32,8 @@ static const char* ppszTypeName[] =
     "ERROR",
     "tx",
     "block",
-    "filtered block"
+    "filtered block",
+    "cmpct block"
 };
 
 CMessageHeader::CMessageHeader(const MessageStartChars& pchMessageStartIn)
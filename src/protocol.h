@@ -90,6 +90,9 @@ enum {
     // Zcash nodes used to support this by default, without advertising this bit,
     // but no longer do as of protocol version 170004 (= NO_BLOOM_VERSION)
     NODE_BLOOM = (1 << 2),
+    // NODE_COMPACT_FILTERS means the node serves the basic block filters of BIP157/158,
+    // with getcfilters, getcfheaders and getcfcheckpt.
+    NODE_COMPACT_FILTERS = (1 << 6),
 
     NODE_NSPV = (1 << 30),
     NODE_ADDRINDEX = (1 << 29),
@@ -173,6 +176,9 @@ enum {
     // Nodes may always request a MSG_FILTERED_BLOCK in a getdata, however,
     // MSG_FILTERED_BLOCK should not appear in any invs except as a part of getdata.
     MSG_FILTERED_BLOCK,
+    // MSG_CMPCT_BLOCK asks for a compact block (BIP 152) in a getdata, it does
+    // not appear in invs either.
+    MSG_CMPCT_BLOCK,
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -20,6 +20,7 @@
 
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "base58.h"
 #include "main.h"
 #include "httpserver.h"
 #include "rpc/server.h"
@@ -71,6 +72,48 @@ struct CCoin {
     }
 };
 
+/** An address index unspent output, entries of /rest/address/utxos without the address repeated */
+struct CAddressCoin {
+    uint256 txhash;
+    uint32_t nIndex;
+    CAmount nValue;
+    CScript script;
+    uint32_t nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(txhash);
+        READWRITE(nIndex);
+        READWRITE(nValue);
+        READWRITE(*(CScriptBase*)(&script));
+        READWRITE(nHeight);
+    }
+};
+
+/** An address index delta, entries of /rest/address/deltas; spends have a negative value */
+struct CAddressDelta {
+    uint32_t nHeight;
+    uint32_t nTxIndex;
+    uint256 txhash;
+    uint32_t nIndex;
+    CAmount nValue;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nHeight);
+        READWRITE(nTxIndex);
+        READWRITE(txhash);
+        READWRITE(nIndex);
+        READWRITE(nValue);
+    }
+};
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 extern UniValue mempoolInfoToJSON();
@@ -605,6 +648,264 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * Parses /rest/address/<kind>/<address>[/<start>/<end>].<ext> into the index key of the address
+ * and the optional inclusive block height range, returning false with an error reply sent.
+ */
+static bool ParseAddressURI(HTTPRequest* req, const std::string& strURIPart, enum RetFormat& rf,
+                            std::string& strAddress, uint160& hashBytes, int& type, int& nStart, int& nEnd)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    rf = ParseDataFormat(params, strURIPart);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+    if (path.size() != 1 && path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/address/<kind>/<address>[/<start>/<end>].<ext>.");
+
+    strAddress = path[0];
+    CBitcoinAddress address(strAddress);
+    if (!address.GetIndexKey(hashBytes, type, false))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + strAddress);
+
+    nStart = nEnd = 0;
+    if (path.size() == 3) {
+        if (!ParseInt32(path[1], &nStart) || !ParseInt32(path[2], &nEnd) || nStart < 1 || nEnd < nStart)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height range: " + path[1] + "/" + path[2]);
+    }
+    return true;
+}
+
+/** Writes a result serialized after the chain height and tip hash, as bin or hex */
+static bool WriteAddressReply(HTTPRequest* req, enum RetFormat rf, const CDataStream& ssResult)
+{
+    if (rf == RF_BINARY) {
+        string strBinary = ssResult.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, strBinary);
+    } else {
+        string strHex = HexStr(ssResult.begin(), ssResult.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+    }
+    return true;
+}
+
+static void GetAddressReplyTip(int& nHeight, uint256& hashBlock)
+{
+    std::shared_ptr<const CChainTipSnapshot> tip = GetChainTipSnapshot();
+    if (tip) {
+        nHeight = tip->nHeight;
+        hashBlock = tip->hashBlock;
+        return;
+    }
+    LOCK(cs_main);
+    nHeight = chainActive.Height();
+    hashBlock = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+}
+
+static bool rest_address_utxos(HTTPRequest* req, const std::string& strURIPart)
+{
+    enum RetFormat rf;
+    std::string strAddress;
+    uint160 hashBytes;
+    int type, nStart, nEnd;
+    if (!ParseAddressURI(req, strURIPart, rf, strAddress, hashBytes, type, nStart, nEnd))
+        return false;
+
+    int nTipHeight;
+    uint256 hashTip;
+    GetAddressReplyTip(nTipHeight, hashTip);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    if (!GetAddressUnspent(hashBytes, type, unspentOutputs))
+        return RESTERR(req, HTTP_NOT_FOUND, "No information available for address " + strAddress);
+
+    vector<CAddressCoin> coins;
+    coins.reserve(unspentOutputs.size());
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        if (nStart > 0 && (it->second.blockHeight < nStart || it->second.blockHeight > nEnd))
+            continue;
+        CAddressCoin coin;
+        coin.txhash = it->first.txhash;
+        coin.nIndex = it->first.index;
+        coin.nValue = it->second.satoshis;
+        coin.script = it->second.script;
+        coin.nHeight = it->second.blockHeight;
+        coins.push_back(coin);
+    }
+
+    if (rf != RF_JSON) {
+        CDataStream ssResult(SER_NETWORK, PROTOCOL_VERSION);
+        ssResult << nTipHeight << hashTip << coins;
+        return WriteAddressReply(req, rf, ssResult);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("chainHeight", nTipHeight));
+    result.push_back(Pair("chaintipHash", hashTip.GetHex()));
+    UniValue utxos(UniValue::VARR);
+    BOOST_FOREACH(const CAddressCoin& coin, coins) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", strAddress));
+        output.push_back(Pair("txid", coin.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int64_t)coin.nIndex));
+        output.push_back(Pair("script", HexStr(coin.script.begin(), coin.script.end())));
+        output.push_back(Pair("satoshis", coin.nValue));
+        output.push_back(Pair("height", (int64_t)coin.nHeight));
+        utxos.push_back(output);
+    }
+    result.push_back(Pair("utxos", utxos));
+
+    string strJSON = result.write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
+/** Reads the address index entries of an address, within the height range if one was given */
+static bool ReadAddressURIIndex(HTTPRequest* req, const std::string& strURIPart, enum RetFormat& rf, std::string& strAddress,
+                                int& nTipHeight, uint256& hashTip, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex)
+{
+    uint160 hashBytes;
+    int type, nStart, nEnd;
+    if (!ParseAddressURI(req, strURIPart, rf, strAddress, hashBytes, type, nStart, nEnd))
+        return false;
+
+    GetAddressReplyTip(nTipHeight, hashTip);
+    if (!GetAddressIndex(hashBytes, type, addressIndex, nStart, nEnd))
+        return RESTERR(req, HTTP_NOT_FOUND, "No information available for address " + strAddress);
+    return true;
+}
+
+static bool rest_address_txids(HTTPRequest* req, const std::string& strURIPart)
+{
+    enum RetFormat rf;
+    std::string strAddress;
+    int nTipHeight;
+    uint256 hashTip;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!ReadAddressURIIndex(req, strURIPart, rf, strAddress, nTipHeight, hashTip, addressIndex))
+        return false;
+
+    // index entries are ordered by height and position in the block, so duplicates are adjacent
+    vector<uint256> txids;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
+        if (txids.empty() || txids.back() != it->first.txhash)
+            txids.push_back(it->first.txhash);
+    }
+
+    if (rf != RF_JSON) {
+        CDataStream ssResult(SER_NETWORK, PROTOCOL_VERSION);
+        ssResult << nTipHeight << hashTip << txids;
+        return WriteAddressReply(req, rf, ssResult);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("chainHeight", nTipHeight));
+    result.push_back(Pair("chaintipHash", hashTip.GetHex()));
+    UniValue arr(UniValue::VARR);
+    BOOST_FOREACH(const uint256& txid, txids) {
+        arr.push_back(txid.GetHex());
+    }
+    result.push_back(Pair("txids", arr));
+
+    string strJSON = result.write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
+static bool rest_address_balance(HTTPRequest* req, const std::string& strURIPart)
+{
+    enum RetFormat rf;
+    std::string strAddress;
+    int nTipHeight;
+    uint256 hashTip;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!ReadAddressURIIndex(req, strURIPart, rf, strAddress, nTipHeight, hashTip, addressIndex))
+        return false;
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
+        if (it->second > 0)
+            received += it->second;
+        balance += it->second;
+    }
+
+    if (rf != RF_JSON) {
+        CDataStream ssResult(SER_NETWORK, PROTOCOL_VERSION);
+        ssResult << nTipHeight << hashTip << balance << received;
+        return WriteAddressReply(req, rf, ssResult);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("chainHeight", nTipHeight));
+    result.push_back(Pair("chaintipHash", hashTip.GetHex()));
+    result.push_back(Pair("balance", balance));
+    result.push_back(Pair("received", received));
+
+    string strJSON = result.write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
+static bool rest_address_deltas(HTTPRequest* req, const std::string& strURIPart)
+{
+    enum RetFormat rf;
+    std::string strAddress;
+    int nTipHeight;
+    uint256 hashTip;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!ReadAddressURIIndex(req, strURIPart, rf, strAddress, nTipHeight, hashTip, addressIndex))
+        return false;
+
+    vector<CAddressDelta> deltas;
+    deltas.reserve(addressIndex.size());
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
+        CAddressDelta delta;
+        delta.nHeight = it->first.blockHeight;
+        delta.nTxIndex = it->first.txindex;
+        delta.txhash = it->first.txhash;
+        delta.nIndex = it->first.index;
+        delta.nValue = it->second;
+        deltas.push_back(delta);
+    }
+
+    if (rf != RF_JSON) {
+        CDataStream ssResult(SER_NETWORK, PROTOCOL_VERSION);
+        ssResult << nTipHeight << hashTip << deltas;
+        return WriteAddressReply(req, rf, ssResult);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("chainHeight", nTipHeight));
+    result.push_back(Pair("chaintipHash", hashTip.GetHex()));
+    UniValue arr(UniValue::VARR);
+    BOOST_FOREACH(const CAddressDelta& delta, deltas) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("satoshis", delta.nValue));
+        entry.push_back(Pair("txid", delta.txhash.GetHex()));
+        entry.push_back(Pair("index", (int64_t)delta.nIndex));
+        entry.push_back(Pair("blockindex", (int64_t)delta.nTxIndex));
+        entry.push_back(Pair("height", (int64_t)delta.nHeight));
+        entry.push_back(Pair("address", strAddress));
+        arr.push_back(entry);
+    }
+    result.push_back(Pair("deltas", arr));
+
+    string strJSON = result.write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -617,6 +918,10 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/address/utxos/", rest_address_utxos},
+      {"/rest/address/txids/", rest_address_txids},
+      {"/rest/address/balance/", rest_address_balance},
+      {"/rest/address/deltas/", rest_address_deltas},
 };
 
 bool StartREST()
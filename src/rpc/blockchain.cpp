@@ -26,7 +26,10 @@
 #include "base58.h"
 #include "consensus/validation.h"
 #include "cc/eval.h"
+#include "indexbuilder.h"
+#include "jsoncache.h"
 #include "main.h"
+#include "metrics.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
 #include "streams.h"
@@ -75,7 +78,11 @@ double GetDifficultyINTERNAL(const CBlockIndex* blockindex, bool networkDifficul
     } else {
         bits = blockindex->nBits;
     }
+    return GetDifficultyFromBits(bits);
+}
 
+double GetDifficultyFromBits(uint32_t bits)
+{
     uint32_t powLimit =
         UintToArith256(Params().GetConsensus().powLimit).GetCompact();
     int nShift = (bits >> 24) & 0xff;
@@ -354,6 +361,9 @@ UniValue getblockcount(const UniValue& params, bool fHelp, const CPubKey& mypk)
             + HelpExampleRpc("getblockcount", "")
         );
 
+    std::shared_ptr<const CChainTipSnapshot> tip = GetChainTipSnapshot();
+    if (tip)
+        return tip->nHeight;
     LOCK(cs_main);
     return chainActive.Height();
 }
@@ -371,6 +381,9 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp, const CPubKey& myp
             + HelpExampleRpc("getbestblockhash", "")
         );
 
+    std::shared_ptr<const CChainTipSnapshot> tip = GetChainTipSnapshot();
+    if (tip)
+        return tip->hashBlock.GetHex();
     LOCK(cs_main);
     return chainActive.LastTip()->GetBlockHash().GetHex();
 }
@@ -388,6 +401,9 @@ UniValue getdifficulty(const UniValue& params, bool fHelp, const CPubKey& mypk)
             + HelpExampleRpc("getdifficulty", "")
         );
 
+    std::shared_ptr<const CChainTipSnapshot> tip = GetChainTipSnapshot();
+    if (tip)
+        return GetDifficultyFromBits(tip->nBitsNext);
     LOCK(cs_main);
     return GetNetworkDifficulty();
 }
@@ -397,27 +413,15 @@ bool NSPV_inmempool(uint256 txid);
 
 bool myIsutxo_spentinmempool(uint256 &spenttxid,int32_t &spentvini,uint256 txid,int32_t vout)
 {
-    int32_t vini = 0;
     if ( SAFECOIN_NSPV_SUPERLITE )
         return(NSPV_spentinmempool(spenttxid,spentvini,txid,vout));
-    BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
-    {
-        const CTransaction &tx = e.GetTx();
-        const uint256 &hash = tx.GetHash();
-        BOOST_FOREACH(const CTxIn &txin,tx.vin)
-        {
-            //fprintf(stderr,"%s/v%d ",uint256_str(str,txin.prevout.hash),txin.prevout.n);
-            if ( txin.prevout.n == vout && txin.prevout.hash == txid )
-            {
-                spenttxid = hash;
-                spentvini = vini;
-                return(true);
-            }
-            vini++;
-        }
-        //fprintf(stderr,"are vins for %s\n",uint256_str(str,hash));
-    }
-    return(false);
+    LOCK(mempool.cs);
+    std::map<COutPoint, CInPoint>::const_iterator it = mempool.mapNextTx.find(COutPoint(txid, vout));
+    if ( it == mempool.mapNextTx.end() )
+        return(false);
+    spenttxid = it->second.ptx->GetHash();
+    spentvini = it->second.n;
+    return(true);
 }
 
 bool mytxid_inmempool(uint256 txid)
@@ -598,9 +602,6 @@ UniValue getblockhashes(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
     std::vector<std::pair<uint256, unsigned int> > blockHashes;
 
-    if (fActiveOnly)
-        LOCK(cs_main);
-
     if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
@@ -653,7 +654,7 @@ UniValue getlastsegidstakes(const UniValue& params, bool fHelp, const CPubKey& m
             "getlastsegidstakes depth\n"
             "\nReturns object containing the counts of the last X blocks staked by each segid.\n"
             "\nArguments:\n"
-            "1. depth           (numeric, required) The amount of blocks to scan back."
+            "1. depth           (numeric, required) The amount of blocks to scan back. Counts for 100, 1000 and 10000 are kept up to date as blocks connect."
             "\nResult:\n"
             "{\n"
             "  \"0\" : n,       (numeric) number of stakes from segid 0 in the last X blocks.\n"
@@ -673,11 +674,14 @@ UniValue getlastsegidstakes(const UniValue& params, bool fHelp, const CPubKey& m
     if ( depth > chainActive.Height() )
         throw runtime_error("Not enough blocks to scan back that far.\n");
     
-    int32_t segids[64] = {0};
-    int32_t pow = 0;
-    int32_t notset = 0;
-
-    for (int64_t i = chainActive.Height(); i >  chainActive.Height()-depth; i--)
+    int32_t segids[66] = {0};
+    int32_t &pow = segids[64];
+    int32_t &notset = segids[65];
+
+    // the last 10000 blocks are counted as tips connect, the 100, 1000 and 10000 block windows are kept ready
+    if ( depth <= 10000 )
+        safecoin_segidstats(segids,depth);
+    else for (int64_t i = chainActive.Height(); i >  chainActive.Height()-depth; i--)
     {
         int8_t segid = safecoin_segid(0,i);
         //CBlockIndex* pblockindex = chainActive[i];
@@ -879,6 +883,12 @@ UniValue getblock(const UniValue& params, bool fHelp, const CPubKey& mypk)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
+    // explorers ask for the same recent blocks over and over
+    std::string strCacheKey = strprintf("block%d/%s", verbosity, hash.GetHex());
+    UniValue cached;
+    if (verbosity > 0 && rpcJSONCache.Get(chainActive.Tip()->GetBlockHash(), strCacheKey, cached))
+        return cached;
+
     if(!ReadBlockFromDisk(block, pblockindex,1))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -890,47 +900,145 @@ UniValue getblock(const UniValue& params, bool fHelp, const CPubKey& mypk)
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    UniValue result = blockToJSON(block, pblockindex, verbosity >= 2);
+    rpcJSONCache.Insert(chainActive.Tip()->GetBlockHash(), strCacheKey, result);
+    return result;
 }
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
             "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"    (string, optional, default=\"hash_serialized\") Which UTXO set hash to calculate:\n"
+            "                    \"hash_serialized\" hashes the set in database order on one thread,\n"
+            "                    \"muhash\" scans it on all cores and is then kept up to date with the tip, so later calls are fast,\n"
+            "                    \"none\" only counts it on all cores.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions, not given by \"muhash\" once it is kept up to date\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size, not given by \"muhash\" once it is kept up to date\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, only with \"hash_serialized\"\n"
+            "  \"muhash\": \"hash\",   (string) The MuHash3072 of the set, only with \"muhash\"\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
-            + HelpExampleRpc("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
+            + HelpExampleRpc("gettxoutsetinfo", "\"muhash\"")
         );
 
+    std::string strHashType = params.size() > 0 ? params[0].get_str() : "hash_serialized";
+    if (strHashType != "hash_serialized" && strHashType != "muhash" && strHashType != "none")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_type must be one of hash_serialized, muhash or none");
+
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
+    bool fScanned = true;
     FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
+    bool fOk;
+    if (strHashType == "hash_serialized")
+        fOk = pcoinsTip->GetStats(stats);
+    else if (strHashType == "muhash")
+        fOk = GetUTXOMuHashStats(stats, fScanned);
+    else
+        fOk = pcoinsTip->GetStatsMuHash(stats, NULL);
+    if (fOk) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+        if (fScanned)
+            ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        if (fScanned)
+            ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
+        if (strHashType == "hash_serialized")
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        else if (strHashType == "muhash")
+            ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
     return ret;
 }
 
+UniValue dumptxoutset(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction output set, with the shielded anchors and nullifiers, to a file.\n"
+            "A node that has the blocks but an empty chainstate can start from it with -loadtxoutset.\n"
+            "Note this call may take some time, no blocks are connected while it runs.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) file to write, relative to the data directory unless absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"xxxx\",             (string) the file that was written\n"
+            "  \"base_hash\": \"hex\",         (string) the block the set is the state after\n"
+            "  \"base_height\": n,           (numeric) its height\n"
+            "  \"notarized_hash\": \"hex\",    (string) the notarized block a loading node checks the base against\n"
+            "  \"notarized_height\": n,      (numeric) its height\n"
+            "  \"transactions\": n,          (numeric) the number of transactions written\n"
+            "  \"txouts\": n,                (numeric) the number of unspent outputs written\n"
+            "  \"hash_serialized\": \"hash\"   (string) same as gettxoutsetinfo at base_height\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    boost::filesystem::path path = boost::filesystem::absolute(params[0].get_str(), GetDataDir());
+    boost::filesystem::path temppath = path.string() + ".incomplete";
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CTxOutSetSnapshotHeader header;
+    CCoinsStats stats;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        header.hashBlock = pcoinsTip->GetBestBlock();
+        header.nHeight = chainActive.Height();
+        int32_t prevMoMheight; uint256 notarized_desttxid;
+        header.nNotarizedHeight = safecoin_notarized_height(&prevMoMheight, &header.hashNotarized, &notarized_desttxid);
+        if (header.nNotarizedHeight <= 0)
+            throw JSONRPCError(RPC_MISC_ERROR, "No notarized block yet, a snapshot could not be checked when loading");
+
+        CAutoFile file(fopen(temppath.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open " + temppath.string());
+        bool fOk;
+        try {
+            fOk = pcoinsTip->DumpSnapshot(file, header, stats);
+        } catch (const std::exception& e) {
+            fOk = false;
+        }
+        file.fclose();
+        if (!fOk) {
+            boost::filesystem::remove(temppath);
+            throw JSONRPCError(RPC_MISC_ERROR, "Error writing the UTXO snapshot");
+        }
+    }
+    boost::filesystem::rename(temppath, path);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("base_hash", header.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", header.nHeight));
+    ret.push_back(Pair("notarized_hash", header.hashNotarized.GetHex()));
+    ret.push_back(Pair("notarized_height", header.nNotarizedHeight));
+    ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+    return ret;
+}
+
 #define IGUANA_MAXSCRIPTSIZE 10001
 #define SAFECOIN_KVDURATION 1440
 #define SAFECOIN_KVBINARY 2
@@ -956,13 +1064,14 @@ int32_t safecoin_kvsearch(uint256 *refpubkeyp,int32_t current_height,uint32_t *f
 
 UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
-    UniValue ret(UniValue::VOBJ); uint32_t flags; uint8_t value[IGUANA_MAXSCRIPTSIZE*8],key[IGUANA_MAXSCRIPTSIZE*8]; int32_t duration,j,height,valuesize,keylen; uint256 refpubkey; static uint256 zeroes;
-    if (fHelp || params.size() != 1 )
+    UniValue ret(UniValue::VOBJ); uint32_t flags; uint8_t value[IGUANA_MAXSCRIPTSIZE*8],key[IGUANA_MAXSCRIPTSIZE*8]; int32_t duration,j,height,valuesize,keylen; uint256 refpubkey,txid; static uint256 zeroes; bool fMempool,inMempool = false;
+    if (fHelp || params.size() < 1 || params.size() > 2 )
         throw runtime_error(
-            "kvsearch key\n"
+            "kvsearch key ( include_mempool )\n"
             "\nSearch for a key stored via the kvupdate command. This feature is only available for asset chains.\n"
             "\nArguments:\n"
             "1. key                      (string, required) search the chain for this key\n"
+            "2. include_mempool          (boolean, optional, default=false) a newer value from a transaction still in the mempool is returned instead\n"
             "\nResult:\n"
             "{\n"
             "  \"coin\": \"xxxxx\",          (string) chain the key is stored on\n"
@@ -975,11 +1084,15 @@ UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"flags\": x                  (numeric) 1 if the key was created with a password; 0 otherwise.\n"
             "  \"value\": \"xxxxx\",         (string) stored value\n"
             "  \"valuesize\": xxxxx          (string) amount of characters stored\n"
+            "  \"mempool\": true|false       (boolean) with include_mempool, whether the value is not mined yet\n"
+            "  \"txid\": \"xxxxx\"            (string) with include_mempool, the mempool transaction storing the value\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("kvsearch", "examplekey")
+            + HelpExampleCli("kvsearch", "examplekey true")
             + HelpExampleRpc("kvsearch", "\"examplekey\"")
         );
+    fMempool = params.size() > 1 && params[1].get_bool();
     LOCK(cs_main);
     if ( (keylen= (int32_t)strlen(params[0].get_str().c_str())) > 0 )
     {
@@ -990,7 +1103,10 @@ UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
         if ( keylen < sizeof(key) )
         {
             memcpy(key,params[0].get_str().c_str(),keylen);
-            if ( (valuesize= safecoin_kvsearch(&refpubkey,chainActive.LastTip()->GetHeight(),&flags,&height,value,key,keylen)) >= 0 )
+            if ( fMempool && (valuesize= safecoin_kvsearch_mempool(&txid,&refpubkey,&flags,&height,value,key,keylen)) >= 0 )
+                inMempool = true;
+            else valuesize = safecoin_kvsearch(&refpubkey,chainActive.LastTip()->GetHeight(),&flags,&height,value,key,keylen);
+            if ( valuesize >= 0 )
             {
                 std::string val; char *valuestr;
                 val.resize(valuesize);
@@ -1004,6 +1120,12 @@ UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
                 ret.push_back(Pair("flags",(int64_t)flags));
                 ret.push_back(Pair("value",val));
                 ret.push_back(Pair("valuesize",valuesize));
+                if ( fMempool )
+                {
+                    ret.push_back(Pair("mempool",inMempool));
+                    if ( inMempool )
+                        ret.push_back(Pair("txid",txid.GetHex()));
+                }
             } else ret.push_back(Pair("error",(char *)"cant find key"));
         } else ret.push_back(Pair("error",(char *)"key too big"));
     } else ret.push_back(Pair("error",(char *)"null key"));
@@ -1361,23 +1483,37 @@ UniValue notaries(const UniValue& params, bool fHelp, const CPubKey& mypk)
     UniValue a(UniValue::VARR); uint32_t timestamp=0; UniValue ret(UniValue::VOBJ); int32_t i,j,n,m; char *hexstr;  uint8_t pubkeys[64][33]; char btcaddr[64],safeaddr[64],*ptr;
     if ( fHelp || (params.size() != 1 && params.size() != 2) )
         throw runtime_error("notaries height timestamp\n");
-    LOCK(cs_main);
     int32_t height = atoi(params[0].get_str().c_str());
     if ( params.size() == 2 )
         timestamp = (uint32_t)atol(params[1].get_str().c_str());
     else timestamp = (uint32_t)time(NULL);
-    if ( height < 0 )
+    std::shared_ptr<const CChainTipSnapshot> tip = GetChainTipSnapshot();
+    if ( height < 0 && tip )
+    {
+        height = tip->nHeight;
+        timestamp = tip->nTime;
+    }
+    else if ( height < 0 )
     {
+        LOCK(cs_main);
         height = chainActive.LastTip()->GetHeight();
         timestamp = chainActive.LastTip()->GetBlockTime();
     }
     else if ( params.size() < 2 )
     {
+        LOCK(cs_main);
         CBlockIndex *pblockindex = chainActive[height];
         if ( pblockindex != 0 )
             timestamp = pblockindex->GetBlockTime();
     }
-    if ( (n= safecoin_notaries(pubkeys,height,timestamp)) > 0 )
+    if ( timestamp == 0 )
+    {
+        // the timestamp is then looked up in the chain
+        LOCK(cs_main);
+        n = safecoin_notaries(pubkeys,height,timestamp);
+    }
+    else n = safecoin_notaries(pubkeys,height,timestamp);
+    if ( n > 0 )
     {
         for (i=0; i<n; i++)
         {
@@ -1973,6 +2109,49 @@ void NetworkUpgradeDescPushBack(
     }
 }
 
+static UniValue IndexInfo(const std::string& name, bool fEnabled)
+{
+    UniValue obj(UniValue::VOBJ);
+    int nHeight;
+    if (GetIndexBuildHeight(name, nHeight)) {
+        obj.push_back(Pair("synced", false));
+        obj.push_back(Pair("best_block_height", nHeight));
+    } else {
+        obj.push_back(Pair("synced", fEnabled));
+        obj.push_back(Pair("best_block_height", fEnabled ? chainActive.Height() : 0));
+    }
+    return obj;
+}
+
+UniValue getindexinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getindexinfo\n"
+            "\nReturns the state of the address and spent indexes, including one being built in the background.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"addressindex\": {            (object) only present when enabled or being built\n"
+            "    \"synced\": xx,              (boolean) whether the index follows the chain tip\n"
+            "    \"best_block_height\": xxxx  (numeric) the last block the index covers\n"
+            "  },\n"
+            "  \"spentindex\": { ... }        (object) same fields as addressindex\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getindexinfo", "")
+            + HelpExampleRpc("getindexinfo", "")
+        );
+
+    LOCK(cs_main);
+    UniValue result(UniValue::VOBJ);
+    int nHeight;
+    if (fAddressIndex || GetIndexBuildHeight("addressindex", nHeight))
+        result.push_back(Pair("addressindex", IndexInfo("addressindex", fAddressIndex)));
+    if (fSpentIndex || GetIndexBuildHeight("spentindex", nHeight))
+        result.push_back(Pair("spentindex", IndexInfo("spentindex", fSpentIndex)));
+    return result;
+}
+
 UniValue getblockchaininfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() != 0)
@@ -1991,6 +2170,13 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp, const CPubKey& my
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"commitments\": xxxxxx,    (numeric) the current number of note commitments in the commitment tree\n"
+            "  \"coinscache\": {           (object) the in-memory coins cache\n"
+            "     \"entries\": xxxxxx,       (numeric) transactions with cached coins\n"
+            "     \"usage\": xxxxxx,         (numeric) memory used by the cache, in bytes\n"
+            "     \"hits\": xxxxxx,          (numeric) coin lookups answered from the cache since startup\n"
+            "     \"misses\": xxxxxx,        (numeric) coin lookups that read the database since startup\n"
+            "     \"hitrate\": x.xxx         (numeric) hits / (hits + misses)\n"
+            "  },\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -2049,6 +2235,16 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp, const CPubKey& my
     pcoinsTip->GetSproutAnchorAt(pcoinsTip->GetBestAnchor(SPROUT), tree);
     obj.push_back(Pair("commitments",           static_cast<uint64_t>(tree.size())));
 
+    uint64_t nHits, nMisses;
+    pcoinsTip->GetCacheStats(nHits, nMisses);
+    UniValue coinscache(UniValue::VOBJ);
+    coinscache.push_back(Pair("entries",        (uint64_t)pcoinsTip->GetCacheSize()));
+    coinscache.push_back(Pair("usage",          (uint64_t)pcoinsTip->DynamicMemoryUsage()));
+    coinscache.push_back(Pair("hits",           nHits));
+    coinscache.push_back(Pair("misses",         nMisses));
+    coinscache.push_back(Pair("hitrate",        nHits + nMisses ? (double)nHits / (nHits + nMisses) : 0.0));
+    obj.push_back(Pair("coinscache",            coinscache));
+
     CBlockIndex* tip = chainActive.LastTip();
     UniValue valuePools(UniValue::VARR);
     valuePools.push_back(ValuePoolDesc("sprout", tip->nChainSproutValue, boost::none));
@@ -2217,6 +2413,9 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
     ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
 
     if (Params().NetworkIDString() == "regtest") {
         ret.push_back(Pair("fullyNotified", mempool.IsFullyNotified()));
@@ -2236,6 +2435,8 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee per kB for a transaction to be accepted\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -2245,6 +2446,43 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return mempoolInfoToJSON();
 }
 
+UniValue getvalidationstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getvalidationstats\n"
+            "\nReturns the time spent in each phase of connecting blocks to the tip since the node started.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"phase\": {                   (object) one of readblock, connect, checkpow, verify, index, callbacks,\n"
+            "                                 safecoin, flush, chainstate, postconnect, prices, snapshot, total\n"
+            "    \"count\": n,                 (numeric) Number of times the phase ran\n"
+            "    \"last_ms\": x.xxx,           (numeric) Milliseconds spent the last time it ran\n"
+            "    \"total_ms\": x.xxx,          (numeric) Milliseconds spent in total\n"
+            "    \"average_ms\": x.xxx         (numeric) Average milliseconds per run\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationstats", "")
+            + HelpExampleRpc("getvalidationstats", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    for (int i = 0; i < MAX_VALIDATION_PHASES; i++) {
+        const ValidationPhaseTimer& timer = validationPhaseTimes[i];
+        uint64_t count = timer.count.get();
+        int64_t nTotal = timer.nTotal;
+        UniValue phase(UniValue::VOBJ);
+        phase.push_back(Pair("count", count));
+        phase.push_back(Pair("last_ms", timer.nLast * 0.001));
+        phase.push_back(Pair("total_ms", nTotal * 0.001));
+        phase.push_back(Pair("average_ms", count > 0 ? nTotal * 0.001 / count : 0.0));
+        ret.push_back(Pair(ValidationPhaseName(i), phase));
+    }
+    return ret;
+}
+
 inline CBlockIndex* LookupBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);
@@ -2419,6 +2657,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "getvalidationstats",     &getvalidationstats,     true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
 
     /* Not shown in help */
@@ -39,6 +39,7 @@ public:
 static const CRPCConvertParam vRPCConvertParams[] =
 {
     { "stop", 0 },
+    { "getlockprofile", 0 },
     { "setmocktime", 0 },
     { "getaddednodeinfo", 0 },
     { "setgenerate", 0 },
@@ -71,6 +72,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listtransactions", 1 },
     { "listtransactions", 2 },
     { "listtransactions", 3 },
+    { "listtransactions", 4 },
     { "listaccounts", 0 },
     { "listaccounts", 1 },
     { "walletpassphrase", 1 },
@@ -85,6 +87,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "createmultisig", 0 },
     { "createmultisig", 1 },
     { "listfromto", 2 },
+    { "listfromto", 3 },
+    { "listfromto", 5 },
     { "listunspent", 0 },
     { "listunspent", 1 },
     { "listunspent", 2 },
@@ -132,6 +136,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getaddresstxids", 0},
     { "getaddressbalance", 0},
     { "getaddressdeltas", 0},
+    { "txsnotarizedconfirmed", 0},
     { "getaddressutxos", 0},
     { "getaddressmempool", 0},
     { "zcrawjoinsplit", 1 },
@@ -174,6 +179,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "safeids", 2 },
     { "safeids", 3 },
     { "kvsearch", 1 },
+    { "getregistrationinfo", 1 },
     { "kvupdate", 4 },
     { "regnode", 0 },
     { "z_importkey", 2 },
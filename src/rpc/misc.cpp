@@ -20,6 +20,7 @@
  ******************************************************************************/
 
 #include "clientversion.h"
+#include "httpserver.h"
 #include "init.h"
 #include "key_io.h"
 #include "main.h"
@@ -31,6 +32,7 @@
 #include "safecoin_defs.h"
 #include "safecoin_structs.h"
 #include "notaries_staked.h"
+#include "safenodes.h"
 #include "cc/eval.h"
 #include "cc/CCinclude.h"
 #ifdef ENABLE_WALLET
@@ -68,6 +70,7 @@ uint64_t safecoin_interestsum();
 int32_t safecoin_longestchain();
 int32_t safecoin_notarized_height(int32_t *prevMoMheightp,uint256 *hashp,uint256 *txidp);
 bool safecoin_txnotarizedconfirmed(uint256 txid);
+void safecoin_txsnotarizedconfirmed(const std::vector<uint256> &txids,std::vector<bool> &confirmed);
 uint32_t safecoin_chainactive_timestamp();
 int32_t safecoin_whoami(char *pubkeystr,int32_t height,uint32_t timestamp);
 extern uint64_t SAFECOIN_INTERESTSUM,SAFECOIN_WALLETBALANCE;
@@ -90,7 +93,6 @@ extern uint64_t ASSETCHAINS_COMMISSION,ASSETCHAINS_SUPPLY;
 extern int32_t ASSETCHAINS_LWMAPOS,ASSETCHAINS_SAPLING,ASSETCHAINS_STAKED;
 extern uint64_t ASSETCHAINS_ENDSUBSIDY[],ASSETCHAINS_REWARD[],ASSETCHAINS_HALVING[],ASSETCHAINS_DECAY[],ASSETCHAINS_NOTARY_PAY[];
 extern std::string NOTARY_PUBKEY,NOTARY_ADDRESS; extern uint8_t NOTARY_PUBKEY33[];
-extern std::vector<std::string> vs_safecoin_notaries(int32_t height, uint32_t timestamp);
 extern std::string str_safe_address(std::string pubkey);
 extern bool getAddressFromIndex(const int &type, const uint160 &hash, std::string &address);
 extern bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a, std::pair<CAddressUnspentKey, CAddressUnspentValue> b);
@@ -231,15 +233,26 @@ UniValue getinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             + HelpExampleRpc("getinfo", "")
         );
 
+    // The chain state comes from the tip snapshot, cs_main is only needed without one,
+    // for the wallet and for the notary lookup
+    std::shared_ptr<const CChainTipSnapshot> tip = GetChainTipSnapshot();
+    bool fLockChain = !tip || NOTARY_PUBKEY33[0] != 0;
 #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
+    LOCK2(fLockChain || pwalletMain ? &cs_main : NULL, pwalletMain ? &pwalletMain->cs_wallet : NULL);
 #else
-    LOCK(cs_main);
+    LOCK(fLockChain ? &cs_main : NULL);
 #endif
     
     proxyType proxy;
     GetProxy(NET_IPV4, proxy);
-    notarized_height = safecoin_notarized_height(&prevMoMheight,&notarized_hash,&notarized_desttxid);
+    if ( tip )
+    {
+        notarized_height = tip->nNotarizedHeight;
+        prevMoMheight = tip->nPrevMoMHeight;
+        notarized_hash = tip->hashNotarized;
+        notarized_desttxid = tip->txidNotarized;
+    }
+    else notarized_height = safecoin_notarized_height(&prevMoMheight,&notarized_hash,&notarized_desttxid);
     //fprintf(stderr,"after notarized_height %u\n",(uint32_t)time(NULL));
     
     UniValue obj(UniValue::VOBJ);
@@ -287,17 +300,22 @@ UniValue getinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
         }
 #endif
         //fprintf(stderr,"after wallet %u\n",(uint32_t)time(NULL));
-        obj.push_back(Pair("blocks",        (int)chainActive.Height()));
-        if ( (longestchain= SAFECOIN_LONGESTCHAIN) != 0 && chainActive.Height() > longestchain )
+        int nHeight = tip ? tip->nHeight : chainActive.Height();
+        obj.push_back(Pair("blocks",        nHeight));
+        if ( (longestchain= SAFECOIN_LONGESTCHAIN) != 0 && nHeight > longestchain )
         {
-            longestchain = chainActive.Height();
+            longestchain = nHeight;
             //fprintf(stderr,"after longestchain %u\n",(uint32_t)time(NULL));
         }
 
         obj.push_back(Pair("longestchain",		longestchain));
         obj.push_back(Pair("timeoffset",		0));
         
-        if ( chainActive.LastTip() != 0 )
+        if ( tip )
+        {
+            obj.push_back(Pair("tiptime", (int)tip->nTime));
+        }
+        else if ( chainActive.LastTip() != 0 )
         {
             obj.push_back(Pair("tiptime", (int)chainActive.LastTip()->nTime));
         }
@@ -305,7 +323,7 @@ UniValue getinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
         obj.push_back(Pair("connections",   (int)vNodes.size()));
         obj.push_back(Pair("tls_connections", (int)std::count_if(vNodes.begin(), vNodes.end(), [](CNode* n) {return n->ssl != NULL;})));
         obj.push_back(Pair("proxy",         (proxy.IsValid() ? proxy.proxy.ToStringIPPort() : string())));
-        obj.push_back(Pair("difficulty",    (double)GetDifficulty()));
+        obj.push_back(Pair("difficulty",    tip ? GetDifficultyFromBits(tip->nBits) : (double)GetDifficulty()));
         obj.push_back(Pair("testnet",       Params().TestnetToBeDeprecatedFieldRPC()));
 #ifdef ENABLE_WALLET
         if (pwalletMain)
@@ -992,6 +1010,188 @@ bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
     return a.second.blockHeight < b.second.blockHeight;
 }
 
+//! most entries of one page of address history
+static const int MAX_ADDRESS_HISTORY_PAGE = 10000;
+//! serialized type and hash that start every address index key
+static const size_t ADDRESS_INDEX_PREFIX_SIZE = 21;
+
+/** Where an entry sits within its address, the index key past the address. Orders entries like the database does. */
+static std::string AddressIndexPosition(const CAddressIndexKey& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return std::string(ss.begin() + ADDRESS_INDEX_PREFIX_SIZE, ss.end());
+}
+
+/** The index key of an address at a position taken from AddressIndexPosition, false for a malformed position */
+static bool AddressIndexKeyAt(int type, const uint160& hash, const std::string& position, CAddressIndexKey& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CAddressIndexIteratorKey(type, hash);
+    ss.write(position.data(), position.size());
+    if (ss.size() != key.GetSerializeSize(SER_DISK, CLIENT_VERSION))
+        return false;
+    try {
+        ss >> key;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The address index entries of several addresses in one stream, merged in block order (newest first when
+ * reversed). Each address is read a page at a time, so memory stays bounded however long its history is.
+ * Entries of one transaction come out next to each other.
+ */
+class CAddressHistoryMerge
+{
+private:
+    struct Source {
+        uint160 hash;
+        int type;
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vPage;
+        size_t nPos;
+        bool fMore;
+    };
+
+    std::vector<Source> vSources;
+    bool fReverse;
+    int nStart, nEnd;
+    size_t nPageSize;
+
+    void Read(Source& source, const CAddressIndexKey* pAfter)
+    {
+        source.vPage.clear();
+        source.nPos = 0;
+        if (!GetAddressIndex(source.hash, source.type, pAfter, nPageSize, source.vPage, source.fMore, fReverse, nStart, nEnd))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    const std::pair<CAddressIndexKey, CAmount>* Head(Source& source)
+    {
+        if (source.nPos == source.vPage.size()) {
+            if (!source.fMore || source.vPage.empty())
+                return NULL;
+            CAddressIndexKey after = source.vPage.back().first;
+            Read(source, &after);
+            if (source.vPage.empty())
+                return NULL;
+        }
+        return &source.vPage[source.nPos];
+    }
+
+    Source* Best()
+    {
+        Source* pbest = NULL;
+        std::string bestPosition;
+        for (size_t i = 0; i < vSources.size(); i++) {
+            const std::pair<CAddressIndexKey, CAmount>* phead = Head(vSources[i]);
+            if (phead == NULL)
+                continue;
+            std::string position = AddressIndexPosition(phead->first);
+            if (pbest == NULL || (fReverse ? position > bestPosition : position < bestPosition)) {
+                pbest = &vSources[i];
+                bestPosition = position;
+            }
+        }
+        return pbest;
+    }
+
+public:
+    /** Pages of nPageSizeIn entries per address, starting after position (from the start when empty) */
+    CAddressHistoryMerge(const std::vector<std::pair<uint160, int> >& addresses, bool fReverseIn, int nStartIn, int nEndIn,
+                         size_t nPageSizeIn, const std::string& position) :
+        fReverse(fReverseIn), nStart(nStartIn), nEnd(nEndIn), nPageSize(nPageSizeIn)
+    {
+        std::set<std::pair<uint160, int> > setSeen;
+        for (size_t i = 0; i < addresses.size(); i++) {
+            if (!setSeen.insert(addresses[i]).second)
+                continue;
+            Source source;
+            source.hash = addresses[i].first;
+            source.type = addresses[i].second;
+            if (position.empty())
+                Read(source, NULL);
+            else {
+                CAddressIndexKey after;
+                if (!AddressIndexKeyAt(source.type, source.hash, position, after))
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+                Read(source, &after);
+            }
+            vSources.push_back(source);
+        }
+    }
+
+    bool Peek(std::pair<CAddressIndexKey, CAmount>& entry)
+    {
+        Source* pbest = Best();
+        if (pbest == NULL)
+            return false;
+        entry = pbest->vPage[pbest->nPos];
+        return true;
+    }
+
+    bool Next(std::pair<CAddressIndexKey, CAmount>& entry)
+    {
+        Source* pbest = Best();
+        if (pbest == NULL)
+            return false;
+        entry = pbest->vPage[pbest->nPos++];
+        return true;
+    }
+};
+
+/**
+ * The "limit", "cursor" and "reverse" of a paged address history call from obj, nLimit stays 0 for an
+ * unpaged call. The cursor is the position of the last entry returned, as hex.
+ */
+static void ParseAddressHistoryPage(const UniValue& obj, int& nLimit, std::string& position, bool& fReverse)
+{
+    UniValue limitValue, cursorValue, reverseValue;
+    if (obj.isObject()) {
+        limitValue = find_value(obj.get_obj(), "limit");
+        cursorValue = find_value(obj.get_obj(), "cursor");
+        reverseValue = find_value(obj.get_obj(), "reverse");
+    }
+    nLimit = 0;
+    position.clear();
+    fReverse = false;
+    if (limitValue.isNull()) {
+        if (!cursorValue.isNull() || !reverseValue.isNull())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "cursor and reverse need a limit");
+        return;
+    }
+    nLimit = limitValue.get_int();
+    if (nLimit <= 0 || nLimit > MAX_ADDRESS_HISTORY_PAGE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("limit must be between 1 and %d", MAX_ADDRESS_HISTORY_PAGE));
+    if (!cursorValue.isNull() && !cursorValue.get_str().empty()) {
+        if (!IsHex(cursorValue.get_str()))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        std::vector<unsigned char> vch = ParseHex(cursorValue.get_str());
+        position.assign(vch.begin(), vch.end());
+    }
+    if (!reverseValue.isNull())
+        fReverse = reverseValue.get_bool();
+}
+
+static UniValue AddressDeltaToJSON(const std::pair<CAddressIndexKey, CAmount>& entry)
+{
+    std::string address;
+    if (!getAddressFromIndex(entry.first.type, entry.first.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
+
+    UniValue delta(UniValue::VOBJ);
+    delta.push_back(Pair("satoshis", entry.second));
+    delta.push_back(Pair("txid", entry.first.txhash.GetHex()));
+    delta.push_back(Pair("index", (int)entry.first.index));
+    delta.push_back(Pair("blockindex", (int)entry.first.txindex));
+    delta.push_back(Pair("height", entry.first.blockHeight));
+    delta.push_back(Pair("address", address));
+    return delta;
+}
+
 bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
                    std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> b) {
     return a.second.time < b.second.time;
@@ -1257,6 +1457,9 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& myp
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\" (number, optional) Return at most this many deltas and a cursor for the rest\n"
+            "  \"cursor\" (string, optional) The cursor of the previous page, needs limit\n"
+            "  \"reverse\" (boolean, optional, default=false) Newest first, needs limit\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
             "\nResult:\n"
@@ -1269,8 +1472,15 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& myp
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit, or chainInfo with start and end):\n"
+            "{\n"
+            "  \"deltas\": [ ... ]  (array) As above\n"
+            "  \"cursor\"         (string) Where the next page starts, only when there are more deltas\n"
+            "  \"start\", \"end\"   (object) Hash and height of start and end, with chainInfo\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"], \"limit\": 100, \"reverse\": true}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
         );
 
@@ -1298,42 +1508,46 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& myp
         }
     }
 
+    int nLimit;
+    std::string position;
+    bool fReverse;
+    ParseAddressHistoryPage(params[0], nLimit, position, fReverse);
+
     std::vector<std::pair<uint160, int> > addresses;
 
     if (!getAddressesFromParams(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
-    }
-
     UniValue deltas(UniValue::VARR);
+    std::string strCursor;
+
+    if (nLimit > 0) {
+        CAddressHistoryMerge merge(addresses, fReverse, start, end, nLimit, position);
+        std::pair<CAddressIndexKey, CAmount> entry;
+        while ((int)deltas.size() < nLimit && merge.Next(entry)) {
+            deltas.push_back(AddressDeltaToJSON(entry));
+            position = AddressIndexPosition(entry.first);
+        }
+        if (merge.Peek(entry))
+            strCursor = HexStr(position.begin(), position.end());
+    } else {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            }
         }
 
-        UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
-        delta.push_back(Pair("address", address));
-        deltas.push_back(delta);
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++)
+            deltas.push_back(AddressDeltaToJSON(*it));
     }
 
     UniValue result(UniValue::VOBJ);
@@ -1358,10 +1572,17 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& myp
         endInfo.push_back(Pair("height", end));
 
         result.push_back(Pair("deltas", deltas));
+        if (!strCursor.empty())
+            result.push_back(Pair("cursor", strCursor));
         result.push_back(Pair("start", startInfo));
         result.push_back(Pair("end", endInfo));
 
         return result;
+    } else if (nLimit > 0) {
+        result.push_back(Pair("deltas", deltas));
+        if (!strCursor.empty())
+            result.push_back(Pair("cursor", strCursor));
+        return result;
     } else {
         return deltas;
     }
@@ -1598,6 +1819,9 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many txids, in block order, and a cursor for the rest\n"
+            "  \"cursor\" (string, optional) The cursor of the previous page, needs limit\n"
+            "  \"reverse\" (boolean, optional, default=false) Newest first, needs limit\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
             "\nResult:\n"
@@ -1605,8 +1829,14 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"txids\": [ ... ]  (array) As above\n"
+            "  \"cursor\"         (string) Where the next page starts, only when there are more txids\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"], \"limit\": 100}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
         );
 
@@ -1627,6 +1857,32 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
         }
     }
 
+    int nLimit;
+    std::string position;
+    bool fReverse;
+    ParseAddressHistoryPage(params[0], nLimit, position, fReverse);
+    if (nLimit > 0) {
+        if (start <= 0 || end <= 0)
+            start = end = 0;
+        CAddressHistoryMerge merge(addresses, fReverse, start, end, nLimit, position);
+        UniValue txids(UniValue::VARR);
+        std::pair<CAddressIndexKey, CAmount> entry;
+        // a page ends between transactions, their entries are next to each other
+        while (merge.Peek(entry)) {
+            if ((int)txids.size() >= nLimit && entry.first.txhash.GetHex() != txids[txids.size() - 1].get_str())
+                break;
+            merge.Next(entry);
+            if (txids.empty() || entry.first.txhash.GetHex() != txids[txids.size() - 1].get_str())
+                txids.push_back(entry.first.txhash.GetHex());
+            position = AddressIndexPosition(entry.first);
+        }
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("txids", txids));
+        if (merge.Peek(entry))
+            result.push_back(Pair("cursor", HexStr(position.begin(), position.end())));
+        return result;
+    }
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
@@ -1667,12 +1923,71 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
 
 }
 
+/** The listfromto item of a candidate transaction, false unless every input is from src and an output pays dst */
+static bool ListFromToItem(const uint256& hash, int height, const CBitcoinAddress& src_address, const CBitcoinAddress& dst_address,
+                           UniValue& item)
+{
+    CTransaction tx;
+    uint256 hashBlock;
+    int nBlockTime = 0;
+
+    // skip coinbase transactions
+    if (!GetTransaction(hash, tx, hashBlock, true) || tx.IsCoinBase())
+        return false;
+
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi != mapBlockIndex.end() && (*mi).second)
+        nBlockTime = (*mi).second->GetBlockTime();
+
+    // we want all inputs to be from src address
+    for (const CTxIn& txin : tx.vin)
+    {
+        uint256 prevout_hash;
+        CTransaction prevout_tx;
+        CTxDestination prevout_address;
+        if (!GetTransaction(txin.prevout.hash, prevout_tx, prevout_hash, false))
+            return false;
+        if (!ExtractDestination(prevout_tx.vout[txin.prevout.n].scriptPubKey, prevout_address) || !(CBitcoinAddress(prevout_address) == src_address))
+            return false;
+    }
+
+    // we want at least one output to be dst address
+    int good_vout_count = 0;
+    CAmount received_satoshis = 0;
+    for (const CTxOut& txout : tx.vout)
+    {
+        CTxDestination out_address;
+        if (ExtractDestination(txout.scriptPubKey, out_address) && CBitcoinAddress(out_address) == dst_address)
+        {
+            good_vout_count++;
+            received_satoshis += txout.nValue; // only dst address received amount matters
+        }
+    }
+    if (good_vout_count == 0)
+        return false;
+
+    item = UniValue(UniValue::VOBJ);
+    item.push_back(Pair("height", (int64_t)height));
+    item.push_back(Pair("timestamp", nBlockTime));
+    item.push_back(Pair("txid", hash.GetHex()));
+    item.push_back(Pair("received_SAFE", ValueFromAmount(received_satoshis)));
+    return true;
+}
+
 UniValue listfromto(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
-    if (fHelp || params.size() < 2)
+    if (fHelp || params.size() < 2 || params.size() > 6)
         throw runtime_error(
-            "\nlistfromto \"src-address\" \"dst-address\" ( start-height )\n"
+            "\nlistfromto \"src-address\" \"dst-address\" ( start-height limit \"cursor\" reverse )\n"
             "\nReturns payments txids from src-address to dst-address (requires addressindex to be enabled).\n"
+            "\nArguments:\n"
+            "1. \"src-address\"  (string, required) The paying address\n"
+            "2. \"dst-address\"  (string, required) The paid address\n"
+            "3. start-height   (numeric, optional, default=1) The first block height searched\n"
+            "4. limit          (numeric, optional) Read at most this many address index entries of the two addresses\n"
+            "                  and return a cursor for the rest. A page can hold fewer payments than it read entries.\n"
+            "5. \"cursor\"       (string, optional) The cursor of the previous page, \"\" for the first one\n"
+            "6. reverse        (boolean, optional, default=false) Newest first\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -1683,151 +1998,144 @@ UniValue listfromto(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  }\n"
             "  , ...\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"payments\": [ ... ]  (array) As above\n"
+            "  \"cursor\"           (string) Where the next page starts, only when there are more entries\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("listfromto", "\"RsaEqW1sbbANmjbqD51zHfDJxGP1xMVoVG\" \"RjvitJRxtkeLYe9cvDdrWKrUCVSWk29Hmp\" 683820")
+            + HelpExampleCli("listfromto", "\"RsaEqW1sbbANmjbqD51zHfDJxGP1xMVoVG\" \"RjvitJRxtkeLYe9cvDdrWKrUCVSWk29Hmp\" 1 1000 \"\" true")
             + HelpExampleRpc("listfromto", "\"RsaEqW1sbbANmjbqD51zHfDJxGP1xMVoVG\", \"RjvitJRxtkeLYe9cvDdrWKrUCVSWk29Hmp\", 683820")
         );
     
     std::string str_src_address = params[0].get_str();
     std::string str_dst_address = params[1].get_str();
-	
-	uint32_t start_height = (params.size() == 3) ? params[2].get_int() : 1;
-	uint32_t end_height = chainActive.LastTip()->GetHeight();
-	
-	LOCK(cs_main);
-	
-	CBitcoinAddress src_address(str_src_address);
-	CBitcoinAddress dst_address(str_dst_address);
+
+    UniValue page(UniValue::VOBJ);
+    if (params.size() > 3)
+        page.push_back(Pair("limit", params[3]));
+    if (params.size() > 4)
+        page.push_back(Pair("cursor", params[4]));
+    if (params.size() > 5)
+        page.push_back(Pair("reverse", params[5]));
+    int nLimit;
+    std::string position;
+    bool fReverse;
+    ParseAddressHistoryPage(page, nLimit, position, fReverse);
+
+    LOCK(cs_main);
+
+    uint32_t start_height = (params.size() >= 3) ? params[2].get_int() : 1;
+    uint32_t end_height = chainActive.LastTip()->GetHeight();
+
+    CBitcoinAddress src_address(str_src_address);
+    CBitcoinAddress dst_address(str_dst_address);
     uint160 src_hash_bytes, dst_hash_bytes;
     int src_type = 0, dst_type = 0;
     
-	if (!src_address.GetIndexKey(src_hash_bytes, src_type, false))
+    if (!src_address.GetIndexKey(src_hash_bytes, src_type, false))
     {
-		throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid source address");
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid source address");
     }
     
     if (!dst_address.GetIndexKey(dst_hash_bytes, dst_type, false))
     {
-		throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid destination address");
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid destination address");
     }
     
     if (start_height > end_height)
     {
-		throw JSONRPCError(RPC_INVALID_PARAMETER, "Start height above the current chain tip");
-	}
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Start height above the current chain tip");
+    }
+
+    if (nLimit > 0) {
+        std::vector<std::pair<uint160, int> > addresses;
+        addresses.push_back(std::make_pair(src_hash_bytes, src_type));
+        addresses.push_back(std::make_pair(dst_hash_bytes, dst_type));
+        CAddressHistoryMerge merge(addresses, fReverse, start_height, end_height, nLimit, position);
+
+        // the entries of one transaction are next to each other, it is a candidate when both addresses have one
+        UniValue payments(UniValue::VARR);
+        std::pair<CAddressIndexKey, CAmount> entry;
+        uint256 txid;
+        int height = 0;
+        bool fSrc = false, fDst = false;
+        int nRead = 0;
+        while (merge.Peek(entry)) {
+            if (entry.first.txhash != txid) {
+                if (fSrc && fDst) {
+                    UniValue item;
+                    if (ListFromToItem(txid, height, src_address, dst_address, item))
+                        payments.push_back(item);
+                }
+                if (nRead >= nLimit)
+                    break;
+                txid = entry.first.txhash;
+                height = entry.first.blockHeight;
+                fSrc = fDst = false;
+            }
+            merge.Next(entry);
+            nRead++;
+            if (entry.first.type == (unsigned int)src_type && entry.first.hashBytes == src_hash_bytes)
+                fSrc = true;
+            if (entry.first.type == (unsigned int)dst_type && entry.first.hashBytes == dst_hash_bytes)
+                fDst = true;
+            position = AddressIndexPosition(entry.first);
+        }
+        UniValue result(UniValue::VOBJ);
+        if (merge.Peek(entry))
+            result.push_back(Pair("cursor", HexStr(position.begin(), position.end())));
+        else if (fSrc && fDst) {
+            UniValue item;
+            if (ListFromToItem(txid, height, src_address, dst_address, item))
+                payments.push_back(item);
+        }
+        result.push_back(Pair("payments", payments));
+        return result;
+    }
 
- 
-	std::vector<std::pair<CAddressIndexKey, CAmount> > src_address_index;
-	std::vector<std::pair<CAddressIndexKey, CAmount> > dst_address_index;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > src_address_index;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > dst_address_index;
 
-	if (!GetAddressIndex(src_hash_bytes, src_type, src_address_index, start_height, end_height))
-	{
-		throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for source address");
-	}
-	
-	if (!GetAddressIndex(dst_hash_bytes, dst_type, dst_address_index, start_height, end_height))
-	{
-		throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for destination address");
-	}
+    if (!GetAddressIndex(src_hash_bytes, src_type, src_address_index, start_height, end_height))
+    {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for source address");
+    }
+    
+    if (!GetAddressIndex(dst_hash_bytes, dst_type, dst_address_index, start_height, end_height))
+    {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for destination address");
+    }
  
     std::set<std::pair<int, std::string> > src_txids, dst_txids, intersect_txids;
     
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=src_address_index.begin(); it!=src_address_index.end(); it++)
-	{
+    {
         int height = it->first.blockHeight;
         std::string txid = it->first.txhash.GetHex();
-		src_txids.insert(std::make_pair(height, txid));
+        src_txids.insert(std::make_pair(height, txid));
     }
     
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=dst_address_index.begin(); it!=dst_address_index.end(); it++)
-	{
+    {
         int height = it->first.blockHeight;
         std::string txid = it->first.txhash.GetHex();
-		dst_txids.insert(std::make_pair(height, txid));
+        dst_txids.insert(std::make_pair(height, txid));
     }
     
     std::set_intersection(src_txids.begin(), src_txids.end(),
                           dst_txids.begin(), dst_txids.end(),
                           std::inserter(intersect_txids, intersect_txids.end()));
 
-	UniValue result(UniValue::VARR);
-	for (auto const &p: intersect_txids)
-	{
-	    uint32_t height = p.first;
-	    std::string str_txid = p.second;
-	    uint256 hash = ParseHashV(str_txid, "txid");
-
-		CTransaction tx;
-		uint256 hashBlock;
-		int nBlockTime = 0;
-
-		if (GetTransaction(hash, tx, hashBlock, true))
-		{
-			if (!tx.IsCoinBase()) // skip coinbase transactions
-			{
-							
-				BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-				if (mi != mapBlockIndex.end() && (*mi).second)
-				{
-					CBlockIndex* pindex = (*mi).second;
-					nBlockTime = pindex->GetBlockTime();
-				}
-
-				// we want all inputs to be from src address
-				bool flag_good_src = true;
-				for (const CTxIn& txin : tx.vin)
-				{
-					uint256 prevout_hash;
-					CTransaction prevout_tx;
-					CTxDestination prevout_address;
-					
-					if (GetTransaction(txin.prevout.hash, prevout_tx, prevout_hash, false))
-					{
-						if (ExtractDestination(prevout_tx.vout[txin.prevout.n].scriptPubKey, prevout_address))
-						{
-							flag_good_src = flag_good_src && (CBitcoinAddress(prevout_address) == src_address);
-						}
-						else flag_good_src = false;
-					}
-					else flag_good_src = false;
-					
-					// no need to wait end of the loop if we already know the result
-					if (!flag_good_src) break;	
-				
-				}
-				
-				if (flag_good_src)
-				{
-					// we want at least one output to be dst address
-					int good_vout_count = 0;
-					CAmount received_satoshis = 0;
-					for (const CTxOut& txout : tx.vout)
-					{
-						CTxDestination out_address;
-						if (ExtractDestination(txout.scriptPubKey, out_address))
-						{
-							if (CBitcoinAddress(out_address) == dst_address)
-							{
-								good_vout_count++;
-								received_satoshis += txout.nValue; // only dst address received amount matters
-							}
-						}
-					}
-					
-					if (good_vout_count > 0)
-					{
-						UniValue item(UniValue::VOBJ);
-						item.push_back(Pair("height", (int64_t)height));
-						item.push_back(Pair("timestamp", nBlockTime));
-						item.push_back(Pair("txid", str_txid));
-						item.push_back(Pair("received_SAFE", ValueFromAmount(received_satoshis)));
-						result.push_back(item);
-					}
-				}
-			}
-		}
-	}
-	
+    UniValue result(UniValue::VARR);
+    for (auto const &p: intersect_txids)
+    {
+        UniValue item;
+        if (ListFromToItem(ParseHashV(p.second, "txid"), p.first, src_address, dst_address, item))
+            result.push_back(item);
+    }
+    
     return result;
 }
 
@@ -1905,6 +2213,48 @@ UniValue txnotarizedconfirmed(const UniValue& params, bool fHelp, const CPubKey&
     return result;
 }
 
+UniValue txsnotarizedconfirmed(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 1)
+    {
+        string msg = "txsnotarizedconfirmed [\"txid\",...]\n"
+            "\nRuns the txnotarizedconfirmed check for many transactions at once, reading each block and the notarization state only once.\n"
+
+            "\nArguments:\n"
+            "1. \"txids\"     (array, required) Transaction ids.\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\": \"hash\",  (string) The transaction id.\n"
+            "    \"result\": true,  (bool) The value of the check.\n"
+            "  }, ...\n"
+            "]\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("txsnotarizedconfirmed", "'[\"mytxid\",...]'")
+            + HelpExampleRpc("txsnotarizedconfirmed", "[\"mytxid\",...]")
+        ;
+        throw runtime_error(msg);
+    }
+    const UniValue& txidValues = params[0].get_array();
+    std::vector<uint256> vTxids;
+    for (size_t i = 0; i < txidValues.size(); i++)
+        vTxids.push_back(ParseHashV(txidValues[i], "txid"));
+
+    std::vector<bool> vConfirmed;
+    safecoin_txsnotarizedconfirmed(vTxids, vConfirmed);
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vTxids.size(); i++) {
+        UniValue item(UniValue::VOBJ);
+        item.push_back(Pair("txid", vTxids[i].GetHex()));
+        item.push_back(Pair("result", (bool)vConfirmed[i]));
+        result.push_back(item);
+    }
+    return result;
+}
+
 UniValue decodeccopret(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     CTransaction tx; uint256 tokenid,txid,hashblock;
@@ -2012,9 +2362,7 @@ UniValue getnodeinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     if ( pblockindex != 0 ) timestamp = pblockindex->GetBlockTime();
 	
     // checking parentkey
-    std::vector<std::string> notaries = vs_safecoin_notaries(height, timestamp);
-    std::vector<std::string>::iterator it = std::find(notaries.begin(), notaries.end(), parentkey);
-    if (it == notaries.end())
+    if (!safecoin_notaryset(height, timestamp)->IsNotary(parentkey))
     {
 		errors.push_back("Invalid parentkey, should be a valid notary pubkey !");
 		safenode_valid = false;
@@ -2091,6 +2439,99 @@ UniValue getnodeinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return obj;
 }
 
+static int CollateralTier(int64_t collateral_satoshis)
+{
+	int tier = 0;
+	if (collateral_satoshis >= (int64_t)(COLLATERAL_MIN_TIER_1 * 1e8)) tier = 1;
+	if (collateral_satoshis >= (int64_t)(COLLATERAL_MIN_TIER_2 * 1e8)) tier = 2;
+	if (collateral_satoshis >= (int64_t)(COLLATERAL_MIN_TIER_3 * 1e8)) tier = 3;
+	return tier;
+}
+
+struct CSafeNodeCollateral
+{
+	int64_t balance_satoshis;
+	int64_t collateral_satoshis;
+	int tier;
+
+	CSafeNodeCollateral() : balance_satoshis(0), collateral_satoshis(0), tier(0) {}
+};
+
+// collateral per safekey, valid for the tip it was computed at
+static CCriticalSection cs_collateralcache;
+static uint256 collateralCacheTip;
+static std::map<std::string, CSafeNodeCollateral> mapCollateralCache;
+
+/**
+ * Collateral of many safekeys at the current tip. Keys not cached for this tip
+ * are resolved together with one sorted sweep over the address unspent index.
+ * Caller must hold cs_main.
+ */
+static void GetSafeNodeCollaterals(const std::vector<std::string>& safekeys, std::map<std::string, CSafeNodeCollateral>& mapOut)
+{
+	AssertLockHeld(cs_main);
+	uint256 tip = chainActive.LastTip()->GetBlockHash();
+	int32_t height = chainActive.LastTip()->GetHeight();
+	std::map<std::pair<int, uint160>, std::vector<std::string> > mapAddresses;
+
+	{
+		LOCK(cs_collateralcache);
+		if (collateralCacheTip != tip)
+		{
+			mapCollateralCache.clear();
+			collateralCacheTip = tip;
+		}
+		for (int i = 0; i < safekeys.size(); i++)
+		{
+			std::map<std::string, CSafeNodeCollateral>::const_iterator it = mapCollateralCache.find(safekeys[i]);
+			if (it != mapCollateralCache.end())
+			{
+				mapOut[safekeys[i]] = it->second;
+				continue;
+			}
+			uint160 hashBytes;
+			int type = 0;
+			CBitcoinAddress address(str_safe_address(safekeys[i]));
+			if (address.GetIndexKey(hashBytes, type, false))
+				mapAddresses[std::make_pair(type, hashBytes)].push_back(safekeys[i]);
+			else
+				mapOut[safekeys[i]] = mapCollateralCache[safekeys[i]] = CSafeNodeCollateral();
+		}
+	}
+	if (mapAddresses.empty())
+		return;
+
+	std::vector<std::pair<int, uint160> > vAddresses;
+	for (std::map<std::pair<int, uint160>, std::vector<std::string> >::const_iterator it = mapAddresses.begin(); it != mapAddresses.end(); it++)
+		vAddresses.push_back(it->first);
+	std::map<std::pair<int, uint160>, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > mapUnspent;
+	bool fRead = GetAddressUnspent(vAddresses, mapUnspent);
+
+	LOCK(cs_collateralcache);
+	for (std::map<std::pair<int, uint160>, std::vector<std::string> >::const_iterator it = mapAddresses.begin(); it != mapAddresses.end(); it++)
+	{
+		CSafeNodeCollateral collateral;
+		const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs = mapUnspent[it->first];
+		for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itu = unspentOutputs.begin(); itu != unspentOutputs.end(); itu++)
+		{
+			std::string tmp_address;
+			if (!getAddressFromIndex(itu->first.type, itu->first.hashBytes, tmp_address))
+				continue;
+			uint32_t confirmations = height - itu->second.blockHeight;
+			collateral.balance_satoshis += itu->second.satoshis;
+			if (confirmations > COLLATERAL_MATURITY) collateral.collateral_satoshis += itu->second.satoshis;
+		}
+		collateral.tier = CollateralTier(collateral.collateral_satoshis);
+		for (int i = 0; i < it->second.size(); i++)
+		{
+			mapOut[it->second[i]] = collateral;
+			// a failed read is retried on the next call instead of being cached
+			if (fRead)
+				mapCollateralCache[it->second[i]] = collateral;
+		}
+	}
+}
+
 UniValue getcollateralinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() > 1)
@@ -2212,10 +2653,7 @@ UniValue getcollateralinfo(const UniValue& params, bool fHelp, const CPubKey& my
 		obj.push_back(Pair("height", height));
 		obj.push_back(Pair("current_balance", ValueFromAmount(balance_satoshis)));
 		obj.push_back(Pair("collateral", ValueFromAmount(collateral_satoshis)));
-		int tier = 0;
-		if (collateral_satoshis >= (int64_t)(COLLATERAL_MIN_TIER_1 * 1e8)) tier = 1;
-		if (collateral_satoshis >= (int64_t)(COLLATERAL_MIN_TIER_2 * 1e8)) tier = 2;
-		if (collateral_satoshis >= (int64_t)(COLLATERAL_MIN_TIER_3 * 1e8)) tier = 3;
+		int tier = CollateralTier(collateral_satoshis);
 		obj.push_back(Pair("tier", tier));
 		if (!tier)
 		{
@@ -2230,27 +2668,30 @@ UniValue getcollateralinfo(const UniValue& params, bool fHelp, const CPubKey& my
 
 UniValue getregistrationinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
-    if (fHelp || params.size() > 1)
+    if (fHelp || params.size() > 2)
         throw runtime_error(
-            "getregistrationinfo {safekey}\n"
+            "getregistrationinfo {safekey} ( include_mempool )\n"
             "Returns an object containing info about SafeNode registration.\n"
+            "An empty safekey uses -safekey. With include_mempool, a registration still in the mempool\n"
+            "is reported as pending_txid, pending_reg_height and pending_parentkey.\n"
             "\nExamples:\n"
             + HelpExampleCli("getregistrationinfo", "03caeaa88e6ab615ed85135fc5e6ef4a1ccb8cc1142389bbb64607fb47aeb492f0")
             + HelpExampleRpc("getregistrationinfo", "03caeaa88e6ab615ed85135fc5e6ef4a1ccb8cc1142389bbb64607fb47aeb492f0")
         );
 
+    bool fMempool = params.size() > 1 && params[1].get_bool();
     LOCK(cs_main);
 	
 	UniValue obj(UniValue::VOBJ);
     UniValue errors(UniValue::VARR);
 
 	int32_t current_height = chainActive.LastTip()->GetHeight(); 
-    std::vector<std::string> vs_notaries = vs_safecoin_notaries(current_height, 0);
+    CNotarySetRef notaries = safecoin_notaryset(current_height, 0);
 
 	std::string safe_key, safe_address;
 	bool is_valid = true; 
 	
-	if (params.size() == 0)
+	if (params.size() == 0 || params[0].get_str().empty())
 	{
 		// use safekey from conf
 		safe_key = GetArg("-safekey", "");
@@ -2277,76 +2718,41 @@ UniValue getregistrationinfo(const UniValue& params, bool fHelp, const CPubKey&
 		}
 	}
 	
-	int32_t last_reg_height = 0;
-	int32_t last_reg_duration = 0;
-	std::string last_parentkey = "";
-    
+	CSafeNodeRegistration reg;
     
 	if (is_valid)
 	{
         obj.push_back(Pair("safekey", safe_key));
 		obj.push_back(Pair("SAFE_address", safe_address));
         
-		struct safecoin_kv *s;
-		extern struct safecoin_kv *SAFECOIN_KV;
-		extern pthread_mutex_t SAFECOIN_KV_mutex;
-		
-		pthread_mutex_lock(&SAFECOIN_KV_mutex);
-		
-		for(s = SAFECOIN_KV; s != NULL; s = (safecoin_kv*)s->hh.next)
+		// only registrations made under a currently valid parentkey count
+		safenodeRegistry.GetLatest(safe_key, *notaries, reg);
+
+		if (reg.height > 0)
 		{
-			uint8_t *key_ptr = s->key;
-			uint16_t key_size = s->keylen;            
-            uint8_t *value_ptr = s->value;
-			uint16_t value_size = s->valuesize;
-			
-			// check only records with valid safeid size
-			if (value_size == 66)
-			{
-				// check only records with valid key size
-                if (key_size == 74 || key_size == 75)
-                {
-                    std::string str_keyname((char*)key_ptr, (int)key_size);
-                    std::string parentkey = str_keyname.substr(0, 66);
-                    std::string safe_height = str_keyname.substr(66, (key_size == 74) ? 7 : 8);
-                    std::string one = str_keyname.substr((key_size == 74) ? 73 : 74, 1);                   
-                    std::string str_saved_safeid = std::string((char*)value_ptr, (int)value_size);
-                    
-                    // more validations
-                    if (one == "1")
-                    {
-                        // check only records with valid parentkey
-                        std::vector<std::string>::iterator it;
-                        it = find (vs_notaries.begin(), vs_notaries.end(), parentkey);
-                        if (it != vs_notaries.end())
-                        {
-                            if (s->height > last_reg_height && str_saved_safeid == safe_key)
-                            {
-                                last_reg_height = s->height;
-                                last_reg_duration = ((s->flags >> 2) + 1) * SAFECOIN_KVDURATION;
-                                last_parentkey = parentkey;
-                            }
-                        }                        
-                    }
-                }
-            } 
+			obj.push_back(Pair("parentkey", reg.parentkey));
+            obj.push_back(Pair("current_height", current_height));
+			obj.push_back(Pair("last_reg_height", reg.height));
+			obj.push_back(Pair("valid_thru_height", reg.ValidThru()));
+		}
+		else if (!fMempool)
+		{
+			errors.push_back("No registration found !");
+			is_valid = false;
 		}
-		
-		pthread_mutex_unlock(&SAFECOIN_KV_mutex);
 
-		if (last_reg_height > 0)
+		uint256 pending_txid; int32_t pending_height; std::string pending_parentkey;
+		if (fMempool && safecoin_kvmempool_registration(&pending_txid, &pending_height, pending_parentkey, safe_key) == 0)
 		{
-			obj.push_back(Pair("parentkey", last_parentkey));
-            obj.push_back(Pair("current_height", current_height));
-			obj.push_back(Pair("last_reg_height", last_reg_height));
-			obj.push_back(Pair("valid_thru_height", last_reg_height + last_reg_duration));
+			obj.push_back(Pair("pending_txid", pending_txid.GetHex()));
+			obj.push_back(Pair("pending_reg_height", pending_height));
+			obj.push_back(Pair("pending_parentkey", pending_parentkey));
 		}
-		else
+		else if (fMempool && reg.height <= 0)
 		{
 			errors.push_back("No registration found !");
 			is_valid = false;
 		}
-		
 	}
 			
 	obj.push_back(Pair("errors", errors));
@@ -2372,33 +2778,7 @@ UniValue getactivenodes(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
 	int32_t current_height = chainActive.LastTip()->GetHeight(); 
 
-	std::vector<std::string> vs_safekeys;
-	std::vector<std::string>::iterator it;
-	
-	struct safecoin_kv *s;
-	extern struct safecoin_kv *SAFECOIN_KV;
-	extern pthread_mutex_t SAFECOIN_KV_mutex;
-	
-	pthread_mutex_lock(&SAFECOIN_KV_mutex);
-	
-	for(s = SAFECOIN_KV; s != NULL; s = (safecoin_kv*)s->hh.next)
-	{
-		uint8_t *value_ptr = s->value;
-		uint16_t value_size = s->valuesize;
-		
-		// skip checking against records with invalid safeid size
-		if (value_size == 66)
-		{
-			std::string str_saved_safeid = std::string((char*)value_ptr, 66);
-			it = std::find(vs_safekeys.begin(), vs_safekeys.end(), str_saved_safeid);
-			if (it == vs_safekeys.end())
-			{
-				vs_safekeys.push_back(str_saved_safeid);
-			}
-		} 
-	}
-	
-	pthread_mutex_unlock(&SAFECOIN_KV_mutex);
+	std::vector<CSafeNodeRegistration> vActive = safenodeRegistry.GetActive(current_height, *safecoin_notaryset(current_height, 0));
 	
 	int node_count = 0;
 	int tier_0_count = 0;
@@ -2408,37 +2788,34 @@ UniValue getactivenodes(const UniValue& params, bool fHelp, const CPubKey& mypk)
 	double collateral_total = 0;
 	extern bool fAddressIndex;
 	
-	for (int i = 0; i < vs_safekeys.size(); i++)
+	std::map<std::string, CSafeNodeCollateral> mapCollateral;
+	if (fAddressIndex)
 	{
-		UniValue uv_one_node(UniValue::VOBJ), params(UniValue::VARR);
-		params.push_back(vs_safekeys.at(i));
-		UniValue uv_registration_info = getregistrationinfo(params, false, mypk);
-		UniValue uv_safe_address = find_value(uv_registration_info, "SAFE_address");
-		UniValue uv_last_reg_height = find_value(uv_registration_info, "last_reg_height");
-		UniValue uv_valid_thru_height = find_value(uv_registration_info, "valid_thru_height");
-		
-		if (!uv_last_reg_height.isNull() && uv_valid_thru_height.get_int() >= current_height)
+		std::vector<std::string> safekeys;
+		for (int i = 0; i < vActive.size(); i++)
+			safekeys.push_back(vActive[i].safekey);
+		GetSafeNodeCollaterals(safekeys, mapCollateral);
+	}
+	
+	for (int i = 0; i < vActive.size(); i++)
+	{
+		UniValue uv_one_node(UniValue::VOBJ);
+		uv_one_node.push_back(Pair("safekey", vActive[i].safekey));
+		uv_one_node.push_back(Pair("SAFE_address", str_safe_address(vActive[i].safekey)));
+		node_count++;
+		if (fAddressIndex)
 		{
-			uv_one_node.push_back(Pair("safekey", vs_safekeys.at(i)));
-			uv_one_node.push_back(Pair("SAFE_address", uv_safe_address));
-			node_count++;
-			if (fAddressIndex)
-			{
-				UniValue uv_collateral_info = getcollateralinfo(params, false, mypk);
-				UniValue uv_collateral = find_value(uv_collateral_info, "collateral");
-				UniValue uv_balance = find_value(uv_collateral_info, "current_balance");
-				UniValue uv_tier = find_value(uv_collateral_info, "tier");
-				uv_one_node.push_back(Pair("balance", uv_balance));
-				uv_one_node.push_back(Pair("collateral", uv_collateral));
-				collateral_total += uv_collateral.get_real();
-				uv_one_node.push_back(Pair("tier", uv_tier));
-				if (uv_tier.get_int() == 0) tier_0_count++;
-				if (uv_tier.get_int() == 1) tier_1_count++;
-				if (uv_tier.get_int() == 2) tier_2_count++;
-				if (uv_tier.get_int() == 3) tier_3_count++;
-			}	
-			uv_safenodes.push_back(uv_one_node);
-		}
+			const CSafeNodeCollateral& collateral = mapCollateral[vActive[i].safekey];
+			uv_one_node.push_back(Pair("balance", ValueFromAmount(collateral.balance_satoshis)));
+			uv_one_node.push_back(Pair("collateral", ValueFromAmount(collateral.collateral_satoshis)));
+			collateral_total += ValueFromAmount(collateral.collateral_satoshis).get_real();
+			uv_one_node.push_back(Pair("tier", collateral.tier));
+			if (collateral.tier == 0) tier_0_count++;
+			if (collateral.tier == 1) tier_1_count++;
+			if (collateral.tier == 2) tier_2_count++;
+			if (collateral.tier == 3) tier_3_count++;
+		}	
+		uv_safenodes.push_back(uv_one_node);
 	}
 	
 	obj.push_back(Pair("SafeNodes", uv_safenodes));
@@ -2452,14 +2829,63 @@ UniValue getactivenodes(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return obj;
 }
 
+UniValue getrpcqueueinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcqueueinfo\n"
+            "\nReturns the state of the RPC work queue.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"depth\": xxxxx,             (numeric) calls waiting in the client queues\n"
+            "  \"prioritydepth\": xxxxx,     (numeric) calls waiting in the priority lane\n"
+            "  \"processed\": xxxxx,         (numeric) calls run since startup\n"
+            "  \"priorityprocessed\": xxxxx, (numeric) calls run from the priority lane since startup\n"
+            "  \"rejected\": xxxxx,          (numeric) calls refused because a queue was full\n"
+            "  \"avgwait\": xxxxx,           (numeric) average time calls waited in the queue, in microseconds\n"
+            "  \"maxwait\": xxxxx,           (numeric) longest time a call waited in the queue, in microseconds\n"
+            "  \"avgrun\": xxxxx,            (numeric) average time calls took to run, in microseconds\n"
+            "  \"maxrun\": xxxxx,            (numeric) longest time a call took to run, in microseconds\n"
+            "  \"clients\": {                (object) calls waiting per client address\n"
+            "    \"address\": xxxxx,\n"
+            "    ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcqueueinfo", "")
+            + HelpExampleRpc("getrpcqueueinfo", "")
+        );
+
+    HTTPWorkQueueStats stats;
+    if (!GetHTTPWorkQueueStats(stats))
+        throw JSONRPCError(RPC_MISC_ERROR, "RPC work queue not running");
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("depth", (uint64_t)stats.nDepth));
+    obj.push_back(Pair("prioritydepth", (uint64_t)stats.nPriorityDepth));
+    obj.push_back(Pair("processed", stats.nProcessed));
+    obj.push_back(Pair("priorityprocessed", stats.nPriorityProcessed));
+    obj.push_back(Pair("rejected", stats.nRejected));
+    obj.push_back(Pair("avgwait", stats.nProcessed ? stats.nWaitTotal / (int64_t)stats.nProcessed : 0));
+    obj.push_back(Pair("maxwait", stats.nWaitMax));
+    obj.push_back(Pair("avgrun", stats.nProcessed ? stats.nRunTotal / (int64_t)stats.nProcessed : 0));
+    obj.push_back(Pair("maxrun", stats.nRunMax));
+    UniValue clients(UniValue::VOBJ);
+    for (std::map<std::string, size_t>::const_iterator it = stats.mapClientDepth.begin(); it != stats.mapClientDepth.end(); ++it)
+        clients.push_back(Pair(it->first, (uint64_t)it->second));
+    obj.push_back(Pair("clients", clients));
+    return obj;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "control",            "getnodeinfo",            &getnodeinfo,            true  }, 
+    { "control",            "getrpcqueueinfo",        &getrpcqueueinfo,        true  },
+    { "control",            "getnodeinfo",            &getnodeinfo,            true,  true  },
     { "control",            "getcollateralinfo",      &getcollateralinfo,      true  },
     { "control",            "getregistrationinfo",    &getregistrationinfo,    true  }, 
-    { "control",            "getactivenodes",         &getactivenodes,         true  }, 
+    { "control",            "getactivenodes",         &getactivenodes,         true,  true  },
     { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
     { "util",               "z_validateaddress",      &z_validateaddress,      true  }, /* uses wallet if enabled */
     { "util",               "createmultisig",         &createmultisig,         true  },
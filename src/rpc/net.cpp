@@ -128,7 +128,12 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"inflightlimit\": n,        (numeric) How many blocks this peer may have in flight, adapted to how fast it delivers\n"
+            "    \"blocksdownloaded\": n,     (numeric) The number of requested blocks this peer delivered\n"
+            "    \"blocklatency\": n,         (numeric) Average time in milliseconds from requesting a block to receiving it\n"
+            "    \"blockbytespersec\": n,     (numeric) Block download rate from this peer while blocks were in flight\n"
+            "    \"stalls\": n,               (numeric) How often this peer held up the block download window\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -180,6 +185,11 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("inflightlimit", statestats.nBlocksInFlightLimit));
+            obj.push_back(Pair("blocksdownloaded", statestats.nBlocksDownloaded));
+            obj.push_back(Pair("blocklatency", statestats.nAvgBlockLatency / 1000));
+            obj.push_back(Pair("blockbytespersec", statestats.nBlockBytesPerSec));
+            obj.push_back(Pair("stalls", statestats.nStalls));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
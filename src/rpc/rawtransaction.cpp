@@ -22,6 +22,7 @@
 #include "consensus/validation.h"
 #include "core_io.h"
 #include "init.h"
+#include "jsoncache.h"
 #include "deprecation.h"
 #include "key_io.h"
 #include "keystore.h"
@@ -529,9 +530,15 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp, const CPubKey& my
     int nHeight = 0;
     int nConfirmations = 0;
     int nBlockTime = 0;
+    uint256 hashTip;
+    std::string strCacheKey = "tx/" + hash.GetHex();
 
     {
         LOCK(cs_main);
+        hashTip = chainActive.Tip()->GetBlockHash();
+        UniValue cached;
+        if (fVerbose && rpcJSONCache.Get(hashTip, strCacheKey, cached))
+            return cached;
         if (!GetTransaction(hash, tx, hashBlock, true))
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction");
 
@@ -558,6 +565,7 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp, const CPubKey& my
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hex", strHex));
     TxToJSONExpanded(tx, hashBlock, result, nHeight, nConfirmations, nBlockTime);
+    rpcJSONCache.Insert(hashTip, strCacheKey, result);
     return result;
 }
 
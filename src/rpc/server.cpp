@@ -21,15 +21,20 @@
 
 #include "rpc/server.h"
 
+#include "chain.h"
 #include "init.h"
 #include "key_io.h"
 #include "random.h"
 #include "sync.h"
+#include "trace.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "validationinterface.h"
 #include "asyncrpcqueue.h"
 
+#include <algorithm>
+#include <deque>
 #include <memory>
 
 #include <univalue.h>
@@ -285,18 +290,146 @@ UniValue stop(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return buf;
 }
 
+UniValue getrpcstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getrpcstats ( \"method\" )\n"
+            "\nReturns call counts and latencies of the RPC methods called since startup, in microseconds.\n"
+            "Percentiles are the upper bounds of power of two buckets.\n"
+            "\nArguments:\n"
+            "1. \"method\"     (string, optional) Only this method\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"method\": {\n"
+            "    \"calls\": n,        (numeric) calls made\n"
+            "    \"errors\": n,       (numeric) calls that failed\n"
+            "    \"avg\": n,          (numeric) average time of a call\n"
+            "    \"p50\": n,          (numeric) median time of a call\n"
+            "    \"p95\": n,          (numeric) 95th percentile\n"
+            "    \"p99\": n,          (numeric) 99th percentile\n"
+            "    \"max\": n,          (numeric) longest call\n"
+            "    \"lockwait\": n      (numeric) average time a call waited for cs_main\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleCli("getrpcstats", "\"getblock\"")
+            + HelpExampleRpc("getrpcstats", "\"getblock\"")
+        );
+
+    std::string strMethod;
+    if (params.size() > 0)
+        strMethod = params[0].get_str();
+
+    const std::map<std::string, CRPCMethodStats>& mapStats = tableRPC.GetStats();
+    if (!strMethod.empty() && !mapStats.count(strMethod))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown method");
+
+    UniValue result(UniValue::VOBJ);
+    for (std::map<std::string, CRPCMethodStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        const CRPCMethodStats& stats = it->second;
+        uint64_t nCalls = stats.nCalls.load(std::memory_order_relaxed);
+        if (strMethod.empty() ? nCalls == 0 : it->first != strMethod)
+            continue;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("calls", nCalls));
+        entry.push_back(Pair("errors", stats.nErrors.load(std::memory_order_relaxed)));
+        entry.push_back(Pair("avg", nCalls ? stats.nTimeTotal.load(std::memory_order_relaxed) / nCalls : 0));
+        entry.push_back(Pair("p50", stats.Percentile(0.50)));
+        entry.push_back(Pair("p95", stats.Percentile(0.95)));
+        entry.push_back(Pair("p99", stats.Percentile(0.99)));
+        entry.push_back(Pair("max", stats.nTimeMax.load(std::memory_order_relaxed)));
+        entry.push_back(Pair("lockwait", nCalls ? stats.nLockWaitTotal.load(std::memory_order_relaxed) / nCalls : 0));
+        result.push_back(Pair(it->first, entry));
+    }
+    return result;
+}
+
+UniValue getlockprofile(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getlockprofile ( count )\n"
+            "\nReturns the LOCK sites with the most time spent waiting, recorded while the node runs with -lockprofile.\n"
+            "Times are in microseconds, histogram bucket i counts the times below 2^i us, the last one the rest.\n"
+            "\nArguments:\n"
+            "1. count          (numeric, optional, default=20) Number of sites\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lock\": \"name\",       (string) the locked critical section, e.g. cs_main\n"
+            "    \"site\": \"file:line\",  (string) where it was locked\n"
+            "    \"count\": n,            (numeric) times it was locked there\n"
+            "    \"contended\": n,        (numeric) times it had to wait\n"
+            "    \"wait_total\": n,       (numeric) time spent waiting\n"
+            "    \"wait_max\": n,         (numeric) longest wait\n"
+            "    \"hold_total\": n,       (numeric) time the lock was held\n"
+            "    \"hold_max\": n,         (numeric) longest hold\n"
+            "    \"wait_histogram\": [ n, ... ],\n"
+            "    \"hold_histogram\": [ n, ... ]\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockprofile", "")
+            + HelpExampleRpc("getlockprofile", "50")
+        );
+
+    if (!fLockProfile)
+        throw JSONRPCError(RPC_MISC_ERROR, "Start the node with -lockprofile to record lock times");
+
+    size_t nCount = 20;
+    if (params.size() > 0) {
+        if (params[0].get_int() <= 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be positive");
+        nCount = params[0].get_int();
+    }
+
+    std::vector<const CLockSiteStats*> vSites = GetLockProfile();
+    std::sort(vSites.begin(), vSites.end(), [](const CLockSiteStats* a, const CLockSiteStats* b) {
+        return a->nWaitTotal.load(std::memory_order_relaxed) > b->nWaitTotal.load(std::memory_order_relaxed);
+    });
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vSites.size() && i < nCount; i++) {
+        const CLockSiteStats& site = *vSites[i];
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("lock", site.strName));
+        entry.push_back(Pair("site", site.strSite));
+        entry.push_back(Pair("count", site.nCount.load(std::memory_order_relaxed)));
+        entry.push_back(Pair("contended", site.nContended.load(std::memory_order_relaxed)));
+        entry.push_back(Pair("wait_total", site.nWaitTotal.load(std::memory_order_relaxed)));
+        entry.push_back(Pair("wait_max", site.nWaitMax.load(std::memory_order_relaxed)));
+        entry.push_back(Pair("hold_total", site.nHoldTotal.load(std::memory_order_relaxed)));
+        entry.push_back(Pair("hold_max", site.nHoldMax.load(std::memory_order_relaxed)));
+        UniValue waits(UniValue::VARR), holds(UniValue::VARR);
+        for (int j = 0; j < LOCK_PROFILE_BUCKETS; j++) {
+            waits.push_back(site.vWaitHistogram[j].load(std::memory_order_relaxed));
+            holds.push_back(site.vHoldHistogram[j].load(std::memory_order_relaxed));
+        }
+        entry.push_back(Pair("wait_histogram", waits));
+        entry.push_back(Pair("hold_histogram", holds));
+        result.push_back(entry);
+    }
+    return result;
+}
+
 /**
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode cacheByTip parallelBatch
+  //  --------------------- ------------------------  -----------------------  ---------- ---------- -------------
     /* Overall control/query calls */
     { "control",            "help",                   &help,                   true  },
     { "control",            "getiguanajson",          &getiguanajson,          true  },
     { "control",            "getnotarysendmany",      &getnotarysendmany,      true  },
     { "control",            "geterablockheights",     &geterablockheights,     true  },
     { "control",            "stop",                   &stop,                   true  },
+    { "control",            "getrpcstats",            &getrpcstats,            true  },
+    { "control",            "getlockprofile",         &getlockprofile,         true  },
 
     /* P2P networking */
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
@@ -315,24 +448,27 @@ static const CRPCCommand vRPCCommands[] =
     /* Block chain and UTXO */
     { "blockchain",         "coinsupply",             &coinsupply,             true  },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
+    { "blockchain",         "getindexinfo",           &getindexinfo,           true  },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
     { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false },
-    { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
+    { "blockchain",         "getblock",               &getblock,               true,  false, true  },
+    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false, false, true  },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         true,  false, true  },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  false, true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,  false, true  },
     { "blockchain",         "getlastsegidstakes",     &getlastsegidstakes,     true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
+    { "blockchain",         "gettxout",               &gettxout,               true,  false, true  },
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  false, true  },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,  false, true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "getvalidationstats",     &getvalidationstats,     true  },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
-    { "blockchain",         "getspentinfo",           &getspentinfo,           false },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           false, false, true  },
     //{ "blockchain",         "paxprice",               &paxprice,               true  },
     //{ "blockchain",         "paxpending",             &paxpending,             true  },
     //{ "blockchain",         "paxprices",              &paxprices,              true  },
@@ -340,8 +476,8 @@ static const CRPCCommand vRPCCommands[] =
     //{ "blockchain",         "height_MoM",             &height_MoM,             true  },
     //{ "blockchain",         "txMoMproof",             &txMoMproof,             true  },
     { "blockchain",         "minerids",               &minerids,               true  },
-    { "blockchain",         "optsafeids",             &optsafeids,             true  },
-    { "blockchain",         "safeids",                &safeids,                true  },
+    { "blockchain",         "optsafeids",             &optsafeids,             true,  true  },
+    { "blockchain",         "safeids",                &safeids,                true,  true  },
     { "blockchain",         "kvsearch",               &kvsearch,               true  },
     { "blockchain",         "kvupdate",               &kvupdate,               true  },
     { "blockchain",         "regnode",                &regnode,                true  },
@@ -398,9 +534,9 @@ static const CRPCCommand vRPCCommands[] =
 
     /* Raw transactions */
     { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  false, true  },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,  false, true  },
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,  false, true  },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
 #ifdef ENABLE_WALLET
@@ -585,15 +721,15 @@ static const CRPCCommand vRPCCommands[] =
     { "pegs",       "pegsinfo",         &pegsinfo,      true },
 
     /* Address index */
-    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true  },
-    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false },
+    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true,  false, true  },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false, false, true  },
     { "addressindex",       "listutxos",              &listutxos,              false },
     { "addressindex",       "listfromto",             &listfromto,             false },
     { "addressindex",       "checknotarization",      &checknotarization,      false },
     { "addressindex",       "getnotarypayinfo",       &getnotarypayinfo,       false },
-    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false },
-    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false },
-    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false, false, true  },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false, false, true  },
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false, false, true  },
     { "addressindex",       "getsnapshot",            &getsnapshot,            false },
 
     /* Utility functions */
@@ -601,6 +737,7 @@ static const CRPCCommand vRPCCommands[] =
     { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
     { "util",               "verifymessage",          &verifymessage,          true  },
     { "util",               "txnotarizedconfirmed",   &txnotarizedconfirmed,   true  },
+    { "util",               "txsnotarizedconfirmed",  &txsnotarizedconfirmed,  true  },
     { "util",               "decodeccopret",   &decodeccopret,   true  },
     { "util",               "estimatefee",            &estimatefee,            true  },
     { "util",               "estimatepriority",       &estimatepriority,       true  },
@@ -630,6 +767,7 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "cleanwallettransactions", &cleanwallettransactions, false },
     { "wallet",             "getbalance",             &getbalance,             false },
     { "wallet",             "getbalance64",           &getbalance64,             false },
+    { "wallet",             "getconsolidationinfo",   &getconsolidationinfo,   false },
     { "wallet",             "getnewaddress",          &getnewaddress,          true  },
 //    { "wallet",             "getnewaddress64",        &getnewaddress64,          true  },
     { "wallet",             "getrawchangeaddress",    &getrawchangeaddress,    true  },
@@ -677,6 +815,7 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "z_getoperationstatus",   &z_getoperationstatus,   true  },
     { "wallet",             "z_getoperationresult",   &z_getoperationresult,   true  },
     { "wallet",             "z_listoperationids",     &z_listoperationids,     true  },
+    { "wallet",             "z_setoperationpriority", &z_setoperationpriority, true  },
     { "wallet",             "z_getnewaddress",        &z_getnewaddress,        true  },
     { "wallet",             "z_listaddresses",        &z_listaddresses,        true  },
     { "wallet",             "z_exportkey",            &z_exportkey,            true  },
@@ -702,6 +841,7 @@ CRPCTable::CRPCTable()
 
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
+        mapStats[pcmd->name];
     }
 }
 
@@ -724,29 +864,292 @@ bool CRPCTable::appendCommand(const std::string& name, const CRPCCommand* pcmd)
         return false;
 
     mapCommands[name] = pcmd;
+    mapStats[name];
     return true;
 }
 
+CRPCMethodStats::CRPCMethodStats() : nCalls(0), nErrors(0), nTimeTotal(0), nTimeMax(0), nLockWaitTotal(0)
+{
+    for (int i = 0; i < BUCKETS; i++)
+        vBuckets[i] = 0;
+}
+
+void CRPCMethodStats::Add(int64_t nTime, int64_t nLockWait, bool fError)
+{
+    nTime = std::max(nTime, (int64_t)0);
+    int nBucket = 0;
+    while (nBucket < BUCKETS - 1 && nTime >= BucketLimit(nBucket))
+        nBucket++;
+    vBuckets[nBucket].fetch_add(1, std::memory_order_relaxed);
+    nCalls.fetch_add(1, std::memory_order_relaxed);
+    if (fError)
+        nErrors.fetch_add(1, std::memory_order_relaxed);
+    nTimeTotal.fetch_add(nTime, std::memory_order_relaxed);
+    nLockWaitTotal.fetch_add(std::max(nLockWait, (int64_t)0), std::memory_order_relaxed);
+    uint64_t nMax = nTimeMax.load(std::memory_order_relaxed);
+    while ((uint64_t)nTime > nMax && !nTimeMax.compare_exchange_weak(nMax, nTime, std::memory_order_relaxed)) {}
+}
+
+int64_t CRPCMethodStats::Percentile(double dFraction) const
+{
+    uint64_t vCounts[BUCKETS];
+    uint64_t nTotal = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        vCounts[i] = vBuckets[i].load(std::memory_order_relaxed);
+        nTotal += vCounts[i];
+    }
+    if (nTotal == 0)
+        return 0;
+    uint64_t nRank = std::max((uint64_t)1, (uint64_t)(dFraction * nTotal + 0.5));
+    uint64_t nSeen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        nSeen += vCounts[i];
+        if (nSeen >= nRank)
+            return BucketLimit(i);
+    }
+    return BucketLimit(BUCKETS - 1);
+}
+
+std::string RPCStatsToPrometheus()
+{
+    std::string strOut;
+    const std::map<std::string, CRPCMethodStats>& mapStats = tableRPC.GetStats();
+    strOut += "# TYPE safecoin_rpc_errors_total counter\n";
+    for (std::map<std::string, CRPCMethodStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        if (it->second.nCalls.load(std::memory_order_relaxed))
+            strOut += strprintf("safecoin_rpc_errors_total{method=\"%s\"} %u\n", it->first, it->second.nErrors.load(std::memory_order_relaxed));
+    }
+    strOut += "# TYPE safecoin_rpc_lock_wait_microseconds_total counter\n";
+    for (std::map<std::string, CRPCMethodStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        if (it->second.nCalls.load(std::memory_order_relaxed))
+            strOut += strprintf("safecoin_rpc_lock_wait_microseconds_total{method=\"%s\"} %u\n", it->first, it->second.nLockWaitTotal.load(std::memory_order_relaxed));
+    }
+    strOut += "# TYPE safecoin_rpc_duration_microseconds histogram\n";
+    for (std::map<std::string, CRPCMethodStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        const CRPCMethodStats& stats = it->second;
+        uint64_t nCalls = stats.nCalls.load(std::memory_order_relaxed);
+        if (!nCalls)
+            continue;
+        // the last bucket also counts everything above it, so it is only reported as +Inf
+        uint64_t nCumulative = 0;
+        for (int i = 0; i < CRPCMethodStats::BUCKETS - 1; i++) {
+            nCumulative += stats.vBuckets[i].load(std::memory_order_relaxed);
+            strOut += strprintf("safecoin_rpc_duration_microseconds_bucket{method=\"%s\",le=\"%d\"} %u\n", it->first, CRPCMethodStats::BucketLimit(i), nCumulative);
+        }
+        nCumulative += stats.vBuckets[CRPCMethodStats::BUCKETS - 1].load(std::memory_order_relaxed);
+        strOut += strprintf("safecoin_rpc_duration_microseconds_bucket{method=\"%s\",le=\"+Inf\"} %u\n", it->first, nCumulative);
+        strOut += strprintf("safecoin_rpc_duration_microseconds_sum{method=\"%s\"} %u\n", it->first, stats.nTimeTotal.load(std::memory_order_relaxed));
+        strOut += strprintf("safecoin_rpc_duration_microseconds_count{method=\"%s\"} %u\n", it->first, nCumulative);
+    }
+    return strOut;
+}
+
+//! -rpcslowcall in milliseconds
+static int64_t nRPCSlowCall = DEFAULT_RPC_SLOW_CALL;
+
+/** Records the time of one call in the method statistics, however the call ends */
+class CRPCCallTimer
+{
+private:
+    const std::string& strMethod;
+    CRPCMethodStats* pstats;
+    int64_t nTimeStart;
+    int64_t nLockWaitStart;
+public:
+    bool fError;
+
+    CRPCCallTimer(const std::string& strMethodIn, CRPCMethodStats* pstatsIn) :
+        strMethod(strMethodIn), pstats(pstatsIn), nTimeStart(GetTimeMicros()), nLockWaitStart(GetLockWaitMicros()), fError(true)
+    {
+        TRACE1(rpc, start, strMethod.c_str());
+    }
+
+    ~CRPCCallTimer()
+    {
+        int64_t nTime = GetTimeMicros() - nTimeStart;
+        int64_t nLockWait = GetLockWaitMicros() - nLockWaitStart;
+        TRACE4(rpc, finish, strMethod.c_str(), fError, nTime, nLockWait);
+        if (pstats)
+            pstats->Add(nTime, nLockWait, fError);
+        if (nRPCSlowCall > 0 && nTime >= nRPCSlowCall * 1000)
+            LogPrintf("Slow RPC call %s%s took %dms, %dms of it waiting for cs_main\n", SanitizeString(strMethod),
+                      fError ? " (failed)" : "", nTime / 1000, nLockWait / 1000);
+    }
+};
+
+/** Most distinct (method, params) results kept for one tip */
+static const size_t RPC_TIPCACHE_MAX_ENTRIES = 256;
+
+/**
+ * Results of fCacheByTip commands for the current chain tip, dropped on every
+ * UpdatedBlockTip. That signal only fires once initial block download is over,
+ * so nothing is cached before the first tip it reports.
+ */
+class CRPCTipCache : public CValidationInterface
+{
+private:
+    CCriticalSection cs;
+    uint256 hashTip;
+    uint64_t nGeneration;
+    std::map<std::string, UniValue> mapResults;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex)
+    {
+        LOCK(cs);
+        hashTip = pindex->GetBlockHash();
+        nGeneration++;
+        mapResults.clear();
+    }
+
+public:
+    CRPCTipCache() : nGeneration(0) {}
+
+    /** Cached result for key; generation is what a result computed on a miss must be stored with */
+    bool Get(const std::string& key, UniValue& result, uint64_t& generation)
+    {
+        LOCK(cs);
+        generation = nGeneration;
+        if (hashTip.IsNull())
+            return false;
+        std::map<std::string, UniValue>::const_iterator it = mapResults.find(key);
+        if (it == mapResults.end())
+            return false;
+        result = it->second;
+        return true;
+    }
+
+    void Put(const std::string& key, const UniValue& result, uint64_t generation)
+    {
+        LOCK(cs);
+        // the tip moved while the result was computed
+        if (hashTip.IsNull() || generation != nGeneration)
+            return;
+        if (mapResults.size() >= RPC_TIPCACHE_MAX_ENTRIES)
+            mapResults.clear();
+        mapResults[key] = result;
+    }
+};
+
+static CRPCTipCache rpcTipCache;
+
+static UniValue JSONRPCExecOne(const UniValue& req);
+
+/**
+ * Threads running runs of consecutive fParallelBatch calls from JSON-RPC batches. The HTTP worker
+ * that received the batch takes calls from the run as well, so a batch never waits on a busy pool,
+ * and every reply goes to the slot of its call so the batch reply keeps the order of the request.
+ */
+class CRPCBatchPool
+{
+private:
+    struct Job {
+        const UniValue* pvReq;
+        std::vector<UniValue>* pvReply;
+        size_t nNext;
+        size_t nEnd;
+        int nWorkers;   //! pool threads that took the job off the queue and may still be running calls
+    };
+
+    boost::mutex cs;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    //! a job is queued once for every pool thread it could use
+    std::deque<Job*> queue;
+    boost::thread_group threads;
+    int nThreads;
+
+    /** Run calls of job until none are left, cs is held by lock on entry and on return */
+    void Work(Job* job, boost::unique_lock<boost::mutex>& lock)
+    {
+        while (job->nNext < job->nEnd) {
+            size_t i = job->nNext++;
+            lock.unlock();
+            UniValue reply = JSONRPCExecOne((*job->pvReq)[i]);
+            lock.lock();
+            (*job->pvReply)[i] = reply;
+        }
+    }
+
+    void Thread()
+    {
+        RenameThread("safecoin-rpcbatch");
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (true) {
+            while (queue.empty())
+                condWork.wait(lock); // interruption point
+            Job* job = queue.front();
+            queue.pop_front();
+            // Exec waits for nWorkers to drop back, so a Stop() must not unwind us in the middle of
+            // a call, the interruption is taken at the next wait instead
+            boost::this_thread::disable_interruption di;
+            job->nWorkers++;
+            Work(job, lock);
+            if (--job->nWorkers == 0)
+                condDone.notify_all();
+        }
+    }
+
+public:
+    CRPCBatchPool() : nThreads(0) {}
+
+    void Start(int nThreadsIn)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (nThreads > 0)
+            return;
+        nThreads = std::max(nThreadsIn, 0);
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CRPCBatchPool::Thread, this));
+    }
+
+    void Stop()
+    {
+        threads.interrupt_all();
+        threads.join_all();
+        boost::unique_lock<boost::mutex> lock(cs);
+        nThreads = 0;
+    }
+
+    /** Execute the calls vReq[nBegin, nEnd), putting their replies at the same indexes of vReply */
+    void Exec(const UniValue& vReq, std::vector<UniValue>& vReply, size_t nBegin, size_t nEnd)
+    {
+        // pool threads may hold on to job until it is done, so this must not unwind early
+        boost::this_thread::disable_interruption di;
+
+        Job job = { &vReq, &vReply, nBegin, nEnd, 0 };
+        boost::unique_lock<boost::mutex> lock(cs);
+        int nHelpers = (int)std::min<size_t>(nThreads, nEnd - nBegin - 1);
+        for (int i = 0; i < nHelpers; i++)
+            queue.push_back(&job);
+        if (nHelpers > 0)
+            condWork.notify_all();
+        Work(&job, lock);
+        // drop the entries no thread got to, then wait for the calls still running elsewhere
+        queue.erase(std::remove(queue.begin(), queue.end(), &job), queue.end());
+        while (job.nWorkers > 0)
+            condDone.wait(lock);
+    }
+};
+
+static CRPCBatchPool rpcBatchPool;
+
 bool StartRPC()
 {
     LogPrint("rpc", "Starting RPC\n");
     fRPCRunning = true;
+    RegisterValidationInterface(&rpcTipCache);
     g_rpcSignals.Started();
-
-    // Launch one async rpc worker.  The ability to launch multiple workers is not recommended at present and thus the option is disabled.
+    rpcBatchPool.Start(GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS));
+    nRPCSlowCall = GetArg("-rpcslowcall", DEFAULT_RPC_SLOW_CALL);
+
+    // Launch one async rpc worker, more are added while operations wait, as many as
+    // there are cores for the proofs unless -rpcasyncthreads says otherwise.
+    int n = GetArg("-rpcasyncthreads", DEFAULT_RPC_ASYNC_THREADS);
+    if (n <= 0)
+        n = std::max(1, GetNumCores());
+    getAsyncRPCQueue()->setMaxWorkers(n);
     getAsyncRPCQueue()->addWorker();
-/*
-    int n = GetArg("-rpcasyncthreads", 1);
-    if (n<1) {
-        LogPrintf("ERROR: Invalid value %d for -rpcasyncthreads.  Must be at least 1.\n", n);
-        strerr = strprintf(_("An error occurred while setting up the Async RPC threads, invalid parameter value of %d (must be at least 1)."), n);
-        uiInterface.ThreadSafeMessageBox(strerr, "", CClientUIInterface::MSG_ERROR);
-        StartShutdown();
-        return;
-    }
-    for (int i = 0; i < n; i++)
-        getAsyncRPCQueue()->addWorker();
-*/
     return true;
 }
 
@@ -761,7 +1164,9 @@ void StopRPC()
 {
     LogPrint("rpc", "Stopping RPC\n");
     deadlineTimers.clear();
+    UnregisterValidationInterface(&rpcTipCache);
     g_rpcSignals.Stopped();
+    rpcBatchPool.Stop();
 
     // Tells async queue to cancel all operations and shutdown.
     LogPrintf("%s: waiting for async rpc workers to stop\n", __func__);
@@ -848,13 +1253,41 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+static bool IsParallelBatchCall(const UniValue& req)
 {
-    UniValue ret(UniValue::VARR);
-    for (size_t reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req.get_obj(), "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->fParallelBatch;
+}
+
+UniValue JSONRPCExecBatch(const UniValue& vReq)
+{
+    // Runs of consecutive read-only calls execute concurrently, every other call
+    // waits for the calls before it and runs alone, as in a sequential batch
+    std::vector<UniValue> vReply(vReq.size());
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size())
+    {
+        size_t nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsParallelBatchCall(vReq[nEnd]))
+            nEnd++;
+        if (nEnd - reqIdx > 1) {
+            rpcBatchPool.Exec(vReq, vReply, reqIdx, nEnd);
+            reqIdx = nEnd;
+        } else {
+            vReply[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+        }
+    }
 
-    return ret.write() + "\n";
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < vReply.size(); i++)
+        ret.push_back(vReply[i]);
+    return ret;
 }
 
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
@@ -875,10 +1308,27 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    std::map<std::string, CRPCMethodStats>::iterator itStats = mapStats.find(strMethod);
+    CRPCCallTimer timer(strMethod, itStats != mapStats.end() ? &itStats->second : NULL);
     try
     {
         // Execute
-        return pcmd->actor(params, false, CPubKey());
+        if (pcmd->fCacheByTip) {
+            std::string strKey = strMethod + " " + params.write();
+            UniValue result;
+            uint64_t nGeneration;
+            if (rpcTipCache.Get(strKey, result, nGeneration)) {
+                timer.fError = false;
+                return result;
+            }
+            result = pcmd->actor(params, false, CPubKey());
+            rpcTipCache.Put(strKey, result, nGeneration);
+            timer.fError = false;
+            return result;
+        }
+        UniValue result = pcmd->actor(params, false, CPubKey());
+        timer.fError = false;
+        return result;
     }
     catch (const std::exception& e)
     {
@@ -25,6 +25,7 @@
 #include "rpc/protocol.h"
 #include "uint256.h"
 
+#include <atomic>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -142,6 +143,38 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    bool fCacheByTip;   //! result depends only on params and the chain tip, reuse it until the tip changes
+    bool fParallelBatch; //! read-only and safe to run concurrently with others like it within a batch
+};
+
+/** -rpcbatchthreads default, threads helping the HTTP worker with the calls of a JSON-RPC batch */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+
+/** -rpcslowcall default, in milliseconds, 0 logs no slow calls */
+static const int64_t DEFAULT_RPC_SLOW_CALL = 0;
+
+/**
+ * Call counts and a latency histogram of one RPC method, updated without locks.
+ * Bucket i counts the calls that took less than 2^i microseconds and at least
+ * half of that.
+ */
+class CRPCMethodStats
+{
+public:
+    static const int BUCKETS = 36;
+
+    std::atomic<uint64_t> nCalls;
+    std::atomic<uint64_t> nErrors;
+    std::atomic<uint64_t> nTimeTotal;
+    std::atomic<uint64_t> nTimeMax;
+    std::atomic<uint64_t> nLockWaitTotal;   //! time spent waiting for cs_main
+    std::atomic<uint64_t> vBuckets[BUCKETS];
+
+    CRPCMethodStats();
+    void Add(int64_t nTime, int64_t nLockWait, bool fError);
+    /** Upper bound of the bucket the given fraction of calls falls under, in microseconds */
+    int64_t Percentile(double dFraction) const;
+    static int64_t BucketLimit(int nBucket) { return (int64_t)1 << nBucket; }
 };
 
 /**
@@ -151,6 +184,8 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    //! one entry per command, made along with it before the server starts
+    mutable std::map<std::string, CRPCMethodStats> mapStats;
 public:
     CRPCTable();
     const CRPCCommand* operator[](const std::string& name) const;
@@ -172,8 +207,14 @@ public:
      * Commands cannot be overwritten (returns false).
      */
     bool appendCommand(const std::string& name, const CRPCCommand* pcmd);
+
+    /** Statistics of the methods, by name */
+    const std::map<std::string, CRPCMethodStats>& GetStats() const { return mapStats; }
 };
 
+/** The method statistics in the Prometheus text exposition format */
+std::string RPCStatsToPrometheus();
+
 extern CRPCTable tableRPC;
 
 /**
@@ -190,6 +231,7 @@ extern CAmount AmountFromValue(const UniValue& value);
 extern UniValue ValueFromAmount(const CAmount& amount);
 extern double GetDifficulty(const CBlockIndex* blockindex = NULL);
 extern double GetNetworkDifficulty(const CBlockIndex* blockindex = NULL);
+extern double GetDifficultyFromBits(uint32_t bits);
 extern std::string HelpRequiringPassphrase();
 extern std::string HelpExampleCli(const std::string& methodname, const std::string& args);
 extern std::string HelpExampleRpc(const std::string& methodname, const std::string& args);
@@ -199,7 +241,7 @@ extern void EnsureWalletIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+UniValue JSONRPCExecBatch(const UniValue& vReq);
 
 extern std::string experimentalDisabledHelpMsg(const std::string& rpc, const std::string& enableArg);
 
@@ -378,6 +420,7 @@ extern UniValue getreceivedbyaccount(const UniValue& params, bool fHelp, const C
 extern UniValue cleanwallettransactions(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getbalance(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getbalance64(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getconsolidationinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getunconfirmedbalance(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue movecmd(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue sendfrom(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -399,6 +442,7 @@ extern UniValue walletlock(const UniValue& params, bool fHelp, const CPubKey& my
 extern UniValue encryptwallet(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue validateaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue txnotarizedconfirmed(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue txsnotarizedconfirmed(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue decodeccopret(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getiguanajson(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -408,6 +452,7 @@ extern UniValue setpubkey(const UniValue& params, bool fHelp, const CPubKey& myp
 extern UniValue setstakingsplit(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getwalletinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockchaininfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getindexinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getnetworkinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getdeprecationinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue setmocktime(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -445,6 +490,7 @@ extern UniValue getbestblockhash(const UniValue& params, bool fHelp, const CPubK
 extern UniValue getdifficulty(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue settxfee(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getvalidationstats(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockhashes(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockdeltas(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -453,6 +499,7 @@ extern UniValue getblockheader(const UniValue& params, bool fHelp, const CPubKey
 extern UniValue getlastsegidstakes(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblock(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue dumptxoutset(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue gettxout(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue verifychain(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getchaintips(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -506,6 +553,7 @@ extern UniValue z_shieldcoinbase(const UniValue& params, bool fHelp, const CPubK
 extern UniValue z_getoperationstatus(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcwallet.cpp
 extern UniValue z_getoperationresult(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcwallet.cpp
 extern UniValue z_listoperationids(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcwallet.cpp
+extern UniValue z_setoperationpriority(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcwallet.cpp
 extern UniValue opreturn_burn(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcwallet.cpp
 extern UniValue z_validateaddress(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcmisc.cpp
 extern UniValue z_getpaymentdisclosure(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcdisclosure.cpp
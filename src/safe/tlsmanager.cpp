@@ -31,6 +31,63 @@ int tlsCertVerificationCallback(int preverify_ok, X509_STORE_CTX* chainContext)
 {
     return 1;
 }
+
+/** Most client sessions kept for resuming connections to peers we reconnect to */
+static const size_t TLS_SESSION_CACHE_SIZE = 1024;
+
+static CCriticalSection cs_tlsSessions;
+static std::map<std::string, SSL_SESSION*> mapTLSSessions; // by peer ip:port
+static std::deque<std::string> vTLSSessionsOrder;
+static int nTLSPeerIndex = -1; // SSL ex_data slot holding the peer key of an outgoing connection
+
+static void tlsPeerFree(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp)
+{
+    delete (std::string*)ptr;
+}
+
+static void tlsSessionForget(const std::string& strPeer)
+{
+    LOCK(cs_tlsSessions);
+    std::map<std::string, SSL_SESSION*>::iterator it = mapTLSSessions.find(strPeer);
+    if (it != mapTLSSessions.end()) {
+        SSL_SESSION_free(it->second);
+        mapTLSSessions.erase(it);
+    }
+}
+
+/**
+ * @brief Keep the session of an outgoing connection, to resume it when reconnecting. TLS 1.3 servers send
+ * their tickets after the handshake, so this is called from SSL_read as well.
+ *
+ * @param ssl the connection.
+ * @param session the new session.
+ * @return int returns 1 when the session is kept, which takes over its reference.
+ */
+static int tlsNewSessionCallback(SSL* ssl, SSL_SESSION* session)
+{
+    std::string* pstrPeer = (std::string*)SSL_get_ex_data(ssl, nTLSPeerIndex);
+    if (pstrPeer == NULL)
+        return 0;
+
+    LOCK(cs_tlsSessions);
+    std::map<std::string, SSL_SESSION*>::iterator it = mapTLSSessions.find(*pstrPeer);
+    if (it != mapTLSSessions.end()) {
+        SSL_SESSION_free(it->second);
+        it->second = session;
+        return 1;
+    }
+    mapTLSSessions[*pstrPeer] = session;
+    vTLSSessionsOrder.push_back(*pstrPeer);
+    while (vTLSSessionsOrder.size() > TLS_SESSION_CACHE_SIZE) {
+        it = mapTLSSessions.find(vTLSSessionsOrder.front());
+        if (it != mapTLSSessions.end()) {
+            SSL_SESSION_free(it->second);
+            mapTLSSessions.erase(it);
+        }
+        vTLSSessionsOrder.pop_front();
+    }
+    return 1;
+}
 /**
  * @brief Wait for a given SSL connection event.
  * 
@@ -79,14 +136,8 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
             break;
         }
 
-        fd_set socketSet;
-        FD_ZERO(&socketSet);
-        FD_SET(hSocket, &socketSet);
-
-        struct timeval timeout = {timeoutSec, 0};
-
         if (sslErr == SSL_ERROR_WANT_READ) {
-            int result = select(hSocket + 1, &socketSet, NULL, NULL, &timeout);
+            int result = WaitForSocket(hSocket, false, timeoutSec * 1000);
             if (result == 0) {
                 LogPrint("net", "TLS: ERROR: %s: %s: WANT_READ timeout\n", __FILE__, __func__);
                 nErr = -1;
@@ -97,7 +148,7 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
                 break;
             }
         } else {
-            int result = select(hSocket + 1, NULL, &socketSet, NULL, &timeout);
+            int result = WaitForSocket(hSocket, true, timeoutSec * 1000);
             if (result == 0) {
                 LogPrint("net", "TLS: ERROR: %s: %s: WANT_WRITE timeout\n", __FILE__, __func__);
                 nErr = -1;
@@ -112,6 +163,18 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
 
     return nErr;
 }
+/**
+ * @brief log whether the kernel took over the encryption of a connection (kTLS)
+ *
+ * @param ssl the established connection.
+ */
+static void logKTLS(SSL* ssl)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && defined(BIO_get_ktls_send)
+    if (GetBoolArg("-tlsktls", DEFAULT_TLS_KTLS))
+        LogPrint("net", "TLS: kernel TLS send %s, receive %s\n", BIO_get_ktls_send(SSL_get_wbio(ssl)) ? "on" : "off", BIO_get_ktls_recv(SSL_get_rbio(ssl)) ? "on" : "off");
+#endif
+}
 /**
  * @brief establish TLS connection to an address
  * 
@@ -126,9 +189,18 @@ SSL* TLSManager::connect(SOCKET hSocket, const CAddress& addrConnect)
 
     SSL* ssl = NULL;
     bool bConnectedTLS = false;
+    std::string strPeer = addrConnect.ToStringIPPort();
 
     if ((ssl = SSL_new(tls_ctx_client))) {
         if (SSL_set_fd(ssl, hSocket)) {
+            // resume the last session with this peer, saving the key exchange and certificate checks
+            SSL_set_ex_data(ssl, nTLSPeerIndex, new std::string(strPeer));
+            {
+                LOCK(cs_tlsSessions);
+                std::map<std::string, SSL_SESSION*>::iterator it = mapTLSSessions.find(strPeer);
+                if (it != mapTLSSessions.end())
+                    SSL_set_session(ssl, it->second);
+            }
             if (TLSManager::waitFor(SSL_CONNECT, hSocket, ssl, (DEFAULT_CONNECT_TIMEOUT / 1000)) == 1)
 
                 bConnectedTLS = true;
@@ -136,9 +208,11 @@ SSL* TLSManager::connect(SOCKET hSocket, const CAddress& addrConnect)
     }
 
     if (bConnectedTLS) {
-        LogPrintf("TLS: connection to %s has been established. Using cipher: %s\n", addrConnect.ToString(), SSL_get_cipher(ssl));
+        LogPrintf("TLS: connection to %s has been established (%s). Using cipher: %s\n", addrConnect.ToString(), SSL_session_reused(ssl) ? "resumed" : "full handshake", SSL_get_cipher(ssl));
+        logKTLS(ssl);
     } else {
         LogPrintf("TLS: %s: %s: TLS connection to %s failed\n", __FILE__, __func__, addrConnect.ToString());
+        tlsSessionForget(strPeer);
 
         if (ssl) {
             SSL_free(ssl);
@@ -172,6 +246,23 @@ SSL_CTX* TLSManager::initCtx(
     if ((tlsCtx = SSL_CTX_new(ctxType == SERVER_CONTEXT ? TLS_server_method() : TLS_client_method()))) {
         SSL_CTX_set_mode(tlsCtx, SSL_MODE_AUTO_RETRY);
 
+        // Session resumption: the server hands out tickets (resumption with client certificates
+        // needs a session id context), the client keeps one session per peer.
+        if (ctxType == SERVER_CONTEXT) {
+            static const unsigned char sidCtx[] = "safecoin-p2p";
+            SSL_CTX_set_session_id_context(tlsCtx, sidCtx, sizeof(sidCtx) - 1);
+            SSL_CTX_set_session_cache_mode(tlsCtx, SSL_SESS_CACHE_SERVER);
+        } else {
+            SSL_CTX_set_session_cache_mode(tlsCtx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(tlsCtx, tlsNewSessionCallback);
+        }
+
+#ifdef SSL_OP_ENABLE_KTLS
+        // Let the kernel do the record encryption after the handshake, where it supports the cipher
+        if (GetBoolArg("-tlsktls", DEFAULT_TLS_KTLS))
+            SSL_CTX_set_options(tlsCtx, SSL_OP_ENABLE_KTLS);
+#endif
+
         int rootCertsNum = LoadDefaultRootCertificates(tlsCtx);
         int trustedPathsNum = 0;
 
@@ -269,7 +360,8 @@ SSL* TLSManager::accept(SOCKET hSocket, const CAddress& addr)
     }
 
     if (bAcceptedTLS) {
-        LogPrintf("TLS: connection from %s has been accepted. Using cipher: %s\n", addr.ToString(), SSL_get_cipher(ssl));
+        LogPrintf("TLS: connection from %s has been accepted (%s). Using cipher: %s\n", addr.ToString(), SSL_session_reused(ssl) ? "resumed" : "full handshake", SSL_get_cipher(ssl));
+        logKTLS(ssl);
     } else {
         LogPrintf("TLS: ERROR: %s: %s: TLS connection from %s failed\n", __FILE__, __func__, addr.ToString());
 
@@ -328,27 +420,21 @@ void TLSManager::cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection
  * @brief Handles send and recieve functionality in TLS Sockets.
  * 
  * @param pnode reference to the CNode object.
- * @param fdsetRecv 
- * @param fdsetSend 
- * @param fdsetError 
+ * @param recvSet the socket is readable
+ * @param sendSet the socket is writable
+ * @param errorSet the socket has an error or was hung up
  * @return int returns -1 when socket is invalid. returns 0 otherwise.
  */
-int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fdsetSend, fd_set& fdsetError)
+int TLSManager::threadSocketHandler(CNode* pnode, bool recvSet, bool sendSet, bool errorSet)
 {
     //
     // Receive
     //
-    bool recvSet = false, sendSet = false, errorSet = false;
-
     {
         LOCK(pnode->cs_hSocket);
 
         if (pnode->hSocket == INVALID_SOCKET)
             return -1;
-
-        recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-        sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-        errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
     }
 
     if (recvSet || errorSet) {
@@ -361,6 +447,12 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
                 bool bIsSSL = false;
                 int nBytes = 0, nRet = 0;
 
+                // the rest of a large message is read straight into it rather than through pchBuf
+                unsigned int nDirect = 0;
+                char *pchDirect = pnode->GetRecvDataSpace(nDirect);
+                char *pchRead = pchDirect ? pchDirect : pchBuf;
+                int nReadSize = pchDirect ? (int)nDirect : (int)sizeof(pchBuf);
+
                 {
                     LOCK(pnode->cs_hSocket);
 
@@ -373,16 +465,18 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
 
                     if (bIsSSL) {
                         ERR_clear_error(); // clear the error queue, otherwise we may be reading an old error that occurred previously in the current thread
-                        nBytes = SSL_read(pnode->ssl, pchBuf, sizeof(pchBuf));
+                        nBytes = SSL_read(pnode->ssl, pchRead, nReadSize);
                         nRet = SSL_get_error(pnode->ssl, nBytes);
                     } else {
-                        nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                        nBytes = recv(pnode->hSocket, pchRead, nReadSize, MSG_DONTWAIT);
                         nRet = WSAGetLastError();
                     }
                 }
 
                 if (nBytes > 0) {
-                    if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+                    if (pchDirect)
+                        pnode->ReceivedMsgData(nBytes);
+                    else if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
                         pnode->CloseSocketDisconnect();
                     pnode->nLastRecv = GetTime();
                     pnode->nRecvBytes += nBytes;
@@ -444,6 +538,9 @@ bool TLSManager::initialize()
     SSL_load_error_strings();
     ERR_load_crypto_strings();
     OpenSSL_add_ssl_algorithms(); // OpenSSL_add_ssl_algorithms() always returns "1", so it is safe to discard the return value.
+
+    if (nTLSPeerIndex < 0)
+        nTLSPeerIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, tlsPeerFree);
     
     namespace fs = boost::filesystem;
     fs::path certFile = GetArg("-tlscertpath", "");
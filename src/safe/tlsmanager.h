@@ -26,6 +26,9 @@ using namespace std;
 
 namespace safe
 {
+/** -tlsktls default, hand TLS record encryption to the kernel after the handshake where OpenSSL and the kernel support it */
+static const bool DEFAULT_TLS_KTLS = false;
+
 typedef struct _NODE_ADDR {
     std::string ipAddr;
     int64_t time; // time in msec, of an attempt to connect via TLS
@@ -56,7 +59,7 @@ public:
      SSL* accept(SOCKET hSocket, const CAddress& addr);
      bool isNonTLSAddr(const string& strAddr, const vector<NODE_ADDR>& vPool, CCriticalSection& cs);
      void cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection& cs);
-     int threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fdsetSend, fd_set& fdsetError);
+     int threadSocketHandler(CNode* pnode, bool recvSet, bool sendSet, bool errorSet);
      bool initialize();
 };
 }
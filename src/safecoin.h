@@ -58,6 +58,7 @@ int32_t safecoin_parsestatefile(struct safecoin_state *sp,FILE *fp,char *symbol,
 #include "safecoin_jumblr.h"
 #include "safecoin_gateway.h"
 #include "safecoin_events.h"
+#include "safecoin_statesnap.h"
 #include "safecoin_ccdata.h"
 
 void safecoin_currentheight_set(int32_t height)
@@ -359,8 +360,8 @@ int32_t safecoin_parsestatefiledata(struct safecoin_state *sp,uint8_t *filedata,
 
 void safecoin_stateupdate(int32_t height,uint8_t notarypubs[][33],uint8_t numnotaries,uint8_t notaryid,uint256 txhash,uint64_t voutmask,uint8_t numvouts,uint32_t *pvals,uint8_t numpvals,int32_t SAFEheight,uint32_t SAFEtimestamp,uint64_t opretvalue,uint8_t *opretbuf,uint16_t opretlen,uint16_t vout,uint256 MoM,int32_t MoMdepth)
 {
-    static FILE *fp; static int32_t errs,didinit; static uint256 zero;
-    struct safecoin_state *sp; char fname[512],symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; int32_t retval,ht,func; uint8_t num,pubkeys[64][33];
+    static FILE *fp; static int32_t errs,didinit,snapheight; static uint256 zero;
+    struct safecoin_state *sp; char fname[512],symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; int32_t retval,ht,func; long snapfpos; uint8_t num,pubkeys[64][33];
     if ( didinit == 0 )
     {
         portable_mutex_init(&SAFECOIN_KV_mutex);
@@ -379,14 +380,24 @@ void safecoin_stateupdate(int32_t height,uint8_t notarypubs[][33],uint8_t numnot
         safecoin_statefname(fname,ASSETCHAINS_SYMBOL,(char *)"safecoinstate");
         if ( (fp= fopen(fname,"rb+")) != 0 )
         {
-            if ( (retval= safecoin_faststateinit(sp,fname,symbol,dest)) > 0 )
+            fseek(fp,0,SEEK_END);
+            if ( fReindex == 0 && (snapfpos= safecoin_statesnap_load(sp,fname,ftell(fp))) > 0 )
+            {
+                // only the records appended after the snapshot was taken
+                fseek(fp,snapfpos,SEEK_SET);
+                while ( safecoin_parsestatefile(sp,fp,symbol,dest) >= 0 )
+                    ;
+            }
+            else if ( (retval= safecoin_faststateinit(sp,fname,symbol,dest)) > 0 )
                 fseek(fp,0,SEEK_END);
             else
             {
                 fprintf(stderr,"safecoin_faststateinit retval.%d\n",retval);
+                fseek(fp,0,SEEK_SET);
                 while ( safecoin_parsestatefile(sp,fp,symbol,dest) >= 0 )
                     ;
             }
+            SAFECOIN_STATEFPOS = ftell(fp);
         } else fp = fopen(fname,"wb+");
         SAFECOIN_INITDONE = (uint32_t)time(NULL);
     }
@@ -511,6 +522,12 @@ void safecoin_stateupdate(int32_t height,uint8_t notarypubs[][33],uint8_t numnot
             }
         }
         fflush(fp);
+        SAFECOIN_STATEFPOS = ftell(fp);
+        if ( height >= snapheight + SAFECOIN_STATESNAP_INTERVAL && SAFECOIN_LOADINGBLOCKS == 0 )
+        {
+            safecoin_statesnap_write(sp,SAFECOIN_STATEFPOS);
+            snapheight = height;
+        }
     }
 }
 
@@ -808,6 +825,15 @@ int32_t safecoin_notarycmp(uint8_t *scriptPubKey,int32_t scriptlen,uint8_t pubke
     return(-1);
 }
 
+// notarizations, ratifications and the opreturn data safecoin_voutupdate parses all come in an OP_RETURN output
+int32_t safecoin_txhasopret(const CTransaction &tx)
+{
+    for (int32_t j=0; j<tx.vout.size(); j++)
+        if ( tx.vout[j].scriptPubKey.size() > 0 && tx.vout[j].scriptPubKey[0] == OP_RETURN )
+            return(1);
+    return(0);
+}
+
 // int32_t (!!!)
 /*
     read blackjok3rtt comments in main.cpp 
@@ -819,7 +845,7 @@ int32_t safecoin_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block
     std::vector<int32_t> notarisations;
     uint64_t signedmask,voutmask; char symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; struct safecoin_state *sp;
     uint8_t scriptbuf[10001],pubkeys[64][33],rmd160[20],scriptPubKey[35]; uint256 zero,btctxid,txhash;
-    int32_t i,j,k,numnotaries,notarized,scriptlen,isratification,nid,numvalid,specialtx,notarizedheight,notaryid,len,numvouts,numvins,height,txn_count;
+    int32_t i,j,k,numnotaries,notarized,scriptlen,isratification,nid,numvalid,specialtx,notarizedheight,notaryid,len,numvouts,numvins,height,txn_count,minsigned,nlookups;
     if ( pindex == 0 )
     {
         fprintf(stderr,"safecoin_connectblock null pindex\n");
@@ -871,6 +897,8 @@ int32_t safecoin_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block
     {
         height = pindex->GetHeight();
         txn_count = block.vtx.size();
+        // fewest notary signed vins that pass the numvalid checks below, fewer only matter next to an OP_RETURN
+        minsigned = (numnotaries/5 + 1 < SAFECOIN_MINRATIFY) ? numnotaries/5 + 1 : SAFECOIN_MINRATIFY;
         for (i=0; i<txn_count; i++)
         {
             if ( (is_STAKED(ASSETCHAINS_SYMBOL) != 0 && staked_era == 0) || (is_STAKED(ASSETCHAINS_SYMBOL) == 255) ) {
@@ -886,7 +914,9 @@ int32_t safecoin_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block
             voutmask = specialtx = notarizedheight = isratification = notarized = 0;
             signedmask = (height < 91400) ? 1 : 0;
             numvins = block.vtx[i].vin.size();
-            for (j=0; j<numvins; j++)
+            // each vin costs a GetTransaction, skip the ones whose signedmask could not change anything
+            nlookups = (numvins + 1 < minsigned && safecoin_txhasopret(block.vtx[i]) == 0) ? 0 : numvins;
+            for (j=0; j<nlookups; j++)
             {
                 if ( i == 0 && j == 0 )
                     continue;
@@ -958,7 +988,9 @@ int32_t safecoin_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block
                 if ( IS_SAFECOIN_NOTARY != 0 && ASSETCHAINS_SYMBOL[0] == 0 )
                     printf("%.8f ",dstr(block.vtx[i].vout[j].nValue));
                 len = block.vtx[i].vout[j].scriptPubKey.size();
-                
+                // safecoin_voutupdate only looks at pay to pubkey and OP_RETURN scripts
+                if ( len != 35 && (len == 0 || block.vtx[i].vout[j].scriptPubKey[0] != OP_RETURN) )
+                    continue;
                 if ( len >= sizeof(uint32_t) && len <= sizeof(scriptbuf) )
                 {
                     memcpy(scriptbuf,(uint8_t *)&block.vtx[i].vout[j].scriptPubKey[0],len);
@@ -21,7 +21,9 @@
 #include "primitives/nonce.h"
 #include "consensus/params.h"
 #include "safecoin_defs.h"
+#include "safenodesdb.h"
 #include "script/standard.h"
+#include "trace.h"
 #include "cc/CCinclude.h"
 
 int32_t safecoin_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestamp);
@@ -369,21 +371,128 @@ char *curl_post(CURL **cHandlep,char *url,char *userpass,char *postfields,char *
     return(chunk.memory);
 }
 
+// Connections to the other daemons are kept alive between calls. A caller takes an idle handle for the port out
+// of the pool and puts it back after the call, so two threads never share a handle, and curl_easy_reset keeps the
+// connection open while the options are set again.
+struct safecoin_curlhandle { struct safecoin_curlhandle *next; CURL *handle; uint16_t port; };
+static struct safecoin_curlhandle *SAFECOIN_CURLPOOL;
+static pthread_mutex_t safecoin_curlpool_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define SAFECOIN_CURLPOOL_MAX 16
+
+CURL *safecoin_curlpool_get(uint16_t port)
+{
+    struct safecoin_curlhandle *ch; CURL *handle = 0;
+    pthread_mutex_lock(&safecoin_curlpool_mutex);
+    LL_FOREACH(SAFECOIN_CURLPOOL,ch)
+    {
+        if ( ch->port == port )
+        {
+            handle = ch->handle;
+            LL_DELETE(SAFECOIN_CURLPOOL,ch);
+            free(ch);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&safecoin_curlpool_mutex);
+    return(handle);
+}
+
+void safecoin_curlpool_put(uint16_t port,CURL *handle)
+{
+    struct safecoin_curlhandle *ch; int32_t n;
+    if ( handle == 0 )
+        return;
+    pthread_mutex_lock(&safecoin_curlpool_mutex);
+    LL_COUNT(SAFECOIN_CURLPOOL,ch,n);
+    if ( n < SAFECOIN_CURLPOOL_MAX )
+    {
+        ch = (struct safecoin_curlhandle *)calloc(1,sizeof(*ch));
+        ch->handle = handle, ch->port = port;
+        LL_PREPEND(SAFECOIN_CURLPOOL,ch);
+        handle = 0;
+    }
+    pthread_mutex_unlock(&safecoin_curlpool_mutex);
+    if ( handle != 0 )
+        curl_easy_cleanup(handle);
+}
+
+// the call on a pooled handle, returns the body of the reply whatever the http status, as rpc errors come with a 500
+char *safecoin_curlrpc(CURL **cHandlep,char *url,char *userpass,char *postfields)
+{
+    struct MemoryStruct chunk; struct curl_slist *headers; CURLcode res;
+    if ( *cHandlep == 0 )
+        *cHandlep = curl_easy_init();
+    else curl_easy_reset(*cHandlep);
+    if ( *cHandlep == 0 )
+        return(0);
+    memset(&chunk,0,sizeof(chunk));
+    headers = curl_slist_append(0,"Expect:");
+    curl_easy_setopt(*cHandlep,CURLOPT_USERAGENT,"mozilla/4.0");
+    curl_easy_setopt(*cHandlep,CURLOPT_HTTPHEADER,headers);
+    curl_easy_setopt(*cHandlep,CURLOPT_URL,url);
+    curl_easy_setopt(*cHandlep,CURLOPT_NOSIGNAL,1L);
+    curl_easy_setopt(*cHandlep,CURLOPT_NOPROGRESS,1L);
+    curl_easy_setopt(*cHandlep,CURLOPT_CONNECTTIMEOUT,10);
+    if ( userpass != 0 )
+        curl_easy_setopt(*cHandlep,CURLOPT_USERPWD,userpass);
+    curl_easy_setopt(*cHandlep,CURLOPT_POST,1L);
+    curl_easy_setopt(*cHandlep,CURLOPT_POSTFIELDS,postfields);
+    curl_easy_setopt(*cHandlep,CURLOPT_WRITEFUNCTION,WriteMemoryCallback);
+    curl_easy_setopt(*cHandlep,CURLOPT_WRITEDATA,(void *)&chunk);
+    res = curl_easy_perform(*cHandlep);
+    curl_slist_free_all(headers);
+    if ( res != CURLE_OK )
+    {
+        if ( (rand() % 1000) == 0 )
+            printf("curl_easy_perform() failed: %s (%s)\n",curl_easy_strerror(res),url);
+        // drop the handle, its connection is in an unknown state
+        curl_easy_cleanup(*cHandlep);
+        *cHandlep = 0;
+        if ( chunk.memory != 0 )
+            free(chunk.memory);
+        return(0);
+    }
+    return(chunk.memory);
+}
+
+// a method on this node itself goes straight to the rpc table, and the reply is wrapped the way the http server
+// would so the callers parse it the same
+char *safecoin_localmethod(char *method,char *params)
+{
+    UniValue valParams(UniValue::VARR),result,error;
+    if ( valParams.read(params) == 0 || valParams.isArray() == 0 )
+        return(0);
+    try
+    {
+        result = tableRPC.execute(method,valParams);
+    }
+    catch (const UniValue& objError)
+    {
+        error = objError;
+    }
+    catch (const std::exception& e)
+    {
+        error = JSONRPCError(RPC_MISC_ERROR,e.what());
+    }
+    return(clonestr((char *)JSONRPCReply(result,error,UniValue("jl777")).c_str()));
+}
+
 char *safecoin_issuemethod(char *userpass,char *method,char *params,uint16_t port)
 {
-    //static void *cHandle;
-    char url[512],*retstr=0,*retstr2=0,postdata[8192];
+    char url[512],*retstr=0,postdata[8192]; CURL *handle;
     if ( params == 0 || params[0] == 0 )
         params = (char *)"[]";
+    if ( port == BITCOIND_RPCPORT )
+        return(safecoin_localmethod(method,params));
     if ( strlen(params) < sizeof(postdata)-128 )
     {
         sprintf(url,(char *)"http://127.0.0.1:%u",port);
-        sprintf(postdata,"{\"method\":\"%s\",\"params\":%s}",method,params);
- //printf("[%s] (%s) postdata.(%s) params.(%s) USERPASS.(%s)\n",ASSETCHAINS_SYMBOL,url,postdata,params,SAFEUSERPASS);
-        retstr2 = bitcoind_RPC(&retstr,(char *)"debug",url,userpass,method,params);
-        //retstr = curl_post(&cHandle,url,USERPASS,postdata,0,0,0,0);
+        sprintf(postdata,"{\"id\":\"jl777\",\"method\":\"%s\",\"params\":%s}",method,params);
+        handle = safecoin_curlpool_get(port);
+        retstr = safecoin_curlrpc(&handle,url,userpass,postdata);
+        safecoin_curlpool_put(port,handle);
     }
-    return(retstr2);
+    return(retstr);
 }
 
 int32_t notarizedtxid_height(char *dest,char *txidstr,int32_t *safenotarized_heightp)
@@ -739,7 +848,7 @@ uint256 safecoin_calcmerkleroot(CBlock *pblock, uint256 prevBlockHash, int32_t n
     return GetMerkleRoot(vLeaves);
 }
 
-int32_t safecoin_isPoS(CBlock *pblock, int32_t height,CTxDestination *addressout)
+int32_t _safecoin_isPoS(CBlock *pblock, int32_t height,CTxDestination *addressout)
 {
     int32_t n,vout,numvouts,ret; uint32_t txtime; uint64_t value; char voutaddr[64],destaddr[64]; CTxDestination voutaddress; uint256 txid, merkleroot; CScript opret;
     if ( ASSETCHAINS_STAKED != 0 )
@@ -790,6 +899,65 @@ int32_t safecoin_isPoS(CBlock *pblock, int32_t height,CTxDestination *addressout
     return(0);
 }
 
+// blocks found to be PoS, by block hash and the values the verdict depends on. A block is checked in CheckBlock,
+// ContextualCheckBlock and safecoin_checkPOW, each check looks up the staked output's transaction and the slow one
+// redoes its stake hash. Only positive verdicts are kept, a negative one can be down to a transaction not found yet.
+struct safecoin_posverdict_key
+{
+    uint256 blockhash,target,prevhash; int32_t height,slowflag;
+    bool operator<(const safecoin_posverdict_key &other) const
+    {
+        if ( blockhash != other.blockhash )
+            return(blockhash < other.blockhash);
+        if ( target != other.target )
+            return(target < other.target);
+        if ( prevhash != other.prevhash )
+            return(prevhash < other.prevhash);
+        if ( height != other.height )
+            return(height < other.height);
+        return(slowflag < other.slowflag);
+    }
+};
+static CCriticalSection cs_posverdicts;
+static std::set<safecoin_posverdict_key> setPoSverdicts;
+static std::deque<safecoin_posverdict_key> dqPoSverdicts;   // insertion order, oldest dropped first
+static const size_t MAX_POSVERDICTS = 1024;
+
+bool safecoin_posverdict_get(const safecoin_posverdict_key &key)
+{
+    LOCK(cs_posverdicts);
+    return(setPoSverdicts.count(key) != 0);
+}
+
+void safecoin_posverdict_set(const safecoin_posverdict_key &key)
+{
+    LOCK(cs_posverdicts);
+    if ( setPoSverdicts.insert(key).second )
+    {
+        dqPoSverdicts.push_back(key);
+        while ( dqPoSverdicts.size() > MAX_POSVERDICTS )
+        {
+            setPoSverdicts.erase(dqPoSverdicts.front());
+            dqPoSverdicts.pop_front();
+        }
+    }
+}
+
+int32_t safecoin_isPoS(CBlock *pblock, int32_t height,CTxDestination *addressout)
+{
+    safecoin_posverdict_key key; int32_t isPoS;
+    if ( ASSETCHAINS_STAKED == 0 || addressout != 0 )
+        return(_safecoin_isPoS(pblock,height,addressout));
+    key.blockhash = pblock->GetHash();
+    key.height = height;
+    key.slowflag = 0;
+    if ( safecoin_posverdict_get(key) )
+        return(1);
+    if ( (isPoS= _safecoin_isPoS(pblock,height,addressout)) != 0 )
+        safecoin_posverdict_set(key);
+    return(isPoS);
+}
+
 void safecoin_disconnect(CBlockIndex *pindex,CBlock& block)
 {
     char symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; struct safecoin_state *sp;
@@ -888,14 +1056,7 @@ int32_t safecoin_block2pubkey33(uint8_t *pubkey33,CBlock *block)
 
 int32_t safecoin_blockload(CBlock& block,CBlockIndex *pindex)
 {
-    block.SetNull();
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pindex->GetBlockPos(),true),SER_DISK,CLIENT_VERSION);
-    if (filein.IsNull())
-        return(-1);
-    // Read block
-    try { filein >> block; }
-    catch (const std::exception& e)
+    if ( !ReadBlockFromDisk(block,pindex,false) )
     {
         fprintf(stderr,"readblockfromdisk err B\n");
         return(-1);
@@ -903,6 +1064,48 @@ int32_t safecoin_blockload(CBlock& block,CBlockIndex *pindex)
     return(0);
 }
 
+// header and coinbase only, the rest of the block is never deserialized. For the helpers that look at nothing else.
+int32_t safecoin_coinbaseload(CBlock& block,CBlockIndex *pindex)
+{
+    return(ReadBlockEndsFromDisk(block,pindex,false) ? 0 : -1);
+}
+
+// header, coinbase and the last tx, where a staking tx sits
+int32_t safecoin_blockendsload(CBlock& block,CBlockIndex *pindex)
+{
+    return(ReadBlockEndsFromDisk(block,pindex,true) ? 0 : -1);
+}
+
+// remember the coinbase pubkey in pindex, unless there is none and the answer would depend on SAFECOIN_LOADINGBLOCKS
+void safecoin_pindex_setpubkey33(CBlockIndex *pindex,CBlock *block)
+{
+    uint8_t pubkey33[33];
+    if ( pindex == 0 || pindex->fMinerPubkey != 0 || block->vtx.size() == 0 || block->vtx[0].vout.size() == 0 )
+        return;
+    safecoin_block2pubkey33(pubkey33,block);
+    memcpy(pindex->minerPubkey33,pubkey33,33);
+    pindex->fMinerPubkey = true;
+}
+
+// coinbase pubkey of the block at pindex, loading the block only the first time it is asked for
+int32_t safecoin_pindex2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex)
+{
+    CBlock block;
+    if ( pindex->fMinerPubkey == 0 )
+    {
+        if ( safecoin_coinbaseload(block,pindex) != 0 )
+            return(-1);
+        safecoin_pindex_setpubkey33(pindex,&block);
+        if ( pindex->fMinerPubkey == 0 )
+        {
+            safecoin_block2pubkey33(pubkey33,&block);
+            return(0);
+        }
+    }
+    memcpy(pubkey33,pindex->minerPubkey33,33);
+    return(0);
+}
+
 uint32_t safecoin_chainactive_timestamp()
 {
     if ( chainActive.LastTip() != 0 )
@@ -974,13 +1177,9 @@ uint32_t safecoin_heightstamp(int32_t height)
 
 void safecoin_index2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex,int32_t height)
 {
-    int32_t num,i; CBlock block;
     memset(pubkey33,0,33);
-    if ( pindex != 0 )
-    {
-        if ( safecoin_blockload(block,pindex) == 0 )
-            safecoin_block2pubkey33(pubkey33,&block);
-    }
+    if ( pindex != 0 && safecoin_pindex2pubkey33(pubkey33,pindex) < 0 )
+        memset(pubkey33,0,33);
 }
 
 /*int8_t safecoin_minerid(int32_t height,uint8_t *destpubkey33)
@@ -1014,7 +1213,7 @@ void safecoin_index2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex,int32_t heigh
 int32_t safecoin_eligiblenotary(uint8_t pubkeys[66][33],int32_t *mids,uint32_t blocktimes[66],int32_t *nonzpkeysp,int32_t height)
 {
     // after the season HF block ALL new notaries instantly become elegible. 
-    int32_t i,j,n,duplicate; CBlock block; CBlockIndex *pindex; uint8_t notarypubs33[64][33];
+    int32_t i,j,n,duplicate; CBlockIndex *pindex; uint8_t notarypubs33[64][33];
     memset(mids,-1,sizeof(*mids)*66);
     n = safecoin_notaries(notarypubs33,height,0);
     for (i=duplicate=0; i<66; i++)
@@ -1022,9 +1221,8 @@ int32_t safecoin_eligiblenotary(uint8_t pubkeys[66][33],int32_t *mids,uint32_t b
         if ( (pindex= safecoin_chainactive(height-i)) != 0 )
         {
             blocktimes[i] = pindex->nTime;
-            if ( safecoin_blockload(block,pindex) == 0 )
+            if ( safecoin_pindex2pubkey33(pubkeys[i],pindex) == 0 )
             {
-                safecoin_block2pubkey33(pubkeys[i],&block);
                 for (j=0; j<n; j++)
                 {
                     if ( memcmp(notarypubs33[j],pubkeys[i],33) == 0 )
@@ -1046,7 +1244,7 @@ int32_t safecoin_eligiblenotary(uint8_t pubkeys[66][33],int32_t *mids,uint32_t b
 
 int32_t safecoin_minerids(uint8_t *minerids,int32_t height,int32_t width)
 {
-    int32_t i,j,nonz,numnotaries; CBlock block; CBlockIndex *pindex; uint8_t notarypubs33[64][33],pubkey33[33];
+    int32_t i,j,nonz,numnotaries; CBlockIndex *pindex; uint8_t notarypubs33[64][33],pubkey33[33];
     numnotaries = safecoin_notaries(notarypubs33,height,0);
     for (i=nonz=0; i<width; i++)
     {
@@ -1054,9 +1252,8 @@ int32_t safecoin_minerids(uint8_t *minerids,int32_t height,int32_t width)
             continue;
         if ( (pindex= safecoin_chainactive(height-width+i+1)) != 0 )
         {
-            if ( safecoin_blockload(block,pindex) == 0 )
+            if ( safecoin_pindex2pubkey33(pubkey33,pindex) == 0 )
             {
-                safecoin_block2pubkey33(pubkey33,&block);
                 for (j=0; j<numnotaries; j++)
                 {
                     if ( memcmp(notarypubs33[j],pubkey33,33) == 0 )
@@ -1073,210 +1270,54 @@ int32_t safecoin_minerids(uint8_t *minerids,int32_t height,int32_t width)
     return(nonz);
 }
 
-// replacement for safecoin_safeids() - new one using kvsearch
+// replacement for safecoin_safeids() - tallied from the SafeNode registry instead of a kvsearch per notary per block
 std::vector<std::tuple<std::string, uint32_t, std::vector<pair<std::string, uint32_t>>>> vt_safecoin_safeids_new(int32_t height, int32_t width)
 {
-    int32_t i, j, nonz, block_height, scan_range;
-    scan_range = height - 750000;
-    CBlockIndex *pindex;
-    uint8_t pubkey33[33];
-    std::vector<std::tuple<std::string, uint32_t, std::vector<pair<std::string, uint32_t>>>> vt;
-    std::vector<std::string> vs_pubkeys;
-    std::vector<uint32_t> vu_pubkey_blocks_count;
-    std::vector<std::vector<pair<std::string, uint32_t>>> vvp_pubkey_safeids;
-        
-    for (i = nonz = 0; i < scan_range; i++)
-    {
-        if (height-i <= 0)
-            continue;
-        block_height = height - scan_range + i + 1;
-        if ((pindex = safecoin_chainactive(block_height)) != 0) // to be sure it's a valid block_height
-        {
-			// loop through all notary pubkeys
-			std::vector<std::string> vs_all_pubkeys = vs_safecoin_notaries(block_height, 0);
-			
-			for (int j = 0; j < vs_all_pubkeys.size(); j++)
-			{
-				std::string s_current_pubkey = vs_all_pubkeys.at(j);
-				//std::string s_current_block_height = ((block_height < 1000000)?"0":"") +  std::to_string(block_height);
-                std::string s_current_block_height = "0" +  std::to_string(block_height);
-				std::string s_search_keyname = s_current_pubkey + s_current_block_height + "1";
-                
-				int32_t flags = 1, keylen;
-				uint8_t value[IGUANA_MAXSCRIPTSIZE*8];
-				uint256 pubs;
-				int32_t valuesize;
-				std::string keystr;
-				keylen = s_search_keyname.length();
-				uint8_t key[keylen];
-				int32_t heightp;
-				memcpy(key, s_search_keyname.c_str(), keylen);
-				
-				valuesize = safecoin_kvsearch((uint256 *)&pubs, height, (uint32_t *)&flags, (int32_t *)&heightp, (uint8_t *)&value, key, keylen);
-
-				if (valuesize > 0 && (height-heightp) < width) // key name found
-				{
-                    std::string s_safeid;
-					char *valuestr;
-					s_safeid.resize(valuesize);
-					valuestr = (char *)s_safeid.data();
-					memcpy (valuestr, value, valuesize);
-                    
-					// we should store this safeid
-					std::vector<std::string>::iterator it;
-
-					// check if pubkey is already in the result list
-					it = std::find(vs_pubkeys.begin(), vs_pubkeys.end(), s_current_pubkey);
-					if (it != vs_pubkeys.end())
-					{
-						// found !
-						// get the element index
-						uint32_t index = std::distance(vs_pubkeys.begin(), it);
-						
-						// increase the block count
-						vu_pubkey_blocks_count.at(index) = vu_pubkey_blocks_count.at(index) + 1;
-						
-						// get this pubkey safeids
-						std::vector<pair<std::string, uint32_t>> vp_safeids = vvp_pubkey_safeids.at(index);
-						
-						// check if extracted safeid is already in the current pubkey safeids list
-						auto p = find_if(vp_safeids.begin(), vp_safeids.end(), [&s_safeid](const pair<string, uint32_t>& r){return r.first == s_safeid;});
-
-						if (p != vp_safeids.end())
-						{
-							// found safeid entry within current pubkey 
-							
-							// get the element index
-							uint32_t p_index = std::distance(vp_safeids.begin(), p);
-							
-							// // increase the safeid block count 
-							(vvp_pubkey_safeids.at(index)).at(p_index).second = vp_safeids.at(p_index).second + 1;
-						}
-						else
-						{
-							// not found, add safeid and block count of 1 to the current pubkey	
-							(vvp_pubkey_safeids.at(index)).push_back(std::make_pair(s_safeid, 1));
-						}
-					}
-					else
-					{
-						// not found
-						// insert both pubkey and safeid, block counts of 1
-						vs_pubkeys.push_back(s_current_pubkey);
-						vu_pubkey_blocks_count.push_back(1);
-						std::vector<pair<std::string, uint32_t>> vp_init_safeid;
-						vp_init_safeid.push_back(std::make_pair(s_safeid, 1));
-						vvp_pubkey_safeids.push_back(vp_init_safeid);
-					}
-				}
-			}
-        }
-    }
-    
-    // join pubkeys and safeids in result tuple
-    for (unsigned k = 0; k < vs_pubkeys.size(); k++)
-    {
-		std::tuple<std::string, uint32_t, std::vector<pair<std::string, uint32_t>>> tup;
-		std::get<0>(tup) = vs_pubkeys.at(k);
-		std::get<1>(tup) = vu_pubkey_blocks_count.at(k);
-		std::get<2>(tup) = vvp_pubkey_safeids.at(k);
-		vt.push_back(tup);
-	}
-    return vt;
+    return safenodeRegistry.GetTally(height, width);
 }
 
 
 // optimized safecoin_safeids()
 std::vector<std::tuple<std::string, uint32_t, std::vector<pair<std::string, uint32_t>>>> vt_safecoin_safeids_optimized(int32_t height, int32_t width)
 {
-    std::vector<std::string> vs_safekeys;
-	std::vector<std::string>::iterator it;
-	
-	struct safecoin_kv *s;
-	extern struct safecoin_kv *SAFECOIN_KV;
-	extern pthread_mutex_t SAFECOIN_KV_mutex;
-	
-	pthread_mutex_lock(&SAFECOIN_KV_mutex);
-	
-	for(s = SAFECOIN_KV; s != NULL; s = (safecoin_kv*)s->hh.next)
-	{
-		uint8_t *value_ptr = s->value;
-		uint16_t value_size = s->valuesize;
-		
-		// skip checking against records with invalid safeid size
-		if (value_size == 66)
-		{
-			std::string str_saved_safeid = std::string((char*)value_ptr, 66);
-			it = std::find(vs_safekeys.begin(), vs_safekeys.end(), str_saved_safeid);
-			if (it == vs_safekeys.end())
-			{
-				vs_safekeys.push_back(str_saved_safeid);
-			}
-		} 
-	}
-	
-	pthread_mutex_unlock(&SAFECOIN_KV_mutex);
+    std::vector<std::string>::iterator it;
+    
+    // latest registration of every safekey still valid at height, straight from the registry
+    std::vector<CSafeNodeRegistration> vActive = safenodeRegistry.GetActive(height, *safecoin_notaryset(chainActive.LastTip()->GetHeight(), 0));
   
     std::vector<std::tuple<std::string, uint32_t, std::vector<pair<std::string, uint32_t>>>> vt;
     std::vector<std::string> vs_pubkeys;
     std::vector<uint32_t> vu_pubkey_blocks_count;
     std::vector<std::vector<pair<std::string, uint32_t>>> vvp_pubkey_safeids;
         
-    for (int i = 0; i < vs_safekeys.size(); i++)
+    for (int i = 0; i < vActive.size(); i++)
     {
-        UniValue uv_one_node(UniValue::VOBJ), params(UniValue::VARR);
-		params.push_back(vs_safekeys.at(i));
-        UniValue uv_registration_info = getregistrationinfo(params, false, CPubKey());
-        UniValue uv_parentkey = find_value(uv_registration_info, "parentkey");
+        const std::string& s_parentkey = vActive[i].parentkey;
+        const std::string& s_safeid = vActive[i].safekey;
         
-        UniValue uv_valid_thru_height = find_value(uv_registration_info, "valid_thru_height");
+        it = std::find(vs_pubkeys.begin(), vs_pubkeys.end(), s_parentkey);
         
-        if (uv_valid_thru_height.get_int() >= height)
+        if (it != vs_pubkeys.end())
         {
-            it = std::find(vs_pubkeys.begin(), vs_pubkeys.end(), uv_parentkey.get_str());
+            // found !
+            // get the element index
+            uint32_t index = std::distance(vs_pubkeys.begin(), it);
             
-            if (it != vs_pubkeys.end())
-            {
-                // found !
-                // get the element index
-                uint32_t index = std::distance(vs_pubkeys.begin(), it);
-                
-                // increase the block count
-                vu_pubkey_blocks_count.at(index) = vu_pubkey_blocks_count.at(index) + 1;
-                
-                // get this pubkey safeids
-                std::vector<pair<std::string, uint32_t>> vp_safeids = vvp_pubkey_safeids.at(index);
-                
-                // check if extracted safeid is already in the current pubkey safeids list
-                std::string s_safeid = vs_safekeys.at(i);
-                auto p = find_if(vp_safeids.begin(), vp_safeids.end(), [&s_safeid](const pair<string, uint32_t>& r){return r.first == s_safeid;});
-
-                if (p != vp_safeids.end())
-                {
-                    // found safeid entry within current pubkey 
-                    
-                    // get the element index
-                    uint32_t p_index = std::distance(vp_safeids.begin(), p);
-                    
-                    // // increase the safeid block count 
-                    (vvp_pubkey_safeids.at(index)).at(p_index).second = vp_safeids.at(p_index).second + 1;
-                }
-                else
-                {
-                    // not found, add safeid and block count of 1 to the current pubkey	
-                    (vvp_pubkey_safeids.at(index)).push_back(std::make_pair(s_safeid, 1));
-                }
-            }
-            else
-            {
-                // not found
-                // insert both pubkey and safeid, block counts of 1
-                vs_pubkeys.push_back(uv_parentkey.get_str());
-                vu_pubkey_blocks_count.push_back(1);
-                std::vector<pair<std::string, uint32_t>> vp_init_safeid;
-                vp_init_safeid.push_back(std::make_pair(vs_safekeys.at(i), 1));
-                vvp_pubkey_safeids.push_back(vp_init_safeid);
-            }
+            // increase the block count
+            vu_pubkey_blocks_count.at(index) = vu_pubkey_blocks_count.at(index) + 1;
+            
+            // registry yields each safekey once, so it is new for this pubkey
+            (vvp_pubkey_safeids.at(index)).push_back(std::make_pair(s_safeid, 1));
+        }
+        else
+        {
+            // not found
+            // insert both pubkey and safeid, block counts of 1
+            vs_pubkeys.push_back(s_parentkey);
+            vu_pubkey_blocks_count.push_back(1);
+            std::vector<pair<std::string, uint32_t>> vp_init_safeid;
+            vp_init_safeid.push_back(std::make_pair(s_safeid, 1));
+            vvp_pubkey_safeids.push_back(vp_init_safeid);
         }
     }
     
@@ -1456,6 +1497,12 @@ uint64_t safecoin_interest(int32_t txheight,uint64_t nValue,uint32_t nLockTime,u
 
 uint64_t safecoin_accrued_interest(int32_t *txheightp,uint32_t *locktimep,uint256 hash,int32_t n,int32_t checkheight,uint64_t checkvalue,int32_t tipheight)
 {  
+    *txheightp = 0;
+    *locktimep = 0;
+#ifndef SAFECOIN_ENABLE_INTEREST
+    // safecoin_interest pays nothing, don't load the transaction of every utxo to find out
+    return(0);
+#endif
    if (ASSETCHAINS_SYMBOL[0] == 0)
    return(0);  //disinterested
     uint64_t value; uint32_t tiptime=0,txheighttimep; CBlockIndex *pindex;
@@ -1626,35 +1673,41 @@ uint32_t safecoin_segid32(char *coinaddr)
     return(addrhash.uints[0]);
 }
 
+// segid of the staking tx in block at height, -1 if it is not a staking block
+int8_t safecoin_blocksegid(int32_t height,CBlockIndex *pindex,CBlock &block)
+{
+    CTxDestination voutaddress; uint64_t value; uint32_t txtime; char voutaddr[64],destaddr[64]; int32_t txn_count,vout,newStakerActive; uint256 txid,merkleroot; CScript opret; int8_t segid = -1;
+    newStakerActive = safecoin_newStakerActive(height, block.nTime);
+    txn_count = block.vtx.size();
+    if ( txn_count > 1 && block.vtx[txn_count-1].vin.size() == 1 && block.vtx[txn_count-1].vout.size() == 1+safecoin_hasOpRet(height,pindex->nTime) )
+    {
+        txid = block.vtx[txn_count-1].vin[0].prevout.hash;
+        vout = block.vtx[txn_count-1].vin[0].prevout.n;
+        txtime = safecoin_txtime(opret,&value,txid,vout,destaddr);
+        if ( ExtractDestination(block.vtx[txn_count-1].vout[0].scriptPubKey,voutaddress) )
+        {
+            strcpy(voutaddr,CBitcoinAddress(voutaddress).ToString().c_str());
+            if ( newStakerActive == 1 && block.vtx[txn_count-1].vout.size() == 2 && DecodeStakingOpRet(block.vtx[txn_count-1].vout[1].scriptPubKey, merkleroot) != 0 )
+                newStakerActive++;
+            if ( newStakerActive == 2 || (newStakerActive == 0 && strcmp(destaddr,voutaddr) == 0 && block.vtx[txn_count-1].vout[0].nValue == value) )
+            {
+                segid = safecoin_segid32(voutaddr) & 0x3f;
+                //fprintf(stderr, "safecoin_segid: ht.%i --> %i\n",height,pindex->segid);
+            }
+        } else fprintf(stderr,"safecoin_segid ht.%d couldnt extract voutaddress\n",height);
+    }
+    return(segid);
+}
+
 int8_t safecoin_segid(int32_t nocache,int32_t height)
 {
-    CTxDestination voutaddress; CBlock block; CBlockIndex *pindex; uint64_t value; uint32_t txtime; char voutaddr[64],destaddr[64]; int32_t txn_count,vout,newStakerActive; uint256 txid,merkleroot; CScript opret; int8_t segid = -1;
+    CBlock block; CBlockIndex *pindex; int8_t segid = -1;
     if ( height > 0 && (pindex= safecoin_chainactive(height)) != 0 )
     {
         if ( nocache == 0 && pindex->segid >= -1 )
             return(pindex->segid);
-        if ( safecoin_blockload(block,pindex) == 0 )
-        {
-            newStakerActive = safecoin_newStakerActive(height, block.nTime);
-            txn_count = block.vtx.size();
-            if ( txn_count > 1 && block.vtx[txn_count-1].vin.size() == 1 && block.vtx[txn_count-1].vout.size() == 1+safecoin_hasOpRet(height,pindex->nTime) )
-            {
-                txid = block.vtx[txn_count-1].vin[0].prevout.hash;
-                vout = block.vtx[txn_count-1].vin[0].prevout.n;
-                txtime = safecoin_txtime(opret,&value,txid,vout,destaddr);
-                if ( ExtractDestination(block.vtx[txn_count-1].vout[0].scriptPubKey,voutaddress) )
-                {
-                    strcpy(voutaddr,CBitcoinAddress(voutaddress).ToString().c_str());
-                    if ( newStakerActive == 1 && block.vtx[txn_count-1].vout.size() == 2 && DecodeStakingOpRet(block.vtx[txn_count-1].vout[1].scriptPubKey, merkleroot) != 0 )
-                        newStakerActive++;
-                    if ( newStakerActive == 2 || (newStakerActive == 0 && strcmp(destaddr,voutaddr) == 0 && block.vtx[txn_count-1].vout[0].nValue == value) )
-                    {
-                        segid = safecoin_segid32(voutaddr) & 0x3f;
-                        //fprintf(stderr, "safecoin_segid: ht.%i --> %i\n",height,pindex->segid);
-                    }
-                } else fprintf(stderr,"safecoin_segid ht.%d couldnt extract voutaddress\n",height);
-            }
-        }
+        if ( safecoin_blockendsload(block,pindex) == 0 )
+            segid = safecoin_blocksegid(height,pindex,block);
         // The new staker sets segid in safecoin_checkPOW, this persists after restart by being saved in the blockindex for blocks past the HF timestamp, to keep backwards compatibility.
         // PoW blocks cannot contain a staking tx. If segid has not yet been set, we can set it here accurately.
         if ( pindex->segid == -2 ) 
@@ -1663,37 +1716,193 @@ int8_t safecoin_segid(int32_t nocache,int32_t height)
     return(segid);
 }
 
-void safecoin_segids(uint8_t *hashbuf,int32_t height,int32_t n)
+// segids of the most recent active chain heights, slot height & (SAFECOIN_SEGIDRING-1). Filled by
+// safecoin_segids_connect() as each tip is connected and cleared again when it is disconnected, so the
+// 100 segids before a new block are normally all present and safecoin_segids() never loads a block.
+#define SAFECOIN_SEGIDRING 128
+int32_t SAFECOIN_SEGIDHEIGHTS[SAFECOIN_SEGIDRING]; int8_t SAFECOIN_SEGIDVALS[SAFECOIN_SEGIDRING]; uint32_t SAFECOIN_SEGIDGEN;
+pthread_mutex_t safecoin_segidmutex = PTHREAD_MUTEX_INITIALIZER;
+
+// stakes per segid over the last 100, 1000 and 10000 active chain blocks for getlastsegidstakes, slot 64 counts
+// PoW blocks and slot 65 blocks without a segid. Moved along by safecoin_segids_connect/disconnect, which keep the
+// counted segids in a ring for taking them off again, and rebuilt by safecoin_segidstats() once SAFECOIN_SEGIDSTATS_TIP
+// is 0 after startup, initial sync or a gap. All of it is guarded by cs_main.
+#define SAFECOIN_SEGIDSTATS_MAXDEPTH 10000
+#define SAFECOIN_SEGIDSTATS_RING 16384
+#define SAFECOIN_SEGIDSTATS_SLOTS 66
+static const int32_t SAFECOIN_SEGIDSTATS_DEPTHS[3] = { 100, 1000, SAFECOIN_SEGIDSTATS_MAXDEPTH };
+int32_t SAFECOIN_SEGIDSTATS[3][SAFECOIN_SEGIDSTATS_SLOTS],SAFECOIN_SEGIDSTATS_TIP;
+int32_t SAFECOIN_SEGIDSTATS_HEIGHTS[SAFECOIN_SEGIDSTATS_RING]; int8_t SAFECOIN_SEGIDSTATS_VALS[SAFECOIN_SEGIDSTATS_RING];
+
+int32_t safecoin_segidstats_slot(int8_t segid)
 {
-    static uint8_t prevhashbuf[100]; static int32_t prevheight;
-    int32_t i;
-    if ( height == prevheight && n == 100 )
-        memcpy(hashbuf,prevhashbuf,100);
-    else
+    if ( segid >= 0 )
+        return(segid & 0x3f);
+    else if ( segid == -1 )
+        return(64);
+    else return(65);
+}
+
+void safecoin_segidstats_connect(int32_t height,int8_t segid)
+{
+    int32_t i,ht,ind;
+    if ( SAFECOIN_SEGIDSTATS_TIP == 0 || SAFECOIN_SEGIDSTATS_TIP != height-1 )
+    {
+        SAFECOIN_SEGIDSTATS_TIP = 0;
+        return;
+    }
+    for (i=0; i<3; i++)
     {
-        memset(hashbuf,0xff,n);
-        for (i=0; i<n; i++)
+        if ( (ht= height - SAFECOIN_SEGIDSTATS_DEPTHS[i]) > 0 )
         {
-            hashbuf[i] = (uint8_t)safecoin_segid(0,height+i);
-            //fprintf(stderr,"%02x ",hashbuf[i]);
+            ind = ht & (SAFECOIN_SEGIDSTATS_RING-1);
+            if ( SAFECOIN_SEGIDSTATS_HEIGHTS[ind] != ht )
+            {
+                SAFECOIN_SEGIDSTATS_TIP = 0;
+                return;
+            }
+            SAFECOIN_SEGIDSTATS[i][safecoin_segidstats_slot(SAFECOIN_SEGIDSTATS_VALS[ind])]--;
         }
-        if ( n == 100 )
+        SAFECOIN_SEGIDSTATS[i][safecoin_segidstats_slot(segid)]++;
+    }
+    SAFECOIN_SEGIDSTATS_HEIGHTS[height & (SAFECOIN_SEGIDSTATS_RING-1)] = height;
+    SAFECOIN_SEGIDSTATS_VALS[height & (SAFECOIN_SEGIDSTATS_RING-1)] = segid;
+    SAFECOIN_SEGIDSTATS_TIP = height;
+}
+
+void safecoin_segidstats_disconnect(int32_t height)
+{
+    int32_t i,ht,ind = height & (SAFECOIN_SEGIDSTATS_RING-1);
+    if ( SAFECOIN_SEGIDSTATS_TIP == 0 || SAFECOIN_SEGIDSTATS_TIP != height || SAFECOIN_SEGIDSTATS_HEIGHTS[ind] != height )
+    {
+        SAFECOIN_SEGIDSTATS_TIP = 0;
+        return;
+    }
+    for (i=0; i<3; i++)
+    {
+        SAFECOIN_SEGIDSTATS[i][safecoin_segidstats_slot(SAFECOIN_SEGIDSTATS_VALS[ind])]--;
+        if ( (ht= height - SAFECOIN_SEGIDSTATS_DEPTHS[i]) > 0 )
         {
-            memcpy(prevhashbuf,hashbuf,100);
-            prevheight = height;
-            //fprintf(stderr,"prevsegids.%d\n",height+n);
+            if ( SAFECOIN_SEGIDSTATS_HEIGHTS[ht & (SAFECOIN_SEGIDSTATS_RING-1)] != ht )
+            {
+                SAFECOIN_SEGIDSTATS_TIP = 0;
+                return;
+            }
+            SAFECOIN_SEGIDSTATS[i][safecoin_segidstats_slot(SAFECOIN_SEGIDSTATS_VALS[ht & (SAFECOIN_SEGIDSTATS_RING-1)])]++;
         }
     }
+    SAFECOIN_SEGIDSTATS_HEIGHTS[ind] = 0;
+    SAFECOIN_SEGIDSTATS_TIP = height - 1;
 }
 
-uint32_t safecoin_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256 txid,int32_t vout)
+// counts[SAFECOIN_SEGIDSTATS_SLOTS] of the last depth blocks, depth at most SAFECOIN_SEGIDSTATS_MAXDEPTH and the chain height
+
+void safecoin_segidstats(int32_t *counts,int32_t depth)
 {
-    bits256 addrhash;
-    vcalc_sha256(0,(uint8_t *)&addrhash,(uint8_t *)address,(int32_t)strlen(address));
-    memcpy(&hashbuf[100],&addrhash,sizeof(addrhash));
-    memcpy(&hashbuf[100+sizeof(addrhash)],&txid,sizeof(txid));
-    memcpy(&hashbuf[100+sizeof(addrhash)+sizeof(txid)],&vout,sizeof(vout));
-    vcalc_sha256(0,(uint8_t *)hashp,hashbuf,100 + (int32_t)sizeof(uint256)*2 + sizeof(vout));
+    int32_t i,ht,tip = chainActive.Height(); int8_t segid;
+    AssertLockHeld(cs_main);
+    if ( SAFECOIN_SEGIDSTATS_TIP == 0 || SAFECOIN_SEGIDSTATS_TIP != tip )
+    {
+        memset(SAFECOIN_SEGIDSTATS,0,sizeof(SAFECOIN_SEGIDSTATS));
+        for (ht=std::max(1,tip-SAFECOIN_SEGIDSTATS_MAXDEPTH+1); ht<=tip; ht++)
+        {
+            segid = safecoin_segid(0,ht);
+            SAFECOIN_SEGIDSTATS_HEIGHTS[ht & (SAFECOIN_SEGIDSTATS_RING-1)] = ht;
+            SAFECOIN_SEGIDSTATS_VALS[ht & (SAFECOIN_SEGIDSTATS_RING-1)] = segid;
+            for (i=0; i<3; i++)
+                if ( ht > tip - SAFECOIN_SEGIDSTATS_DEPTHS[i] )
+                    SAFECOIN_SEGIDSTATS[i][safecoin_segidstats_slot(segid)]++;
+        }
+        SAFECOIN_SEGIDSTATS_TIP = tip;
+    }
+    for (i=0; i<3; i++)
+        if ( depth == SAFECOIN_SEGIDSTATS_DEPTHS[i] )
+        {
+            memcpy(counts,SAFECOIN_SEGIDSTATS[i],sizeof(SAFECOIN_SEGIDSTATS[i]));
+            return;
+        }
+    memset(counts,0,sizeof(*counts) * SAFECOIN_SEGIDSTATS_SLOTS);
+    for (ht=tip-depth+1; ht<=tip; ht++)
+        counts[safecoin_segidstats_slot(SAFECOIN_SEGIDSTATS_VALS[ht & (SAFECOIN_SEGIDSTATS_RING-1)])]++;
+}
+
+void safecoin_segids_connect(CBlockIndex *pindex,CBlock *block)
+{
+    int32_t height = pindex->GetHeight(); int8_t segid;
+    if ( height <= 0 )
+        return;
+    if ( pindex->segid >= -1 )
+        segid = pindex->segid;
+    else if ( IsInitialBlockDownload() != 0 )
+    {
+        SAFECOIN_SEGIDSTATS_TIP = 0;
+        return; // the stake checks of the next blocks look it up once through safecoin_segids()
+    }
+    else
+    {
+        segid = safecoin_blocksegid(height,pindex,*block);
+        if ( pindex->segid == -2 )
+            pindex->segid = segid;
+    }
+    safecoin_segidstats_connect(height,segid);
+    pthread_mutex_lock(&safecoin_segidmutex);
+    SAFECOIN_SEGIDHEIGHTS[height & (SAFECOIN_SEGIDRING-1)] = height;
+    SAFECOIN_SEGIDVALS[height & (SAFECOIN_SEGIDRING-1)] = segid;
+    pthread_mutex_unlock(&safecoin_segidmutex);
+}
+
+void safecoin_segids_disconnect(int32_t height)
+{
+    safecoin_segidstats_disconnect(height);
+    pthread_mutex_lock(&safecoin_segidmutex);
+    if ( SAFECOIN_SEGIDHEIGHTS[height & (SAFECOIN_SEGIDRING-1)] == height )
+        SAFECOIN_SEGIDHEIGHTS[height & (SAFECOIN_SEGIDRING-1)] = 0;
+    SAFECOIN_SEGIDGEN++;
+    pthread_mutex_unlock(&safecoin_segidmutex);
+}
+
+void safecoin_segids(uint8_t *hashbuf,int32_t height,int32_t n)
+{
+    int32_t i,ht,missing = 0; uint32_t gen; int8_t segid;
+    pthread_mutex_lock(&safecoin_segidmutex);
+    for (i=0; i<n; i++)
+    {
+        ht = height + i;
+        if ( ht <= 0 )
+            hashbuf[i] = 0xff;
+        else if ( SAFECOIN_SEGIDHEIGHTS[ht & (SAFECOIN_SEGIDRING-1)] == ht )
+            hashbuf[i] = (uint8_t)SAFECOIN_SEGIDVALS[ht & (SAFECOIN_SEGIDRING-1)];
+        else hashbuf[i] = 0xff, missing++;
+    }
+    gen = SAFECOIN_SEGIDGEN;
+    pthread_mutex_unlock(&safecoin_segidmutex);
+    if ( missing == 0 )
+        return;
+    // after startup or a deep reorg, fall back to the blocks and remember what was found unless a tip was disconnected meanwhile
+    for (i=0; i<n; i++)
+    {
+        ht = height + i;
+        if ( hashbuf[i] != 0xff || ht <= 0 )
+            continue;
+        hashbuf[i] = (uint8_t)(segid= safecoin_segid(0,ht));
+        if ( safecoin_chainactive(ht) == 0 )
+            continue;
+        pthread_mutex_lock(&safecoin_segidmutex);
+        if ( gen == SAFECOIN_SEGIDGEN )
+        {
+            SAFECOIN_SEGIDHEIGHTS[ht & (SAFECOIN_SEGIDRING-1)] = ht;
+            SAFECOIN_SEGIDVALS[ht & (SAFECOIN_SEGIDRING-1)] = segid;
+        }
+        pthread_mutex_unlock(&safecoin_segidmutex);
+    }
+}
+
+// the 100 segid bytes lead every stake hash of a round, so callers hash them once into segidstate and
+// each output only adds its address hash, txid and vout on top of a copy
+uint32_t safecoin_addrstakehash(uint256 *hashp,const CSHA256 &segidstate,bits256 addrhash,uint256 txid,int32_t vout)
+{
+    CSHA256 sha256(segidstate);
+    sha256.Write(addrhash.bytes,sizeof(addrhash)).Write(txid.begin(),sizeof(txid)).Write((const uint8_t *)&vout,sizeof(vout)).Finalize((uint8_t *)hashp);
     return(addrhash.uints[0]);
 }
 
@@ -1723,7 +1932,7 @@ arith_uint256 safecoin_adaptivepow_target(int32_t height,arith_uint256 bnTarget,
     return(bnTarget);
 }
 
-arith_uint256 safecoin_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t height,int32_t goalperc,int32_t newStakerActive)
+arith_uint256 _safecoin_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t height,int32_t goalperc,int32_t newStakerActive)
 {
     int32_t oldflag = 0,dispflag = 0;
     CBlockIndex *pindex; arith_uint256 easydiff,bnTarget,hashval,sum,ave; bool fNegative,fOverflow; int32_t i,n,m,ht,percPoS,diff,val;
@@ -1840,10 +2049,64 @@ arith_uint256 safecoin_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t
     return(bnTarget);
 }
 
-uint32_t safecoin_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,char *destaddr,int32_t PoSperc)
+// staked PoW targets by the block before height and the other inputs. The 100 blocks the target is averaged
+// over end at that block, so an entry holds as long as its hash does. The staker and the block checks of the
+// same height ask for the same target over and over.
+struct safecoin_powtarget_key
+{
+    uint256 prevhash,target; int32_t goalperc,newStakerActive;
+    bool operator<(const safecoin_powtarget_key &other) const
+    {
+        if ( prevhash != other.prevhash )
+            return(prevhash < other.prevhash);
+        if ( target != other.target )
+            return(target < other.target);
+        if ( goalperc != other.goalperc )
+            return(goalperc < other.goalperc);
+        return(newStakerActive < other.newStakerActive);
+    }
+};
+static CCriticalSection cs_powtargets;
+static std::map<safecoin_powtarget_key,std::pair<arith_uint256,int32_t> > mapPoWtargets;
+static std::deque<safecoin_powtarget_key> dqPoWtargets;   // insertion order, oldest dropped first
+static const size_t MAX_POWTARGETS = 256;
+
+arith_uint256 safecoin_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t height,int32_t goalperc,int32_t newStakerActive)
+{
+    safecoin_powtarget_key key; CBlockIndex *pindex; arith_uint256 bnTarget;
+    if ( height <= 100 || (pindex= safecoin_chainactive(height-1)) == 0 )
+        return(_safecoin_PoWtarget(percPoSp,target,height,goalperc,newStakerActive));
+    key.prevhash = pindex->GetBlockHash();
+    key.target = ArithToUint256(target);
+    key.goalperc = goalperc;
+    key.newStakerActive = newStakerActive;
+    {
+        LOCK(cs_powtargets);
+        std::map<safecoin_powtarget_key,std::pair<arith_uint256,int32_t> >::const_iterator it = mapPoWtargets.find(key);
+        if ( it != mapPoWtargets.end() )
+        {
+            *percPoSp = it->second.second;
+            return(it->second.first);
+        }
+    }
+    bnTarget = _safecoin_PoWtarget(percPoSp,target,height,goalperc,newStakerActive);
+    LOCK(cs_powtargets);
+    if ( mapPoWtargets.insert(std::make_pair(key,std::make_pair(bnTarget,*percPoSp))).second )
+    {
+        dqPoWtargets.push_back(key);
+        while ( dqPoWtargets.size() > MAX_POWTARGETS )
+        {
+            mapPoWtargets.erase(dqPoWtargets.front());
+            dqPoWtargets.pop_front();
+        }
+    }
+    return(bnTarget);
+}
+
+// stake check of an output whose txtime, value and address hash are already known, segidstate has the 100 segids before nHeight
+uint32_t safecoin_stakeutxo(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,const CSHA256 &segidstate,uint256 txid,int32_t vout,uint32_t txtime,uint64_t value,bits256 addrhash,uint32_t blocktime,uint32_t prevtime,int32_t PoSperc)
 {
-    bool fNegative,fOverflow; uint8_t hashbuf[256]; char address[64]; bits256 addrhash; arith_uint256 hashval,mindiff,ratio,coinage256; uint256 hash,pasthash; int32_t segid,minage,i,iter=0; int64_t diff=0; uint32_t txtime,segid32,winner = 0 ; uint64_t value,coinage;
-    txtime = safecoin_txtime2(&value,txid,vout,address);
+    bool fNegative,fOverflow; arith_uint256 hashval,mindiff,ratio,coinage256; uint256 hash,pasthash; int32_t segid,minage,i,iter=0; int64_t diff=0; uint32_t segid32,winner = 0 ; uint64_t coinage;
     if ( validateflag == 0 )
     {
         //fprintf(stderr,"blocktime.%u -> ",blocktime);
@@ -1865,8 +2128,7 @@ uint32_t safecoin_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHei
     ratio = (mindiff / bnTarget);
     if ( (minage= nHeight*3) > 6000 ) // about 100 blocks
         minage = 6000;
-    safecoin_segids(hashbuf,nHeight-101,100);
-    segid32 = safecoin_stakehash(&hash,address,hashbuf,txid,vout);
+    segid32 = safecoin_addrstakehash(&hash,segidstate,addrhash,txid,vout);
     segid = ((nHeight + segid32) & 0x3f);
     for (iter=0; iter<600; iter++)
     {
@@ -1954,7 +2216,19 @@ uint32_t safecoin_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHei
     return(blocktime * winner);
 }
 
-int32_t safecoin_is_PoSblock(int32_t slowflag,int32_t height,CBlock *pblock,arith_uint256 bnTarget,arith_uint256 bhash)
+uint32_t safecoin_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,char *destaddr,int32_t PoSperc)
+{
+    uint8_t hashbuf[100]; char address[64]; bits256 addrhash; uint32_t txtime; uint64_t value;
+    address[0] = 0;
+    if ( (txtime= safecoin_txtime2(&value,txid,vout,address)) == 0 || value == 0 )
+        return(0);
+    vcalc_sha256(0,(uint8_t *)&addrhash,(uint8_t *)address,(int32_t)strlen(address));
+    safecoin_segids(hashbuf,nHeight-101,100);
+    CSHA256 segidstate; segidstate.Write(hashbuf,100);
+    return(safecoin_stakeutxo(validateflag,bnTarget,nHeight,segidstate,txid,vout,txtime,value,addrhash,blocktime,prevtime,PoSperc));
+}
+
+int32_t _safecoin_is_PoSblock(int32_t slowflag,int32_t height,CBlock *pblock,arith_uint256 bnTarget,arith_uint256 bhash)
 {
     CBlockIndex *previndex,*pindex; char voutaddr[64],destaddr[64]; uint256 txid, merkleroot; uint32_t txtime,prevtime=0; int32_t ret,vout,PoSperc,txn_count,eligible=0,isPoS = 0,segid; uint64_t value; arith_uint256 POWTarget;
     if ( ASSETCHAINS_STAKED == 100 && height <= 10 )
@@ -2015,6 +2289,25 @@ int32_t safecoin_is_PoSblock(int32_t slowflag,int32_t height,CBlock *pblock,arit
     return(isPoS != 0);
 }
 
+// the slow check reads the segids and PoS share of the chain below height, so its verdict is kept by the active
+// block at height-1 too, the same as the staked PoW target
+int32_t safecoin_is_PoSblock(int32_t slowflag,int32_t height,CBlock *pblock,arith_uint256 bnTarget,arith_uint256 bhash)
+{
+    safecoin_posverdict_key key; CBlockIndex *pindex; int32_t isPoS;
+    if ( slowflag == 0 || height <= 100 || (pindex= safecoin_chainactive(height-1)) == 0 )
+        return(_safecoin_is_PoSblock(slowflag,height,pblock,bnTarget,bhash));
+    key.blockhash = pblock->GetHash();
+    key.target = ArithToUint256(bnTarget);
+    key.prevhash = pindex->GetBlockHash();
+    key.height = height;
+    key.slowflag = 1;
+    if ( safecoin_posverdict_get(key) )
+        return(1);
+    if ( (isPoS= _safecoin_is_PoSblock(slowflag,height,pblock,bnTarget,bhash)) != 0 )
+        safecoin_posverdict_set(key);
+    return(isPoS);
+}
+
 bool GetStakeParams(const CTransaction &stakeTx, CStakeParams &stakeParams);
 bool ValidateMatchingStake(const CTransaction &ccTx, uint32_t voutNum, const CTransaction &stakeTx, bool &cheating);
 
@@ -2752,9 +3045,55 @@ int32_t safecoin_acpublic(uint32_t tiptime)
     return(acpublic);
 }
 
-int64_t safecoin_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,CBlock *pblock)
+// the outputs coinsupply counts, leaving out the burn address and a trailing OP_RETURN
+
+int64_t safecoin_supplyvouts(const CTransaction &tx)
+{
+    CTxDestination address; uint8_t *script; int32_t j,m; int64_t voutsum = 0;
+    if ( (m= tx.vout.size()) > 0 )
+    {
+        for (j=0; j<m-1; j++)
+        {
+            if ( ExtractDestination(tx.vout[j].scriptPubKey,address) != 0 && strcmp("RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY",CBitcoinAddress(address).ToString().c_str()) != 0 )
+                voutsum += tx.vout[j].nValue;
+        }
+        script = (uint8_t *)&tx.vout[j].scriptPubKey[0];
+        if ( script == 0 || script[0] != 0x6a )
+        {
+            if ( ExtractDestination(tx.vout[j].scriptPubKey,address) != 0 && strcmp("RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY",CBitcoinAddress(address).ToString().c_str()) != 0 )
+                voutsum += tx.vout[j].nValue;
+        }
+    }
+    return(voutsum);
+}
+
+// value moved into the shielded pools by tx, sproutfunds only counts the joinsplits
+
+int64_t safecoin_supplyzfunds(int64_t *sproutfundsp,const CTransaction &tx)
+{
+    int64_t zfunds = 0;
+    BOOST_FOREACH(const JSDescription& joinsplit, tx.vjoinsplit)
+    {
+        zfunds -= joinsplit.vpub_new;
+        zfunds += joinsplit.vpub_old;
+        *sproutfundsp -= joinsplit.vpub_new;
+        *sproutfundsp += joinsplit.vpub_old;
+    }
+    zfunds -= tx.valueBalance;
+    return(zfunds);
+}
+
+int64_t safecoin_blocknewcoins(int64_t voutsum,int64_t vinsum)
+{
+    if ( ASSETCHAINS_SYMBOL[0] == 0 && (voutsum-vinsum) == 100003*SATOSHIDEN ) // 15 times
+        return(3 * SATOSHIDEN);
+    return(voutsum - vinsum);
+}
+
+int64_t safecoin_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,CBlock *pblock,bool *pfMissing)
 {
-    CTxDestination address; int32_t i,j,m,n,vout; uint8_t *script; uint256 txid,hashBlock; int64_t zfunds=0,vinsum=0,voutsum=0,sproutfunds=0;
+    int32_t i,j,m,n,vout; uint256 txid,hashBlock; int64_t zfunds=0,vinsum=0,voutsum=0,sproutfunds=0;
+    *pfMissing = false;
     n = pblock->vtx.size();
     for (i=0; i<n; i++)
     {
@@ -2770,114 +3109,143 @@ int64_t safecoin_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight
                 if ( !GetTransaction(txid,vintx,hashBlock, false) || vout >= vintx.vout.size() )
                 {
                     fprintf(stderr,"ERROR: %s/v%d cant find\n",txid.ToString().c_str(),vout);
+                    *pfMissing = true;
                     return(0);
                 }
                 vinsum += vintx.vout[vout].nValue;
             }
         }
-        if ( (m= tx.vout.size()) > 0 )
-        {
-            for (j=0; j<m-1; j++)
-            {
-                if ( ExtractDestination(tx.vout[j].scriptPubKey,address) != 0 && strcmp("RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY",CBitcoinAddress(address).ToString().c_str()) != 0 )
-                    voutsum += tx.vout[j].nValue;
-                else printf("skip %.8f -> %s\n",dstr(tx.vout[j].nValue),CBitcoinAddress(address).ToString().c_str());
-            }
-            script = (uint8_t *)&tx.vout[j].scriptPubKey[0];
-            if ( script == 0 || script[0] != 0x6a )
-            {
-                if ( ExtractDestination(tx.vout[j].scriptPubKey,address) != 0 && strcmp("RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY",CBitcoinAddress(address).ToString().c_str()) != 0 )
-                    voutsum += tx.vout[j].nValue;
-            }
-        }
-        BOOST_FOREACH(const JSDescription& joinsplit, tx.vjoinsplit)
-        {
-            zfunds -= joinsplit.vpub_new;
-            zfunds += joinsplit.vpub_old;
-            sproutfunds -= joinsplit.vpub_new;
-            sproutfunds += joinsplit.vpub_old;
-        }
-        zfunds -= tx.valueBalance;
+        voutsum += safecoin_supplyvouts(tx);
+        zfunds += safecoin_supplyzfunds(&sproutfunds,tx);
     }
     *zfundsp = zfunds;
     *sproutfundsp = sproutfunds;
-    if ( ASSETCHAINS_SYMBOL[0] == 0 && (voutsum-vinsum) == 100003*SATOSHIDEN ) // 15 times
-        return(3 * SATOSHIDEN);
     //if ( voutsum-vinsum+zfunds > 100000*SATOSHIDEN || voutsum-vinsum+zfunds < 0 )
     //.    fprintf(stderr,"ht.%d vins %.8f, vouts %.8f -> %.8f zfunds %.8f\n",nHeight,dstr(vinsum),dstr(voutsum),dstr(voutsum)-dstr(vinsum),dstr(zfunds));
-    return(voutsum - vinsum);
+    return(safecoin_blocknewcoins(voutsum,vinsum));
 }
 
+// the totals are kept in the block index by ConnectBlock, blocks connected by older versions
+// get them here by walking back to the last block that has them, once
+
 int64_t safecoin_coinsupply(int64_t *zfundsp,int64_t *sproutfundsp,int32_t height)
 {
-    CBlockIndex *pindex; CBlock block; int64_t zfunds=0,sproutfunds=0,supply = 0;
+    std::vector<CBlockIndex *> vWalk; CBlockIndex *pindex; CBlock block; int32_t i; int64_t zfunds=0,sproutfunds=0,supply = 0; bool fMissing = false;
     //fprintf(stderr,"coinsupply %d\n",height);
     *zfundsp = *sproutfundsp = 0;
-    if ( (pindex= safecoin_chainactive(height)) != 0 )
+    LOCK(cs_main);
+    if ( (pindex= safecoin_chainactive(height)) == 0 )
+        return(0);
+    while ( pindex != 0 && pindex->GetHeight() > 0 && (pindex->nStatus & BLOCK_HAVE_SUPPLY) == 0 )
+    {
+        vWalk.push_back(pindex);
+        pindex = pindex->pprev;
+    }
+    if ( pindex != 0 && (pindex->nStatus & BLOCK_HAVE_SUPPLY) != 0 )
+    {
+        supply = pindex->nChainSupply;
+        zfunds = pindex->nChainZfunds;
+        sproutfunds = pindex->nChainSproutfunds;
+    }
+    for (i=(int32_t)vWalk.size()-1; i>=0; i--)
     {
-        while ( pindex != 0 && pindex->GetHeight() > 0 )
+        pindex = vWalk[i];
+        if ( pindex->newcoins == 0 && pindex->zfunds == 0 )
         {
-            if ( pindex->newcoins == 0 && pindex->zfunds == 0 )
+            if ( safecoin_blockload(block,pindex) != 0 )
             {
-                if ( safecoin_blockload(block,pindex) == 0 )
-                    pindex->newcoins = safecoin_newcoins(&pindex->zfunds,&pindex->sproutfunds,pindex->GetHeight(),&block);
-                else
-                {
-                    fprintf(stderr,"error loading block.%d\n",pindex->GetHeight());
-                    return(0);
-                }
+                fprintf(stderr,"error loading block.%d\n",pindex->GetHeight());
+                return(0);
             }
-            supply += pindex->newcoins;
-            zfunds += pindex->zfunds;
-            sproutfunds += pindex->sproutfunds;
-            //printf("start ht.%d new %.8f -> supply %.8f zfunds %.8f -> %.8f\n",pindex->GetHeight(),dstr(pindex->newcoins),dstr(supply),dstr(pindex->zfunds),dstr(zfunds));
-            pindex = pindex->pprev;
+            pindex->newcoins = safecoin_newcoins(&pindex->zfunds,&pindex->sproutfunds,pindex->GetHeight(),&block,&fMissing);
+            if ( fMissing ) // a supply without the spent outputs would be kept in the block index
+                return(0);
         }
+        supply += pindex->newcoins;
+        zfunds += pindex->zfunds;
+        sproutfunds += pindex->sproutfunds;
+        //printf("start ht.%d new %.8f -> supply %.8f zfunds %.8f -> %.8f\n",pindex->GetHeight(),dstr(pindex->newcoins),dstr(supply),dstr(pindex->zfunds),dstr(zfunds));
+        pindex->nChainSupply = supply;
+        pindex->nChainZfunds = zfunds;
+        pindex->nChainSproutfunds = sproutfunds;
+        pindex->nStatus |= BLOCK_HAVE_SUPPLY;
+        setDirtyBlockIndex.insert(pindex);
     }
     *zfundsp = zfunds;
     *sproutfundsp = sproutfunds;
     return(supply);
 }
-struct safecoin_staking
+void safecoin_addcandidate(std::vector<CStakingCandidate> &vCandidates,uint32_t txtime,uint64_t nValue,uint256 txid,int32_t vout,char *address,CScript pk)
+{
+    CStakingCandidate candidate;
+    candidate.txid = txid;
+    candidate.vout = vout;
+    candidate.nValue = nValue;
+    candidate.txtime = txtime;
+    candidate.address = address;
+    vcalc_sha256(0,(uint8_t *)&candidate.addrhash,(uint8_t *)address,(int32_t)strlen(address));
+    candidate.scriptPubKey = pk;
+    vCandidates.push_back(candidate);
+}
+
+// What the staker knows about when a candidate becomes eligible on the current tip. Past minage the coinage of an
+// output only grows with the block time, so once its stake hash meets the target at some time it does at every later
+// one: a scan of 600 seconds without a winner says the earliest eligible time is past its end. A round on the same
+// tip only scans again when its window reaches past what is known, and then the 600 seconds after that.
+struct safecoin_stakeslot
 {
-    char address[64];
-    uint256 txid;
-    arith_uint256 hashval;
-    uint64_t nValue;
-    uint32_t segid32,txtime;
-    int32_t vout;
-    CScript scriptPubKey;
+    uint32_t earliest;      // earliest eligible block time, 0 while not found
+    uint32_t scannedto;     // no eligible block time up to here
+    safecoin_stakeslot() : earliest(0),scannedto(0) {}
 };
+static CCriticalSection cs_stakeschedule;
+static uint256 stakescheduletip; static uint32_t stakeschedulebits;
+static std::map<COutPoint,safecoin_stakeslot> mapStakeSchedule;
 
-struct safecoin_staking *safecoin_addutxo(struct safecoin_staking *array,int32_t *numkp,int32_t *maxkp,uint32_t txtime,uint64_t nValue,uint256 txid,int32_t vout,char *address,uint8_t *hashbuf,CScript pk)
+// eligible block time of the candidate for this round, the same as safecoin_stakeutxo(0,...) with a blocktime of 0
+// returns, except that a borderline candidate can come out a second late
+uint32_t safecoin_stakeschedule(const CStakingCandidate &kp,arith_uint256 bnTarget,int32_t nHeight,const CSHA256 &segidstate,uint32_t prevtime,int32_t PoSperc)
 {
-    uint256 hash; uint32_t segid32; struct safecoin_staking *kp;
-    segid32 = safecoin_stakehash(&hash,address,hashbuf,txid,vout);
-    if ( *numkp >= *maxkp )
-    {
-        *maxkp += 1000;
-        array = (struct safecoin_staking *)realloc(array,sizeof(*array) * (*maxkp));
-        //fprintf(stderr,"realloc max.%d array.%p\n",*maxkp,array);
-    }
-    kp = &array[(*numkp)++];
-    //fprintf(stderr,"kp.%p num.%d\n",kp,*numkp);
-    memset(kp,0,sizeof(*kp));
-    strcpy(kp->address,address);
-    kp->txid = txid;
-    kp->vout = vout;
-    kp->hashval = UintToArith256(hash);
-    kp->txtime = txtime;
-    kp->segid32 = segid32;
-    kp->nValue = nValue;
-    kp->scriptPubKey = pk;
-    return(array);
+    bits256 addrhash; uint32_t blocktime,windowstart,windowend,eligible; int32_t segid;
+    memcpy(&addrhash,kp.addrhash.begin(),sizeof(addrhash));
+    if ( nHeight < 10 )
+        return(safecoin_stakeutxo(0,bnTarget,nHeight,segidstate,kp.txid,kp.vout,kp.txtime,(uint64_t)kp.nValue,addrhash,0,prevtime,PoSperc));
+    // the scan window safecoin_stakeutxo works out for a blocktime of 0
+    if ( (blocktime= prevtime+3) < GetTime()-60 )
+        blocktime = GetTime()+30;
+    segid = ((nHeight + addrhash.uints[0]) & 0x3f);
+    windowstart = blocktime + segid*2;
+    windowend = windowstart + 599;
+    safecoin_stakeslot &slot = mapStakeSchedule[COutPoint(kp.txid,kp.vout)];
+    if ( slot.earliest == 0 && slot.scannedto < windowend )
+    {
+        if ( slot.scannedto < windowstart )
+        {
+            eligible = safecoin_stakeutxo(0,bnTarget,nHeight,segidstate,kp.txid,kp.vout,kp.txtime,(uint64_t)kp.nValue,addrhash,0,prevtime,PoSperc);
+            if ( eligible == 0 )
+                slot.scannedto = windowend;
+            else slot.earliest = eligible;
+            return(eligible);
+        }
+        // the 600 seconds after what is known, the scan starts late enough that safecoin_stakeutxo keeps its blocktime
+        eligible = safecoin_stakeutxo(0,bnTarget,nHeight,segidstate,kp.txid,kp.vout,kp.txtime,(uint64_t)kp.nValue,addrhash,slot.scannedto+1-segid*2,prevtime,PoSperc);
+        if ( eligible == 0 )
+            slot.scannedto += 600;
+        else slot.earliest = eligible;
+    }
+    if ( slot.earliest == 0 || slot.earliest > windowend )
+        return(0);
+    else if ( slot.earliest > windowstart )
+        return(slot.earliest);
+    // eligible from the start of the window on, a short scan gives the exact time
+    return(safecoin_stakeutxo(0,bnTarget,nHeight,segidstate,kp.txid,kp.vout,kp.txtime,(uint64_t)kp.nValue,addrhash,0,prevtime,PoSperc));
 }
 
 int32_t safecoin_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blocktimep,uint32_t *txtimep,uint256 *utxotxidp,int32_t *utxovoutp,uint64_t *utxovaluep,uint8_t *utxosig, uint256 merkleroot)
 {
-    static struct safecoin_staking *array; static int32_t numkp,maxkp; static uint32_t lasttime;
+    static uint32_t lasttime;
     int32_t PoSperc = 0, newStakerActive; 
-    set<CBitcoinAddress> setAddress; struct safecoin_staking *kp; int32_t winners,segid,minage,nHeight,counter=0,i,m,siglen=0,nMinDepth = 1,nMaxDepth = 99999999; vector<COutput> vecOutputs; uint32_t block_from_future_rejecttime,besttime,eligible,earliest = 0; CScript best_scriptPubKey; arith_uint256 mindiff,ratio,bnTarget,tmpTarget; CBlockIndex *tipindex,*pindex; CTxDestination address; bool fNegative,fOverflow; uint8_t hashbuf[256]; CTransaction tx; uint256 hashBlock;
+    const CStakingCandidate *kp; std::vector<CStakingCandidate> vCandidates; int32_t winners,minage,nHeight,i,siglen=0; uint32_t block_from_future_rejecttime,besttime,eligible,earliest = 0; CScript best_scriptPubKey; arith_uint256 bnTarget; CBlockIndex *tipindex,*pindex; bool fNegative,fOverflow; uint8_t hashbuf[256]; CTransaction tx; uint256 hashBlock; bits256 addrhash;
     uint64_t cbPerc = *utxovaluep, tocoinbase = 0;
     if (!EnsureWalletIsAvailable(0))
         return 0;
@@ -2896,71 +3264,37 @@ int32_t safecoin_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *bloc
     if ( *blocktimep < tipindex->nTime+60)
         *blocktimep = tipindex->nTime+60;
     safecoin_segids(hashbuf,nHeight-101,100);
+    CSHA256 segidstate; segidstate.Write(hashbuf,100);
     // this was for VerusHash PoS64
     //tmpTarget = safecoin_PoWtarget(&PoSperc,bnTarget,nHeight,ASSETCHAINS_STAKED);
-    bool resetstaker = false;
-    if ( array != 0 )
+    if ( ASSETCHAINS_MARMARA == 0 )
     {
-        LOCK(cs_main);
-        CBlockIndex* pblockindex = chainActive[tipindex->GetHeight()];
-        CBlock block; CTxDestination addressout;
-        if ( ASSETCHAINS_MARMARA != 0 )
-            resetstaker = true;
-         else if ( ReadBlockFromDisk(block, pblockindex, 1) && safecoin_isPoS(&block, nHeight, &addressout) != 0 && IsMine(*pwalletMain,addressout) != 0 )
+        // stakingSet follows the wallet from the validation interface, the periodic reload only catches what it cannot follow
+        if ( stakingSet.IsLoaded() == 0 || time(NULL) > lasttime+3600 )
         {
-              resetstaker = true;
-              fprintf(stderr, "[%s:%d] Reset ram staker after mining a block!\n",ASSETCHAINS_SYMBOL,nHeight);
+            LOCK2(cs_main, pwalletMain->cs_wallet);
+            stakingSet.Load(pwalletMain);
+            lasttime = (uint32_t)time(NULL);
+            //fprintf(stderr,"finished kp data of utxo for staking %u ht.%d numkp.%d\n",(uint32_t)time(NULL),nHeight,(int32_t)stakingSet.Size());
         }
+        stakingSet.GetCandidates(vCandidates);
     }
-
-    if ( resetstaker || array == 0 || time(NULL) > lasttime+600 )
+    else
     {
+        static std::vector<CStakingCandidate> vMarmaraCandidates; static uint256 marmaratiphash; static unsigned int marmaraupdates; static CPubKey marmarapk;
+        struct CCcontract_info *cp,C; uint256 txid; int32_t vout,ht,unlockht; CAmount nValue; char coinaddr[64]; CPubKey mypk,Marmarapk,pk;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
         LOCK2(cs_main, pwalletMain->cs_wallet);
-        pwalletMain->AvailableCoins(vecOutputs, false, NULL, true);
-        if ( array != 0 )
-        {
-            free(array);
-            array = 0;
-            maxkp = numkp = 0;
-            lasttime = 0;
-        }
-        if ( ASSETCHAINS_MARMARA == 0 )
-        {
-            BOOST_FOREACH(const COutput& out, vecOutputs)
-            {
-                if ( (tipindex= chainActive.Tip()) == 0 || tipindex->GetHeight()+1 > nHeight )
-                {
-                    fprintf(stderr,"[%s:%d] chain tip changed during staking loop t.%u counter.%d\n",ASSETCHAINS_SYMBOL,nHeight,(uint32_t)time(NULL),counter);
-                    return(0);
-                }
-                counter++;
-                if ( out.nDepth < nMinDepth || out.nDepth > nMaxDepth )
-                {
-                    //fprintf(stderr,"safecoin_staked invalid depth %d\n",(int32_t)out.nDepth);
-                    continue;
-                }
-                CAmount nValue = out.tx->vout[out.i].nValue;
-                if ( nValue < COIN  || !out.fSpendable )
-                    continue;
-                const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-                if ( ExtractDestination(pk,address) != 0 )
-                {
-                    if ( IsMine(*pwalletMain,address) == 0 )
-                        continue;
-                    if ( myGetTransaction(out.tx->GetHash(),tx,hashBlock) != 0 && (pindex= safecoin_getblockindex(hashBlock)) != 0 )
-                    {
-                        array = safecoin_addutxo(array,&numkp,&maxkp,(uint32_t)pindex->nTime,(uint64_t)nValue,out.tx->GetHash(),out.i,(char *)CBitcoinAddress(address).ToString().c_str(),hashbuf,(CScript)pk);
-                        //fprintf(stderr,"addutxo numkp.%d vs max.%d\n",numkp,maxkp);
-                    }
-                }
-            }
-        }
+        mypk = pubkey2pk(Mypubkey());
+        // the activated coins only change with the chain and the mempool, later rounds on the same tip reuse them
+        if ( chainActive.Tip()->GetBlockHash() == marmaratiphash && mempool.GetTransactionsUpdated() == marmaraupdates && mypk == marmarapk )
+            vCandidates = vMarmaraCandidates;
         else
         {
-            struct CCcontract_info *cp,C; uint256 txid; int32_t vout,ht,unlockht; CAmount nValue; char coinaddr[64]; CPubKey mypk,Marmarapk,pk;
-            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+            marmaratiphash = chainActive.Tip()->GetBlockHash();
+            marmaraupdates = mempool.GetTransactionsUpdated();
+            marmarapk = mypk;
             cp = CCinit(&C,EVAL_MARMARA);
-            mypk = pubkey2pk(Mypubkey());
             Marmarapk = GetUnspendable(cp,0);
             GetCCaddress1of2(cp,coinaddr,Marmarapk,mypk);
             SetCCunspents(unspentOutputs,coinaddr,true);
@@ -2975,17 +3309,24 @@ int32_t safecoin_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *bloc
                     const CScript &scriptPubKey = tx.vout[vout].scriptPubKey;
                     if ( DecodeMaramaraCoinbaseOpRet(tx.vout[tx.vout.size()-1].scriptPubKey,pk,ht,unlockht) != 0 && pk == mypk )
                     {
-                        array = safecoin_addutxo(array,&numkp,&maxkp,(uint32_t)pindex->nTime,(uint64_t)nValue,txid,vout,coinaddr,hashbuf,(CScript)scriptPubKey);
+                        safecoin_addcandidate(vCandidates,(uint32_t)pindex->nTime,(uint64_t)nValue,txid,vout,coinaddr,(CScript)scriptPubKey);
                     }
-                    // else fprintf(stderr,"SKIP addutxo %.8f numkp.%d vs max.%d\n",(double)nValue/COIN,numkp,maxkp);
+                    // else fprintf(stderr,"SKIP addutxo %.8f numkp.%d\n",(double)nValue/COIN,(int32_t)vCandidates.size());
                 }
             }
+            vMarmaraCandidates = vCandidates;
         }
-        lasttime = (uint32_t)time(NULL);
-        //fprintf(stderr,"finished kp data of utxo for staking %u ht.%d numkp.%d maxkp.%d\n",(uint32_t)time(NULL),nHeight,numkp,maxkp);
     }
     block_from_future_rejecttime = (uint32_t)GetTime() + ASSETCHAINS_STAKED_BLOCK_FUTURE_MAX;    
-    for (i=winners=0; i<numkp; i++)
+    TRACE2(staking, attempt_start, nHeight, vCandidates.size());
+    LOCK(cs_stakeschedule);
+    if ( tipindex->GetBlockHash() != stakescheduletip || nBits != stakeschedulebits )
+    {
+        mapStakeSchedule.clear();
+        stakescheduletip = tipindex->GetBlockHash();
+        stakeschedulebits = nBits;
+    }
+    for (i=winners=0; i<vCandidates.size(); i++)
     {
         if ( fRequestShutdown || !GetBoolArg("-gen",false) )
             return(0);
@@ -2994,12 +3335,13 @@ int32_t safecoin_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *bloc
             fprintf(stderr,"[%s:%d] chain tip changed during staking loop t.%u counter.%d\n",ASSETCHAINS_SYMBOL,nHeight,(uint32_t)time(NULL),i);
             return(0);
         }
-        kp = &array[i];
-        eligible = safecoin_stake(0,bnTarget,nHeight,kp->txid,kp->vout,0,(uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF,kp->address,PoSperc);
+        kp = &vCandidates[i];
+        memcpy(&addrhash,kp->addrhash.begin(),sizeof(addrhash));
+        eligible = safecoin_stakeschedule(*kp,bnTarget,nHeight,segidstate,(uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF,PoSperc);
         if ( eligible > 0 )
         {
             besttime = 0;
-            if ( eligible == safecoin_stake(1,bnTarget,nHeight,kp->txid,kp->vout,eligible,(uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF,kp->address,PoSperc) )
+            if ( eligible == safecoin_stakeutxo(1,bnTarget,nHeight,segidstate,kp->txid,kp->vout,kp->txtime,(uint64_t)kp->nValue,addrhash,eligible,(uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF,PoSperc) )
             {
                 // have elegible utxo to stake with. 
                 if ( earliest == 0 || eligible < earliest || (eligible == earliest && (*utxovaluep == 0 || kp->nValue < *utxovaluep)) )
@@ -3021,13 +3363,6 @@ int32_t safecoin_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *bloc
             }
         }
     }
-    if ( numkp < 500 && array != 0 )
-    {
-        free(array);
-        array = 0;
-        maxkp = numkp = 0;
-        lasttime = 0;
-    }
     if ( earliest != 0 )
     {
         bool signSuccess; SignatureData sigdata; uint64_t txfee; uint8_t *ptr; uint256 revtxid,utxotxid;
@@ -3078,5 +3413,6 @@ int32_t safecoin_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *bloc
         else
             *blocktimep = earliest;
     }
+    TRACE3(staking, attempt_finish, nHeight, winners, siglen);
     return(siglen);
 }
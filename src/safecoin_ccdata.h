@@ -20,22 +20,13 @@ struct safecoin_ccdata *CC_data;
 int32_t CC_firstheight;
 
 uint256 BuildMerkleTree(bool* fMutated, const std::vector<uint256> leaves, std::vector<uint256> &vMerkleTree);
+uint256 GetMoM(int height, int depth);
 
 uint256 safecoin_calcMoM(int32_t height,int32_t MoMdepth)
 {
-    static uint256 zero; CBlockIndex *pindex; int32_t i; std::vector<uint256> tree, leaves;
-    bool fMutated;
     MoMdepth &= 0xffff;  // In case it includes the ccid
-    if ( MoMdepth >= height )
-        return(zero);
-    for (i=0; i<MoMdepth; i++)
-    {
-        if ( (pindex= safecoin_chainactive(height - i)) != 0 )
-            leaves.push_back(pindex->hashMerkleRoot);
-        else
-            return(zero);
-    }
-    return BuildMerkleTree(&fMutated, leaves, tree);
+    LOCK(cs_main);
+    return GetMoM(height,MoMdepth); // shares the trees the crosschain proofs are taken from
 }
 
 struct safecoin_ccdata_entry *safecoin_allMoMs(int32_t *nump,uint256 *MoMoMp,int32_t safestarti,int32_t safeendi)
@@ -179,11 +179,14 @@ int32_t safecoin_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timest
 char *bitcoin_address(char *coinaddr,uint8_t addrtype,uint8_t *pubkey_or_rmd160,int32_t len);
 int32_t safecoin_minerids(uint8_t *minerids,int32_t height,int32_t width);
 int32_t safecoin_kvsearch(uint256 *refpubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen);
+int32_t safecoin_kvsearch_mempool(uint256 *txidp,uint256 *pubkeyp,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen);
+int32_t safecoin_kvmempool_registration(uint256 *txidp,int32_t *heightp,std::string &parentkey,const std::string &safekey);
 
 uint32_t safecoin_blocktime(uint256 hash);
 int32_t safecoin_longestchain();
 int32_t safecoin_dpowconfs(int32_t height,int32_t numconfs);
 int8_t safecoin_segid(int32_t nocache,int32_t height);
+void safecoin_segidstats(int32_t *counts,int32_t depth);
 int32_t safecoin_heightpricebits(uint64_t *seedp,uint32_t *heightbits,int32_t nHeight);
 char *safecoin_pricename(char *name,int32_t ind);
 int32_t safecoin_priceind(const char *symbol);
@@ -209,7 +212,10 @@ CBlockIndex *safecoin_blockindex(uint256 hash);
 CBlockIndex *safecoin_chainactive(int32_t height);
 int32_t safecoin_blockheight(uint256 hash);
 bool safecoin_txnotarizedconfirmed(uint256 txid);
+void safecoin_txsnotarizedconfirmed(const std::vector<uint256> &txids,std::vector<bool> &confirmed);
 int32_t safecoin_blockload(CBlock& block, CBlockIndex *pindex);
+int32_t safecoin_coinbaseload(CBlock& block, CBlockIndex *pindex);
+int32_t safecoin_blockendsload(CBlock& block, CBlockIndex *pindex);
 uint32_t safecoin_chainactive_timestamp();
 uint32_t GetLatestTimestamp(int32_t height);
 
@@ -149,6 +149,8 @@ void safecoin_event_rewind(struct safecoin_state *sp,char *symbol,int32_t height
                 sp->Safecoin_numevents--;
             }
         }
+        if ( psafenodes == 0 || height > psafenodes->GetBestHeight() )
+            safenodeRegistry.Rewind(height);
     }
 }
 
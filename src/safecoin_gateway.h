@@ -16,6 +16,8 @@
 // paxdeposit equivalent in reverse makes opreturn and SAFE does the same in reverse
 #include "safecoin_defs.h"
 
+#include <thread>
+
 /*#include "secp256k1/include/secp256k1.h"
 #include "secp256k1/include/secp256k1_schnorrsig.h"
 #include "secp256k1/include/secp256k1_musig.h"
@@ -63,6 +65,26 @@ void pax_keyset(uint8_t *buf,uint256 txid,uint16_t vout,uint8_t type)
     buf[34] = type;
 }
 
+// the coinbase deposit and withdraw code only wants one or two types, so each entry is also on the list of its type
+struct pax_transaction **safecoin_paxlist(uint8_t type)
+{
+    if ( type == 'I' )
+        return(&PAX_ISSUED);
+    else if ( type == 'D' || type == 'A' )
+        return(&PAX_DEPOSITS);
+    else if ( type == 'W' )
+        return(&PAX_WITHDRAWS);
+    return(0);
+}
+
+void safecoin_paxadd(struct pax_transaction *pax) // safecoin_mutex held
+{
+    struct pax_transaction **listp;
+    HASH_ADD_KEYPTR(hh,PAX,pax->buf,sizeof(pax->buf),pax);
+    if ( (listp= safecoin_paxlist(pax->type)) != 0 )
+        DL_APPEND2(*listp,pax,prevtype,nexttype);
+}
+
 struct pax_transaction *safecoin_paxfind(uint256 txid,uint16_t vout,uint8_t type)
 {
     struct pax_transaction *pax; uint8_t buf[35];
@@ -95,7 +117,7 @@ struct pax_transaction *safecoin_paxmark(int32_t height,uint256 txid,uint16_t vo
         pax->vout = vout;
         pax->type = type;
         memcpy(pax->buf,buf,sizeof(pax->buf));
-        HASH_ADD_KEYPTR(hh,PAX,pax->buf,sizeof(pax->buf),pax);
+        safecoin_paxadd(pax);
         //printf("ht.%d create pax.%p mark.%d\n",height,pax,mark);
     }
     if ( pax != 0 )
@@ -112,8 +134,11 @@ struct pax_transaction *safecoin_paxmark(int32_t height,uint256 txid,uint16_t vo
 void safecoin_paxdelete(struct pax_transaction *pax)
 {
     return; // breaks when out of order
+    struct pax_transaction **listp;
     pthread_mutex_lock(&safecoin_mutex);
     HASH_DELETE(hh,PAX,pax);
+    if ( (listp= safecoin_paxlist(pax->type)) != 0 )
+        DL_DELETE2(*listp,pax,prevtype,nexttype);
     pthread_mutex_unlock(&safecoin_mutex);
 }
 
@@ -135,7 +160,7 @@ void safecoin_gateway_deposit(char *coinaddr,uint64_t value,char *symbol,uint64_
         pax->vout = vout;
         pax->type = type;
         memcpy(pax->buf,buf,sizeof(pax->buf));
-        HASH_ADD_KEYPTR(hh,PAX,pax->buf,sizeof(pax->buf),pax);
+        safecoin_paxadd(pax);
         addflag = 1;
         if ( 0 && ASSETCHAINS_SYMBOL[0] == 0 )
         {
@@ -311,7 +336,10 @@ uint64_t safecoin_paxtotal()
         return(0);
     else
     {
-        HASH_ITER(hh,PAX,pax,tmp)
+        struct pax_transaction *lists[2]; // only issues and withdraws need their stats updated
+        lists[0] = PAX_ISSUED, lists[1] = PAX_WITHDRAWS;
+        for (i=0; i<2; i++)
+        DL_FOREACH_SAFE2(lists[i],pax,tmp,nexttype)
         {
             if ( pax->marked != 0 )
                 continue;
@@ -359,7 +387,7 @@ uint64_t safecoin_paxtotal()
         }
     }
     safecoin_stateptr(symbol,dest);
-    HASH_ITER(hh,PAX,pax,tmp)
+    DL_FOREACH_SAFE2(PAX_DEPOSITS,pax,tmp,nexttype) // ready is only looked at for deposits
     {
         pax->ready = 0;
         if ( 0 && pax->type == 'A' )
@@ -435,27 +463,24 @@ int32_t safecoin_pending_withdraws(char *opretstr) // todo: enforce deterministi
     if ( safecoin_isrealtime(&ht) == 0 || ASSETCHAINS_SYMBOL[0] != 0 )
         return(0);
     n = 0;
-    HASH_ITER(hh,PAX,pax,tmp)
+    DL_FOREACH_SAFE2(PAX_WITHDRAWS,pax,tmp,nexttype)
     {
-        if ( pax->type == 'W' )
+        if ( (pax2= safecoin_paxfind(pax->txid,pax->vout,'A')) != 0 )
         {
-            if ( (pax2= safecoin_paxfind(pax->txid,pax->vout,'A')) != 0 )
-            {
-                if ( pax2->approved != 0 )
-                    pax->approved = pax2->approved;
-            }
-            else if ( (pax2= safecoin_paxfind(pax->txid,pax->vout,'X')) != 0 )
-                pax->approved = pax->height;
-            //printf("pending_withdraw: pax %s marked.%u approved.%u validated.%llu\n",pax->symbol,pax->marked,pax->approved,(long long)pax->validated);
-            if ( pax->marked == 0 && pax->approved == 0 && pax->validated != 0 ) //strcmp((char *)"SAFE",pax->symbol) == 0 &&
+            if ( pax2->approved != 0 )
+                pax->approved = pax2->approved;
+        }
+        else if ( (pax2= safecoin_paxfind(pax->txid,pax->vout,'X')) != 0 )
+            pax->approved = pax->height;
+        //printf("pending_withdraw: pax %s marked.%u approved.%u validated.%llu\n",pax->symbol,pax->marked,pax->approved,(long long)pax->validated);
+        if ( pax->marked == 0 && pax->approved == 0 && pax->validated != 0 ) //strcmp((char *)"SAFE",pax->symbol) == 0 &&
+        {
+            if ( n < sizeof(paxes)/sizeof(*paxes) )
             {
-                if ( n < sizeof(paxes)/sizeof(*paxes) )
-                {
-                    paxes[n++] = pax;
-                    //int32_t j; for (j=0; j<32; j++)
-                    //    printf("%02x",((uint8_t *)&pax->txid)[j]);
-                    //printf(" %s.(safeht.%d ht.%d marked.%u approved.%d validated %.8f) %.8f\n",pax->source,pax->height,pax->otherheight,pax->marked,pax->approved,dstr(pax->validated),dstr(pax->safetoshis));
-                }
+                paxes[n++] = pax;
+                //int32_t j; for (j=0; j<32; j++)
+                //    printf("%02x",((uint8_t *)&pax->txid)[j]);
+                //printf(" %s.(safeht.%d ht.%d marked.%u approved.%d validated %.8f) %.8f\n",pax->source,pax->height,pax->otherheight,pax->marked,pax->approved,dstr(pax->validated),dstr(pax->safetoshis));
             }
         }
     }
@@ -509,10 +534,8 @@ int32_t safecoin_gateway_deposits(CMutableTransaction *txNew,char *base,int32_t
         if ( 1 || safecoin_paxtotal() == 0 )
             return(0);
     }
-    HASH_ITER(hh,PAX,pax,tmp)
+    DL_FOREACH_SAFE2(PAX_DEPOSITS,pax,tmp,nexttype)
     {
-        if ( pax->type != 'D' && pax->type != 'A' )
-            continue;
         {
 #ifdef SAFECOIN_ASSETCHAINS_WAITNOTARIZE
             if ( pax->height > 236000 )
@@ -850,7 +873,7 @@ const char *safecoin_opreturn(int32_t height,uint64_t value,uint8_t *opretbuf,in
     tosafecoin = (safecoin_is_issuer() == 0);
     if ( opretbuf[0] == 'K' && opretlen != 40 )
     {
-        safecoin_kvupdate(opretbuf,opretlen,value);
+        safecoin_kvupdate(opretbuf,opretlen,value,height);
         return("kv");
     }
     else if ( ASSETCHAINS_SYMBOL[0] == 0 && SAFECOIN_PAX == 0 )
@@ -1253,6 +1276,13 @@ void safecoin_stateind_set(struct safecoin_state *sp,uint32_t *inds,int32_t n,ui
     else if ( func == 'R' ) // opreturn:*/
 }
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 void *OS_loadfile(char *fname,uint8_t **bufp,long *lenp,long *allocsizep)
 {
     FILE *fp;
@@ -1299,47 +1329,148 @@ uint8_t *OS_fileptr(long *allocsizep,char *fname)
     return((uint8_t *)retptr);
 }
 
+// private copy-on-write mapping, so callers can patch the buffer in place like an OS_fileptr one
+uint8_t *OS_mapfile(char *fname,long *lenp,int32_t *mappedp)
+{
+#ifndef _WIN32
+    int fd; struct stat st; void *ptr;
+    *lenp = 0;
+    *mappedp = 0;
+    if ( (fd= open(fname,O_RDONLY)) >= 0 )
+    {
+        if ( fstat(fd,&st) == 0 && st.st_size > 0 && (ptr= mmap(0,(size_t)st.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0)) != MAP_FAILED )
+        {
+            close(fd);
+#ifdef MADV_SEQUENTIAL
+            madvise(ptr,(size_t)st.st_size,MADV_SEQUENTIAL);
+#endif
+            *lenp = (long)st.st_size;
+            *mappedp = 1;
+            return((uint8_t *)ptr);
+        }
+        close(fd);
+    }
+#endif
+    *mappedp = 0;
+    return(OS_fileptr(lenp,fname));
+}
+
+void OS_releasefile(uint8_t *ptr,long len,int32_t mapped)
+{
+#ifndef _WIN32
+    if ( mapped != 0 )
+    {
+        munmap(ptr,(size_t)len);
+        return;
+    }
+#endif
+    free(ptr);
+}
+
+#define SAFECOIN_INDTHREADS 8
+#define SAFECOIN_INDPERTHREAD 250000
+
+struct safecoin_indsegment { uint8_t *inds,*filedata; long datalen,lastfpos,fpos; int32_t first,last,err; };
+
+// fpos of the entry just before inds[i], i a multiple of 100: previous prevpos100 plus the offset of the last entry it covers
+long safecoin_stateind_startfpos(uint8_t *inds,int32_t i)
+{
+    uint32_t prevpos100,tmp;
+    if ( i < 100 )
+        return(0);
+    memcpy(&prevpos100,&inds[(i - 100) * sizeof(uint32_t)],sizeof(uint32_t));
+    memcpy(&tmp,&inds[(i - 1) * sizeof(uint32_t)],sizeof(uint32_t));
+    return(prevpos100 + (tmp >> 8));
+}
+
+void *safecoin_stateind_segment(void *ptr)
+{
+    struct safecoin_indsegment *seg = (struct safecoin_indsegment *)ptr; long lastfpos,fpos; int32_t i; uint8_t func; uint32_t offset,tmp,prevpos100 = 0;
+    lastfpos = fpos = seg->lastfpos;
+    for (i=seg->first; i<seg->last; i++)
+    {
+        memcpy(&tmp,&seg->inds[i * sizeof(uint32_t)],sizeof(uint32_t));
+        if ( (i % 100) == 0 )
+            prevpos100 = tmp;
+        else
+        {
+            func = (tmp & 0xff);
+            offset = (tmp >> 8);
+            fpos = prevpos100 + offset;
+            if ( lastfpos >= seg->datalen || seg->filedata[lastfpos] != func )
+            {
+                printf("validate.%d error (%u %d) prev100 %u -> fpos.%ld datalen.%ld [%d] (%c) vs (%c) lastfpos.%ld\n",i,offset,func,prevpos100,fpos,seg->datalen,lastfpos < seg->datalen ? seg->filedata[lastfpos] : -1,func,lastfpos < seg->datalen ? seg->filedata[lastfpos] : 0,lastfpos);
+                seg->err = i;
+                return(0);
+            }
+        }
+        lastfpos = fpos;
+    }
+    seg->fpos = fpos;
+    return(0);
+}
+
 long safecoin_stateind_validate(struct safecoin_state *sp,char *indfname,uint8_t *filedata,long datalen,uint32_t *prevpos100p,uint32_t *indcounterp,char *symbol,char *dest)
 {
-    FILE *fp; long fsize,lastfpos=0,fpos=0; uint8_t *inds,func; int32_t i,n; uint32_t offset,tmp,prevpos100 = 0;
+    struct safecoin_indsegment segs[SAFECOIN_INDTHREADS]; pthread_t tids[SAFECOIN_INDTHREADS]; int32_t started[SAFECOIN_INDTHREADS];
+    long fsize,fpos=0; uint8_t *inds; int32_t i,n,nsegs,numthreads,mapped,err = 0; uint32_t prevpos100 = 0; double startmillis = OS_milliseconds();
     *indcounterp = *prevpos100p = 0;
-    if ( (inds= OS_fileptr(&fsize,indfname)) != 0 )
+    if ( (inds= OS_mapfile(indfname,&fsize,&mapped)) != 0 )
     {
-        lastfpos = 0;
-        fprintf(stderr,"inds.%p validate %s fsize.%ld datalen.%ld n.%d lastfpos.%ld\n",inds,indfname,fsize,datalen,(int32_t)(fsize / sizeof(uint32_t)),lastfpos);
+        fprintf(stderr,"inds.%p validate %s fsize.%ld datalen.%ld n.%d mapped.%d\n",inds,indfname,fsize,datalen,(int32_t)(fsize / sizeof(uint32_t)),mapped);
         if ( (fsize % sizeof(uint32_t)) == 0 )
         {
+            // every prevpos100 starts an independent run of 100 entries, so whole runs are checked in parallel
             n = (int32_t)(fsize / sizeof(uint32_t));
-            for (i=0; i<n; i++)
+            nsegs = (n + 99) / 100;
+            numthreads = n / SAFECOIN_INDPERTHREAD + 1;
+            if ( numthreads > SAFECOIN_INDTHREADS )
+                numthreads = SAFECOIN_INDTHREADS;
+            if ( numthreads > nsegs )
+                numthreads = nsegs;
+            if ( numthreads < 1 )
+                numthreads = 1;
+            for (i=0; i<numthreads; i++)
             {
-                memcpy(&tmp,&inds[i * sizeof(uint32_t)],sizeof(uint32_t));
-                if ( 0 && i > n-10 )
-                    printf("%d: tmp.%08x [%c] prevpos100.%u\n",i,tmp,tmp&0xff,prevpos100);
-                if ( (i % 100) == 0 )
-                    prevpos100 = tmp;
-                else
-                {
-                    func = (tmp & 0xff);
-                    offset = (tmp >> 8);
-                    fpos = prevpos100 + offset;
-                    if ( lastfpos >= datalen || filedata[lastfpos] != func )
-                    {
-                        printf("validate.%d error (%u %d) prev100 %u -> fpos.%ld datalen.%ld [%d] (%c) vs (%c) lastfpos.%ld\n",i,offset,func,prevpos100,fpos,datalen,lastfpos < datalen ? filedata[lastfpos] : -1,func,filedata[lastfpos],lastfpos);
-                        return(-1);
-                    }
-                }
-                lastfpos = fpos;
+                memset(&segs[i],0,sizeof(segs[i]));
+                segs[i].inds = inds;
+                segs[i].filedata = filedata;
+                segs[i].datalen = datalen;
+                segs[i].first = (int32_t)(((int64_t)nsegs * i) / numthreads) * 100;
+                segs[i].last = (int32_t)(((int64_t)nsegs * (i+1)) / numthreads) * 100;
+                if ( segs[i].last > n )
+                    segs[i].last = n;
+                segs[i].lastfpos = segs[i].fpos = safecoin_stateind_startfpos(inds,segs[i].first);
+                segs[i].err = -1;
+                started[i] = (i > 0 && pthread_create(&tids[i],NULL,safecoin_stateind_segment,&segs[i]) == 0);
+            }
+            for (i=0; i<numthreads; i++)
+            {
+                if ( started[i] != 0 )
+                    pthread_join(tids[i],NULL);
+                else safecoin_stateind_segment(&segs[i]);
+                if ( segs[i].err >= 0 )
+                    err = 1;
             }
+            if ( err != 0 )
+            {
+                OS_releasefile(inds,fsize,mapped);
+                return(-1);
+            }
+            fpos = segs[numthreads-1].fpos;
+            if ( n > 0 )
+                memcpy(&prevpos100,&inds[((n-1) / 100) * 100 * sizeof(uint32_t)],sizeof(uint32_t));
+            fprintf(stderr,"%s validated n.%d in %d threads %.3f millis\n",indfname,n,numthreads,OS_milliseconds() - startmillis);
             *indcounterp = n;
             *prevpos100p = prevpos100;
             if ( sp != 0 )
                 safecoin_stateind_set(sp,(uint32_t *)inds,n,filedata,fpos,symbol,dest);
             //printf("free inds.%p %s validated[%d] fpos.%ld datalen.%ld, offset %ld vs fsize.%ld\n",inds,indfname,i,fpos,datalen,i * sizeof(uint32_t),fsize);
-            free(inds);
+            OS_releasefile(inds,fsize,mapped);
             return(fpos);
         } else printf("wrong filesize %s %ld\n",indfname,fsize);
+        OS_releasefile(inds,fsize,mapped);
     }
-    free(inds);
     fprintf(stderr,"indvalidate return -1\n");
     return(-1);
 }
@@ -1365,12 +1496,15 @@ long safecoin_indfile_update(FILE *indfp,uint32_t *prevpos100p,long lastfpos,lon
 
 int32_t safecoin_faststateinit(struct safecoin_state *sp,char *fname,char *symbol,char *dest)
 {
-    FILE *indfp; char indfname[1024]; uint8_t *filedata; long validated=-1,datalen,fpos,lastfpos; uint32_t tmp,prevpos100,indcounter,starttime; int32_t func,finished = 0;
+    FILE *indfp; char indfname[1024]; uint8_t *filedata; long validated=-1,datalen,fpos,lastfpos; uint32_t tmp,prevpos100,indcounter,starttime; int32_t func,mapped,finished = 0; double startmillis,mapmillis,parsemillis,validatemillis;
     starttime = (uint32_t)time(NULL);
+    startmillis = OS_milliseconds();
     safecopy(indfname,fname,sizeof(indfname)-4);
     strcat(indfname,".ind");
-    if ( (filedata= OS_fileptr(&datalen,fname)) != 0 )
+    if ( (filedata= OS_mapfile(fname,&datalen,&mapped)) != 0 )
     {
+        mapmillis = OS_milliseconds();
+        parsemillis = validatemillis = mapmillis;
         if ( 1 )//datalen >= (1LL << 32) || GetArg("-genind",0) != 0 || (validated= safecoin_stateind_validate(0,indfname,filedata,datalen,&prevpos100,&indcounter,symbol,dest)) < 0 )
         {
             lastfpos = fpos = 0;
@@ -1382,15 +1516,17 @@ int32_t safecoin_faststateinit(struct safecoin_state *sp,char *fname,char *symbo
             {
                 lastfpos = safecoin_indfile_update(indfp,&prevpos100,lastfpos,fpos,func,&indcounter);
             }
+            parsemillis = validatemillis = OS_milliseconds();
             if ( indfp != 0 )
             {
                 fclose(indfp);
                 if ( (fpos= safecoin_stateind_validate(0,indfname,filedata,datalen,&prevpos100,&indcounter,symbol,dest)) < 0 )
                     printf("unexpected safecoinstate.ind validate failure %s datalen.%ld\n",indfname,datalen);
                 else printf("%s validated fpos.%ld\n",indfname,fpos);
+                validatemillis = OS_milliseconds();
             }
             finished = 1;
-            fprintf(stderr,"took %d seconds to process %s %ldKB\n",(int32_t)(time(NULL)-starttime),fname,datalen/1024);
+            fprintf(stderr,"took %d seconds to process %s %ldKB | map %.3f parse %.3f validate %.3f millis mapped.%d\n",(int32_t)(time(NULL)-starttime),fname,datalen/1024,mapmillis - startmillis,parsemillis - mapmillis,validatemillis - parsemillis,mapped);
         }
         else if ( validated > 0 )
         {
@@ -1421,7 +1557,7 @@ int32_t safecoin_faststateinit(struct safecoin_state *sp,char *fname,char *symbo
                 }
             }
         } else printf("safecoin_faststateinit unexpected case\n");
-        free(filedata);
+        OS_releasefile(filedata,datalen,mapped);
         return(finished == 1);
     }
     return(-1);
@@ -1433,7 +1569,7 @@ void safecoin_passport_iteration()
 {
     static long lastpos[34]; static char userpass[33][1024]; static uint32_t lasttime,callcounter,lastinterest;
     int32_t maxseconds = 10;
-    FILE *fp; uint8_t *filedata; long fpos,datalen,lastfpos; int32_t baseid,limit,n,ht,isrealtime,expired,refid,blocks,longest; struct safecoin_state *sp,*refsp; char *retstr,fname[512],*base,symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; uint32_t buf[3],starttime; uint64_t RTmask = 0; //CBlockIndex *pindex;
+    FILE *fp; struct stat st; uint8_t *filedata; long fpos,datalen,lastfpos; int32_t baseid,limit,n,ht,isrealtime,expired,refid,blocks,longest; struct safecoin_state *sp,*refsp; char *retstr,fname[512],*base,symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; uint32_t buf[3],starttime; uint64_t RTmask = 0; //CBlockIndex *pindex;
     expired = 0;
     while ( 0 && SAFECOIN_INITDONE == 0 )
     {
@@ -1501,6 +1637,10 @@ void safecoin_passport_iteration()
                     free(filedata), filedata = 0;
                     datalen = 0;
                 }
+                else if ( lastpos[baseid] != 0 && sp != 0 && stat(fname,&st) == 0 && st.st_size <= lastpos[baseid] )
+                {
+                    // nothing was appended since the last pass, only parse the state file when the other daemon wrote new events
+                }
                 else if ( (fp= fopen(fname,"rb")) != 0 && sp != 0 )
                 {
                     fseek(fp,0,SEEK_END);
@@ -1626,8 +1766,8 @@ void safecoin_PriceCache_shift()
 
 int32_t _safecoin_heightpricebits(uint64_t *seedp,uint32_t *heightbits,CBlock *block)
 {
-    CTransaction tx; int32_t numvouts; std::vector<uint8_t> vopret;
-    tx = block->vtx[0];
+    int32_t numvouts; std::vector<uint8_t> vopret;
+    const CTransaction &tx = block->vtx[0];
     numvouts = (int32_t)tx.vout.size();
     GetOpReturnData(tx.vout[numvouts-1].scriptPubKey,vopret);
     if ( vopret.size() >= PRICES_SIZEBIT0 )
@@ -1648,7 +1788,7 @@ int32_t safecoin_heightpricebits(uint64_t *seedp,uint32_t *heightbits,int32_t nH
         *seedp = 0;
     if ( (pindex= safecoin_chainactive(nHeight)) != 0 )
     {
-        if ( safecoin_blockload(block,pindex) == 0 )
+        if ( safecoin_coinbaseload(block,pindex) == 0 )
         {
             return(_safecoin_heightpricebits(seedp,heightbits,&block));
         }
@@ -2023,7 +2163,39 @@ cJSON *send_curl(char *url,char *fname)
     return(json);
 }
 
-// get_urljson just returns the JSON returned by the URL using issue_curl
+// safecoin_curlget() fetches url on the caller's handle, which is kept between calls so its connection cache skips the TCP and TLS handshakes on the next request to the same host
+char *safecoin_curlget(CURL **cHandlep,char *url)
+{
+    struct MemoryStruct chunk; CURL *cHandle;
+    if ( (cHandle= *cHandlep) == 0 )
+    {
+        if ( (*cHandlep= cHandle= curl_easy_init()) == 0 )
+            return(0);
+    } else curl_easy_reset(cHandle); // only resets the options, the open connections stay
+    memset(&chunk,0,sizeof(chunk));
+    curl_easy_setopt(cHandle,CURLOPT_USERAGENT,"mozilla/4.0");
+    curl_easy_setopt(cHandle,CURLOPT_URL,url);
+    curl_easy_setopt(cHandle,CURLOPT_NOSIGNAL,1L);
+    curl_easy_setopt(cHandle,CURLOPT_NOPROGRESS,1L);
+    curl_easy_setopt(cHandle,CURLOPT_CONNECTTIMEOUT,10L);
+    curl_easy_setopt(cHandle,CURLOPT_TIMEOUT,30L);
+    if ( strncmp(url,"https",5) == 0 )
+    {
+        curl_easy_setopt(cHandle,CURLOPT_SSL_VERIFYPEER,0L);
+        curl_easy_setopt(cHandle,CURLOPT_SSL_VERIFYHOST,0L);
+    }
+    curl_easy_setopt(cHandle,CURLOPT_WRITEFUNCTION,WriteMemoryCallback);
+    curl_easy_setopt(cHandle,CURLOPT_WRITEDATA,(void *)&chunk);
+    if ( curl_easy_perform(cHandle) != CURLE_OK )
+    {
+        if ( chunk.memory != 0 )
+            free(chunk.memory);
+        return(0);
+    }
+    return(chunk.memory);
+}
+
+// get_urljson just returns the JSON returned by the URL, each price source passes its own handle
 
 
 /*
@@ -2035,10 +2207,10 @@ const char *Metals[] = { "XAU", "XAG", "XPT", "XPD", };
 const char *Markets[] = { "DJIA", "SPX", "NDX", "VIX" };
 */
 
-cJSON *get_urljson(char *url)
+cJSON *get_urljson(CURL **cHandlep,char *url)
 {
     char *jsonstr; cJSON *json = 0;
-    if ( (jsonstr= issue_curl(url)) != 0 )
+    if ( (jsonstr= safecoin_curlget(cHandlep,url)) != 0 )
     {
         //fprintf(stderr,"(%s) -> (%s)\n",url,jsonstr);
         json = cJSON_Parse(jsonstr);
@@ -2049,10 +2221,10 @@ cJSON *get_urljson(char *url)
 
 int32_t get_stockprices(uint32_t now,uint32_t *prices,std::vector<std::string> symbols)
 {
-    char url[32768],*symbol,*timestr; cJSON *json,*obj; int32_t i,n=0,retval=-1; uint32_t uprice,timestamp;
+    static CURL *cHandle; char url[32768],*symbol,*timestr; cJSON *json,*obj; int32_t i,n=0,retval=-1; uint32_t uprice,timestamp;
     sprintf(url,"https://api.iextrading.com/1.0/tops/last?symbols=%s",GetArg("-ac_stocks","").c_str());
     fprintf(stderr,"url.(%s)\n",url);
-    if ( (json= get_urljson(url)) != 0 ) //if ( (json= send_curl(url,(char *)"iex")) != 0 ) //
+    if ( (json= get_urljson(&cHandle,url)) != 0 ) //if ( (json= send_curl(url,(char *)"iex")) != 0 ) //
     {
         fprintf(stderr,"stocks.(%s)\n",jprint(json,0));
         if ( (n= cJSON_GetArraySize(json)) > 0 )
@@ -2090,9 +2262,9 @@ int32_t get_stockprices(uint32_t now,uint32_t *prices,std::vector<std::string> s
 uint32_t get_dailyfx(uint32_t *prices)
 {
     //{"base":"USD","rates":{"BGN":1.74344803,"NZD":1.471652701,"ILS":3.6329113924,"RUB":65.1997682296,"CAD":1.3430201462,"USD":1.0,"PHP":52.8641469068,"CHF":0.9970582992,"AUD":1.4129078267,"JPY":110.6792654662,"TRY":5.6523444464,"HKD":7.8499732573,"MYR":4.0824567659,"HRK":6.6232840078,"CZK":22.9862720628,"IDR":14267.4986628633,"DKK":6.6551078624,"NOK":8.6806917454,"HUF":285.131039401,"GBP":0.7626582278,"MXN":19.4183455161,"THB":31.8702085933,"ISK":122.5708682475,"ZAR":14.7033339276,"BRL":3.9750401141,"SGD":1.3573720806,"PLN":3.8286682118,"INR":69.33187734,"KRW":1139.1602781244,"RON":4.2423783206,"CNY":6.7387234801,"SEK":9.3385630237,"EUR":0.8914244963},"date":"2019-03-28"}
-    char url[512],*datestr; cJSON *json,*rates; int32_t i; uint32_t datenum=0,price = 0;
+    static CURL *cHandle; char url[512],*datestr; cJSON *json,*rates; int32_t i; uint32_t datenum=0,price = 0;
     sprintf(url,"https://api.openrates.io/latest?base=USD");
-    if ( (json= get_urljson(url)) != 0 ) //if ( (json= send_curl(url,(char *)"dailyfx")) != 0 )
+    if ( (json= get_urljson(&cHandle,url)) != 0 ) //if ( (json= send_curl(url,(char *)"dailyfx")) != 0 )
     {
         if ( (rates= jobj(json,(char *)"rates")) != 0 )
         {
@@ -2113,9 +2285,9 @@ uint32_t get_dailyfx(uint32_t *prices)
 
 uint32_t get_binanceprice(const char *symbol)
 {
-    char url[512]; cJSON *json; uint32_t price = 0;
+    static CURL *cHandle; char url[512]; cJSON *json; uint32_t price = 0;
     sprintf(url,"https://api.binance.com/api/v1/ticker/price?symbol=%sBTC",symbol);
-    if ( (json= get_urljson(url)) != 0 ) //if ( (json= send_curl(url,(char *)"bnbprice")) != 0 )
+    if ( (json= get_urljson(&cHandle,url)) != 0 ) //if ( (json= send_curl(url,(char *)"bnbprice")) != 0 )
     {
         price = jdouble(json,(char *)"price")*SATOSHIDEN + 0.0000000049;
         free_json(json);
@@ -2188,8 +2360,8 @@ int32_t get_stocks(const char *list[],int32_t n)
 
 int32_t get_btcusd(uint32_t pricebits[4])
 {
-    cJSON *pjson,*bpi,*obj; char str[512]; double dbtcgbp,dbtcusd,dbtceur; uint64_t btcusd = 0,btcgbp = 0,btceur = 0;
-    if ( (pjson= get_urljson((char *)"http://api.coindesk.com/v1/bpi/currentprice.json")) != 0 )
+    static CURL *cHandle; cJSON *pjson,*bpi,*obj; char str[512]; double dbtcgbp,dbtcusd,dbtceur; uint64_t btcusd = 0,btcgbp = 0,btceur = 0;
+    if ( (pjson= get_urljson(&cHandle,(char *)"http://api.coindesk.com/v1/bpi/currentprice.json")) != 0 )
     {
         if ( (bpi= jobj(pjson,(char *)"bpi")) != 0 )
         {
@@ -2243,9 +2415,9 @@ extern uint256 Queued_reconsiderblock;
 
 void safecoin_cbopretupdate(int32_t forceflag)
 {
-    static uint32_t lasttime,lastbtc,pending;
-    static uint32_t pricebits[4],pricebuf[SAFECOIN_MAXPRICES],forexprices[sizeof(Forex)/sizeof(*Forex)];
-    int32_t size; uint32_t flags=0,now; CBlockIndex *pindex;
+    static uint32_t lasttime,lastbtc,pending; static int32_t didinit;
+    static uint32_t pricebits[4],cryptobuf[SAFECOIN_MAXPRICES],stockbuf[SAFECOIN_MAXPRICES],forexprices[sizeof(Forex)/sizeof(*Forex)];
+    int32_t size,wantbtc,wantfx,btcret=-1,stockret=-1; uint32_t flags=0,now; CBlockIndex *pindex; std::vector<std::thread> fetchers;
     if ( Queued_reconsiderblock != zeroid )
     {
         fprintf(stderr,"Queued_reconsiderblock %s\n",Queued_reconsiderblock.GetHex().c_str());
@@ -2268,7 +2440,27 @@ void safecoin_cbopretupdate(int32_t forceflag)
         if ( Mineropret.size() < size )
             Mineropret.resize(size);
         size = PRICES_SIZEBIT0;
-        if ( (forceflag != 0 || now > lastbtc+120) && get_btcusd(pricebits) == 0 )
+        if ( didinit == 0 )
+        {
+            curl_global_init(CURL_GLOBAL_ALL); // not thread safe, so before the fetchers start
+            didinit = 1;
+        }
+        // every source is fetched at once on its own thread and kept-alive handle, so a forced update
+        // from the miner or validation waits for the slowest source instead of the sum of them.
+        // cryptos and stocks are only used when btc or forex updated, they are fetched alongside and dropped otherwise
+        wantbtc = (forceflag != 0 || now > lastbtc+120);
+        wantfx = ((ASSETCHAINS_CBOPRET & 2) != 0 && (now > lasttime+3600*5 || forexprices[0] == 0));
+        if ( wantbtc != 0 )
+            fetchers.push_back(std::thread([&btcret]() { btcret = get_btcusd(pricebits); }));
+        if ( wantfx != 0 )
+            fetchers.push_back(std::thread([]() { get_dailyfx(forexprices); }));
+        if ( (forceflag != 0 || wantbtc != 0 || wantfx != 0) && (ASSETCHAINS_CBOPRET & 4) != 0 )
+            fetchers.push_back(std::thread([]() { get_cryptoprices(cryptobuf,Cryptos,(int32_t)(sizeof(Cryptos)/sizeof(*Cryptos)),ASSETCHAINS_PRICES); }));
+        if ( (forceflag != 0 || wantbtc != 0 || wantfx != 0) && (ASSETCHAINS_CBOPRET & 8) != 0 )
+            fetchers.push_back(std::thread([&stockret,now]() { stockret = get_stockprices(now,stockbuf,ASSETCHAINS_STOCKS); }));
+        for (auto& fetcher : fetchers)
+            fetcher.join();
+        if ( wantbtc != 0 && btcret == 0 )
         {
             if ( flags == 0 )
                 safecoin_PriceCache_shift();
@@ -2277,9 +2469,8 @@ void safecoin_cbopretupdate(int32_t forceflag)
         }
         if ( (ASSETCHAINS_CBOPRET & 2) != 0 )
         {
-            if ( now > lasttime+3600*5 || forexprices[0] == 0 ) // cant assume timestamp is valid for forex price as it is a daily weekday changing thing anyway.
+            if ( wantfx != 0 ) // cant assume timestamp is valid for forex price as it is a daily weekday changing thing anyway.
             {
-                get_dailyfx(forexprices);
                 if ( flags == 0 )
                     safecoin_PriceCache_shift();
                 flags |= 2;
@@ -2291,10 +2482,9 @@ void safecoin_cbopretupdate(int32_t forceflag)
         {
             if ( forceflag != 0 || flags != 0 )
             {
-                get_cryptoprices(pricebuf,Cryptos,(int32_t)(sizeof(Cryptos)/sizeof(*Cryptos)),ASSETCHAINS_PRICES);
                 if ( flags == 0 )
                     safecoin_PriceCache_shift();
-                memcpy(&PriceCache[0][size/sizeof(uint32_t)],pricebuf,(sizeof(Cryptos)/sizeof(*Cryptos)+ASSETCHAINS_PRICES.size()) * sizeof(uint32_t));
+                memcpy(&PriceCache[0][size/sizeof(uint32_t)],cryptobuf,(sizeof(Cryptos)/sizeof(*Cryptos)+ASSETCHAINS_PRICES.size()) * sizeof(uint32_t));
                 flags |= 4; // very rarely we can see flags == 6 case
             }
             size += (sizeof(Cryptos)/sizeof(*Cryptos)+ASSETCHAINS_PRICES.size()) * sizeof(uint32_t);
@@ -2304,11 +2494,11 @@ void safecoin_cbopretupdate(int32_t forceflag)
         {
             if ( forceflag != 0 || flags != 0 )
             {
-                if ( get_stockprices(now,pricebuf,ASSETCHAINS_STOCKS) == ASSETCHAINS_STOCKS.size() )
+                if ( stockret == ASSETCHAINS_STOCKS.size() )
                 {
                     if ( flags == 0 )
                         safecoin_PriceCache_shift();
-                    memcpy(&PriceCache[0][size/sizeof(uint32_t)],pricebuf,ASSETCHAINS_STOCKS.size() * sizeof(uint32_t));
+                    memcpy(&PriceCache[0][size/sizeof(uint32_t)],stockbuf,ASSETCHAINS_STOCKS.size() * sizeof(uint32_t));
                     flags |= 8; // very rarely we can see flags == 10 case
                 }
             }
@@ -2742,7 +2932,9 @@ int32_t safecoin_pricesinit()
     return(0);
 }
 
-pthread_mutex_t pricemutex;
+// safecoin_pricesupdate writes the price files under the write lock; readers share
+// the lock as they pread at their own offsets without moving the file position
+pthread_rwlock_t pricelock = PTHREAD_RWLOCK_INITIALIZER;
 
 // PRICES file layouts
 // [0] rawprice32 / timestamp
@@ -2757,7 +2949,6 @@ void safecoin_pricesupdate(int32_t height,CBlock *pblock)
     width = PRICES_DAYWINDOW;//(2*PRICES_DAYWINDOW + PRICES_SMOOTHWIDTH);
     if ( numprices == 0 )
     {
-        pthread_mutex_init(&pricemutex,0);
         numprices = (int32_t)(safecoin_cbopretsize(ASSETCHAINS_CBOPRET) / sizeof(uint32_t));
         ptr32 = (uint32_t *)calloc(sizeof(uint32_t),numprices * width);
         ptr64 = (int64_t *)calloc(sizeof(int64_t),PRICES_DAYWINDOW*PRICES_MAXDATAPOINTS);
@@ -2771,7 +2962,7 @@ void safecoin_pricesupdate(int32_t height,CBlock *pblock)
         //fprintf(stderr,"numprices.%d\n",numprices);
         if ( PRICES[0].fp != 0 )
         {
-            pthread_mutex_lock(&pricemutex);
+            pthread_rwlock_wrlock(&pricelock);
             fseek(PRICES[0].fp,height * numprices * sizeof(uint32_t),SEEK_SET);
             if ( fwrite(rawprices,sizeof(uint32_t),numprices,PRICES[0].fp) != numprices )
                 fprintf(stderr,"error writing rawprices for ht.%d\n",height);
@@ -2819,7 +3010,11 @@ void safecoin_pricesupdate(int32_t height,CBlock *pblock)
                     fprintf(stderr,"height.%d\n",height);
                 } else fprintf(stderr,"error reading rawprices for ht.%d\n",height);
             } else fprintf(stderr,"height.%d <= width.%d\n",height,width);
-            pthread_mutex_unlock(&pricemutex);
+            // readers go around the stdio buffers
+            for (ind=1; ind<numprices; ind++)
+                if ( PRICES[ind].fp != 0 )
+                    fflush(PRICES[ind].fp);
+            pthread_rwlock_unlock(&pricelock);
         } else fprintf(stderr,"null PRICES[0].fp\n");
     } else fprintf(stderr,"numprices mismatch, height.%d\n",height);
 }
@@ -2827,13 +3022,24 @@ void safecoin_pricesupdate(int32_t height,CBlock *pblock)
 int32_t safecoin_priceget(int64_t *buf64,int32_t ind,int32_t height,int32_t numblocks)
 {
     FILE *fp; int32_t retval = PRICES_MAXDATAPOINTS;
-    pthread_mutex_lock(&pricemutex);
+#ifndef _WIN32
+    pthread_rwlock_rdlock(&pricelock);
+    if ( ind < SAFECOIN_MAXPRICES && (fp= PRICES[ind].fp) != 0 )
+    {
+        ssize_t len = numblocks * PRICES_MAXDATAPOINTS * sizeof(int64_t);
+        if ( pread(fileno(fp),buf64,len,(off_t)height * PRICES_MAXDATAPOINTS * sizeof(int64_t)) != len )
+            retval = -1;
+    }
+#else
+    // no pread, the readers share the file position
+    pthread_rwlock_wrlock(&pricelock);
     if ( ind < SAFECOIN_MAXPRICES && (fp= PRICES[ind].fp) != 0 )
     {
         fseek(fp,height * PRICES_MAXDATAPOINTS * sizeof(int64_t),SEEK_SET);
         if ( fread(buf64,sizeof(int64_t),numblocks*PRICES_MAXDATAPOINTS,fp) != numblocks*PRICES_MAXDATAPOINTS )
             retval = -1;
     }
-    pthread_mutex_unlock(&pricemutex);
+#endif
+    pthread_rwlock_unlock(&pricelock);
     return(retval);
 }
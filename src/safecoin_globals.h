@@ -36,7 +36,7 @@ pthread_mutex_t safecoin_mutex,staked_mutex;
 #define SAFECOIN_ELECTION_GAP 2000    //((ASSETCHAINS_SYMBOL[0] == 0) ? 2000 : 100)
 #define SAFECOIN_ASSETCHAIN_MAXLEN 65
 
-struct pax_transaction *PAX;
+struct pax_transaction *PAX,*PAX_ISSUED,*PAX_DEPOSITS,*PAX_WITHDRAWS;
 int32_t NUM_PRICES; uint32_t *PVALS;
 struct knotaries_entry *Pubkeys;
 
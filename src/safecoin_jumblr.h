@@ -54,29 +54,31 @@ struct jumblr_item
 char Jumblr_secretaddrs[JUMBLR_MAXSECRETADDRS][64],Jumblr_deposit[64];
 int32_t Jumblr_numsecretaddrs; // if 0 -> run silent mode
 
+// All the jumblr methods are this node's own rpcs, so they are dispatched through the rpc table in process
+// instead of being posted to our own rpc port, which cost a curl round trip and tied up an rpc worker for every
+// step. The shielded sends still go through z_sendmany and its async operation queue. userpass and port are
+// left over from the loopback and ignored. Returns the result, or the error object, as a json string to free().
 char *jumblr_issuemethod(char *userpass,char *method,char *params,uint16_t port)
 {
-    cJSON *retjson,*resjson = 0; char *retstr;
-    if ( (retstr= safecoin_issuemethod(userpass,method,params,port)) != 0 )
+    UniValue valParams(UniValue::VARR),result;
+    if ( params == 0 || params[0] == 0 )
+        params = (char *)"[]";
+    if ( valParams.read(params) == 0 || valParams.isArray() == 0 )
+        return(clonestr((char *)"{\"error\":\"cant parse params\"}"));
+    try
     {
-        if ( (retjson= cJSON_Parse(retstr)) != 0 )
-        {
-            if ( jobj(retjson,(char *)"result") != 0 )
-                resjson = jduplicate(jobj(retjson,(char *)"result"));
-            else if ( jobj(retjson,(char *)"error") != 0 )
-                resjson = jduplicate(jobj(retjson,(char *)"error"));
-            else
-            {
-                resjson = cJSON_CreateObject();
-                jaddstr(resjson,(char *)"error",(char *)"cant parse return");
-            }
-            free_json(retjson);
-        }
-        free(retstr);
+        result = tableRPC.execute(method,valParams);
+    }
+    catch (const UniValue& objError)
+    {
+        result = objError;
+    }
+    catch (const std::exception& e)
+    {
+        result = UniValue(UniValue::VOBJ);
+        result.push_back(Pair("error",e.what()));
     }
-    if ( resjson != 0 )
-        return(jprint(resjson,1));
-    else return(clonestr((char *)"{\"error\":\"unknown error\"}"));
+    return(clonestr((char *)result.write().c_str()));
 }
 
 char *jumblr_importaddress(char *address)
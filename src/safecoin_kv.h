@@ -17,8 +17,8 @@
 #define H_SAFECOINKV_H
 
 #include "safecoin_defs.h"
+#include "safenodesdb.h"
 
-extern std::vector<std::string> vs_safecoin_notaries(int32_t height, uint32_t timestamp);
 
 int32_t safecoin_kvcmp(uint8_t *refvalue,uint16_t refvaluesize,uint8_t *value,uint16_t valuesize)
 {
@@ -55,6 +55,86 @@ uint64_t safecoin_kvfee(uint32_t flags,int32_t opretlen,int32_t keylen)
     return(fee);
 }
 
+// expiry wheel: height + duration -> keys of the records expiring there. Entries go stale
+// when a record is updated or dropped and are skipped when their bucket is reached.
+std::map<int32_t,std::vector<std::string> > SAFECOIN_KVWHEEL;
+// records evicted by safecoin_kvexpire(), by the block height that evicted them
+std::map<int32_t,std::vector<struct safecoin_kv *> > SAFECOIN_KVEVICTED;
+
+void safecoin_kvfree(struct safecoin_kv *ptr)
+{
+    if ( ptr->value != 0 )
+        free(ptr->value);
+    if ( ptr->key != 0 )
+        free(ptr->key);
+    free(ptr);
+}
+
+// caller holds SAFECOIN_KV_mutex
+void safecoin_kvwheel_add(struct safecoin_kv *ptr)
+{
+    SAFECOIN_KVWHEEL[ptr->height + safecoin_kvduration(ptr->flags)].push_back(std::string((char *)ptr->key,ptr->keylen));
+}
+
+// evict every record that is expired at height, like safecoin_kvsearch() would on lookup
+void safecoin_kvexpire(int32_t height)
+{
+    struct safecoin_kv *ptr; int32_t i,expiry,numevicted = 0;
+    portable_mutex_lock(&SAFECOIN_KV_mutex);
+    while ( SAFECOIN_KVWHEEL.empty() == 0 && (expiry= SAFECOIN_KVWHEEL.begin()->first) < height )
+    {
+        std::vector<std::string> &keys = SAFECOIN_KVWHEEL.begin()->second;
+        for (i=0; i<keys.size(); i++)
+        {
+            HASH_FIND(hh,SAFECOIN_KV,keys[i].data(),(int32_t)keys[i].size(),ptr);
+            if ( ptr == 0 || ptr->height + safecoin_kvduration(ptr->flags) != expiry )
+                continue;
+            HASH_DELETE(hh,SAFECOIN_KV,ptr);
+            // a reorg can only bring back records that were still live within MAX_REORG_LENGTH
+            if ( expiry >= height - (int32_t)MAX_REORG_LENGTH )
+                SAFECOIN_KVEVICTED[height].push_back(ptr);
+            else safecoin_kvfree(ptr);
+            numevicted++;
+        }
+        SAFECOIN_KVWHEEL.erase(SAFECOIN_KVWHEEL.begin());
+    }
+    while ( SAFECOIN_KVEVICTED.empty() == 0 && SAFECOIN_KVEVICTED.begin()->first < height - (int32_t)MAX_REORG_LENGTH )
+    {
+        std::vector<struct safecoin_kv *> &evicted = SAFECOIN_KVEVICTED.begin()->second;
+        for (i=0; i<evicted.size(); i++)
+            safecoin_kvfree(evicted[i]);
+        SAFECOIN_KVEVICTED.erase(SAFECOIN_KVEVICTED.begin());
+    }
+    portable_mutex_unlock(&SAFECOIN_KV_mutex);
+    if ( numevicted != 0 )
+        LogPrint("safenodes","SAFENODES: expired %d KV records at height %d\n",numevicted,height);
+}
+
+// put back the records evicted at height and above, the blocks that evicted them are disconnected
+void safecoin_kvunexpire(int32_t height)
+{
+    struct safecoin_kv *ptr,*cur; int32_t i;
+    portable_mutex_lock(&SAFECOIN_KV_mutex);
+    while ( SAFECOIN_KVEVICTED.empty() == 0 && SAFECOIN_KVEVICTED.rbegin()->first >= height )
+    {
+        std::vector<struct safecoin_kv *> &evicted = SAFECOIN_KVEVICTED.rbegin()->second;
+        for (i=0; i<evicted.size(); i++)
+        {
+            ptr = evicted[i];
+            HASH_FIND(hh,SAFECOIN_KV,ptr->key,ptr->keylen,cur);
+            if ( cur != 0 ) // the key was written again since, keep that record
+            {
+                safecoin_kvfree(ptr);
+                continue;
+            }
+            HASH_ADD_KEYPTR(hh,SAFECOIN_KV,ptr->key,ptr->keylen,ptr);
+            safecoin_kvwheel_add(ptr);
+        }
+        SAFECOIN_KVEVICTED.erase(--SAFECOIN_KVEVICTED.end());
+    }
+    portable_mutex_unlock(&SAFECOIN_KV_mutex);
+}
+
 int32_t safecoin_kvsearch(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen)
 {
     struct safecoin_kv *ptr; int32_t duration,retval = -1;
@@ -70,11 +150,7 @@ int32_t safecoin_kvsearch(uint256 *pubkeyp,int32_t current_height,uint32_t *flag
         if ( current_height > (ptr->height + duration) )
         {
             HASH_DELETE(hh,SAFECOIN_KV,ptr);
-            if ( ptr->value != 0 )
-                free(ptr->value);
-            if ( ptr->key != 0 )
-                free(ptr->key);
-            free(ptr);
+            safecoin_kvfree(ptr);
         }
         else
         {
@@ -92,17 +168,130 @@ int32_t safecoin_kvsearch(uint256 *pubkeyp,int32_t current_height,uint32_t *flag
         }
     } //else fprintf(stderr,"couldnt find (%s)\n",(char *)key);
     portable_mutex_unlock(&SAFECOIN_KV_mutex);
-    if ( retval < 0 )
+    // only confirmed records, safecoin_kvupdate() relies on that. Mempool records are in safecoin_kvsearch_mempool()
+    return(retval);
+}
+
+int32_t safecoin_kvislowerhex(uint8_t *str,int32_t n)
+{
+    int32_t i;
+    for (i=0; i<n; i++)
+        if ( (str[i] < '0' || str[i] > '9') && (str[i] < 'a' || str[i] > 'f') )
+            return(0);
+    return(1);
+}
+
+// beacon keys are parentkey (66 lowercase hex) + registration height (7 or 8 chars) + type flag '1'
+int32_t safecoin_kvparsekey(uint8_t parentkey33[33],int32_t *regheightp,uint8_t *regtypep,uint8_t *key,int32_t keylen)
+{
+    char heightstr[9]; int32_t i,n;
+    if ( keylen != 74 && keylen != 75 )
+        return(-1);
+    if ( (*regtypep= key[keylen-1]) != '1' || safecoin_kvislowerhex(key,66) == 0 )
+        return(-1);
+    for (i=0; i<33; i++)
+        parentkey33[i] = _decode_hex((char *)&key[i*2]);
+    n = keylen - 67;
+    memcpy(heightstr,&key[66],n);
+    heightstr[n] = 0;
+    *regheightp = atoi(heightstr);
+    return(0);
+}
+
+// the KV record a mempool transaction would store once mined, with the checks of safecoin_kvupdate()
+// against the records confirmed so far. Returns the value size, or -1 when it would not be stored.
+// caller holds cs_main
+int32_t safecoin_kvpending(const CTransaction &tx,uint256 *pubkeyp,uint32_t *flagsp,int32_t *heightp,std::string &key,std::string &value)
+{
+    std::vector<uint8_t> opret; uint16_t keylen,valuesize; int32_t i,height,coresize,refvaluesize,kvheight,regheight; uint32_t flags,refflags; uint8_t parentkey33[33],regtype,refvalue[IGUANA_MAXSCRIPTSIZE],keyvalue[IGUANA_MAXSCRIPTSIZE*8]; uint256 refpubkey,sig; static uint256 zeroes;
+    for (i=0; i<tx.vout.size(); i++)
+    {
+        if ( GetOpReturnData(tx.vout[i].scriptPubKey,opret) == 0 || opret.size() < 13 || opret[0] != 'K' || opret.size() == 40 )
+            continue;
+        iguana_rwnum(0,&opret[1],sizeof(keylen),&keylen);
+        iguana_rwnum(0,&opret[3],sizeof(valuesize),&valuesize);
+        iguana_rwnum(0,&opret[5],sizeof(height),&height);
+        iguana_rwnum(0,&opret[9],sizeof(flags),&flags);
+        if ( keylen+13 > opret.size() || safecoin_kvparsekey(parentkey33,&regheight,&regtype,&opret[13],keylen) < 0 )
+            continue;
+        if ( !safecoin_notaryset(height, 0)->IsNotary(parentkey33) || tx.vout[i].nValue < safecoin_kvfee(flags,(int32_t)opret.size(),keylen) )
+            continue;
+        coresize = (int32_t)(sizeof(flags)+sizeof(height)+sizeof(keylen)+sizeof(valuesize)+keylen+valuesize+1);
+        if ( opret.size() != coresize && opret.size() != coresize+sizeof(uint256) && opret.size() != coresize+2*sizeof(uint256) )
+            continue;
+        memset(pubkeyp,0,sizeof(*pubkeyp));
+        memset(&sig,0,sizeof(sig));
+        if ( opret.size() >= coresize+sizeof(uint256) )
+            memcpy(pubkeyp,&opret[coresize],sizeof(*pubkeyp));
+        if ( opret.size() == coresize+2*sizeof(uint256) )
+            memcpy(&sig,&opret[coresize+sizeof(uint256)],sizeof(sig));
+        // looked up at the tip, the height in the record is only the sender's word until it is mined
+        if ( (refvaluesize= safecoin_kvsearch(&refpubkey,chainActive.LastTip()->GetHeight(),&refflags,&kvheight,refvalue,&opret[13],keylen)) >= 0 )
+        {
+            // an owned key only takes updates signed by its owner, a protected one keeps its value
+            memcpy(keyvalue,&opret[13],keylen);
+            memcpy(&keyvalue[keylen],refvalue,refvaluesize);
+            if ( memcmp(&zeroes,&refpubkey,sizeof(refpubkey)) != 0 && safecoin_kvsigverify(keyvalue,keylen+refvaluesize,refpubkey,sig) < 0 )
+                continue;
+            if ( (refflags & SAFECOIN_KVPROTECTED) != 0 )
+                continue;
+        }
+        key = std::string((char *)&opret[13],keylen);
+        value = std::string((char *)&opret[13+keylen],valuesize);
+        *flagsp = flags;
+        *heightp = height;
+        return(valuesize);
+    }
+    return(-1);
+}
+
+// the newest record for key among the mempool transactions, the confirmed store is left alone
+int32_t safecoin_kvsearch_mempool(uint256 *txidp,uint256 *pubkeyp,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen)
+{
+    std::vector<CTransaction> txs; std::string txkey,txvalue; uint256 pubkey; uint32_t flags; int32_t i,height,retval = -1;
+    *heightp = -1;
+    mempool.queryKVOpRet(std::string((char *)key,keylen),txs);
+    for (i=0; i<txs.size(); i++)
     {
-        // search rawmempool
+        if ( safecoin_kvpending(txs[i],&pubkey,&flags,&height,txkey,txvalue) < 0 || txkey.size() != keylen || memcmp(txkey.data(),key,keylen) != 0 )
+            continue;
+        if ( height > *heightp && txvalue.size() <= IGUANA_MAXSCRIPTSIZE )
+        {
+            *txidp = txs[i].GetHash();
+            *pubkeyp = pubkey;
+            *flagsp = flags;
+            *heightp = height;
+            if ( (retval= (int32_t)txvalue.size()) > 0 )
+                memcpy(value,txvalue.data(),retval);
+        }
     }
     return(retval);
 }
 
-void safecoin_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
+// the newest SafeNode registration for safekey among the mempool transactions, 0 when there is one
+int32_t safecoin_kvmempool_registration(uint256 *txidp,int32_t *heightp,std::string &parentkey,const std::string &safekey)
+{
+    std::vector<CTransaction> txs; std::string txkey,txvalue; uint256 pubkey; uint32_t flags; int32_t i,height,regheight,retval = -1; uint8_t parentkey33[33],regtype;
+    *heightp = -1;
+    mempool.queryKVOpRet("",txs);
+    for (i=0; i<txs.size(); i++)
+    {
+        if ( safecoin_kvpending(txs[i],&pubkey,&flags,&height,txkey,txvalue) != 66 || txvalue != safekey || height <= *heightp )
+            continue;
+        if ( safecoin_kvparsekey(parentkey33,&regheight,&regtype,(uint8_t *)txkey.data(),(int32_t)txkey.size()) < 0 )
+            continue;
+        *txidp = txs[i].GetHash();
+        *heightp = height;
+        parentkey = HexStr(parentkey33,parentkey33+33);
+        retval = 0;
+    }
+    return(retval);
+}
+
+void safecoin_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value,int32_t blockheight)
 {
     static uint256 zeroes;
-    uint32_t flags; uint256 pubkey,refpubkey,sig; int32_t i,refvaluesize,hassig,coresize,haspubkey,height,kvheight; uint16_t keylen,valuesize,newflag = 0; uint8_t *key,*valueptr,keyvalue[IGUANA_MAXSCRIPTSIZE*8]; struct safecoin_kv *ptr; char *transferpubstr,*tstr; uint64_t fee;
+    uint32_t flags; uint256 pubkey,refpubkey,sig; int32_t i,refvaluesize,hassig,coresize,haspubkey,height,kvheight,regheight; uint16_t keylen,valuesize,newflag = 0; uint8_t *key,*valueptr,keyvalue[IGUANA_MAXSCRIPTSIZE*8],parentkey33[33],regtype; struct safecoin_kv *ptr; char *transferpubstr,*tstr; uint64_t fee;
     //    if ( ASSETCHAINS_SYMBOL[0] == 0 ) // disable KV for SAFE
     //        return;
     iguana_rwnum(0,&opretbuf[1],sizeof(keylen),&keylen);
@@ -120,26 +309,13 @@ void safecoin_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
     valueptr = &key[keylen];
     
     // resource non-expensive checks first 
-    // first eliminatory check for the exact keyname size: 66 + 7 + 1 = 74 
-    // update: since recent blocks are 7 digits, 75 is also valid key length
-    if (keylen != 74 && keylen != 75)
-		return;
-    
-    std::string str_keyname((char*)key, (int)keylen);
-    std::string parentkey = str_keyname.substr(0, 66);
-    std::string safe_height = str_keyname.substr(66, (keylen == 74) ? 7 : 8);
-    std::string one = str_keyname.substr((keylen == 74) ? 73 : 74, 1);    
-    std::string sid = std::string((char *)valueptr, (int)valuesize);
-    
-    // second eliminatory check for the exact keyname termination character: 1
-    if (one != "1")
+    // exact keyname size: 66 + 7 + 1 = 74, or 75 since recent blocks have 8 digit heights,
+    // and the exact keyname termination character: 1
+    if ( safecoin_kvparsekey(parentkey33,&regheight,&regtype,key,keylen) < 0 )
 		return;
     
-    // third eliminatory check for the parent pubkey validity 
-    std::vector<std::string> vs_notaries = vs_safecoin_notaries(height, 0);
-    std::vector<std::string>::iterator it;
-    it = find (vs_notaries.begin(), vs_notaries.end(), parentkey);
-    if (it == vs_notaries.end())
+    // then the parent pubkey validity 
+    if ( !safecoin_notaryset(height, 0)->IsNotary(parentkey33) )
 		return;
     
     // initial checks passed, keep going
@@ -224,6 +400,7 @@ void safecoin_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
             {
 				// COLLATERAL CHECK
 				
+				std::string sid = std::string((char *)valueptr, (int)valuesize);
 				std::string safeid_address = str_safe_address(sid);
 		
 				// Check if address index is enabled
@@ -348,6 +525,35 @@ void safecoin_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
 			memcpy(&ptr->pubkey,&pubkey,sizeof(ptr->pubkey));
 			ptr->height = height;
 			ptr->flags = flags; // jl777 used to or in KVPROTECTED
+			memcpy(ptr->parentkey33,parentkey33,sizeof(ptr->parentkey33));
+			ptr->regheight = regheight;
+			ptr->regtype = regtype;
+			safecoin_kvwheel_add(ptr);
+			if ( (ptr->hassafekey= (ptr->valuesize == 66 && safecoin_kvislowerhex(ptr->value,66) != 0)) != 0 )
+			{
+				for (i=0; i<33; i++)
+					ptr->safekey33[i] = _decode_hex((char *)&ptr->value[i*2]);
+			} else memset(ptr->safekey33,0,sizeof(ptr->safekey33));
+            
+            // keep the SafeNode registry in step with the record as it is now stored
+            CSafeNodeRegistration reg;
+            std::string parentkey = HexStr(parentkey33,parentkey33+33);
+            if ( ptr->valuesize == 66 )
+            {
+                int32_t keyheight = regheight;
+                if ( keyheight != height )
+                {
+                    if ( !safecoin_notaryset(keyheight, 0)->IsNotary(parentkey33) )
+                        keyheight = 0;
+                }
+                reg = CSafeNodeRegistration(std::string((char *)ptr->value,66),parentkey,ptr->height,((ptr->flags >> 2) + 1) * SAFECOIN_KVDURATION,keyheight);
+            }
+            // blocks already covered by the on-disk registry are only replayed from safecoinstate
+            if ( psafenodes == 0 || blockheight > psafenodes->GetBestHeight() )
+            {
+                safenodeRegistry.Update(std::string((char *)key,keylen),reg,blockheight);
+                safenodeRegistry.PruneUndo(blockheight - (int32_t)MAX_REORG_LENGTH);
+            }
             
             portable_mutex_unlock(&SAFECOIN_KV_mutex);
            
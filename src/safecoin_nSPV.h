@@ -137,6 +137,36 @@ void NSPV_utxosresp_copy(struct NSPV_utxosresp *dest,struct NSPV_utxosresp *ptr)
     }
 }
 
+int32_t NSPV_rwpagecursor(int32_t rwflag,uint8_t *serialized,struct NSPV_pagecursor *ptr)
+{
+    int32_t len = 0;
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->valid),&ptr->valid);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->height),&ptr->height);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->txindex),&ptr->txindex);
+    len += iguana_rwbignum(rwflag,&serialized[len],sizeof(ptr->txid),(uint8_t *)&ptr->txid);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->vout),&ptr->vout);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->spending),&ptr->spending);
+    return(len);
+}
+
+int32_t NSPV_rwutxospageresp(int32_t rwflag,uint8_t *serialized,struct NSPV_utxospageresp *ptr)
+{
+    int32_t len = 0;
+    len += NSPV_rwutxosresp(rwflag,&serialized[len],&ptr->U);
+    len += NSPV_rwpagecursor(rwflag,&serialized[len],&ptr->next);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->more),&ptr->more);
+    return(len);
+}
+
+void NSPV_utxospageresp_purge(struct NSPV_utxospageresp *ptr)
+{
+    if ( ptr != 0 )
+    {
+        NSPV_utxosresp_purge(&ptr->U);
+        memset(ptr,0,sizeof(*ptr));
+    }
+}
+
 int32_t NSPV_rwtxidresp(int32_t rwflag,uint8_t *serialized,struct NSPV_txidresp *ptr)
 {
     int32_t len = 0;
@@ -186,6 +216,24 @@ void NSPV_txidsresp_purge(struct NSPV_txidsresp *ptr)
     }
 }
 
+int32_t NSPV_rwtxidspageresp(int32_t rwflag,uint8_t *serialized,struct NSPV_txidspageresp *ptr)
+{
+    int32_t len = 0;
+    len += NSPV_rwtxidsresp(rwflag,&serialized[len],&ptr->T);
+    len += NSPV_rwpagecursor(rwflag,&serialized[len],&ptr->next);
+    len += iguana_rwnum(rwflag,&serialized[len],sizeof(ptr->more),&ptr->more);
+    return(len);
+}
+
+void NSPV_txidspageresp_purge(struct NSPV_txidspageresp *ptr)
+{
+    if ( ptr != 0 )
+    {
+        NSPV_txidsresp_purge(&ptr->T);
+        memset(ptr,0,sizeof(*ptr));
+    }
+}
+
 void NSPV_txidsresp_copy(struct NSPV_txidsresp *dest,struct NSPV_txidsresp *ptr)
 {
     *dest = *ptr;
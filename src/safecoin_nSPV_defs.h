@@ -17,9 +17,10 @@
 #ifndef SAFECOIN_NSPV_DEFSH
 #define SAFECOIN_NSPV_DEFSH
 
-#define NSPV_PROTOCOL_VERSION 0x00000004
+#define NSPV_PROTOCOL_VERSION 0x00000006
 #define NSPV_POLLITERS 200
 #define NSPV_POLLMICROS 50000
+#define NSPV_REQFANOUT 2
 #define NSPV_MAXVINS 64
 #define NSPV_AUTOLOGOUT 777
 #define NSPV_BRANCHID 0x76b809bb
@@ -54,6 +55,21 @@
 #define NSPV_CC_TXIDS 16
 #define NSPV_REMOTERPC 0x14
 #define NSPV_REMOTERPCRESP 0x15
+#define NSPV_UTXOSPAGE 0x16
+#define NSPV_UTXOSPAGERESP 0x17
+#define NSPV_TXIDSPAGE 0x18
+#define NSPV_TXIDSPAGERESP 0x19
+#define NSPV_MAXPAGERECORDS 1024
+#define NSPV_PAGECURSOR_LEN 46
+#define NSPV_BATCH 0x1a
+#define NSPV_BATCHRESP 0x1b
+#define NSPV_MAXBATCH 16
+#define NSPV_BATCH_VERSION 0x00000006
+#define NSPV_SUBSCRIBE 0x1c
+#define NSPV_SUBSCRIBERESP 0x1d
+#define NSPV_NOTIFY_ACK 0
+#define NSPV_NOTIFY_MEMPOOL 1
+#define NSPV_NOTIFY_BLOCK 2
 
 int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int32_t height,CTransaction &tx,uint256 &hashblock,int32_t &txheight,int32_t &currentheight,int64_t extradata,uint32_t tiptime,int64_t &rewardsum);
 UniValue NSPV_spend(char *srcaddr,char *destaddr,int64_t satoshis);
@@ -103,6 +119,28 @@ struct NSPV_txidsresp
     uint16_t numtxids,CCflag;
 };
 
+// position in an address index after the last record of a page, valid == 0 for the first page
+struct NSPV_pagecursor
+{
+    uint256 txid;
+    int32_t height,txindex,vout;
+    uint8_t spending,valid;
+};
+
+struct NSPV_utxospageresp
+{
+    struct NSPV_utxosresp U;
+    struct NSPV_pagecursor next;
+    uint8_t more;
+};
+
+struct NSPV_txidspageresp
+{
+    struct NSPV_txidsresp T;
+    struct NSPV_pagecursor next;
+    uint8_t more;
+};
+
 struct NSPV_mempoolresp
 {
     uint256 *txids;
@@ -21,6 +21,7 @@
 
 #include "notarisationdb.h"
 #include "rpc/server.h"
+#include "trace.h"
 
 static std::map<std::string,bool> nspv_remote_commands =  {{"channelsopen", true},{"channelspayment", true},{"channelsclose", true},{"channelsrefund", true},
 {"channelslist", true},{"channelsinfo", true},{"oraclescreate", true},{"oraclesfund", true},{"oraclesregister", true},{"oraclessubscribe", true}, 
@@ -52,11 +53,31 @@ int32_t NSPV_notarization_find(struct NSPV_ntzargs *args,int32_t height,int32_t
     return(args->ntzheight);
 }
 
+void NSPV_ntzargs_set(struct NSPV_ntzargs *args,const NotarisationIndexEntry &entry)
+{
+    args->txid = entry.txid;
+    args->desttxid = entry.destTxid;
+    args->txidht = entry.txHeight;
+    args->ntzheight = entry.notarisedHeight;
+    if ( entry.notarisedHeight > 0 && entry.notarisedHeight <= chainActive.Height() )
+        args->blockhash = chainActive[entry.notarisedHeight]->GetBlockHash();
+}
+
 int32_t NSPV_notarized_bracket(struct NSPV_ntzargs *prev,struct NSPV_ntzargs *next,int32_t height)
 {
-    uint256 bhash; int32_t txidht,ntzht,nextht,i=0;
+    uint256 bhash; int32_t txidht,ntzht,nextht,i=0; NotarisationIndexEntry P,N;
     memset(prev,0,sizeof(*prev));
     memset(next,0,sizeof(*next));
+    // binary search in the notarisation index, scanning the db is only needed without its height index
+    if ( GetNotarisationBracket((ASSETCHAINS_SYMBOL[0] == 0) ? "SAFE" : ASSETCHAINS_SYMBOL,height,P,N) )
+    {
+        NSPV_ntzargs_set(prev,P);
+        if ( N.notarisedHeight != 0 )
+            NSPV_ntzargs_set(next,N);
+        return(0);
+    }
+    else if ( pnotarisations->HasHeightIndex() )
+        return(-1);
     if ( (ntzht= NSPV_notarization_find(prev,height,-1)) < 0 || ntzht > height || ntzht == 0 )
         return(-1);
     txidht = height+1;
@@ -480,6 +501,105 @@ int32_t NSPV_getaddresstxids(struct NSPV_txidsresp *ptr,char *coinaddr,bool isCC
     return(0);
 }
 
+// address index key of coinaddr, as SetCCunspents and SetCCtxids look it up
+static bool NSPV_addressindexkey(uint160 &hashBytes,int32_t &type,char *coinaddr,bool isCC)
+{
+    std::string addrstr(coinaddr);
+    CBitcoinAddress address(addrstr);
+    return(address.GetIndexKey(hashBytes,type,isCC));
+}
+
+// one page of the unspent outputs after cursor, read straight from the address index
+int32_t NSPV_getaddressutxospage(struct NSPV_utxospageresp *ptr,char *coinaddr,bool isCC,struct NSPV_pagecursor *cursor,int32_t maxrecords)
+{
+    int64_t total = 0,interest = 0; uint32_t locktime; int32_t type,ind = 0,tipheight,txheight; uint160 hashBytes; bool fMore = false;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    if ( maxrecords <= 0 || maxrecords > NSPV_MAXPAGERECORDS )
+        maxrecords = NSPV_MAXPAGERECORDS;
+    if ( NSPV_addressindexkey(hashBytes,type,coinaddr,isCC) == 0 )
+        return(0);
+    CAddressUnspentKey after(type,hashBytes,cursor->txid,cursor->vout);
+    if ( GetAddressUnspent(hashBytes,type,cursor->valid != 0 ? &after : 0,maxrecords,unspentOutputs,fMore) == 0 )
+        return(0);
+    tipheight = chainActive.LastTip()->GetHeight();
+    strncpy(ptr->U.coinaddr,coinaddr,sizeof(ptr->U.coinaddr)-1);
+    ptr->U.CCflag = isCC;
+    ptr->U.nodeheight = tipheight;
+    if ( unspentOutputs.size() > 0 )
+        ptr->U.utxos = (struct NSPV_utxoresp *)calloc(unspentOutputs.size(),sizeof(*ptr->U.utxos));
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    {
+        // outputs spent in the mempool are left out but still move the cursor
+        if ( myIsutxo_spentinmempool(ignoretxid,ignorevin,it->first.txhash,(int32_t)it->first.index) == 0 )
+        {
+            ptr->U.utxos[ind].txid = it->first.txhash;
+            ptr->U.utxos[ind].vout = (int32_t)it->first.index;
+            ptr->U.utxos[ind].satoshis = it->second.satoshis;
+            ptr->U.utxos[ind].height = it->second.blockHeight;
+            if ( ASSETCHAINS_SYMBOL[0] == 0 && it->second.satoshis >= 10*COIN )
+            {
+                ptr->U.utxos[ind].extradata = safecoin_accrued_interest(&txheight,&locktime,ptr->U.utxos[ind].txid,ptr->U.utxos[ind].vout,ptr->U.utxos[ind].height,ptr->U.utxos[ind].satoshis,tipheight);
+                interest += ptr->U.utxos[ind].extradata;
+            }
+            total += it->second.satoshis;
+            ind++;
+        }
+    }
+    ptr->U.numutxos = ind;
+    ptr->U.total = total;
+    ptr->U.interest = interest;
+    ptr->next = *cursor;
+    if ( unspentOutputs.size() > 0 )
+    {
+        ptr->next.valid = 1;
+        ptr->next.txid = unspentOutputs.back().first.txhash;
+        ptr->next.vout = (int32_t)unspentOutputs.back().first.index;
+    }
+    ptr->more = fMore;
+    return((int32_t)(sizeof(ptr->U) + sizeof(*ptr->U.utxos)*ptr->U.numutxos - sizeof(ptr->U.utxos)) + NSPV_PAGECURSOR_LEN + sizeof(ptr->more));
+}
+
+// one page of the address index entries after cursor
+int32_t NSPV_getaddresstxidspage(struct NSPV_txidspageresp *ptr,char *coinaddr,bool isCC,struct NSPV_pagecursor *cursor,int32_t maxrecords)
+{
+    int32_t type,ind = 0; uint160 hashBytes; bool fMore = false;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > txids;
+    if ( maxrecords <= 0 || maxrecords > NSPV_MAXPAGERECORDS )
+        maxrecords = NSPV_MAXPAGERECORDS;
+    if ( NSPV_addressindexkey(hashBytes,type,coinaddr,isCC) == 0 )
+        return(0);
+    CAddressIndexKey after(type,hashBytes,cursor->height,cursor->txindex,cursor->txid,cursor->vout,cursor->spending != 0);
+    if ( GetAddressIndex(hashBytes,type,cursor->valid != 0 ? &after : 0,maxrecords,txids,fMore) == 0 )
+        return(0);
+    strncpy(ptr->T.coinaddr,coinaddr,sizeof(ptr->T.coinaddr)-1);
+    ptr->T.CCflag = isCC;
+    ptr->T.nodeheight = chainActive.LastTip()->GetHeight();
+    if ( txids.size() > 0 )
+        ptr->T.txids = (struct NSPV_txidresp *)calloc(txids.size(),sizeof(*ptr->T.txids));
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=txids.begin(); it!=txids.end(); it++)
+    {
+        ptr->T.txids[ind].txid = it->first.txhash;
+        ptr->T.txids[ind].vout = (int32_t)it->first.index;
+        ptr->T.txids[ind].satoshis = (int64_t)it->second;
+        ptr->T.txids[ind].height = (int64_t)it->first.blockHeight;
+        ind++;
+    }
+    ptr->T.numtxids = ind;
+    ptr->next = *cursor;
+    if ( txids.size() > 0 )
+    {
+        const CAddressIndexKey &last = txids.back().first;
+        ptr->next.valid = 1;
+        ptr->next.height = last.blockHeight;
+        ptr->next.txindex = last.txindex;
+        ptr->next.txid = last.txhash;
+        ptr->next.vout = (int32_t)last.index;
+        ptr->next.spending = last.spending;
+    }
+    ptr->more = fMore;
+    return((int32_t)(sizeof(ptr->T) + sizeof(*ptr->T.txids)*ptr->T.numtxids - sizeof(ptr->T.txids)) + NSPV_PAGECURSOR_LEN + sizeof(ptr->more));
+}
+
 int32_t NSPV_mempoolfuncs(bits256 *satoshisp,int32_t *vindexp,std::vector<uint256> &txids,char *coinaddr,bool isCC,uint8_t funcid,uint256 txid,int32_t vout)
 {
     int32_t num = 0,vini = 0,vouti = 0; uint8_t evalcode=0,func=0;  std::vector<uint8_t> vopret; char destaddr[64];
@@ -545,6 +665,61 @@ int32_t NSPV_mempoolfuncs(bits256 *satoshisp,int32_t *vindexp,std::vector<uint25
         func = (vout >> 8) & 0xff;
     }
     LOCK(mempool.cs);
+    // everything but the whole mempool listing is answered from the mempool indexes, the scan below is left for
+    // an address query on a node without -addressindex
+    if ( funcid == NSPV_MEMPOOL_INMEMPOOL )
+    {
+        if ( mempool.exists(txid) == 0 )
+            return(0);
+        txids.push_back(txid);
+        return(1);
+    }
+    else if ( funcid == NSPV_MEMPOOL_ISSPENT )
+    {
+        std::map<COutPoint, CInPoint>::const_iterator it = mempool.mapNextTx.find(COutPoint(txid,vout));
+        if ( it == mempool.mapNextTx.end() )
+            return(0);
+        txids.push_back(it->second.ptx->GetHash());
+        *vindexp = it->second.n;
+        return(1);
+    }
+    else if ( funcid == NSPV_MEMPOOL_CCEVALCODE )
+    {
+        std::vector<CTransaction> cctxs;
+        mempool.queryCCOpRet(evalcode,func,cctxs);
+        BOOST_FOREACH(const CTransaction &tx,cctxs)
+        {
+            if ( tx.vout.size() > 1 && GetOpReturnData(tx.vout[tx.vout.size()-1].scriptPubKey,vopret) != 0 && vopret.size() > 1 && vopret[0] == evalcode && vopret[1] == func )
+            {
+                txids.push_back(tx.GetHash());
+                num++;
+            }
+        }
+        return(num);
+    }
+    else if ( funcid == NSPV_MEMPOOL_ADDRESS && fAddressIndex )
+    {
+        std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > deltas; uint160 hashBytes; int type; CTransaction tx;
+        if ( !CBitcoinAddress(coinaddr).GetIndexKey(hashBytes,type,isCC) )
+            return(0);
+        mempool.getAddressDeltas(hashBytes,type,deltas);
+        for (int32_t i=0; i<deltas.size(); i++)
+        {
+            const CMempoolAddressDeltaKey &key = deltas[i].first;
+            if ( key.spending != 0 || mempool.lookup(key.txhash,tx) == 0 || key.index >= tx.vout.size() )
+                continue;
+            const CTxOut &txout = tx.vout[key.index];
+            if ( txout.scriptPubKey.IsPayToCryptoCondition() == isCC && Getscriptaddress(destaddr,txout.scriptPubKey) && strcmp(destaddr,coinaddr) == 0 )
+            {
+                txids.push_back(key.txhash);
+                *vindexp = key.index;
+                if ( num < 4 )
+                    satoshisp->ulongs[num] = txout.nValue;
+                num++;
+            }
+        }
+        return(num);
+    }
     BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
     {
         const CTransaction &tx = e.GetTx();
@@ -755,6 +930,50 @@ int32_t NSPV_sendrawtransaction(struct NSPV_broadcastresp *ptr,uint8_t *data,int
     return(sizeof(*ptr));
 }
 
+// complete merkle trees of the most recent blocks, filled from ConnectTip. Wallets mostly ask for proofs of txs that just confirmed,
+// for these the branch is read from the cached tree instead of loading the block and rehashing it
+#define NSPV_MERKLECACHE_BLOCKS 64
+
+struct NSPV_merklecache_entry { CBlockHeader header; std::vector<uint256> tree; std::map<uint256,uint32_t> txpos; uint32_t numtx; };
+static CCriticalSection cs_NSPV_merklecache;
+static std::map<uint256,NSPV_merklecache_entry> NSPV_merklecache;
+static std::deque<uint256> NSPV_merklecache_order;
+
+void NSPV_merklecache_add(const CBlock &block)
+{
+    uint256 hash = block.GetHash(); uint32_t i;
+    if ( block.vMerkleTree.empty() )
+        block.BuildMerkleTree();
+    LOCK(cs_NSPV_merklecache);
+    if ( NSPV_merklecache.count(hash) != 0 )
+        return;
+    NSPV_merklecache_entry &entry = NSPV_merklecache[hash];
+    entry.header = block.GetBlockHeader();
+    entry.tree = block.vMerkleTree;
+    entry.numtx = (uint32_t)block.vtx.size();
+    for (i=0; i<entry.numtx; i++)
+        entry.txpos[entry.tree[i]] = i;
+    NSPV_merklecache_order.push_back(hash);
+    while ( NSPV_merklecache_order.size() > NSPV_MERKLECACHE_BLOCKS )
+    {
+        NSPV_merklecache.erase(NSPV_merklecache_order.front());
+        NSPV_merklecache_order.pop_front();
+    }
+}
+
+int32_t NSPV_merklecache_proof(std::vector<uint8_t> &proof,uint256 blockhash,uint256 txid)
+{
+    std::map<uint256,NSPV_merklecache_entry>::iterator it; std::map<uint256,uint32_t>::iterator pos;
+    LOCK(cs_NSPV_merklecache);
+    if ( (it= NSPV_merklecache.find(blockhash)) == NSPV_merklecache.end() || (pos= it->second.txpos.find(txid)) == it->second.txpos.end() )
+        return(0);
+    CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION);
+    CMerkleBlock mb(it->second.header,it->second.tree,it->second.numtx,pos->second);
+    ssMB << mb;
+    proof.assign(ssMB.begin(),ssMB.end());
+    return(1);
+}
+
 int32_t NSPV_gettxproof(struct NSPV_txproof *ptr,int32_t vout,uint256 txid,int32_t height)
 {
     int32_t flag = 0,len = 0; CTransaction _tx; uint256 hashBlock; CBlock block; CBlockIndex *pindex;
@@ -768,8 +987,9 @@ int32_t NSPV_gettxproof(struct NSPV_txproof *ptr,int32_t vout,uint256 txid,int32
             ptr->height = safecoin_blockheight(hashBlock);
         else
         {
+            std::vector<uint8_t> proof;
             ptr->height = height;
-            if ( (pindex= safecoin_chainactive(height)) != 0 && safecoin_blockload(block,pindex) == 0 )
+            if ( (pindex= safecoin_chainactive(height)) != 0 && NSPV_merklecache_proof(proof,pindex->GetBlockHash(),txid) == 0 && safecoin_blockload(block,pindex) == 0 )
             {
                 BOOST_FOREACH(const CTransaction&tx, block.vtx)
                 {
@@ -786,17 +1006,17 @@ int32_t NSPV_gettxproof(struct NSPV_txproof *ptr,int32_t vout,uint256 txid,int32
                     setTxids.insert(txid);
                     CMerkleBlock mb(block, setTxids);
                     ssMB << mb;
-                    std::vector<uint8_t> proof(ssMB.begin(), ssMB.end());
-                    ptr->txprooflen = (int32_t)proof.size();
-                    //fprintf(stderr,"%s txproof.(%s)\n",txid.GetHex().c_str(),HexStr(proof).c_str());
-                    if ( ptr->txprooflen > 0 )
-                    {
-                        ptr->txproof = (uint8_t *)calloc(1,ptr->txprooflen);
-                        memcpy(ptr->txproof,&proof[0],ptr->txprooflen);
-                    }
-                    //fprintf(stderr,"gettxproof slen.%d\n",(int32_t)(sizeof(*ptr) - sizeof(ptr->tx) - sizeof(ptr->txproof) + ptr->txlen + ptr->txprooflen));
+                    proof.assign(ssMB.begin(), ssMB.end());
                 }
             }
+            ptr->txprooflen = (int32_t)proof.size();
+            //fprintf(stderr,"%s txproof.(%s)\n",txid.GetHex().c_str(),HexStr(proof).c_str());
+            if ( ptr->txprooflen > 0 )
+            {
+                ptr->txproof = (uint8_t *)calloc(1,ptr->txprooflen);
+                memcpy(ptr->txproof,&proof[0],ptr->txprooflen);
+            }
+            //fprintf(stderr,"gettxproof slen.%d\n",(int32_t)(sizeof(*ptr) - sizeof(ptr->tx) - sizeof(ptr->txproof) + ptr->txlen + ptr->txprooflen));
         }
         ptr->unspentvalue = CCgettxout(txid,vout,1,1);
     }
@@ -867,15 +1087,176 @@ int32_t NSPV_getspentinfo(struct NSPV_spentinfo *ptr,uint256 txid,int32_t vout)
     return(len);
 }
 
-void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a request
+// serialized responses by request bytes, shared by all peers. Everything is dropped when the tip changes,
+// responses that also look at the mempool are only reused while it is unchanged.
+#define NSPV_RESPCACHE_MAXBYTES (32 << 20)
+
+struct NSPV_respcache_entry { uint32_t mempoolupdates; std::vector<uint8_t> response; };
+static CCriticalSection cs_NSPV_respcache;
+static std::map<std::vector<uint8_t>,NSPV_respcache_entry> NSPV_respcache;
+static uint256 NSPV_respcache_tip;
+static int64_t NSPV_respcache_bytes;
+
+static bool NSPV_respcache_usesmempool(uint8_t reqtype)
+{
+    return(reqtype == NSPV_UTXOS || reqtype == NSPV_UTXOSPAGE || reqtype == NSPV_TXPROOF);
+}
+
+static bool NSPV_respcache_iscacheable(uint8_t reqtype)
+{
+    return(reqtype == NSPV_INFO || reqtype == NSPV_NTZS || reqtype == NSPV_NTZSPROOF || reqtype == NSPV_TXIDSPAGE || NSPV_respcache_usesmempool(reqtype));
+}
+
+// caller holds cs_NSPV_respcache
+static void NSPV_respcache_checktip()
+{
+    CBlockIndex *pindex; uint256 tip;
+    if ( (pindex= chainActive.LastTip()) != 0 )
+        tip = pindex->GetBlockHash();
+    if ( tip != NSPV_respcache_tip )
+    {
+        NSPV_respcache.clear();
+        NSPV_respcache_bytes = 0;
+        NSPV_respcache_tip = tip;
+    }
+}
+
+bool NSPV_respcache_get(const std::vector<uint8_t> &request,std::vector<uint8_t> &response)
+{
+    std::map<std::vector<uint8_t>,NSPV_respcache_entry>::iterator it;
+    if ( request.empty() || NSPV_respcache_iscacheable(request[0]) == 0 )
+        return(false);
+    LOCK(cs_NSPV_respcache);
+    NSPV_respcache_checktip();
+    if ( (it= NSPV_respcache.find(request)) == NSPV_respcache.end() )
+        return(false);
+    if ( NSPV_respcache_usesmempool(request[0]) && it->second.mempoolupdates != mempool.GetTransactionsUpdated() )
+    {
+        NSPV_respcache_bytes -= request.size() + it->second.response.size();
+        NSPV_respcache.erase(it);
+        return(false);
+    }
+    response = it->second.response;
+    return(true);
+}
+
+void NSPV_respcache_add(const std::vector<uint8_t> &request,const std::vector<uint8_t> &response)
+{
+    if ( request.empty() || NSPV_respcache_iscacheable(request[0]) == 0 )
+        return;
+    LOCK(cs_NSPV_respcache);
+    NSPV_respcache_checktip();
+    if ( NSPV_respcache.count(request) != 0 || NSPV_respcache_bytes + request.size() + response.size() > NSPV_RESPCACHE_MAXBYTES )
+        return;
+    NSPV_respcache_entry &entry = NSPV_respcache[request];
+    entry.mempoolupdates = mempool.GetTransactionsUpdated();
+    entry.response = response;
+    NSPV_respcache_bytes += request.size() + response.size();
+}
+
+// superlite wallets register a bloom filter (as in filterload) with NSPV_SUBSCRIBE, then every mempool or newly confirmed tx
+// matching it is pushed as NSPV_SUBSCRIBERESP [kind][height][txid][txlen][tx], so they dont need to poll for new activity
+#define NSPV_MAXSUBSCRIBERS 4096
+
+static CCriticalSection cs_NSPV_subscribers;
+static std::map<NodeId,CBloomFilter> NSPV_subscribers;
+
+void NSPV_notifymsg(std::vector<uint8_t> &msg,uint8_t kind,int32_t height,const CTransaction *tx)
+{
+    uint256 txid; int32_t txlen,n = 0; CDataStream ss(SER_NETWORK,PROTOCOL_VERSION);
+    if ( tx != 0 )
+    {
+        txid = tx->GetHash();
+        ss << *tx;
+    }
+    txlen = (int32_t)ss.size();
+    msg.resize(1 + 1 + sizeof(height) + sizeof(txid) + sizeof(txlen) + txlen);
+    msg[n++] = NSPV_SUBSCRIBERESP;
+    msg[n++] = kind;
+    n += iguana_rwnum(1,&msg[n],sizeof(height),&height);
+    n += iguana_rwbignum(1,&msg[n],sizeof(txid),(uint8_t *)&txid);
+    n += iguana_rwnum(1,&msg[n],sizeof(txlen),&txlen);
+    if ( txlen > 0 )
+        memcpy(&msg[n],&ss[0],txlen);
+}
+
+int32_t NSPV_subscribe(CNode *pfrom,std::vector<uint8_t> &request)
+{
+    CBloomFilter filter;
+    try
+    {
+        CDataStream ss(std::vector<unsigned char>(request.begin()+1,request.end()),SER_NETWORK,PROTOCOL_VERSION);
+        ss >> filter;
+    } catch (const std::exception &e) { return(-1); }
+    if ( !filter.IsWithinSizeConstraints() )
+        return(-1);
+    filter.UpdateEmptyFull();
+    LOCK(cs_NSPV_subscribers);
+    if ( NSPV_subscribers.count(pfrom->id) == 0 && NSPV_subscribers.size() >= NSPV_MAXSUBSCRIBERS )
+        return(-1);
+    NSPV_subscribers[pfrom->id] = filter;
+    return(0);
+}
+
+// called with cs_main held, from AcceptToMemoryPool (height 0) and ConnectTip
+void NSPV_notifytxs(const std::vector<CTransaction> &txs,int32_t height)
+{
+    std::map<NodeId,CNode *> nodes; std::map<NodeId,CBloomFilter>::iterator it; std::vector<uint8_t> msg; int32_t i;
+    LOCK(cs_NSPV_subscribers);
+    if ( NSPV_subscribers.empty() )
+        return;
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode *pnode,vNodes)
+            nodes[pnode->id] = pnode;
+        for (it=NSPV_subscribers.begin(); it!=NSPV_subscribers.end(); )
+        {
+            if ( nodes.count(it->first) == 0 ) // peer is gone
+            {
+                NSPV_subscribers.erase(it++);
+                continue;
+            }
+            for (i=0; i<txs.size(); i++)
+                if ( it->second.IsRelevantAndUpdate(txs[i]) )
+                {
+                    NSPV_notifymsg(msg,height == 0 ? NSPV_NOTIFY_MEMPOOL : NSPV_NOTIFY_BLOCK,height,&txs[i]);
+                    nodes[it->first]->PushMessage("nSPV",msg);
+                }
+            it++;
+        }
+    }
+}
+
+void NSPV_notifytx(const CTransaction &tx)
+{
+    NSPV_notifytxs(std::vector<CTransaction>(1,tx),0);
+}
+
+// responses are pushed to the peer directly, or collected when answering the parts of an NSPV_BATCH
+
+void NSPV_sendresp(CNode *pfrom,const std::vector<uint8_t> &response,std::vector<std::vector<uint8_t> > *batch)
+{
+    if ( batch != 0 )
+        batch->push_back(response);
+    else pfrom->PushMessage("nSPV",response);
+}
+
+void NSPV_answer(CNode *pfrom,std::vector<uint8_t> request,std::vector<std::vector<uint8_t> > *batch)
 {
     int32_t len,slen,ind,reqheight,n; std::vector<uint8_t> response; uint32_t timestamp = (uint32_t)time(NULL);
     if ( (len= request.size()) > 0 )
     {
         if ( (ind= request[0]>>1) >= sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes) )
             ind = (int32_t)(sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes)) - 1;
-        if ( pfrom->prevtimes[ind] > timestamp )
+        if ( pfrom->prevtimes[ind] > timestamp || batch != 0 ) // a batch is rate limited as a whole
             pfrom->prevtimes[ind] = 0;
+        // the same request from many wallets within a block is answered once
+        if ( timestamp > pfrom->prevtimes[ind] && NSPV_respcache_get(request,response) )
+        {
+            NSPV_sendresp(pfrom,response,batch);
+            pfrom->prevtimes[ind] = timestamp;
+            return;
+        }
         if ( request[0] == NSPV_INFO ) // info
         {
             //fprintf(stderr,"check info %u vs %u, ind.%d\n",timestamp,pfrom->prevtimes[ind],ind);
@@ -895,7 +1276,8 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                     if ( NSPV_rwinforesp(1,&response[1],&I) == slen )
                     {
                         //fprintf(stderr,"send info resp to id %d\n",(int32_t)pfrom->id);
-                        pfrom->PushMessage("nSPV",response);
+                        NSPV_sendresp(pfrom,response,batch);
+                        NSPV_respcache_add(request,response);
                         pfrom->prevtimes[ind] = timestamp;
                     }
                     NSPV_inforesp_purge(&I);
@@ -935,7 +1317,8 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                         response[0] = NSPV_UTXOSRESP;
                         if ( NSPV_rwutxosresp(1,&response[1],&U) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
+                            NSPV_sendresp(pfrom,response,batch);
+                            NSPV_respcache_add(request,response);
                             pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_utxosresp_purge(&U);
@@ -976,7 +1359,7 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                         response[0] = NSPV_TXIDSRESP;
                         if ( NSPV_rwtxidsresp(1,&response[1],&T) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
+                            NSPV_sendresp(pfrom,response,batch);
                             pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_txidsresp_purge(&T);
@@ -984,6 +1367,58 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                 } else fprintf(stderr,"len.%d req1.%d\n",len,request[1]);
             }
         }
+        else if ( request[0] == NSPV_UTXOSPAGE || request[0] == NSPV_TXIDSPAGE )
+        {
+            if ( timestamp > pfrom->prevtimes[ind] )
+            {
+                // [addrlen][coinaddr][isCC][cursor][maxrecords]
+                if ( len > 2 && request[1] < 64 && len == 2+request[1]+1+NSPV_PAGECURSOR_LEN+sizeof(uint16_t) )
+                {
+                    char coinaddr[64]; uint8_t isCC; uint16_t maxrecords; struct NSPV_pagecursor cursor;
+                    n = 2;
+                    memcpy(coinaddr,&request[n],request[1]), n += request[1];
+                    coinaddr[request[1]] = 0;
+                    isCC = (request[n++] != 0);
+                    memset(&cursor,0,sizeof(cursor));
+                    n += NSPV_rwpagecursor(0,&request[n],&cursor);
+                    n += iguana_rwnum(0,&request[n],sizeof(maxrecords),&maxrecords);
+                    if ( request[0] == NSPV_UTXOSPAGE )
+                    {
+                        struct NSPV_utxospageresp U;
+                        memset(&U,0,sizeof(U));
+                        if ( (slen= NSPV_getaddressutxospage(&U,coinaddr,isCC,&cursor,maxrecords)) > 0 )
+                        {
+                            response.resize(1 + slen);
+                            response[0] = NSPV_UTXOSPAGERESP;
+                            if ( NSPV_rwutxospageresp(1,&response[1],&U) == slen )
+                            {
+                                NSPV_sendresp(pfrom,response,batch);
+                                NSPV_respcache_add(request,response);
+                                pfrom->prevtimes[ind] = timestamp;
+                            }
+                        }
+                        NSPV_utxospageresp_purge(&U);
+                    }
+                    else
+                    {
+                        struct NSPV_txidspageresp T;
+                        memset(&T,0,sizeof(T));
+                        if ( (slen= NSPV_getaddresstxidspage(&T,coinaddr,isCC,&cursor,maxrecords)) > 0 )
+                        {
+                            response.resize(1 + slen);
+                            response[0] = NSPV_TXIDSPAGERESP;
+                            if ( NSPV_rwtxidspageresp(1,&response[1],&T) == slen )
+                            {
+                                NSPV_sendresp(pfrom,response,batch);
+                                NSPV_respcache_add(request,response);
+                                pfrom->prevtimes[ind] = timestamp;
+                            }
+                        }
+                        NSPV_txidspageresp_purge(&T);
+                    }
+                } else fprintf(stderr,"page reqlen.%d\n",len);
+            }
+        }
         else if ( request[0] == NSPV_MEMPOOL )
         {
             if ( timestamp > pfrom->prevtimes[ind] )
@@ -1012,7 +1447,7 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                             response[0] = NSPV_MEMPOOLRESP;
                             if ( NSPV_rwmempoolresp(1,&response[1],&M) == slen )
                             {
-                                pfrom->PushMessage("nSPV",response);
+                                NSPV_sendresp(pfrom,response,batch);
                                 pfrom->prevtimes[ind] = timestamp;
                             }
                             NSPV_mempoolresp_purge(&M);
@@ -1036,7 +1471,8 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                         response[0] = NSPV_NTZSRESP;
                         if ( NSPV_rwntzsresp(1,&response[1],&N) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
+                            NSPV_sendresp(pfrom,response,batch);
+                            NSPV_respcache_add(request,response);
                             pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_ntzsresp_purge(&N);
@@ -1061,7 +1497,8 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                         response[0] = NSPV_NTZSPROOFRESP;
                         if ( NSPV_rwntzsproofresp(1,&response[1],&P) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
+                            NSPV_sendresp(pfrom,response,batch);
+                            NSPV_respcache_add(request,response);
                             pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_ntzsproofresp_purge(&P);
@@ -1089,7 +1526,8 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                         if ( NSPV_rwtxproof(1,&response[1],&P) == slen )
                         {
                             //fprintf(stderr,"send response\n");
-                            pfrom->PushMessage("nSPV",response);
+                            NSPV_sendresp(pfrom,response,batch);
+                            NSPV_respcache_add(request,response);
                             pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_txproof_purge(&P);
@@ -1113,7 +1551,7 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                         response[0] = NSPV_SPENTINFORESP;
                         if ( NSPV_rwspentinfo(1,&response[1],&S) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
+                            NSPV_sendresp(pfrom,response,batch);
                             pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_spentinfo_purge(&S);
@@ -1138,7 +1576,7 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                         response[0] = NSPV_BROADCASTRESP;
                         if ( NSPV_rwbroadcastresp(1,&response[1],&B) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
+                            NSPV_sendresp(pfrom,response,batch);
                             pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_broadcast_purge(&B);
@@ -1146,6 +1584,15 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                 }
             }
         }
+        else if ( request[0] == NSPV_SUBSCRIBE )
+        {
+            if ( timestamp > pfrom->prevtimes[ind] && len > 1 && NSPV_subscribe(pfrom,request) == 0 )
+            {
+                NSPV_notifymsg(response,NSPV_NOTIFY_ACK,chainActive.Height(),0);
+                NSPV_sendresp(pfrom,response,batch);
+                pfrom->prevtimes[ind] = timestamp;
+            }
+        }
         else if ( request[0] == NSPV_REMOTERPC )
         {
             if ( timestamp > pfrom->prevtimes[ind] )
@@ -1159,7 +1606,7 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                     response.resize(1 + slen);
                     response[0] = NSPV_REMOTERPCRESP;
                     NSPV_rwremoterpcresp(1,&response[1],&R,slen);
-                    pfrom->PushMessage("nSPV",response);
+                    NSPV_sendresp(pfrom,response,batch);
                     pfrom->prevtimes[ind] = timestamp;
                     NSPV_remoterpc_purge(&R);
                 }                
@@ -1213,7 +1660,7 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
                                 response[0] = NSPV_CCMODULEUTXOSRESP;
                                 if (NSPV_rwutxosresp(1, &response[1], &U) == slen)
                                 {
-                                    pfrom->PushMessage("nSPV", response);
+                                    NSPV_sendresp(pfrom, response, batch);
                                     pfrom->prevtimes[ind] = timestamp;
                                     std::cerr << __func__ << " " << "returned nSPV response" << std::endl;
                                 }
@@ -1227,4 +1674,58 @@ void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a r
     }
 }
 
+// NSPV_BATCH carries [n] then n times [len][subrequest], the answer is a single NSPV_BATCHRESP of [n] then n times [len][subresponse]
+// a subrequest that is not answered gets a zero len entry, a subresponse that doesnt fit the envelope is pushed by itself instead
+
+void NSPV_batchreq(CNode *pfrom,std::vector<uint8_t> request)
+{
+    std::vector<std::vector<uint8_t> > subresps; std::vector<uint8_t> subreq,response; int32_t i,n,num,sublen,len,ind = NSPV_BATCH>>1,maxlen = MAX_PROTOCOL_MESSAGE_LENGTH - 4096; uint32_t timestamp = (uint32_t)time(NULL);
+    if ( pfrom->prevtimes[ind] > timestamp )
+        pfrom->prevtimes[ind] = 0;
+    if ( timestamp <= pfrom->prevtimes[ind] || (len= request.size()) < 2 || (num= request[1]) == 0 || num > NSPV_MAXBATCH )
+        return;
+    response.resize(2);
+    response[0] = NSPV_BATCHRESP;
+    response[1] = num;
+    for (i=0,n=2; i<num; i++)
+    {
+        if ( n+sizeof(sublen) > len )
+            return;
+        n += iguana_rwnum(0,&request[n],sizeof(sublen),&sublen);
+        if ( sublen < 0 || n+sublen > len )
+            return;
+        subresps.clear();
+        if ( sublen > 0 && request[n] != NSPV_BATCH )
+        {
+            subreq.assign(request.begin()+n,request.begin()+n+sublen);
+            NSPV_answer(pfrom,subreq,&subresps);
+        }
+        n += sublen;
+        sublen = 0;
+        if ( subresps.size() == 1 )
+        {
+            if ( response.size() + sizeof(sublen) + subresps[0].size() > maxlen )
+                pfrom->PushMessage("nSPV",subresps[0]);
+            else sublen = (int32_t)subresps[0].size();
+        }
+        response.resize(response.size() + sizeof(sublen) + sublen);
+        iguana_rwnum(1,&response[response.size() - sublen - sizeof(sublen)],sizeof(sublen),&sublen);
+        if ( sublen > 0 )
+            memcpy(&response[response.size() - sublen],&subresps[0][0],sublen);
+    }
+    pfrom->PushMessage("nSPV",response);
+    pfrom->prevtimes[ind] = timestamp;
+}
+
+void safecoin_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a request
+{
+    uint8_t reqtype = request.size() > 0 ? request[0] : 0;
+    nspvRequests.increment();
+    TRACE3(nspv, request_start, pfrom->id, reqtype, request.size());
+    if ( reqtype == NSPV_BATCH )
+        NSPV_batchreq(pfrom,request);
+    else NSPV_answer(pfrom,request,0);
+    TRACE2(nspv, request_finish, pfrom->id, reqtype);
+}
+
 #endif // SAFECOIN_NSPVFULLNODE_H
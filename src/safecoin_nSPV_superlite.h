@@ -128,6 +128,182 @@ struct NSPV_ntzsproofresp *NSPV_ntzsproof_add(struct NSPV_ntzsproofresp *ptr)
     return(&NSPV_ntzsproofresp_cache[i]);
 }
 
+// request functions block on NSPV_respcond until a response was handled or their deadline passes, instead of polling the result structs
+// a request without a specific peer goes to NSPV_REQFANOUT peers and only the first of their responses is used
+
+boost::mutex NSPV_respmutex; boost::condition_variable NSPV_respcond; uint64_t NSPV_respseq;
+uint8_t NSPV_reqcopies[128],NSPV_reqanswered[128];
+
+struct NSPV_waiter
+{
+    uint64_t seq; int64_t deadline;
+    NSPV_waiter() : seq(0), deadline(GetTimeMicros() + (int64_t)NSPV_POLLITERS * NSPV_POLLMICROS) {}
+
+    // the first call returns at once so a response that is already in is seen
+    bool wait()
+    {
+        int64_t now;
+        boost::unique_lock<boost::mutex> lock(NSPV_respmutex);
+        while ( seq == NSPV_respseq + 1 )
+        {
+            if ( (now= GetTimeMicros()) >= deadline )
+                return(false);
+            NSPV_respcond.timed_wait(lock,boost::posix_time::microseconds(deadline - now));
+        }
+        seq = NSPV_respseq + 1;
+        return(true);
+    }
+};
+
+void NSPV_reqsent(uint8_t reqtype,int32_t copies)
+{
+    boost::unique_lock<boost::mutex> lock(NSPV_respmutex);
+    NSPV_reqcopies[reqtype >> 1] = copies;
+    NSPV_reqanswered[reqtype >> 1] = 0;
+}
+
+bool NSPV_respduplicate(uint8_t resptype)
+{
+    boost::unique_lock<boost::mutex> lock(NSPV_respmutex);
+    return(NSPV_reqcopies[resptype >> 1] > 1 && NSPV_reqanswered[resptype >> 1]++ != 0);
+}
+
+void NSPV_respnotify()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(NSPV_respmutex);
+        NSPV_respseq++;
+    }
+    NSPV_respcond.notify_all();
+}
+
+// notarization brackets, headers proofs and txproofs also go to an append only file in the datadir so a restart doesnt refetch them
+// each record is [type][len][crc32] followed by the response as it came from the network, the file is rewritten from the memory caches when it outgrows NSPV_DISKCACHE_MAXBYTES
+
+#define NSPV_DISKCACHE_MAXBYTES (16 << 20)
+#define NSPV_DISKCACHE_HDRSIZE (1 + sizeof(int32_t) + sizeof(uint32_t))
+
+int32_t NSPV_diskcache_loaded; long NSPV_diskcache_bytes;
+
+std::string NSPV_diskcache_fname()
+{
+    return((GetDataDir() / "nspvcache.dat").string());
+}
+
+int32_t NSPV_diskcache_write(FILE *fp,uint8_t type,uint8_t *data,int32_t len)
+{
+    uint8_t hdr[NSPV_DISKCACHE_HDRSIZE]; uint32_t crc32; int32_t n = 0;
+    crc32 = calc_crc32(0,data,len);
+    hdr[n++] = type;
+    n += iguana_rwnum(1,&hdr[n],sizeof(len),&len);
+    n += iguana_rwnum(1,&hdr[n],sizeof(crc32),&crc32);
+    if ( fwrite(hdr,1,n,fp) != n || fwrite(data,1,len,fp) != len )
+        return(-1);
+    NSPV_diskcache_bytes += n + len;
+    return(0);
+}
+
+int32_t NSPV_diskcache_rewrite()
+{
+    FILE *fp; std::vector<uint8_t> data; int32_t i,len;
+    if ( (fp= fopen(NSPV_diskcache_fname().c_str(),"wb")) == 0 )
+        return(-1);
+    NSPV_diskcache_bytes = 0;
+    for (i=0; i<sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache); i++)
+    {
+        if ( NSPV_ntzsresp_cache[i].reqheight == 0 || NSPV_ntzsresp_cache[i].nextntz.txid.IsNull() )
+            continue;
+        data.resize(2 * sizeof(NSPV_ntzsresp_cache[i]));
+        len = NSPV_rwntzsresp(1,&data[0],&NSPV_ntzsresp_cache[i]);
+        if ( NSPV_diskcache_bytes + NSPV_DISKCACHE_HDRSIZE + len <= NSPV_DISKCACHE_MAXBYTES/2 )
+            NSPV_diskcache_write(fp,NSPV_NTZSRESP,&data[0],len);
+    }
+    for (i=0; i<sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache); i++)
+    {
+        struct NSPV_ntzsproofresp *ptr = &NSPV_ntzsproofresp_cache[i];
+        if ( ptr->common.hdrs == 0 )
+            continue;
+        data.resize(sizeof(*ptr) + ptr->common.numhdrs * sizeof(*ptr->common.hdrs) + ptr->prevtxlen + ptr->nexttxlen);
+        len = NSPV_rwntzsproofresp(1,&data[0],ptr);
+        if ( NSPV_diskcache_bytes + NSPV_DISKCACHE_HDRSIZE + len <= NSPV_DISKCACHE_MAXBYTES/2 )
+            NSPV_diskcache_write(fp,NSPV_NTZSPROOFRESP,&data[0],len);
+    }
+    for (i=0; i<sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache); i++)
+    {
+        struct NSPV_txproof *ptr = &NSPV_txproof_cache[i];
+        if ( ptr->txlen == 0 || ptr->txprooflen == 0 )
+            continue;
+        data.resize(sizeof(*ptr) + ptr->txlen + ptr->txprooflen);
+        len = NSPV_rwtxproof(1,&data[0],ptr);
+        if ( NSPV_diskcache_bytes + NSPV_DISKCACHE_HDRSIZE + len <= NSPV_DISKCACHE_MAXBYTES/2 )
+            NSPV_diskcache_write(fp,NSPV_TXPROOFRESP,&data[0],len);
+    }
+    fclose(fp);
+    return(0);
+}
+
+void NSPV_diskcache_add(uint8_t type,uint8_t *data,int32_t len)
+{
+    FILE *fp;
+    if ( NSPV_diskcache_loaded == 0 || len <= 0 )
+        return;
+    if ( NSPV_diskcache_bytes + NSPV_DISKCACHE_HDRSIZE + len > NSPV_DISKCACHE_MAXBYTES )
+        NSPV_diskcache_rewrite(); // the memory caches already contain this record
+    else if ( (fp= fopen(NSPV_diskcache_fname().c_str(),"ab")) != 0 )
+    {
+        NSPV_diskcache_write(fp,type,data,len);
+        fclose(fp);
+    }
+}
+
+void NSPV_diskcache_load()
+{
+    FILE *fp; std::vector<uint8_t> data; uint8_t hdr[NSPV_DISKCACHE_HDRSIZE],type; uint32_t crc32; int32_t n,len,torn,num = 0;
+    NSPV_diskcache_loaded = 1;
+    NSPV_diskcache_bytes = 0;
+    if ( (fp= fopen(NSPV_diskcache_fname().c_str(),"rb")) == 0 )
+        return;
+    while ( fread(hdr,1,sizeof(hdr),fp) == sizeof(hdr) )
+    {
+        n = 0;
+        type = hdr[n++];
+        n += iguana_rwnum(0,&hdr[n],sizeof(len),&len);
+        n += iguana_rwnum(0,&hdr[n],sizeof(crc32),&crc32);
+        if ( len <= 0 || len > MAX_PROTOCOL_MESSAGE_LENGTH )
+            break;
+        data.resize(len);
+        if ( fread(&data[0],1,len,fp) != len || calc_crc32(0,&data[0],len) != crc32 )
+            break; // torn write at the end of the file
+        if ( type == NSPV_NTZSRESP )
+        {
+            struct NSPV_ntzsresp N; memset(&N,0,sizeof(N));
+            if ( NSPV_rwntzsresp(0,&data[0],&N) == len && NSPV_ntzsresp_find(N.reqheight) == 0 )
+                NSPV_ntzsresp_add(&N);
+        }
+        else if ( type == NSPV_NTZSPROOFRESP )
+        {
+            struct NSPV_ntzsproofresp P; memset(&P,0,sizeof(P));
+            if ( NSPV_rwntzsproofresp(0,&data[0],&P) == len && NSPV_ntzsproof_find(P.prevtxid,P.nexttxid) == 0 )
+                NSPV_ntzsproof_add(&P);
+            NSPV_ntzsproofresp_purge(&P);
+        }
+        else if ( type == NSPV_TXPROOFRESP )
+        {
+            struct NSPV_txproof T; memset(&T,0,sizeof(T));
+            if ( NSPV_rwtxproof(0,&data[0],&T) == len && NSPV_txproof_find(T.txid) == 0 )
+                NSPV_txproof_add(&T);
+            NSPV_txproof_purge(&T);
+        }
+        NSPV_diskcache_bytes += sizeof(hdr) + len;
+        num++;
+    }
+    torn = (feof(fp) == 0);
+    fclose(fp);
+    fprintf(stderr,"loaded %d nSPV cache records from %s\n",num,NSPV_diskcache_fname().c_str());
+    if ( torn != 0 || NSPV_diskcache_bytes > NSPV_DISKCACHE_MAXBYTES/2 )
+        NSPV_diskcache_rewrite();
+}
+
 // safecoin_nSPVresp is called from async message processing
 
 void safecoin_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a response
@@ -136,6 +312,8 @@ void safecoin_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a
     strncpy(NSPV_lastpeer,pfrom->addr.ToString().c_str(),sizeof(NSPV_lastpeer)-1);
     if ( (len= response.size()) > 0 )
     {
+        if ( NSPV_respduplicate(response[0]) )
+            return; // a faster peer already answered
         switch ( response[0] )
         {
             case NSPV_INFORESP:
@@ -176,21 +354,32 @@ void safecoin_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a
                 NSPV_ntzsresp_purge(&NSPV_ntzsresult);
                 NSPV_rwntzsresp(0,&response[1],&NSPV_ntzsresult);
                 if ( NSPV_ntzsresp_find(NSPV_ntzsresult.reqheight) == 0 )
+                {
                     NSPV_ntzsresp_add(&NSPV_ntzsresult);
+                    if ( NSPV_ntzsresult.nextntz.txid.IsNull() == 0 ) // an open bracket can still change
+                        NSPV_diskcache_add(NSPV_NTZSRESP,&response[1],len-1);
+                }
                 fprintf(stderr,"got ntzs response %u size.%d %s prev.%d, %s next.%d\n",timestamp,(int32_t)response.size(),NSPV_ntzsresult.prevntz.txid.GetHex().c_str(),NSPV_ntzsresult.prevntz.height,NSPV_ntzsresult.nextntz.txid.GetHex().c_str(),NSPV_ntzsresult.nextntz.height);
                 break;
             case NSPV_NTZSPROOFRESP:
                 NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
                 NSPV_rwntzsproofresp(0,&response[1],&NSPV_ntzsproofresult);
                 if ( NSPV_ntzsproof_find(NSPV_ntzsproofresult.prevtxid,NSPV_ntzsproofresult.nexttxid) == 0 )
+                {
                     NSPV_ntzsproof_add(&NSPV_ntzsproofresult);
+                    NSPV_diskcache_add(NSPV_NTZSPROOFRESP,&response[1],len-1);
+                }
                 fprintf(stderr,"got ntzproof response %u size.%d prev.%d next.%d\n",timestamp,(int32_t)response.size(),NSPV_ntzsproofresult.common.prevht,NSPV_ntzsproofresult.common.nextht);
                 break;
             case NSPV_TXPROOFRESP:
                 NSPV_txproof_purge(&NSPV_txproofresult);
                 NSPV_rwtxproof(0,&response[1],&NSPV_txproofresult);
                 if ( NSPV_txproof_find(NSPV_txproofresult.txid) == 0 )
+                {
                     NSPV_txproof_add(&NSPV_txproofresult);
+                    if ( NSPV_txproofresult.txprooflen != 0 ) // unconfirmed tx has no proof yet
+                        NSPV_diskcache_add(NSPV_TXPROOFRESP,&response[1],len-1);
+                }
                 fprintf(stderr,"got txproof response %u size.%d %s ht.%d\n",timestamp,(int32_t)response.size(),NSPV_txproofresult.txid.GetHex().c_str(),NSPV_txproofresult.height);
                 break;
             case NSPV_SPENTINFORESP:
@@ -208,10 +397,47 @@ void safecoin_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a
                 NSPV_rwutxosresp(0, &response[1], &NSPV_utxosresult);
                 fprintf(stderr, "got cc module utxos response %u size.%d\n", timestamp, (int32_t)response.size());
                 break;
+            case NSPV_SUBSCRIBERESP:
+            {
+                int32_t n = 2,height; uint256 txid;
+                if ( len < 2 + sizeof(height) + sizeof(txid) )
+                    break;
+                n += iguana_rwnum(0,&response[n],sizeof(height),&height);
+                n += iguana_rwbignum(0,&response[n],sizeof(txid),(uint8_t *)&txid);
+                if ( response[1] != NSPV_NOTIFY_ACK )
+                {
+                    // the wallet address has new activity, dont answer from the old txids and refresh info soon
+                    NSPV_txidsresult.nodeheight = 0;
+                    if ( response[1] == NSPV_NOTIFY_BLOCK )
+                        NSPV_lastinfo = 0;
+                }
+                fprintf(stderr,"got subscribe response %u kind.%d ht.%d %s\n",timestamp,response[1],height,txid.GetHex().c_str());
+                break;
+            }
+            case NSPV_BATCHRESP:
+            {
+                std::vector<uint8_t> subresp; int32_t i,n,num,sublen;
+                num = (len > 1) ? response[1] : 0;
+                for (i=0,n=2; i<num && n+sizeof(sublen)<=len; i++)
+                {
+                    n += iguana_rwnum(0,&response[n],sizeof(sublen),&sublen);
+                    if ( sublen < 0 || n+sublen > len )
+                        break;
+                    if ( sublen > 0 && response[n] != NSPV_BATCHRESP )
+                    {
+                        subresp.assign(response.begin()+n,response.begin()+n+sublen);
+                        safecoin_nSPVresp(pfrom,subresp);
+                    }
+                    n += sublen;
+                }
+                fprintf(stderr,"got batch response %u size.%d num.%d\n",timestamp,(int32_t)response.size(),num);
+                break;
+            }
 
             default: fprintf(stderr,"unexpected response %02x size.%d at %u\n",response[0],(int32_t)response.size(),timestamp);
                 break;
         }
+        NSPV_respnotify();
     }
 }
 
@@ -219,7 +445,7 @@ void safecoin_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a
 
 CNode *NSPV_req(CNode *pnode,uint8_t *msg,int32_t len,uint64_t mask,int32_t ind)
 {
-    int32_t n,flag = 0; CNode *pnodes[64]; uint32_t timestamp = (uint32_t)time(NULL);
+    int32_t i,j,n,flag = 0; CNode *pnodes[64]; uint32_t timestamp = (uint32_t)time(NULL);
     if ( SAFECOIN_NSPV_FULLNODE )
         return(0);
     if ( pnode == 0 )
@@ -241,9 +467,20 @@ CNode *NSPV_req(CNode *pnode,uint8_t *msg,int32_t len,uint64_t mask,int32_t ind)
                     break;
             } // else fprintf(stderr,"nServices %llx vs mask %llx, t%u vs %u, ind.%d\n",(long long)ptr->nServices,(long long)mask,timestamp,ptr->prevtimes[ind],ind);
         }
-        if ( n > 0 )
-            pnode = pnodes[rand() % n];
-    } else flag = 1;
+        for (i=0; i<n && i<NSPV_REQFANOUT; i++) // pick the peers to ask
+        {
+            j = i + (rand() % (n - i));
+            pnode = pnodes[j], pnodes[j] = pnodes[i], pnodes[i] = pnode;
+        }
+        n = i;
+        pnode = (n > 0) ? pnodes[0] : 0;
+    }
+    else
+    {
+        flag = 1;
+        pnodes[0] = pnode;
+        n = 1;
+    }
     if ( pnode != 0 )
     {
         std::vector<uint8_t> request;
@@ -251,13 +488,51 @@ CNode *NSPV_req(CNode *pnode,uint8_t *msg,int32_t len,uint64_t mask,int32_t ind)
         memcpy(&request[0],msg,len);
         if ( (0) && SAFECOIN_NSPV_SUPERLITE )
             fprintf(stderr,"pushmessage [%d] len.%d\n",msg[0],len);
-        pnode->PushMessage("getnSPV",request);
-        pnode->prevtimes[ind] = timestamp;
+        NSPV_reqsent(msg[0],n);
+        for (i=0; i<n; i++)
+        {
+            pnodes[i]->PushMessage("getnSPV",request);
+            pnodes[i]->prevtimes[ind] = timestamp;
+        }
         return(pnode);
     } else fprintf(stderr,"no pnodes\n");
     return(0);
 }
 
+// subscribes to pushes of txs paying to or spending from the logged in address
+
+CNode *NSPV_subscribe(CNode *pnode)
+{
+    CBloomFilter filter(2,0.0001,(unsigned int)rand(),BLOOM_UPDATE_ALL); CPubKey pubkey = NSPV_key.GetPubKey(); CKeyID keyid = pubkey.GetID();
+    CDataStream ss(SER_NETWORK,PROTOCOL_VERSION); std::vector<uint8_t> msg;
+    filter.insert(std::vector<unsigned char>(pubkey.begin(),pubkey.end()));
+    filter.insert(std::vector<unsigned char>(keyid.begin(),keyid.end()));
+    ss << filter;
+    msg.push_back(NSPV_SUBSCRIBE);
+    msg.insert(msg.end(),ss.begin(),ss.end());
+    return(NSPV_req(pnode,&msg[0],(int32_t)msg.size(),NODE_NSPV,NSPV_SUBSCRIBE>>1));
+}
+
+// several requests in one NSPV_BATCH message, the subresponses are handled as if they arrived one by one
+
+CNode *NSPV_reqbatch(CNode *pnode,std::vector<std::vector<uint8_t> > &requests,uint64_t mask)
+{
+    std::vector<uint8_t> msg; int32_t i,sublen,num = (int32_t)requests.size();
+    if ( num == 0 || num > NSPV_MAXBATCH )
+        return(0);
+    msg.push_back(NSPV_BATCH);
+    msg.push_back(num);
+    for (i=0; i<num; i++)
+    {
+        sublen = (int32_t)requests[i].size();
+        msg.resize(msg.size() + sizeof(sublen));
+        iguana_rwnum(1,&msg[msg.size() - sizeof(sublen)],sizeof(sublen),&sublen);
+        msg.insert(msg.end(),requests[i].begin(),requests[i].end());
+        NSPV_reqsent(requests[i][0],1);
+    }
+    return(NSPV_req(pnode,&msg[0],(int32_t)msg.size(),mask,NSPV_BATCH>>1));
+}
+
 UniValue NSPV_logout()
 {
     UniValue result(UniValue::VOBJ);
@@ -287,6 +562,8 @@ void safecoin_nSPV(CNode *pto) // polling loop from SendMessages
         pto->prevtimes[NSPV_INFO>>1] = 0;
     if ( SAFECOIN_NSPV_SUPERLITE )
     {
+        if ( NSPV_diskcache_loaded == 0 )
+            NSPV_diskcache_load();
         if ( timestamp > NSPV_lastinfo + ASSETCHAINS_BLOCKTIME/2 && timestamp > pto->prevtimes[NSPV_INFO>>1] + 2*ASSETCHAINS_BLOCKTIME/3 )
         {
             int32_t reqht;
@@ -295,8 +572,29 @@ void safecoin_nSPV(CNode *pto) // polling loop from SendMessages
             msg[len++] = NSPV_INFO;
             len += iguana_rwnum(1,&msg[len],sizeof(reqht),&reqht);
             //fprintf(stderr,"issue getinfo\n");
-            NSPV_req(pto,msg,len,NODE_NSPV,NSPV_INFO>>1);
+            if ( NSPV_logintime != 0 && NSPV_address.size() != 0 && NSPV_inforesult.version >= NSPV_BATCH_VERSION && (pto->nServices & NODE_ADDRINDEX) != 0 )
+            {
+                // refresh the wallet address utxos and txids together with the info in one round trip
+                std::vector<std::vector<uint8_t> > requests; int32_t zero = 0; uint8_t types[2] = { NSPV_UTXOS, NSPV_TXIDS };
+                requests.push_back(std::vector<uint8_t>(msg,msg+len));
+                for (i=0; i<sizeof(types)/sizeof(*types); i++)
+                {
+                    len = 0;
+                    msg[len++] = types[i];
+                    msg[len++] = (uint8_t)NSPV_address.size();
+                    memcpy(&msg[len],NSPV_address.c_str(),NSPV_address.size()), len += NSPV_address.size();
+                    msg[len++] = 0;
+                    len += iguana_rwnum(1,&msg[len],sizeof(zero),&zero);
+                    len += iguana_rwnum(1,&msg[len],sizeof(zero),&zero);
+                    requests.push_back(std::vector<uint8_t>(msg,msg+len));
+                }
+                if ( NSPV_reqbatch(pto,requests,NODE_NSPV|NODE_ADDRINDEX) != 0 )
+                    pto->prevtimes[NSPV_INFO>>1] = timestamp;
+            }
+            else NSPV_req(pto,msg,len,NODE_NSPV,NSPV_INFO>>1);
         }
+        if ( NSPV_logintime != 0 && timestamp > pto->prevtimes[NSPV_SUBSCRIBE>>1] && pto->prevtimes[NSPV_SUBSCRIBE>>1] < NSPV_logintime )
+            NSPV_subscribe(pto);
     }
 }
 
@@ -553,16 +851,15 @@ UniValue NSPV_login(char *wifstr)
 
 UniValue NSPV_getinfo_req(int32_t reqht)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_inforesp I;
+    uint8_t msg[512]; int32_t iter,len = 0; struct NSPV_inforesp I;
     NSPV_inforesp_purge(&NSPV_inforesult);
     msg[len++] = NSPV_INFO;
     len += iguana_rwnum(1,&msg[len],sizeof(reqht),&reqht);
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (NSPV_waiter W; W.wait(); )
         {
-            usleep(NSPV_POLLMICROS);
             if ( NSPV_inforesult.height != 0 )
                 return(NSPV_getinfo_json(&NSPV_inforesult));
         }
@@ -591,7 +888,7 @@ uint32_t NSPV_blocktime(int32_t hdrheight)
 
 UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter)
 {
-    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t i,iter,slen,len = 0;
+    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t iter,slen,len = 0;
     //fprintf(stderr,"utxos %s NSPV addr %s\n",coinaddr,NSPV_address.c_str());
     //if ( NSPV_utxosresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_utxosresult.coinaddr) == 0 && CCflag == NSPV_utxosresult.CCflag  && skipcount == NSPV_utxosresult.skipcount && filter == NSPV_utxosresult.filter )
     //    return(NSPV_utxosresp_json(&NSPV_utxosresult));
@@ -614,9 +911,8 @@ UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_ADDRINDEX,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (NSPV_waiter W; W.wait(); )
         {
-            usleep(NSPV_POLLMICROS);
             if ( (NSPV_inforesult.height == 0 || NSPV_utxosresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr,NSPV_utxosresult.coinaddr) == 0 && CCflag == NSPV_utxosresult.CCflag )
                 return(NSPV_utxosresp_json(&NSPV_utxosresult));
         }
@@ -629,7 +925,7 @@ UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
 
 UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter)
 {
-    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t i,iter,slen,len = 0;
+    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t iter,slen,len = 0;
     if ( NSPV_txidsresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_txidsresult.coinaddr) == 0 && CCflag == NSPV_txidsresult.CCflag && skipcount == NSPV_txidsresult.skipcount )
         return(NSPV_txidsresp_json(&NSPV_txidsresult));
     if ( skipcount < 0 )
@@ -652,9 +948,8 @@ UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_ADDRINDEX,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (NSPV_waiter W; W.wait(); )
         {
-            usleep(NSPV_POLLMICROS);
             if ( (NSPV_inforesult.height == 0 || NSPV_txidsresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr,NSPV_txidsresult.coinaddr) == 0 && CCflag == NSPV_txidsresult.CCflag )
                 return(NSPV_txidsresp_json(&NSPV_txidsresult));
         }
@@ -667,7 +962,7 @@ UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
 
 UniValue NSPV_ccaddresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,uint256 filtertxid,uint8_t evalcode, uint8_t func)
 {
-    UniValue result(UniValue::VOBJ); uint8_t msg[512],funcid=NSPV_CC_TXIDS; char zeroes[64]; int32_t i,iter,slen,len = 0,vout;
+    UniValue result(UniValue::VOBJ); uint8_t msg[512],funcid=NSPV_CC_TXIDS; char zeroes[64]; int32_t iter,slen,len = 0,vout;
     NSPV_mempoolresp_purge(&NSPV_mempoolresult);
     memset(zeroes,0,sizeof(zeroes));
     if ( coinaddr == 0 )
@@ -691,9 +986,8 @@ UniValue NSPV_ccaddresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,uin
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (NSPV_waiter W; W.wait(); )
         {
-            usleep(NSPV_POLLMICROS);
             if ( NSPV_mempoolresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_mempoolresult.coinaddr) == 0 && CCflag == NSPV_mempoolresult.CCflag && filtertxid == NSPV_mempoolresult.txid && vout == NSPV_mempoolresult.vout && funcid == NSPV_mempoolresult.funcid )
                 return(NSPV_mempoolresp_json(&NSPV_mempoolresult));
         }
@@ -706,7 +1000,7 @@ UniValue NSPV_ccaddresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,uin
 
 UniValue NSPV_mempooltxids(char *coinaddr,int32_t CCflag,uint8_t funcid,uint256 txid,int32_t vout)
 {
-    UniValue result(UniValue::VOBJ); uint8_t msg[512]; char zeroes[64]; int32_t i,iter,slen,len = 0;
+    UniValue result(UniValue::VOBJ); uint8_t msg[512]; char zeroes[64]; int32_t iter,slen,len = 0;
     NSPV_mempoolresp_purge(&NSPV_mempoolresult);
     memset(zeroes,0,sizeof(zeroes));
     if ( coinaddr == 0 )
@@ -729,9 +1023,8 @@ UniValue NSPV_mempooltxids(char *coinaddr,int32_t CCflag,uint8_t funcid,uint256
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (NSPV_waiter W; W.wait(); )
         {
-            usleep(NSPV_POLLMICROS);
             if ( NSPV_mempoolresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_mempoolresult.coinaddr) == 0 && CCflag == NSPV_mempoolresult.CCflag && txid == NSPV_mempoolresult.txid && vout == NSPV_mempoolresult.vout && funcid == NSPV_mempoolresult.funcid )
                 return(NSPV_mempoolresp_json(&NSPV_mempoolresult));
         }
@@ -783,7 +1076,7 @@ bool NSPV_evalcode_inmempool(uint8_t evalcode,uint8_t funcid)
 
 UniValue NSPV_notarizations(int32_t reqheight)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_ntzsresp N,*ptr;
+    uint8_t msg[512]; int32_t iter,len = 0; struct NSPV_ntzsresp N,*ptr;
     if ( (ptr= NSPV_ntzsresp_find(reqheight)) != 0 )
     {
         fprintf(stderr,"FROM CACHE NSPV_notarizations.%d\n",reqheight);
@@ -796,9 +1089,8 @@ UniValue NSPV_notarizations(int32_t reqheight)
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (NSPV_waiter W; W.wait(); )
         {
-            usleep(NSPV_POLLMICROS);
             if ( NSPV_ntzsresult.reqheight == reqheight )
                 return(NSPV_ntzsresp_json(&NSPV_ntzsresult));
         }
@@ -809,7 +1101,7 @@ UniValue NSPV_notarizations(int32_t reqheight)
 
 UniValue NSPV_txidhdrsproof(uint256 prevtxid,uint256 nexttxid)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_ntzsproofresp P,*ptr;
+    uint8_t msg[512]; int32_t iter,len = 0; struct NSPV_ntzsproofresp P,*ptr;
     if ( (ptr= NSPV_ntzsproof_find(prevtxid,nexttxid)) != 0 )
     {
         fprintf(stderr,"FROM CACHE NSPV_txidhdrsproof %s %s\n",ptr->prevtxid.GetHex().c_str(),ptr->nexttxid.GetHex().c_str());
@@ -824,9 +1116,8 @@ UniValue NSPV_txidhdrsproof(uint256 prevtxid,uint256 nexttxid)
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (NSPV_waiter W; W.wait(); )
         {
-            usleep(NSPV_POLLMICROS);
             if ( NSPV_ntzsproofresult.prevtxid == prevtxid && NSPV_ntzsproofresult.nexttxid == nexttxid )
                 return(NSPV_ntzsproof_json(&NSPV_ntzsproofresult));
         }
@@ -847,7 +1138,7 @@ UniValue NSPV_hdrsproof(int32_t prevht,int32_t nextht)
 
 UniValue NSPV_txproof(int32_t vout,uint256 txid,int32_t height)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_txproof P,*ptr;
+    uint8_t msg[512]; int32_t iter,len = 0; struct NSPV_txproof P,*ptr;
     if ( (ptr= NSPV_txproof_find(txid)) != 0 )
     {
         fprintf(stderr,"FROM CACHE NSPV_txproof %s\n",txid.GetHex().c_str());
@@ -864,9 +1155,8 @@ UniValue NSPV_txproof(int32_t vout,uint256 txid,int32_t height)
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (NSPV_waiter W; W.wait(); )
         {
-            usleep(NSPV_POLLMICROS);
             if ( NSPV_txproofresult.txid == txid )
                 return(NSPV_txproof_json(&NSPV_txproofresult));
         }
@@ -878,7 +1168,7 @@ UniValue NSPV_txproof(int32_t vout,uint256 txid,int32_t height)
 
 UniValue NSPV_spentinfo(uint256 txid,int32_t vout)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_spentinfo I;
+    uint8_t msg[512]; int32_t iter,len = 0; struct NSPV_spentinfo I;
     NSPV_spentinfo_purge(&NSPV_spentresult);
     msg[len++] = NSPV_SPENTINFO;
     len += iguana_rwnum(1,&msg[len],sizeof(vout),&vout);
@@ -886,9 +1176,8 @@ UniValue NSPV_spentinfo(uint256 txid,int32_t vout)
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_SPENTINDEX,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (NSPV_waiter W; W.wait(); )
         {
-            usleep(NSPV_POLLMICROS);
             if ( NSPV_spentresult.txid == txid && NSPV_spentresult.vout == vout )
                 return(NSPV_spentinfo_json(&NSPV_spentresult));
         }
@@ -899,7 +1188,7 @@ UniValue NSPV_spentinfo(uint256 txid,int32_t vout)
 
 UniValue NSPV_broadcast(char *hex)
 {
-    uint8_t *msg,*data; uint256 txid; int32_t i,n,iter,len = 0; struct NSPV_broadcastresp B;
+    uint8_t *msg,*data; uint256 txid; int32_t n,iter,len = 0; struct NSPV_broadcastresp B;
     NSPV_broadcast_purge(&NSPV_broadcastresult);
     n = (int32_t)strlen(hex) >> 1;
     data = (uint8_t *)malloc(n);
@@ -915,9 +1204,8 @@ UniValue NSPV_broadcast(char *hex)
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (NSPV_waiter W; W.wait(); )
         {
-            usleep(NSPV_POLLMICROS);
             if ( NSPV_broadcastresult.txid == txid )
             {
                 free(msg);
@@ -937,7 +1225,7 @@ UniValue NSPV_broadcast(char *hex)
 // For second+ funcids the filtertxid will be compared to txid in opret
 UniValue NSPV_ccmoduleutxos(char *coinaddr, int64_t amount, uint8_t evalcode, std::string funcids, uint256 filtertxid)
 {
-    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t i, iter, slen, len = 0;
+    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t iter, slen, len = 0;
     uint8_t CCflag = 1;
 
     NSPV_utxosresp_purge(&NSPV_utxosresult);
@@ -964,9 +1252,8 @@ UniValue NSPV_ccmoduleutxos(char *coinaddr, int64_t amount, uint8_t evalcode, st
     for (iter = 0; iter<3; iter++)
         if (NSPV_req(0, msg, len, NODE_ADDRINDEX, msg[0] >> 1) != 0)
         {
-            for (i = 0; i<NSPV_POLLITERS; i++)
+            for (NSPV_waiter W; W.wait(); )
             {
-                usleep(NSPV_POLLMICROS);
                 if ((NSPV_inforesult.height == 0 || NSPV_utxosresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr, NSPV_utxosresult.coinaddr) == 0 && CCflag == NSPV_utxosresult.CCflag)
                     return(NSPV_utxosresp_json(&NSPV_utxosresult));
             }
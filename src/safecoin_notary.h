@@ -18,6 +18,7 @@
 #include "safecoin_cJSON.h"
 
 #include "notaries_staked.h"
+#include "notaryset.h"
 
 #define SAFECOIN_MAINNET_START 178999
 #define SAFECOIN_NOTARIES_HEIGHT1 814000
@@ -166,18 +167,15 @@ int32_t safecoin_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timest
 }
 
 
+CNotarySetRef safecoin_notaryset(int32_t height, uint32_t timestamp)
+{
+    uint8_t notary_pubkeys[64][33];
+    return(GetSharedNotarySet(notary_pubkeys,safecoin_notaries(notary_pubkeys,height,timestamp)));
+}
+
 std::vector<std::string> vs_safecoin_notaries(int32_t height, uint32_t timestamp)
 {
-	uint8_t notary_pubkeys[64][33];
-	std::vector<std::string> vs = std::vector<std::string>();
-	int32_t notaries_count = safecoin_notaries(notary_pubkeys, height, timestamp);
-	
-	if (notaries_count == -1) return vs;
-	for (int i = 0; i < notaries_count; i++)
-	{
-		vs.push_back(HexStr(std::begin(notary_pubkeys[i]), std::end(notary_pubkeys[i])));
-	}
-	return vs;
+	return safecoin_notaryset(height, timestamp)->Hexkeys();
 }
 
 
@@ -209,9 +207,12 @@ int32_t safecoin_ratify_threshold(int32_t height,uint64_t signedmask)
     else return(0);
 }
 
+// highest height a notary set was ratified at, kept in the state snapshot
+int32_t SAFECOIN_NOTARIES_HWM;
+
 void safecoin_notarysinit(int32_t origheight,uint8_t pubkeys[64][33],int32_t num)
 {
-    static int32_t hwmheight;
+    int32_t &hwmheight = SAFECOIN_NOTARIES_HWM;
     int32_t k,i,htind,height; struct knotary_entry *kp; struct knotaries_entry N;
     if ( Pubkeys == 0 )
         Pubkeys = (struct knotaries_entry *)calloc(1 + (SAFECOIN_MAXBLOCKS / SAFECOIN_ELECTION_GAP),sizeof(*Pubkeys));
@@ -301,12 +302,48 @@ int32_t safecoin_chosennotary(int32_t *notaryidp,int32_t height,uint8_t *pubkey3
 
 //struct safecoin_state *safecoin_stateptr(char *symbol,char *dest);
 
+// first checkpoint with nHeight >= height, binary searched in the ordered prefix, a tail appended after a reorg is scanned
+int32_t safecoin_npoints_lowerbound(struct safecoin_state *sp,int32_t height)
+{
+    int32_t lo = 0,hi = sp->NUM_SORTED_NPOINTS,mid,i;
+    while ( lo < hi )
+    {
+        mid = (lo + hi) >> 1;
+        if ( sp->NPOINTS[mid].nHeight < height )
+            lo = mid + 1;
+        else hi = mid;
+    }
+    if ( lo < sp->NUM_SORTED_NPOINTS )
+        return(lo);
+    for (i=sp->NUM_SORTED_NPOINTS; i<sp->NUM_NPOINTS; i++)
+        if ( sp->NPOINTS[i].nHeight >= height )
+            break;
+    return(i);
+}
+
 struct notarized_checkpoint *safecoin_npptr_for_height(int32_t height, int *idx)
 {
-    char symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; int32_t i; struct safecoin_state *sp; struct notarized_checkpoint *np = 0;
+    char symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; int32_t i,lo,hi,mid; struct safecoin_state *sp; struct notarized_checkpoint *np = 0;
     if ( (sp= safecoin_stateptr(symbol,dest)) != 0 )
     {
-        for (i=sp->NUM_NPOINTS-1; i>=0; i--)
+        // latest checkpoint whose MoM covers height, the unordered tail comes last so it is checked first
+        for (i=sp->NUM_NPOINTS-1; i>=sp->NUM_SORTED_NPOINTS; i--)
+        {
+            *idx = i;
+            np = &sp->NPOINTS[i];
+            if ( np->MoMdepth != 0 && height > np->notarized_height-(np->MoMdepth&0xffff) && height <= np->notarized_height )
+                return(np);
+        }
+        // in the ordered prefix only notarized heights in [height, height + max MoMdepth) can cover it
+        lo = 0, hi = sp->NUM_SORTED_NPOINTS;
+        while ( lo < hi )
+        {
+            mid = (lo + hi) >> 1;
+            if ( sp->NPOINTS[mid].notarized_height < height + sp->MAX_NPOINTS_MoMdepth )
+                lo = mid + 1;
+            else hi = mid;
+        }
+        for (i=lo-1; i>=0 && sp->NPOINTS[i].notarized_height >= height; i--)
         {
             *idx = i;
             np = &sp->NPOINTS[i];
@@ -378,13 +415,13 @@ int32_t safecoin_notarized_height(int32_t *prevMoMheightp,uint256 *hashp,uint256
 int32_t safecoin_dpowconfs(int32_t txheight,int32_t numconfs)
 {
     static int32_t hadnotarization;
-    char symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; struct safecoin_state *sp;
+    char symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; struct safecoin_state *sp; int32_t notarized_height;
     if ( SAFECOIN_DPOWCONFS != 0 && txheight > 0 && numconfs > 0 && (sp= safecoin_stateptr(symbol,dest)) != 0 )
     {
-        if ( sp->NOTARIZED_HEIGHT > 0 )
+        if ( (notarized_height= sp->NOTARIZED_HEIGHT) > 0 )
         {
             hadnotarization = 1;
-            if ( txheight < sp->NOTARIZED_HEIGHT )
+            if ( txheight < notarized_height )
                 return(numconfs);
             else return(1);
         }
@@ -418,50 +455,15 @@ int32_t safecoin_MoMdata(int32_t *notarized_htp,uint256 *MoMp,uint256 *safetxidp
 
 int32_t safecoin_notarizeddata(int32_t nHeight,uint256 *notarized_hashp,uint256 *notarized_desttxidp)
 {
-    struct notarized_checkpoint *np = 0; int32_t i=0,flag = 0; char symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; struct safecoin_state *sp;
+    struct notarized_checkpoint *np = 0; int32_t i; char symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN]; struct safecoin_state *sp;
     if ( (sp= safecoin_stateptr(symbol,dest)) != 0 )
     {
-        if ( sp->NUM_NPOINTS > 0 )
-        {
-            flag = 0;
-            if ( sp->last_NPOINTSi < sp->NUM_NPOINTS && sp->last_NPOINTSi > 0 )
-            {
-                np = &sp->NPOINTS[sp->last_NPOINTSi-1];
-                if ( np->nHeight < nHeight )
-                {
-                    for (i=sp->last_NPOINTSi; i<sp->NUM_NPOINTS; i++)
-                    {
-                        if ( sp->NPOINTS[i].nHeight >= nHeight )
-                        {
-                            //printf("flag.1 i.%d np->ht %d [%d].ht %d >= nHeight.%d, last.%d num.%d\n",i,np->nHeight,i,sp->NPOINTS[i].nHeight,nHeight,sp->last_NPOINTSi,sp->NUM_NPOINTS);
-                            flag = 1;
-                            break;
-                        }
-                        np = &sp->NPOINTS[i];
-                        sp->last_NPOINTSi = i;
-                    }
-                }
-            }
-            if ( flag == 0 )
-            {
-                np = 0;
-                for (i=0; i<sp->NUM_NPOINTS; i++)
-                {
-                    if ( sp->NPOINTS[i].nHeight >= nHeight )
-                    {
-                        //printf("i.%d np->ht %d [%d].ht %d >= nHeight.%d\n",i,np->nHeight,i,sp->NPOINTS[i].nHeight,nHeight);
-                        break;
-                    }
-                    np = &sp->NPOINTS[i];
-                    sp->last_NPOINTSi = i;
-                }
-            }
-        }
+        // the last checkpoint before the first one at or above nHeight
+        if ( sp->NUM_NPOINTS > 0 && (i= safecoin_npoints_lowerbound(sp,nHeight)) > 0 )
+            np = &sp->NPOINTS[i-1];
         if ( np != 0 )
         {
             //char str[65],str2[65]; printf("[%s] notarized_ht.%d\n",ASSETCHAINS_SYMBOL,np->notarized_height);
-            if ( np->nHeight >= nHeight || (i < sp->NUM_NPOINTS && np[1].nHeight < nHeight) )
-                printf("warning: flag.%d i.%d np->ht %d [1].ht %d >= nHeight.%d\n",flag,i,np->nHeight,np[1].nHeight,nHeight);
             *notarized_hashp = np->notarized_hash;
             *notarized_desttxidp = np->notarized_desttxid;
             return(np->notarized_height);
@@ -492,6 +494,11 @@ void safecoin_notarized_update(struct safecoin_state *sp,int32_t nHeight,int32_t
     sp->NOTARIZED_DESTTXID = np->notarized_desttxid = notarized_desttxid;
     sp->MoM = np->MoM = MoM;
     sp->MoMdepth = np->MoMdepth = MoMdepth;
+    // the ordered prefix grows while checkpoints arrive in height order, which they stop doing after a reorg
+    if ( sp->NUM_SORTED_NPOINTS == sp->NUM_NPOINTS-1 && (sp->NUM_SORTED_NPOINTS == 0 || (np[-1].nHeight <= nHeight && np[-1].notarized_height <= notarized_height)) )
+        sp->NUM_SORTED_NPOINTS = sp->NUM_NPOINTS;
+    if ( (MoMdepth & 0xffff) > sp->MAX_NPOINTS_MoMdepth )
+        sp->MAX_NPOINTS_MoMdepth = (MoMdepth & 0xffff);
     portable_mutex_unlock(&safecoin_mutex);
 }
 
@@ -0,0 +1,368 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef H_SAFECOINSTATESNAP_H
+#define H_SAFECOINSTATESNAP_H
+#include "safecoin_defs.h"
+
+// safecoinstate.snap holds what replaying safecoinstate builds in memory: the notarization
+// checkpoints, events, notary sets, price feeds and KV records. It names the safecoinstate
+// offset it was taken at, so a restart only parses the records appended after that offset.
+// Written at shutdown and every SAFECOIN_STATESNAP_INTERVAL blocks, checksummed like peers.dat.
+#define SAFECOIN_STATESNAP_MAGIC 0x706e5373 // "sSnp"
+#define SAFECOIN_STATESNAP_VERSION 1
+#define SAFECOIN_STATESNAP_INTERVAL 1000
+#define SAFECOIN_STATESNAP_TAILCHECK 4096 // bytes of safecoinstate before the offset that are hashed
+
+// end of the last record written to safecoinstate
+long SAFECOIN_STATEFPOS;
+
+void safecoin_statesnap_fname(char *fname)
+{
+    safecoin_statefname(fname,ASSETCHAINS_SYMBOL,(char *)"safecoinstate");
+    strcat(fname,".snap");
+}
+
+// ties a snapshot to the safecoinstate it was taken from, a replaced or truncated file does not match
+bool safecoin_statesnap_tailhash(uint256 &hash,char *statefname,long fpos)
+{
+    FILE *fp; long len = std::min(fpos,(long)SAFECOIN_STATESNAP_TAILCHECK); std::vector<uint8_t> buf(len); bool ok;
+    if ( len <= 0 || (fp= fopen(statefname,"rb")) == 0 )
+        return(false);
+    ok = (fseek(fp,fpos - len,SEEK_SET) == 0 && fread(&buf[0],1,len,fp) == len);
+    fclose(fp);
+    if ( ok )
+        hash = Hash(buf.begin(),buf.end());
+    return(ok);
+}
+
+void safecoin_statesnap_writekv(CDataStream &ss,struct safecoin_kv *ptr)
+{
+    ss << ptr->keylen << ptr->valuesize << ptr->height << ptr->regheight << ptr->flags << ptr->regtype << ptr->hassafekey;
+    ss.write((char *)&ptr->pubkey,sizeof(ptr->pubkey));
+    ss.write((char *)ptr->parentkey33,sizeof(ptr->parentkey33));
+    ss.write((char *)ptr->safekey33,sizeof(ptr->safekey33));
+    ss.write((char *)ptr->key,ptr->keylen);
+    if ( ptr->valuesize != 0 )
+        ss.write((char *)ptr->value,ptr->valuesize);
+}
+
+struct safecoin_kv *safecoin_statesnap_readkv(CDataStream &ss)
+{
+    struct safecoin_kv *ptr = (struct safecoin_kv *)calloc(1,sizeof(*ptr));
+    try
+    {
+        ss >> ptr->keylen >> ptr->valuesize >> ptr->height >> ptr->regheight >> ptr->flags >> ptr->regtype >> ptr->hassafekey;
+        ss.read((char *)&ptr->pubkey,sizeof(ptr->pubkey));
+        ss.read((char *)ptr->parentkey33,sizeof(ptr->parentkey33));
+        ss.read((char *)ptr->safekey33,sizeof(ptr->safekey33));
+        ptr->key = (uint8_t *)calloc(1,ptr->keylen);
+        ss.read((char *)ptr->key,ptr->keylen);
+        if ( ptr->valuesize != 0 )
+        {
+            ptr->value = (uint8_t *)calloc(1,ptr->valuesize);
+            ss.read((char *)ptr->value,ptr->valuesize);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        safecoin_kvfree(ptr);
+        throw;
+    }
+    return(ptr);
+}
+
+int32_t safecoin_statesnap_write(struct safecoin_state *sp,long fpos)
+{
+    char statefname[512],fname[512],tmpname[520]; uint8_t pubkeys[64][33]; uint256 tailhash; CBlockIndex *pindex; FILE *fp;
+    struct knotary_entry *kp,*ktmp; struct safecoin_kv *ptr,*tmp; int32_t i,j,n; double startmillis = OS_milliseconds();
+    if ( sp == 0 || fpos <= 0 || (pindex= chainActive.LastTip()) == 0 )
+        return(-1);
+    if ( PAX != 0 )
+    {
+        // pax deposits and withdrawals link states across chains, only a full replay rebuilds them
+        static int32_t didwarn;
+        if ( didwarn++ == 0 )
+            LogPrintf("%s: not taken, pax transactions are not covered\n",__func__);
+        return(-1);
+    }
+    safecoin_statefname(statefname,ASSETCHAINS_SYMBOL,(char *)"safecoinstate");
+    if ( safecoin_statesnap_tailhash(tailhash,statefname,fpos) == 0 )
+        return(-1);
+    CDataStream ss(SER_DISK,CLIENT_VERSION);
+    ss << (uint32_t)SAFECOIN_STATESNAP_MAGIC << (int32_t)SAFECOIN_STATESNAP_VERSION << (int64_t)fpos << tailhash;
+    ss << pindex->GetBlockHash() << (int32_t)pindex->GetHeight();
+    // the checkpoints and events are stored as they are laid out in memory
+    ss << (uint32_t)sizeof(struct notarized_checkpoint) << (uint32_t)sizeof(struct safecoin_event);
+    portable_mutex_lock(&safecoin_mutex);
+    ss << sp->NOTARIZED_HASH << sp->NOTARIZED_DESTTXID << sp->MoM;
+    ss << sp->SAVEDHEIGHT << sp->CURRENT_HEIGHT << sp->NOTARIZED_HEIGHT << sp->MoMdepth << sp->SAVEDTIMESTAMP;
+    ss << sp->deposited << sp->issued << sp->withdrawn << sp->approved << sp->redeemed << sp->shorted;
+    ss.write((char *)sp->RTbufs,sizeof(sp->RTbufs));
+    ss << sp->RTmask;
+    ss << sp->NUM_NPOINTS << sp->NUM_SORTED_NPOINTS << sp->MAX_NPOINTS_MoMdepth;
+    if ( sp->NUM_NPOINTS > 0 )
+        ss.write((char *)sp->NPOINTS,sp->NUM_NPOINTS * sizeof(*sp->NPOINTS));
+    ss << sp->Safecoin_numevents;
+    for (i=0; i<sp->Safecoin_numevents; i++)
+    {
+        ss << sp->Safecoin_events[i]->len;
+        ss.write((char *)sp->Safecoin_events[i],sp->Safecoin_events[i]->len);
+    }
+    // each notary set is shared by the run of election periods it is active for
+    n = (Pubkeys != 0) ? (SAFECOIN_MAXBLOCKS / SAFECOIN_ELECTION_GAP) : 0;
+    ss << SAFECOIN_NOTARIES_HWM << n;
+    for (i=0; i<n; i=j)
+    {
+        for (j=i+1; j<n; j++)
+            if ( Pubkeys[j].Notaries != Pubkeys[i].Notaries || Pubkeys[j].numnotaries != Pubkeys[i].numnotaries || (Pubkeys[j].height == j * SAFECOIN_ELECTION_GAP) != (Pubkeys[i].height == i * SAFECOIN_ELECTION_GAP) )
+                break;
+        memset(pubkeys,0,sizeof(pubkeys));
+        HASH_ITER(hh,Pubkeys[i].Notaries,kp,ktmp)
+        {
+            if ( kp->notaryid < 64 )
+                memcpy(pubkeys[kp->notaryid],kp->pubkey,33);
+        }
+        ss << i << j << (uint8_t)(Pubkeys[i].height == i * SAFECOIN_ELECTION_GAP) << (uint8_t)Pubkeys[i].numnotaries;
+        ss.write((char *)pubkeys,33 * Pubkeys[i].numnotaries);
+    }
+    ss << NUM_PRICES;
+    if ( NUM_PRICES > 0 )
+        ss.write((char *)PVALS,NUM_PRICES * sizeof(*PVALS) * 36);
+    portable_mutex_unlock(&safecoin_mutex);
+    portable_mutex_lock(&SAFECOIN_KV_mutex);
+    ss << (int32_t)HASH_COUNT(SAFECOIN_KV);
+    HASH_ITER(hh,SAFECOIN_KV,ptr,tmp)
+    {
+        safecoin_statesnap_writekv(ss,ptr);
+    }
+    ss << (int32_t)SAFECOIN_KVEVICTED.size();
+    for (std::map<int32_t,std::vector<struct safecoin_kv *> >::iterator it=SAFECOIN_KVEVICTED.begin(); it!=SAFECOIN_KVEVICTED.end(); ++it)
+    {
+        ss << it->first << (int32_t)it->second.size();
+        for (i=0; i<it->second.size(); i++)
+            safecoin_statesnap_writekv(ss,it->second[i]);
+    }
+    portable_mutex_unlock(&SAFECOIN_KV_mutex);
+    ss << Hash(ss.begin(),ss.end());
+
+    safecoin_statesnap_fname(fname);
+    snprintf(tmpname,sizeof(tmpname),"%s.new",fname);
+    if ( (fp= fopen(tmpname,"wb")) == 0 )
+        return(-1);
+    if ( fwrite(&ss[0],1,ss.size(),fp) != ss.size() || fflush(fp) != 0 )
+    {
+        fclose(fp);
+        return(-1);
+    }
+    FileCommit(fp);
+    fclose(fp);
+    if ( RenameOver(tmpname,fname) == 0 )
+        return(-1);
+    LogPrint("bench","%s: ht.%d fpos.%ld %u bytes in %.3f millis\n",__func__,pindex->GetHeight(),fpos,(uint32_t)ss.size(),OS_milliseconds() - startmillis);
+    return(0);
+}
+
+// at clean shutdown, so the next start parses nothing
+void safecoin_statesnap_flush()
+{
+    struct safecoin_state *sp; char symbol[SAFECOIN_ASSETCHAIN_MAXLEN],dest[SAFECOIN_ASSETCHAIN_MAXLEN];
+    if ( SAFECOIN_STATEFPOS > 0 && (sp= safecoin_stateptr(symbol,dest)) != 0 )
+        safecoin_statesnap_write(sp,SAFECOIN_STATEFPOS);
+}
+
+// returns the safecoinstate offset the loaded snapshot covers, 0 if the whole file is to be parsed
+long safecoin_statesnap_load(struct safecoin_state *sp,char *statefname,long statesize)
+{
+    char fname[512]; FILE *fp; long fsize,fpos = 0; std::vector<char> data; uint256 hash,tailhash; double startmillis = OS_milliseconds();
+    if ( sp == 0 || sp->NUM_NPOINTS != 0 || sp->Safecoin_numevents != 0 || NUM_PRICES != 0 || SAFECOIN_KV != 0 )
+        return(0);
+    safecoin_statesnap_fname(fname);
+    if ( (fp= fopen(fname,"rb")) == 0 )
+        return(0);
+    fseek(fp,0,SEEK_END);
+    if ( (fsize= ftell(fp)) > (long)sizeof(hash) )
+    {
+        data.resize(fsize);
+        fseek(fp,0,SEEK_SET);
+        if ( fread(&data[0],1,fsize,fp) != fsize )
+            data.clear();
+    }
+    fclose(fp);
+    if ( data.empty() != 0 )
+        return(0);
+    memcpy(&hash,&data[fsize - sizeof(hash)],sizeof(hash));
+    if ( hash != Hash(data.begin(),data.end() - sizeof(hash)) )
+    {
+        fprintf(stderr,"%s checksum mismatch, replaying safecoinstate\n",fname);
+        return(0);
+    }
+
+    struct safecoin_state S; std::vector<struct notarized_checkpoint> npoints; std::vector<struct safecoin_event *> events;
+    struct notaryrun { int32_t first,last; uint8_t fset,num; uint8_t pubkeys[64][33]; }; std::vector<struct notaryrun> runs; std::vector<uint32_t> pvals;
+    std::vector<struct safecoin_kv *> kvs; std::map<int32_t,std::vector<struct safecoin_kv *> > evicted;
+    uint32_t magic,npsize,epsize; int32_t i,j,n,version,height,hwmheight,numprices; int64_t snapfpos; uint256 blockhash; uint16_t len;
+    try
+    {
+        CDataStream ss(&data[0],&data[0] + fsize - sizeof(hash),SER_DISK,CLIENT_VERSION);
+        ss >> magic >> version >> snapfpos >> tailhash >> blockhash >> height >> npsize >> epsize;
+        if ( magic != SAFECOIN_STATESNAP_MAGIC || version != SAFECOIN_STATESNAP_VERSION || npsize != sizeof(struct notarized_checkpoint) || epsize != sizeof(struct safecoin_event) )
+            throw std::runtime_error("unknown version");
+        if ( snapfpos <= 0 || snapfpos > statesize || safecoin_statesnap_tailhash(hash,statefname,snapfpos) == 0 || hash != tailhash )
+            throw std::runtime_error("taken from a different safecoinstate");
+        BlockMap::iterator mi = mapBlockIndex.find(blockhash);
+        if ( mi == mapBlockIndex.end() || mi->second == 0 || chainActive.Contains(mi->second) == 0 )
+            throw std::runtime_error("tip not in the active chain");
+        memset(&S,0,sizeof(S));
+        ss >> S.NOTARIZED_HASH >> S.NOTARIZED_DESTTXID >> S.MoM;
+        ss >> S.SAVEDHEIGHT >> S.CURRENT_HEIGHT >> S.NOTARIZED_HEIGHT >> S.MoMdepth >> S.SAVEDTIMESTAMP;
+        ss >> S.deposited >> S.issued >> S.withdrawn >> S.approved >> S.redeemed >> S.shorted;
+        ss.read((char *)S.RTbufs,sizeof(S.RTbufs));
+        ss >> S.RTmask;
+        ss >> S.NUM_NPOINTS >> S.NUM_SORTED_NPOINTS >> S.MAX_NPOINTS_MoMdepth;
+        if ( S.NUM_NPOINTS < 0 || S.NUM_SORTED_NPOINTS < 0 || S.NUM_SORTED_NPOINTS > S.NUM_NPOINTS || S.NUM_NPOINTS > ss.size() / sizeof(struct notarized_checkpoint) )
+            throw std::runtime_error("bad checkpoint count");
+        npoints.resize(S.NUM_NPOINTS);
+        if ( S.NUM_NPOINTS > 0 )
+            ss.read((char *)&npoints[0],S.NUM_NPOINTS * sizeof(struct notarized_checkpoint));
+        ss >> n;
+        for (i=0; i<n; i++)
+        {
+            ss >> len;
+            if ( len < sizeof(struct safecoin_event) )
+                throw std::runtime_error("bad event");
+            events.push_back((struct safecoin_event *)calloc(1,len));
+            ss.read((char *)events.back(),len);
+            events.back()->related = 0;
+            if ( events.back()->len != len )
+                throw std::runtime_error("bad event");
+        }
+        ss >> hwmheight >> n;
+        if ( n != 0 && n != SAFECOIN_MAXBLOCKS / SAFECOIN_ELECTION_GAP )
+            throw std::runtime_error("bad notary sets");
+        for (i=0; i<n; )
+        {
+            struct notaryrun run;
+            memset(&run,0,sizeof(run));
+            ss >> run.first >> run.last >> run.fset >> run.num;
+            if ( run.first != i || run.last <= i || run.last > n || run.num > 64 )
+                throw std::runtime_error("bad notary sets");
+            ss.read((char *)run.pubkeys,33 * run.num);
+            runs.push_back(run);
+            i = run.last;
+        }
+        ss >> numprices;
+        if ( numprices < 0 || numprices > ss.size() / (sizeof(uint32_t) * 36) )
+            throw std::runtime_error("bad price count");
+        pvals.resize(numprices * 36);
+        if ( numprices > 0 )
+            ss.read((char *)&pvals[0],pvals.size() * sizeof(uint32_t));
+        ss >> n;
+        for (i=0; i<n; i++)
+            kvs.push_back(safecoin_statesnap_readkv(ss));
+        ss >> n;
+        for (i=0; i<n; i++)
+        {
+            int32_t evictheight,num;
+            ss >> evictheight >> num;
+            std::vector<struct safecoin_kv *> &vec = evicted[evictheight];
+            for (j=0; j<num; j++)
+                vec.push_back(safecoin_statesnap_readkv(ss));
+        }
+        if ( ss.empty() == 0 )
+            throw std::runtime_error("trailing data");
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr,"%s not used (%s), replaying safecoinstate\n",fname,e.what());
+        for (i=0; i<events.size(); i++)
+            free(events[i]);
+        for (i=0; i<kvs.size(); i++)
+            safecoin_kvfree(kvs[i]);
+        for (std::map<int32_t,std::vector<struct safecoin_kv *> >::iterator it=evicted.begin(); it!=evicted.end(); ++it)
+            for (i=0; i<it->second.size(); i++)
+                safecoin_kvfree(it->second[i]);
+        return(0);
+    }
+
+    portable_mutex_lock(&safecoin_mutex);
+    memcpy(sp,&S,sizeof(S));
+    sp->NPOINTS = 0;
+    if ( S.NUM_NPOINTS > 0 )
+    {
+        sp->NPOINTS = (struct notarized_checkpoint *)malloc(S.NUM_NPOINTS * sizeof(*sp->NPOINTS));
+        memcpy(sp->NPOINTS,&npoints[0],S.NUM_NPOINTS * sizeof(*sp->NPOINTS));
+    }
+    sp->Safecoin_events = 0;
+    if ( (sp->Safecoin_numevents= (int32_t)events.size()) > 0 )
+    {
+        sp->Safecoin_events = (struct safecoin_event **)malloc(events.size() * sizeof(*sp->Safecoin_events));
+        memcpy(sp->Safecoin_events,&events[0],events.size() * sizeof(*sp->Safecoin_events));
+    }
+    if ( runs.empty() == 0 )
+    {
+        struct knotary_entry *kp,*ktmp; struct knotaries_entry N;
+        // drop the genesis notaries safecoin_init() set up, the snapshot has them
+        for (i=0; Pubkeys!=0 && i<SAFECOIN_MAXBLOCKS / SAFECOIN_ELECTION_GAP; i++)
+        {
+            if ( Pubkeys[i].Notaries != 0 && (i == 0 || Pubkeys[i].Notaries != Pubkeys[i-1].Notaries) )
+            {
+                HASH_ITER(hh,Pubkeys[i].Notaries,kp,ktmp)
+                {
+                    HASH_DEL(Pubkeys[i].Notaries,kp);
+                    free(kp);
+                }
+            }
+        }
+        free(Pubkeys);
+        Pubkeys = (struct knotaries_entry *)calloc(1 + (SAFECOIN_MAXBLOCKS / SAFECOIN_ELECTION_GAP),sizeof(*Pubkeys));
+        for (j=0; j<runs.size(); j++)
+        {
+            memset(&N,0,sizeof(N));
+            for (i=0; i<runs[j].num; i++)
+            {
+                kp = (struct knotary_entry *)calloc(1,sizeof(*kp));
+                memcpy(kp->pubkey,runs[j].pubkeys[i],33);
+                kp->notaryid = i;
+                HASH_ADD_KEYPTR(hh,N.Notaries,kp->pubkey,33,kp);
+            }
+            N.numnotaries = runs[j].num;
+            for (i=runs[j].first; i<runs[j].last; i++)
+            {
+                Pubkeys[i] = N;
+                Pubkeys[i].height = (runs[j].fset != 0) ? i * SAFECOIN_ELECTION_GAP : 0;
+            }
+        }
+        SAFECOIN_NOTARIES_HWM = hwmheight;
+    }
+    if ( (NUM_PRICES= numprices) > 0 )
+    {
+        PVALS = (uint32_t *)realloc(PVALS,pvals.size() * sizeof(*PVALS));
+        memcpy(PVALS,&pvals[0],pvals.size() * sizeof(*PVALS));
+    }
+    portable_mutex_unlock(&safecoin_mutex);
+    portable_mutex_lock(&SAFECOIN_KV_mutex);
+    for (i=0; i<kvs.size(); i++)
+    {
+        HASH_ADD_KEYPTR(hh,SAFECOIN_KV,kvs[i]->key,kvs[i]->keylen,kvs[i]);
+        safecoin_kvwheel_add(kvs[i]);
+    }
+    SAFECOIN_KVEVICTED.swap(evicted);
+    portable_mutex_unlock(&SAFECOIN_KV_mutex);
+    fprintf(stderr,"loaded %s ht.%d fpos.%ld, %d checkpoints %d events %d KV records in %.3f millis\n",fname,height,(long)snapfpos,sp->NUM_NPOINTS,sp->Safecoin_numevents,(int32_t)kvs.size(),OS_milliseconds() - startmillis);
+    return((long)snapfpos);
+}
+
+#endif
@@ -57,7 +57,8 @@
 union _bits320 { uint8_t bytes[40]; uint16_t ushorts[20]; uint32_t uints[10]; uint64_t ulongs[5]; uint64_t txid; };
 typedef union _bits320 bits320;
 
-struct safecoin_kv { UT_hash_handle hh; bits256 pubkey; uint8_t *key,*value; int32_t height; uint32_t flags; uint16_t keylen,valuesize; };
+// parentkey33/regheight/regtype are parsed from the beacon key on insert, safekey33 from the value when hassafekey is set
+struct safecoin_kv { UT_hash_handle hh; bits256 pubkey; uint8_t *key,*value; int32_t height,regheight; uint32_t flags; uint16_t keylen,valuesize; uint8_t parentkey33[33],safekey33[33],regtype,hassafekey; };
 
 struct safecoin_event_notarized { uint256 blockhash,desttxid,MoM; int32_t notarizedheight,MoMdepth; char dest[16]; };
 struct safecoin_event_pubkeys { uint8_t num; uint8_t pubkeys[64][33]; };
@@ -77,6 +78,7 @@ struct safecoin_event
 struct pax_transaction
 {
     UT_hash_handle hh;
+    struct pax_transaction *prevtype,*nexttype; // PAX_ISSUED, PAX_DEPOSITS or PAX_WITHDRAWS in the order they were added
     uint256 txid;
     uint64_t safetoshis,fiatoshis,validated;
     int32_t marked,height,otherheight,approved,didstats,ready;
@@ -122,7 +124,7 @@ struct safecoin_state
     int32_t SAVEDHEIGHT,CURRENT_HEIGHT,NOTARIZED_HEIGHT,MoMdepth;
     uint32_t SAVEDTIMESTAMP;
     uint64_t deposited,issued,withdrawn,approved,redeemed,shorted;
-    struct notarized_checkpoint *NPOINTS; int32_t NUM_NPOINTS,last_NPOINTSi;
+    struct notarized_checkpoint *NPOINTS; int32_t NUM_NPOINTS,NUM_SORTED_NPOINTS,MAX_NPOINTS_MoMdepth; // NPOINTS[0..NUM_SORTED_NPOINTS) are in height order
     struct safecoin_event **Safecoin_events; int32_t Safecoin_numevents;
     uint32_t RTbufs[64][3]; uint64_t RTmask;
 };
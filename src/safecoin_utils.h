@@ -834,13 +834,7 @@ int32_t bitweight(uint64_t x)
 
 int32_t _unhex(char c)
 {
-    if ( c >= '0' && c <= '9' )
-        return(c - '0');
-    else if ( c >= 'a' && c <= 'f' )
-        return(c - 'a' + 10);
-    else if ( c >= 'A' && c <= 'F' )
-        return(c - 'A' + 10);
-    return(-1);
+    return(HexDigit(c)); // table lookup, -1 for a non hex char
 }
 
 int32_t is_hexstr(char *str,int32_t n)
@@ -915,6 +909,7 @@ char hexbyte(int32_t c)
 
 int32_t init_hexbytes_noT(char *hexbytes,unsigned char *message,long len)
 {
+    static const char hexmap[16] = { '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' };
     int32_t i;
     if ( len <= 0 )
     {
@@ -923,8 +918,8 @@ int32_t init_hexbytes_noT(char *hexbytes,unsigned char *message,long len)
     }
     for (i=0; i<len; i++)
     {
-        hexbytes[i*2] = hexbyte((message[i]>>4) & 0xf);
-        hexbytes[i*2 + 1] = hexbyte(message[i] & 0xf);
+        hexbytes[i*2] = hexmap[message[i] >> 4];
+        hexbytes[i*2 + 1] = hexmap[message[i] & 0xf];
         //printf("i.%d (%02x) [%c%c]\n",i,message[i],hexbytes[i*2],hexbytes[i*2+1]);
     }
     hexbytes[len*2] = 0;
@@ -2411,20 +2406,11 @@ struct safecoin_state *safecoin_stateptr(char *symbol,char *dest)
 
 void safecoin_prefetch(FILE *fp)
 {
-    long fsize,fpos; int32_t incr = 16*1024*1024;
+    long fsize,fpos;
     fpos = ftell(fp);
     fseek(fp,0,SEEK_END);
     fsize = ftell(fp);
-    if ( fsize > incr )
-    {
-        char *ignore = (char *)malloc(incr);
-        if ( ignore != 0 )
-        {
-            rewind(fp);
-            while ( fread(ignore,1,incr,fp) == incr ) // prefetch
-                fprintf(stderr,".");
-            free(ignore);
-        }
-    }
     fseek(fp,fpos,SEEK_SET);
+    if ( fsize > 0 ) // a hint to the kernel, the pages are read in the background and nothing is copied here
+        FileReadAhead(fp,0,(unsigned int)fsize);
 }
@@ -0,0 +1,220 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "safenodes.h"
+
+CSafeNodeRegistry safenodeRegistry;
+
+void CSafeNodeRegistry::Insert(const std::string& kvkey, const CSafeNodeRegistration& reg)
+{
+    mapByKVKey[kvkey] = reg;
+    mapBySafekey[reg.safekey].insert(std::make_pair(reg.height, kvkey));
+    mapByParentkey[reg.parentkey][reg.safekey]++;
+    mapByHeight[reg.height].insert(kvkey);
+}
+
+void CSafeNodeRegistry::Erase(const std::string& kvkey)
+{
+    std::map<std::string, CSafeNodeRegistration>::iterator it = mapByKVKey.find(kvkey);
+    if (it == mapByKVKey.end())
+        return;
+    const CSafeNodeRegistration& reg = it->second;
+
+    std::map<std::string, std::set<std::pair<int32_t, std::string> > >::iterator its = mapBySafekey.find(reg.safekey);
+    if (its != mapBySafekey.end()) {
+        its->second.erase(std::make_pair(reg.height, kvkey));
+        if (its->second.empty())
+            mapBySafekey.erase(its);
+    }
+
+    std::map<std::string, std::map<std::string, int> >::iterator itp = mapByParentkey.find(reg.parentkey);
+    if (itp != mapByParentkey.end()) {
+        std::map<std::string, int>::iterator itc = itp->second.find(reg.safekey);
+        if (itc != itp->second.end() && --itc->second <= 0)
+            itp->second.erase(itc);
+        if (itp->second.empty())
+            mapByParentkey.erase(itp);
+    }
+
+    std::map<int32_t, std::set<std::string> >::iterator ith = mapByHeight.find(reg.height);
+    if (ith != mapByHeight.end()) {
+        ith->second.erase(kvkey);
+        if (ith->second.empty())
+            mapByHeight.erase(ith);
+    }
+
+    mapByKVKey.erase(it);
+}
+
+void CSafeNodeRegistry::Set(const std::string& kvkey, const CSafeNodeRegistration& reg)
+{
+    Erase(kvkey);
+    if (!reg.IsNull())
+        Insert(kvkey, reg);
+}
+
+void CSafeNodeRegistry::Update(const std::string& kvkey, const CSafeNodeRegistration& reg, int32_t nBlockHeight)
+{
+    LOCK(cs);
+    CSafeNodeUndo undo;
+    undo.nBlockHeight = nBlockHeight;
+    undo.kvkey = kvkey;
+    std::map<std::string, CSafeNodeRegistration>::const_iterator it = mapByKVKey.find(kvkey);
+    if (it != mapByKVKey.end())
+        undo.prev = it->second;
+    if (undo.prev.IsNull() && reg.IsNull())
+        return;
+    vUndo.push_back(undo);
+    Set(kvkey, reg);
+}
+
+void CSafeNodeRegistry::Rewind(int32_t nBlockHeight)
+{
+    LOCK(cs);
+    while (!vUndo.empty() && vUndo.back().nBlockHeight >= nBlockHeight) {
+        Set(vUndo.back().kvkey, vUndo.back().prev);
+        vUndo.pop_back();
+    }
+}
+
+void CSafeNodeRegistry::PruneUndo(int32_t nBlockHeight)
+{
+    LOCK(cs);
+    std::vector<CSafeNodeUndo>::iterator it = vUndo.begin();
+    while (it != vUndo.end() && it->nBlockHeight < nBlockHeight)
+        ++it;
+    vUndo.erase(vUndo.begin(), it);
+}
+
+void CSafeNodeRegistry::Load(const std::map<std::string, CSafeNodeRegistration>& mapRegistrations, const std::vector<CSafeNodeUndo>& vUndoIn)
+{
+    LOCK(cs);
+    mapByKVKey.clear();
+    mapBySafekey.clear();
+    mapByParentkey.clear();
+    mapByHeight.clear();
+    for (std::map<std::string, CSafeNodeRegistration>::const_iterator it = mapRegistrations.begin(); it != mapRegistrations.end(); ++it)
+        Insert(it->first, it->second);
+    vUndo = vUndoIn;
+}
+
+std::vector<CSafeNodeUndo> CSafeNodeRegistry::GetUndo(int32_t nFromHeight, int32_t nToHeight) const
+{
+    LOCK(cs);
+    std::vector<CSafeNodeUndo> vRet;
+    for (std::vector<CSafeNodeUndo>::const_iterator it = vUndo.begin(); it != vUndo.end(); ++it) {
+        if (it->nBlockHeight > nFromHeight && it->nBlockHeight <= nToHeight)
+            vRet.push_back(*it);
+    }
+    return vRet;
+}
+
+std::map<std::string, CSafeNodeRegistration> CSafeNodeRegistry::GetAll() const
+{
+    LOCK(cs);
+    return mapByKVKey;
+}
+
+bool CSafeNodeRegistry::Get(const std::string& kvkey, CSafeNodeRegistration& reg) const
+{
+    LOCK(cs);
+    std::map<std::string, CSafeNodeRegistration>::const_iterator it = mapByKVKey.find(kvkey);
+    if (it == mapByKVKey.end())
+        return false;
+    reg = it->second;
+    return true;
+}
+
+bool CSafeNodeRegistry::GetLatest(const std::string& safekey, const CNotarySet& parentkeys, CSafeNodeRegistration& reg) const
+{
+    LOCK(cs);
+    std::map<std::string, std::set<std::pair<int32_t, std::string> > >::const_iterator its = mapBySafekey.find(safekey);
+    if (its == mapBySafekey.end())
+        return false;
+    for (std::set<std::pair<int32_t, std::string> >::const_reverse_iterator it = its->second.rbegin(); it != its->second.rend(); ++it) {
+        std::map<std::string, CSafeNodeRegistration>::const_iterator itk = mapByKVKey.find(it->second);
+        if (itk != mapByKVKey.end() && parentkeys.IsNotary(itk->second.parentkey)) {
+            reg = itk->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<CSafeNodeRegistration> CSafeNodeRegistry::GetActive(int32_t nHeight, const CNotarySet& parentkeys) const
+{
+    LOCK(cs);
+    std::vector<CSafeNodeRegistration> vActive;
+    for (std::map<std::string, std::set<std::pair<int32_t, std::string> > >::const_iterator its = mapBySafekey.begin(); its != mapBySafekey.end(); ++its) {
+        for (std::set<std::pair<int32_t, std::string> >::const_reverse_iterator it = its->second.rbegin(); it != its->second.rend(); ++it) {
+            std::map<std::string, CSafeNodeRegistration>::const_iterator itk = mapByKVKey.find(it->second);
+            if (itk != mapByKVKey.end() && parentkeys.IsNotary(itk->second.parentkey)) {
+                if (itk->second.ValidThru() >= nHeight)
+                    vActive.push_back(itk->second);
+                break;
+            }
+        }
+    }
+    return vActive;
+}
+
+std::vector<SafeNodeTally> CSafeNodeRegistry::GetTally(int32_t nHeight, int32_t nWidth) const
+{
+    LOCK(cs);
+    std::vector<SafeNodeTally> vTally;
+    std::map<std::string, size_t> mapIndex;
+    for (std::map<int32_t, std::set<std::string> >::const_iterator ith = mapByHeight.upper_bound(nHeight - nWidth); ith != mapByHeight.end(); ++ith) {
+        for (std::set<std::string>::const_iterator itk = ith->second.begin(); itk != ith->second.end(); ++itk) {
+            const CSafeNodeRegistration& reg = mapByKVKey.find(*itk)->second;
+            if (reg.keyheight <= SAFENODES_TALLY_START_HEIGHT || reg.keyheight > nHeight || reg.ValidThru() < nHeight)
+                continue;
+
+            std::map<std::string, size_t>::iterator iti = mapIndex.find(reg.parentkey);
+            if (iti == mapIndex.end()) {
+                iti = mapIndex.insert(std::make_pair(reg.parentkey, vTally.size())).first;
+                vTally.push_back(SafeNodeTally(reg.parentkey, 0, std::vector<std::pair<std::string, uint32_t> >()));
+            }
+            SafeNodeTally& tally = vTally[iti->second];
+            std::get<1>(tally)++;
+
+            std::vector<std::pair<std::string, uint32_t> >& vSafeids = std::get<2>(tally);
+            std::vector<std::pair<std::string, uint32_t> >::iterator its = vSafeids.begin();
+            while (its != vSafeids.end() && its->first != reg.safekey)
+                ++its;
+            if (its != vSafeids.end())
+                its->second++;
+            else
+                vSafeids.push_back(std::make_pair(reg.safekey, 1));
+        }
+    }
+    return vTally;
+}
+
+std::set<std::string> CSafeNodeRegistry::GetSafekeys(const std::string& parentkey) const
+{
+    LOCK(cs);
+    std::set<std::string> safekeys;
+    std::map<std::string, std::map<std::string, int> >::const_iterator itp = mapByParentkey.find(parentkey);
+    if (itp != mapByParentkey.end()) {
+        for (std::map<std::string, int>::const_iterator it = itp->second.begin(); it != itp->second.end(); ++it)
+            safekeys.insert(it->first);
+    }
+    return safekeys;
+}
+
+size_t CSafeNodeRegistry::Size() const
+{
+    LOCK(cs);
+    return mapBySafekey.size();
+}
+
+void CSafeNodeRegistry::Clear()
+{
+    LOCK(cs);
+    mapByKVKey.clear();
+    mapBySafekey.clear();
+    mapByParentkey.clear();
+    mapByHeight.clear();
+    vUndo.clear();
+}
@@ -0,0 +1,130 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_SAFENODES_H
+#define SAFECOIN_SAFENODES_H
+
+#include "notaryset.h"
+#include "serialize.h"
+#include "sync.h"
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/** A SafeNode registration, as carried by a beacon KV record (parentkey + height + "1" -> safekey) */
+struct CSafeNodeRegistration
+{
+    std::string safekey;
+    std::string parentkey;
+    int32_t height;     //! registration height embedded in the KV record
+    int32_t duration;   //! number of blocks the registration stays valid
+    int32_t keyheight;  //! height named by the KV key, 0 if parentkey was not a notary there
+
+    CSafeNodeRegistration() : height(0), duration(0), keyheight(0) {}
+    CSafeNodeRegistration(const std::string& safekeyIn, const std::string& parentkeyIn, int32_t heightIn, int32_t durationIn, int32_t keyheightIn) :
+        safekey(safekeyIn), parentkey(parentkeyIn), height(heightIn), duration(durationIn), keyheight(keyheightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(safekey);
+        READWRITE(parentkey);
+        READWRITE(height);
+        READWRITE(duration);
+        READWRITE(keyheight);
+    }
+
+    bool IsNull() const { return safekey.empty(); }
+    int32_t ValidThru() const { return height + duration; }
+};
+
+/** What a KV key held before it was updated in block nBlockHeight */
+struct CSafeNodeUndo
+{
+    int32_t nBlockHeight;
+    std::string kvkey;
+    CSafeNodeRegistration prev;     //! null if the KV key had no registration before
+
+    CSafeNodeUndo() : nBlockHeight(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nBlockHeight);
+        READWRITE(kvkey);
+        READWRITE(prev);
+    }
+};
+
+/** Beacon registrations counted for one parentkey: (parentkey, registrations, [(safekey, registrations)]) */
+typedef std::tuple<std::string, uint32_t, std::vector<std::pair<std::string, uint32_t> > > SafeNodeTally;
+
+/** Registrations before this height predate the SafeNode beacons and are never tallied */
+static const int32_t SAFENODES_TALLY_START_HEIGHT = 750000;
+
+/**
+ * In-memory index of SafeNode registrations, kept in step with the SAFECOIN_KV
+ * store by safecoin_kvupdate() and rewound together with the safecoin events on
+ * reorg. Lets the SafeNode RPCs answer without walking the whole KV hash.
+ */
+class CSafeNodeRegistry
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<std::string, CSafeNodeRegistration> mapByKVKey;
+    //! safekey -> (registration height, KV key), latest registration last
+    std::map<std::string, std::set<std::pair<int32_t, std::string> > > mapBySafekey;
+    //! parentkey -> safekey -> number of registrations
+    std::map<std::string, std::map<std::string, int> > mapByParentkey;
+    //! registration height -> KV keys, for window tallies
+    std::map<int32_t, std::set<std::string> > mapByHeight;
+    std::vector<CSafeNodeUndo> vUndo;
+
+    void Insert(const std::string& kvkey, const CSafeNodeRegistration& reg);
+    void Erase(const std::string& kvkey);
+    void Set(const std::string& kvkey, const CSafeNodeRegistration& reg);
+
+public:
+    /** Record the registration now held by KV key kvkey (null reg drops it), applied in block nBlockHeight */
+    void Update(const std::string& kvkey, const CSafeNodeRegistration& reg, int32_t nBlockHeight);
+    /** Undo every update applied in blocks at or above nBlockHeight */
+    void Rewind(int32_t nBlockHeight);
+    /** Forget undo data for blocks below nBlockHeight, they can no longer be reorged */
+    void PruneUndo(int32_t nBlockHeight);
+
+    /** Replace the whole registry with state loaded from disk */
+    void Load(const std::map<std::string, CSafeNodeRegistration>& mapRegistrations, const std::vector<CSafeNodeUndo>& vUndoIn);
+    /** Undo entries for updates applied in blocks above nFromHeight up to and including nToHeight */
+    std::vector<CSafeNodeUndo> GetUndo(int32_t nFromHeight, int32_t nToHeight) const;
+    /** Every registration, keyed by KV key */
+    std::map<std::string, CSafeNodeRegistration> GetAll() const;
+    /** Registration currently held by KV key kvkey */
+    bool Get(const std::string& kvkey, CSafeNodeRegistration& reg) const;
+
+    /** Latest registration of safekey whose parentkey is in parentkeys */
+    bool GetLatest(const std::string& safekey, const CNotarySet& parentkeys, CSafeNodeRegistration& reg) const;
+    /** Latest registration of every safekey whose parentkey is in parentkeys and which is still valid at nHeight */
+    std::vector<CSafeNodeRegistration> GetActive(int32_t nHeight, const CNotarySet& parentkeys) const;
+    /**
+     * Per parentkey and per safekey registration counts over the nWidth blocks
+     * ending at nHeight, in order of first registration. Matches what scanning
+     * every notary key of every block in that range through the KV store gives.
+     */
+    std::vector<SafeNodeTally> GetTally(int32_t nHeight, int32_t nWidth) const;
+    /** All safekeys registered under parentkey */
+    std::set<std::string> GetSafekeys(const std::string& parentkey) const;
+
+    size_t Size() const;
+    void Clear();
+};
+
+extern CSafeNodeRegistry safenodeRegistry;
+
+#endif // SAFECOIN_SAFENODES_H
@@ -0,0 +1,123 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "safenodesdb.h"
+#include "util.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+static const char DB_SAFENODE_REGISTRATION = 'r';
+static const char DB_SAFENODE_UNDO = 'u';
+static const char DB_BEST_HEIGHT = 'H';
+
+CSafeNodesDB *psafenodes = NULL;
+
+CSafeNodesDB::CSafeNodesDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "safenodes", nCacheSize, fMemory, fWipe)
+{
+    if (!Read(DB_BEST_HEIGHT, nBestHeight))
+        nBestHeight = -1;
+}
+
+bool CSafeNodesDB::WriteBlock(const CSafeNodeRegistry& registry, int32_t nHeight, int32_t nUndoDepth)
+{
+    if (nHeight <= nBestHeight)
+        return true;
+
+    std::vector<CSafeNodeUndo> vUndo = registry.GetUndo(nBestHeight, nHeight);
+    std::map<int32_t, std::vector<CSafeNodeUndo> > mapBlockUndo;
+    CDBBatch batch(*this);
+    if (nBestHeight < 0) {
+        // first write, the registry was built by the safecoinstate replay
+        std::map<std::string, CSafeNodeRegistration> mapAll = registry.GetAll();
+        for (std::map<std::string, CSafeNodeRegistration>::const_iterator it = mapAll.begin(); it != mapAll.end(); ++it)
+            batch.Write(std::make_pair(DB_SAFENODE_REGISTRATION, it->first), it->second);
+    }
+    for (std::vector<CSafeNodeUndo>::const_iterator it = vUndo.begin(); it != vUndo.end(); ++it) {
+        CSafeNodeRegistration reg;
+        if (registry.Get(it->kvkey, reg))
+            batch.Write(std::make_pair(DB_SAFENODE_REGISTRATION, it->kvkey), reg);
+        else
+            batch.Erase(std::make_pair(DB_SAFENODE_REGISTRATION, it->kvkey));
+        mapBlockUndo[it->nBlockHeight].push_back(*it);
+    }
+    // undo data older than the reorg limit is never needed again
+    for (std::map<int32_t, std::vector<CSafeNodeUndo> >::const_iterator it = mapBlockUndo.begin(); it != mapBlockUndo.end(); ++it) {
+        if (it->first > nHeight - nUndoDepth)
+            batch.Write(std::make_pair(DB_SAFENODE_UNDO, it->first), it->second);
+    }
+    if (nBestHeight >= 0) {
+        for (int32_t h = nBestHeight - nUndoDepth + 1; h <= std::min(nBestHeight, nHeight - nUndoDepth); h++)
+            batch.Erase(std::make_pair(DB_SAFENODE_UNDO, h));
+    }
+    batch.Write(DB_BEST_HEIGHT, nHeight);
+    if (!WriteBatch(batch))
+        return false;
+    nBestHeight = nHeight;
+    return true;
+}
+
+bool CSafeNodesDB::DisconnectBlock(int32_t nHeight)
+{
+    if (nBestHeight < nHeight)
+        return true;
+
+    CDBBatch batch(*this);
+    std::vector<CSafeNodeUndo> vUndo;
+    if (Read(std::make_pair(DB_SAFENODE_UNDO, nHeight), vUndo)) {
+        // restore in reverse order, a key may have been updated more than once in the block
+        for (std::vector<CSafeNodeUndo>::const_reverse_iterator it = vUndo.rbegin(); it != vUndo.rend(); ++it) {
+            if (it->prev.IsNull())
+                batch.Erase(std::make_pair(DB_SAFENODE_REGISTRATION, it->kvkey));
+            else
+                batch.Write(std::make_pair(DB_SAFENODE_REGISTRATION, it->kvkey), it->prev);
+        }
+        batch.Erase(std::make_pair(DB_SAFENODE_UNDO, nHeight));
+    }
+    batch.Write(DB_BEST_HEIGHT, nHeight - 1);
+    if (!WriteBatch(batch))
+        return false;
+    nBestHeight = nHeight - 1;
+    return true;
+}
+
+bool CSafeNodesDB::LoadRegistry(CSafeNodeRegistry& registry)
+{
+    if (nBestHeight < 0)
+        return false;
+
+    std::map<std::string, CSafeNodeRegistration> mapRegistrations;
+    std::map<int32_t, std::vector<CSafeNodeUndo> > mapBlockUndo;
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_SAFENODE_REGISTRATION, std::string()));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::string> key;
+        if (!pcursor->GetKey(key) || key.first != DB_SAFENODE_REGISTRATION)
+            break;
+        CSafeNodeRegistration reg;
+        if (!pcursor->GetValue(reg))
+            return error("%s: failed to read registration", __func__);
+        mapRegistrations[key.second] = reg;
+        pcursor->Next();
+    }
+
+    pcursor->Seek(std::make_pair(DB_SAFENODE_UNDO, (int32_t)0));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, int32_t> key;
+        if (!pcursor->GetKey(key) || key.first != DB_SAFENODE_UNDO)
+            break;
+        if (!pcursor->GetValue(mapBlockUndo[key.second]))
+            return error("%s: failed to read undo data", __func__);
+        pcursor->Next();
+    }
+
+    std::vector<CSafeNodeUndo> vUndo;
+    for (std::map<int32_t, std::vector<CSafeNodeUndo> >::const_iterator it = mapBlockUndo.begin(); it != mapBlockUndo.end(); ++it)
+        vUndo.insert(vUndo.end(), it->second.begin(), it->second.end());
+    registry.Load(mapRegistrations, vUndo);
+    LogPrintf("%s: loaded %u safenode registrations up to height %d\n", __func__, mapRegistrations.size(), nBestHeight);
+    return true;
+}
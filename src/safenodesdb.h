@@ -0,0 +1,37 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_SAFENODESDB_H
+#define SAFECOIN_SAFENODESDB_H
+
+#include "dbwrapper.h"
+#include "safenodes.h"
+
+/**
+ * On-disk copy of the SafeNode registry, so it does not have to be rebuilt
+ * from the safecoinstate replay at every start. Registrations are keyed by
+ * their KV key; each block that changed the registry also gets an undo
+ * record so the index can be rolled back together with the chain.
+ */
+class CSafeNodesDB : public CDBWrapper
+{
+private:
+    int32_t nBestHeight;
+
+public:
+    CSafeNodesDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Height up to which the registry has been written, -1 if never */
+    int32_t GetBestHeight() const { return nBestHeight; }
+    /** Write the registry updates of blocks above the best height up to nHeight */
+    bool WriteBlock(const CSafeNodeRegistry& registry, int32_t nHeight, int32_t nUndoDepth);
+    /** Roll the stored registry back over block nHeight */
+    bool DisconnectBlock(int32_t nHeight);
+    /** Fill registry from disk, returns false if nothing was stored yet */
+    bool LoadRegistry(CSafeNodeRegistry& registry);
+};
+
+extern CSafeNodesDB *psafenodes;
+
+#endif // SAFECOIN_SAFENODESDB_H
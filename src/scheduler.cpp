@@ -25,7 +25,10 @@
 #include <boost/bind.hpp>
 #include <utility>
 
-CScheduler::CScheduler() : nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
+/** Most a periodic task is run ahead of time to share a wakeup with another task */
+static const int64_t MAX_SLACK_MILLIS = 10 * 1000;
+
+CScheduler::CScheduler() : nThreadsServicingQueue(0), nLowRunning(0), stopRequested(false), stopWhenEmpty(false)
 {
 }
 
@@ -45,6 +48,33 @@ CScheduler::~CScheduler()
     assert(nThreadsServicingQueue == 0);
 }
 
+// requires newTaskMutex
+bool CScheduler::isRunnable(const Task& task) const
+{
+    if (!task.strKey.empty() && setRunningKeys.count(task.strKey))
+        return false;
+    // keep a thread free for the tasks that are not housekeeping
+    if (task.priority == PRIORITY_LOW && nThreadsServicingQueue > 1 && nLowRunning >= nThreadsServicingQueue - 1)
+        return false;
+    return true;
+}
+
+// requires newTaskMutex
+void CScheduler::finishTask(const Task& task)
+{
+    bool fUnblocked = false;
+    if (!task.strKey.empty()) {
+        setRunningKeys.erase(task.strKey);
+        fUnblocked = true;
+    }
+    if (task.priority == PRIORITY_LOW) {
+        --nLowRunning;
+        fUnblocked = true;
+    }
+    // tasks that were held back by this one may be due already
+    if (fUnblocked)
+        newTaskScheduled.notify_all();
+}
 
 void CScheduler::serviceQueue()
 {
@@ -60,31 +90,60 @@ void CScheduler::serviceQueue()
                 // Wait until there is something to do.
                 newTaskScheduled.wait(lock);
             }
+            if (shouldStop())
+                continue;
 
-            // Wait until either there is a new task, or until
-            // the time of the first item on the queue:
-
-            // Some boost versions have a conflicting overload of wait_until that returns void.
-            // Explicitly use a template here to avoid hitting that overload.
-            while (!shouldStop() && !taskQueue.empty() &&
-                   newTaskScheduled.wait_until<>(lock, taskQueue.begin()->first) != boost::cv_status::timeout) {
-                // Keep waiting until timeout
+            // Pick the due task of the highest priority, the earliest of those, that can run now.
+            // Those that are to run soon may go early by their slack, and the first
+            // runnable one is the time to wait for when none is due.
+            boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+            boost::chrono::system_clock::time_point horizon = now + boost::chrono::milliseconds(MAX_SLACK_MILLIS);
+            std::multimap<boost::chrono::system_clock::time_point, Task>::iterator next = taskQueue.end();
+            boost::chrono::system_clock::time_point wake;
+            bool fWake = false;
+            for (std::multimap<boost::chrono::system_clock::time_point, Task>::iterator it = taskQueue.begin(); it != taskQueue.end(); ++it) {
+                if (!isRunnable(it->second))
+                    continue;
+                if (!fWake) {
+                    wake = it->first;
+                    fWake = true;
+                }
+                if (it->first > horizon)
+                    break;
+                if (it->first - it->second.slack > now)
+                    continue;
+                if (next == taskQueue.end() || it->second.priority < next->second.priority)
+                    next = it;
             }
 
-            // If there are multiple threads, the queue can empty while we're waiting (another
-            // thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty())
+            if (next == taskQueue.end()) {
+                // Wait until there is a new task, one finishes, or the time of the first that can run.
+                // Some boost versions have a conflicting overload of wait_until that returns void.
+                // Explicitly use a template here to avoid hitting that overload.
+                if (fWake)
+                    newTaskScheduled.wait_until<>(lock, wake);
+                else
+                    newTaskScheduled.wait(lock);
                 continue;
+            }
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            Task task = next->second;
+            taskQueue.erase(next);
+            if (!task.strKey.empty())
+                setRunningKeys.insert(task.strKey);
+            if (task.priority == PRIORITY_LOW)
+                ++nLowRunning;
 
-            {
+            try {
                 // Unlock before calling f, so it can reschedule itself or another task
                 // without deadlocking:
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
-                f();
+                task.f();
+            } catch (...) {
+                finishTask(task);
+                throw;
             }
+            finishTask(task);
         } catch (...) {
             --nThreadsServicingQueue;
             throw;
@@ -107,27 +166,42 @@ void CScheduler::stop(bool drain)
 
 void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
 {
+    schedule(f, t, PRIORITY_NORMAL, "");
+}
+
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t, Priority priority,
+                          const std::string& strKey, boost::chrono::milliseconds slack)
+{
+    Task task;
+    task.f = f;
+    task.priority = priority;
+    task.strKey = strKey;
+    task.slack = std::min(slack, boost::chrono::milliseconds(MAX_SLACK_MILLIS));
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue.insert(std::make_pair(t, task));
     }
     newTaskScheduled.notify_one();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds)
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds, Priority priority, const std::string& strKey)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds));
+    schedule(f, boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds), priority, strKey);
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaSeconds)
+static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaSeconds, CScheduler::Priority priority, const std::string& strKey)
 {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaSeconds), deltaSeconds);
+    s->schedule(boost::bind(&Repeat, s, f, deltaSeconds, priority, strKey),
+                boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds),
+                priority, strKey, boost::chrono::milliseconds(deltaSeconds * 100));
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds)
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds, Priority priority, const std::string& strKey)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaSeconds), deltaSeconds);
+    schedule(boost::bind(&Repeat, this, f, deltaSeconds, priority, strKey),
+             boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds),
+             priority, strKey, boost::chrono::milliseconds(deltaSeconds * 100));
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
@@ -29,6 +29,8 @@
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
 #include <map>
+#include <set>
+#include <string>
 
 //
 // Simple class for background tasks that should be run
@@ -47,6 +49,14 @@
 // delete t;
 // delete s; // Must be done after thread is interrupted/joined.
 //
+// Several threads may run serviceQueue. Tasks that must not overlap are given the same key,
+// and housekeeping is scheduled at PRIORITY_LOW so it never holds up the others:
+//
+// s->scheduleEvery(doHousekeeping, 60, CScheduler::PRIORITY_LOW, "housekeeping");
+//
+
+/** Threads servicing the node's scheduler by default */
+static const int DEFAULT_SCHEDULER_THREADS = 2;
 
 class CScheduler
 {
@@ -56,18 +66,36 @@ public:
 
     typedef boost::function<void(void)> Function;
 
+    // Of the tasks that are due, the ones of the highest priority run first.
+    // PRIORITY_LOW tasks never take the last thread servicing the queue, so
+    // with two or more threads a slow one does not delay anything else.
+    enum Priority {
+        PRIORITY_HIGH = 0,
+        PRIORITY_NORMAL = 1,
+        PRIORITY_LOW = 2,
+    };
+
     // Call func at/after time t
     void schedule(Function f, boost::chrono::system_clock::time_point t);
 
+    // The same, with a priority and a key: tasks that share a non-empty key
+    // never run at the same time. A task may be run up to slack early, when
+    // a thread is awake for another one anyway.
+    void schedule(Function f, boost::chrono::system_clock::time_point t, Priority priority,
+                  const std::string& strKey, boost::chrono::milliseconds slack = boost::chrono::milliseconds(0));
+
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaSeconds);
+    void scheduleFromNow(Function f, int64_t deltaSeconds, Priority priority = PRIORITY_NORMAL, const std::string& strKey = "");
 
     // Another convenience method: call f approximately
     // every deltaSeconds forever, starting deltaSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaSeconds);
+    // Periodic tasks have a slack of a tenth of their interval
+    // (at most 10 seconds), so that they are coalesced into the
+    // wakeups of the other tasks rather than each having its own.
+    void scheduleEvery(Function f, int64_t deltaSeconds, Priority priority = PRIORITY_NORMAL, const std::string& strKey = "");
 
     // To keep things as simple as possible, there is no unschedule.
 
@@ -86,13 +114,25 @@ public:
                         boost::chrono::system_clock::time_point &last) const;
 
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    struct Task {
+        Function f;
+        Priority priority;
+        std::string strKey;
+        boost::chrono::milliseconds slack;
+    };
+
+    std::multimap<boost::chrono::system_clock::time_point, Task> taskQueue;
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
+    // keys of the tasks being run, and how many of them are PRIORITY_LOW
+    std::set<std::string> setRunningKeys;
+    int nLowRunning;
     bool stopRequested;
     bool stopWhenEmpty;
     bool shouldStop() { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
+    bool isRunnable(const Task& task) const;
+    void finishTask(const Task& task);
 };
 
 #endif
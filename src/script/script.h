@@ -376,7 +376,11 @@ private:
     int64_t m_value;
 };
 
-typedef prevector<28, unsigned char> CScriptBase;
+/**
+ * Inline capacity of a script. 36 bytes hold the 35 byte pay-to-pubkey scripts of notary and
+ * staking outputs, as well as P2PKH and P2SH, without a heap allocation, and keep sizeof(CScript) at 40.
+ */
+typedef prevector<36, unsigned char> CScriptBase;
 
 /** Serialized script, used inside transaction inputs and outputs */
 class CScript : public CScriptBase
@@ -20,93 +20,67 @@
 
 #include "serverchecker.h"
 #include "script/cc.h"
+#include "script/sigcache.h"
 #include "cc/eval.h"
 
 #include "pubkey.h"
-#include "random.h"
 #include "uint256.h"
-#include "util.h"
-
-#undef __cpuid
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
-
-namespace {
-
-/**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
- */
-class CSignatureCache
-{
-private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_serverchecker;
-
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_serverchecker);
-
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
-    }
-
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there can be no more than 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxservercheckersize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_serverchecker);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
-    }
-};
-
-}
 
 bool ServerTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    uint256 entry = SignatureCacheEntry(sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    // block validation is the last use of an entry, so free its slot on a hit
+    if (GetCachedSignature(entry, !store))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        SetCachedSignature(entry);
     return true;
 }
 
+int ServerTransactionSignatureChecker::CheckCryptoCondition(const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin,
+                                                            const CScript& scriptCode, uint32_t consensusBranchId) const
+{
+    if (ffillBin.empty())
+        return false;
+
+    // a fulfillment without Eval nodes is stored whole, one with them only for its
+    // signatures, as the Eval result depends on chain state
+    uint256 entry = CryptoConditionCacheEntry(*txTo, nIn, amount, consensusBranchId, condBin, ffillBin, false);
+    if (GetCachedSignature(entry, !store))
+        return 1;
+    uint256 evalEntry = CryptoConditionCacheEntry(*txTo, nIn, amount, consensusBranchId, condBin, ffillBin, true);
+    if (GetCachedSignature(evalEntry, !store))
+        return CheckCachedEvalCondition(ffillBin);
+
+    fEvalChecked = false;
+    int out = TransactionSignatureChecker::CheckCryptoCondition(condBin, ffillBin, scriptCode, consensusBranchId);
+    // cc_verify only gets to the Eval nodes once the condition binary and every signature matched
+    if (store && fEvalChecked)
+        SetCachedSignature(evalEntry);
+    else if (store && out == 1)
+        SetCachedSignature(entry);
+    return out;
+}
+
+int ServerTransactionSignatureChecker::CheckCachedEvalCondition(const std::vector<unsigned char>& ffillBin) const
+{
+    CC *cond;
+    int error = cc_readFulfillmentBinaryExt((unsigned char*)ffillBin.data(), ffillBin.size()-1, &cond);
+    if (error || !cond) return -1;
+
+    VerifyEval eval = [] (CC *cond, void *checker) {
+        return ((TransactionSignatureChecker*)checker)->CheckEvalCondition(cond);
+    };
+    int out = cc_verifyEval(cond, eval, (void*)this);
+    cc_free(cond);
+    return out;
+}
+
 /*
  * The reason that these functions are here is that the what used to be the
  * CachingTransactionSignatureChecker, now the ServerTransactionSignatureChecker,
@@ -119,5 +93,6 @@ bool ServerTransactionSignatureChecker::VerifySignature(const std::vector<unsign
 int ServerTransactionSignatureChecker::CheckEvalCondition(const CC *cond) const
 {
     //fprintf(stderr,"call RunCCeval from ServerTransactionSignatureChecker::CheckEvalCondition\n");
+    fEvalChecked = true;
     return RunCCEval(cond, *txTo, nIn);
 }
@@ -31,12 +31,19 @@ class ServerTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
+    //! set when an Eval node ran, whose result depends on chain state and is not cached
+    mutable bool fEvalChecked;
+
+    //! runs just the Eval nodes of a fulfillment whose signatures are in the cache
+    int CheckCachedEvalCondition(const std::vector<unsigned char>& ffillBin) const;
 
 public:
-    ServerTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nIn, const CAmount& amount, bool storeIn, const PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nIn, amount, txdataIn), store(storeIn) {}
-    ServerTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nIn, const CAmount& amount, bool storeIn) : TransactionSignatureChecker(txToIn, nIn, amount), store(storeIn) {}
+    ServerTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nIn, const CAmount& amount, bool storeIn, const PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nIn, amount, txdataIn), store(storeIn), fEvalChecked(false) {}
+    ServerTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nIn, const CAmount& amount, bool storeIn) : TransactionSignatureChecker(txToIn, nIn, amount), store(storeIn), fEvalChecked(false) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+    int CheckCryptoCondition(const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin,
+                             const CScript& scriptCode, uint32_t consensusBranchId) const;
     int CheckEvalCondition(const CC *cond) const;
 };
 
@@ -20,6 +20,10 @@
 
 #include "sigcache.h"
 
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
+#include "primitives/transaction.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
@@ -28,7 +32,8 @@
 #undef __cpuid
 #endif
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
+
+#include <atomic>
 
 namespace {
 
@@ -36,72 +41,139 @@ namespace {
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * Entries are salted SHA256 digests rather than the (sighash, signature, pubkey)
+ * tuples, so an attacker cannot aim for collisions and a slot is 32 bytes. Valid
+ * crypto-condition fulfillments share the table under a differently salted hasher.
  */
 class CSignatureCache
 {
 private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
+    //! Entries are SECP256K1 verified signature and crypto-condition hashes
+    CSHA256 m_salted_hasher;
+    CSHA256 m_salted_cc_hasher;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
     boost::shared_mutex cs_sigcache;
 
 public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    CSignatureCache()
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        uint256 nonce = GetRandHash();
+        // We want the nonce to be 64 bytes long to force the hasher to process
+        // this chunk, which makes later hash computations more efficient. We
+        // just write our 32-byte entropy twice to fill the 64 bytes, and a
+        // different second half for crypto-condition entries.
+        static const unsigned char ccTag[32] = {'c','r','y','p','t','o','c','o','n','d','i','t','i','o','n'};
+        m_salted_hasher.Write(nonce.begin(), 32);
+        m_salted_hasher.Write(nonce.begin(), 32);
+        m_salted_cc_hasher.Write(nonce.begin(), 32);
+        m_salted_cc_hasher.Write(ccTag, 32);
+
+        size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+        size_t nElems = setValid.setup_bytes(nMaxCacheSize);
+        LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to store %zu elements\n",
+                  (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+    void
+    ComputeEntry(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+    {
+        CSHA256(m_salted_hasher).Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
     }
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    void
+    ComputeEntry(uint256& entry, const CTransaction& tx, unsigned int nIn, const CAmount& amount, uint32_t consensusBranchId,
+                 const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin, bool fEval)
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there can be no more than 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
+        unsigned char buf[21];
+        WriteLE32(buf, nIn);
+        WriteLE64(buf+4, amount);
+        WriteLE32(buf+12, consensusBranchId);
+        // length prefix the condition so condition and fulfillment bytes cannot shift
+        WriteLE32(buf+16, condBin.size());
+        buf[20] = fEval;
+        CSHA256(m_salted_cc_hasher).Write(tx.GetHash().begin(), 32).Write(buf, sizeof(buf))
+            .Write(condBin.data(), condBin.size()).Write(ffillBin.data(), ffillBin.size()).Finalize(entry.begin());
+    }
 
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+    bool
+    Get(const uint256& entry, const bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.contains(entry, erase);
+    }
 
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    void Set(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        setValid.insert(entry);
     }
 };
 
+/* In previous versions of this code, signatureCache was a local static variable
+ * in CachingTransactionSignatureChecker::VerifySignature. It is shared with the
+ * ServerTransactionSignatureChecker now, and sized from -maxsigcachesize on first
+ * use, which InitSignatureCache makes happen once the arguments are parsed.
+ */
+CSignatureCache& SignatureCache()
+{
+    static CSignatureCache signatureCache;
+    return signatureCache;
+}
+
+}
+
+void InitSignatureCache()
+{
+    SignatureCache();
+}
+
+uint256 SignatureCacheEntry(const uint256& sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+{
+    uint256 entry;
+    SignatureCache().ComputeEntry(entry, sighash, vchSig, pubkey);
+    return entry;
+}
+
+uint256 CryptoConditionCacheEntry(const CTransaction& tx, unsigned int nIn, const CAmount& amount, uint32_t consensusBranchId,
+                                  const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin, bool fEval)
+{
+    uint256 entry;
+    SignatureCache().ComputeEntry(entry, tx, nIn, amount, consensusBranchId, condBin, ffillBin, fEval);
+    return entry;
+}
+
+static std::atomic<uint64_t> nSignatureCacheHits(0), nSignatureCacheMisses(0);
+
+bool GetCachedSignature(const uint256& entry, bool erase)
+{
+    bool fHit = SignatureCache().Get(entry, erase);
+    (fHit ? nSignatureCacheHits : nSignatureCacheMisses).fetch_add(1, std::memory_order_relaxed);
+    return fHit;
+}
+
+void GetSignatureCacheStats(uint64_t& nHits, uint64_t& nMisses)
+{
+    nHits = nSignatureCacheHits.load(std::memory_order_relaxed);
+    nMisses = nSignatureCacheMisses.load(std::memory_order_relaxed);
+}
+
+void SetCachedSignature(const uint256& entry)
+{
+    SignatureCache().Set(entry);
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    uint256 entry = SignatureCacheEntry(sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    if (GetCachedSignature(entry, !store))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        SetCachedSignature(entry);
     return true;
 }
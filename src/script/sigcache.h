@@ -25,8 +25,55 @@
 
 #include <vector>
 
+// DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
+// systems). Due to how we count cache size, actual memory usage is slightly
+// more (~32.25 MB)
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+// Maximum sig cache size allowed
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
 class CPubKey;
 
+/**
+ * We're hashing a nonce into the entries themselves, so we don't need extra
+ * blinding in the set hash computation.
+ *
+ * This may exhibit platform endian dependent behavior but because these are
+ * nonced hashes (random) and this state is only ever used locally it is safe.
+ * All that matters is local consistency.
+ */
+class SignatureCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select <8, "SignatureCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin()+4*hash_select, 4);
+        return u;
+    }
+};
+
+/** Size the shared signature cache from -maxsigcachesize (in MiB) */
+void InitSignatureCache();
+
+/** Salted cache entry for a valid signature */
+uint256 SignatureCacheEntry(const uint256& sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey);
+/**
+ * Salted cache entry for a valid crypto-condition fulfillment. The transaction, input,
+ * amount and branch fix the sighash, so a hit needs neither the sighash nor the
+ * fulfillment parsed. With fEval the entry only vouches for the condition binary and
+ * the signatures, the Eval nodes still have to be run against the chain.
+ */
+uint256 CryptoConditionCacheEntry(const CTransaction& tx, unsigned int nIn, const CAmount& amount, uint32_t consensusBranchId,
+                                  const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin, bool fEval);
+/** Look an entry up, erasing it on a hit when it will not be needed again (block validation) */
+bool GetCachedSignature(const uint256& entry, bool erase);
+void SetCachedSignature(const uint256& entry);
+/** Lookups that hit and missed since startup, for the /metrics endpoint */
+void GetSignatureCacheStats(uint64_t& nHits, uint64_t& nMisses);
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -0,0 +1,91 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "shieldedcache.h"
+
+#include "hash.h"
+#include "memusage.h"
+#include "random.h"
+
+#include <algorithm>
+
+CNullifierFilter::CNullifierFilter() : nBlocks(0), nElements(0), nCapacity(0)
+{
+    GetRandBytes((unsigned char*)&k0, sizeof(k0));
+    GetRandBytes((unsigned char*)&k1, sizeof(k1));
+    Reset(MIN_NULLIFIER_FILTER_ELEMENTS);
+}
+
+// block from the high half of the hash, the bits within it by double hashing the low half
+void CNullifierFilter::Positions(const uint256& nf, size_t& nBlock, uint32_t& a, uint32_t& b) const
+{
+    uint64_t h = SipHashUint256(k0, k1, nf);
+    nBlock = (size_t)(((h >> 32) * (uint64_t)nBlocks) >> 32);
+    a = (uint32_t)h;
+    b = (a >> 16) | (a << 16) | 1;
+}
+
+void CNullifierFilter::Reset(size_t nCapacityIn)
+{
+    LOCK(cs);
+    nCapacity = std::max(nCapacityIn, MIN_NULLIFIER_FILTER_ELEMENTS);
+    nBlocks = (nCapacity * BITS_PER_ELEMENT + BLOCK_WORDS * 64 - 1) / (BLOCK_WORDS * 64);
+    vData.assign(nBlocks * BLOCK_WORDS, 0);
+    nElements = 0;
+}
+
+void CNullifierFilter::Insert(const uint256& nf)
+{
+    size_t nBlock;
+    uint32_t a, b;
+    LOCK(cs);
+    Positions(nf, nBlock, a, b);
+    uint64_t* block = &vData[nBlock * BLOCK_WORDS];
+    for (int i = 0; i < HASHES; i++, a += b)
+        block[(a >> 6) & (BLOCK_WORDS - 1)] |= (uint64_t)1 << (a & 63);
+    nElements++;
+}
+
+bool CNullifierFilter::MayContain(const uint256& nf) const
+{
+    size_t nBlock;
+    uint32_t a, b;
+    LOCK(cs);
+    Positions(nf, nBlock, a, b);
+    const uint64_t* block = &vData[nBlock * BLOCK_WORDS];
+    for (int i = 0; i < HASHES; i++, a += b) {
+        if (!(block[(a >> 6) & (BLOCK_WORDS - 1)] & ((uint64_t)1 << (a & 63))))
+            return false;
+    }
+    return true;
+}
+
+void CNullifierFilter::Swap(CNullifierFilter& other)
+{
+    LOCK2(cs, other.cs);
+    vData.swap(other.vData);
+    std::swap(nBlocks, other.nBlocks);
+    std::swap(nElements, other.nElements);
+    std::swap(nCapacity, other.nCapacity);
+    std::swap(k0, other.k0);
+    std::swap(k1, other.k1);
+}
+
+bool CNullifierFilter::IsFull() const
+{
+    LOCK(cs);
+    return nElements >= nCapacity;
+}
+
+size_t CNullifierFilter::Size() const
+{
+    LOCK(cs);
+    return nElements;
+}
+
+size_t CNullifierFilter::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return memusage::DynamicUsage(vData);
+}
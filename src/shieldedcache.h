@@ -0,0 +1,122 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_SHIELDEDCACHE_H
+#define SAFECOIN_SHIELDEDCACHE_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+/** Anchors CCoinsViewDB keeps in memory for each pool */
+static const size_t DEFAULT_ANCHOR_CACHE_SIZE = 64;
+/** Room for this many nullifiers at least, the filter grows with the set */
+static const size_t MIN_NULLIFIER_FILTER_ELEMENTS = 1 << 16;
+
+/**
+ * A blocked Bloom filter over the spent nullifiers of one pool. Every element
+ * sets 8 of the 512 bits of a single cache line, about 0.2% false positives at
+ * the 16 bits per element it is sized for. Nullifiers are hashed with a random
+ * key, so nobody can pick ones that all land in the same block. There is no
+ * removal, a nullifier unspent by a reorg only costs a disk read later.
+ */
+class CNullifierFilter
+{
+private:
+    static const size_t BLOCK_WORDS = 8;
+    static const int BITS_PER_ELEMENT = 16;
+    static const int HASHES = 8;
+
+    mutable CCriticalSection cs;
+    std::vector<uint64_t> vData;
+    size_t nBlocks;
+    size_t nElements;
+    size_t nCapacity;
+    uint64_t k0, k1;
+
+    void Positions(const uint256& nf, size_t& nBlock, uint32_t& a, uint32_t& b) const;
+
+public:
+    CNullifierFilter();
+
+    /** Empty the filter and size it for nCapacityIn nullifiers */
+    void Reset(size_t nCapacityIn);
+    void Insert(const uint256& nf);
+    /** False only for a nullifier that was never inserted */
+    bool MayContain(const uint256& nf) const;
+    /** Take over a filter built on the side, readers never see one half filled */
+    void Swap(CNullifierFilter& other);
+    /** Past the size it was made for, the false positive rate climbs from here */
+    bool IsFull() const;
+    size_t Size() const;
+    size_t DynamicMemoryUsage() const;
+};
+
+/** The most recently used anchors of one pool, by root */
+template <typename Tree>
+class CAnchorCache
+{
+private:
+    typedef std::list<std::pair<uint256, Tree> > AnchorList;
+
+    mutable CCriticalSection cs;
+    //! most recently used first
+    mutable AnchorList listAnchors;
+    std::map<uint256, typename AnchorList::iterator> mapAnchors;
+    size_t nMaxSize;
+
+public:
+    explicit CAnchorCache(size_t nMaxSizeIn = DEFAULT_ANCHOR_CACHE_SIZE) : nMaxSize(nMaxSizeIn) {}
+
+    bool Get(const uint256& rt, Tree& tree) const
+    {
+        LOCK(cs);
+        typename std::map<uint256, typename AnchorList::iterator>::const_iterator it = mapAnchors.find(rt);
+        if (it == mapAnchors.end())
+            return false;
+        listAnchors.splice(listAnchors.begin(), listAnchors, it->second);
+        tree = it->second->second;
+        return true;
+    }
+
+    void Insert(const uint256& rt, const Tree& tree)
+    {
+        LOCK(cs);
+        typename std::map<uint256, typename AnchorList::iterator>::iterator it = mapAnchors.find(rt);
+        if (it != mapAnchors.end()) {
+            it->second->second = tree;
+            listAnchors.splice(listAnchors.begin(), listAnchors, it->second);
+            return;
+        }
+        listAnchors.push_front(std::make_pair(rt, tree));
+        mapAnchors[rt] = listAnchors.begin();
+        while (listAnchors.size() > nMaxSize) {
+            mapAnchors.erase(listAnchors.back().first);
+            listAnchors.pop_back();
+        }
+    }
+
+    void Erase(const uint256& rt)
+    {
+        LOCK(cs);
+        typename std::map<uint256, typename AnchorList::iterator>::iterator it = mapAnchors.find(rt);
+        if (it == mapAnchors.end())
+            return;
+        listAnchors.erase(it->second);
+        mapAnchors.erase(it);
+    }
+
+    size_t Size() const
+    {
+        LOCK(cs);
+        return listAnchors.size();
+    }
+};
+
+#endif // SAFECOIN_SHIELDEDCACHE_H
@@ -0,0 +1,562 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stratum.h"
+
+#include "arith_uint256.h"
+#include "chainparams.h"
+#include "chainparamsbase.h"
+#include "crypto/common.h"
+#include "init.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "miner.h"
+#include "netbase.h"
+#include "pow.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "validationinterface.h"
+#ifdef ENABLE_WALLET
+#include "wallet/wallet.h"
+#endif
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+#include <univalue.h>
+
+#include "safecoin_defs.h"
+
+arith_uint256 safecoin_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t height,int32_t goalperc,int32_t newStakerActive);
+int32_t safecoin_newStakerActive(int32_t height, uint32_t timestamp);
+
+/** Bytes of the 32 byte header nonce that the server gives each connection, the miner picks the rest */
+static const unsigned int STRATUM_NONCE1_SIZE = 4;
+
+// stratum error codes
+static const int STRATUM_ERROR_OTHER = 20;
+static const int STRATUM_ERROR_JOB_NOT_FOUND = 21;
+static const int STRATUM_ERROR_DUPLICATE = 22;
+static const int STRATUM_ERROR_LOW_DIFFICULTY = 23;
+static const int STRATUM_ERROR_UNAUTHORIZED = 24;
+static const int STRATUM_ERROR_NOT_SUBSCRIBED = 25;
+
+/** A block template handed to the miners, the header is completed with each share */
+struct CStratumJob
+{
+    std::string strId;
+    CBlock block;
+    int nHeight;
+    arith_uint256 hashTarget;
+};
+
+struct CStratumClient
+{
+    CService addr;
+    std::string strNonce1;
+    std::string strWorker;
+    bool fSubscribed;
+    bool fAuthorized;
+    uint64_t nAccepted;
+    uint64_t nRejected;
+
+    CStratumClient() : fSubscribed(false), fAuthorized(false), nAccepted(0), nRejected(0) {}
+};
+
+// Everything below is only touched on the stratum thread, apart from fTipChanged and
+// the event_active on eventJob from the validation interface.
+static struct event_base* eventBase = NULL;
+static std::vector<struct evconnlistener*> vListeners;
+static struct event* eventJob = NULL;
+static boost::thread threadStratum;
+static std::vector<CSubNet> vAllowSubnets;
+static std::atomic<bool> fTipChanged(false);
+
+static std::map<struct bufferevent*, CStratumClient> mapClients;
+static std::map<std::string, CStratumJob> mapJobs;
+static std::deque<std::string> dqJobs;
+static std::set<uint256> setShares;
+static uint32_t nNextNonce1;
+static uint64_t nNextJobId;
+static arith_uint256 shareTarget;
+static unsigned int nLastTransactionsUpdated;
+static int64_t nLastJobTime;
+#ifdef ENABLE_WALLET
+static CReserveKey* pStratumReserveKey = NULL;
+#endif
+
+class CStratumNotifier : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex)
+    {
+        // the job is rebuilt on the stratum thread, this only wakes it
+        fTipChanged = true;
+        if (eventJob)
+            event_active(eventJob, EV_TIMEOUT, 0);
+    }
+};
+static CStratumNotifier* pStratumNotifier = NULL;
+
+static void StratumSend(struct bufferevent* bev, const UniValue& msg)
+{
+    std::string strLine = msg.write() + "\n";
+    bufferevent_write(bev, strLine.data(), strLine.size());
+}
+
+static void StratumReply(struct bufferevent* bev, const UniValue& id, const UniValue& result)
+{
+    UniValue reply(UniValue::VOBJ);
+    reply.push_back(Pair("id", id));
+    reply.push_back(Pair("result", result));
+    reply.push_back(Pair("error", NullUniValue));
+    StratumSend(bev, reply);
+}
+
+static void StratumError(struct bufferevent* bev, const UniValue& id, int nCode, const std::string& strMessage)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back(nCode);
+    error.push_back(strMessage);
+    error.push_back(NullUniValue);
+    UniValue reply(UniValue::VOBJ);
+    reply.push_back(Pair("id", id));
+    reply.push_back(Pair("result", NullUniValue));
+    reply.push_back(Pair("error", error));
+    StratumSend(bev, reply);
+}
+
+static void StratumNotify(struct bufferevent* bev, const std::string& strMethod, const UniValue& params)
+{
+    UniValue msg(UniValue::VOBJ);
+    msg.push_back(Pair("id", NullUniValue));
+    msg.push_back(Pair("method", strMethod));
+    msg.push_back(Pair("params", params));
+    StratumSend(bev, msg);
+}
+
+/** A little endian field as it is serialized in the header */
+template <typename T>
+static std::string HeaderHex(const T& obj)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << obj;
+    return HexStr(ss.begin(), ss.end());
+}
+
+static UniValue JobParams(const CStratumJob& job, bool fClean)
+{
+    const CBlock& block = job.block;
+    UniValue params(UniValue::VARR);
+    params.push_back(job.strId);
+    params.push_back(HeaderHex(block.nVersion));
+    params.push_back(HeaderHex(block.hashPrevBlock));
+    params.push_back(HeaderHex(block.hashMerkleRoot));
+    params.push_back(HeaderHex(block.hashFinalSaplingRoot));
+    params.push_back(HeaderHex(block.nTime));
+    params.push_back(HeaderHex(block.nBits));
+    params.push_back(fClean);
+    return params;
+}
+
+static arith_uint256 ShareTarget(const CStratumJob& job)
+{
+    // never harder than a block
+    return std::max(shareTarget, job.hashTarget);
+}
+
+static bool BuildStratumJob(bool fClean)
+{
+    int nHeight;
+    {
+        LOCK(cs_main);
+        if (chainActive.LastTip() == NULL || IsInitialBlockDownload())
+            return false;
+        nHeight = chainActive.LastTip()->GetHeight() + 1;
+    }
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+
+#ifdef ENABLE_WALLET
+    if (pStratumReserveKey == NULL && pwalletMain)
+        pStratumReserveKey = new CReserveKey(pwalletMain);
+    if (pStratumReserveKey == NULL)
+        return false;
+    std::unique_ptr<CBlockTemplate> ptemplate(CreateNewBlockWithKey(*pStratumReserveKey, nHeight, SAFECOIN_MAXGPUCOUNT));
+#else
+    std::unique_ptr<CBlockTemplate> ptemplate(CreateNewBlockWithKey());
+#endif
+    if (!ptemplate)
+        return false;
+
+    CStratumJob job;
+    job.strId = strprintf("%x", ++nNextJobId);
+    job.block = ptemplate->block;
+    job.nHeight = nHeight;
+    {
+        LOCK(cs_main);
+        CBlockIndex* pindexPrev = chainActive.LastTip();
+        if (pindexPrev == NULL || pindexPrev->GetBlockHash() != job.block.hashPrevBlock)
+            return false; // the tip moved while the template was built, the next wakeup has the new one
+        UpdateTime(&job.block, Params().GetConsensus(), pindexPrev);
+    }
+    job.hashTarget.SetCompact(job.block.nBits);
+    if (ASSETCHAINS_STAKED != 0) {
+        int32_t PoSperc;
+        job.hashTarget = safecoin_PoWtarget(&PoSperc, job.hashTarget, nHeight, ASSETCHAINS_STAKED, safecoin_newStakerActive(nHeight, job.block.nTime));
+    }
+
+    if (fClean) {
+        mapJobs.clear();
+        dqJobs.clear();
+        setShares.clear();
+    }
+    while (dqJobs.size() >= MAX_STRATUM_JOBS) {
+        mapJobs.erase(dqJobs.front());
+        dqJobs.pop_front();
+    }
+    mapJobs[job.strId] = job;
+    dqJobs.push_back(job.strId);
+    nLastTransactionsUpdated = nTransactionsUpdated;
+    nLastJobTime = GetTime();
+
+    UniValue params = JobParams(job, fClean);
+    UniValue target(UniValue::VARR);
+    target.push_back(ShareTarget(job).GetHex());
+    for (std::map<struct bufferevent*, CStratumClient>::iterator it = mapClients.begin(); it != mapClients.end(); ++it) {
+        if (!it->second.fSubscribed)
+            continue;
+        StratumNotify(it->first, "mining.set_target", target);
+        StratumNotify(it->first, "mining.notify", params);
+    }
+    LogPrint("stratum", "stratum: job %s at height %d with %u transactions for %u miners%s\n",
+             job.strId, nHeight, job.block.vtx.size(), mapClients.size(), fClean ? " (clean)" : "");
+    return true;
+}
+
+static void JobCallback(evutil_socket_t, short, void*)
+{
+    bool fNewTip = fTipChanged.exchange(false);
+    if (mapClients.empty())
+        return;
+    if (fNewTip || dqJobs.empty())
+        BuildStratumJob(true);
+    else if (mempool.GetTransactionsUpdated() != nLastTransactionsUpdated &&
+             GetTime() - nLastJobTime >= GetArg("-stratumjobinterval", DEFAULT_STRATUM_JOB_INTERVAL))
+        BuildStratumJob(false);
+}
+
+static void SubmitShare(struct bufferevent* bev, CStratumClient& client, const UniValue& id, const UniValue& params)
+{
+    if (!client.fAuthorized)
+        return StratumError(bev, id, STRATUM_ERROR_UNAUTHORIZED, "Unauthorized worker");
+    if (params.size() < 5 || !params[1].isStr() || !params[2].isStr() || !params[3].isStr() || !params[4].isStr())
+        return StratumError(bev, id, STRATUM_ERROR_OTHER, "Expected worker, job id, time, nonce2 and solution");
+
+    std::map<std::string, CStratumJob>::iterator mi = mapJobs.find(params[1].get_str());
+    if (mi == mapJobs.end()) {
+        client.nRejected++;
+        return StratumError(bev, id, STRATUM_ERROR_JOB_NOT_FOUND, "Job not found");
+    }
+    const CStratumJob& job = mi->second;
+
+    std::vector<unsigned char> vTime = ParseHex(params[2].get_str());
+    std::vector<unsigned char> vNonce = ParseHex(client.strNonce1 + params[3].get_str());
+    std::vector<unsigned char> vSolution = ParseHex(params[4].get_str());
+    if (vTime.size() != 4 || vNonce.size() != 32 || vSolution.empty()) {
+        client.nRejected++;
+        return StratumError(bev, id, STRATUM_ERROR_OTHER, "Malformed time, nonce2 or solution");
+    }
+
+    CBlockHeader header = job.block.GetBlockHeader();
+    header.nTime = ReadLE32(&vTime[0]);
+    uint256 nonce;
+    memcpy(nonce.begin(), &vNonce[0], 32);
+    header.nNonce = nonce;
+    try {
+        // the solution comes with its compact size, as in the header
+        CDataStream ss(vSolution, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> header.nSolution;
+    } catch (const std::exception&) {
+        client.nRejected++;
+        return StratumError(bev, id, STRATUM_ERROR_OTHER, "Malformed solution");
+    }
+
+    if (ASSETCHAINS_ALGO == ASSETCHAINS_EQUIHASH && !CheckEquihashSolution(&header, Params())) {
+        client.nRejected++;
+        return StratumError(bev, id, STRATUM_ERROR_OTHER, "Invalid solution");
+    }
+    uint256 hash = header.GetHash();
+    if (UintToArith256(hash) > ShareTarget(job)) {
+        client.nRejected++;
+        return StratumError(bev, id, STRATUM_ERROR_LOW_DIFFICULTY, "Low difficulty share");
+    }
+    if (!setShares.insert(hash).second) {
+        client.nRejected++;
+        return StratumError(bev, id, STRATUM_ERROR_DUPLICATE, "Duplicate share");
+    }
+    client.nAccepted++;
+
+    if (UintToArith256(hash) <= job.hashTarget) {
+        CBlock block = job.block;
+        block.nTime = header.nTime;
+        block.nNonce = header.nNonce;
+        block.nSolution = header.nSolution;
+        CValidationState state;
+        bool fAccepted = ProcessNewBlock(1, job.nHeight, state, NULL, &block, true, NULL);
+        LogPrintf("stratum: block %s at height %d from %s (%s) %s\n", hash.GetHex(), job.nHeight,
+                  client.strWorker, client.addr.ToString(), fAccepted ? "accepted" : "rejected: " + state.GetRejectReason());
+#ifdef ENABLE_WALLET
+        if (fAccepted && pStratumReserveKey) {
+            pStratumReserveKey->KeepKey();
+            delete pStratumReserveKey;
+            pStratumReserveKey = NULL;
+        }
+#endif
+    }
+    StratumReply(bev, id, true);
+}
+
+static void HandleRequest(struct bufferevent* bev, CStratumClient& client, const std::string& strLine)
+{
+    UniValue request;
+    if (!request.read(strLine) || !request.isObject()) {
+        LogPrint("stratum", "stratum: unparsable request from %s\n", client.addr.ToString());
+        return;
+    }
+    const UniValue& id = find_value(request, "id");
+    const UniValue& method = find_value(request, "method");
+    UniValue params = find_value(request, "params");
+    if (!method.isStr())
+        return StratumError(bev, id, STRATUM_ERROR_OTHER, "Missing method");
+    if (!params.isArray())
+        params = UniValue(UniValue::VARR);
+    const std::string& strMethod = method.get_str();
+
+    if (strMethod == "mining.subscribe") {
+        client.fSubscribed = true;
+        UniValue result(UniValue::VARR);
+        result.push_back(NullUniValue);
+        result.push_back(client.strNonce1);
+        StratumReply(bev, id, result);
+    } else if (strMethod == "mining.authorize") {
+        if (!client.fSubscribed)
+            return StratumError(bev, id, STRATUM_ERROR_NOT_SUBSCRIBED, "Not subscribed");
+        // the payout is the node's, the worker name is only for the log and the pool's accounting
+        client.fAuthorized = true;
+        client.strWorker = params.size() > 0 && params[0].isStr() ? SanitizeString(params[0].get_str()) : "";
+        StratumReply(bev, id, true);
+        if (dqJobs.empty()) {
+            BuildStratumJob(true);
+        } else {
+            UniValue target(UniValue::VARR);
+            const CStratumJob& job = mapJobs[dqJobs.back()];
+            target.push_back(ShareTarget(job).GetHex());
+            StratumNotify(bev, "mining.set_target", target);
+            StratumNotify(bev, "mining.notify", JobParams(job, true));
+        }
+    } else if (strMethod == "mining.extranonce.subscribe") {
+        StratumReply(bev, id, true);
+    } else if (strMethod == "mining.submit") {
+        SubmitShare(bev, client, id, params);
+    } else {
+        StratumError(bev, id, STRATUM_ERROR_OTHER, "Method not found");
+    }
+}
+
+static void CloseClient(struct bufferevent* bev)
+{
+    std::map<struct bufferevent*, CStratumClient>::iterator it = mapClients.find(bev);
+    if (it != mapClients.end()) {
+        LogPrint("stratum", "stratum: %s (%s) left, %d accepted and %d rejected shares\n", it->second.strWorker,
+                 it->second.addr.ToString(), it->second.nAccepted, it->second.nRejected);
+        mapClients.erase(it);
+    }
+    bufferevent_free(bev);
+}
+
+static void ReadCallback(struct bufferevent* bev, void*)
+{
+    std::map<struct bufferevent*, CStratumClient>::iterator it = mapClients.find(bev);
+    if (it == mapClients.end())
+        return;
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t nLength;
+    char* pszLine;
+    while ((pszLine = evbuffer_readln(input, &nLength, EVBUFFER_EOL_CRLF)) != NULL) {
+        std::string strLine(pszLine, nLength);
+        free(pszLine);
+        if (nLength > MAX_STRATUM_LINE)
+            return CloseClient(bev);
+        HandleRequest(bev, it->second, strLine);
+    }
+    if (evbuffer_get_length(input) > MAX_STRATUM_LINE)
+        CloseClient(bev);
+}
+
+static void EventCallback(struct bufferevent* bev, short what, void*)
+{
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
+        CloseClient(bev);
+}
+
+static void AcceptCallback(struct evconnlistener*, evutil_socket_t fd, struct sockaddr* address, int, void*)
+{
+    CService addr;
+    addr.SetSockAddr(address);
+    bool fAllowed = false;
+    BOOST_FOREACH(const CSubNet& subnet, vAllowSubnets)
+        if (subnet.Match(addr))
+            fAllowed = true;
+    if (!fAllowed || mapClients.size() >= (size_t)MAX_STRATUM_CLIENTS) {
+        LogPrint("stratum", "stratum: refused connection from %s\n", addr.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+
+    struct bufferevent* bev = bufferevent_socket_new(eventBase, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+    CStratumClient& client = mapClients[bev];
+    client.addr = addr;
+    uint32_t nNonce1 = nNextNonce1++;
+    client.strNonce1 = HexStr((unsigned char*)&nNonce1, (unsigned char*)&nNonce1 + STRATUM_NONCE1_SIZE);
+    bufferevent_setcb(bev, ReadCallback, NULL, EventCallback, NULL);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+    LogPrint("stratum", "stratum: connection from %s\n", addr.ToString());
+}
+
+static void ThreadStratum(struct event_base* base)
+{
+    RenameThread("safecoin-stratum");
+    event_base_dispatch(base);
+}
+
+static bool StratumInitError(const std::string& strError)
+{
+    uiInterface.ThreadSafeMessageBox(strError, "", CClientUIInterface::MSG_ERROR);
+    return false;
+}
+
+static bool InitStratumAllowList()
+{
+    vAllowSubnets.clear();
+    vAllowSubnets.push_back(CSubNet("127.0.0.0/8"));
+    vAllowSubnets.push_back(CSubNet("::1"));
+    if (mapMultiArgs.count("-stratumallowip")) {
+        BOOST_FOREACH(const std::string& strAllow, mapMultiArgs["-stratumallowip"]) {
+            CSubNet subnet(strAllow);
+            if (!subnet.IsValid())
+                return StratumInitError(strprintf(_("Invalid -stratumallowip subnet specification: %s"), strAllow));
+            vAllowSubnets.push_back(subnet);
+        }
+    }
+    return true;
+}
+
+bool StartStratumServer()
+{
+    if (!InitStratumAllowList())
+        return false;
+
+    int64_t nDifficulty = GetArg("-stratumdifficulty", DEFAULT_STRATUM_DIFFICULTY);
+    if (nDifficulty < 1)
+        return StratumInitError(_("-stratumdifficulty must be at least 1"));
+    shareTarget = UintToArith256(Params().GetConsensus().powLimit) / arith_uint256((uint64_t)nDifficulty);
+    nNextNonce1 = GetRand(std::numeric_limits<uint32_t>::max());
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    eventBase = event_base_new();
+    if (!eventBase)
+        return StratumInitError(_("Could not create the stratum event base"));
+
+    int nDefaultPort = BaseParams().RPCPort() + 1;
+    std::vector<std::string> vBind;
+    if (mapMultiArgs.count("-stratumbind"))
+        vBind = mapMultiArgs["-stratumbind"];
+    else
+        vBind.push_back("127.0.0.1");
+    BOOST_FOREACH(const std::string& strBind, vBind) {
+        CService addrBind;
+        if (!Lookup(strBind.c_str(), addrBind, GetArg("-stratumport", nDefaultPort), false))
+            return StratumInitError(strprintf(_("Cannot resolve -stratumbind address: '%s'"), strBind));
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        if (!addrBind.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+            return StratumInitError(strprintf(_("Cannot bind stratum to %s"), addrBind.ToString()));
+        struct evconnlistener* listener = evconnlistener_new_bind(eventBase, AcceptCallback, NULL,
+                LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&sockaddr, len);
+        if (!listener)
+            return StratumInitError(strprintf(_("Cannot bind stratum to %s"), addrBind.ToString()));
+        vListeners.push_back(listener);
+        LogPrintf("Stratum server listening on %s\n", addrBind.ToString());
+    }
+
+    // the timer looks at the mempool, a new tip wakes it right away
+    eventJob = event_new(eventBase, -1, EV_PERSIST, JobCallback, NULL);
+    struct timeval tv = {1, 0};
+    event_add(eventJob, &tv);
+
+    pStratumNotifier = new CStratumNotifier();
+    RegisterValidationInterface(pStratumNotifier);
+    threadStratum = boost::thread(boost::bind(&ThreadStratum, eventBase));
+    return true;
+}
+
+void InterruptStratumServer()
+{
+    if (pStratumNotifier)
+        UnregisterValidationInterface(pStratumNotifier);
+    if (eventBase)
+        event_base_loopbreak(eventBase);
+}
+
+void StopStratumServer()
+{
+    InterruptStratumServer();
+    if (threadStratum.joinable())
+        threadStratum.join();
+    for (std::map<struct bufferevent*, CStratumClient>::iterator it = mapClients.begin(); it != mapClients.end(); ++it)
+        bufferevent_free(it->first);
+    mapClients.clear();
+    BOOST_FOREACH(struct evconnlistener* listener, vListeners)
+        evconnlistener_free(listener);
+    vListeners.clear();
+    if (eventJob) {
+        event_free(eventJob);
+        eventJob = NULL;
+    }
+    if (eventBase) {
+        event_base_free(eventBase);
+        eventBase = NULL;
+    }
+    delete pStratumNotifier;
+    pStratumNotifier = NULL;
+#ifdef ENABLE_WALLET
+    delete pStratumReserveKey;
+    pStratumReserveKey = NULL;
+#endif
+}
@@ -0,0 +1,35 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_STRATUM_H
+#define SAFECOIN_STRATUM_H
+
+#include <stdint.h>
+
+/** Default for -stratum, serve pool miners directly */
+static const bool DEFAULT_STRATUM = false;
+/** Default for -stratumdifficulty, the share target is the pow limit divided by it */
+static const int64_t DEFAULT_STRATUM_DIFFICULTY = 1;
+/** Default for -stratumjobinterval, seconds before a job is rebuilt for new mempool transactions */
+static const int64_t DEFAULT_STRATUM_JOB_INTERVAL = 30;
+/** Most miners connected at once */
+static const int MAX_STRATUM_CLIENTS = 1024;
+/** Jobs still accepted shares for, older ones are forgotten */
+static const unsigned int MAX_STRATUM_JOBS = 8;
+/** Longest request line, a solution of the largest Equihash parameters fits well within it */
+static const unsigned int MAX_STRATUM_LINE = 16 * 1024;
+
+/**
+ * Stratum server (ZIP 301 for Equihash, the same messages for VerusHash) on -stratumport.
+ * Jobs are built from the node's own block templates, pushed when the tip changes and when
+ * the mempool changed for -stratumjobinterval, and shares are checked in-process. Shares that
+ * meet the block target are submitted as blocks. The coinbase pays the wallet (or -mineraddress),
+ * so this is for a pool or solo miners that do their payouts from it.
+ */
+bool StartStratumServer();
+/** Stop the event loop and the listener, before the wallet and the chain go away */
+void InterruptStratumServer();
+void StopStratumServer();
+
+#endif // SAFECOIN_STRATUM_H
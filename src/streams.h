@@ -365,6 +365,12 @@ public:
         d.insert(d.end(), begin(), end());
         clear();
     }
+
+    /** Exchange the underlying buffer with vchOther, to reuse its allocation. Reading starts over from the front */
+    void SwapBuffer(vector_type &vchOther) {
+        vch.swap(vchOther);
+        nReadPos = 0;
+    }
 };
 
 class CDataStream : public CBaseDataStream<CSerializeData>
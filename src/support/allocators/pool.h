@@ -0,0 +1,200 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <new>
+#include <vector>
+
+/**
+ * Memory resource for node based containers. Blocks of up to
+ * MAX_BLOCK_SIZE_BYTES are carved from large chunks and kept on per size free
+ * lists when they are given back, larger ones come from operator new. The
+ * chunks are only returned to the system by Release() or the destructor, so
+ * the memory used is known exactly and there is no per node malloc overhead.
+ *
+ * Chunks are allocated on first use, an unused resource costs nothing.
+ */
+template <size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+class PoolResource
+{
+    //! A free block, links to the next free block of the same size
+    struct ListNode {
+        ListNode* next;
+        explicit ListNode(ListNode* nextIn) : next(nextIn) {}
+    };
+
+    static const size_t ELEM_ALIGN_BYTES = ALIGN_BYTES > sizeof(ListNode) ? ALIGN_BYTES : sizeof(ListNode);
+    static_assert((ELEM_ALIGN_BYTES & (ELEM_ALIGN_BYTES - 1)) == 0, "ELEM_ALIGN_BYTES must be a power of two");
+    static_assert(ELEM_ALIGN_BYTES <= alignof(max_align_t), "operator new does not align chunks to ELEM_ALIGN_BYTES");
+    static_assert(MAX_BLOCK_SIZE_BYTES >= ELEM_ALIGN_BYTES, "MAX_BLOCK_SIZE_BYTES too small");
+
+    static const size_t NUM_FREE_LISTS = (MAX_BLOCK_SIZE_BYTES + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + 1;
+
+    const size_t nChunkSizeBytes;
+    std::vector<char*> vChunks;
+    //! Free lists, indexed by block size in ELEM_ALIGN_BYTES units
+    ListNode* vFreeLists[NUM_FREE_LISTS];
+    //! Not yet handed out part of the last chunk
+    char* pAvailable;
+    char* pAvailableEnd;
+
+    static size_t NumElemAlignBytes(size_t bytes)
+    {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + (bytes == 0);
+    }
+
+    static bool IsFreeListUsable(size_t bytes, size_t alignment)
+    {
+        return alignment <= ELEM_ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void AddToFreeList(void* p, size_t nElems)
+    {
+        vFreeLists[nElems] = new (p) ListNode(vFreeLists[nElems]);
+    }
+
+    void AllocateChunk()
+    {
+        // the rest of the last chunk is a multiple of ELEM_ALIGN_BYTES, keep it as one free block
+        size_t nRemaining = pAvailableEnd - pAvailable;
+        if (nRemaining != 0)
+            AddToFreeList(pAvailable, nRemaining / ELEM_ALIGN_BYTES);
+        pAvailable = static_cast<char*>(::operator new(nChunkSizeBytes));
+        pAvailableEnd = pAvailable + nChunkSizeBytes;
+        vChunks.push_back(pAvailable);
+    }
+
+    void Reset()
+    {
+        for (size_t i = 0; i < NUM_FREE_LISTS; i++)
+            vFreeLists[i] = NULL;
+        pAvailable = pAvailableEnd = NULL;
+    }
+
+public:
+    static const size_t DEFAULT_CHUNK_SIZE_BYTES = 256 << 10;
+
+    explicit PoolResource(size_t nChunkSizeBytesIn = DEFAULT_CHUNK_SIZE_BYTES)
+        : nChunkSizeBytes(NumElemAlignBytes(nChunkSizeBytesIn) * ELEM_ALIGN_BYTES)
+    {
+        assert(nChunkSizeBytes >= MAX_BLOCK_SIZE_BYTES);
+        Reset();
+    }
+
+    ~PoolResource()
+    {
+        Release();
+    }
+
+    void* Allocate(size_t bytes, size_t alignment)
+    {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            assert(alignment <= alignof(max_align_t));
+            return ::operator new(bytes);
+        }
+        const size_t nElems = NumElemAlignBytes(bytes);
+        if (vFreeLists[nElems] != NULL) {
+            ListNode* node = vFreeLists[nElems];
+            vFreeLists[nElems] = node->next;
+            return node;
+        }
+        const size_t nRoundBytes = nElems * ELEM_ALIGN_BYTES;
+        if (nRoundBytes > (size_t)(pAvailableEnd - pAvailable))
+            AllocateChunk();
+        void* p = pAvailable;
+        pAvailable += nRoundBytes;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t bytes, size_t alignment)
+    {
+        if (IsFreeListUsable(bytes, alignment))
+            AddToFreeList(p, NumElemAlignBytes(bytes));
+        else
+            ::operator delete(p);
+    }
+
+    /** Hand all chunks back to the system. Nothing allocated from them may be in use. */
+    void Release()
+    {
+        for (size_t i = 0; i < vChunks.size(); i++)
+            ::operator delete(vChunks[i]);
+        std::vector<char*>().swap(vChunks);
+        Reset();
+    }
+
+    size_t NumberOfChunks() const { return vChunks.size(); }
+
+    size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+
+private:
+    PoolResource(const PoolResource&);
+    PoolResource& operator=(const PoolResource&);
+};
+
+/**
+ * Allocator drawing from a PoolResource. A default constructed allocator has
+ * no resource and uses operator new, so containers that are never given a
+ * resource behave like std::allocator ones.
+ */
+template <class T, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES = alignof(void*)>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    PoolAllocator() : resource(NULL) {}
+
+    explicit PoolAllocator(ResourceType* resourceIn) : resource(resourceIn) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) : resource(other.GetResource()) {}
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    T* allocate(size_t n)
+    {
+        if (resource == NULL)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (resource == NULL)
+            ::operator delete(p);
+        else
+            resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* GetResource() const { return resource; }
+
+private:
+    ResourceType* resource;
+};
+
+template <class T1, class T2, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b)
+{
+    return a.GetResource() == b.GetResource();
+}
+
+template <class T1, class T2, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b)
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -22,11 +22,106 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <map>
+#include <memory>
+#include <mutex>
 #include <stdio.h>
 
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
+void* pLockWaitTracked = NULL;
+
+static thread_local int64_t nThreadLockWait = 0;
+
+int64_t GetLockWaitMicros()
+{
+    return nThreadLockWait;
+}
+
+int64_t LockWaitStart()
+{
+    return GetTimeMicros();
+}
+
+int64_t LockWaitEnd(int64_t nStart, bool fTracked)
+{
+    int64_t nWait = GetTimeMicros() - nStart;
+    if (fTracked)
+        nThreadLockWait += nWait;
+    return nWait;
+}
+
+std::atomic<bool> fLockProfile(false);
+
+CLockSiteStats::CLockSiteStats(const char* pszName, const char* pszFile, int nLine) :
+    strName(pszName), strSite(strprintf("%s:%d", pszFile, nLine)),
+    nCount(0), nContended(0), nWaitTotal(0), nWaitMax(0), nHoldTotal(0), nHoldMax(0)
+{
+    for (int i = 0; i < LOCK_PROFILE_BUCKETS; i++) {
+        vWaitHistogram[i] = 0;
+        vHoldHistogram[i] = 0;
+    }
+}
+
+static int LockProfileBucket(uint64_t nMicros)
+{
+    int nBucket = 0;
+    while (nMicros > 0 && nBucket < LOCK_PROFILE_BUCKETS - 1) {
+        nMicros >>= 1;
+        nBucket++;
+    }
+    return nBucket;
+}
+
+static void UpdateMax(std::atomic<uint64_t>& nMax, uint64_t nValue)
+{
+    uint64_t nPrev = nMax.load(std::memory_order_relaxed);
+    while (nValue > nPrev && !nMax.compare_exchange_weak(nPrev, nValue, std::memory_order_relaxed)) {}
+}
+
+void CLockSiteStats::AddWait(int64_t nWait)
+{
+    uint64_t n = std::max(nWait, (int64_t)0);
+    nCount.fetch_add(1, std::memory_order_relaxed);
+    if (n > 0)
+        nContended.fetch_add(1, std::memory_order_relaxed);
+    nWaitTotal.fetch_add(n, std::memory_order_relaxed);
+    UpdateMax(nWaitMax, n);
+    vWaitHistogram[LockProfileBucket(n)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void CLockSiteStats::AddHold(int64_t nHold)
+{
+    uint64_t n = std::max(nHold, (int64_t)0);
+    nHoldTotal.fetch_add(n, std::memory_order_relaxed);
+    UpdateMax(nHoldMax, n);
+    vHoldHistogram[LockProfileBucket(n)].fetch_add(1, std::memory_order_relaxed);
+}
+
+// by the address of the __FILE__ literal and line, a LOCK site is found without building a string
+static std::mutex csLockProfile;
+static std::map<std::pair<const char*, int>, std::unique_ptr<CLockSiteStats> > mapLockSites;
+
+CLockSiteStats* GetLockSiteStats(const char* pszName, const char* pszFile, int nLine)
+{
+    std::lock_guard<std::mutex> lock(csLockProfile);
+    std::unique_ptr<CLockSiteStats>& psite = mapLockSites[std::make_pair(pszFile, nLine)];
+    if (!psite)
+        psite.reset(new CLockSiteStats(pszName, pszFile, nLine));
+    return psite.get();
+}
+
+std::vector<const CLockSiteStats*> GetLockProfile()
+{
+    std::lock_guard<std::mutex> lock(csLockProfile);
+    std::vector<const CLockSiteStats*> vSites;
+    vSites.reserve(mapLockSites.size());
+    for (auto it = mapLockSites.begin(); it != mapLockSites.end(); ++it)
+        vSites.push_back(it->second.get());
+    return vSites;
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
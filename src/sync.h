@@ -23,6 +23,10 @@
 
 #include "threadsafety.h"
 
+#include <atomic>
+#include <string>
+#include <vector>
+
 #undef __cpuid
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
@@ -115,16 +119,67 @@ void static inline AssertLockHeldInternal(const char* pszName, const char* pszFi
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** The lock whose contended waits are added up per thread, cs_main once init sets it */
+extern void* pLockWaitTracked;
+/** Microseconds the calling thread has spent waiting for pLockWaitTracked */
+int64_t GetLockWaitMicros();
+int64_t LockWaitStart();
+/** Returns the microseconds waited since nStart, added to the thread's total if fTracked */
+int64_t LockWaitEnd(int64_t nStart, bool fTracked);
+
+/** Log2 buckets of microseconds, the last one takes everything from 2^(LOCK_PROFILE_BUCKETS-2) us on */
+static const int LOCK_PROFILE_BUCKETS = 24;
+
+/** Wait and hold times of the LOCKs taken at one file:line, kept while -lockprofile is set */
+struct CLockSiteStats {
+    std::string strName;
+    std::string strSite;
+    std::atomic<uint64_t> nCount;
+    std::atomic<uint64_t> nContended;
+    std::atomic<uint64_t> nWaitTotal, nWaitMax;
+    std::atomic<uint64_t> nHoldTotal, nHoldMax;
+    std::atomic<uint64_t> vWaitHistogram[LOCK_PROFILE_BUCKETS];
+    std::atomic<uint64_t> vHoldHistogram[LOCK_PROFILE_BUCKETS];
+
+    CLockSiteStats(const char* pszName, const char* pszFile, int nLine);
+    void AddWait(int64_t nWait);
+    void AddHold(int64_t nHold);
+};
+
+/** Set from -lockprofile, LOCK sites are only looked up and timed while it is */
+extern std::atomic<bool> fLockProfile;
+CLockSiteStats* GetLockSiteStats(const char* pszName, const char* pszFile, int nLine);
+/** A snapshot of the sites seen so far, they live until shutdown */
+std::vector<const CLockSiteStats*> GetLockProfile();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class SCOPED_LOCKABLE CMutexLock
 {
 private:
     boost::unique_lock<Mutex> lock;
+    CLockSiteStats* psite = NULL;
+    int64_t nHoldStart = 0;
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+        bool fTracked = pLockWaitTracked && (void*)(lock.mutex()) == pLockWaitTracked;
+        bool fProfile = fLockProfile.load(std::memory_order_relaxed);
+        if (fTracked || fProfile) {
+            int64_t nWait = 0;
+            if (!lock.try_lock()) {
+                int64_t nStart = LockWaitStart();
+                lock.lock();
+                nWait = LockWaitEnd(nStart, fTracked);
+            }
+            if (fProfile) {
+                psite = GetLockSiteStats(pszName, pszFile, nLine);
+                psite->AddWait(nWait);
+                nHoldStart = LockWaitStart();
+            }
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -168,6 +223,8 @@ public:
     {
         if (lock.owns_lock())
             LeaveCritical();
+        if (psite)
+            psite->AddHold(LockWaitStart() - nHoldStart);
     }
 
     operator bool()
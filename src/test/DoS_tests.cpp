@@ -9,6 +9,7 @@
 
 
 #include "consensus/upgrades.h"
+#include "core_memusage.h"
 #include "keystore.h"
 #include "main.h"
 #include "net.h"
@@ -28,15 +29,18 @@
 #include <boost/test/data/test_case.hpp>
 
 // Tests this internal-to-main.cpp method:
-extern bool AddOrphanTx(const CTransaction& tx, NodeId peer);
+extern bool AddOrphanTx(const CTransaction& tx, NodeId peer, size_t nMaxPeerUsage);
 extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxUsage);
 struct COrphanTx {
     CTransaction tx;
     NodeId fromPeer;
+    int64_t nTimeExpire;
+    size_t nUsage;
 };
 extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
+extern std::map<COutPoint, std::set<uint256> > mapOrphanTransactionsByPrev;
+extern size_t nOrphanUsage;
 
 CService ip(uint32_t i)
 {
@@ -141,7 +145,7 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
 
-        AddOrphanTx(tx, i);
+        AddOrphanTx(tx, i, std::numeric_limits<size_t>::max());
     }
 
     // ... and 50 that depend on other orphans:
@@ -158,7 +162,7 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
         SignSignature(keystore, txPrev, tx, 0, SIGHASH_ALL, consensusBranchId);
 
-        AddOrphanTx(tx, i);
+        AddOrphanTx(tx, i, std::numeric_limits<size_t>::max());
     }
 
     // This really-big orphan should be ignored:
@@ -182,7 +186,7 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        BOOST_CHECK(!AddOrphanTx(tx, i));
+        BOOST_CHECK(!AddOrphanTx(tx, i, std::numeric_limits<size_t>::max()));
     }
 
     // Test EraseOrphansFor:
@@ -194,13 +198,54 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
     }
 
     // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
+    LimitOrphanTxSize(40, std::numeric_limits<size_t>::max());
     BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
+    LimitOrphanTxSize(10, std::numeric_limits<size_t>::max());
     BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
+    size_t nUsageLimit = nOrphanUsage / 2;
+    LimitOrphanTxSize(10, nUsageLimit);
+    BOOST_CHECK(nOrphanUsage <= nUsageLimit);
+    LimitOrphanTxSize(0, std::numeric_limits<size_t>::max());
     BOOST_CHECK(mapOrphanTransactions.empty());
     BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    BOOST_CHECK_EQUAL(nOrphanUsage, 0);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphansQuotaExpiry)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.n = 0;
+    tx.vin[0].scriptSig << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1*CENT;
+    tx.vout[0].scriptPubKey << OP_1;
+
+    // a peer is held to its quota, other peers are not affected by it
+    tx.vin[0].prevout.hash = GetRandHash();
+    size_t nQuota = RecursiveDynamicUsage(CTransaction(tx)) * 3;
+    int nAdded = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        tx.vin[0].prevout.hash = GetRandHash();
+        if (AddOrphanTx(tx, 0, nQuota))
+            nAdded++;
+    }
+    BOOST_CHECK_EQUAL(nAdded, 3);
+    tx.vin[0].prevout.hash = GetRandHash();
+    BOOST_CHECK(AddOrphanTx(tx, 1, nQuota));
+
+    // orphans are found by the outpoint they spend
+    BOOST_CHECK(mapOrphanTransactionsByPrev.count(tx.vin[0].prevout));
+    BOOST_CHECK(!mapOrphanTransactionsByPrev.count(COutPoint(tx.vin[0].prevout.hash, 1)));
+
+    // and dropped once they waited too long for their parents
+    int64_t nStartTime = GetTime();
+    SetMockTime(nStartTime + ORPHAN_TX_EXPIRE_TIME + ORPHAN_TX_EXPIRE_INTERVAL + 1);
+    LimitOrphanTxSize(std::numeric_limits<unsigned int>::max(), std::numeric_limits<size_t>::max());
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK_EQUAL(nOrphanUsage, 0);
+    SetMockTime(0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
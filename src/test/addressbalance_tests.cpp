@@ -0,0 +1,213 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "base58.h"
+#include "main.h"
+#include "txdb.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressbalance_tests, TestingSetup)
+
+static std::pair<CAddressIndexKey, CAmount> Delta(const uint160& hash, int height, const uint256& txhash, size_t index, bool fSpending, CAmount nValue)
+{
+    return std::make_pair(CAddressIndexKey(1, hash, height, 1, txhash, index, fSpending), nValue);
+}
+
+BOOST_AUTO_TEST_CASE(addressbalance_follows_address_index)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashA(std::vector<unsigned char>(20, 1)), hashB(std::vector<unsigned char>(20, 2));
+    std::string addressA = CBitcoinAddress(CKeyID(hashA)).ToString();
+    std::string addressB = CBitcoinAddress(CKeyID(hashB)).ToString();
+    uint256 tx1 = uint256S("11"), tx2 = uint256S("22");
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock1, vBlock2;
+    vBlock1.push_back(Delta(hashA, 1, tx1, 0, false, 5 * COIN));
+    vBlock1.push_back(Delta(hashB, 1, tx1, 1, false, 3 * COIN));
+    vBlock2.push_back(Delta(hashA, 2, tx2, 0, true, -5 * COIN));
+    vBlock2.push_back(Delta(hashA, 2, tx2, 0, false, 2 * COIN));
+    BOOST_CHECK(db.WriteAddressIndex(vBlock1));
+    BOOST_CHECK(db.WriteAddressIndex(vBlock2));
+    // connecting a block again after an unclean shutdown does not count it twice
+    BOOST_CHECK(db.WriteAddressIndex(vBlock2));
+
+    std::map<std::string, CAmount> addressAmounts;
+    BOOST_CHECK(db.Snapshot2(addressAmounts, NULL));
+    BOOST_CHECK_EQUAL(addressAmounts.size(), 2);
+    BOOST_CHECK_EQUAL(addressAmounts[addressA], 2 * COIN);
+    BOOST_CHECK_EQUAL(addressAmounts[addressB], 3 * COIN);
+    UniValue result = db.Snapshot(1);
+    BOOST_CHECK_EQUAL(result["addresses"].size(), 1);
+    BOOST_CHECK_EQUAL(result["addresses"][0]["addr"].get_str(), addressB);
+    BOOST_CHECK_EQUAL(result["utxos"].get_int64(), 2);
+
+    BOOST_CHECK(db.EraseAddressIndex(vBlock2));
+    addressAmounts.clear();
+    BOOST_CHECK(db.Snapshot2(addressAmounts, NULL));
+    BOOST_CHECK_EQUAL(addressAmounts[addressA], 5 * COIN);
+    result = db.Snapshot(1);
+    BOOST_CHECK_EQUAL(result["addresses"][0]["addr"].get_str(), addressA);
+
+    BOOST_CHECK(db.EraseAddressIndex(vBlock1));
+    addressAmounts.clear();
+    BOOST_CHECK(db.Snapshot2(addressAmounts, NULL));
+    BOOST_CHECK(addressAmounts.empty());
+}
+
+BOOST_AUTO_TEST_CASE(address_index_pages)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashA(std::vector<unsigned char>(20, 1)), hashB(std::vector<unsigned char>(20, 2));
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    for (int i = 0; i < 5; i++) {
+        uint256 txhash = uint256S(strprintf("%x", i + 1));
+        vIndex.push_back(Delta(hashA, i + 1, txhash, 0, false, COIN));
+        vUnspent.push_back(std::make_pair(CAddressUnspentKey(1, hashA, txhash, 0), CAddressUnspentValue(COIN, CScript(), i + 1)));
+    }
+    vIndex.push_back(Delta(hashB, 1, uint256S("77"), 0, false, COIN));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(1, hashB, uint256S("77"), 0), CAddressUnspentValue(COIN, CScript(), 1)));
+    BOOST_CHECK(db.WriteAddressIndex(vIndex));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(vUnspent));
+
+    // pages of two walk the address in index order and stop at its end
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vPage, vAll;
+    bool fMore = true;
+    const CAddressIndexKey* pAfter = NULL;
+    CAddressIndexKey after;
+    for (int nPages = 0; fMore; nPages++) {
+        BOOST_CHECK(nPages < 3);
+        vPage.clear();
+        BOOST_CHECK(db.ReadAddressIndex(hashA, 1, pAfter, 2, vPage, fMore));
+        BOOST_CHECK(vPage.size() == 2 || !fMore);
+        vAll.insert(vAll.end(), vPage.begin(), vPage.end());
+        after = vPage.back().first;
+        pAfter = &after;
+    }
+    BOOST_CHECK_EQUAL(vAll.size(), 5);
+    for (size_t i = 0; i < vAll.size(); i++)
+        BOOST_CHECK_EQUAL(vAll[i].first.blockHeight, i + 1);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vOutputs, vFirst;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashA, 1, NULL, 3, vFirst, fMore));
+    BOOST_CHECK_EQUAL(vFirst.size(), 3);
+    BOOST_CHECK(fMore);
+    // the cursor output is spent before the next page is read
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vSpend;
+    vSpend.push_back(std::make_pair(vFirst.back().first, CAddressUnspentValue()));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(vSpend));
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashA, 1, &vFirst.back().first, 3, vOutputs, fMore));
+    BOOST_CHECK_EQUAL(vOutputs.size(), 2);
+    BOOST_CHECK(!fMore);
+    for (size_t i = 0; i < vOutputs.size(); i++) {
+        BOOST_CHECK(vOutputs[i].first.hashBytes == hashA);
+        for (size_t j = 0; j < vFirst.size(); j++)
+            BOOST_CHECK(vOutputs[i].first.txhash != vFirst[j].first.txhash);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(address_index_pages_reverse)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashA(std::vector<unsigned char>(20, 1)), hashB(std::vector<unsigned char>(20, 2));
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vIndex;
+    for (int i = 0; i < 5; i++) {
+        vIndex.push_back(Delta(hashA, i + 1, uint256S(strprintf("%x", i + 1)), 0, false, COIN));
+        vIndex.push_back(Delta(hashB, i + 1, uint256S(strprintf("%x", i + 11)), 0, false, COIN));
+    }
+    BOOST_CHECK(db.WriteAddressIndex(vIndex));
+
+    // newest first, from before the next address (hashA) and from the end of the index (hashB)
+    for (int n = 0; n < 2; n++) {
+        const uint160& hash = n == 0 ? hashA : hashB;
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vPage, vAll;
+        bool fMore = true;
+        const CAddressIndexKey* pAfter = NULL;
+        CAddressIndexKey after;
+        while (fMore) {
+            vPage.clear();
+            BOOST_CHECK(db.ReadAddressIndex(hash, 1, pAfter, 2, vPage, fMore, true));
+            vAll.insert(vAll.end(), vPage.begin(), vPage.end());
+            after = vPage.back().first;
+            pAfter = &after;
+        }
+        BOOST_CHECK_EQUAL(vAll.size(), 5);
+        for (size_t i = 0; i < vAll.size(); i++) {
+            BOOST_CHECK(vAll[i].first.hashBytes == hash);
+            BOOST_CHECK_EQUAL(vAll[i].first.blockHeight, 5 - i);
+        }
+    }
+
+    // a height range bounds both directions
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRange;
+    bool fMore;
+    BOOST_CHECK(db.ReadAddressIndex(hashA, 1, NULL, 10, vRange, fMore, true, 2, 4));
+    BOOST_CHECK(!fMore);
+    BOOST_CHECK_EQUAL(vRange.size(), 3);
+    BOOST_CHECK_EQUAL(vRange.front().first.blockHeight, 4);
+    BOOST_CHECK_EQUAL(vRange.back().first.blockHeight, 2);
+    vRange.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hashA, 1, NULL, 10, vRange, fMore, false, 2, 4));
+    BOOST_CHECK_EQUAL(vRange.size(), 3);
+    BOOST_CHECK_EQUAL(vRange.front().first.blockHeight, 2);
+    BOOST_CHECK_EQUAL(vRange.back().first.blockHeight, 4);
+}
+
+BOOST_AUTO_TEST_CASE(tx_archive_replaces_txindex)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(uint256S("99"), 0);
+    mtx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    CTransaction tx(mtx);
+    uint256 hashBlock = uint256S("1234");
+
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    vPos.push_back(std::make_pair(tx.GetHash(), CDiskTxPos(CDiskBlockPos(0, 80), 1)));
+    BOOST_CHECK(db.WriteTxIndex(vPos));
+
+    CTransaction txOut;
+    uint256 hashOut;
+    CDiskTxPos pos;
+    BOOST_CHECK(!db.ReadTxArchive(tx.GetHash(), txOut, hashOut));
+    BOOST_CHECK(db.ReadTxIndex(tx.GetHash(), pos));
+
+    // the archive takes over from the txindex entry that pointed into the pruned file
+    BOOST_CHECK(db.WriteTxArchive(hashBlock, std::vector<CTransaction>(1, tx)));
+    BOOST_CHECK(!db.ReadTxIndex(tx.GetHash(), pos));
+    BOOST_CHECK(db.ReadTxArchive(tx.GetHash(), txOut, hashOut));
+    BOOST_CHECK(txOut == tx);
+    BOOST_CHECK(hashOut == hashBlock);
+}
+
+BOOST_AUTO_TEST_CASE(txindex_batch_read)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    std::vector<std::pair<uint256, CDiskTxPos> > vWritten;
+    std::vector<uint256> vTxids;
+    for (int i = 0; i < 10; i++) {
+        uint256 txid = GetRandHash();
+        vTxids.push_back(txid);
+        if (i % 2 == 0)
+            vWritten.push_back(std::make_pair(txid, CDiskTxPos(CDiskBlockPos(i, 80), i + 1)));
+    }
+    BOOST_CHECK(db.WriteTxIndex(vWritten));
+
+    // unknown txids are left out and duplicates answered once
+    vTxids.push_back(vTxids[0]);
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    BOOST_CHECK(db.ReadTxIndex(vTxids, vPos));
+    BOOST_CHECK_EQUAL(vPos.size(), vWritten.size());
+    for (size_t i = 0; i < vPos.size(); i++) {
+        CDiskTxPos pos;
+        BOOST_CHECK(db.ReadTxIndex(vPos[i].first, pos));
+        BOOST_CHECK_EQUAL(vPos[i].second.nFile, pos.nFile);
+        BOOST_CHECK_EQUAL(vPos[i].second.nTxOffset, pos.nTxOffset);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,8 +6,10 @@
 #include <string>
 #include <boost/test/unit_test.hpp>
 
+#include "clientversion.h"
 #include "hash.h"
 #include "random.h"
+#include "streams.h"
 
 using namespace std;
 
@@ -395,6 +397,45 @@ BOOST_AUTO_TEST_CASE(addrman_getaddr)
     BOOST_CHECK(addrman.size() == 2007);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_snapshot_adopt)
+{
+    CAddrManTest addrman;
+
+    // Set addrman addr placement to be deterministic.
+    addrman.MakeDeterministic();
+
+    CNetAddr source = CNetAddr("252.2.2.2");
+    CAddress addr1 = CAddress(CService("250.1.1.1", 8333));
+    addr1.nTime = GetTime();
+    CAddress addr2 = CAddress(CService("250.2.2.2", 8333));
+    addr2.nTime = GetTime();
+    CAddress addr3 = CAddress(CService("251.3.3.3", 8333));
+    addr3.nTime = GetTime();
+    addrman.Add(addr1, source);
+    addrman.Add(addr2, source);
+    addrman.Good(addr2);
+
+    // A snapshot serializes exactly like the tables it was taken from.
+    CAddrMan snapshot;
+    addrman.Snapshot(snapshot);
+    BOOST_CHECK(snapshot.size() == 2);
+    CDataStream ssOrig(SER_DISK, CLIENT_VERSION), ssCopy(SER_DISK, CLIENT_VERSION);
+    ssOrig << addrman;
+    ssCopy << snapshot;
+    BOOST_CHECK(ssOrig.str() == ssCopy.str());
+
+    // Adopting the loaded tables keeps what was learned meanwhile, tried or not.
+    CAddrMan learned;
+    learned.Add(addr3, source);
+    learned.Good(addr3);
+    learned.Adopt(snapshot);
+    BOOST_CHECK(learned.size() == 3);
+    BOOST_CHECK(snapshot.size() == 1);
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK(learned.Select(true).ToString() == "250.1.1.1:8333");
+    BOOST_CHECK(addrman.size() == 2);
+}
+
 
 BOOST_AUTO_TEST_CASE(caddrinfo_get_tried_bucket)
 {
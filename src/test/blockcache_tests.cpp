@@ -0,0 +1,47 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    CBlockCache cache(300);
+    uint256 hashes[4];
+    for (int i = 0; i < 4; i++)
+        hashes[i] = GetRandHash();
+    CBlockRef pblock = std::make_shared<const CBlock>();
+
+    cache.Insert(hashes[0], pblock, 100);
+    cache.Insert(hashes[1], pblock, 100);
+    cache.Insert(hashes[2], pblock, 100);
+    BOOST_CHECK_EQUAL(cache.Size(), 3);
+    BOOST_CHECK_EQUAL(cache.Bytes(), 300);
+    BOOST_CHECK(cache.Get(hashes[0]) == pblock);
+
+    // the least recently used block goes first, 0 was just looked up
+    cache.Insert(hashes[3], pblock, 100);
+    BOOST_CHECK_EQUAL(cache.Size(), 3);
+    BOOST_CHECK(!cache.Get(hashes[1]));
+    BOOST_CHECK(cache.Get(hashes[0]));
+    BOOST_CHECK(cache.Get(hashes[2]));
+
+    // a block larger than the whole cache is not kept
+    cache.Insert(GetRandHash(), pblock, 301);
+    BOOST_CHECK_EQUAL(cache.Size(), 3);
+
+    cache.SetMaxBytes(100);
+    BOOST_CHECK_EQUAL(cache.Size(), 1);
+    BOOST_CHECK(cache.Get(hashes[2]));
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.Bytes(), 0);
+    BOOST_CHECK(!cache.Get(hashes[2]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
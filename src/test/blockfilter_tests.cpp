@@ -0,0 +1,101 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "crypto/common.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "test/test_bitcoin.h"
+#include "undo.h"
+#include "utilstrencodings.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_bip158_vector)
+{
+    // the basic filter of the bitcoin testnet genesis block, from the BIP158 test vectors
+    uint256 blockHash = uint256S("000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943");
+    GCSFilter::ElementSet elements;
+    elements.insert(ParseHex("4104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac"));
+    GCSFilter filter(ReadLE64(blockHash.begin()), ReadLE64(blockHash.begin() + 8), elements);
+    BOOST_CHECK_EQUAL(HexStr(filter.GetEncoded()), "019dfca8");
+    BOOST_CHECK(filter.Match(*elements.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_match)
+{
+    GCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 200; i++) {
+        GCSFilter::Element element(32, 0);
+        WriteLE64(&element[0], i);
+        included.insert(element);
+        element[31] = 1;
+        excluded.insert(element);
+    }
+    GCSFilter filter(1, 2, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 200U);
+    for (GCSFilter::ElementSet::const_iterator it = included.begin(); it != included.end(); it++)
+        BOOST_CHECK(filter.Match(*it));
+    BOOST_CHECK(filter.MatchAny(included));
+    // 1 in 784931 false positives, none expected among 200
+    BOOST_CHECK(!filter.MatchAny(excluded));
+
+    // a received filter decodes to the same set
+    GCSFilter decoded(1, 2, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 200U);
+    BOOST_CHECK(decoded.MatchAny(included));
+
+    GCSFilter empty(1, 2, GCSFilter::ElementSet());
+    BOOST_CHECK_EQUAL(HexStr(empty.GetEncoded()), "00");
+    BOOST_CHECK(!empty.Match(*included.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic)
+{
+    CScript included = CScript() << ParseHex("76a914000000000000000000000000000000000000000088ac");
+    CScript spent = CScript() << OP_1 << OP_EQUAL;
+    CScript opreturn = CScript() << OP_RETURN << ParseHex("01020304");
+    // a CC output with parameters, its condition script goes in as well
+    std::vector<unsigned char> condition(39, 0xa0);
+    CScript ccSubScript = CScript() << condition << OP_CHECKCRYPTOCONDITION;
+    CScript cc = ccSubScript;
+    cc << ParseHex("0102") << OP_DROP;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(2);
+    coinbase.vout[0].scriptPubKey = included;
+    coinbase.vout[1].scriptPubKey = opreturn;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.n = 1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = cc;
+    CBlock block;
+    block.vtx.push_back(coinbase);
+    block.vtx.push_back(tx);
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(1, spent)));
+
+    BlockFilter filter(block, blockundo);
+    BOOST_CHECK(filter.GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(filter.GetFilter().GetN(), 4U);
+    BOOST_CHECK(filter.GetFilter().Match(GCSFilter::Element(included.begin(), included.end())));
+    BOOST_CHECK(filter.GetFilter().Match(GCSFilter::Element(spent.begin(), spent.end())));
+    BOOST_CHECK(filter.GetFilter().Match(GCSFilter::Element(cc.begin(), cc.end())));
+    BOOST_CHECK(filter.GetFilter().Match(GCSFilter::Element(ccSubScript.begin(), ccSubScript.end())));
+    BOOST_CHECK(!filter.GetFilter().Match(GCSFilter::Element(opreturn.begin(), opreturn.end())));
+
+    // what a peer receives is the same filter
+    BlockFilter received(BLOCK_FILTER_BASIC, filter.GetBlockHash(), filter.GetEncodedFilter());
+    BOOST_CHECK(received.GetHash() == filter.GetHash());
+    BOOST_CHECK(received.GetFilter().Match(GCSFilter::Element(spent.begin(), spent.end())));
+    BOOST_CHECK(filter.ComputeHeader(uint256()) != filter.ComputeHeader(filter.GetHash()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,91 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+std::atomic<unsigned int> nChecked(0);
+
+struct FakeCheck
+{
+    bool fOk;
+    FakeCheck(bool fOkIn = true) : fOk(fOkIn) {}
+    bool operator()()
+    {
+        nChecked++;
+        return fOk;
+    }
+    void swap(FakeCheck& other) { std::swap(fOk, other.fOk); }
+};
+
+void RunBatches(CCheckQueue<FakeCheck>& queue, unsigned int nBatches, unsigned int nPerBatch, int nFail, bool fExpected)
+{
+    CCheckQueueControl<FakeCheck> control(&queue);
+    for (unsigned int i = 0; i < nBatches; i++) {
+        std::vector<FakeCheck> vChecks;
+        for (unsigned int j = 0; j < nPerBatch; j++)
+            vChecks.push_back(FakeCheck((int)(i * nPerBatch + j) != nFail));
+        control.Add(vChecks);
+    }
+    BOOST_CHECK_EQUAL(control.Wait(), fExpected);
+    BOOST_CHECK(queue.IsIdle());
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_checked)
+{
+    CCheckQueue<FakeCheck> queue(16);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 8; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<FakeCheck>::Thread, boost::ref(queue)));
+
+    // single jobs, large batches and nothing at all, the workers steal from the master and each other
+    unsigned int sizes[][2] = {{1, 1}, {1000, 1}, {3, 5000}, {0, 0}, {50, 37}};
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        nChecked = 0;
+        RunBatches(queue, sizes[i][0], sizes[i][1], -1, true);
+        BOOST_CHECK_EQUAL(nChecked, sizes[i][0] * sizes[i][1]);
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CCheckQueue<FakeCheck> queue(16);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 8; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<FakeCheck>::Thread, boost::ref(queue)));
+
+    RunBatches(queue, 100, 100, 0, false);
+    RunBatches(queue, 100, 100, 9999, false);
+    // the result is reset for the next block
+    RunBatches(queue, 100, 100, -1, true);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_no_workers)
+{
+    // the master alone checks everything in Wait
+    CCheckQueue<FakeCheck> queue(16);
+    nChecked = 0;
+    RunBatches(queue, 10, 10, -1, true);
+    BOOST_CHECK_EQUAL(nChecked, 100U);
+    RunBatches(queue, 10, 10, 55, false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
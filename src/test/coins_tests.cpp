@@ -13,6 +13,7 @@
 #include "undo.h"
 #include "primitives/transaction.h"
 #include "pubkey.h"
+#include "txdb.h"
 
 #include <vector>
 #include <map>
@@ -211,6 +212,15 @@ public:
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
 
+    bool IsCached(const uint256& txid) const { return cacheCoins.count(txid) != 0; }
+
+    unsigned char Flags(const uint256& txid) const { return cacheCoins.find(txid)->second.flags; }
+
+    //! What Sync charges for keeping the entry of txid
+    size_t EntryUsage(const uint256& txid) const
+    {
+        return sizeof(CCoinsMap::value_type) + sizeof(void*) * 3 + cacheCoins.find(txid)->second.coins.DynamicMemoryUsage();
+    }
 };
 
 class TxWithNullifiers
@@ -869,6 +879,108 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+BOOST_AUTO_TEST_CASE(coins_cache_sync)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    uint256 txids[3];
+    for (int i = 0; i < 3; i++) {
+        txids[i] = GetRandHash();
+        CCoinsModifier coins = cache.ModifyCoins(txids[i]);
+        coins->vout.resize(1);
+        coins->vout[0].nValue = i + 1;
+        coins->vout[0].scriptPubKey = CScript() << OP_TRUE;
+    }
+
+    // everything fits, the coins reach the base and stay cached as clean entries
+    BOOST_CHECK(cache.Sync(std::numeric_limits<size_t>::max()));
+    cache.SelfTest();
+    CCoins coins;
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK(base.GetCoins(txids[i], coins));
+        BOOST_CHECK(cache.IsCached(txids[i]));
+        BOOST_CHECK_EQUAL(cache.Flags(txids[i]), 0);
+    }
+    uint64_t nHits, nMisses;
+    cache.GetCacheStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, 0);
+    BOOST_CHECK_EQUAL(nMisses, 3);
+
+    // with room for one coin the one looked up since the last Sync stays
+    BOOST_CHECK(cache.AccessCoins(txids[1]) != NULL);
+    BOOST_CHECK(cache.Sync(cache.EntryUsage(txids[1])));
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1);
+    BOOST_CHECK(cache.IsCached(txids[1]));
+
+    // modifications reach the base even when nothing stays cached
+    cache.ModifyCoins(txids[1])->vout[0].nValue = 10;
+    BOOST_CHECK(cache.Flags(txids[1]) & CCoinsCacheEntry::DIRTY);
+    BOOST_CHECK(cache.Sync(0));
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0);
+    BOOST_CHECK(base.GetCoins(txids[1], coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 10);
+
+    // evicted coins are read back from the base
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txids[1])->vout[0].nValue, 10);
+    cache.GetCacheStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, 2);
+    BOOST_CHECK_EQUAL(nMisses, 4);
+
+    // spent coins are never kept
+    cache.ModifyCoins(txids[1])->Clear();
+    BOOST_CHECK(cache.Sync(std::numeric_limits<size_t>::max()));
+    BOOST_CHECK(!cache.IsCached(txids[1]));
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_batch_read, TestingSetup)
+{
+    // enough txids for GetCoinsBatch to split the reads over several threads
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsMap mapCoins;
+    std::vector<uint256> vTxids;
+    for (int i = 0; i < 200; i++) {
+        vTxids.push_back(GetRandHash());
+        if (i % 4 == 0)
+            continue; // not in the database
+        CCoinsCacheEntry& entry = mapCoins[vTxids.back()];
+        entry.coins.nHeight = i;
+        entry.coins.vout.push_back(CTxOut(i, CScript() << OP_TRUE));
+        entry.flags = CCoinsCacheEntry::DIRTY;
+    }
+    CAnchorsSproutMap mapSproutAnchors;
+    CAnchorsSaplingMap mapSaplingAnchors;
+    CNullifiersMap mapSproutNullifiers, mapSaplingNullifiers;
+    BOOST_CHECK(db.BatchWrite(mapCoins, GetRandHash(), uint256(), uint256(), mapSproutAnchors, mapSaplingAnchors, mapSproutNullifiers, mapSaplingNullifiers));
+
+    std::vector<std::pair<uint256, CCoins> > vCoins;
+    db.GetCoinsBatch(vTxids, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 150);
+    for (size_t i = 0; i < vCoins.size(); i++) {
+        size_t n = std::find(vTxids.begin(), vTxids.end(), vCoins[i].first) - vTxids.begin();
+        BOOST_CHECK_EQUAL(vCoins[i].second.nHeight, n);
+        BOOST_CHECK_EQUAL(vCoins[i].second.vout[0].nValue, n);
+    }
+
+    // a cache loads what it is missing in one batch, and serves it afterwards
+    CCoinsViewCacheTest cache(&db);
+    BOOST_CHECK(cache.AccessCoins(vTxids[1]) != NULL);
+    cache.Prefetch(vTxids);
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 150);
+    uint64_t nHits, nMisses;
+    cache.GetCacheStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nMisses, 200);
+    BOOST_CHECK_EQUAL(cache.AccessCoins(vTxids[5])->vout[0].nValue, 5);
+    BOOST_CHECK(cache.AccessCoins(vTxids[4]) == NULL);
+    CCoinsViewCacheTest child(&cache);
+    vCoins.clear();
+    child.GetCoinsBatch(vTxids, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 150);
+    BOOST_CHECK_EQUAL(child.GetCacheSize(), 150);
+}
+
 BOOST_AUTO_TEST_CASE(coins_coinbase_spends)
 {
     CCoinsViewTest base;
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "compressor.h"
+#include "random.h"
 #include "util.h"
 #include "test/test_bitcoin.h"
 
@@ -62,4 +63,38 @@ BOOST_AUTO_TEST_CASE(compress_amounts)
         BOOST_CHECK(TestDecode(i));
 }
 
+BOOST_AUTO_TEST_CASE(compress_data)
+{
+    // repetitive data like block headers and scripts shrinks, random data survives the roundtrip
+    std::vector<unsigned char> vRepeat;
+    for (int i = 0; i < 5000; i++)
+        vRepeat.push_back("0123456789abcdef"[i % 16 + (i / 320) % 2]);
+    std::vector<unsigned char> vRandom(3000);
+    GetRandBytes(&vRandom[0], vRandom.size());
+    std::vector<unsigned char> vRuns(700, 7);
+    std::vector<unsigned char> vShort(3, 1);
+
+    std::vector<std::vector<unsigned char> > vInputs;
+    vInputs.push_back(vRepeat);
+    vInputs.push_back(vRandom);
+    vInputs.push_back(vRuns);
+    vInputs.push_back(vShort);
+    vInputs.push_back(std::vector<unsigned char>());
+    for (size_t i = 0; i < vInputs.size(); i++) {
+        std::vector<unsigned char> vCompressed, vOut;
+        CompressData(vInputs[i], vCompressed);
+        BOOST_CHECK(DecompressData(vCompressed, vInputs[i].size(), vOut));
+        BOOST_CHECK(vOut == vInputs[i]);
+    }
+    std::vector<unsigned char> vCompressed, vOut;
+    CompressData(vRepeat, vCompressed);
+    BOOST_CHECK(vCompressed.size() < vRepeat.size() / 4);
+
+    // a wrong size or a cut off input is rejected
+    BOOST_CHECK(!DecompressData(vCompressed, vRepeat.size() - 1, vOut));
+    BOOST_CHECK(!DecompressData(vCompressed, vRepeat.size() + 1, vOut));
+    std::vector<unsigned char> vTruncated(vCompressed.begin(), vCompressed.begin() + vCompressed.size() / 2);
+    BOOST_CHECK(!DecompressData(vTruncated, vRepeat.size(), vOut));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
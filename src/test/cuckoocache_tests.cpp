@@ -0,0 +1,64 @@
+// Copyright (c) 2016 Jeremy Rubin
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(cuckoocache_insert_contains_erase)
+{
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc;
+    cc.setup_bytes(1 << 16);
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 64; i++) {
+        hashes.push_back(GetRandHash());
+        cc.insert(hashes.back());
+    }
+    for (size_t i = 0; i < hashes.size(); i++)
+        BOOST_CHECK(cc.contains(hashes[i], false));
+    BOOST_CHECK(!cc.contains(GetRandHash(), false));
+
+    // an erase only marks the slot, the entry stays readable until overwritten
+    BOOST_CHECK(cc.contains(hashes[0], true));
+    BOOST_CHECK(cc.contains(hashes[0], false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate)
+{
+    // with the table filled to its size, most of the newest half must survive
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc;
+    uint32_t n = cc.setup_bytes(1 << 18);
+    std::vector<uint256> hashes(n);
+    for (uint32_t i = 0; i < n; i++) {
+        hashes[i] = GetRandHash();
+        cc.insert(hashes[i]);
+    }
+    uint32_t found = 0;
+    for (uint32_t i = n / 2; i < n; i++)
+        found += cc.contains(hashes[i], false);
+    BOOST_CHECK(found > (n / 2) * 9 / 10);
+}
+
+BOOST_AUTO_TEST_CASE(signature_cache_entries)
+{
+    uint256 sighash = GetRandHash();
+    std::vector<unsigned char> vchSig(72, 0x30);
+    CPubKey pubkey;
+    uint256 entry = SignatureCacheEntry(sighash, vchSig, pubkey);
+    BOOST_CHECK(entry == SignatureCacheEntry(sighash, vchSig, pubkey));
+    vchSig[1] ^= 1;
+    BOOST_CHECK(entry != SignatureCacheEntry(sighash, vchSig, pubkey));
+
+    BOOST_CHECK(!GetCachedSignature(entry, false));
+    SetCachedSignature(entry);
+    BOOST_CHECK(GetCachedSignature(entry, true));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
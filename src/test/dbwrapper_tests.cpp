@@ -118,6 +118,44 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+BOOST_AUTO_TEST_CASE(iterator_prefix)
+{
+    path ph = temp_directory_path() / unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false);
+    for (int x=0; x<4; ++x) {
+        for (uint32_t y=0; y<10; ++y) {
+            BOOST_CHECK(dbw.Write(make_pair((char)('a' + x), y), y));
+        }
+    }
+
+    boost::scoped_ptr<CDBIterator> it(const_cast<CDBWrapper*>(&dbw)->NewIterator());
+    it->SeekPrefix('b');
+    uint32_t count = 0;
+    for (; it->Valid(); it->Next()) {
+        pair<char, uint32_t> key;
+        uint32_t value;
+        BOOST_CHECK(it->GetKey(key));
+        BOOST_CHECK(it->GetValue(value));
+        BOOST_CHECK_EQUAL(key.first, 'b');
+        BOOST_CHECK_EQUAL(key.second, count);
+        BOOST_CHECK_EQUAL(value, count);
+        BOOST_CHECK_EQUAL(it->GetKeySlice().size(), 5);
+        count++;
+    }
+    BOOST_CHECK_EQUAL(count, 10);
+
+    // Seek() moves inside the prefix and keeps the bound
+    it->SeekPrefix('c');
+    it->Seek(make_pair('c', (uint32_t)8));
+    count = 0;
+    for (; it->Valid(); it->Next())
+        count++;
+    BOOST_CHECK_EQUAL(count, 2);
+
+    it->SeekPrefix('e');
+    BOOST_CHECK(!it->Valid());
+}
+
 BOOST_AUTO_TEST_CASE(iterator_ordering)
 {
     path ph = temp_directory_path() / unique_path();
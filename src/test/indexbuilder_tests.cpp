@@ -0,0 +1,81 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexbuilder.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "undo.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(indexbuilder_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(indexbuilder_block_entries)
+{
+    uint160 hashA(std::vector<unsigned char>(20, 1)), hashB(std::vector<unsigned char>(20, 2));
+    CScript scriptA = GetScriptForDestination(CKeyID(hashA));
+    CScript scriptB = GetScriptForDestination(CKeyID(hashB));
+    uint256 prevhash = uint256S("99");
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.push_back(CTxOut(3 * COIN, scriptA));
+
+    // spends an earlier output of B, pays A
+    CMutableTransaction spend1;
+    spend1.vin.push_back(CTxIn(COutPoint(prevhash, 0)));
+    spend1.vout.push_back(CTxOut(4 * COIN, scriptA));
+    CTransaction tx1(spend1);
+
+    // spends the output of tx1 in the same block, pays B
+    CMutableTransaction spend2;
+    spend2.vin.push_back(CTxIn(COutPoint(tx1.GetHash(), 0)));
+    spend2.vout.push_back(CTxOut(4 * COIN, scriptB));
+    CTransaction tx2(spend2);
+
+    CBlock block;
+    block.vtx.push_back(CTransaction(coinbase));
+    block.vtx.push_back(tx1);
+    block.vtx.push_back(tx2);
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(2);
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(5 * COIN, scriptB)));
+    blockundo.vtxundo[1].vprevout.push_back(CTxInUndo(CTxOut(4 * COIN, scriptA)));
+
+    CIndexBuildBatch batch;
+    BOOST_CHECK(BuildBlockIndexEntries(block, blockundo, 10, true, true, batch));
+    BOOST_CHECK_EQUAL(batch.addressIndex.size(), 5);
+    BOOST_CHECK_EQUAL(batch.spentIndex.size(), 2);
+    BOOST_CHECK_EQUAL(batch.spentIndex[1].second.txid.GetHex(), tx2.GetHash().GetHex());
+    // the output of tx1 was created and spent in the block, only its erase is left
+    BOOST_CHECK_EQUAL(batch.addressUnspentIndex.size(), 4);
+    BOOST_CHECK(batch.addressUnspentIndex[CAddressUnspentKey(1, hashA, tx1.GetHash(), 0)].IsNull());
+
+    // undo data that does not belong to the block is refused
+    CBlockUndo shortundo;
+    shortundo.vtxundo.resize(1);
+    CIndexBuildBatch other;
+    BOOST_CHECK(!BuildBlockIndexEntries(block, shortundo, 10, true, true, other));
+
+    BOOST_CHECK(batch.Write(true, true));
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentA, unspentB;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(hashA, 1, unspentA));
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(hashB, 1, unspentB));
+    BOOST_CHECK_EQUAL(unspentA.size(), 1);
+    BOOST_CHECK_EQUAL(unspentA[0].second.satoshis, 3 * COIN);
+    BOOST_CHECK_EQUAL(unspentB.size(), 1);
+    BOOST_CHECK(unspentB[0].first.txhash == tx2.GetHash());
+
+    CSpentIndexValue spent;
+    CSpentIndexKey key(prevhash, 0);
+    BOOST_CHECK(pblocktree->ReadSpentIndex(key, spent));
+    BOOST_CHECK(spent.txid == tx1.GetHash());
+    BOOST_CHECK_EQUAL(spent.satoshis, 5 * COIN);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
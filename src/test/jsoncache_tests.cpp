@@ -0,0 +1,80 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsoncache.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(jsoncache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(jsoncache_splice)
+{
+    CJSONCache cache(1 << 20);
+    uint256 hashTip = GetRandHash();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("hash", "00ff"));
+    obj.push_back(Pair("height", 42));
+
+    UniValue result;
+    BOOST_CHECK(!cache.Get(hashTip, "b1", result));
+    cache.Insert(hashTip, "b1", obj);
+    BOOST_CHECK(cache.Get(hashTip, "b1", result));
+
+    // the cached text is written unchanged inside a reply
+    UniValue reply(UniValue::VOBJ);
+    reply.push_back(Pair("result", result));
+    UniValue expected(UniValue::VOBJ);
+    expected.push_back(Pair("result", obj));
+    BOOST_CHECK_EQUAL(reply.write(), expected.write());
+}
+
+BOOST_AUTO_TEST_CASE(jsoncache_tip)
+{
+    CJSONCache cache(1 << 20);
+    uint256 hashTip = GetRandHash(), hashNewTip = GetRandHash();
+    UniValue result;
+    BOOST_CHECK(!cache.Get(hashTip, "b1", result));
+    cache.Insert(hashTip, "b1", UniValue("a"));
+    BOOST_CHECK_EQUAL(cache.Size(), 1);
+
+    // a new tip drops everything
+    BOOST_CHECK(!cache.Get(hashNewTip, "b1", result));
+    BOOST_CHECK_EQUAL(cache.Size(), 0);
+
+    // an entry made for the old tip after that is not kept
+    cache.Insert(hashTip, "b1", UniValue("a"));
+    BOOST_CHECK_EQUAL(cache.Size(), 0);
+    cache.Insert(hashNewTip, "b1", UniValue("b"));
+    BOOST_CHECK(cache.Get(hashNewTip, "b1", result));
+    BOOST_CHECK_EQUAL(result.write(), "\"b\"");
+}
+
+BOOST_AUTO_TEST_CASE(jsoncache_lru)
+{
+    // each entry is a 2 byte key and a 3 byte string
+    CJSONCache cache(15);
+    uint256 hashTip = GetRandHash();
+    UniValue result;
+    cache.Get(hashTip, "", result);
+
+    cache.Insert(hashTip, "k0", UniValue("a"));
+    cache.Insert(hashTip, "k1", UniValue("b"));
+    cache.Insert(hashTip, "k2", UniValue("c"));
+    BOOST_CHECK_EQUAL(cache.Bytes(), 15);
+    BOOST_CHECK(cache.Get(hashTip, "k0", result));
+
+    cache.Insert(hashTip, "k3", UniValue("d"));
+    BOOST_CHECK_EQUAL(cache.Size(), 3);
+    BOOST_CHECK(!cache.Get(hashTip, "k1", result));
+    BOOST_CHECK(cache.Get(hashTip, "k0", result));
+
+    cache.SetMaxBytes(0);
+    BOOST_CHECK_EQUAL(cache.Size(), 0);
+    cache.Insert(hashTip, "k0", UniValue("a"));
+    BOOST_CHECK_EQUAL(cache.Size(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
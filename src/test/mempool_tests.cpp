@@ -2,8 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "cc/eval.h"
 #include "consensus/upgrades.h"
 #include "main.h"
+#include "script/interpreter.h"
 #include "txmempool.h"
 #include "util.h"
 
@@ -212,6 +214,155 @@ BOOST_AUTO_TEST_CASE(RemoveWithoutBranchId) {
     BOOST_CHECK_EQUAL(pool.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    entry.hadNoDependencies = true;
+
+    /* low fee parent */
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vout.resize(2);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    tx1.vout[1].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[1].nValue = 10 * COIN;
+    CTxMemPoolEntry entry1 = entry.Fee(1000LL).FromTx(tx1);
+    pool.addUnchecked(tx1.GetHash(), entry1);
+
+    /* unrelated, mid fee */
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_12 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(5000LL).FromTx(tx2));
+
+    /* high fee child of tx1 */
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx3.vin[0].scriptSig = CScript() << OP_11;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_13 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    CTxMemPoolEntry entry3 = entry.Fee(50000LL).FromTx(tx3);
+    pool.addUnchecked(tx3.GetHash(), entry3);
+
+    /* grandchild of tx1, also spending its second output */
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vin.resize(2);
+    tx4.vin[0].prevout = COutPoint(tx3.GetHash(), 0);
+    tx4.vin[0].scriptSig = CScript() << OP_11;
+    tx4.vin[1].prevout = COutPoint(tx1.GetHash(), 1);
+    tx4.vin[1].scriptSig = CScript() << OP_11;
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_14 << OP_EQUAL;
+    tx4.vout[0].nValue = 20 * COIN;
+    CTxMemPoolEntry entry4 = entry.Fee(2000LL).FromTx(tx4);
+    pool.addUnchecked(tx4.GetHash(), entry4);
+    BOOST_CHECK_EQUAL(pool.size(), 4);
+
+    CTxMemPool::indexed_transaction_set::const_iterator it4 = pool.mapTx.find(tx4.GetHash());
+    BOOST_CHECK_EQUAL(it4->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(it4->GetSizeWithAncestors(), entry1.GetTxSize() + entry3.GetTxSize() + entry4.GetTxSize());
+    BOOST_CHECK_EQUAL(it4->GetFeesWithAncestors(), 53000LL);
+
+    // tx3 pays for tx1 and sorts first, the package beats tx2 but tx1 alone does not
+    CTxMemPool::indexed_transaction_set::nth_index<2>::type::iterator it = pool.mapTx.get<2>().begin();
+    BOOST_CHECK_EQUAL(it++->GetTx().GetHash().ToString(), tx3.GetHash().ToString());
+    BOOST_CHECK_EQUAL(it++->GetTx().GetHash().ToString(), tx2.GetHash().ToString());
+    BOOST_CHECK(it != pool.mapTx.get<2>().end());
+
+    // tx1 confirmed, its descendants forget it
+    std::list<CTransaction> removed;
+    pool.remove(tx1, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx3.GetHash())->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx3.GetHash())->GetFeesWithAncestors(), 50000LL);
+    it4 = pool.mapTx.find(tx4.GetHash());
+    BOOST_CHECK_EQUAL(it4->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(it4->GetSizeWithAncestors(), entry3.GetTxSize() + entry4.GetTxSize());
+    BOOST_CHECK_EQUAL(it4->GetFeesWithAncestors(), 52000LL);
+
+    // and pick it up again when it comes back on a reorg
+    pool.addUnchecked(tx1.GetHash(), entry1);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx3.GetHash())->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx4.GetHash())->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx4.GetHash())->GetFeesWithAncestors(), 53000LL);
+
+    pool.remove(tx1, removed, true);
+    BOOST_CHECK_EQUAL(pool.size(), 1);
+    BOOST_CHECK_EQUAL(pool.mapTx.get<2>().begin()->GetTx().GetHash().ToString(), tx2.GetHash().ToString());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    TestMemPoolEntryHelper entry;
+    entry.hadNoDependencies = true;
+    SetMockTime(42);
+
+    /* low fee parent */
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    CTxMemPoolEntry entry1 = entry.Fee(10000LL).FromTx(tx1);
+    pool.addUnchecked(tx1.GetHash(), entry1);
+
+    /* high fee child paying for it */
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vin[0].scriptSig = CScript() << OP_11;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_12 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    CTxMemPoolEntry entry2 = entry.Fee(40000LL).FromTx(tx2);
+    pool.addUnchecked(tx2.GetHash(), entry2);
+
+    /* unrelated, lowest fee */
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_13 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    CTxMemPoolEntry entry3 = entry.Fee(1000LL).FromTx(tx3);
+    pool.addUnchecked(tx3.GetHash(), entry3);
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+
+    CTxMemPool::indexed_transaction_set::const_iterator it1 = pool.mapTx.find(tx1.GetHash());
+    BOOST_CHECK_EQUAL(it1->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(it1->GetSizeWithDescendants(), entry1.GetTxSize() + entry2.GetTxSize());
+    BOOST_CHECK_EQUAL(it1->GetFeesWithDescendants(), 50000LL);
+    BOOST_CHECK_EQUAL(pool.mapTx.get<3>().begin()->GetTx().GetHash().ToString(), tx3.GetHash().ToString());
+    BOOST_CHECK(pool.GetMinFee(1000000) == CFeeRate(0));
+
+    // just over the limit evicts the lowest package and raises the minimum fee above it
+    BOOST_CHECK_EQUAL(pool.TrimToSize(pool.DynamicMemoryUsage() - 1), 1);
+    BOOST_CHECK(!pool.exists(tx3.GetHash()));
+    CFeeRate minFee = pool.GetMinFee(1000000);
+    BOOST_CHECK(minFee == CFeeRate(CFeeRate(1000LL, entry3.GetTxSize()).GetFeePerK() + 1000));
+
+    // which decays after a block, here four halvings as the pool is nearly empty
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(std::vector<CTransaction>(), 1, conflicts);
+    SetMockTime(42 + CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK(pool.GetMinFee(1000000) < minFee);
+
+    // the child leaving takes it out of the parent's package
+    std::list<CTransaction> removed;
+    pool.remove(tx2, removed, false);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetCountWithDescendants(), 1);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetFeesWithDescendants(), 10000LL);
+    pool.addUnchecked(tx2.GetHash(), entry2);
+
+    // a package is evicted as a whole
+    BOOST_CHECK_EQUAL(pool.TrimToSize(0), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+
+    SetMockTime(0);
+}
+
 // Test that nCheckFrequency is set correctly when calling setSanityCheck().
 // https://github.com/zcash/zcash/issues/3134
 BOOST_AUTO_TEST_CASE(SetSanityCheck) {
@@ -222,4 +373,80 @@ BOOST_AUTO_TEST_CASE(SetSanityCheck) {
     BOOST_CHECK_EQUAL(pool.GetCheckFrequency(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolCCOpRetIndexTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+    const uint8_t evalcode = 0xe6;
+
+    // a 'P' and a 'C' transaction of one contract, a token one and a plain one
+    CMutableTransaction tx[4];
+    const uint8_t opret[4][2] = { { evalcode, 'P' }, { evalcode, 'C' }, { EVAL_TOKENS, 't' }, { 0, 0 } };
+    for (int i = 0; i < 4; i++) {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].prevout.hash = GetRandHash();
+        tx[i].vout.resize(2);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10000LL;
+        if (i < 3)
+            tx[i].vout[1].scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(opret[i], opret[i] + 2);
+        pool.addUnchecked(tx[i].GetHash(), entry.FromTx(tx[i]));
+    }
+
+    std::vector<CTransaction> txs;
+    pool.queryCCOpRet(evalcode, 'P', txs);
+    BOOST_CHECK_EQUAL(txs.size(), 2);
+    std::set<uint256> found;
+    for (size_t i = 0; i < txs.size(); i++)
+        found.insert(txs[i].GetHash());
+    BOOST_CHECK(found.count(tx[0].GetHash()));
+    BOOST_CHECK(found.count(tx[2].GetHash()));
+
+    // removed transactions leave the index
+    std::list<CTransaction> removed;
+    pool.remove(tx[0], removed);
+    pool.remove(tx[2], removed);
+    txs.clear();
+    pool.queryCCOpRet(evalcode, 'P', txs);
+    BOOST_CHECK(txs.empty());
+    pool.queryCCOpRet(evalcode, 'C', txs);
+    BOOST_CHECK_EQUAL(txs.size(), 1);
+    BOOST_CHECK(txs[0].GetHash() == tx[1].GetHash());
+
+    // the spend of an outpoint is found through mapNextTx
+    BOOST_CHECK(pool.mapNextTx.count(tx[1].vin[0].prevout));
+    BOOST_CHECK(!pool.mapNextTx.count(tx[0].vin[0].prevout));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolTxDataTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = 10000LL;
+
+    // entries added without script checks carry no midstates
+    std::shared_ptr<const PrecomputedTransactionData> ptxdata;
+    pool.addUnchecked(tx.GetHash(), entry.FromTx(tx));
+    BOOST_CHECK(!pool.lookupTxData(tx.GetHash(), ptxdata));
+    std::list<CTransaction> removed;
+    pool.remove(tx, removed);
+
+    CTxMemPoolEntry txentry(entry.FromTx(tx));
+    size_t nUsage = txentry.DynamicMemoryUsage();
+    txentry.SetTxData(std::make_shared<PrecomputedTransactionData>(tx));
+    BOOST_CHECK(txentry.DynamicMemoryUsage() > nUsage);
+    pool.addUnchecked(tx.GetHash(), txentry);
+
+    BOOST_CHECK(pool.lookupTxData(tx.GetHash(), ptxdata));
+    PrecomputedTransactionData txdata(tx);
+    BOOST_CHECK(ptxdata->hashPrevouts == txdata.hashPrevouts);
+    BOOST_CHECK(ptxdata->hashOutputs == txdata.hashOutputs);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,87 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "crypto/muhash.h"
+#include "script/script.h"
+#include "test/test_bitcoin.h"
+#include "uint256.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(muhash_tests, BasicTestingSetup)
+
+static uint256 FinalizeHash(const MuHash3072& muhash)
+{
+    unsigned char hash[MuHash3072::OUTPUT_SIZE];
+    muhash.Finalize(hash);
+    return uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
+}
+
+static MuHash3072 FromElements(const std::vector<int>& elements)
+{
+    MuHash3072 muhash;
+    for (size_t i = 0; i < elements.size(); i++) {
+        unsigned char data[4] = {(unsigned char)elements[i], 0, 0, 1};
+        muhash.Insert(data, sizeof(data));
+    }
+    return muhash;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_set)
+{
+    uint256 empty = FinalizeHash(MuHash3072());
+    uint256 hash123 = FinalizeHash(FromElements({1, 2, 3}));
+    BOOST_CHECK(hash123 != empty);
+    BOOST_CHECK(FinalizeHash(FromElements({3, 1, 2})) == hash123);
+    BOOST_CHECK(FinalizeHash(FromElements({1, 2})) != hash123);
+
+    // sets hashed apart combine to the hash of their union
+    MuHash3072 combined = FromElements({1});
+    combined *= FromElements({2, 3});
+    BOOST_CHECK(FinalizeHash(combined) == hash123);
+
+    // taking an element out again is the same as never adding it
+    MuHash3072 removed = FromElements({1, 2, 3, 4});
+    unsigned char data[4] = {4, 0, 0, 1};
+    removed.Remove(data, sizeof(data));
+    BOOST_CHECK(FinalizeHash(removed) == hash123);
+    combined /= FromElements({1, 2, 3});
+    BOOST_CHECK(FinalizeHash(combined) == empty);
+}
+
+BOOST_AUTO_TEST_CASE(muhash_coins_cache)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache base(&viewDummy);
+    uint256 txidA = uint256S("0a"), txidB = uint256S("0b");
+    CTxOut out0(1000, CScript() << OP_1), out1(2000, CScript() << OP_2), out2(3000, CScript() << OP_3);
+    {
+        CCoinsModifier coins = base.ModifyCoins(txidA);
+        coins->vout.push_back(out0);
+        coins->vout.push_back(out1);
+    }
+
+    MuHash3072 muhash;
+    CCoinsStats stats;
+    MuHashTxOut(muhash, txidA, 0, out0, false);
+    MuHashTxOut(muhash, txidA, 1, out1, false);
+    stats.nTransactionOutputs = 2;
+    stats.nTotalAmount = 3000;
+
+    // spend one output of A and add B on top of the base
+    CCoinsViewCache view(&base);
+    view.ModifyCoins(txidA)->Spend(0);
+    view.ModifyCoins(txidB)->vout.push_back(out2);
+    view.UpdateMuHash(muhash, stats);
+
+    MuHash3072 expected;
+    MuHashTxOut(expected, txidA, 1, out1, false);
+    MuHashTxOut(expected, txidB, 0, out2, false);
+    BOOST_CHECK(FinalizeHash(muhash) == FinalizeHash(expected));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 2U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 4000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
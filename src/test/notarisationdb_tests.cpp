@@ -0,0 +1,54 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "notarisationdb.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(notarisationdb_tests, BasicTestingSetup)
+
+static std::vector<NotarisationIndexEntry> MakeIndex()
+{
+    std::vector<NotarisationIndexEntry> index;
+    for (int i = 1; i <= 5; i++) {
+        NotarisationIndexEntry entry;
+        entry.notarisedHeight = i * 10;
+        entry.txHeight = i * 10 + 3;
+        entry.txid = ArithToUint256(arith_uint256(i));
+        index.push_back(entry);
+    }
+    return index;
+}
+
+BOOST_AUTO_TEST_CASE(notarisation_bracket)
+{
+    std::vector<NotarisationIndexEntry> index = MakeIndex();
+    NotarisationIndexEntry prev, next;
+
+    // below the first notarisation there is no bracket
+    BOOST_CHECK(!FindNotarisationBracket(index, 5, prev, next));
+    BOOST_CHECK_EQUAL(next.notarisedHeight, 10);
+
+    BOOST_CHECK(FindNotarisationBracket(index, 25, prev, next));
+    BOOST_CHECK_EQUAL(prev.notarisedHeight, 20);
+    BOOST_CHECK_EQUAL(next.notarisedHeight, 30);
+    BOOST_CHECK(next.txid == ArithToUint256(arith_uint256(3)));
+
+    // a notarised height is its own prev
+    BOOST_CHECK(FindNotarisationBracket(index, 30, prev, next));
+    BOOST_CHECK_EQUAL(prev.notarisedHeight, 30);
+    BOOST_CHECK_EQUAL(next.notarisedHeight, 40);
+
+    // past the last notarisation next is empty
+    BOOST_CHECK(FindNotarisationBracket(index, 57, prev, next));
+    BOOST_CHECK_EQUAL(prev.notarisedHeight, 50);
+    BOOST_CHECK_EQUAL(next.notarisedHeight, 0);
+    BOOST_CHECK(next.txid.IsNull());
+
+    index.clear();
+    BOOST_CHECK(!FindNotarisationBracket(index, 25, prev, next));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
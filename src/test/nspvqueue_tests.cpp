@@ -0,0 +1,84 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "nspvqueue.h"
+#include "utiltime.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(nspvqueue_tests, BasicTestingSetup)
+
+static boost::mutex mutexAnswered;
+static std::vector<std::pair<NodeId, uint8_t> > vAnswered;
+
+static void RecordRequest(CNode *pfrom, std::vector<uint8_t> request)
+{
+    boost::unique_lock<boost::mutex> lock(mutexAnswered);
+    vAnswered.push_back(std::make_pair(pfrom->id, request[0]));
+}
+
+static CAddress Addr(uint32_t i)
+{
+    struct in_addr s;
+    s.s_addr = i;
+    return CAddress(CService(CNetAddr(s), 8770));
+}
+
+BOOST_AUTO_TEST_CASE(nspvqueue_fairness)
+{
+    CNode nodeA(INVALID_SOCKET, Addr(0x0100000a), "", true), nodeB(INVALID_SOCKET, Addr(0x0200000a), "", true);
+    CNSPVRequestQueue queue(RecordRequest, 8);
+    // a burst from A does not hold up B, each peer keeps its order
+    for (uint8_t i = 0; i < 3; i++)
+        BOOST_CHECK(queue.Push(&nodeA, std::vector<uint8_t>(1, i)));
+    for (uint8_t i = 0; i < 2; i++)
+        BOOST_CHECK(queue.Push(&nodeB, std::vector<uint8_t>(1, i)));
+    BOOST_CHECK_EQUAL(queue.Size(), 5);
+    BOOST_CHECK_EQUAL(nodeA.GetRefCount(), 1);
+    // the queue is bounded in total
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(queue.Push(&nodeB, std::vector<uint8_t>(1, 9)));
+    BOOST_CHECK(!queue.Push(&nodeA, std::vector<uint8_t>(1, 9)));
+
+    vAnswered.clear();
+    boost::thread worker(boost::bind(&CNSPVRequestQueue::Thread, &queue));
+    for (int i = 0; i < 500 && queue.Size() != 0; i++)
+        MilliSleep(10);
+    MilliSleep(50);
+    worker.interrupt();
+    worker.join();
+
+    boost::unique_lock<boost::mutex> lock(mutexAnswered);
+    BOOST_CHECK_EQUAL(vAnswered.size(), 8);
+    NodeId order[5] = { nodeA.id, nodeB.id, nodeA.id, nodeB.id, nodeA.id };
+    uint8_t requests[5] = { 0, 0, 1, 1, 2 };
+    for (int i = 0; i < 5 && i < (int)vAnswered.size(); i++) {
+        BOOST_CHECK_EQUAL(vAnswered[i].first, order[i]);
+        BOOST_CHECK_EQUAL(vAnswered[i].second, requests[i]);
+    }
+    // references taken for queued requests are given back
+    BOOST_CHECK_EQUAL(nodeA.GetRefCount(), 0);
+    BOOST_CHECK_EQUAL(nodeB.GetRefCount(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(nspvqueue_per_peer_limit)
+{
+    CNode node(INVALID_SOCKET, Addr(0x0300000a), "", true), other(INVALID_SOCKET, Addr(0x0400000a), "", true);
+    CNSPVRequestQueue queue(RecordRequest, DEFAULT_NSPV_QUEUE);
+    for (unsigned int i = 0; i < NSPV_QUEUE_PER_PEER; i++)
+        BOOST_CHECK(queue.Push(&node, std::vector<uint8_t>(1, 0)));
+    BOOST_CHECK(!queue.Push(&node, std::vector<uint8_t>(1, 0)));
+    BOOST_CHECK(queue.Push(&other, std::vector<uint8_t>(1, 0)));
+
+    boost::thread worker(boost::bind(&CNSPVRequestQueue::Thread, &queue));
+    for (int i = 0; i < 500 && queue.Size() != 0; i++)
+        MilliSleep(10);
+    MilliSleep(50);
+    worker.interrupt();
+    worker.join();
+    BOOST_CHECK_EQUAL(node.GetRefCount(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
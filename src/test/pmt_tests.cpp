@@ -108,6 +108,41 @@ BOOST_AUTO_TEST_CASE(pmt_test1)
     }
 }
 
+BOOST_AUTO_TEST_CASE(pmt_single_from_tree)
+{
+    static const unsigned int nTxCounts[] = {1, 2, 7, 17, 100, 513};
+
+    for (int n = 0; n < 6; n++) {
+        unsigned int nTx = nTxCounts[n];
+        CBlock block;
+        for (unsigned int j=0; j<nTx; j++) {
+            CMutableTransaction tx;
+            tx.nLockTime = j;
+            block.vtx.push_back(CTransaction(tx));
+        }
+        uint256 merkleRoot = block.BuildMerkleTree();
+        std::vector<uint256> vTxid(nTx, uint256());
+        for (unsigned int j=0; j<nTx; j++)
+            vTxid[j] = block.vtx[j].GetHash();
+
+        // every leaf gives the same partial tree as matching it in the full txid list
+        for (unsigned int j=0; j<nTx; j++) {
+            std::vector<bool> vMatch(nTx, false);
+            vMatch[j] = true;
+            CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION), ss2(SER_NETWORK, PROTOCOL_VERSION);
+            ss1 << CPartialMerkleTree(vTxid, vMatch);
+            ss2 << CPartialMerkleTree(block.vMerkleTree, nTx, j);
+            BOOST_CHECK(std::vector<char>(ss1.begin(), ss1.end()) == std::vector<char>(ss2.begin(), ss2.end()));
+
+            CPartialMerkleTree pmt;
+            ss2 >> pmt;
+            std::vector<uint256> vMatchTxid;
+            BOOST_CHECK(pmt.ExtractMatches(vMatchTxid) == merkleRoot);
+            BOOST_CHECK(vMatchTxid.size() == 1 && vMatchTxid[0] == vTxid[j]);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(pmt_malleability)
 {
     std::vector<uint256> vTxid = boost::assign::list_of
@@ -0,0 +1,76 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "memusage.h"
+#include "random.h"
+#include "support/allocators/pool.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_resource_blocks)
+{
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumberOfChunks(), 0);
+
+    // blocks come from one chunk, freed ones are handed out again
+    void* a = resource.Allocate(24, 8);
+    void* b = resource.Allocate(24, 8);
+    BOOST_CHECK_EQUAL(resource.NumberOfChunks(), 1);
+    BOOST_CHECK_EQUAL((char*)b - (char*)a, 24);
+    resource.Deallocate(a, 24, 8);
+    BOOST_CHECK(resource.Allocate(24, 8) == a);
+    // a different size does not take the freed block
+    resource.Deallocate(b, 24, 8);
+    BOOST_CHECK(resource.Allocate(16, 8) != b);
+
+    // too large for the pool, comes from operator new
+    void* large = resource.Allocate(128, 8);
+    BOOST_CHECK_EQUAL(resource.NumberOfChunks(), 1);
+    resource.Deallocate(large, 128, 8);
+
+    // a full chunk starts the next one
+    for (int i = 0; i < 1024 / 64; i++)
+        resource.Allocate(64, 8);
+    BOOST_CHECK_EQUAL(resource.NumberOfChunks(), 2);
+    resource.Release();
+    BOOST_CHECK_EQUAL(resource.NumberOfChunks(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(pool_coins_map)
+{
+    CCoinsMap::allocator_type::ResourceType resource;
+    CCoinsMap::allocator_type alloc(&resource);
+    CCoinsMap map(alloc);
+    for (int i = 0; i < 10000; i++)
+        map[GetRandHash()].coins.nVersion = 1;
+    BOOST_CHECK(resource.NumberOfChunks() > 0);
+    size_t nUsage = memusage::DynamicUsage(map);
+    BOOST_CHECK_EQUAL(nUsage, memusage::MallocUsage(resource.ChunkSizeBytes()) * resource.NumberOfChunks() +
+                              memusage::MallocUsage(sizeof(char*) * resource.NumberOfChunks()) +
+                              memusage::MallocUsage(sizeof(void*) * map.bucket_count()));
+
+    // erasing only fills the free lists, new entries reuse them
+    size_t nChunks = resource.NumberOfChunks();
+    for (CCoinsMap::iterator it = map.begin(); it != map.end();)
+        map.erase(it++);
+    for (int i = 0; i < 10000; i++)
+        map[GetRandHash()].coins.nVersion = 1;
+    BOOST_CHECK_EQUAL(resource.NumberOfChunks(), nChunks);
+
+    CCoinsMap(map.get_allocator()).swap(map);
+    resource.Release();
+    BOOST_CHECK_EQUAL(resource.NumberOfChunks(), 0);
+    BOOST_CHECK(memusage::DynamicUsage(map) < nUsage);
+
+    // maps without a resource use the heap
+    CCoinsMap plain;
+    plain[GetRandHash()].coins.nVersion = 1;
+    BOOST_CHECK(plain.get_allocator().GetResource() == NULL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
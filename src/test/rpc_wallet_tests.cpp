@@ -824,6 +824,68 @@ BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_parallel_cancel)
     BOOST_CHECK(ids.size()==0);
 }
 
+// Records the order operations run in, optionally sharing inputs with others
+std::mutex gOrderLock;
+std::vector<std::string> gOrder;
+
+class KeyedOperation : public AsyncRPCOperation {
+public:
+    std::string name, key;
+    KeyedOperation(std::string n, std::string k) : name(n), key(k) {}
+    virtual ~KeyedOperation() {}
+    virtual std::string getInputsKey() const { return key; }
+    virtual void main() {
+        set_state(OperationStatus::EXECUTING);
+        {
+            std::lock_guard<std::mutex> guard(gOrderLock);
+            gOrder.push_back(name + "+");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        {
+            std::lock_guard<std::mutex> guard(gOrderLock);
+            gOrder.push_back(name + "-");
+        }
+        set_state(OperationStatus::SUCCESS);
+    }
+};
+
+// This tests priority classes and operations that share inputs
+BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_priority)
+{
+    gOrder.clear();
+    std::shared_ptr<AsyncRPCQueue> q = std::make_shared<AsyncRPCQueue>();
+    std::shared_ptr<AsyncRPCOperation> a(new KeyedOperation("a", "x"));
+    std::shared_ptr<AsyncRPCOperation> b(new KeyedOperation("b", "x"));
+    std::shared_ptr<AsyncRPCOperation> c(new KeyedOperation("c", "y"));
+    q->addOperation(a, ASYNC_RPC_PRIORITY_LOW);
+    q->addOperation(b);
+    q->addOperation(c);
+    BOOST_CHECK(q->setOperationPriority(c->getId(), ASYNC_RPC_PRIORITY_HIGH));
+    BOOST_CHECK(!q->setOperationPriority("opid-1234", ASYNC_RPC_PRIORITY_HIGH));
+
+    // c goes first and b runs alongside it, a shares inputs with b and starts
+    // only once b is done
+    q->addWorker();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    q->addWorker();
+    q->finishAndWait();
+    BOOST_CHECK(gOrder.size() == 6);
+    BOOST_CHECK(gOrder[0] == "c+");
+    BOOST_CHECK(gOrder[1] == "b+");
+    BOOST_CHECK(std::find(gOrder.begin(), gOrder.end(), "a+") > std::find(gOrder.begin(), gOrder.end(), "b-"));
+    BOOST_CHECK(!q->setOperationPriority(a->getId(), ASYNC_RPC_PRIORITY_HIGH));
+
+    // workers are added as operations wait, up to the maximum
+    q = std::make_shared<AsyncRPCQueue>();
+    q->setMaxWorkers(2);
+    for (int i = 0; i < 4; i++) {
+        std::shared_ptr<AsyncRPCOperation> op(new MockSleepOperation(200));
+        q->addOperation(op);
+    }
+    BOOST_CHECK(q->getNumberOfWorkers() == 2);
+    q->finishAndWait();
+}
+
 // This tests z_getoperationstatus, z_getoperationresult, z_listoperationids
 BOOST_AUTO_TEST_CASE(rpc_z_getoperations)
 {
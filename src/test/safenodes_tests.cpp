@@ -0,0 +1,177 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "safenodes.h"
+#include "safenodesdb.h"
+#include "test/test_bitcoin.h"
+#include "utilstrencodings.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(safenodes_tests, BasicTestingSetup)
+
+static const std::string PARENT_A(66, 'a');
+static const std::string PARENT_B(66, 'b');
+static const std::string SAFEKEY_1(66, '1');
+static const std::string SAFEKEY_2(66, '2');
+
+static CNotarySet Notaries(const std::string& a, const std::string& b = "")
+{
+    std::vector<std::vector<unsigned char> > vPubkeys;
+    vPubkeys.push_back(ParseHex(a));
+    if (!b.empty())
+        vPubkeys.push_back(ParseHex(b));
+    return CNotarySet(vPubkeys);
+}
+
+static std::string KVKey(const std::string& parentkey, int32_t height)
+{
+    return parentkey + "0" + std::to_string(height) + "1";
+}
+
+BOOST_AUTO_TEST_CASE(safenodes_latest_registration)
+{
+    CSafeNodeRegistry registry;
+    CNotarySet parents = Notaries(PARENT_A, PARENT_B);
+
+    registry.Update(KVKey(PARENT_A, 1000000), CSafeNodeRegistration(SAFEKEY_1, PARENT_A, 1000000, 1440, 1000000), 1000000);
+    registry.Update(KVKey(PARENT_B, 1000100), CSafeNodeRegistration(SAFEKEY_1, PARENT_B, 1000100, 2880, 1000100), 1000100);
+    registry.Update(KVKey(PARENT_A, 1000200), CSafeNodeRegistration(SAFEKEY_2, PARENT_A, 1000200, 1440, 1000200), 1000200);
+
+    CSafeNodeRegistration reg;
+    BOOST_CHECK(registry.GetLatest(SAFEKEY_1, parents, reg));
+    BOOST_CHECK_EQUAL(reg.parentkey, PARENT_B);
+    BOOST_CHECK_EQUAL(reg.ValidThru(), 1000100 + 2880);
+
+    // registrations under a parentkey that is no longer a notary are skipped
+    CNotarySet onlyA = Notaries(PARENT_A);
+    BOOST_CHECK(registry.GetLatest(SAFEKEY_1, onlyA, reg));
+    BOOST_CHECK_EQUAL(reg.height, 1000000);
+
+    BOOST_CHECK_EQUAL(registry.GetActive(1001500, parents).size(), 2);
+    BOOST_CHECK_EQUAL(registry.GetActive(1002000, parents).size(), 1);
+    BOOST_CHECK_EQUAL(registry.GetSafekeys(PARENT_A).size(), 2);
+    BOOST_CHECK_EQUAL(registry.GetSafekeys(PARENT_B).size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(safenodes_rewind)
+{
+    CSafeNodeRegistry registry;
+    CNotarySet parents = Notaries(PARENT_A);
+    std::string kvkey = KVKey(PARENT_A, 1000000);
+
+    registry.Update(kvkey, CSafeNodeRegistration(SAFEKEY_1, PARENT_A, 1000000, 1440, 1000000), 1000001);
+    // same KV key overwritten with another safekey in a later block
+    registry.Update(kvkey, CSafeNodeRegistration(SAFEKEY_2, PARENT_A, 1000000, 1440, 1000000), 1000005);
+
+    CSafeNodeRegistration reg;
+    BOOST_CHECK(!registry.GetLatest(SAFEKEY_1, parents, reg));
+    BOOST_CHECK(registry.GetLatest(SAFEKEY_2, parents, reg));
+
+    registry.Rewind(1000005);
+    BOOST_CHECK(registry.GetLatest(SAFEKEY_1, parents, reg));
+    BOOST_CHECK(!registry.GetLatest(SAFEKEY_2, parents, reg));
+
+    registry.Rewind(1000001);
+    BOOST_CHECK(!registry.GetLatest(SAFEKEY_1, parents, reg));
+    BOOST_CHECK_EQUAL(registry.Size(), 0);
+    BOOST_CHECK(registry.GetSafekeys(PARENT_A).empty());
+}
+
+BOOST_AUTO_TEST_CASE(safenodes_prune_undo)
+{
+    CSafeNodeRegistry registry;
+    CNotarySet parents = Notaries(PARENT_A);
+
+    registry.Update(KVKey(PARENT_A, 1000000), CSafeNodeRegistration(SAFEKEY_1, PARENT_A, 1000000, 1440, 1000000), 1000000);
+    registry.PruneUndo(1000001);
+    registry.Rewind(1000000);
+
+    CSafeNodeRegistration reg;
+    BOOST_CHECK(registry.GetLatest(SAFEKEY_1, parents, reg));
+}
+
+BOOST_AUTO_TEST_CASE(safenodes_tally_window)
+{
+    CSafeNodeRegistry registry;
+
+    registry.Update(KVKey(PARENT_A, 1000000), CSafeNodeRegistration(SAFEKEY_1, PARENT_A, 1000000, 10000, 1000000), 1000000);
+    registry.Update(KVKey(PARENT_A, 1000010), CSafeNodeRegistration(SAFEKEY_1, PARENT_A, 1000010, 10000, 1000010), 1000010);
+    registry.Update(KVKey(PARENT_A, 1000020), CSafeNodeRegistration(SAFEKEY_2, PARENT_A, 1000020, 10000, 1000020), 1000020);
+    registry.Update(KVKey(PARENT_B, 1000030), CSafeNodeRegistration(SAFEKEY_2, PARENT_B, 1000030, 10000, 1000030), 1000030);
+    // parentkey was not a notary at the height named by the key
+    registry.Update(KVKey(PARENT_B, 1000040), CSafeNodeRegistration(SAFEKEY_1, PARENT_B, 1000040, 10000, 0), 1000040);
+
+    std::vector<SafeNodeTally> vTally = registry.GetTally(1000100, 1000);
+    BOOST_CHECK_EQUAL(vTally.size(), 2);
+    BOOST_CHECK_EQUAL(std::get<0>(vTally[0]), PARENT_A);
+    BOOST_CHECK_EQUAL(std::get<1>(vTally[0]), 3);
+    BOOST_CHECK_EQUAL(std::get<2>(vTally[0]).size(), 2);
+    BOOST_CHECK_EQUAL(std::get<2>(vTally[0])[0].second, 2);
+    BOOST_CHECK_EQUAL(std::get<1>(vTally[1]), 1);
+
+    // window only reaches back to the last two registrations
+    vTally = registry.GetTally(1000030, 15);
+    BOOST_CHECK_EQUAL(vTally.size(), 2);
+    BOOST_CHECK_EQUAL(std::get<1>(vTally[0]), 1);
+    BOOST_CHECK_EQUAL(std::get<1>(vTally[1]), 1);
+
+    registry.Rewind(1000030);
+    vTally = registry.GetTally(1000030, 15);
+    BOOST_CHECK_EQUAL(vTally.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(safenodes_db_roundtrip)
+{
+    CSafeNodesDB db(1 << 20, true);
+    CSafeNodeRegistry registry;
+    CNotarySet parents = Notaries(PARENT_A);
+    BOOST_CHECK_EQUAL(db.GetBestHeight(), -1);
+    BOOST_CHECK(!db.LoadRegistry(registry));
+
+    registry.Update(KVKey(PARENT_A, 1000000), CSafeNodeRegistration(SAFEKEY_1, PARENT_A, 1000000, 1440, 1000000), 1000000);
+    BOOST_CHECK(db.WriteBlock(registry, 1000000, 100));
+    registry.Update(KVKey(PARENT_A, 1000001), CSafeNodeRegistration(SAFEKEY_2, PARENT_A, 1000001, 1440, 1000001), 1000001);
+    BOOST_CHECK(db.WriteBlock(registry, 1000001, 100));
+    BOOST_CHECK_EQUAL(db.GetBestHeight(), 1000001);
+
+    CSafeNodeRegistry loaded;
+    CSafeNodeRegistration reg;
+    BOOST_CHECK(db.LoadRegistry(loaded));
+    BOOST_CHECK_EQUAL(loaded.Size(), 2);
+    BOOST_CHECK(loaded.GetLatest(SAFEKEY_2, parents, reg));
+
+    // loaded undo data lets the in-memory copy follow a reorg
+    loaded.Rewind(1000001);
+    BOOST_CHECK(!loaded.GetLatest(SAFEKEY_2, parents, reg));
+
+    BOOST_CHECK(db.DisconnectBlock(1000001));
+    BOOST_CHECK_EQUAL(db.GetBestHeight(), 1000000);
+    BOOST_CHECK(db.LoadRegistry(loaded));
+    BOOST_CHECK_EQUAL(loaded.Size(), 1);
+    BOOST_CHECK(loaded.GetLatest(SAFEKEY_1, parents, reg));
+}
+
+BOOST_AUTO_TEST_CASE(safenodes_shared_notaryset)
+{
+    uint8_t pubkeys[2][33];
+    std::vector<unsigned char> a = ParseHex(PARENT_A), b = ParseHex(PARENT_B);
+    memcpy(pubkeys[0], &a[0], 33);
+    memcpy(pubkeys[1], &b[0], 33);
+
+    CNotarySetRef set = GetSharedNotarySet(pubkeys, 2);
+    BOOST_CHECK_EQUAL(set->Size(), 2);
+    BOOST_CHECK(set->IsNotary(PARENT_B));
+    BOOST_CHECK(!set->IsNotary(SAFEKEY_1));
+    BOOST_CHECK_EQUAL(set->Hexkeys()[0], PARENT_A);
+    BOOST_CHECK(set->Pubkeys()[1] == b);
+    BOOST_CHECK(set->IsNotary(pubkeys[1]));
+    BOOST_CHECK(!set->IsNotary(&ParseHex(SAFEKEY_2)[0]));
+    // the same pubkeys map to the same shared set, a different list to another one
+    BOOST_CHECK(GetSharedNotarySet(pubkeys, 2) == set);
+    BOOST_CHECK(GetSharedNotarySet(pubkeys, 1) != set);
+    BOOST_CHECK_EQUAL(GetSharedNotarySet(pubkeys, -1)->Size(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
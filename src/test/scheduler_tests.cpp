@@ -109,4 +109,104 @@ BOOST_AUTO_TEST_CASE(manythreads)
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+static void keyedTask(boost::mutex& mutex, int& nRunning, int& nMaxRunning, int& nDone)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nMaxRunning = std::max(nMaxRunning, ++nRunning);
+    }
+    MicroSleep(1000);
+    boost::unique_lock<boost::mutex> lock(mutex);
+    --nRunning;
+    ++nDone;
+}
+
+BOOST_AUTO_TEST_CASE(serialized_keys)
+{
+    // tasks that share a key never overlap, however many threads there are
+    CScheduler scheduler;
+    boost::mutex mutex;
+    int nRunning = 0, nMaxRunning = 0, nDone = 0;
+    boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    for (int i = 0; i < 20; i++)
+        scheduler.schedule(boost::bind(&keyedTask, boost::ref(mutex), boost::ref(nRunning), boost::ref(nMaxRunning), boost::ref(nDone)),
+                           now, CScheduler::PRIORITY_NORMAL, "key");
+
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK_EQUAL(nDone, 20);
+    BOOST_CHECK_EQUAL(nMaxRunning, 1);
+}
+
+static void orderedTask(std::vector<int>& vOrder, int n)
+{
+    vOrder.push_back(n);
+}
+
+BOOST_AUTO_TEST_CASE(priorities)
+{
+    // of the tasks that are due, the highest priority goes first even when it is due last
+    CScheduler scheduler;
+    std::vector<int> vOrder;
+    boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    scheduler.schedule(boost::bind(&orderedTask, boost::ref(vOrder), 2), now - boost::chrono::seconds(3), CScheduler::PRIORITY_LOW, "");
+    scheduler.schedule(boost::bind(&orderedTask, boost::ref(vOrder), 1), now - boost::chrono::seconds(2), CScheduler::PRIORITY_NORMAL, "");
+    scheduler.schedule(boost::bind(&orderedTask, boost::ref(vOrder), 0), now - boost::chrono::seconds(1), CScheduler::PRIORITY_HIGH, "");
+
+    boost::thread thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    thread.join();
+
+    BOOST_CHECK_EQUAL(vOrder.size(), 3U);
+    for (size_t i = 0; i < vOrder.size(); i++)
+        BOOST_CHECK_EQUAL(vOrder[i], (int)i);
+}
+
+static void housekeepingTask(boost::mutex& mutex, boost::condition_variable& cond, bool& fSignalled, bool& fTimedOut, int& nRunning, int& nMaxRunning)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nMaxRunning = std::max(nMaxRunning, ++nRunning);
+    while (!fSignalled && !fTimedOut)
+        fTimedOut = cond.wait_for(lock, boost::chrono::seconds(5)) == boost::cv_status::timeout;
+    --nRunning;
+}
+
+static void signalTask(boost::mutex& mutex, boost::condition_variable& cond, bool& fSignalled)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fSignalled = true;
+    cond.notify_all();
+}
+
+BOOST_AUTO_TEST_CASE(low_priority_leaves_a_thread)
+{
+    // with two threads, a slow low priority task does not keep a normal one from running,
+    // and a second low priority task waits rather than take the other thread
+    CScheduler scheduler;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fSignalled = false, fTimedOut = false;
+    int nRunning = 0, nMaxRunning = 0;
+    boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    for (int i = 0; i < 2; i++)
+        scheduler.schedule(boost::bind(&housekeepingTask, boost::ref(mutex), boost::ref(cond), boost::ref(fSignalled), boost::ref(fTimedOut),
+                                       boost::ref(nRunning), boost::ref(nMaxRunning)), now, CScheduler::PRIORITY_LOW, "");
+    scheduler.schedule(boost::bind(&signalTask, boost::ref(mutex), boost::ref(cond), boost::ref(fSignalled)),
+                       now + boost::chrono::milliseconds(10), CScheduler::PRIORITY_NORMAL, "");
+
+    boost::thread_group threads;
+    for (int i = 0; i < 2; i++)
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK(fSignalled);
+    BOOST_CHECK(!fTimedOut);
+    BOOST_CHECK_EQUAL(nMaxRunning, 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,85 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "shieldedcache.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(shieldedcache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(nullifier_filter)
+{
+    CNullifierFilter filter;
+    std::vector<uint256> vInserted;
+    for (size_t i = 0; i < MIN_NULLIFIER_FILTER_ELEMENTS; i++) {
+        BOOST_CHECK(!filter.IsFull());
+        vInserted.push_back(GetRandHash());
+        filter.Insert(vInserted.back());
+    }
+    BOOST_CHECK_EQUAL(filter.Size(), MIN_NULLIFIER_FILTER_ELEMENTS);
+    BOOST_CHECK(filter.IsFull());
+
+    // never a false negative
+    for (size_t i = 0; i < vInserted.size(); i++)
+        BOOST_CHECK(filter.MayContain(vInserted[i]));
+
+    // about 0.2% false positives at the size it was made for, allow some slack
+    int nFalse = 0;
+    for (int i = 0; i < 100000; i++)
+        if (filter.MayContain(GetRandHash()))
+            nFalse++;
+    BOOST_CHECK(nFalse < 1000);
+
+    // a swapped in filter answers for its own set
+    CNullifierFilter other;
+    other.Swap(filter);
+    BOOST_CHECK_EQUAL(filter.Size(), 0);
+    BOOST_CHECK(!filter.MayContain(vInserted[0]));
+    BOOST_CHECK(other.MayContain(vInserted[0]));
+
+    // never sized below the minimum
+    other.Reset(0);
+    BOOST_CHECK_EQUAL(other.Size(), 0);
+    for (int i = 0; i < 1000; i++)
+        other.Insert(GetRandHash());
+    BOOST_CHECK(!other.IsFull());
+}
+
+BOOST_AUTO_TEST_CASE(anchor_cache_lru)
+{
+    CAnchorCache<int> cache(3);
+    uint256 roots[4];
+    for (int i = 0; i < 4; i++)
+        roots[i] = GetRandHash();
+
+    cache.Insert(roots[0], 0);
+    cache.Insert(roots[1], 1);
+    cache.Insert(roots[2], 2);
+    int tree = -1;
+    BOOST_CHECK(cache.Get(roots[0], tree));
+    BOOST_CHECK_EQUAL(tree, 0);
+
+    // the least recently used anchor goes first, 0 was just looked up
+    cache.Insert(roots[3], 3);
+    BOOST_CHECK_EQUAL(cache.Size(), 3);
+    BOOST_CHECK(!cache.Get(roots[1], tree));
+    BOOST_CHECK(cache.Get(roots[2], tree));
+    BOOST_CHECK_EQUAL(tree, 2);
+
+    // inserting a cached root replaces its tree
+    cache.Insert(roots[3], 4);
+    BOOST_CHECK_EQUAL(cache.Size(), 3);
+    BOOST_CHECK(cache.Get(roots[3], tree));
+    BOOST_CHECK_EQUAL(tree, 4);
+
+    cache.Erase(roots[3]);
+    BOOST_CHECK_EQUAL(cache.Size(), 2);
+    BOOST_CHECK(!cache.Get(roots[3], tree));
+    cache.Erase(roots[3]);
+    BOOST_CHECK_EQUAL(cache.Size(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -100,4 +100,45 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(findearliestatleast_test)
+{
+    std::vector<uint256> vHashMain(10000);
+    std::vector<CBlockIndex> vBlocksMain(10000);
+    for (unsigned int i = 0; i < vBlocksMain.size(); i++) {
+        vHashMain[i] = ArithToUint256(i); // Set the hash equal to the height
+        vBlocksMain[i].SetHeight(i);
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+        vBlocksMain[i].phashBlock = &vHashMain[i];
+        vBlocksMain[i].BuildSkip();
+        // timestamps that mostly grow but sometimes repeat or go back
+        vBlocksMain[i].nTime = 1000000 + i * 60 - (insecure_rand() % 3) * 90;
+        vBlocksMain[i].BuildTimeMax();
+        if (i > 0) {
+            BOOST_CHECK(vBlocksMain[i].nTimeMax >= vBlocksMain[i - 1].nTimeMax);
+            BOOST_CHECK(vBlocksMain[i].nTimeLogical > vBlocksMain[i - 1].nTimeLogical);
+        }
+    }
+
+    CChain chain;
+    chain.SetTip(&vBlocksMain.back());
+
+    for (int n = 0; n < 1000; n++) {
+        int64_t nTime = 1000000 - 500 + insecure_rand() % (10000 * 60 + 1000);
+        CBlockIndex* pindex = chain.FindEarliestAtLeast(nTime);
+        if (pindex == NULL) {
+            BOOST_CHECK(chain.Tip()->GetBlockTimeMax() < nTime);
+        } else {
+            BOOST_CHECK(pindex->GetBlockTimeMax() >= nTime);
+            BOOST_CHECK(pindex->pprev == NULL || pindex->pprev->GetBlockTimeMax() < nTime);
+        }
+        pindex = chain.FindEarliestLogicalAtLeast(nTime);
+        if (pindex == NULL) {
+            BOOST_CHECK(chain.Tip()->nTimeLogical < nTime);
+        } else {
+            BOOST_CHECK(pindex->nTimeLogical >= nTime);
+            BOOST_CHECK(pindex->pprev == NULL || pindex->pprev->nTimeLogical < nTime);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
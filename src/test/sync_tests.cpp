@@ -0,0 +1,44 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sync.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(lockprofile_sites)
+{
+    CCriticalSection cs;
+    fLockProfile = true;
+    for (int i = 0; i < 3; i++) {
+        LOCK(cs);
+    }
+    fLockProfile = false;
+    {
+        LOCK(cs); // not recorded
+    }
+
+    const CLockSiteStats* psite = NULL;
+    std::vector<const CLockSiteStats*> vSites = GetLockProfile();
+    for (size_t i = 0; i < vSites.size(); i++)
+        if (vSites[i]->strName == "cs")
+            psite = vSites[i];
+    BOOST_REQUIRE(psite != NULL);
+    BOOST_CHECK_EQUAL(psite->nCount.load(), 3);
+    BOOST_CHECK_EQUAL(psite->nContended.load(), 0);
+
+    // every lock lands in exactly one bucket of each histogram
+    uint64_t nWaits = 0, nHolds = 0;
+    for (int i = 0; i < LOCK_PROFILE_BUCKETS; i++) {
+        nWaits += psite->vWaitHistogram[i].load();
+        nHolds += psite->vHoldHistogram[i].load();
+    }
+    BOOST_CHECK_EQUAL(nWaits, 3);
+    BOOST_CHECK_EQUAL(nHolds, 3);
+    BOOST_CHECK_EQUAL(psite->vWaitHistogram[0].load(), 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -285,6 +285,31 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(tx, state, verifier) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(transaction_total_size)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(2);
+    mtx.vin[0].scriptSig << OP_1;
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 42;
+    mtx.vout[0].scriptPubKey << OP_2;
+
+    CTransaction tx(mtx);
+    BOOST_CHECK_EQUAL(tx.GetTotalSize(), ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
+
+    // the cached size follows the transaction through copies and deserialization
+    CTransaction tx2;
+    BOOST_CHECK_EQUAL(tx2.GetTotalSize(), ::GetSerializeSize(tx2, SER_NETWORK, PROTOCOL_VERSION));
+    tx2 = tx;
+    BOOST_CHECK_EQUAL(tx2.GetTotalSize(), tx.GetTotalSize());
+
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << tx;
+    CTransaction tx3;
+    stream >> tx3;
+    BOOST_CHECK_EQUAL(tx3.GetTotalSize(), tx.GetTotalSize());
+}
+
 //
 // Helper: create two dummy transactions, each with
 // two outputs.  The first has 11 and 50 CENT outputs
@@ -0,0 +1,116 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "script/standard.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txoutsetsnapshot_tests, TestingSetup)
+
+static bool Dump(const CCoinsViewDB& db, const boost::filesystem::path& path, const CTxOutSetSnapshotHeader& header, CCoinsStats& stats)
+{
+    CAutoFile file(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    return db.DumpSnapshot(file, header, stats);
+}
+
+static bool Load(CCoinsViewDB& db, const boost::filesystem::path& path, CCoinsStats& stats)
+{
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    CTxOutSetSnapshotHeader header;
+    file >> header;
+    return db.LoadSnapshot(file, header, stats);
+}
+
+BOOST_AUTO_TEST_CASE(txoutsetsnapshot_roundtrip)
+{
+    CCoinsViewDB source(1 << 20, true);
+    uint256 txid = uint256S("11"), nullifier = uint256S("22"), hashBlock = uint256S("33"), hashAnchor = uint256S("44");
+
+    CCoinsMap mapCoins;
+    CCoinsCacheEntry& entry = mapCoins[txid];
+    entry.coins.nHeight = 7;
+    entry.coins.vout.push_back(CTxOut(5 * COIN, GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 1))))));
+    entry.coins.vout.push_back(CTxOut(2 * COIN, CScript() << OP_TRUE));
+    entry.flags = CCoinsCacheEntry::DIRTY;
+    CCoins written = entry.coins;
+    CNullifiersMap mapSproutNullifiers, mapSaplingNullifiers;
+    mapSaplingNullifiers[nullifier].entered = true;
+    mapSaplingNullifiers[nullifier].flags = CNullifiersCacheEntry::DIRTY;
+    CAnchorsSproutMap mapSproutAnchors;
+    CAnchorsSaplingMap mapSaplingAnchors;
+    BOOST_CHECK(source.BatchWrite(mapCoins, hashBlock, hashAnchor, uint256(), mapSproutAnchors, mapSaplingAnchors, mapSproutNullifiers, mapSaplingNullifiers));
+
+    CTxOutSetSnapshotHeader header;
+    header.hashBlock = hashBlock;
+    header.nHeight = 10;
+    header.hashNotarized = uint256S("55");
+    header.nNotarizedHeight = 8;
+    boost::filesystem::path path = GetDataDir() / "utxo.dat";
+    CCoinsStats stats;
+    BOOST_CHECK(Dump(source, path, header, stats));
+    BOOST_CHECK_EQUAL(stats.nTransactions, 1);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 2);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 7 * COIN);
+    // only the block the set belongs to can be dumped
+    CTxOutSetSnapshotHeader other = header;
+    other.hashBlock = uint256S("66");
+    CCoinsStats otherstats;
+    BOOST_CHECK(!Dump(source, GetDataDir() / "other.dat", other, otherstats));
+
+    CCoinsViewDB target(1 << 20, true);
+    CCoinsStats loaded;
+    BOOST_CHECK(Load(target, path, loaded));
+    BOOST_CHECK(loaded.hashSerialized == stats.hashSerialized);
+    BOOST_CHECK(target.GetBestBlock() == hashBlock);
+    BOOST_CHECK(target.GetBestAnchor(SPROUT) == hashAnchor);
+    BOOST_CHECK(target.GetNullifier(nullifier, SAPLING));
+    BOOST_CHECK(!target.GetNullifier(nullifier, SPROUT));
+    CCoins coins;
+    BOOST_CHECK(target.GetCoins(txid, coins));
+    BOOST_CHECK(coins == written);
+    // a coin database that is not empty is never overwritten
+    CCoinsStats again;
+    BOOST_CHECK(!Load(target, path, again));
+}
+
+BOOST_AUTO_TEST_CASE(txoutsetsnapshot_corrupt)
+{
+    CCoinsViewDB source(1 << 20, true);
+    CCoinsMap mapCoins;
+    CCoinsCacheEntry& entry = mapCoins[uint256S("11")];
+    entry.coins.vout.push_back(CTxOut(5 * COIN, CScript() << OP_TRUE));
+    entry.flags = CCoinsCacheEntry::DIRTY;
+    CNullifiersMap mapSproutNullifiers, mapSaplingNullifiers;
+    CAnchorsSproutMap mapSproutAnchors;
+    CAnchorsSaplingMap mapSaplingAnchors;
+    BOOST_CHECK(source.BatchWrite(mapCoins, uint256S("33"), uint256(), uint256(), mapSproutAnchors, mapSaplingAnchors, mapSproutNullifiers, mapSaplingNullifiers));
+
+    CTxOutSetSnapshotHeader header;
+    header.hashBlock = uint256S("33");
+    boost::filesystem::path path = GetDataDir() / "utxo.dat";
+    CCoinsStats stats;
+    BOOST_CHECK(Dump(source, path, header, stats));
+
+    // flip a bit of the totals at the end, the checksum no longer matches
+    {
+        FILE* file = fopen(path.string().c_str(), "r+b");
+        BOOST_CHECK(file != NULL);
+        fseek(file, -60, SEEK_END);
+        int ch = fgetc(file);
+        fseek(file, -60, SEEK_END);
+        fputc(ch ^ 1, file);
+        fclose(file);
+    }
+    CCoinsViewDB target(1 << 20, true);
+    CCoinsStats loaded;
+    BOOST_CHECK(!Load(target, path, loaded));
+    BOOST_CHECK(target.GetBestBlock().IsNull());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
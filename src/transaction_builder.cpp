@@ -167,21 +167,48 @@ boost::optional<CTransaction> TransactionBuilder::Build()
     // Sapling spends and outputs
     //
 
-    auto ctx = librustzcash_sapling_proving_ctx_init();
-
-    // Create Sapling SpendDescriptions
-    for (auto spend : spends) {
+    // Everything but the proofs first, so a bad note fails before any proving
+    // starts: the proofs are by far the slowest part and share the one proving
+    // context that sums up the value commitment randomness for the binding signature.
+    std::vector<uint256> nullifiers;
+    std::vector<std::vector<unsigned char>> witnessPaths;
+    for (const auto& spend : spends) {
         auto cm = spend.note.cm();
         auto nf = spend.note.nullifier(
             spend.expsk.full_viewing_key(), spend.witness.position());
         if (!(cm && nf)) {
-            librustzcash_sapling_proving_ctx_free(ctx);
             return boost::none;
         }
+        nullifiers.push_back(*nf);
 
         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
         ss << spend.witness.path();
-        std::vector<unsigned char> witness(ss.begin(), ss.end());
+        witnessPaths.emplace_back(ss.begin(), ss.end());
+    }
+
+    std::vector<uint256> cms;
+    std::vector<libzcash::SaplingNotePlaintextEncryptionResult> encryptions;
+    for (const auto& output : outputs) {
+        auto cm = output.note.cm();
+        if (!cm) {
+            return boost::none;
+        }
+        cms.push_back(*cm);
+
+        libzcash::SaplingNotePlaintext notePlaintext(output.note, output.memo);
+        auto res = notePlaintext.encrypt(output.note.pk_d);
+        if (!res) {
+            return boost::none;
+        }
+        encryptions.push_back(res.get());
+    }
+
+    ZCEnsureParamsLoaded();
+    auto ctx = librustzcash_sapling_proving_ctx_init();
+
+    // Create Sapling SpendDescriptions
+    for (size_t i = 0; i < spends.size(); i++) {
+        const auto& spend = spends[i];
 
         SpendDescription sdesc;
         if (!librustzcash_sapling_spend_proof(
@@ -193,7 +220,7 @@ boost::optional<CTransaction> TransactionBuilder::Build()
                 spend.alpha.begin(),
                 spend.note.value(),
                 spend.anchor.begin(),
-                witness.data(),
+                witnessPaths[i].data(),
                 sdesc.cv.begin(),
                 sdesc.rk.begin(),
                 sdesc.zkproof.data())) {
@@ -202,27 +229,14 @@ boost::optional<CTransaction> TransactionBuilder::Build()
         }
 
         sdesc.anchor = spend.anchor;
-        sdesc.nullifier = *nf;
+        sdesc.nullifier = nullifiers[i];
         mtx.vShieldedSpend.push_back(sdesc);
     }
 
     // Create Sapling OutputDescriptions
-    for (auto output : outputs) {
-        auto cm = output.note.cm();
-        if (!cm) {
-            librustzcash_sapling_proving_ctx_free(ctx);
-            return boost::none;
-        }
-
-        libzcash::SaplingNotePlaintext notePlaintext(output.note, output.memo);
-
-        auto res = notePlaintext.encrypt(output.note.pk_d);
-        if (!res) {
-            librustzcash_sapling_proving_ctx_free(ctx);
-            return boost::none;
-        }
-        auto enc = res.get();
-        auto encryptor = enc.second;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        const auto& output = outputs[i];
+        auto& encryptor = encryptions[i].second;
 
         OutputDescription odesc;
         if (!librustzcash_sapling_output_proof(
@@ -238,9 +252,9 @@ boost::optional<CTransaction> TransactionBuilder::Build()
             return boost::none;
         }
 
-        odesc.cm = *cm;
+        odesc.cm = cms[i];
         odesc.ephemeralKey = encryptor.get_epk();
-        odesc.encCiphertext = enc.first;
+        odesc.encCiphertext = encryptions[i].first;
 
         libzcash::SaplingOutgoingPlaintext outPlaintext(output.note.pk_d, encryptor.get_esk());
         odesc.outCiphertext = outPlaintext.encrypt(
@@ -21,7 +21,9 @@
 #include "txdb.h"
 
 #include "chainparams.h"
+#include "crypto/muhash.h"
 #include "hash.h"
+#include "init.h"
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
@@ -29,6 +31,12 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -42,26 +50,57 @@ static const char DB_SAPLING_NULLIFIER = 'S';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_TXARCHIVE = 'x';
 static const char DB_ADDRESSINDEX = 'd';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 'S';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ADDRESSBALANCE = 'w';
+static const char DB_ADDRESSBALANCERANK = 'W';
+static const char DB_CCINDEX = 'e';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_BEST_SPROUT_ANCHOR = 'a';
 static const char DB_BEST_SAPLING_ANCHOR = 'z';
 static const char DB_FLAG = 'F';
+static const char DB_INDEXBUILD = 'I';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
 
 CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
+    LoadNullifierFilter(DB_NULLIFIER, sproutNullifierFilter);
+    LoadNullifierFilter(DB_SAPLING_NULLIFIER, saplingNullifierFilter);
 }
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
 {
+    LoadNullifierFilter(DB_NULLIFIER, sproutNullifierFilter);
+    LoadNullifierFilter(DB_SAPLING_NULLIFIER, saplingNullifierFilter);
+}
+
+void CCoinsViewDB::LoadNullifierFilter(char dbChar, CNullifierFilter& filter)
+{
+    // count first, one pass over the keys is far cheaper than a filter that was sized too small
+    size_t nCount = 0;
+    {
+        boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+        for (pcursor->SeekPrefix(dbChar); pcursor->Valid(); pcursor->Next())
+            nCount++;
+    }
+    CNullifierFilter newFilter;
+    newFilter.Reset(nCount * 2);
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    for (pcursor->SeekPrefix(dbChar); pcursor->Valid(); pcursor->Next()) {
+        pair<char, uint256> key;
+        if (!pcursor->GetKey(key))
+            throw dbwrapper_error("Failed to read nullifier record");
+        newFilter.Insert(key.second);
+    }
+    filter.Swap(newFilter);
+    LogPrint("coindb", "Loaded %u nullifiers of type '%c' into a %u byte filter\n", nCount, dbChar, filter.DynamicMemoryUsage());
 }
 
 
@@ -72,7 +111,12 @@ bool CCoinsViewDB::GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree)
         return true;
     }
 
+    if (sproutAnchorCache.Get(rt, tree))
+        return true;
+
     bool read = db.Read(make_pair(DB_SPROUT_ANCHOR, rt), tree);
+    if (read)
+        sproutAnchorCache.Insert(rt, tree);
 
     return read;
 }
@@ -84,7 +128,12 @@ bool CCoinsViewDB::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree
         return true;
     }
 
+    if (saplingAnchorCache.Get(rt, tree))
+        return true;
+
     bool read = db.Read(make_pair(DB_SAPLING_ANCHOR, rt), tree);
+    if (read)
+        saplingAnchorCache.Insert(rt, tree);
 
     return read;
 }
@@ -94,9 +143,13 @@ bool CCoinsViewDB::GetNullifier(const uint256 &nf, ShieldedType type) const {
     char dbChar;
     switch (type) {
         case SPROUT:
+            if (!sproutNullifierFilter.MayContain(nf))
+                return false;
             dbChar = DB_NULLIFIER;
             break;
         case SAPLING:
+            if (!saplingNullifierFilter.MayContain(nf))
+                return false;
             dbChar = DB_SAPLING_NULLIFIER;
             break;
         default:
@@ -109,6 +162,49 @@ bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
     return db.Read(make_pair(DB_COINS, txid), coins);
 }
 
+/** Read the coins of vTxids[nBegin, nEnd), a database error is kept in strError */
+static void ReadCoinsRange(const CDBWrapper* db, const std::vector<uint256>* vTxids, size_t nBegin, size_t nEnd,
+                           std::vector<std::pair<uint256, CCoins> >* vCoins, std::string* strError)
+{
+    try {
+        CCoins coins;
+        for (size_t i = nBegin; i < nEnd; i++) {
+            if (db->Read(make_pair(DB_COINS, (*vTxids)[i]), coins))
+                vCoins->push_back(make_pair((*vTxids)[i], coins));
+        }
+    } catch (const std::runtime_error& e) {
+        *strError = e.what();
+    }
+}
+
+void CCoinsViewDB::GetCoinsBatch(const std::vector<uint256> &vTxids, std::vector<std::pair<uint256, CCoins> > &vCoins) const {
+    // In key order the reads of each thread stay close together on disk, and
+    // the threads keep several reads in flight for storage that can serve them.
+    std::vector<uint256> vSorted(vTxids);
+    std::sort(vSorted.begin(), vSorted.end());
+    size_t nThreads = std::min<size_t>(COINS_BATCH_MAX_THREADS, vSorted.size() / COINS_BATCH_READS_PER_THREAD);
+    if (nThreads <= 1) {
+        std::string strError;
+        ReadCoinsRange(&db, &vSorted, 0, vSorted.size(), &vCoins, &strError);
+        if (!strError.empty())
+            throw dbwrapper_error(strError);
+        return;
+    }
+    std::vector<std::vector<std::pair<uint256, CCoins> > > vResults(nThreads);
+    std::vector<std::string> vErrors(nThreads);
+    boost::thread_group threads;
+    for (size_t i = 0; i < nThreads; i++) {
+        threads.create_thread(boost::bind(&ReadCoinsRange, &db, &vSorted, vSorted.size() * i / nThreads,
+                                          vSorted.size() * (i + 1) / nThreads, &vResults[i], &vErrors[i]));
+    }
+    threads.join_all();
+    for (size_t i = 0; i < nThreads; i++) {
+        if (!vErrors[i].empty())
+            throw dbwrapper_error(vErrors[i]);
+        vCoins.insert(vCoins.end(), vResults[i].begin(), vResults[i].end());
+    }
+}
+
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
     return db.Exists(make_pair(DB_COINS, txid));
 }
@@ -139,14 +235,17 @@ uint256 CCoinsViewDB::GetBestAnchor(ShieldedType type) const {
     return hashBestAnchor;
 }
 
-void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char& dbChar)
+// the filter learns a nullifier before the database has it, never after
+void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char& dbChar, CNullifierFilter& filter)
 {
     for (CNullifiersMap::iterator it = mapToUse.begin(); it != mapToUse.end();) {
         if (it->second.flags & CNullifiersCacheEntry::DIRTY) {
             if (!it->second.entered)
                 batch.Erase(make_pair(dbChar, it->first));
-            else
+            else {
+                filter.Insert(it->first);
                 batch.Write(make_pair(dbChar, it->first), true);
+            }
             // TODO: changed++? ... See comment in CCoinsViewDB::BatchWrite. If this is needed we could return an int
         }
         CNullifiersMap::iterator itOld = it++;
@@ -155,14 +254,16 @@ void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char&
 }
 
 template<typename Map, typename MapIterator, typename MapEntry, typename Tree>
-void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
+void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar, CAnchorCache<Tree>& cache)
 {
     for (MapIterator it = mapToUse.begin(); it != mapToUse.end();) {
         if (it->second.flags & MapEntry::DIRTY) {
-            if (!it->second.entered)
+            if (!it->second.entered) {
+                cache.Erase(it->first);
                 batch.Erase(make_pair(dbChar, it->first));
-            else {
+            } else {
                 if (it->first != Tree::empty_root()) {
+                    cache.Insert(it->first, it->second.tree);
                     batch.Write(make_pair(dbChar, it->first), it->second.tree);
                 }
             }
@@ -197,11 +298,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
         mapCoins.erase(itOld);
     }
 
-    ::BatchWriteAnchors<CAnchorsSproutMap, CAnchorsSproutMap::iterator, CAnchorsSproutCacheEntry, SproutMerkleTree>(batch, mapSproutAnchors, DB_SPROUT_ANCHOR);
-    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR);
+    ::BatchWriteAnchors<CAnchorsSproutMap, CAnchorsSproutMap::iterator, CAnchorsSproutCacheEntry, SproutMerkleTree>(batch, mapSproutAnchors, DB_SPROUT_ANCHOR, sproutAnchorCache);
+    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR, saplingAnchorCache);
 
-    ::BatchWriteNullifiers(batch, mapSproutNullifiers, DB_NULLIFIER);
-    ::BatchWriteNullifiers(batch, mapSaplingNullifiers, DB_SAPLING_NULLIFIER);
+    ::BatchWriteNullifiers(batch, mapSproutNullifiers, DB_NULLIFIER, sproutNullifierFilter);
+    ::BatchWriteNullifiers(batch, mapSaplingNullifiers, DB_SAPLING_NULLIFIER, saplingNullifierFilter);
 
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
@@ -211,10 +312,69 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
         batch.Write(DB_BEST_SAPLING_ANCHOR, hashSaplingAnchor);
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    if (!db.WriteBatch(batch))
+        return false;
+
+    // spent nullifiers only ever add up, past its size a filter is rebuilt for twice as many
+    if (sproutNullifierFilter.IsFull())
+        LoadNullifierFilter(DB_NULLIFIER, sproutNullifierFilter);
+    if (saplingNullifierFilter.IsFull())
+        LoadNullifierFilter(DB_SAPLING_NULLIFIER, saplingNullifierFilter);
+    return true;
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles) {
+/** Move every record of type chType from one database to another, in chunks so memory stays bounded */
+template<typename K, typename V>
+static void MoveIndexRecords(CDBWrapper& from, CDBWrapper& to, char chType)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(from.NewIterator());
+    pcursor->SeekPrefix(chType);
+    uint64_t nMoved = 0;
+    while (pcursor->Valid()) {
+        CDBBatch batchTo(to), batchFrom(from);
+        for (int n = 0; pcursor->Valid() && n < 100000; pcursor->Next(), n++) {
+            pair<char, K> key;
+            V value;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(value))
+                throw dbwrapper_error("Failed to read index record to move");
+            batchTo.Write(key, value);
+            batchFrom.Erase(key);
+            nMoved++;
+        }
+        // a crash between the two writes only leaves records to be moved again
+        to.WriteBatch(batchTo, true);
+        from.WriteBatch(batchFrom);
+    }
+    if (nMoved > 0)
+        LogPrintf("Moved %u index records of type '%c' out of the block index database\n", nMoved, chType);
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles,
+                           size_t nAddressIndexCache, size_t nSpentIndexCache, size_t nTimestampIndexCache) :
+    CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles),
+    addressdb(GetDataDir() / "blocks" / "addressindex", nAddressIndexCache, fMemory, fWipe, compression, maxOpenFiles),
+    spentdb(GetDataDir() / "blocks" / "spentindex", nSpentIndexCache, fMemory, fWipe, compression, maxOpenFiles),
+    timestampdb(GetDataDir() / "blocks" / "timestampindex", nTimestampIndexCache, fMemory, fWipe, compression, maxOpenFiles) {
+    // indexes written by earlier versions still sit in the block index database
+    MoveIndexRecords<CAddressIndexKey, CAmount>(*this, addressdb, DB_ADDRESSINDEX);
+    MoveIndexRecords<CAddressUnspentKey, CAddressUnspentValue>(*this, addressdb, DB_ADDRESSUNSPENTINDEX);
+    MoveIndexRecords<CAddressIndexIteratorKey, CAddressBalanceValue>(*this, addressdb, DB_ADDRESSBALANCE);
+    MoveIndexRecords<CAddressBalanceRankKey, char>(*this, addressdb, DB_ADDRESSBALANCERANK);
+    MoveIndexRecords<CSpentIndexKey, CSpentIndexValue>(*this, spentdb, DB_SPENTINDEX);
+    MoveIndexRecords<CTimestampIndexKey, int>(*this, timestampdb, DB_TIMESTAMPINDEX);
+    MoveIndexRecords<CTimestampBlockIndexKey, CTimestampBlockIndexValue>(*this, timestampdb, DB_BLOCKHASHINDEX);
+
+    // the balance table flag belongs with the table
+    const std::pair<char, std::string> balanceflag = make_pair(DB_FLAG, std::string("addressbalanceindex"));
+    char ch;
+    if (Read(balanceflag, ch)) {
+        addressdb.Write(balanceflag, ch, true);
+        Erase(balanceflag);
+    }
+    // an empty address index has an empty balance table, it is kept up to date from here on
+    if (fWipe)
+        addressdb.Write(balanceflag, '1');
+    fAddressBalanceIndex = addressdb.Read(balanceflag, ch) && ch == '1';
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -237,49 +397,317 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
 
+/** Add coins to stats and to the gettxoutsetinfo hash_serialized stream */
+static void AddCoinsStats(CHashWriter& ss, CCoinsStats& stats, const CCoins& coins)
+{
+    stats.nTransactions++;
+    for (unsigned int i=0; i<coins.vout.size(); i++) {
+        const CTxOut &out = coins.vout[i];
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            ss << VARINT(i+1);
+            ss << out;
+            stats.nTotalAmount += out.nValue;
+        }
+    }
+    ss << VARINT(0);
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
-    pcursor->Seek(DB_COINS);
+    pcursor->SeekPrefix(DB_COINS);
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
         CCoins coins;
-        if (pcursor->GetKey(key) && key.first == DB_COINS) {
-            if (pcursor->GetValue(coins)) {
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
+        if (!pcursor->GetValue(coins))
+            return error("CCoinsViewDB::GetStats() : unable to read value");
+        AddCoinsStats(ss, stats, coins);
+        stats.nSerializedSize += 32 + pcursor->GetValueSize();
+        pcursor->Next();
+    }
+    {
+        LOCK(cs_main);
+        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->GetHeight();
+    }
+    stats.hashSerialized = ss.GetHash();
+    return true;
+}
+
+//! most threads a MuHash3072 scan of the coin database is split over
+static const int MUHASH_SCAN_MAX_THREADS = 16;
+
+bool CCoinsViewDB::GetStatsMuHash(CCoinsStats &stats, MuHash3072 *muhash) const {
+    // The set hash does not depend on the order of the coins, so the txid
+    // space is cut into ranges by its first byte and each is scanned on its
+    // own thread. The iterators are all taken while no block can be written,
+    // every leveldb iterator reads the database as it was when it was made.
+    int nThreads = std::max(1, std::min(MUHASH_SCAN_MAX_THREADS, GetNumCores()));
+    std::vector<CDBIterator*> vCursors(nThreads);
+    {
+        LOCK(cs_main);
+        for (int t = 0; t < nThreads; t++)
+            vCursors[t] = const_cast<CDBWrapper*>(&db)->NewIterator();
+        stats.hashBlock = GetBestBlock();
+        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->GetHeight();
+    }
+    std::vector<CCoinsStats> vStats(nThreads);
+    std::vector<MuHash3072> vMuHash(nThreads);
+    std::atomic<bool> fFailed(false);
+    std::vector<std::thread> vThreads;
+    for (int t = 0; t < nThreads; t++) {
+        vThreads.emplace_back([&, t]() {
+            CDBIterator *pcursor = vCursors[t];
+            int nBegin = t * 256 / nThreads, nEnd = (t + 1) * 256 / nThreads;
+            uint256 hashBegin;
+            *hashBegin.begin() = (unsigned char)nBegin;
+            for (pcursor->Seek(make_pair(DB_COINS, hashBegin)); pcursor->Valid() && !fFailed; pcursor->Next()) {
+                leveldb::Slice slKey = pcursor->GetKeySlice();
+                if (slKey.size() < 2 || slKey[0] != DB_COINS || (unsigned char)slKey[1] >= nEnd)
+                    break;
+                std::pair<char, uint256> key;
+                CCoins coins;
+                if (ShutdownRequested() || !pcursor->GetKey(key) || !pcursor->GetValue(coins)) {
+                    fFailed = true;
+                    break;
+                }
+                vStats[t].nTransactions++;
+                for (unsigned int i = 0; i < coins.vout.size(); i++) {
                     const CTxOut &out = coins.vout[i];
                     if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
+                        vStats[t].nTransactionOutputs++;
+                        vStats[t].nTotalAmount += out.nValue;
+                        if (muhash)
+                            MuHashTxOut(vMuHash[t], key.second, i, out, false);
                     }
                 }
-                stats.nSerializedSize += 32 + pcursor->GetValueSize();
-                ss << VARINT(0);
-            } else {
-                return error("CCoinsViewDB::GetStats() : unable to read value");
+                vStats[t].nSerializedSize += 32 + pcursor->GetValueSize();
             }
-        } else {
+        });
+    }
+    for (int t = 0; t < nThreads; t++) {
+        vThreads[t].join();
+        delete vCursors[t];
+        stats.nTransactions += vStats[t].nTransactions;
+        stats.nTransactionOutputs += vStats[t].nTransactionOutputs;
+        stats.nSerializedSize += vStats[t].nSerializedSize;
+        stats.nTotalAmount += vStats[t].nTotalAmount;
+        if (muhash)
+            *muhash *= vMuHash[t];
+    }
+    if (fFailed)
+        return error("CCoinsViewDB::GetStatsMuHash() : unable to read coins");
+    if (muhash) {
+        unsigned char hash[MuHash3072::OUTPUT_SIZE];
+        muhash->Finalize(hash);
+        stats.hashMuHash = uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
+    }
+    return true;
+}
+
+namespace {
+/** Serializes to a snapshot file and hashes the same bytes for its checksum */
+class CSnapshotWriter
+{
+    CAutoFile& file;
+    CHashWriter hasher;
+public:
+    CSnapshotWriter(CAutoFile& fileIn) : file(fileIn), hasher(SER_DISK, CLIENT_VERSION) {}
+    template<typename T> CSnapshotWriter& operator<<(const T& obj) {
+        file << obj;
+        hasher << obj;
+        return *this;
+    }
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+/** Reads a snapshot file back, hashing what it read */
+class CSnapshotReader
+{
+    CAutoFile& file;
+    CHashWriter hasher;
+public:
+    CSnapshotReader(CAutoFile& fileIn) : file(fileIn), hasher(SER_DISK, CLIENT_VERSION) {}
+    template<typename T> CSnapshotReader& operator>>(T& obj) {
+        file >> obj;
+        hasher << obj;
+        return *this;
+    }
+    //! hash obj as if it had been read from the file
+    template<typename T> void Include(const T& obj) { hasher << obj; }
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+}
+
+//! record type closing the record list of a snapshot
+static const char SNAPSHOT_END = 0;
+//! records loaded per coin database batch
+static const size_t SNAPSHOT_BATCH_SIZE = 10000;
+
+bool CCoinsViewDB::DumpSnapshot(CAutoFile &file, const CTxOutSetSnapshotHeader &header, CCoinsStats &stats) const {
+    if (header.hashBlock != GetBestBlock())
+        return error("%s: coin database is not at block %s", __func__, header.hashBlock.ToString());
+
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    CSnapshotWriter writer(file);
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    stats.hashBlock = header.hashBlock;
+    stats.nHeight = header.nHeight;
+    ss << stats.hashBlock;
+    writer << header;
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        leveldb::Slice slKey = pcursor->GetKeySlice();
+        if (slKey.size() == 0)
+            continue;
+        char chType = slKey[0];
+        std::pair<char, uint256> key;
+        uint256 hash;
+        switch (chType) {
+        case DB_COINS: {
+            CCoins coins;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coins))
+                return error("%s: unable to read coins", __func__);
+            writer << chType << key.second << coins;
+            AddCoinsStats(ss, stats, coins);
+            stats.nSerializedSize += 32 + pcursor->GetValueSize();
+            break;
+        }
+        case DB_SPROUT_ANCHOR: {
+            SproutMerkleTree tree;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(tree))
+                return error("%s: unable to read sprout anchor", __func__);
+            writer << chType << key.second << tree;
+            break;
+        }
+        case DB_SAPLING_ANCHOR: {
+            SaplingMerkleTree tree;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(tree))
+                return error("%s: unable to read sapling anchor", __func__);
+            writer << chType << key.second << tree;
+            break;
+        }
+        case DB_NULLIFIER:
+        case DB_SAPLING_NULLIFIER:
+            if (!pcursor->GetKey(key))
+                return error("%s: unable to read nullifier", __func__);
+            writer << chType << key.second;
+            break;
+        case DB_BEST_SPROUT_ANCHOR:
+        case DB_BEST_SAPLING_ANCHOR:
+            if (!pcursor->GetValue(hash))
+                return error("%s: unable to read best anchor", __func__);
+            writer << chType << hash;
+            break;
+        default:
+            // DB_BEST_BLOCK is the header's hashBlock
             break;
         }
-        pcursor->Next();
-    }
-    {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->GetHeight();
     }
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+    writer << SNAPSHOT_END << stats.nTransactions << stats.nTransactionOutputs << stats.nTotalAmount << stats.hashSerialized;
+    file << writer.GetHash();
+    return true;
+}
+
+bool CCoinsViewDB::LoadSnapshot(CAutoFile &file, const CTxOutSetSnapshotHeader &header, CCoinsStats &stats) {
+    if (!GetBestBlock().IsNull())
+        return error("%s: coin database is not empty", __func__);
+
+    CSnapshotReader reader(file);
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    // the caller already read the header to check it
+    reader.Include(header);
+    uint256 hashSproutAnchor, hashSaplingAnchor;
+    stats.hashBlock = header.hashBlock;
+    stats.nHeight = header.nHeight;
+    ss << stats.hashBlock;
+    try {
+        bool fEnd = false;
+        while (!fEnd) {
+            CDBBatch batch(db);
+            for (size_t n = 0; n < SNAPSHOT_BATCH_SIZE; n++) {
+                boost::this_thread::interruption_point();
+                char chType;
+                reader >> chType;
+                if (chType == SNAPSHOT_END) {
+                    fEnd = true;
+                    break;
+                }
+                uint256 hash;
+                reader >> hash;
+                switch (chType) {
+                case DB_COINS: {
+                    CCoins coins;
+                    reader >> coins;
+                    AddCoinsStats(ss, stats, coins);
+                    batch.Write(make_pair(DB_COINS, hash), coins);
+                    break;
+                }
+                case DB_SPROUT_ANCHOR: {
+                    SproutMerkleTree tree;
+                    reader >> tree;
+                    batch.Write(make_pair(DB_SPROUT_ANCHOR, hash), tree);
+                    break;
+                }
+                case DB_SAPLING_ANCHOR: {
+                    SaplingMerkleTree tree;
+                    reader >> tree;
+                    batch.Write(make_pair(DB_SAPLING_ANCHOR, hash), tree);
+                    break;
+                }
+                case DB_NULLIFIER:
+                case DB_SAPLING_NULLIFIER:
+                    (chType == DB_NULLIFIER ? sproutNullifierFilter : saplingNullifierFilter).Insert(hash);
+                    batch.Write(make_pair(chType, hash), true);
+                    break;
+                case DB_BEST_SPROUT_ANCHOR:
+                    hashSproutAnchor = hash;
+                    break;
+                case DB_BEST_SAPLING_ANCHOR:
+                    hashSaplingAnchor = hash;
+                    break;
+                default:
+                    return error("%s: unknown record type %d", __func__, chType);
+                }
+            }
+            if (!db.WriteBatch(batch))
+                return false;
+        }
+
+        CCoinsStats filestats;
+        reader >> filestats.nTransactions >> filestats.nTransactionOutputs >> filestats.nTotalAmount >> filestats.hashSerialized;
+        uint256 hashChecksum;
+        file >> hashChecksum;
+        if (hashChecksum != reader.GetHash())
+            return error("%s: checksum mismatch", __func__);
+        stats.hashSerialized = ss.GetHash();
+        if (filestats.nTransactions != stats.nTransactions || filestats.nTotalAmount != stats.nTotalAmount || filestats.hashSerialized != stats.hashSerialized)
+            return error("%s: coin totals do not match the file", __func__);
+    } catch (const std::exception& e) {
+        return error("%s: deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    // only a complete set gets a best block, a failed load leaves a coin database that is still "empty"
+    CDBBatch batch(db);
+    batch.Write(DB_BEST_BLOCK, header.hashBlock);
+    if (!hashSproutAnchor.IsNull())
+        batch.Write(DB_BEST_SPROUT_ANCHOR, hashSproutAnchor);
+    if (!hashSaplingAnchor.IsNull())
+        batch.Write(DB_BEST_SAPLING_ANCHOR, hashSaplingAnchor);
+    if (!db.WriteBatch(batch, true))
+        return false;
+
+    if (sproutNullifierFilter.IsFull())
+        LoadNullifierFilter(DB_NULLIFIER, sproutNullifierFilter);
+    if (saplingNullifierFilter.IsFull())
+        LoadNullifierFilter(DB_SAPLING_NULLIFIER, saplingNullifierFilter);
     return true;
 }
 
@@ -307,6 +735,26 @@ bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
 
+bool CBlockTreeDB::ReadTxIndex(const std::vector<uint256> &vTxids, std::vector<std::pair<uint256, CDiskTxPos> > &vPos) {
+    // uint256 orders like its serialized bytes, so the seeks only ever move forward
+    std::vector<uint256> vSorted(vTxids);
+    std::sort(vSorted.begin(), vSorted.end());
+    vSorted.erase(std::unique(vSorted.begin(), vSorted.end()), vSorted.end());
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    for (std::vector<uint256>::const_iterator it = vSorted.begin(); it != vSorted.end(); it++) {
+        pcursor->Seek(make_pair(DB_TXINDEX, *it));
+        std::pair<char, uint256> key;
+        if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_TXINDEX || key.second != *it)
+            continue;
+        CDiskTxPos pos;
+        if (!pcursor->GetValue(pos))
+            return error("ReadTxIndex: unable to read value for %s", it->GetHex());
+        vPos.push_back(make_pair(*it, pos));
+    }
+    return true;
+}
+
 bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
@@ -314,12 +762,31 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadTxArchive(const uint256 &txid, CTransaction &tx, uint256 &hashBlock) {
+    std::pair<uint256, CTransaction> value;
+    if (!Read(make_pair(DB_TXARCHIVE, txid), value))
+        return false;
+    hashBlock = value.first;
+    tx = value.second;
+    return true;
+}
+
+bool CBlockTreeDB::WriteTxArchive(const uint256 &hashBlock, const std::vector<CTransaction> &vtx) {
+    CDBBatch batch(*this);
+    for (std::vector<CTransaction>::const_iterator it = vtx.begin(); it != vtx.end(); it++) {
+        uint256 txid = it->GetHash();
+        batch.Write(make_pair(DB_TXARCHIVE, txid), make_pair(hashBlock, *it));
+        batch.Erase(make_pair(DB_TXINDEX, txid));
+    }
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(make_pair(DB_SPENTINDEX, key), value);
+    return spentdb.Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
 bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
-    CDBBatch batch(*this);
+    CDBBatch batch(spentdb);
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(make_pair(DB_SPENTINDEX, it->first));
@@ -327,11 +794,11 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
             batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
+    return spentdb.WriteBatch(batch);
 }
 
 bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(*this);
+    CDBBatch batch(addressdb);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
@@ -339,97 +806,268 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
             batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
+    return addressdb.WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(addressdb.NewIterator());
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    pcursor->SeekPrefix(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        try {
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        pair<char, CAddressUnspentKey> keyObj;
+        if (!pcursor->GetKey(keyObj))
+            break;
+        CAddressUnspentValue nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address unspent value");
+        unspentOutputs.push_back(make_pair(keyObj.second, nValue));
+        pcursor->Next();
+    }
+    return true;
+}
+
+/*
+ * Unspent outputs of many (type, address) pairs with one cursor, visiting the
+ * addresses in key order so every seek moves forward through the index.
+ */
+bool CBlockTreeDB::ReadAddressUnspentIndex(const std::vector<std::pair<int, uint160> > &addresses,
+                                           std::map<std::pair<int, uint160>, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > &unspentOutputs) {
+
+    std::vector<std::pair<int, uint160> > sorted(addresses);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    boost::scoped_ptr<CDBIterator> pcursor(addressdb.NewIterator());
+
+    for (std::vector<std::pair<int, uint160> >::const_iterator ita = sorted.begin(); ita != sorted.end(); ita++) {
+        boost::this_thread::interruption_point();
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &outputs = unspentOutputs[*ita];
+        pcursor->SeekPrefix(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(ita->first, ita->second)));
+
+        while (pcursor->Valid()) {
             pair<char, CAddressUnspentKey> keyObj;
-            pcursor->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressUnspentKey indexKey = keyObj.second;
-
-            if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.hashBytes == addressHash) {
-                try {
-                    CAddressUnspentValue nValue;
-                    pcursor->GetValue(nValue);
-                    unspentOutputs.push_back(make_pair(indexKey, nValue));
-                    pcursor->Next();
-                } catch (const std::exception& e) {
-                    return error("failed to get address unspent value");
-                }
-            } else {
+            if (!pcursor->GetKey(keyObj))
                 break;
-            }
-        } catch (const std::exception& e) {
+            CAddressUnspentValue nValue;
+            if (!pcursor->GetValue(nValue))
+                return error("failed to get address unspent value");
+            outputs.push_back(make_pair(keyObj.second, nValue));
+            pcursor->Next();
+        }
+    }
+    return true;
+}
+
+void CBlockTreeDB::UpdateAddressBalances(CDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fErase) {
+    std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue> mapDeltas;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        // a block connected again after an unclean shutdown rewrites deltas that are already counted
+        if (addressdb.Exists(make_pair(DB_ADDRESSINDEX, it->first)) != fErase)
+            continue;
+        CAddressBalanceValue& delta = mapDeltas[make_pair(it->first.type, it->first.hashBytes)];
+        delta.nBalance += fErase ? -it->second : it->second;
+        if (it->second != 0)
+            delta.nUtxos += (it->first.spending != fErase) ? -1 : 1;
+    }
+
+    for (std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue>::const_iterator it=mapDeltas.begin(); it!=mapDeltas.end(); it++) {
+        CAddressIndexIteratorKey key(it->first.first, it->first.second);
+        CAddressBalanceValue value;
+        if (addressdb.Read(make_pair(DB_ADDRESSBALANCE, key), value) && value.nBalance != 0)
+            batch.Erase(make_pair(DB_ADDRESSBALANCERANK, CAddressBalanceRankKey(value.nBalance, key.type, key.hashBytes)));
+        value.nBalance += it->second.nBalance;
+        value.nUtxos += it->second.nUtxos;
+        if (value.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSBALANCE, key));
+        else
+            batch.Write(make_pair(DB_ADDRESSBALANCE, key), value);
+        if (value.nBalance != 0)
+            batch.Write(make_pair(DB_ADDRESSBALANCERANK, CAddressBalanceRankKey(value.nBalance, key.type, key.hashBytes)), '1');
+    }
+}
+
+bool CBlockTreeDB::BuildAddressBalanceIndex() {
+    LogPrintf("%s: building address balance table from the address unspent index\n", __func__);
+    std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue> mapBalances;
+    boost::scoped_ptr<CDBIterator> pcursor(addressdb.NewIterator());
+    pcursor->SeekPrefix(DB_ADDRESSUNSPENTINDEX);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        pair<char, CAddressIndexIteratorKey> keyObj;
+        if (!pcursor->GetKey(keyObj))
             break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address unspent value");
+        CAddressBalanceValue& value = mapBalances[make_pair(keyObj.second.type, keyObj.second.hashBytes)];
+        value.nBalance += nValue;
+        if (nValue != 0)
+            value.nUtxos++;
+        pcursor->Next();
+    }
+
+    CDBBatch batch(addressdb);
+    for (std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue>::const_iterator it=mapBalances.begin(); it!=mapBalances.end(); it++) {
+        if (it->second.IsNull())
+            continue;
+        batch.Write(make_pair(DB_ADDRESSBALANCE, CAddressIndexIteratorKey(it->first.first, it->first.second)), it->second);
+        if (it->second.nBalance != 0)
+            batch.Write(make_pair(DB_ADDRESSBALANCERANK, CAddressBalanceRankKey(it->second.nBalance, it->first.first, it->first.second)), '1');
+    }
+    batch.Write(make_pair(DB_FLAG, std::string("addressbalanceindex")), '1');
+    if (!addressdb.WriteBatch(batch))
+        return error("failed to write address balance table");
+    fAddressBalanceIndex = true;
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type, const CAddressUnspentKey *pAfter, size_t nMax,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, bool &fMore) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(addressdb.NewIterator());
+
+    pcursor->SeekPrefix(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (pAfter != NULL)
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, *pAfter));
+
+    fMore = false;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        pair<char, CAddressUnspentKey> keyObj;
+        if (!pcursor->GetKey(keyObj))
+            break;
+        // the output the last page ended with, unless it was spent since
+        if (pAfter != NULL && keyObj.second.txhash == pAfter->txhash && keyObj.second.index == pAfter->index) {
+            pcursor->Next();
+            continue;
         }
+        if (unspentOutputs.size() >= nMax) {
+            fMore = true;
+            break;
+        }
+        CAddressUnspentValue nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address unspent value");
+        unspentOutputs.push_back(make_pair(keyObj.second, nValue));
+        pcursor->Next();
     }
     return true;
 }
 
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
+    CDBBatch batch(addressdb);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
+    if (fAddressBalanceIndex)
+        UpdateAddressBalances(batch, vect, false);
+    return addressdb.WriteBatch(batch);
 }
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
+    CDBBatch batch(addressdb);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+    if (fAddressBalanceIndex)
+        UpdateAddressBalances(batch, vect, true);
+    return addressdb.WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseDisconnectedAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                                 const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+                                                 const std::vector<std::pair<CCIndexKey, CCIndexValue> > &ccIndex) {
+    CDBBatch batch(addressdb);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++)
+        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    if (fAddressBalanceIndex)
+        UpdateAddressBalances(batch, addressIndex, true);
+    for (std::vector<std::pair<CCIndexKey, CCIndexValue> >::const_iterator it=ccIndex.begin(); it!=ccIndex.end(); it++)
+        batch.Erase(make_pair(DB_CCINDEX, it->first));
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=addressUnspentIndex.begin(); it!=addressUnspentIndex.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    }
+    return addressdb.WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(addressdb.NewIterator());
 
-    if (start > 0 && end > 0) {
+    pcursor->SeekPrefix(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (start > 0 && end > 0)
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
-    }
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        try {
-            pair<char, CAddressIndexKey> keyObj;
-            pcursor->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressIndexKey indexKey = keyObj.second;
+        pair<char, CAddressIndexKey> keyObj;
+        if (!pcursor->GetKey(keyObj))
+            break;
+        if (end > 0 && keyObj.second.blockHeight > end)
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        addressIndex.push_back(make_pair(keyObj.second, nValue));
+        pcursor->Next();
+    }
 
-            if (chType == DB_ADDRESSINDEX && indexKey.hashBytes == addressHash) {
-                if (end > 0 && indexKey.blockHeight > end) {
-                    break;
-                }
-                try {
-                    CAmount nValue;
-                    pcursor->GetValue(nValue);
-
-                    addressIndex.push_back(make_pair(indexKey, nValue));
-                    pcursor->Next();
-                } catch (const std::exception& e) {
-                    return error("failed to get address index value");
-                }
-            } else {
-                break;
-            }
-        } catch (const std::exception& e) {
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type, const CAddressIndexKey *pAfter, size_t nMax,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, bool &fMore,
+                                    bool fReverse, int start, int end) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(addressdb.NewIterator());
+
+    pcursor->SeekPrefix(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (fReverse) {
+        // SeekBefore never lands on pAfter itself
+        if (pAfter != NULL)
+            pcursor->SeekBefore(make_pair(DB_ADDRESSINDEX, *pAfter));
+        else {
+            int nAfterEnd = end > 0 && end < std::numeric_limits<int>::max() ? end + 1 : std::numeric_limits<int>::max();
+            pcursor->SeekBefore(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, nAfterEnd)));
+        }
+    } else if (pAfter != NULL)
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, *pAfter));
+    else if (start > 0)
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+
+    fMore = false;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        pair<char, CAddressIndexKey> keyObj;
+        if (!pcursor->GetKey(keyObj))
+            break;
+        if ((end > 0 && keyObj.second.blockHeight > end) || (start > 0 && keyObj.second.blockHeight < start))
             break;
+        if (!fReverse && pAfter != NULL && keyObj.second.blockHeight == pAfter->blockHeight && keyObj.second.txindex == pAfter->txindex &&
+            keyObj.second.txhash == pAfter->txhash && keyObj.second.index == pAfter->index && keyObj.second.spending == pAfter->spending) {
+            pcursor->Next();
+            continue;
         }
+        if (addressIndex.size() >= nMax) {
+            fMore = true;
+            break;
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        addressIndex.push_back(make_pair(keyObj.second, nValue));
+        if (fReverse)
+            pcursor->Prev();
+        else
+            pcursor->Next();
     }
 
     return true;
@@ -458,77 +1096,68 @@ uint32_t safecoin_segid32(char *coinaddr);
     {"RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY", 1} \
 };
 
-bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret)
+const leveldb::Snapshot* CBlockTreeDB::PinAddressIndex()
+{
+    // the table has to be there before the pin, a snapshot does not see it being built
+    if ( !fAddressBalanceIndex && !BuildAddressBalanceIndex() )
+        return NULL;
+    return addressdb.GetSnapshot();
+}
+
+void CBlockTreeDB::UnpinAddressIndex(const leveldb::Snapshot* snapshot)
+{
+    addressdb.ReleaseSnapshot(snapshot);
+}
+
+bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret, const leveldb::Snapshot* snapshot)
 {
     int64_t total = 0; int64_t totalAddresses = 0; std::string address;
     int64_t utxos = 0; int64_t ignoredAddresses = 0, cryptoConditionsUTXOs = 0, cryptoConditionsTotals = 0;
     DECLARE_IGNORELIST
-    boost::scoped_ptr<CDBIterator> iter(NewIterator());
-    //std::map <std::string, CAmount> addressAmounts;
-    for (iter->SeekToLast(); iter->Valid(); iter->Prev())
+    if ( snapshot == NULL && !fAddressBalanceIndex && !BuildAddressBalanceIndex() )
+        return false;
+    // one record per address instead of one per unspent output
+    boost::scoped_ptr<CDBIterator> iter(snapshot != NULL ? addressdb.NewIterator(snapshot) : addressdb.NewIterator());
+    for (iter->SeekPrefix(DB_ADDRESSBALANCE); iter->Valid(); iter->Next())
     {
         boost::this_thread::interruption_point();
-        try
+        pair<char, CAddressIndexIteratorKey> keyObj;
+        if ( !iter->GetKey(keyObj) )
+            break;
+        CAddressIndexIteratorKey indexKey = keyObj.second;
+        CAddressBalanceValue value;
+        if ( !iter->GetValue(value) )
         {
-            std::vector<unsigned char> slKey = std::vector<unsigned char>();
-            pair<char, CAddressIndexIteratorKey> keyObj;
-            iter->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressIndexIteratorKey indexKey = keyObj.second;
-            //fprintf(stderr, "chType=%d\n", chType);
-            if (chType == DB_ADDRESSUNSPENTINDEX)
-            {
-                try {
-                    CAmount nValue;
-                    iter->GetValue(nValue);
-                    if ( nValue == 0 )
-                        continue;
-                    getAddressFromIndex(indexKey.type, indexKey.hashBytes, address);
-                    if ( indexKey.type == 3 )
-                    {
-                        cryptoConditionsUTXOs++;
-                        cryptoConditionsTotals += nValue;
-                        total += nValue;
-                        continue;
-                    }
-                    std::map <std::string, int>::iterator ignored = ignoredMap.find(address);
-                    if (ignored != ignoredMap.end())
-                    {
-                        fprintf(stderr,"ignoring %s\n", address.c_str());
-                        ignoredAddresses++;
-                        continue;
-                    }
-                    std::map <std::string, CAmount>::iterator pos = addressAmounts.find(address);
-                    if ( pos == addressAmounts.end() )
-                    {
-                        // insert new address + utxo amount
-                        //fprintf(stderr, "inserting new address %s with amount %li\n", address.c_str(), nValue);
-                        addressAmounts[address] = nValue;
-                        totalAddresses++;
-                    }
-                    else
-                    {
-                        // update unspent tally for this address
-                        //fprintf(stderr, "updating address %s with new utxo amount %li\n", address.c_str(), nValue);
-                        addressAmounts[address] += nValue;
-                    }
-                    //fprintf(stderr,"{\"%s\", %.8f},\n",address.c_str(),(double)nValue/COIN);
-                    // total += nValue;
-                    utxos++;
-                    total += nValue;
-                }
-                catch (const std::exception& e)
-                {
-                    fprintf(stderr, "DONE %s: LevelDB addressindex exception! - %s\n", __func__, e.what());
-                    return false; //break; this means failiure of DB? we need to exit here if so for consensus code!
-                }
-            }
+            fprintf(stderr, "DONE %s: LevelDB address balance exception!\n", __func__);
+            return false; // this means failiure of DB? we need to exit here if so for consensus code!
         }
-        catch (const std::exception& e)
+        if ( value.nBalance == 0 )
+            continue;
+        if ( indexKey.type == 3 )
         {
-            fprintf(stderr, "DONE reading index entries\n");
-            break;
+            cryptoConditionsUTXOs += value.nUtxos;
+            cryptoConditionsTotals += value.nBalance;
+            total += value.nBalance;
+            continue;
         }
+        getAddressFromIndex(indexKey.type, indexKey.hashBytes, address);
+        std::map <std::string, int>::iterator ignored = ignoredMap.find(address);
+        if (ignored != ignoredMap.end())
+        {
+            fprintf(stderr,"ignoring %s\n", address.c_str());
+            ignoredAddresses += value.nUtxos;
+            continue;
+        }
+        std::map <std::string, CAmount>::iterator pos = addressAmounts.find(address);
+        if ( pos == addressAmounts.end() )
+        {
+            addressAmounts[address] = value.nBalance;
+            totalAddresses++;
+        }
+        else
+            pos->second += value.nBalance;
+        utxos += value.nUtxos;
+        total += value.nBalance;
     }
     //fprintf(stderr, "total=%f, totalAddresses=%li, utxos=%li, ignored=%li\n", (double) total / COIN, totalAddresses, utxos, ignoredAddresses);
     
@@ -570,7 +1199,26 @@ UniValue CBlockTreeDB::Snapshot(int top)
     result.push_back(Pair("start_time", (int) time(NULL)));
     if ( (vAddressSnapshot.size() > 0 && top < 0) || (Snapshot2(addressAmounts,&result) && top >= 0) )
     {
-        if ( top > -1 )
+        if ( top > 0 )
+        {
+            // the rank index holds the addresses largest balance first, only the top ones are read
+            DECLARE_IGNORELIST
+            std::string address;
+            boost::scoped_ptr<CDBIterator> iter(addressdb.NewIterator());
+            for (iter->SeekPrefix(DB_ADDRESSBALANCERANK); iter->Valid() && (int)vaddr.size() < top; iter->Next())
+            {
+                pair<char, CAddressBalanceRankKey> keyObj;
+                if ( !iter->GetKey(keyObj) )
+                    break;
+                if ( keyObj.second.type == 3 )
+                    continue;
+                getAddressFromIndex(keyObj.second.type, keyObj.second.hashBytes, address);
+                if ( ignoredMap.find(address) != ignoredMap.end() )
+                    continue;
+                vaddr.push_back(make_pair(keyObj.second.nBalance, address));
+            }
+        }
+        else if ( top == 0 )
         {
             for (std::pair<std::string, CAmount> element : addressAmounts)
                 vaddr.push_back( make_pair(element.second, element.first) );
@@ -603,15 +1251,50 @@ UniValue CBlockTreeDB::Snapshot(int top)
     return(result);
 }
 
+bool CBlockTreeDB::WriteCCIndex(const std::vector<std::pair<CCIndexKey, CCIndexValue> > &vect) {
+    CDBBatch batch(addressdb);
+    for (std::vector<std::pair<CCIndexKey, CCIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_CCINDEX, it->first), it->second);
+    return addressdb.WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseCCIndex(const std::vector<std::pair<CCIndexKey, CCIndexValue> > &vect) {
+    CDBBatch batch(addressdb);
+    for (std::vector<std::pair<CCIndexKey, CCIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Erase(make_pair(DB_CCINDEX, it->first));
+    return addressdb.WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadCCIndex(uint8_t evalcode, uint8_t funcid, std::vector<std::pair<CCIndexKey, CCIndexValue> > &vect) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(addressdb.NewIterator());
+
+    pcursor->SeekPrefix(make_pair(DB_CCINDEX, CCIndexIteratorKey(evalcode, funcid)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        pair<char, CCIndexKey> keyObj;
+        if (!pcursor->GetKey(keyObj))
+            break;
+        CCIndexValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get CC index value");
+        vect.push_back(make_pair(keyObj.second, value));
+        pcursor->Next();
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
+    CDBBatch batch(timestampdb);
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
+    return timestampdb.WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(timestampdb.NewIterator());
 
     pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
 
@@ -645,15 +1328,15 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
 }
 
 bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
-    CDBBatch batch(*this);
+    CDBBatch batch(timestampdb);
     batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
+    return timestampdb.WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
 
     CTimestampBlockIndexValue(lts);
-    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
+    if (!timestampdb.Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
 	return false;
 
     ltimestamp = lts.ltimestamp;
@@ -672,6 +1355,23 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::WriteIndexBuildProgress(const std::string &name, int nHeight, const uint256 &hash) {
+    return Write(std::make_pair(DB_INDEXBUILD, name), std::make_pair(nHeight, hash));
+}
+
+bool CBlockTreeDB::ReadIndexBuildProgress(const std::string &name, int &nHeight, uint256 &hash) {
+    std::pair<int, uint256> progress;
+    if (!Read(std::make_pair(DB_INDEXBUILD, name), progress))
+        return false;
+    nHeight = progress.first;
+    hash = progress.second;
+    return true;
+}
+
+bool CBlockTreeDB::EraseIndexBuildProgress(const std::string &name) {
+    return Erase(std::make_pair(DB_INDEXBUILD, name));
+}
+
 void safecoin_index2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex,int32_t height);
 
 bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
@@ -685,9 +1385,34 @@ bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     return true;
 }
 
+/**
+ * Rehashes the headers of the loaded entries on all cores, an Equihash header with its
+ * solution is most of the cost of loading the block index. Returns the first mismatch or NULL.
+ */
+static const CBlockIndex* CheckBlockIndexHashes(const std::vector<const CBlockIndex*>& vIndex)
+{
+    size_t nThreads = std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+    std::atomic<size_t> nFailed(vIndex.size());
+    std::vector<std::thread> vThreads;
+    for (size_t t = 0; t < nThreads; t++) {
+        vThreads.emplace_back([&vIndex, &nFailed, t, nThreads]() {
+            for (size_t i = t; i < vIndex.size() && i < nFailed.load(std::memory_order_relaxed); i += nThreads) {
+                if (vIndex[i]->GetBlockHeader().GetHash() != vIndex[i]->GetBlockHash()) {
+                    size_t nPrev = nFailed.load();
+                    while (i < nPrev && !nFailed.compare_exchange_weak(nPrev, i)) {}
+                }
+            }
+        });
+    }
+    for (size_t t = 0; t < nThreads; t++)
+        vThreads[t].join();
+    return nFailed < vIndex.size() ? vIndex[nFailed] : NULL;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    std::vector<const CBlockIndex*> vLoaded;
 
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
 
@@ -720,17 +1445,17 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->nSaplingValue  = diskindex.nSaplingValue;
                 pindexNew->segid          = diskindex.segid;
                 pindexNew->nNotaryPay     = diskindex.nNotaryPay;
+                pindexNew->nChainSupply   = diskindex.nChainSupply;
+                pindexNew->nChainZfunds   = diskindex.nChainZfunds;
+                pindexNew->nChainSproutfunds = diskindex.nChainSproutfunds;
 //fprintf(stderr,"loadguts ht.%d\n",pindexNew->GetHeight());
-                // Consistency checks
-                auto header = pindexNew->GetBlockHeader();
-                if (header.GetHash() != pindexNew->GetBlockHash())
-                    return error("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, in-memory = %s",
-                                 diskindex.ToString(),  pindexNew->ToString());
+                // Consistency checks, the header hashes are checked once all entries are read
+                vLoaded.push_back(pindexNew);
                 if ( 0 ) // POW will be checked before any block is connected
                 {
                     uint8_t pubkey33[33];
                     safecoin_index2pubkey33(pubkey33,pindexNew,pindexNew->GetHeight());
-                    if (!CheckProofOfWork(header,pubkey33,pindexNew->GetHeight(),Params().GetConsensus()))
+                    if (!CheckProofOfWork(pindexNew->GetBlockHeader(),pubkey33,pindexNew->GetHeight(),Params().GetConsensus()))
                         return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
                 }
                 pcursor->Next();
@@ -742,5 +1467,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
         }
     }
 
+    const CBlockIndex* pindexBad = CheckBlockIndexHashes(vLoaded);
+    if (pindexBad != NULL)
+        return error("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, in-memory = %s",
+                     pindexBad->GetBlockHeader().GetHash().ToString(), pindexBad->ToString());
     return true;
 }
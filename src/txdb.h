@@ -23,6 +23,7 @@
 
 #include "coins.h"
 #include "dbwrapper.h"
+#include "shieldedcache.h"
 
 #include <map>
 #include <string>
@@ -44,6 +45,8 @@ struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct CCIndexKey;
+struct CCIndexValue;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -52,13 +55,28 @@ static const int64_t nDefaultDbCache = 450;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! cache of an index database that was not given a budget (MiB)
+static const int64_t nDefaultIndexDbCache = 1;
+//! reads each GetCoinsBatch thread does at least
+static const unsigned int COINS_BATCH_READS_PER_THREAD = 16;
+//! max. threads of one GetCoinsBatch
+static const unsigned int COINS_BATCH_MAX_THREADS = 8;
 
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! a nullifier missing from its filter is not in the database, so most lookups skip the disk
+    CNullifierFilter sproutNullifierFilter;
+    CNullifierFilter saplingNullifierFilter;
+    //! recent anchors, the ones transactions spend against
+    mutable CAnchorCache<SproutMerkleTree> sproutAnchorCache;
+    mutable CAnchorCache<SaplingMerkleTree> saplingAnchorCache;
+
     CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    /** Rebuild a nullifier filter from the database, sized for twice the set it holds now */
+    void LoadNullifierFilter(char dbChar, CNullifierFilter& filter);
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -66,6 +84,7 @@ public:
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const;
     bool GetNullifier(const uint256 &nf, ShieldedType type) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    void GetCoinsBatch(const std::vector<uint256> &vTxids, std::vector<std::pair<uint256, CCoins> > &vCoins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     uint256 GetBestAnchor(ShieldedType type) const;
@@ -78,16 +97,38 @@ public:
                     CNullifiersMap &mapSproutNullifiers,
                     CNullifiersMap &mapSaplingNullifiers);
     bool GetStats(CCoinsStats &stats) const;
+    bool GetStatsMuHash(CCoinsStats &stats, MuHash3072 *muhash) const;
+    bool DumpSnapshot(CAutoFile &file, const CTxOutSetSnapshotHeader &header, CCoinsStats &stats) const;
+    /**
+     * Fill an empty coin database from a dumptxoutset file whose header the
+     * caller already read. The best block is only written once every record
+     * was loaded and the checksum and coin totals matched.
+     */
+    bool LoadSnapshot(CAutoFile &file, const CTxOutSetSnapshotHeader &header, CCoinsStats &stats);
 };
 
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
 public:
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = true, int maxOpenFiles = 1000);
+    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = true, int maxOpenFiles = 1000,
+                 size_t nAddressIndexCache = nDefaultIndexDbCache << 20, size_t nSpentIndexCache = nDefaultIndexDbCache << 20,
+                 size_t nTimestampIndexCache = nDefaultIndexDbCache << 20);
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    // The optional indexes each live in a database of their own (blocks/addressindex,
+    // blocks/spentindex, blocks/timestampindex) with their own cache, so compacting
+    // and scanning them does not stall or evict the block index.
+    CDBWrapper addressdb;
+    CDBWrapper spentdb;
+    CDBWrapper timestampdb;
+
+    //! the per address balance table follows the address index, false until it was built once
+    bool fAddressBalanceIndex;
+    void UpdateAddressBalances(CDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fErase);
+    bool BuildAddressBalanceIndex();
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool EraseBatchSync(const std::vector<const CBlockIndex*>& blockinfo);
@@ -96,27 +137,59 @@ public:
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
+    //! positions of the txids the txindex knows, looked up in key order through one iterator
+    bool ReadTxIndex(const std::vector<uint256> &vTxids, std::vector<std::pair<uint256, CDiskTxPos> > &vPos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    //! transactions of pruned blocks kept for the indexes (-prunetxarchive), by txid
+    bool ReadTxArchive(const uint256 &txid, CTransaction &tx, uint256 &hashBlock);
+    //! archive the transactions of a block about to be pruned, their txindex entries go with it
+    bool WriteTxArchive(const uint256 &hashBlock, const std::vector<CTransaction> &vtx);
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool ReadAddressUnspentIndex(const std::vector<std::pair<int, uint160> > &addresses,
+                                 std::map<std::pair<int, uint160>, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > &unspentOutputs);
+    /** Up to nMax unspent outputs of the address following pAfter (from the start if NULL), fMore if there are more */
+    bool ReadAddressUnspentIndex(uint160 addressHash, int type, const CAddressUnspentKey *pAfter, size_t nMax,
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect, bool &fMore);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    //! erase the address and CC index rows of disconnected blocks and restore the unspent index in one batch
+    bool EraseDisconnectedAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                       const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+                                       const std::vector<std::pair<CCIndexKey, CCIndexValue> > &ccIndex);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    /** Up to nMax address index entries following pAfter (from the start if NULL), fMore if there are more */
+    //! newest first with fReverse, pAfter is then the oldest entry of the previous page
+    bool ReadAddressIndex(uint160 addressHash, int type, const CAddressIndexKey *pAfter, size_t nMax,
+                          std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, bool &fMore,
+                          bool fReverse = false, int start = 0, int end = 0);
+    //! the CC index sits in the address index database and is written along with it
+    bool WriteCCIndex(const std::vector<std::pair<CCIndexKey, CCIndexValue> > &vect);
+    bool EraseCCIndex(const std::vector<std::pair<CCIndexKey, CCIndexValue> > &vect);
+    bool ReadCCIndex(uint8_t evalcode, uint8_t funcid, std::vector<std::pair<CCIndexKey, CCIndexValue> > &vect);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    //! last block the background index builder applied for index name
+    bool WriteIndexBuildProgress(const std::string &name, int nHeight, const uint256 &hash);
+    bool ReadIndexBuildProgress(const std::string &name, int &nHeight, uint256 &hash);
+    bool EraseIndexBuildProgress(const std::string &name);
     bool LoadBlockIndexGuts();
     bool blockOnchainActive(const uint256 &hash);
     UniValue Snapshot(int top);
-    bool Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret);
+    /** Addresses and balances from the balance table, as they were when snapshot was pinned if one is given */
+    bool Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret, const leveldb::Snapshot* snapshot = NULL);
+    /** Pin the address index for Snapshot2() on another thread, NULL if the balance table can not be built */
+    const leveldb::Snapshot* PinAddressIndex();
+    void UnpinAddressIndex(const leveldb::Snapshot* snapshot);
 };
 
 #endif // BITCOIN_TXDB_H
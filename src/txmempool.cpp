@@ -24,6 +24,9 @@
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
 #include "main.h"
+#include "cc/eval.h"
+#include "script/cc.h"
+#include "script/interpreter.h"
 #include "policy/fees.h"
 #include "streams.h"
 #include "timedata.h"
@@ -37,7 +40,9 @@ using namespace std;
 
 CTxMemPoolEntry::CTxMemPoolEntry():
     nFee(0), nTxSize(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0),
-    hadNoDependencies(false), spendsCoinbase(false)
+    hadNoDependencies(false), spendsCoinbase(false),
+    nCountWithAncestors(0), nSizeWithAncestors(0), nFeesWithAncestors(0),
+    nCountWithDescendants(0), nSizeWithDescendants(0), nFeesWithDescendants(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
@@ -50,10 +55,17 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
     hadNoDependencies(poolHasNoInputsOf),
     spendsCoinbase(_spendsCoinbase), nBranchId(_nBranchId)
 {
-    nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    nTxSize = tx.GetTotalSize();
     nModSize = tx.CalculateModifiedSize(nTxSize);
     nUsageSize = RecursiveDynamicUsage(tx);
     feeRate = CFeeRate(nFee, nTxSize);
+
+    nCountWithAncestors = 1;
+    nSizeWithAncestors = nTxSize;
+    nFeesWithAncestors = nFee;
+    nCountWithDescendants = 1;
+    nSizeWithDescendants = nTxSize;
+    nFeesWithDescendants = nFee;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -61,6 +73,27 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
     *this = other;
 }
 
+void CTxMemPoolEntry::SetTxData(const std::shared_ptr<const PrecomputedTransactionData>& txdataIn)
+{
+    if (!txdata && txdataIn)
+        nUsageSize += memusage::MallocUsage(sizeof(PrecomputedTransactionData));
+    txdata = txdataIn;
+}
+
+void CTxMemPoolEntry::SetAncestorState(uint64_t nCount, uint64_t nSize, CAmount nFees)
+{
+    nCountWithAncestors = nCount;
+    nSizeWithAncestors = nSize;
+    nFeesWithAncestors = nFees;
+}
+
+void CTxMemPoolEntry::SetDescendantState(uint64_t nCount, uint64_t nSize, CAmount nFees)
+{
+    nCountWithDescendants = nCount;
+    nSizeWithDescendants = nSize;
+    nFeesWithDescendants = nFees;
+}
+
 double
 CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 {
@@ -71,7 +104,8 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), minReasonableRelayFee(_minRelayFee), lastRollingFeeUpdate(GetTime()),
+    blockSinceLastRollingFeeBump(false), rollingMinimumFeeRate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -111,6 +145,104 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+void CTxMemPool::CalculateAncestors(const CTransaction& tx, std::set<uint256>& setAncestors) const
+{
+    std::deque<const CTransaction*> txToVisit;
+    txToVisit.push_back(&tx);
+    while (!txToVisit.empty())
+    {
+        const CTransaction* ptx = txToVisit.front();
+        txToVisit.pop_front();
+        BOOST_FOREACH(const CTxIn& txin, ptx->vin) {
+            indexed_transaction_set::const_iterator it = mapTx.find(txin.prevout.hash);
+            if (it != mapTx.end() && setAncestors.insert(txin.prevout.hash).second)
+                txToVisit.push_back(&it->GetTx());
+        }
+    }
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const
+{
+    std::deque<uint256> txToVisit;
+    txToVisit.push_back(hash);
+    while (!txToVisit.empty())
+    {
+        uint256 hashParent = txToVisit.front();
+        txToVisit.pop_front();
+        std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.lower_bound(COutPoint(hashParent, 0));
+        for (; it != mapNextTx.end() && it->first.hash == hashParent; ++it) {
+            const uint256& hashChild = it->second.ptx->GetHash();
+            if (setDescendants.insert(hashChild).second)
+                txToVisit.push_back(hashChild);
+        }
+    }
+}
+
+void CTxMemPool::UpdateAncestorState(const uint256& hash)
+{
+    indexed_transaction_set::iterator it = mapTx.find(hash);
+    if (it == mapTx.end())
+        return;
+    std::set<uint256> setAncestors;
+    CalculateAncestors(it->GetTx(), setAncestors);
+
+    uint64_t nCount = 1;
+    uint64_t nSize = it->GetTxSize();
+    CAmount nFees = it->GetFee();
+    BOOST_FOREACH(const uint256& hashAncestor, setAncestors) {
+        indexed_transaction_set::const_iterator ita = mapTx.find(hashAncestor);
+        nCount++;
+        nSize += ita->GetTxSize();
+        nFees += ita->GetFee();
+    }
+    mapTx.modify(it, set_ancestor_state(nCount, nSize, nFees));
+}
+
+void CTxMemPool::UpdateDescendantState(const uint256& hash)
+{
+    indexed_transaction_set::iterator it = mapTx.find(hash);
+    if (it == mapTx.end())
+        return;
+    std::set<uint256> setDescendants;
+    CalculateDescendants(hash, setDescendants);
+
+    uint64_t nCount = 1;
+    uint64_t nSize = it->GetTxSize();
+    CAmount nFees = it->GetFee();
+    BOOST_FOREACH(const uint256& hashDescendant, setDescendants) {
+        indexed_transaction_set::const_iterator itd = mapTx.find(hashDescendant);
+        if (itd == mapTx.end())
+            continue;
+        nCount++;
+        nSize += itd->GetTxSize();
+        nFees += itd->GetFee();
+    }
+    mapTx.modify(it, set_descendant_state(nCount, nSize, nFees));
+}
+
+/** The evalcode and funcid a CC transaction's OP_RETURN (its last output) starts with */
+static bool GetCCOpRetKey(const CTransaction& tx, std::pair<uint8_t, uint8_t>& key)
+{
+    std::vector<unsigned char> vopret;
+    if (tx.vout.empty() || !GetOpReturnData(tx.vout.back().scriptPubKey, vopret) || vopret.size() < 2)
+        return false;
+    key = std::make_pair(vopret[0], vopret[1]);
+    return true;
+}
+
+/** The keys of the KV records a transaction stores, laid out as safecoin_kvupdate() reads them */
+static void GetKVOpRetKeys(const CTransaction& tx, std::vector<std::string>& keys)
+{
+    std::vector<unsigned char> vopret;
+    BOOST_FOREACH(const CTxOut& txout, tx.vout) {
+        // 40 bytes is the size of a notarization, not a KV record
+        if (!GetOpReturnData(txout.scriptPubKey, vopret) || vopret.size() < 13 || vopret[0] != 'K' || vopret.size() == 40)
+            continue;
+        size_t keylen = vopret[1] | (vopret[2] << 8);
+        if (keylen > 0 && 13 + keylen <= vopret.size())
+            keys.push_back(std::string((const char*)&vopret[13], keylen));
+    }
+}
 
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate)
 {
@@ -129,6 +261,18 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
             mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
     }
     }
+    UpdateAncestorState(hash);
+    UpdateDescendantState(hash);
+    // pool transactions already spending from this one (re-added after a reorg) gain it as an ancestor
+    std::set<uint256> setDescendants;
+    CalculateDescendants(hash, setDescendants);
+    BOOST_FOREACH(const uint256& hashDescendant, setDescendants)
+        UpdateAncestorState(hashDescendant);
+    // and the ones it spends from gain it as a descendant
+    std::set<uint256> setAncestors;
+    CalculateAncestors(tx, setAncestors);
+    BOOST_FOREACH(const uint256& hashAncestor, setAncestors)
+        UpdateDescendantState(hashAncestor);
     BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
         BOOST_FOREACH(const uint256 &nf, joinsplit.nullifiers) {
             mapSproutNullifiers[nf] = &tx;
@@ -137,6 +281,13 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
         mapSaplingNullifiers[spendDescription.nullifier] = &tx;
     }
+    std::pair<uint8_t, uint8_t> ccKey;
+    if (GetCCOpRetKey(tx, ccKey))
+        mapCCOpRet[ccKey].insert(hash);
+    std::vector<std::string> kvKeys;
+    GetKVOpRetKeys(tx, kvKeys);
+    BOOST_FOREACH(const std::string& kvKey, kvKeys)
+        mapKVOpRet[kvKey].insert(hash);
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
@@ -224,16 +375,34 @@ bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresse
                                  std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
 {
     LOCK(cs);
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
-            results.push_back(*ait);
-            ait++;
-        }
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++)
+        getAddressDeltas((*it).first, (*it).second, results);
+    return true;
+}
+
+bool CTxMemPool::getAddressDeltas(const uint160& addressHash, int type,
+                                  std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results) const
+{
+    LOCK(cs);
+    addressDeltaMap::const_iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey(type, addressHash));
+    while (ait != mapAddress.end() && (*ait).first.addressBytes == addressHash && (*ait).first.type == type) {
+        results.push_back(*ait);
+        ait++;
     }
     return true;
 }
 
+bool CTxMemPool::hasAddressDelta(const uint160& addressHash, int type, bool fSpending) const
+{
+    LOCK(cs);
+    addressDeltaMap::const_iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey(type, addressHash));
+    for (; ait != mapAddress.end() && (*ait).first.addressBytes == addressHash && (*ait).first.type == type; ait++) {
+        if (((*ait).first.spending != 0) == fSpending)
+            return true;
+    }
+    return false;
+}
+
 bool CTxMemPool::removeAddressIndex(const uint256 txhash)
 {
     LOCK(cs);
@@ -340,6 +509,8 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
     {
         LOCK(cs);
         std::deque<uint256> txToRemove;
+        std::set<uint256> setDescendants;
+        std::set<uint256> setAncestors;
         txToRemove.push_back(origTx.GetHash());
         if (fRecursive && !mapTx.count(origTx.GetHash())) {
             // If recursively removing but origTx isn't in the mempool
@@ -368,7 +539,11 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
                     txToRemove.push_back(it->second.ptx->GetHash());
                 }
             }
-            mapRecentlyAddedTx.erase(hash);
+            CalculateDescendants(hash, setDescendants);
+            CalculateAncestors(tx, setAncestors);
+            // a transaction that was never announced as added is not announced as removed either
+            if (!mapRecentlyAddedTx.erase(hash))
+                vRecentlyRemovedTx.push_back(hash);
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
             BOOST_FOREACH(const JSDescription& joinsplit, tx.vjoinsplit) {
@@ -379,6 +554,25 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
                 mapSaplingNullifiers.erase(spendDescription.nullifier);
             }
+            std::pair<uint8_t, uint8_t> ccKey;
+            if (GetCCOpRetKey(tx, ccKey)) {
+                ccOpRetMap::iterator itCC = mapCCOpRet.find(ccKey);
+                if (itCC != mapCCOpRet.end()) {
+                    itCC->second.erase(hash);
+                    if (itCC->second.empty())
+                        mapCCOpRet.erase(itCC);
+                }
+            }
+            std::vector<std::string> kvKeys;
+            GetKVOpRetKeys(tx, kvKeys);
+            BOOST_FOREACH(const std::string& kvKey, kvKeys) {
+                kvOpRetMap::iterator itKV = mapKVOpRet.find(kvKey);
+                if (itKV != mapKVOpRet.end()) {
+                    itKV->second.erase(hash);
+                    if (itKV->second.empty())
+                        mapKVOpRet.erase(itKV);
+                }
+            }
             removed.push_back(tx);
             totalTxSize -= mapTx.find(hash)->GetTxSize();
             cachedInnerUsage -= mapTx.find(hash)->DynamicMemoryUsage();
@@ -388,6 +582,11 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             removeAddressIndex(hash);
             removeSpentIndex(hash);
         }
+        // whatever stays behind lost the removed transactions as ancestors or descendants
+        BOOST_FOREACH(const uint256& hashDescendant, setDescendants)
+            UpdateAncestorState(hashDescendant);
+        BOOST_FOREACH(const uint256& hashAncestor, setAncestors)
+            UpdateDescendantState(hashAncestor);
     }
 }
 
@@ -553,11 +752,16 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     {
         std::list<CTransaction> dummy;
         remove(tx, dummy, false);
+        // mined transactions leave with the block connection, not as removals
+        if (!dummy.empty() && !vRecentlyRemovedTx.empty() && vRecentlyRemovedTx.back() == tx.GetHash())
+            vRecentlyRemovedTx.pop_back();
         removeConflicts(tx, conflicts);
         ClearPrioritisation(tx.GetHash());
     }
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 /**
@@ -582,11 +786,74 @@ void CTxMemPool::removeWithoutBranchId(uint32_t nMemPoolBranchId)
     }
 }
 
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+unsigned int CTxMemPool::TrimToSize(size_t sizelimit)
+{
+    LOCK(cs);
+    unsigned int nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        indexed_transaction_set::nth_index<3>::type::iterator it = mapTx.get<3>().begin();
+
+        // The new minimum fee is the feerate of the evicted package plus -minrelaytxfee, so
+        // that a transaction paying as much as an evicted one cannot take its place before
+        // the next block
+        CFeeRate removedRate(it->GetFeesWithDescendants(), it->GetSizeWithDescendants());
+        removedRate = CFeeRate(removedRate.GetFeePerK() + minReasonableRelayFee.GetFeePerK());
+        trackPackageRemoved(removedRate);
+        if (removedRate > maxFeeRateRemoved)
+            maxFeeRateRemoved = removedRate;
+
+        CTransaction tx = it->GetTx();
+        std::list<CTransaction> removed;
+        remove(tx, removed, true);
+        nTxnRemoved += removed.size();
+    }
+    if (maxFeeRateRemoved > CFeeRate(0))
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+    return nTxnRemoved;
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(rollingMinimumFeeRate);
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10) {
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (DynamicMemoryUsage() < sizelimit / 4)
+            halflife /= 4;
+        else if (DynamicMemoryUsage() < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < (double)minReasonableRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(rollingMinimumFeeRate), minReasonableRelayFee);
+}
+
 void CTxMemPool::clear()
 {
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapCCOpRet.clear();
+    mapKVOpRet.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     ++nTransactionsUpdated;
@@ -634,6 +901,30 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second.n == i);
             i++;
         }
+        // Check the cached ancestor statistics.
+        std::set<uint256> setAncestors;
+        CalculateAncestors(tx, setAncestors);
+        uint64_t nSizeCheck = it->GetTxSize();
+        CAmount nFeesCheck = it->GetFee();
+        BOOST_FOREACH(const uint256& hashAncestor, setAncestors) {
+            nSizeCheck += mapTx.find(hashAncestor)->GetTxSize();
+            nFeesCheck += mapTx.find(hashAncestor)->GetFee();
+        }
+        assert(it->GetCountWithAncestors() == setAncestors.size() + 1);
+        assert(it->GetSizeWithAncestors() == nSizeCheck);
+        assert(it->GetFeesWithAncestors() == nFeesCheck);
+        // ... and the descendant ones.
+        std::set<uint256> setDescendants;
+        CalculateDescendants(it->GetTx().GetHash(), setDescendants);
+        nSizeCheck = it->GetTxSize();
+        nFeesCheck = it->GetFee();
+        BOOST_FOREACH(const uint256& hashDescendant, setDescendants) {
+            nSizeCheck += mapTx.find(hashDescendant)->GetTxSize();
+            nFeesCheck += mapTx.find(hashDescendant)->GetFee();
+        }
+        assert(it->GetCountWithDescendants() == setDescendants.size() + 1);
+        assert(it->GetSizeWithDescendants() == nSizeCheck);
+        assert(it->GetFeesWithDescendants() == nFeesCheck);
 
         boost::unordered_map<uint256, SproutMerkleTree, CCoinsKeyHasher> intermediates;
 
@@ -739,6 +1030,41 @@ void CTxMemPool::queryHashes(vector<uint256>& vtxid)
         vtxid.push_back(mi->GetTx().GetHash());
 }
 
+void CTxMemPool::queryCCOpRet(uint8_t evalcode, uint8_t funcid, std::vector<CTransaction>& txs) const
+{
+    LOCK(cs);
+    std::set<uint256> setTxids;
+    ccOpRetMap::const_iterator it = mapCCOpRet.find(std::make_pair(evalcode, funcid));
+    if (it != mapCCOpRet.end())
+        setTxids = it->second;
+    for (it = mapCCOpRet.lower_bound(std::make_pair((uint8_t)EVAL_TOKENS, (uint8_t)0)); it != mapCCOpRet.end() && it->first.first == EVAL_TOKENS; it++)
+        setTxids.insert(it->second.begin(), it->second.end());
+    BOOST_FOREACH(const uint256& hash, setTxids) {
+        indexed_transaction_set::const_iterator itTx = mapTx.find(hash);
+        if (itTx != mapTx.end())
+            txs.push_back(itTx->GetTx());
+    }
+}
+
+void CTxMemPool::queryKVOpRet(const std::string& key, std::vector<CTransaction>& txs) const
+{
+    LOCK(cs);
+    std::set<uint256> setTxids;
+    if (key.empty()) {
+        for (kvOpRetMap::const_iterator it = mapKVOpRet.begin(); it != mapKVOpRet.end(); it++)
+            setTxids.insert(it->second.begin(), it->second.end());
+    } else {
+        kvOpRetMap::const_iterator it = mapKVOpRet.find(key);
+        if (it != mapKVOpRet.end())
+            setTxids = it->second;
+    }
+    BOOST_FOREACH(const uint256& hash, setTxids) {
+        indexed_transaction_set::const_iterator itTx = mapTx.find(hash);
+        if (itTx != mapTx.end())
+            txs.push_back(itTx->GetTx());
+    }
+}
+
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
 {
     LOCK(cs);
@@ -748,14 +1074,22 @@ bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
     return true;
 }
 
-CFeeRate CTxMemPool::estimateFee(int nBlocks) const
+bool CTxMemPool::lookupTxData(const uint256& hash, std::shared_ptr<const PrecomputedTransactionData>& result) const
 {
     LOCK(cs);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
+    if (i == mapTx.end() || !i->GetTxData()) return false;
+    result = i->GetTxData();
+    return true;
+}
+
+// the estimator publishes its answers once per block, no need for cs here
+CFeeRate CTxMemPool::estimateFee(int nBlocks) const
+{
     return minerPolicyEstimator->estimateFee(nBlocks);
 }
 double CTxMemPool::estimatePriority(int nBlocks) const
 {
-    LOCK(cs);
     return minerPolicyEstimator->estimatePriority(nBlocks);
 }
 
@@ -846,6 +1180,7 @@ void CTxMemPool::NotifyRecentlyAdded()
 {
     uint64_t recentlyAddedSequence;
     std::vector<CTransaction> txs;
+    std::vector<uint256> removed;
     {
         LOCK(cs);
         recentlyAddedSequence = nRecentlyAddedSequence;
@@ -853,6 +1188,21 @@ void CTxMemPool::NotifyRecentlyAdded()
             txs.push_back(*(kv.second));
         }
         mapRecentlyAddedTx.clear();
+        removed.swap(vRecentlyRemovedTx);
+    }
+
+    // Removals go first, a transaction removed and accepted again since the
+    // last round must end up added.
+    for (const uint256& hash : removed) {
+        try {
+            GetMainSignals().TransactionRemovedFromMempool(hash);
+        } catch (const boost::thread_interrupted&) {
+            throw;
+        } catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "CTxMemPool::NotifyRecentlyAdded()");
+        } catch (...) {
+            PrintExceptionContinue(NULL, "CTxMemPool::NotifyRecentlyAdded()");
+        }
     }
 
     // A race condition can occur here between these SyncWithWallets calls, and
@@ -862,6 +1212,7 @@ void CTxMemPool::NotifyRecentlyAdded()
     for (auto tx : txs) {
         try {
             SyncWithWallets(tx, NULL);
+            GetMainSignals().TransactionAddedToMempool(tx);
         } catch (const boost::thread_interrupted&) {
             throw;
         } catch (const std::exception& e) {
@@ -910,6 +1261,6 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 6 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 6 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage;
+    // Estimate the overhead of mapTx to be 3 pointers per index + an allocation, as no exact formula for boost::multi_index_contained is implemented.
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage;
 }
@@ -22,6 +22,8 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <memory>
+#include <set>
 
 #include "addressindex.h"
 #include "spentindex.h"
@@ -54,6 +56,8 @@ static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 /**
  * CTxMemPool stores these:
  */
+struct PrecomputedTransactionData;
+
 class CTxMemPoolEntry
 {
 private:
@@ -69,6 +73,17 @@ private:
     bool hadNoDependencies; //! Not dependent on any other txs when it entered the mempool
     bool spendsCoinbase; //! keep track of transactions that spend a coinbase
     uint32_t nBranchId; //! Branch ID this transaction is known to commit to, cached for efficiency
+    std::shared_ptr<const PrecomputedTransactionData> txdata; //! Sighash midstates from the script checks, reused when the tx is connected
+
+    // Statistics of this transaction and all its in-mempool ancestors
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nFeesWithAncestors;
+
+    // ... and of this transaction and all its in-mempool descendants, the package evicted with it
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nFeesWithDescendants;
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
@@ -89,6 +104,46 @@ public:
 
     bool GetSpendsCoinbase() const { return spendsCoinbase; }
     uint32_t GetValidatedBranchId() const { return nBranchId; }
+    const std::shared_ptr<const PrecomputedTransactionData>& GetTxData() const { return txdata; }
+    void SetTxData(const std::shared_ptr<const PrecomputedTransactionData>& txdataIn);
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetFeesWithAncestors() const { return nFeesWithAncestors; }
+    void SetAncestorState(uint64_t nCount, uint64_t nSize, CAmount nFees);
+
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetFeesWithDescendants() const { return nFeesWithDescendants; }
+    void SetDescendantState(uint64_t nCount, uint64_t nSize, CAmount nFees);
+};
+
+// sets the ancestor statistics of an entry through mapTx.modify()
+struct set_ancestor_state
+{
+    set_ancestor_state(uint64_t _nCount, uint64_t _nSize, CAmount _nFees) :
+        nCount(_nCount), nSize(_nSize), nFees(_nFees) {}
+
+    void operator() (CTxMemPoolEntry &e) { e.SetAncestorState(nCount, nSize, nFees); }
+
+private:
+    uint64_t nCount;
+    uint64_t nSize;
+    CAmount nFees;
+};
+
+// sets the descendant statistics of an entry through mapTx.modify()
+struct set_descendant_state
+{
+    set_descendant_state(uint64_t _nCount, uint64_t _nSize, CAmount _nFees) :
+        nCount(_nCount), nSize(_nSize), nFees(_nFees) {}
+
+    void operator() (CTxMemPoolEntry &e) { e.SetDescendantState(nCount, nSize, nFees); }
+
+private:
+    uint64_t nCount;
+    uint64_t nSize;
+    CAmount nFees;
 };
 
 // extracts a TxMemPoolEntry's transaction hash
@@ -104,7 +159,7 @@ struct mempoolentry_txid
 class CompareTxMemPoolEntryByFee
 {
 public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
         if (a.GetFeeRate() == b.GetFeeRate())
             return a.GetTime() < b.GetTime();
@@ -112,6 +167,79 @@ public:
     }
 };
 
+/**
+ * Sort by the lower of the entry's own feerate and the feerate of the entry
+ * together with its in-mempool ancestors, highest first. Walking this index
+ * meets the transactions a fee-ordered block template wants first without
+ * visiting the rest of the pool.
+ */
+class CompareTxMemPoolEntryByAncestorFee
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double aFees, aSize, bFees, bSize;
+        GetScore(a, aFees, aSize);
+        GetScore(b, bFees, bSize);
+
+        // avoid division by rewriting (aFees / aSize) > (bFees / bSize)
+        double f1 = aFees * bSize;
+        double f2 = bFees * aSize;
+        if (f1 == f2)
+            return a.GetTime() < b.GetTime();
+        return f1 > f2;
+    }
+
+    static void GetScore(const CTxMemPoolEntry& e, double& fees, double& size)
+    {
+        double fOwn = (double)e.GetFee() * e.GetSizeWithAncestors();
+        double fAncestors = (double)e.GetFeesWithAncestors() * e.GetTxSize();
+        if (fOwn < fAncestors) {
+            fees = e.GetFee();
+            size = e.GetTxSize();
+        } else {
+            fees = e.GetFeesWithAncestors();
+            size = e.GetSizeWithAncestors();
+        }
+    }
+};
+
+/**
+ * Sort by the higher of the entry's own feerate and the feerate of the entry
+ * together with its in-mempool descendants, lowest first. The first entry is
+ * the one to evict, with its descendants, when the pool is over its size limit:
+ * a parent whose children pay for it is kept as long as the children would be.
+ */
+class CompareTxMemPoolEntryByDescendantScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        bool fUseADescendants = UseDescendantScore(a);
+        bool fUseBDescendants = UseDescendantScore(b);
+
+        double aFees = fUseADescendants ? a.GetFeesWithDescendants() : a.GetFee();
+        double aSize = fUseADescendants ? a.GetSizeWithDescendants() : a.GetTxSize();
+        double bFees = fUseBDescendants ? b.GetFeesWithDescendants() : b.GetFee();
+        double bSize = fUseBDescendants ? b.GetSizeWithDescendants() : b.GetTxSize();
+
+        // avoid division by rewriting (aFees / aSize) < (bFees / bSize)
+        double f1 = aFees * bSize;
+        double f2 = bFees * aSize;
+        if (f1 == f2)
+            return a.GetTime() > b.GetTime();
+        return f1 < f2;
+    }
+
+    // whether the descendant package has the higher feerate
+    static bool UseDescendantScore(const CTxMemPoolEntry& e)
+    {
+        double f1 = (double)e.GetFee() * e.GetSizeWithDescendants();
+        double f2 = (double)e.GetFeesWithDescendants() * e.GetTxSize();
+        return f2 > f1;
+    }
+};
+
 class CBlockPolicyEstimator;
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
@@ -148,7 +276,13 @@ private:
     uint64_t totalTxSize = 0; //! sum of all mempool tx' byte sizes
     uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
+    CFeeRate minReasonableRelayFee; //! the -minrelaytxfee this pool was made with
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! minimum fee to get into the pool, decreases exponentially
+
     std::map<uint256, const CTransaction*> mapRecentlyAddedTx;
+    std::vector<uint256> vRecentlyRemovedTx; //! announced transactions removed since the last NotifyRecentlyAdded
     uint64_t nRecentlyAddedSequence = 0;
     uint64_t nNotifiedSequence = 0;
 
@@ -156,6 +290,17 @@ private:
     std::map<uint256, const CTransaction*> mapSaplingNullifiers;
 
     void checkNullifiers(ShieldedType type) const;
+
+    /** In-mempool transactions tx spends from, directly or through other pool transactions */
+    void CalculateAncestors(const CTransaction& tx, std::set<uint256>& setAncestors) const;
+    /** In-mempool transactions spending from hash, directly or through other pool transactions */
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+    /** Recompute the ancestor statistics of the pool entry with this hash */
+    void UpdateAncestorState(const uint256& hash);
+    /** Recompute the descendant statistics of the pool entry with this hash */
+    void UpdateDescendantState(const uint256& hash);
+    /** Raise the rolling minimum fee to the feerate of a package evicted for space */
+    void trackPackageRemoved(const CFeeRate& rate);
     
 public:
     typedef boost::multi_index_container<
@@ -167,6 +312,16 @@ public:
             boost::multi_index::ordered_non_unique<
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByFee
+            >,
+            // sorted by ancestor fee rate
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByAncestorFee
+            >,
+            // sorted by descendant score, eviction order
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByDescendantScore
             >
         >
     > indexed_transaction_set;
@@ -187,7 +342,17 @@ private:
     typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
+    //! txids by the evalcode and funcid starting the OP_RETURN in their last output
+    typedef std::map<std::pair<uint8_t, uint8_t>, std::set<uint256> > ccOpRetMap;
+    ccOpRetMap mapCCOpRet;
+
+    //! txids by the key of the KV records ('K' OP_RETURNs) in their outputs
+    typedef std::map<std::string, std::set<uint256> > kvOpRetMap;
+    kvOpRetMap mapKVOpRet;
+
 public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
+
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
@@ -207,6 +372,14 @@ public:
     void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
+    /**
+     * The deltas of one address, its outputs and the spends of its outputs, in txid order. CC outputs are
+     * kept under type 3, see CBitcoinAddress::GetIndexKey. Only filled with -addressindex.
+     */
+    bool getAddressDeltas(const uint160& addressHash, int type,
+                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results) const;
+    /** Whether the address has an output (fSpending false) or a spend in the mempool, without copying its deltas */
+    bool hasAddressDelta(const uint160& addressHash, int type, bool fSpending) const;
     bool removeAddressIndex(const uint256 txhash);
 
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
@@ -220,8 +393,27 @@ public:
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     void removeWithoutBranchId(uint32_t nMemPoolBranchId);
+    /**
+     * Evict the lowest descendant score packages until the pool uses at most sizelimit
+     * bytes of memory, raising the rolling minimum fee. Returns the number of transactions
+     * evicted.
+     */
+    unsigned int TrimToSize(size_t sizelimit);
+    /**
+     * The minimum feerate for a transaction to get into the pool: the feerate of the last
+     * evicted package plus -minrelaytxfee, halving every ROLLING_FEE_HALFLIFE seconds after
+     * a block (faster while the pool is well below sizelimit), and 0 once it is negligible.
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
+    /**
+     * Transactions whose OP_RETURN output starts with evalcode and funcid,
+     * plus all token transactions, as their OP_RETURN may wrap that data.
+     */
+    void queryCCOpRet(uint8_t evalcode, uint8_t funcid, std::vector<CTransaction>& txs) const;
+    /** Transactions storing a KV record under key, or every KV transaction for an empty key */
+    void queryKVOpRet(const std::string& key, std::vector<CTransaction>& txs) const;
     void pruneSpent(const uint256& hash, CCoins &coins);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
@@ -260,6 +452,7 @@ public:
     }
 
     bool lookup(uint256 hash, CTransaction& result) const;
+    bool lookupTxData(const uint256& hash, std::shared_ptr<const PrecomputedTransactionData>& result) const;
 
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
@@ -12,11 +12,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <cassert>
 
 #include <sstream>        // .get_int64()
 #include <utility>        // std::pair
 
+/** Objects with at least this many keys get a hashed index for key lookups */
+static const size_t UNIVALUE_KEY_INDEX_MIN = 16;
+
 class UniValue {
 public:
     enum VType { VNULL, VOBJ, VARR, VSTR, VNUM, VBOOL, };
@@ -48,9 +53,20 @@ public:
         std::string s(val_);
         setStr(s);
     }
+    UniValue(const UniValue& other) : typ(other.typ), val(other.val), keys(other.keys), values(other.values),
+        keyIndex(other.keyIndex ? new std::unordered_map<std::string, size_t>(*other.keyIndex) : NULL) {}
+    UniValue(UniValue&& other) = default;
+    UniValue& operator=(const UniValue& other) {
+        if (this != &other)
+            *this = UniValue(other);
+        return *this;
+    }
+    UniValue& operator=(UniValue&& other) = default;
     ~UniValue() {}
 
     void clear();
+    //! make room for n array elements or object members
+    void reserve(size_t n);
 
     bool setNull();
     bool setBool(bool val);
@@ -86,61 +102,53 @@ public:
     bool isObject() const { return (typ == VOBJ); }
 
     bool push_back(const UniValue& val);
+    bool push_back(UniValue&& val);
     bool push_back(const std::string& val_) {
-        UniValue tmpVal(VSTR, val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(VSTR, val_));
     }
     bool push_back(const char *val_) {
         std::string s(val_);
         return push_back(s);
     }
     bool push_back(uint64_t val_) {
-        UniValue tmpVal(val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(val_));
     }
     bool push_back(int64_t val_) {
-        UniValue tmpVal(val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(val_));
     }
     bool push_back(int val_) {
-        UniValue tmpVal(val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(val_));
     }
     bool push_back(double val_) {
-        UniValue tmpVal(val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(val_));
     }
     bool push_backV(const std::vector<UniValue>& vec);
 
     void __pushKV(const std::string& key, const UniValue& val);
+    void __pushKV(const std::string& key, UniValue&& val);
     bool pushKV(const std::string& key, const UniValue& val);
+    bool pushKV(const std::string& key, UniValue&& val);
     bool pushKV(const std::string& key, const std::string& val_) {
-        UniValue tmpVal(VSTR, val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(VSTR, val_));
     }
     bool pushKV(const std::string& key, const char *val_) {
         std::string _val(val_);
         return pushKV(key, _val);
     }
     bool pushKV(const std::string& key, int64_t val_) {
-        UniValue tmpVal(val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(val_));
     }
     bool pushKV(const std::string& key, uint64_t val_) {
-        UniValue tmpVal(val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(val_));
     }
     bool pushKV(const std::string& key, bool val_) {
-        UniValue tmpVal((bool)val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue((bool)val_));
     }
     bool pushKV(const std::string& key, int val_) {
-        UniValue tmpVal((int64_t)val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue((int64_t)val_));
     }
     bool pushKV(const std::string& key, double val_) {
-        UniValue tmpVal(val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(val_));
     }
     bool pushKVs(const UniValue& obj);
 
@@ -158,8 +166,11 @@ private:
     std::string val;                       // numbers are stored as C++ strings
     std::vector<std::string> keys;
     std::vector<UniValue> values;
+    //! key -> index into keys of its first occurrence, kept once an object has UNIVALUE_KEY_INDEX_MIN keys
+    std::unique_ptr<std::unordered_map<std::string, size_t> > keyIndex;
 
     bool findKey(const std::string& key, size_t& retIdx) const;
+    void indexKey(size_t idx);
     void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
 
@@ -178,7 +189,7 @@ public:
 
     enum VType type() const { return getType(); }
     bool push_back(std::pair<std::string,UniValue> pear) {
-        return pushKV(pear.first, pear.second);
+        return pushKV(pear.first, std::move(pear.second));
     }
     friend const UniValue& find_value( const UniValue& obj, const std::string& name);
 };
@@ -191,60 +202,71 @@ static inline std::pair<std::string,UniValue> Pair(const char *cKey, const char
 {
     std::string key(cKey);
     UniValue uVal(cVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, std::string strVal)
 {
     std::string key(cKey);
     UniValue uVal(strVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, uint64_t u64Val)
 {
     std::string key(cKey);
     UniValue uVal(u64Val);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, int64_t i64Val)
 {
     std::string key(cKey);
     UniValue uVal(i64Val);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, bool iVal)
 {
     std::string key(cKey);
     UniValue uVal(iVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, int iVal)
 {
     std::string key(cKey);
     UniValue uVal(iVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, double dVal)
 {
     std::string key(cKey);
     UniValue uVal(dVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, const UniValue& uVal)
 {
     std::string key(cKey);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), uVal);
+}
+
+static inline std::pair<std::string,UniValue> Pair(const char *cKey, UniValue&& uVal)
+{
+    std::string key(cKey);
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(std::string key, const UniValue& uVal)
 {
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), uVal);
+}
+
+static inline std::pair<std::string,UniValue> Pair(std::string key, UniValue&& uVal)
+{
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 enum jtokentype {
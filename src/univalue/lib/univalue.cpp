@@ -83,6 +83,14 @@ void UniValue::clear()
     val.clear();
     keys.clear();
     values.clear();
+    keyIndex.reset();
+}
+
+void UniValue::reserve(size_t n)
+{
+    if (typ == VOBJ)
+        keys.reserve(n);
+    values.reserve(n);
 }
 
 bool UniValue::setNull()
@@ -179,6 +187,15 @@ bool UniValue::push_back(const UniValue& val_)
     return true;
 }
 
+bool UniValue::push_back(UniValue&& val_)
+{
+    if (typ != VARR)
+        return false;
+
+    values.push_back(std::move(val_));
+    return true;
+}
+
 bool UniValue::push_backV(const std::vector<UniValue>& vec)
 {
     if (typ != VARR)
@@ -193,6 +210,14 @@ void UniValue::__pushKV(const std::string& key, const UniValue& val_)
 {
     keys.push_back(key);
     values.push_back(val_);
+    indexKey(keys.size() - 1);
+}
+
+void UniValue::__pushKV(const std::string& key, UniValue&& val_)
+{
+    keys.push_back(key);
+    values.push_back(std::move(val_));
+    indexKey(keys.size() - 1);
 }
 
 bool UniValue::pushKV(const std::string& key, const UniValue& val_)
@@ -208,6 +233,19 @@ bool UniValue::pushKV(const std::string& key, const UniValue& val_)
     return true;
 }
 
+bool UniValue::pushKV(const std::string& key, UniValue&& val_)
+{
+    if (typ != VOBJ)
+        return false;
+
+    size_t idx;
+    if (findKey(key, idx))
+        values[idx] = std::move(val_);
+    else
+        __pushKV(key, std::move(val_));
+    return true;
+}
+
 bool UniValue::pushKVs(const UniValue& obj)
 {
     if (typ != VOBJ || obj.typ != VOBJ)
@@ -229,8 +267,31 @@ void UniValue::getObjMap(std::map<std::string,UniValue>& kv) const
         kv[keys[i]] = values[i];
 }
 
+// Add keys[idx] to the key index, building the index once the object is big enough for it
+void UniValue::indexKey(size_t idx)
+{
+    if (!keyIndex) {
+        if (keys.size() < UNIVALUE_KEY_INDEX_MIN)
+            return;
+        keyIndex.reset(new std::unordered_map<std::string, size_t>());
+        keyIndex->reserve(keys.size() * 2);
+        for (size_t i = 0; i < keys.size(); i++)
+            keyIndex->emplace(keys[i], i);
+        return;
+    }
+    // duplicate keys keep pointing at the first occurrence, as the linear search finds
+    keyIndex->emplace(keys[idx], idx);
+}
+
 bool UniValue::findKey(const std::string& key, size_t& retIdx) const
 {
+    if (keyIndex) {
+        std::unordered_map<std::string, size_t>::const_iterator it = keyIndex->find(key);
+        if (it == keyIndex->end())
+            return false;
+        retIdx = it->second;
+        return true;
+    }
     for (size_t i = 0; i < keys.size(); i++) {
         if (keys[i] == key) {
             retIdx = i;
@@ -298,9 +359,9 @@ const char *uvTypeName(UniValue::VType t)
 
 const UniValue& find_value(const UniValue& obj, const std::string& name)
 {
-    for (unsigned int i = 0; i < obj.keys.size(); i++)
-        if (obj.keys[i] == name)
-            return obj.values.at(i);
+    size_t i;
+    if (obj.findKey(name, i))
+        return obj.values.at(i);
 
     return NullUniValue;
 }
@@ -350,6 +350,8 @@ bool UniValue::read(const char *raw, size_t size)
             UniValue *top = stack.back();
             if (utyp != top->getType())
                 return false;
+            if (utyp == VOBJ && !top->keys.empty())
+                top->indexKey(top->keys.size() - 1);
 
             stack.pop_back();
             clearExpect(OBJ_NAME);
@@ -393,6 +393,44 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK(!v.read("{} 42"));
 }
 
+BOOST_AUTO_TEST_CASE(univalue_keyindex)
+{
+    // big enough objects look keys up through the index, which must agree with the key order
+    UniValue obj(UniValue::VOBJ);
+    obj.reserve(2 * UNIVALUE_KEY_INDEX_MIN);
+    for (size_t i = 0; i < 2 * UNIVALUE_KEY_INDEX_MIN; i++)
+        BOOST_CHECK(obj.pushKV("k" + std::to_string(i), (int64_t)i));
+    BOOST_CHECK_EQUAL(obj.size(), 2 * UNIVALUE_KEY_INDEX_MIN);
+    for (size_t i = 0; i < 2 * UNIVALUE_KEY_INDEX_MIN; i++)
+        BOOST_CHECK_EQUAL(find_value(obj, "k" + std::to_string(i)).get_int64(), (int64_t)i);
+    BOOST_CHECK(find_value(obj, "missing").isNull());
+
+    BOOST_CHECK(obj.pushKV("k3", "replaced"));
+    BOOST_CHECK_EQUAL(obj.size(), 2 * UNIVALUE_KEY_INDEX_MIN);
+    BOOST_CHECK_EQUAL(obj["k3"].getValStr(), "replaced");
+
+    // duplicates from pushKVs resolve to the first occurrence
+    UniValue dup(UniValue::VOBJ);
+    dup.pushKV("k5", "second");
+    BOOST_CHECK(obj.pushKVs(dup));
+    BOOST_CHECK_EQUAL(obj["k5"].get_int64(), 5);
+
+    UniValue copy(obj);
+    BOOST_CHECK_EQUAL(copy["k20"].get_int64(), 20);
+    UniValue moved(std::move(copy));
+    BOOST_CHECK_EQUAL(moved["k21"].get_int64(), 21);
+
+    UniValue parsed;
+    BOOST_CHECK(parsed.read(obj.write()));
+    BOOST_CHECK_EQUAL(parsed["k30"].get_int64(), 30);
+    BOOST_CHECK_EQUAL(parsed["k5"].get_int64(), 5);
+    BOOST_CHECK(parsed.exists("k31"));
+    BOOST_CHECK(!parsed.exists("k32"));
+
+    obj.setObject();
+    BOOST_CHECK(find_value(obj, "k1").isNull());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 int main (int argc, char *argv[])
@@ -403,6 +441,7 @@ int main (int argc, char *argv[])
     univalue_array();
     univalue_object();
     univalue_readwrite();
+    univalue_keyindex();
     return 0;
 }
 
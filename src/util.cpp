@@ -56,6 +56,7 @@
 
 #include <algorithm>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 
@@ -895,6 +896,70 @@ void AllocateFileRange(FILE *file, unsigned int offset, unsigned int length) {
 #endif
 }
 
+/**
+ * this function asks the kernel to start reading a range of a file into the page cache,
+ * without waiting for it and without copying anything. It is advisory, like AllocateFileRange
+ */
+void FileReadAhead(FILE *file, unsigned int offset, unsigned int length) {
+    if (length == 0)
+        return;
+#if defined(WIN32)
+    // no equivalent that does not read the data ourselves
+#elif defined(MAC_OSX)
+    struct radvisory ra;
+    ra.ra_offset = (off_t)offset;
+    ra.ra_count = (int)length;
+    fcntl(fileno(file), F_RDADVISE, &ra);
+#elif defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fileno(file), (off_t)offset, (off_t)length, POSIX_FADV_WILLNEED);
+#endif
+}
+
+std::set<std::pair<uintptr_t, uintptr_t> > GetAnonymousMappings()
+{
+    std::set<std::pair<uintptr_t, uintptr_t> > mappings;
+#if defined(__linux__)
+    FILE *file = fopen("/proc/self/maps", "r");
+    if (file == NULL)
+        return mappings;
+    char line[1024], perms[8], path[512];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        unsigned long start, end, offset, inode;
+        unsigned int major, minor;
+        path[0] = 0;
+        if (sscanf(line, "%lx-%lx %7s %lx %x:%x %lu %511s", &start, &end, perms, &offset, &major, &minor, &inode, path) < 7)
+            continue;
+        if (inode == 0 && strcmp(perms, "rw-p") == 0 && (path[0] == 0 || strcmp(path, "[heap]") == 0))
+            mappings.insert(std::make_pair((uintptr_t)start, (uintptr_t)end));
+    }
+    fclose(file);
+#endif
+    return mappings;
+}
+
+size_t MarkMappingsMergeable(const std::set<std::pair<uintptr_t, uintptr_t> >& before)
+{
+    size_t nMarked = 0;
+#if defined(__linux__) && defined(MADV_MERGEABLE)
+    std::set<std::pair<uintptr_t, uintptr_t> > after = GetAnonymousMappings();
+    for (std::set<std::pair<uintptr_t, uintptr_t> >::const_iterator it = after.begin(); it != after.end(); ++it) {
+        // a mapping that grew or was joined with a new neighbour shows up with other bounds,
+        // only the pages that were not mapped before are new
+        uintptr_t pos = it->first;
+        for (std::set<std::pair<uintptr_t, uintptr_t> >::const_iterator old = before.begin(); old != before.end() && old->first < it->second; ++old) {
+            if (old->second <= pos)
+                continue;
+            if (old->first > pos && madvise((void*)pos, old->first - pos, MADV_MERGEABLE) == 0)
+                nMarked += old->first - pos;
+            pos = old->second;
+        }
+        if (pos < it->second && madvise((void*)pos, it->second - pos, MADV_MERGEABLE) == 0)
+            nMarked += it->second - pos;
+    }
+#endif
+    return nMarked;
+}
+
 void ShrinkDebugFile()
 {
     // Scroll debug.log if it's getting too big
@@ -36,6 +36,7 @@
 #include <atomic>
 #include <exception>
 #include <map>
+#include <set>
 #include <stdint.h>
 #include <string>
 #include <vector>
@@ -138,6 +139,15 @@ void FileCommit(FILE *fileout);
 bool TruncateFile(FILE *file, unsigned int length);
 int RaiseFileDescriptorLimit(int nMinFD);
 void AllocateFileRange(FILE *file, unsigned int offset, unsigned int length);
+/** Start reading [offset, offset + length) of a file into the page cache in the background */
+void FileReadAhead(FILE *file, unsigned int offset, unsigned int length);
+/** (start, end) of the private anonymous memory mappings of the process, empty where they cannot be listed */
+std::set<std::pair<uintptr_t, uintptr_t> > GetAnonymousMappings();
+/**
+ * Let the kernel share pages whose content is the same as other processes' (Linux KSM) in the private
+ * anonymous memory that was not mapped in before. Advisory, returns the number of bytes marked.
+ */
+size_t MarkMappingsMergeable(const std::set<std::pair<uintptr_t, uintptr_t> >& before);
 bool RenameOver(boost::filesystem::path src, boost::filesystem::path dest);
 bool TryCreateDirectory(const boost::filesystem::path& p);
 boost::filesystem::path GetDefaultDataDir();
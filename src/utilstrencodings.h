@@ -87,6 +87,19 @@ std::string HexStr(const T itbegin, const T itend, bool fSpaces=false)
     std::string rv;
     static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
                                      '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    if (!fSpaces)
+    {
+        // the common case, written in place without a capacity check per digit
+        rv.resize((itend-itbegin)*2);
+        std::string::iterator out = rv.begin();
+        for(T it = itbegin; it < itend; ++it)
+        {
+            unsigned char val = (unsigned char)(*it);
+            *out++ = hexmap[val>>4];
+            *out++ = hexmap[val&15];
+        }
+        return rv;
+    }
     rv.reserve((itend-itbegin)*3);
     for(T it = itbegin; it < itend; ++it)
     {
@@ -5,6 +5,16 @@
 
 #include "validationinterface.h"
 
+#include "consensus/validation.h"
+#include "primitives/block.h"
+#include "util.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+
+#include <boost/thread.hpp>
+
 static CMainSignals g_signals;
 
 CMainSignals& GetMainSignals()
@@ -23,9 +33,15 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
     g_signals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1));
     g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
+    g_signals.TransactionAddedToMempool.connect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
+    g_signals.TransactionRemovedFromMempool.connect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
+    g_signals.AsyncOperationFinished.connect(boost::bind(&CValidationInterface::AsyncOperationFinished, pwalletIn, _1, _2));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
+    g_signals.AsyncOperationFinished.disconnect(boost::bind(&CValidationInterface::AsyncOperationFinished, pwalletIn, _1, _2));
+    g_signals.TransactionRemovedFromMempool.disconnect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
+    g_signals.TransactionAddedToMempool.disconnect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
     g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1));
     g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
@@ -39,6 +55,9 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
 }
 
 void UnregisterAllValidationInterfaces() {
+    g_signals.AsyncOperationFinished.disconnect_all_slots();
+    g_signals.TransactionRemovedFromMempool.disconnect_all_slots();
+    g_signals.TransactionAddedToMempool.disconnect_all_slots();
     g_signals.BlockChecked.disconnect_all_slots();
     g_signals.Broadcast.disconnect_all_slots();
     g_signals.Inventory.disconnect_all_slots();
@@ -61,4 +80,182 @@ void EraseFromWallets(const uint256 &hash) {
 
 void RescanWallets() {
     g_signals.RescanWallet();
-}
\ No newline at end of file
+}
+/**
+ * Stands in for a listener on the signals, queueing copies of the notifications
+ * that its thread then delivers in order. The block of consecutive SyncTransaction
+ * calls for the transactions of one block is copied once.
+ */
+class CAsyncValidationInterface : public CValidationInterface
+{
+private:
+    CValidationInterface* pListener;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<boost::function<void()> > queue;
+    bool fRunning;
+    bool fDropping;
+    const CBlock* pblockLast;
+    std::shared_ptr<const CBlock> blockLast;
+    boost::thread thread;
+
+    void Push(const boost::function<void()>& notification)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        // Waiting for room could deadlock, the signals are raised with cs_main held
+        // and the listeners may take it.
+        if (queue.size() >= MAX_ASYNC_NOTIFICATIONS) {
+            if (!fDropping)
+                LogPrintf("%s: notification queue is full, dropping notifications\n", __func__);
+            fDropping = true;
+            return;
+        }
+        fDropping = false;
+        queue.push_back(notification);
+        cond.notify_one();
+    }
+
+    std::shared_ptr<const CBlock> CopyBlock(const CBlock* pblock)
+    {
+        if (!pblock)
+            return std::shared_ptr<const CBlock>();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (pblock != pblockLast || !blockLast || blockLast->GetHash() != pblock->GetHash()) {
+            blockLast = std::make_shared<const CBlock>(*pblock);
+            pblockLast = pblock;
+        }
+        return blockLast;
+    }
+
+    void Thread()
+    {
+        RenameThread("safecoin-notify");
+        while (true) {
+            boost::function<void()> notification;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (fRunning && queue.empty())
+                    cond.wait(lock);
+                if (queue.empty())
+                    break;
+                notification = queue.front();
+                queue.pop_front();
+            }
+            try {
+                notification();
+            } catch (const boost::thread_interrupted&) {
+                throw;
+            } catch (const std::exception& e) {
+                PrintExceptionContinue(&e, "CAsyncValidationInterface::Thread()");
+            } catch (...) {
+                PrintExceptionContinue(NULL, "CAsyncValidationInterface::Thread()");
+            }
+        }
+    }
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex)
+    {
+        CValidationInterface* p = pListener;
+        Push([p, pindex]() { p->UpdatedBlockTip(pindex); });
+    }
+    void SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+    {
+        CValidationInterface* p = pListener;
+        std::shared_ptr<const CBlock> block = CopyBlock(pblock);
+        Push([p, tx, block]() { p->SyncTransaction(tx, block.get()); });
+    }
+    void EraseFromWallet(const uint256 &hash)
+    {
+        CValidationInterface* p = pListener;
+        Push([p, hash]() { p->EraseFromWallet(hash); });
+    }
+    void RescanWallet()
+    {
+        CValidationInterface* p = pListener;
+        Push([p]() { p->RescanWallet(); });
+    }
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added)
+    {
+        CValidationInterface* p = pListener;
+        std::shared_ptr<const CBlock> block = CopyBlock(pblock);
+        Push([p, pindex, block, sproutTree, saplingTree, added]() { p->ChainTip(pindex, block.get(), sproutTree, saplingTree, added); });
+    }
+    void SetBestChain(const CBlockLocator &locator)
+    {
+        CValidationInterface* p = pListener;
+        Push([p, locator]() { p->SetBestChain(locator); });
+    }
+    void UpdatedTransaction(const uint256 &hash)
+    {
+        CValidationInterface* p = pListener;
+        Push([p, hash]() { p->UpdatedTransaction(hash); });
+    }
+    void Inventory(const uint256 &hash)
+    {
+        CValidationInterface* p = pListener;
+        Push([p, hash]() { p->Inventory(hash); });
+    }
+    void ResendWalletTransactions(int64_t nBestBlockTime)
+    {
+        CValidationInterface* p = pListener;
+        Push([p, nBestBlockTime]() { p->ResendWalletTransactions(nBestBlockTime); });
+    }
+    void BlockChecked(const CBlock& block, const CValidationState& state)
+    {
+        CValidationInterface* p = pListener;
+        std::shared_ptr<const CBlock> blockCopy = CopyBlock(&block);
+        Push([p, blockCopy, state]() { p->BlockChecked(*blockCopy, state); });
+    }
+    void TransactionAddedToMempool(const CTransaction &tx)
+    {
+        CValidationInterface* p = pListener;
+        Push([p, tx]() { p->TransactionAddedToMempool(tx); });
+    }
+    void TransactionRemovedFromMempool(const uint256 &hash)
+    {
+        CValidationInterface* p = pListener;
+        Push([p, hash]() { p->TransactionRemovedFromMempool(hash); });
+    }
+    void AsyncOperationFinished(const std::string &id, const std::string &status)
+    {
+        CValidationInterface* p = pListener;
+        Push([p, id, status]() { p->AsyncOperationFinished(id, status); });
+    }
+
+public:
+    CAsyncValidationInterface(CValidationInterface* pListenerIn) : pListener(pListenerIn), fRunning(true), fDropping(false), pblockLast(NULL)
+    {
+        thread = boost::thread(boost::bind(&CAsyncValidationInterface::Thread, this));
+    }
+
+    /** Deliver what is queued, then stop the thread */
+    ~CAsyncValidationInterface()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fRunning = false;
+            cond.notify_all();
+        }
+        thread.join();
+    }
+};
+
+//! asynchronous listeners by the listener they deliver to, only touched from init and shutdown
+static std::map<CValidationInterface*, CAsyncValidationInterface*> mapAsyncInterfaces;
+
+void RegisterValidationInterfaceAsync(CValidationInterface* pListener) {
+    assert(!mapAsyncInterfaces.count(pListener));
+    CAsyncValidationInterface* pAsync = new CAsyncValidationInterface(pListener);
+    mapAsyncInterfaces[pListener] = pAsync;
+    RegisterValidationInterface(pAsync);
+}
+
+void UnregisterValidationInterfaceAsync(CValidationInterface* pListener) {
+    std::map<CValidationInterface*, CAsyncValidationInterface*>::iterator it = mapAsyncInterfaces.find(pListener);
+    if (it == mapAsyncInterfaces.end())
+        return;
+    UnregisterValidationInterface(it->second);
+    delete it->second;
+    mapAsyncInterfaces.erase(it);
+}
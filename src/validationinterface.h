@@ -6,6 +6,8 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include <string>
+
 #include <boost/signals2/signal.hpp>
 
 #include "zcash/IncrementalMerkleTree.hpp"
@@ -18,6 +20,11 @@ class CValidationInterface;
 class CValidationState;
 class uint256;
 
+/** Notifications an asynchronous listener may fall behind by before new ones are dropped */
+static const size_t MAX_ASYNC_NOTIFICATIONS = 10000;
+/** Default for -asyncnotify, deliver ZMQ and AMQP notifications off the validation thread */
+static const bool DEFAULT_ASYNC_NOTIFY = true;
+
 // These functions dispatch to one or all registered wallets
 
 /** Register a wallet to receive updates from core */
@@ -26,6 +33,15 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn);
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
+/**
+ * Register a listener that gets its notifications from a thread of its own, in the
+ * order they were signalled, so it does not hold up block connection. Only for
+ * listeners outside consensus and the wallet: they see the chain with a delay, and
+ * if they fall MAX_ASYNC_NOTIFICATIONS behind further notifications are dropped.
+ */
+void RegisterValidationInterfaceAsync(CValidationInterface* pListener);
+/** Unregister an asynchronous listener, after delivering what is queued for it */
+void UnregisterValidationInterfaceAsync(CValidationInterface* pListener);
 /** Push an updated transaction to all registered wallets */
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL);
 /** Erase a transaction from all registered wallets */
@@ -45,9 +61,13 @@ protected:
     virtual void Inventory(const uint256 &hash) {}
     virtual void ResendWalletTransactions(int64_t nBestBlockTime) {}
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
+    virtual void TransactionAddedToMempool(const CTransaction &tx) {}
+    virtual void TransactionRemovedFromMempool(const uint256 &hash) {}
+    virtual void AsyncOperationFinished(const std::string &id, const std::string &status) {}
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
+    friend class CAsyncValidationInterface;
 };
 
 struct CMainSignals {
@@ -71,6 +91,12 @@ struct CMainSignals {
     boost::signals2::signal<void (int64_t nBestBlockTime)> Broadcast;
     /** Notifies listeners of a block validation result */
     boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
+    /** Notifies listeners of a transaction accepted to the mempool, in the batches of CTxMemPool::NotifyRecentlyAdded. */
+    boost::signals2::signal<void (const CTransaction &)> TransactionAddedToMempool;
+    /** Notifies listeners of a transaction leaving the mempool other than by being mined. */
+    boost::signals2::signal<void (const uint256 &)> TransactionRemovedFromMempool;
+    /** Notifies listeners of an async RPC operation that succeeded, failed or was cancelled, with its z_getoperationstatus JSON. */
+    boost::signals2::signal<void (const std::string &, const std::string &)> AsyncOperationFinished;
 };
 
 CMainSignals& GetMainSignals();
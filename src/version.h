@@ -25,7 +25,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 170022;
+static const int PROTOCOL_VERSION = 170024;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 212;
@@ -50,4 +50,10 @@ static const int MEMPOOL_GD_VERSION = 60002;
 //! "filter*" commands are disabled without NODE_BLOOM after and including this version
 static const int NO_BLOOM_VERSION = 170004;
 
+//! short-id-based block download (compact blocks) starts with this version
+static const int SHORT_IDS_BLOCKS_VERSION = 170023;
+
+//! "sendrecon", reconciliation of transaction announcements, starts with this version
+static const int TXRECON_VERSION = 170024;
+
 #endif // BITCOIN_VERSION_H
@@ -90,6 +90,9 @@ public:
     virtual void main();
     
     virtual UniValue getStatus() const;
+
+    // selects its inputs from many addresses, so it runs on its own
+    virtual std::string getInputsKey() const { return ""; }
     
     bool testmode = false; // Set to true to disable sending txs and generating proofs
     
@@ -34,6 +34,7 @@
 #include "utilmoneystr.h"
 #include "wallet.h"
 #include "walletdb.h"
+#include "wallet/coinselection.h"
 #include "script/interpreter.h"
 #include "utiltime.h"
 #include "zcash/IncrementalMerkleTree.hpp"
@@ -320,18 +321,34 @@ bool AsyncRPCOperation_sendmany::main_impl() {
         CAmount dustChange = -1;
 
         std::vector<SendManyInputUTXO> selectedTInputs;
+        // UTXOs adding up to the target exactly need no change, otherwise take the smallest first
+        std::vector<CInputCoin> vInputs;
         for (SendManyInputUTXO & t : t_inputs_) {
-            bool b = std::get<3>(t);
-            if (b) {
-                selectedUTXOCoinbase = true;
+            vInputs.push_back(CInputCoin(std::get<2>(t), 0));
+        }
+        std::vector<size_t> vSelected;
+        if (SelectCoinsBnB(vInputs, targetAmount, 0, vSelected, selectedUTXOAmount)) {
+            for (size_t i : vSelected) {
+                if (std::get<3>(t_inputs_[i])) {
+                    selectedUTXOCoinbase = true;
+                }
+                selectedTInputs.push_back(t_inputs_[i]);
             }
-            selectedUTXOAmount += std::get<2>(t);
-            selectedTInputs.push_back(t);
-            if (selectedUTXOAmount >= targetAmount) {
-                // Select another utxo if there is change less than the dust threshold.
-                dustChange = selectedUTXOAmount - targetAmount;
-                if (dustChange == 0 || dustChange >= dustThreshold) {
-                    break;
+            dustChange = 0;
+        } else {
+            for (SendManyInputUTXO & t : t_inputs_) {
+                bool b = std::get<3>(t);
+                if (b) {
+                    selectedUTXOCoinbase = true;
+                }
+                selectedUTXOAmount += std::get<2>(t);
+                selectedTInputs.push_back(t);
+                if (selectedUTXOAmount >= targetAmount) {
+                    // Select another utxo if there is change less than the dust threshold.
+                    dustChange = selectedUTXOAmount - targetAmount;
+                    if (dustChange == 0 || dustChange >= dustThreshold) {
+                        break;
+                    }
                 }
             }
         }
@@ -1452,3 +1469,14 @@ UniValue AsyncRPCOperation_sendmany::getStatus() const {
     obj.push_back(Pair("params", contextinfo_ ));
     return obj;
 }
+
+/**
+ * Sends from different addresses spend different coins and notes and may run
+ * alongside each other. Sprout proofs are not made concurrently.
+ */
+std::string AsyncRPCOperation_sendmany::getInputsKey() const {
+    if (!isUsingBuilder_) {
+        return "";
+    }
+    return "z_sendmany:" + fromaddress_;
+}
@@ -88,6 +88,8 @@ public:
 
     virtual UniValue getStatus() const;
 
+    virtual std::string getInputsKey() const;
+
     bool testmode = false;  // Set to true to disable sending txs and generating proofs
 
     bool paymentDisclosureMode = true; // Set to true to save esk for encrypted notes in payment disclosure database.
@@ -77,6 +77,9 @@ public:
 
     virtual UniValue getStatus() const;
 
+    // selects its inputs from many addresses, so it runs on its own
+    virtual std::string getInputsKey() const { return ""; }
+
     bool testmode = false;  // Set to true to disable sending txs and generating proofs
     bool cheatSpend = false; // set when this is shielding a cheating coinbase
 
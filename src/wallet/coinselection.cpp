@@ -0,0 +1,88 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/coinselection.h"
+
+#include <algorithm>
+
+bool SelectCoinsBnB(const std::vector<CInputCoin>& vCoins, CAmount nTarget, CAmount nCostOfChange,
+                    std::vector<size_t>& vSelected, CAmount& nValueRet)
+{
+    vSelected.clear();
+    nValueRet = 0;
+
+    // Largest first, so the search reaches the target quickly and prunes early
+    std::vector<size_t> vOrder;
+    CAmount nAvailable = 0;
+    for (size_t i = 0; i < vCoins.size(); i++) {
+        if (vCoins[i].nEffectiveValue > 0) {
+            vOrder.push_back(i);
+            nAvailable += vCoins[i].nEffectiveValue;
+        }
+    }
+    if (nAvailable < nTarget)
+        return false;
+    std::sort(vOrder.begin(), vOrder.end(), [&vCoins](size_t a, size_t b) {
+        return vCoins[a].nEffectiveValue > vCoins[b].nEffectiveValue;
+    });
+
+    // vCurrent[i] is whether the i'th coin of vOrder is in, for the coins decided so far
+    std::vector<bool> vCurrent, vBest;
+    CAmount nCurrent = 0;
+    CAmount nBestExcess = 0;
+    bool fFound = false;
+    for (size_t nTries = 0; nTries < BNB_TOTAL_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nCurrent + nAvailable < nTarget || nCurrent > nTarget + nCostOfChange) {
+            // can't reach the target any more, or already past the window
+            fBacktrack = true;
+        } else if (nCurrent >= nTarget) {
+            if (!fFound || nCurrent - nTarget < nBestExcess) {
+                vBest = vCurrent;
+                fFound = true;
+                nBestExcess = nCurrent - nTarget;
+                if (nBestExcess == 0)
+                    break;
+            }
+            // adding more coins only adds excess
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Walk back to the last coin taken, putting back the ones left out
+            // after it, and try the branch without it
+            while (!vCurrent.empty() && !vCurrent.back()) {
+                vCurrent.pop_back();
+                nAvailable += vCoins[vOrder[vCurrent.size()]].nEffectiveValue;
+            }
+            if (vCurrent.empty())
+                break;
+            vCurrent.back() = false;
+            nCurrent -= vCoins[vOrder[vCurrent.size() - 1]].nEffectiveValue;
+        } else {
+            const CInputCoin& coin = vCoins[vOrder[vCurrent.size()]];
+            nAvailable -= coin.nEffectiveValue;
+            // Taking this coin when an equal one just before it was left out
+            // would only repeat the branch already searched with that one
+            if (!vCurrent.empty() && !vCurrent.back() &&
+                coin.nEffectiveValue == vCoins[vOrder[vCurrent.size() - 1]].nEffectiveValue) {
+                vCurrent.push_back(false);
+            } else {
+                vCurrent.push_back(true);
+                nCurrent += coin.nEffectiveValue;
+            }
+        }
+    }
+
+    if (!fFound)
+        return false;
+    for (size_t i = 0; i < vBest.size(); i++) {
+        if (vBest[i]) {
+            vSelected.push_back(vOrder[i]);
+            nValueRet += vCoins[vOrder[i]].nValue;
+        }
+    }
+    return true;
+}
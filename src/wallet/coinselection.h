@@ -0,0 +1,44 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_WALLET_COINSELECTION_H
+#define SAFECOIN_WALLET_COINSELECTION_H
+
+#include "amount.h"
+
+#include <vector>
+
+/** Serialized size of a P2PKH input and output, for the fee of spending or creating one */
+static const unsigned int P2PKH_INPUT_SIZE = 148;
+static const unsigned int P2PKH_OUTPUT_SIZE = 34;
+
+/** Branch and bound gives up after this many steps and leaves it to the other selectors */
+static const size_t BNB_TOTAL_TRIES = 100000;
+
+/** A candidate input, the value it adds once the fee of spending it is paid */
+struct CInputCoin
+{
+    CAmount nValue;
+    CAmount nEffectiveValue;
+
+    CInputCoin(CAmount nValueIn, CAmount nFee) : nValue(nValueIn), nEffectiveValue(nValueIn - nFee) {}
+};
+
+/**
+ * Find a set of coins whose effective value is at least nTarget and at most
+ * nTarget + nCostOfChange, so the transaction needs no change output, by a depth
+ * first search over the coins by decreasing value (Murch, "An Evaluation of Coin
+ * Selection Strategies"). Of the sets found, the one with the least excess wins.
+ * Coins of no effective value are never selected.
+ *
+ * @param[in]  vCoins        the candidates
+ * @param[out] vSelected     indexes into vCoins of the coins selected
+ * @param[out] nValueRet     their total value, fees not taken off
+ * @return whether such a set was found within BNB_TOTAL_TRIES steps
+ */
+bool SelectCoinsBnB(const std::vector<CInputCoin>& vCoins, CAmount nTarget, CAmount nCostOfChange,
+                    std::vector<size_t>& vSelected, CAmount& nValueRet);
+
+#endif // SAFECOIN_WALLET_COINSELECTION_H
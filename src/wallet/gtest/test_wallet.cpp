@@ -579,6 +579,60 @@ TEST(WalletTests, FindMySaplingNotesWithIvkOnly) {
     UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
 }
 
+TEST(WalletTests, FindMySaplingNotesInBatch) {
+    SelectParams(CBaseChainParams::REGTEST);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_SAPLING, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    auto consensusParams = Params().GetConsensus();
+
+    TestWallet wallet;
+
+    // One key in the wallet, one not
+    std::vector<unsigned char, secure_allocator<unsigned char>> rawSeed(32);
+    HDSeed seed(rawSeed);
+    auto m = libzcash::SaplingExtendedSpendingKey::Master(seed);
+    auto sk = m.Derive(0);
+    auto sk2 = m.Derive(1);
+    ASSERT_TRUE(wallet.AddSaplingZKey(sk, sk.DefaultAddress()));
+
+    std::vector<CTransaction> vtx;
+    for (auto key : {sk, sk2, sk}) {
+        auto expsk = key.expsk;
+        auto fvk = expsk.full_viewing_key();
+        auto pk = key.DefaultAddress();
+
+        libzcash::SaplingNote note(pk, 50000);
+        SaplingMerkleTree tree;
+        tree.append(note.cm().get());
+
+        auto builder = TransactionBuilder(consensusParams, 1);
+        ASSERT_TRUE(builder.AddSaplingSpend(expsk, note, tree.root(), tree.witness()));
+        builder.AddSaplingOutput(fvk.ovk, pk, 25000, {});
+        auto maybe_tx = builder.Build();
+        ASSERT_EQ(static_cast<bool>(maybe_tx), true);
+        vtx.push_back(maybe_tx.get());
+    }
+
+    // However many threads share the work, the notes found are those found one transaction at a time
+    for (int nThreads : {1, 2, 16}) {
+        auto vNotes = wallet.FindMySaplingNotes(vtx, nThreads);
+        ASSERT_EQ(vtx.size(), vNotes.size());
+        for (size_t i = 0; i < vtx.size(); i++) {
+            auto noteMap = wallet.FindMySaplingNotes(vtx[i]).first;
+            EXPECT_EQ(i == 1 ? 0 : 2, noteMap.size());
+            ASSERT_EQ(noteMap.size(), vNotes[i].first.size());
+            for (const auto& nd : noteMap) {
+                ASSERT_EQ(1, vNotes[i].first.count(nd.first));
+                EXPECT_EQ(nd.second.ivk, vNotes[i].first.at(nd.first).ivk);
+            }
+        }
+    }
+
+    // Revert to default
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_SAPLING, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+}
+
 TEST(WalletTests, FindMySproutNotes) {
     CWallet wallet;
 
@@ -2160,3 +2214,44 @@ TEST(WalletTests, SaplingNoteLocking) {
     EXPECT_FALSE(wallet.IsLockedNote(sop1));
     EXPECT_FALSE(wallet.IsLockedNote(sop2));
 }
+
+TEST(WalletTests, AvailableCoinsFollowsSpendsAndNewKeys) {
+    TestWallet wallet;
+    CKey key, key2;
+    key.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    wallet.AddKey(key);
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 5 * COIN;
+    mtx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    CWalletTx wtx(&wallet, mtx);
+    wallet.AddToWallet(wtx, true, NULL);
+
+    std::vector<COutput> vCoins;
+    wallet.AvailableCoins(vCoins, false);
+    ASSERT_EQ(1, vCoins.size());
+    EXPECT_EQ(wtx.GetHash(), vCoins[0].tx->GetHash());
+
+    // an unconfirmed spend of the coin
+    CMutableTransaction mtxSpend;
+    mtxSpend.vin.resize(1);
+    mtxSpend.vin[0].prevout = COutPoint(wtx.GetHash(), 0);
+    mtxSpend.vout.resize(1);
+    mtxSpend.vout[0].nValue = 4 * COIN;
+    mtxSpend.vout[0].scriptPubKey = GetScriptForDestination(key2.GetPubKey().GetID());
+    CWalletTx wtxSpend(&wallet, mtxSpend);
+    wallet.AddToWallet(wtxSpend, true, NULL);
+    wallet.AvailableCoins(vCoins, false);
+    EXPECT_EQ(0, vCoins.size());
+
+    // the output of the spend becomes ours with its key
+    wallet.AddKey(key2);
+    wallet.MarkDirty();
+    wallet.AvailableCoins(vCoins, false);
+    ASSERT_EQ(1, vCoins.size());
+    EXPECT_EQ(wtxSpend.GetHash(), vCoins[0].tx->GetHash());
+}
@@ -783,21 +783,19 @@ UniValue regnode(const UniValue& params, bool fHelp, const CPubKey& mypk)
         std::string safeheight =  GetArg("-safeheight", "");
                   
         // check for active safenode registration
+        std::vector<unsigned char> vsk = ParseHex(sk);
         pthread_mutex_lock(&SAFECOIN_KV_mutex);
         struct safecoin_kv *s;
         int latest_reg_found = 0;
         
-        for(s = SAFECOIN_KV; s != NULL; s = (safecoin_kv*)s->hh.next)
+        for(s = SAFECOIN_KV; s != NULL && vsk.size() == 33; s = (safecoin_kv*)s->hh.next)
         {
             int32_t saved_on_height = s->height;
-            uint8_t *value_ptr = s->value;
-            uint16_t value_size = s->valuesize;
             
             // skip checking against records with invalid safeid size or height too much in the past
-            if (value_size == 66 && (current_height - saved_on_height <= REGISTRATION_TRIGGER_DAYS * 1440)) // check whole REGISTRATION_TRIGGER_DAYS window
+            if (s->hassafekey != 0 && (current_height - saved_on_height <= REGISTRATION_TRIGGER_DAYS * 1440)) // check whole REGISTRATION_TRIGGER_DAYS window
             {
-                std::string str_saved_safeid = std::string((char*)value_ptr, (int)value_size);
-                if (sk == str_saved_safeid)
+                if (memcmp(s->safekey33, &vsk[0], 33) == 0)
                 {
                     // previous registration found within the search range
                     if (saved_on_height > latest_reg_found)
@@ -1495,7 +1493,7 @@ UniValue movecmd(const UniValue& params, bool fHelp, const CPubKey& mypk)
     debit.nTime = nNow;
     debit.strOtherAccount = strTo;
     debit.strComment = strComment;
-    walletdb.WriteAccountingEntry(debit);
+    pwalletMain->AddAccountingEntry(debit, walletdb);
 
     // Credit
     CAccountingEntry credit;
@@ -1505,7 +1503,7 @@ UniValue movecmd(const UniValue& params, bool fHelp, const CPubKey& mypk)
     credit.nTime = nNow;
     credit.strOtherAccount = strFrom;
     credit.strComment = strComment;
-    walletdb.WriteAccountingEntry(credit);
+    pwalletMain->AddAccountingEntry(credit, walletdb);
 
     if (!walletdb.TxnCommit())
         throw JSONRPCError(RPC_DATABASE_ERROR, "database error");
@@ -2081,15 +2079,18 @@ UniValue listtransactions(const UniValue& params, bool fHelp, const CPubKey& myp
     if (!EnsureWalletIsAvailable(fHelp))
         return NullUniValue;
 
-    if (fHelp || params.size() > 4)
+    if (fHelp || params.size() > 5)
         throw runtime_error(
-            "listtransactions ( \"account\" count from includeWatchonly)\n"
+            "listtransactions ( \"account\" count from includeWatchonly cursor)\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account 'account'.\n"
             "\nArguments:\n"
             "1. \"account\"    (string, optional) DEPRECATED. The account name. Should be \"*\".\n"
             "2. count          (numeric, optional, default=10) The number of transactions to return\n"
             "3. from           (numeric, optional, default=0) The number of transactions to skip\n"
             "4. includeWatchonly (bool, optional, default=false) Include transactions to watchonly addresses (see 'importaddress')\n"
+            "5. cursor         (numeric, optional) Only return transactions older than this orderpos, instead of skipping 'from' of them.\n"
+            "                  Pass the smallest orderpos of a page to get the next one. Such a page keeps every entry of its oldest\n"
+            "                  transaction, so it can be longer than 'count'\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -2122,6 +2123,7 @@ UniValue listtransactions(const UniValue& params, bool fHelp, const CPubKey& myp
             "                                          from (for receiving funds, positive amounts), or went to (for sending funds,\n"
             "                                          negative amounts).\n"
             "    \"size\": n,                (numeric) Transaction size in bytes\n"
+            "    \"orderpos\": n,            (numeric) The position of the transaction in the wallet, for the cursor argument\n"
             "  }\n"
             "]\n"
 
@@ -2154,24 +2156,37 @@ UniValue listtransactions(const UniValue& params, bool fHelp, const CPubKey& myp
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
+    int64_t nCursor = -1;
+    if (params.size() > 4)
+    {
+        nCursor = params[4].get_int64();
+        if (nCursor < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative cursor");
+        if (nFrom > 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "from cannot be used with a cursor");
+    }
 
     UniValue ret(UniValue::VARR);
 
-    std::list<CAccountingEntry> acentries;
-    CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
-
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+    // iterate backwards from the newest entry or the one below the cursor until we have nCount items to return,
+    // wtxOrdered is kept in order so this is as long as the page and does not depend on the size of the wallet
+    const CWallet::TxItems& txOrdered = pwalletMain->wtxOrdered;
+    CWallet::TxItems::const_reverse_iterator it = nCursor >= 0 ? CWallet::TxItems::const_reverse_iterator(txOrdered.lower_bound(nCursor)) : txOrdered.rbegin();
+    for (; nCount > 0 && it != txOrdered.rend(); ++it)
     {
+        UniValue entries(UniValue::VARR);
         CWalletTx *const pwtx = (*it).second.first;
         if (pwtx != 0)
-        {
-            //fprintf(stderr,"pwtx iter.%d %s\n",(int32_t)pwtx->nOrderPos,pwtx->GetHash().GetHex().c_str());
-            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
-        } //else fprintf(stderr,"null pwtx\n");
+            ListTransactions(*pwtx, strAccount, 0, true, entries, filter);
         CAccountingEntry *const pacentry = (*it).second.second;
         if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
+            AcentryToJSON(*pacentry, strAccount, entries);
+        BOOST_FOREACH(const UniValue& entry, entries.getValues())
+        {
+            UniValue orderedEntry = entry;
+            orderedEntry.push_back(Pair("orderpos", (*it).first));
+            ret.push_back(orderedEntry);
+        }
 
         if ((int)ret.size() >= (nCount+nFrom)) break;
     }
@@ -2179,7 +2194,7 @@ UniValue listtransactions(const UniValue& params, bool fHelp, const CPubKey& myp
 
     if (nFrom > (int)ret.size())
         nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
+    if ((nFrom + nCount) > (int)ret.size() || nCursor >= 0)
         nCount = ret.size() - nFrom;
 
     vector<UniValue> arrTmp = ret.getValues();
@@ -2972,6 +2987,64 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return obj;
 }
 
+UniValue getconsolidationinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getconsolidationinfo\n"
+            "Returns the -consolidatedust policy and what it has swept since startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,      (boolean) whether dust utxos are swept as blocks connect\n"
+            "  \"threshold\": x.xxxx,        (numeric) utxos smaller than this are swept, in " + CURRENCY_UNIT + "\n"
+            "  \"maxfee\": x.xxxx,           (numeric) the most fee a sweep pays, in " + CURRENCY_UNIT + "\n"
+            "  \"dustutxos\": xxxx,          (numeric) how many confirmed utxos are below the threshold now\n"
+            "  \"mininputs\": xxxx,          (numeric) how many of them it takes for a sweep\n"
+            "  \"sweeps\": xxxx,             (numeric) how many sweeps were sent since startup\n"
+            "  \"inputs\": xxxx,             (numeric) how many utxos those swept\n"
+            "  \"lastheight\": xxxx,         (numeric) the height of the last sweep\n"
+            "  \"lasttxid\": \"txid\",         (string) the last sweep\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getconsolidationinfo", "")
+            + HelpExampleRpc("getconsolidationinfo", "")
+        );
+
+    CAmount nThreshold = DEFAULT_CONSOLIDATE_DUST_THRESHOLD;
+    if (mapArgs.count("-consolidatedustthreshold"))
+        ParseMoney(mapArgs["-consolidatedustthreshold"], nThreshold);
+    CAmount nMaxFee = DEFAULT_CONSOLIDATE_MAX_FEE;
+    if (mapArgs.count("-consolidatemaxfee"))
+        ParseMoney(mapArgs["-consolidatemaxfee"], nMaxFee);
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    std::vector<COutput> vCoins;
+    pwalletMain->AvailableCoins(vCoins, true, NULL, false, false);
+    int nDust = 0;
+    BOOST_FOREACH(const COutput& out, vCoins)
+    {
+        if (out.fSpendable && out.tx->vout[out.i].nValue < nThreshold)
+            nDust++;
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("enabled",    GetBoolArg("-consolidatedust", DEFAULT_CONSOLIDATE_DUST)));
+    obj.push_back(Pair("threshold",  ValueFromAmount(nThreshold)));
+    obj.push_back(Pair("maxfee",     ValueFromAmount(nMaxFee)));
+    obj.push_back(Pair("dustutxos",  nDust));
+    obj.push_back(Pair("mininputs",  (int)CONSOLIDATE_DUST_MIN_INPUTS));
+    obj.push_back(Pair("sweeps",     pwalletMain->nConsolidateSweeps));
+    obj.push_back(Pair("inputs",     pwalletMain->nConsolidateInputs));
+    obj.push_back(Pair("lastheight", pwalletMain->nConsolidateHeight));
+    if (!pwalletMain->hashConsolidateTx.IsNull())
+        obj.push_back(Pair("lasttxid", pwalletMain->hashConsolidateTx.GetHex()));
+    return obj;
+}
+
 UniValue resendwallettransactions(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -3134,6 +3207,9 @@ UniValue listunspent(const UniValue& params, bool fHelp, const CPubKey& mypk)
                 //interest = safecoin_interest(txheight,nValue,out.tx->nLockTime,tipindex->nTime);
                 entry.push_back(Pair("interest",ValueFromAmount(interest)));
             }
+            // the wallet tx already knows its block, no need to load it again for the height
+            if ( txheight == 0 && (it= mapBlockIndex.find(out.tx->hashBlock)) != mapBlockIndex.end() && it->second != 0 )
+                txheight = it->second->GetHeight();
             //fprintf(stderr,"nValue %.8f pindex.%p tipindex.%p locktime.%u txheight.%d pindexht.%d\n",(double)nValue/COIN,pindex,chainActive.LastTip(),locktime,txheight,pindex->GetHeight());
         }
         else if ( chainActive.LastTip() != 0 )
@@ -3494,6 +3570,9 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
     std::vector<double> sample_times;
 
+    // so -lazyzcparams does not add the parameter loading to the first sample
+    ZCEnsureParamsLoaded();
+
     JSDescription samplejoinsplit;
 
     if (benchmarktype == "verifyjoinsplit") {
@@ -3569,6 +3648,36 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
             sample_times.push_back(benchmark_verify_sapling_spend());
         } else if (benchmarktype == "verifysaplingoutput") {
             sample_times.push_back(benchmark_verify_sapling_output());
+        } else if (benchmarktype == "kvsearch") {
+            sample_times.push_back(benchmark_kvsearch());
+        } else if (benchmarktype == "getregistrationinfo") {
+            sample_times.push_back(benchmark_getregistrationinfo(params.size() >= 3 ? params[2].get_str() : ""));
+        } else if (benchmarktype == "getactivenodes") {
+            sample_times.push_back(benchmark_getactivenodes());
+        } else if (benchmarktype == "safeids") {
+            int nWidth = 100;
+            if (params.size() >= 3) {
+                nWidth = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_safeids(nWidth));
+        } else if (benchmarktype == "eligiblenotary") {
+            sample_times.push_back(benchmark_eligiblenotary());
+        } else if (benchmarktype == "staked") {
+            sample_times.push_back(benchmark_staked());
+        } else if (benchmarktype == "nspvaddressutxos") {
+            if (params.size() < 3) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Benchmark needs an address");
+            }
+            bool isCC = params.size() >= 4 && params[3].get_int() != 0;
+            sample_times.push_back(benchmark_nspv_getaddressutxos(params[2].get_str(), isCC));
+        } else if (benchmarktype == "snapshot") {
+            sample_times.push_back(benchmark_snapshot());
+        } else if (benchmarktype == "replayblocks") {
+            int nBlocks = 100;
+            if (params.size() >= 3) {
+                nBlocks = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_replayblocks(nBlocks));
         } else {
             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid benchmarktype");
         }
@@ -4859,7 +4968,7 @@ UniValue z_sendmany(const UniValue& params, bool fHelp, const CPubKey& mypk)
         }
     }
     CTransaction tx(mtx);
-    txsize += GetSerializeSize(tx, SER_NETWORK, tx.nVersion);
+    txsize += tx.GetTotalSize();
     if (fromTaddr) {
         txsize += CTXIN_SPEND_DUST_SIZE;
         txsize += CTXOUT_REGULAR_SIZE;      // There will probably be taddr change
@@ -5659,6 +5768,43 @@ UniValue z_listoperationids(const UniValue& params, bool fHelp, const CPubKey& m
     return ret;
 }
 
+UniValue z_setoperationpriority(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "z_setoperationpriority \"operationid\" \"priority\"\n"
+            "\nMoves an operation that has not started yet to the end of another priority class.\n"
+            "Waiting operations of a higher class are started first.\n"
+            "\nArguments:\n"
+            "1. \"operationid\"    (string, required) The operation id\n"
+            "2. \"priority\"       (string, required) \"high\", \"normal\" or \"low\"; operations are added as \"normal\"\n"
+            "\nResult:\n"
+            "true|false          (boolean) false if the operation is not waiting any more\n"
+            "\nExamples:\n"
+            + HelpExampleCli("z_setoperationpriority", "\"operationid\" \"high\"")
+            + HelpExampleRpc("z_setoperationpriority", "\"operationid\", \"high\"")
+        );
+
+    std::string strPriority = params[1].get_str();
+    AsyncRPCPriority priority;
+    if (strPriority == "high")
+        priority = ASYNC_RPC_PRIORITY_HIGH;
+    else if (strPriority == "normal")
+        priority = ASYNC_RPC_PRIORITY_NORMAL;
+    else if (strPriority == "low")
+        priority = ASYNC_RPC_PRIORITY_LOW;
+    else
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid priority, should be high, normal or low");
+
+    std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
+    if (!q->getOperationForId(params[0].get_str()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "No operation with this id");
+    return q->setOperationPriority(params[0].get_str(), priority);
+}
+
 
 #include "script/sign.h"
 int32_t decode_hex(uint8_t *bytes,int32_t n,char *hex);
@@ -6174,8 +6320,7 @@ UniValue payments_info(const UniValue& params, bool fHelp, const CPubKey& mypk)
         throw runtime_error("paymentsinfo \"[%22createtxid%22]\"\n");
     if ( ensure_CCrequirements(EVAL_PAYMENTS) < 0 )
         throw runtime_error(CC_REQUIREMENTS_MSG);
-    const CKeyStore& keystore = *pwalletMain;
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    // read-only, the CC lookups take what locks they need
     cp = CCinit(&C,EVAL_PAYMENTS);
     return(PaymentsInfo(cp,(char *)params[0].get_str().c_str()));
 }
@@ -6187,8 +6332,7 @@ UniValue payments_list(const UniValue& params, bool fHelp, const CPubKey& mypk)
         throw runtime_error("paymentslist\n");
     if ( ensure_CCrequirements(EVAL_PAYMENTS) < 0 )
         throw runtime_error(CC_REQUIREMENTS_MSG);
-    const CKeyStore& keystore = *pwalletMain;
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    // read-only, the CC lookups take what locks they need
     cp = CCinit(&C,EVAL_PAYMENTS);
     return(PaymentsList(cp,(char *)""));
 }
@@ -6526,8 +6670,7 @@ UniValue marmara_info(const UniValue& params, bool fHelp, const CPubKey& mypk)
     }
     if ( ensure_CCrequirements(EVAL_MARMARA) < 0 )
         throw runtime_error(CC_REQUIREMENTS_MSG);
-    const CKeyStore& keystore = *pwalletMain;
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    // read-only, the CC lookups take what locks they need
     firstheight = atol(params[0].get_str().c_str());
     lastheight = atol(params[1].get_str().c_str());
     minamount = atof(params[2].get_str().c_str()) * COIN + 0.00000000499999;
@@ -6558,8 +6701,7 @@ UniValue marmara_creditloop(const UniValue& params, bool fHelp, const CPubKey& m
     }
     if ( ensure_CCrequirements(EVAL_MARMARA) < 0 )
         throw runtime_error(CC_REQUIREMENTS_MSG);
-    const CKeyStore& keystore = *pwalletMain;
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    // read-only, the CC lookups take what locks they need
     txid = Parseuint256((char *)params[0].get_str().c_str());
     result = MarmaraCreditloop(txid);
     return(result);
@@ -6880,8 +7022,7 @@ UniValue rewardslist(const UniValue& params, bool fHelp, const CPubKey& mypk)
         throw runtime_error("rewardslist\n");
     if ( ensure_CCrequirements(EVAL_REWARDS) < 0 )
         throw runtime_error(CC_REQUIREMENTS_MSG);
-    const CKeyStore& keystore = *pwalletMain;
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    // read-only, the CC lookups take what locks they need
     return(RewardsList());
 }
 
@@ -6892,8 +7033,7 @@ UniValue rewardsinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
         throw runtime_error("rewardsinfo fundingtxid\n");
     if ( ensure_CCrequirements(EVAL_REWARDS) < 0 )
         throw runtime_error(CC_REQUIREMENTS_MSG);
-    const CKeyStore& keystore = *pwalletMain;
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    // read-only, the CC lookups take what locks they need
     fundingtxid = Parseuint256((char *)params[0].get_str().c_str());
     return(RewardsInfo(fundingtxid));
 }
@@ -0,0 +1,106 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakingset.h"
+
+#include "base58.h"
+#include "crypto/sha256.h"
+#include "main.h"
+#include "wallet/wallet.h"
+
+#include <boost/foreach.hpp>
+
+CStakingSet stakingSet;
+
+// caller holds cs
+bool CStakingSet::Add(const CTransaction& tx, uint32_t vout, uint32_t txtime)
+{
+    CTxDestination dest;
+    const CTxOut& txout = tx.vout[vout];
+    if (txout.nValue < COIN || !ExtractDestination(txout.scriptPubKey, dest))
+        return false;
+    if ((::IsMine(*pwallet, dest) & ISMINE_SPENDABLE) == ISMINE_NO)
+        return false;
+
+    CStakingCandidate candidate;
+    candidate.txid = tx.GetHash();
+    candidate.vout = vout;
+    candidate.nValue = txout.nValue;
+    candidate.txtime = txtime;
+    candidate.address = CBitcoinAddress(dest).ToString();
+    CSHA256().Write((const unsigned char*)candidate.address.data(), candidate.address.size()).Finalize(candidate.addrhash.begin());
+    candidate.scriptPubKey = txout.scriptPubKey;
+    mapCandidates[COutPoint(candidate.txid, vout)] = candidate;
+    return true;
+}
+
+void CStakingSet::Load(CWallet *pwalletIn)
+{
+    std::vector<COutput> vecOutputs;
+    pwalletIn->AvailableCoins(vecOutputs, false, NULL, true);
+
+    LOCK(cs);
+    pwallet = pwalletIn;
+    mapCandidates.clear();
+    for (std::vector<COutput>::const_iterator it = vecOutputs.begin(); it != vecOutputs.end(); ++it) {
+        if (it->nDepth < 1 || !it->fSpendable)
+            continue;
+        BlockMap::const_iterator mi = mapBlockIndex.find(it->tx->hashBlock);
+        if (mi == mapBlockIndex.end() || mi->second == NULL)
+            continue;
+        Add(*it->tx, it->i, mi->second->nTime);
+    }
+    fLoaded = true;
+}
+
+void CStakingSet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    LOCK(cs);
+    if (!fLoaded)
+        return;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        mapCandidates.erase(txin.prevout);
+    if (pblock == NULL) {
+        // unconfirmed again, or only in the mempool
+        for (uint32_t i = 0; i < tx.vout.size(); i++)
+            mapCandidates.erase(COutPoint(tx.GetHash(), i));
+        return;
+    }
+    // coinbase outputs are immature here, the next Load() picks them up
+    if (tx.IsCoinBase())
+        return;
+    for (uint32_t i = 0; i < tx.vout.size(); i++)
+        Add(tx, i, pblock->nTime);
+}
+
+void CStakingSet::ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added)
+{
+    if (added)
+        return;
+    // outputs spent by the disconnected block are spendable again, the staker reloads
+    LOCK(cs);
+    fLoaded = false;
+    mapCandidates.clear();
+}
+
+bool CStakingSet::IsLoaded() const
+{
+    LOCK(cs);
+    return fLoaded;
+}
+
+void CStakingSet::GetCandidates(std::vector<CStakingCandidate>& vCandidates) const
+{
+    LOCK(cs);
+    vCandidates.clear();
+    vCandidates.reserve(mapCandidates.size());
+    for (std::map<COutPoint, CStakingCandidate>::const_iterator it = mapCandidates.begin(); it != mapCandidates.end(); ++it)
+        vCandidates.push_back(it->second);
+}
+
+size_t CStakingSet::Size() const
+{
+    LOCK(cs);
+    return mapCandidates.size();
+}
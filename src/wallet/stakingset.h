@@ -0,0 +1,72 @@
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SAFECOIN_WALLET_STAKINGSET_H
+#define SAFECOIN_WALLET_STAKINGSET_H
+
+#include "amount.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "sync.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CWallet;
+
+/** A wallet output that can stake, with everything the stake check reads about it precomputed */
+struct CStakingCandidate
+{
+    uint256 txid;
+    int32_t vout;
+    CAmount nValue;
+    uint32_t txtime;        //! time of the block that confirmed the output
+    std::string address;
+    uint256 addrhash;       //! sha256 of address, hashed into every stake hash of this output
+    CScript scriptPubKey;
+
+    CStakingCandidate() : vout(0), nValue(0), txtime(0) {}
+};
+
+/**
+ * The wallet's staking candidates, kept in step with the chain through the
+ * validation interface instead of being rebuilt from AvailableCoins() for
+ * every staking round. Confirmed outputs are added and spent ones removed as
+ * transactions come in. Anything the notifications cannot follow exactly
+ * (disconnected tips, conflicted transactions, maturing coinbases) is left to
+ * the next Load(), which the staker only needs to run now and then.
+ */
+class CStakingSet : public CValidationInterface
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<COutPoint, CStakingCandidate> mapCandidates;
+    CWallet *pwallet;
+    bool fLoaded;
+
+    bool Add(const CTransaction& tx, uint32_t vout, uint32_t txtime);
+
+protected:
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added);
+
+public:
+    CStakingSet() : pwallet(NULL), fLoaded(false) {}
+
+    /** Rebuild from the available coins of pwalletIn. Caller holds cs_main and pwalletIn->cs_wallet */
+    void Load(CWallet *pwalletIn);
+    /** False until the first Load() and again after a tip was disconnected */
+    bool IsLoaded() const;
+    /** Copy of every candidate, so the staker can loop without holding any lock */
+    void GetCandidates(std::vector<CStakingCandidate>& vCandidates) const;
+    size_t Size() const;
+};
+
+extern CStakingSet stakingSet;
+
+#endif // SAFECOIN_WALLET_STAKINGSET_H
@@ -0,0 +1,86 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Copyright (c) 2018-2020 Safecoin
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/coinselection.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coinselection_tests, BasicTestingSetup)
+
+static std::vector<CInputCoin> MakeCoins(const std::vector<CAmount>& vValues, CAmount nFee = 0)
+{
+    std::vector<CInputCoin> vCoins;
+    for (CAmount nValue : vValues)
+        vCoins.push_back(CInputCoin(nValue * CENT, nFee));
+    return vCoins;
+}
+
+BOOST_AUTO_TEST_CASE(bnb_exact_match)
+{
+    std::vector<CInputCoin> vCoins = MakeCoins({1, 2, 3, 4});
+    std::vector<size_t> vSelected;
+    CAmount nValueRet = 0;
+
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 1 * CENT, 0, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 1 * CENT);
+    BOOST_CHECK_EQUAL(vSelected.size(), 1U);
+    BOOST_CHECK_EQUAL(vSelected[0], 0U);
+
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 7 * CENT, 0, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 7 * CENT);
+
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 10 * CENT, 0, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 10 * CENT);
+    BOOST_CHECK_EQUAL(vSelected.size(), 4U);
+}
+
+BOOST_AUTO_TEST_CASE(bnb_no_match)
+{
+    std::vector<CInputCoin> vCoins = MakeCoins({2, 4, 6});
+    std::vector<size_t> vSelected;
+    CAmount nValueRet = 0;
+
+    // odd targets cannot be hit exactly, nor more than there is
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 3 * CENT, 0, vSelected, nValueRet));
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 13 * CENT, 0, vSelected, nValueRet));
+    BOOST_CHECK(!SelectCoinsBnB(std::vector<CInputCoin>(), 1 * CENT, 0, vSelected, nValueRet));
+
+    // unless the excess is within the cost of change
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 3 * CENT, 1 * CENT, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 4 * CENT);
+}
+
+BOOST_AUTO_TEST_CASE(bnb_least_excess)
+{
+    std::vector<CInputCoin> vCoins = MakeCoins({5, 9, 10});
+    std::vector<size_t> vSelected;
+    CAmount nValueRet = 0;
+
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 8 * CENT, 3 * CENT, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 9 * CENT);
+    BOOST_CHECK_EQUAL(vSelected.size(), 1U);
+    BOOST_CHECK_EQUAL(vSelected[0], 1U);
+}
+
+BOOST_AUTO_TEST_CASE(bnb_effective_value)
+{
+    // with the fee of spending each coin taken off, two coins fall short of the target
+    std::vector<CInputCoin> vCoins = MakeCoins({1, 1, 1}, CENT / 10);
+    std::vector<size_t> vSelected;
+    CAmount nValueRet = 0;
+
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 2 * CENT, 0, vSelected, nValueRet));
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 2 * CENT, CENT, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(vSelected.size(), 3U);
+    BOOST_CHECK_EQUAL(nValueRet, 3 * CENT);
+
+    // a coin worth no more than its fee is never selected
+    vCoins = MakeCoins({1}, CENT);
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 1, CENT, vSelected, nValueRet));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
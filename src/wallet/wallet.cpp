@@ -20,6 +20,7 @@
  ******************************************************************************/
 
 #include "wallet/wallet.h"
+#include "wallet/coinselection.h"
 
 #include "checkpoints.h"
 #include "coincontrol.h"
@@ -42,6 +43,7 @@
 #include "cc/CCinclude.h"
 
 #include <assert.h>
+#include <atomic>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -63,6 +65,7 @@ bool fPayAtLeastCustomFee = true;
 
 CBlockIndex *safecoin_chainactive(int32_t height);
 extern std::string DONATION_PUBKEY;
+uint32_t safecoin_segid32(char *coinaddr);
 int32_t safecoin_dpowconfs(int32_t height,int32_t numconfs);
 int tx_height( const uint256 &hash );
 
@@ -86,6 +89,25 @@ struct CompareValueOnly
     }
 };
 
+/**
+ * Call fn(i) for each i in [0, n), spread over up to nThreads threads, the
+ * calling one included. Items are taken in order from a shared counter.
+ */
+template<typename Fn>
+static void ParallelFor(size_t n, int nThreads, const Fn& fn)
+{
+    std::atomic<size_t> nNext(0);
+    auto worker = [&]() {
+        for (size_t i = nNext++; i < n; i = nNext++)
+            fn(i);
+    };
+    boost::thread_group threadGroup;
+    for (size_t i = 1; i < std::min<size_t>(std::max(nThreads, 1), n); i++)
+        threadGroup.create_thread(worker);
+    worker();
+    threadGroup.join_all();
+}
+
 std::string JSOutPoint::ToString() const
 {
     return strprintf("JSOutPoint(%s, %d, %d)", hash.ToString().substr(0,10), js, n);
@@ -651,17 +673,27 @@ void CWallet::ChainTip(const CBlockIndex *pindex,
         IncrementNoteWitnesses(pindex, pblock, sproutTree, saplingTree);
         
         CheckNodeReg(pindex); // checks safenode registration and triggers renewal if required
+        if (GetBoolArg("-consolidatedust", DEFAULT_CONSOLIDATE_DUST) && !IsInitialBlockDownload())
+            ConsolidateDust(pindex->GetHeight());
 
+        // every transaction of the block has been synced by now
+        LOCK(cs_wallet);
+        mapSaplingNotesBlock.clear();
+        hashSaplingNotesBlock.SetNull();
     }
     else
     {
         DecrementNoteWitnesses(pindex);
+        // spends confirmed in the block are unconfirmed again
+        LOCK(cs_wallet);
+        fUnspentTxDirty = true;
     }
     UpdateSaplingNullifierNoteMapForBlock(pblock);
 }
 
 void CWallet::SetBestChain(const CBlockLocator& loc)
 {
+    FlushPendingTxWrites();
     CWalletDB walletdb(strWalletFile);
     SetBestChainINTERNAL(walletdb, loc);
 }
@@ -841,9 +873,45 @@ set<uint256> CWallet::GetConflicts(const uint256& txid) const
 
 void CWallet::Flush(bool shutdown)
 {
+    FlushPendingTxWrites();
     bitdb.Flush(shutdown);
 }
 
+bool CWallet::FlushPendingTxWrites()
+{
+    LOCK(cs_wallet);
+    if (setPendingTxWrites.empty())
+        return true;
+    if (!fFileBacked) {
+        setPendingTxWrites.clear();
+        return true;
+    }
+
+    // Do not flush the wallet here for performance reasons
+    CWalletDB walletdb(strWalletFile, "r+", false);
+    if (!walletdb.TxnBegin()) {
+        LogPrintf("FlushPendingTxWrites(): Couldn't start atomic write\n");
+        return false;
+    }
+    for (const uint256& hash : setPendingTxWrites) {
+        // erased since, or written out directly, which is no harm to repeat
+        std::map<uint256, CWalletTx>::iterator it = mapWallet.find(hash);
+        if (it != mapWallet.end() && !it->second.WriteToDisk(&walletdb)) {
+            LogPrintf("FlushPendingTxWrites(): Failed to write %s, aborting atomic write\n", hash.ToString());
+            walletdb.TxnAbort();
+            return false;
+        }
+    }
+    if (!walletdb.WriteOrderPosNext(nOrderPosNext) || !walletdb.TxnCommit()) {
+        LogPrintf("FlushPendingTxWrites(): Couldn't commit atomic write\n");
+        walletdb.TxnAbort();
+        return false;
+    }
+    LogPrint("db", "FlushPendingTxWrites(): wrote %u wallet transactions\n", setPendingTxWrites.size());
+    setPendingTxWrites.clear();
+    return true;
+}
+
 bool CWallet::Verify(const string& walletFile, string& warningString, string& errorString)
 {
     if (!bitdb.Open(GetDataDir()))
@@ -984,6 +1052,54 @@ bool CWallet::IsSaplingSpent(const uint256& nullifier) const {
     return false;
 }
 
+/**
+ * Whether the transaction has an output of ours that no confirmed wallet
+ * transaction spends.
+ */
+bool CWallet::HasUnconfirmedSpendOutput(const CWalletTx& wtx) const
+{
+    const uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsMine(wtx.vout[i]) == ISMINE_NO)
+            continue;
+        bool fConfirmedSpend = false;
+        pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(COutPoint(hash, i));
+        for (TxSpends::const_iterator it = range.first; it != range.second && !fConfirmedSpend; ++it) {
+            std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+            fConfirmedSpend = mit != mapWallet.end() && mit->second.GetDepthInMainChain() > 0;
+        }
+        if (!fConfirmedSpend)
+            return true;
+    }
+    return false;
+}
+
+// caller holds cs_wallet
+void CWallet::UpdateUnspentTx(const uint256& hash)
+{
+    if (fUnspentTxDirty)
+        return;
+    std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+    if (it != mapWallet.end() && HasUnconfirmedSpendOutput(it->second))
+        setUnspentTx.insert(hash);
+    else
+        setUnspentTx.erase(hash);
+}
+
+const std::set<uint256>& CWallet::GetUnspentTx() const
+{
+    AssertLockHeld(cs_wallet);
+    if (fUnspentTxDirty) {
+        setUnspentTx.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+            if (HasUnconfirmedSpendOutput(it->second))
+                setUnspentTx.insert(it->first);
+        }
+        fUnspentTxDirty = false;
+    }
+    return setUnspentTx;
+}
+
 void CWallet::AddToTransparentSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
@@ -1075,22 +1191,52 @@ void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nW
     }
 }
 
-template<typename NoteDataMap>
-void AppendNoteCommitment(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const uint256& note_commitment)
+/** Commitments appended per thread before IncrementNoteWitnesses uses more than one */
+static const size_t WITNESS_APPENDS_PER_THREAD = 256;
+
+/**
+ * Queue the witnesses of noteDataMap that a block's commitments are appended to,
+ * with the index of the first commitment each takes: 0, or for a note the block
+ * itself creates, the one after its own.
+ */
+template<typename OutPoint, typename NoteData, typename Witness>
+void QueueNoteCommitments(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize,
+                          const std::map<const NoteData*, size_t>& mapFirstCommitment, size_t nCommitments,
+                          std::vector<std::pair<Witness*, size_t> >& vWitnesses)
 {
     for (auto& item : noteDataMap) {
-        auto* nd = &(item.second);
+        NoteData* nd = &(item.second);
         if (nd->witnessHeight < indexHeight && nd->witnesses.size() > 0) {
             // Check the validity of the cache
             // See comment in CopyPreviousWitnesses about validity.
             assert(nWitnessCacheSize >= nd->witnesses.size());
-            nd->witnesses.front().append(note_commitment);
+            auto it = mapFirstCommitment.find(nd);
+            size_t nFirst = it == mapFirstCommitment.end() ? 0 : it->second;
+            if (nFirst < nCommitments)
+                vWitnesses.push_back(std::make_pair(&nd->witnesses.front(), nFirst));
         }
     }
 }
 
+/**
+ * Append the queued commitments to each witness. Witnesses don't depend on each
+ * other, so with enough to do they are spread over the cores.
+ */
+template<typename Witness>
+void AppendNoteCommitments(const std::vector<std::pair<Witness*, size_t> >& vWitnesses, const std::vector<uint256>& vCommitments)
+{
+    size_t nAppends = 0;
+    for (const auto& item : vWitnesses)
+        nAppends += vCommitments.size() - item.second;
+    int nThreads = std::min<size_t>(GetNumCores(), 1 + nAppends / WITNESS_APPENDS_PER_THREAD);
+    ParallelFor(vWitnesses.size(), nThreads, [&](size_t i) {
+        for (size_t k = vWitnesses[i].second; k < vCommitments.size(); k++)
+            vWitnesses[i].first->append(vCommitments[k]);
+    });
+}
+
 template<typename OutPoint, typename NoteData, typename Witness>
-void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
+NoteData* WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
 {
     if (noteDataMap.count(key) && noteDataMap[key].witnessHeight < indexHeight) {
         auto* nd = &(noteDataMap[key]);
@@ -1116,7 +1262,9 @@ void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeigh
         nd->witnessHeight = indexHeight - 1;
         // Check the validity of the cache
         assert(nWitnessCacheSize >= nd->witnesses.size());
+        return nd;
     }
+    return NULL;
 }
 
 
@@ -1156,6 +1304,11 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
         pblock = &block;
     }
 
+    // Walk the block's commitments once, witnessing our new notes as they come,
+    // and remember from which commitment on each of those is to be appended to
+    std::vector<uint256> vSproutCommitments, vSaplingCommitments;
+    std::map<const SproutNoteData*, size_t> mapSproutFirstCommitment;
+    std::map<const SaplingNoteData*, size_t> mapSaplingFirstCommitment;
     for (const CTransaction& tx : pblock->vtx) {
         auto hash = tx.GetHash();
         bool txIsOurs = mapWallet.count(hash);
@@ -1165,16 +1318,14 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
             for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
                 const uint256& note_commitment = jsdesc.commitments[j];
                 sproutTree.append(note_commitment);
-
-                // Increment existing witnesses
-                for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                    ::AppendNoteCommitment(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, note_commitment);
-                }
+                vSproutCommitments.push_back(note_commitment);
 
                 // If this is our note, witness it
                 if (txIsOurs) {
                     JSOutPoint jsoutpt {hash, i, j};
-                    ::WitnessNoteIfMine(mapWallet[hash].mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, jsoutpt, sproutTree.witness());
+                    auto* nd = ::WitnessNoteIfMine(mapWallet[hash].mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, jsoutpt, sproutTree.witness());
+                    if (nd)
+                        mapSproutFirstCommitment[nd] = vSproutCommitments.size();
                 }
             }
         }
@@ -1182,20 +1333,30 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
         for (uint32_t i = 0; i < tx.vShieldedOutput.size(); i++) {
             const uint256& note_commitment = tx.vShieldedOutput[i].cm;
             saplingTree.append(note_commitment);
-
-            // Increment existing witnesses
-            for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                ::AppendNoteCommitment(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, note_commitment);
-            }
+            vSaplingCommitments.push_back(note_commitment);
 
             // If this is our note, witness it
             if (txIsOurs) {
                 SaplingOutPoint outPoint {hash, i};
-                ::WitnessNoteIfMine(mapWallet[hash].mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, outPoint, saplingTree.witness());
+                auto* nd = ::WitnessNoteIfMine(mapWallet[hash].mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, outPoint, saplingTree.witness());
+                if (nd)
+                    mapSaplingFirstCommitment[nd] = vSaplingCommitments.size();
             }
         }
     }
 
+    // Increment existing witnesses
+    std::vector<std::pair<SproutWitness*, size_t> > vSproutWitnesses;
+    std::vector<std::pair<SaplingWitness*, size_t> > vSaplingWitnesses;
+    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
+        ::QueueNoteCommitments(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize,
+                               mapSproutFirstCommitment, vSproutCommitments.size(), vSproutWitnesses);
+        ::QueueNoteCommitments(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize,
+                               mapSaplingFirstCommitment, vSaplingCommitments.size(), vSaplingWitnesses);
+    }
+    ::AppendNoteCommitments(vSproutWitnesses, vSproutCommitments);
+    ::AppendNoteCommitments(vSaplingWitnesses, vSaplingCommitments);
+
     // Update witness heights
     for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
         ::UpdateWitnessHeights(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize);
@@ -1384,30 +1545,32 @@ int64_t CWallet::IncOrderPosNext(CWalletDB *pwalletdb)
     return nRet;
 }
 
-CWallet::TxItems CWallet::OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount)
+void CWallet::EraseFromOrdered(const CWalletTx* pwtx)
 {
-    AssertLockHeld(cs_wallet); // mapWallet
-    CWalletDB walletdb(strWalletFile);
+    std::pair<TxItems::iterator, TxItems::iterator> range = wtxOrdered.equal_range(pwtx->nOrderPos);
+    for (TxItems::iterator it = range.first; it != range.second; ++it)
+        if (it->second.first == pwtx) {
+            wtxOrdered.erase(it);
+            return;
+        }
+}
 
-    // First: get all CWalletTx and CAccountingEntry into a sorted-by-order multimap.
-    TxItems txOrdered;
+bool CWallet::AddAccountingEntry(const CAccountingEntry& acentry, CWalletDB& walletdb)
+{
+    AssertLockHeld(cs_wallet); // wtxOrdered
+    CAccountingEntry entry = acentry;
+    if (!walletdb.WriteAccountingEntry(entry))
+        return false;
 
-    // Note: maintaining indices in the database of (account,time) --> txid and (account, time) --> acentry
-    // would make this much faster for applications that do this a lot.
-    for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        CWalletTx* wtx = &((*it).second);
-        txOrdered.insert(make_pair(wtx->nOrderPos, TxPair(wtx, (CAccountingEntry*)0)));
-        //fprintf(stderr,"ordered iter.%d %s\n",(int32_t)wtx->nOrderPos,wtx->GetHash().GetHex().c_str());
-    }
-    acentries.clear();
-    walletdb.ListAccountCreditDebit(strAccount, acentries);
-    BOOST_FOREACH(CAccountingEntry& entry, acentries)
-    {
-        txOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
-    }
+    LoadAccountingEntry(entry);
+    return true;
+}
 
-    return txOrdered;
+void CWallet::LoadAccountingEntry(const CAccountingEntry& acentry)
+{
+    laccentries.push_back(acentry);
+    CAccountingEntry& entry = laccentries.back();
+    wtxOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
 }
 
 // looks through all wallet UTXOs and checks to see if any qualify to stake the block at the current height. it always returns the qualified
@@ -1531,6 +1694,8 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        // called when outputs may have become ours
+        fUnspentTxDirty = true;
     }
 }
 
@@ -1663,10 +1828,15 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
 
     if (fFromLoadWallet)
     {
-        mapWallet[hash] = wtxIn;
-        mapWallet[hash].BindWallet(this);
-        UpdateNullifierNoteMapWithTx(mapWallet[hash]);
+        if (mapWallet.count(hash))
+            EraseFromOrdered(&mapWallet[hash]);
+        CWalletTx& wtx = mapWallet[hash];
+        wtx = wtxIn;
+        wtx.BindWallet(this);
+        wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
+        UpdateNullifierNoteMapWithTx(wtx);
         AddToSpends(hash);
+        fUnspentTxDirty = true;
     }
     else
     {
@@ -1681,6 +1851,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         {
             wtx.nTimeReceived = GetTime();
             wtx.nOrderPos = IncOrderPosNext(pwalletdb);
+            wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
 
             wtx.nTimeSmart = wtx.nTimeReceived;
             if (!wtxIn.hashBlock.IsNull())
@@ -1692,9 +1863,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
                     {
                         // Tolerate times up to the last timestamp in the wallet not more than 5 minutes into the future
                         int64_t latestTolerated = latestNow + 300;
-                        std::list<CAccountingEntry> acentries;
-                        TxItems txOrdered = OrderedTxItems(acentries);
-                        for (TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+                        for (TxItems::reverse_iterator it = wtxOrdered.rbegin(); it != wtxOrdered.rend(); ++it)
                         {
                             CWalletTx *const pwtx = (*it).second.first;
                             if (pwtx == &wtx)
@@ -1759,13 +1928,22 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
         // Write to disk
-        if (fInsertedNew || fUpdated)
-            if (!wtx.WriteToDisk(pwalletdb))
+        if (fInsertedNew || fUpdated) {
+            if (!pwalletdb)
+                setPendingTxWrites.insert(hash);
+            else if (!wtx.WriteToDisk(pwalletdb))
                 return false;
+        }
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
 
+        UpdateUnspentTx(hash);
+        if (!wtx.IsCoinBase() && wtx.GetDepthInMainChain() > 0) {
+            BOOST_FOREACH(const CTxIn& txin, wtx.vin)
+                UpdateUnspentTx(txin.prevout.hash);
+        }
+
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -1832,10 +2010,27 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
             return false;
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
-        auto sproutNoteData = FindMySproutNotes(tx);
-        auto saplingNoteDataAndAddressesToAdd = FindMySaplingNotes(tx);
-        auto saplingNoteData = saplingNoteDataAndAddressesToAdd.first;
-        auto addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
+        return AddToWalletIfInvolvingMe(tx, pblock, fUpdate, FindMySproutNotes(tx), FindMySaplingNotes(tx));
+    }
+}
+
+/**
+ * As above, with the trial decryption of the transaction's notes already done. This is
+ * the part that has to run in order, ScanForWalletTransactions decrypts ahead of it on
+ * other threads.
+ */
+bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate,
+                                       const mapSproutNoteData_t& sproutNoteData,
+                                       const std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>& saplingNoteDataAndAddressesToAdd)
+{
+    {
+        AssertLockHeld(cs_wallet);
+        if ( tx.IsCoinBase() && tx.vout[0].nValue == 0 )
+            return false;
+        bool fExisted = mapWallet.count(tx.GetHash()) != 0;
+        if (fExisted && !fUpdate) return false;
+        const auto& saplingNoteData = saplingNoteDataAndAddressesToAdd.first;
+        const auto& addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
         for (const auto &addressToAdd : addressesToAdd) {
             if (!AddSaplingIncomingViewingKey(addressToAdd.second, addressToAdd.first)) {
                 return false;
@@ -1899,10 +2094,13 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
             if (pblock)
                 wtx.SetMerkleBranch(*pblock);
 
-            // Do not flush the wallet here for performance reasons
-            // this is safe, as in case of a crash, we rescan the necessary blocks on startup through our SetBestChain-mechanism
-            CWalletDB walletdb(strWalletFile, "r+", false);
+            // Do not write the wallet here for performance reasons, a block's transactions are
+            // written together by FlushPendingTxWrites. This is safe, as in case of a crash, we
+            // rescan the necessary blocks on startup through our SetBestChain-mechanism
+            if (pblock)
+                return AddToWallet(wtx, false, NULL);
 
+            CWalletDB walletdb(strWalletFile, "r+", false);
             return AddToWallet(wtx, false, &walletdb);
         }
     }
@@ -1912,7 +2110,10 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
     LOCK(cs_wallet);
-    if (!AddToWalletIfInvolvingMe(tx, pblock, true))
+    if (pblock) {
+        if (!AddToWalletIfInvolvingMe(tx, pblock, true, FindMySproutNotes(tx), FindMySaplingNotesInBlock(tx, *pblock)))
+            return; // Not one of ours
+    } else if (!AddToWalletIfInvolvingMe(tx, pblock, true))
         return; // Not one of ours
 
     MarkAffectedTransactionsDirty(tx);
@@ -1952,8 +2153,19 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            EraseFromOrdered(&mi->second);
+            mapWallet.erase(mi);
             CWalletDB(strWalletFile).EraseTx(hash);
+            fUnspentTxDirty = true;
+            auto itSprout = mapSproutNotePlaintexts.lower_bound(JSOutPoint(hash, 0, 0));
+            while (itSprout != mapSproutNotePlaintexts.end() && itSprout->first.hash == hash)
+                itSprout = mapSproutNotePlaintexts.erase(itSprout);
+            auto itSapling = mapSaplingNoteEntries.lower_bound(SaplingOutPoint(hash, 0));
+            while (itSapling != mapSaplingNoteEntries.end() && itSapling->first.hash == hash)
+                itSapling = mapSaplingNoteEntries.erase(itSapling);
+        }
     }
     return;
 }
@@ -2009,13 +2221,22 @@ boost::optional<uint256> CWallet::GetSproutNoteNullifier(const JSDescription &js
 mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx) const
 {
     LOCK(cs_SpendingKeyStore);
+    return FindMySproutNotes(tx, mapNoteDecryptors);
+}
+
+/**
+ * As above, trying the given decryptors rather than the wallet's own, so that callers
+ * holding a copy can decrypt without cs_SpendingKeyStore held throughout.
+ */
+mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx, const NoteDecryptorMap &noteDecryptors) const
+{
     uint256 hash = tx.GetHash();
 
     mapSproutNoteData_t noteData;
     for (size_t i = 0; i < tx.vjoinsplit.size(); i++) {
         auto hSig = tx.vjoinsplit[i].h_sig(*pzcashParams, tx.joinSplitPubKey);
         for (uint8_t j = 0; j < tx.vjoinsplit[i].ciphertexts.size(); j++) {
-            for (const NoteDecryptorMap::value_type& item : mapNoteDecryptors) {
+            for (const NoteDecryptorMap::value_type& item : noteDecryptors) {
                 try {
                     auto address = item.first;
                     JSOutPoint jsoutpt {hash, i, j};
@@ -2046,6 +2267,90 @@ mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx) const
 }
 
 
+namespace {
+
+/**
+ * Trial decrypt every Sapling output of vtx on nThreads threads. Each distinct ivk is
+ * tried once per output, however many diversified addresses of it the wallet holds,
+ * those with a full viewing key first. With fewer outputs than threads the keys are
+ * split into ranges as well, so a lone output in a large wallet still uses them all.
+ *
+ * Protocol Spec: 4.19 Block Chain Scanning (Sapling)
+ */
+std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> > DecryptSaplingOutputs(
+    const std::vector<const CTransaction*>& vtx,
+    const SaplingFullViewingKeyMap& fullViewingKeys,
+    const SaplingIncomingViewingKeyMap& incomingViewingKeys,
+    int nThreads)
+{
+    std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> > ret(vtx.size());
+
+    std::vector<SaplingIncomingViewingKey> vIvks;
+    for (const auto& item : fullViewingKeys)
+        vIvks.push_back(item.first);
+    const size_t nFullViewingKeys = vIvks.size();
+    std::set<SaplingIncomingViewingKey> setIvkOnly;
+    for (const auto& item : incomingViewingKeys) {
+        if (!fullViewingKeys.count(item.second) && setIvkOnly.insert(item.second).second)
+            vIvks.push_back(item.second);
+    }
+
+    std::vector<std::pair<size_t, uint32_t> > vOutputs;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        for (uint32_t j = 0; j < vtx[i]->vShieldedOutput.size(); j++)
+            vOutputs.push_back(std::make_pair(i, j));
+    }
+    if (vOutputs.empty() || vIvks.empty())
+        return ret;
+
+    size_t nKeyRanges = std::min(vIvks.size(), std::max<size_t>(1, nThreads / vOutputs.size()));
+    const size_t nRangeSize = (vIvks.size() + nKeyRanges - 1) / nKeyRanges;
+    nKeyRanges = (vIvks.size() + nRangeSize - 1) / nRangeSize;
+
+    // One slot per output and key range, each written by the one thread that takes it
+    const size_t nItems = vOutputs.size() * nKeyRanges;
+    std::vector<size_t> vKeyFound(nItems, vIvks.size());
+    std::vector<boost::optional<SaplingPaymentAddress> > vAddressFound(nItems);
+    ParallelFor(nItems, nThreads, [&](size_t item) {
+        const auto& out = vOutputs[item / nKeyRanges];
+        const OutputDescription& output = vtx[out.first]->vShieldedOutput[out.second];
+        size_t nBegin = (item % nKeyRanges) * nRangeSize;
+        size_t nEnd = std::min(nBegin + nRangeSize, vIvks.size());
+        for (size_t k = nBegin; k < nEnd; k++) {
+            auto result = SaplingNotePlaintext::decrypt(output.encCiphertext, vIvks[k], output.ephemeralKey, output.cm);
+            if (result) {
+                vKeyFound[item] = k;
+                if (k < nFullViewingKeys)
+                    vAddressFound[item] = vIvks[k].address(result.get().d);
+                break;
+            }
+        }
+    });
+
+    for (size_t o = 0; o < vOutputs.size(); o++) {
+        for (size_t item = o * nKeyRanges; item < (o + 1) * nKeyRanges; item++) {
+            if (vKeyFound[item] == vIvks.size())
+                continue;
+            const SaplingIncomingViewingKey& ivk = vIvks[vKeyFound[item]];
+            auto& found = ret[vOutputs[o].first];
+            const auto& address = vAddressFound[item];
+            if (address && incomingViewingKeys.count(address.get()) == 0) {
+                found.second[address.get()] = ivk;
+            }
+            // We don't cache the nullifier here as computing it requires knowledge of the note position
+            // in the commitment tree, which can only be determined when the transaction has been mined.
+            SaplingOutPoint op {vtx[vOutputs[o].first]->GetHash(), vOutputs[o].second};
+            SaplingNoteData nd;
+            nd.ivk = ivk;
+            found.first.insert(std::make_pair(op, nd));
+            break;
+        }
+    }
+    return ret;
+}
+
+} // anon namespace
+
 /**
  * Finds all output notes in the given transaction that have been sent to
  * SaplingPaymentAddresses in this wallet.
@@ -2057,52 +2362,63 @@ mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx) const
 std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> CWallet::FindMySaplingNotes(const CTransaction &tx) const
 {
     LOCK(cs_SpendingKeyStore);
-    uint256 hash = tx.GetHash();
+    return FindMySaplingNotes(tx, mapSaplingFullViewingKeys, mapSaplingIncomingViewingKeys);
+}
 
-    mapSaplingNoteData_t noteData;
-    SaplingIncomingViewingKeyMap viewingKeysToAdd;
+/**
+ * As above, trying the given viewing keys rather than the wallet's own.
+ */
+std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> CWallet::FindMySaplingNotes(
+    const CTransaction &tx,
+    const SaplingFullViewingKeyMap &fullViewingKeys,
+    const SaplingIncomingViewingKeyMap &incomingViewingKeys) const
+{
+    return DecryptSaplingOutputs(std::vector<const CTransaction*>(1, &tx), fullViewingKeys, incomingViewingKeys, 1)[0];
+}
 
-    // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
-    for (uint32_t i = 0; i < tx.vShieldedOutput.size(); ++i) {
-        const OutputDescription output = tx.vShieldedOutput[i];
-        bool found = false;
-        for (auto it = mapSaplingFullViewingKeys.begin(); it != mapSaplingFullViewingKeys.end(); ++it) {
-            SaplingIncomingViewingKey ivk = it->first;
-            auto result = SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cm);
-            if (result) {
-                auto address = ivk.address(result.get().d);
-                if (address && mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
-                    viewingKeysToAdd[address.get()] = ivk;
-                }
-                // We don't cache the nullifier here as computing it requires knowledge of the note position
-                // in the commitment tree, which can only be determined when the transaction has been mined.
-                SaplingOutPoint op {hash, i};
-                SaplingNoteData nd;
-                nd.ivk = ivk;
-                noteData.insert(std::make_pair(op, nd));
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            for (auto it = mapSaplingIncomingViewingKeys.begin(); it != mapSaplingIncomingViewingKeys.end(); ++it) {
-                SaplingIncomingViewingKey ivk = it-> second;
-                auto result = SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cm);
-                if (!result) {
-                    continue;
-                }
-                // We don't cache the nullifier here as computing it requires knowledge of the note position
-                // in the commitment tree, which can only be determined when the transaction has been mined.
-                SaplingOutPoint op {hash, i};
-                SaplingNoteData nd;
-                nd.ivk = ivk;
-                noteData.insert(std::make_pair(op, nd));
-                break;
-            }
-        }
-    }
+/**
+ * As above for all of vtx at once, on nThreads threads.
+ */
+std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> > CWallet::FindMySaplingNotes(
+    const std::vector<CTransaction>& vtx,
+    int nThreads) const
+{
+    std::vector<const CTransaction*> vptx;
+    for (const CTransaction& tx : vtx)
+        vptx.push_back(&tx);
+    LOCK(cs_SpendingKeyStore);
+    return DecryptSaplingOutputs(vptx, mapSaplingFullViewingKeys, mapSaplingIncomingViewingKeys, nThreads);
+}
 
-    return std::make_pair(noteData, viewingKeysToAdd);
+/**
+ * The Sapling notes of tx, a transaction of block, decrypting the outputs of the
+ * whole block when it is the first asked about.
+ */
+std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> CWallet::FindMySaplingNotesInBlock(const CTransaction& tx, const CBlock& block)
+{
+    AssertLockHeld(cs_wallet);
+    size_t nKeys;
+    {
+        LOCK(cs_SpendingKeyStore);
+        // syncing the block's transactions only adds addresses of ivks already held
+        nKeys = mapSaplingFullViewingKeys.size();
+    }
+    uint256 hashBlock = block.GetHash();
+    if (hashBlock != hashSaplingNotesBlock || nKeys != nSaplingNotesBlockKeys) {
+        int nThreads = GetArg("-saplingdecryptthreads", DEFAULT_SAPLING_DECRYPT_THREADS);
+        if (nThreads <= 0)
+            nThreads += GetNumCores();
+        auto vNotes = FindMySaplingNotes(block.vtx, std::max(nThreads, 1));
+        mapSaplingNotesBlock.clear();
+        for (size_t i = 0; i < block.vtx.size(); i++)
+            mapSaplingNotesBlock[block.vtx[i].GetHash()] = vNotes[i];
+        hashSaplingNotesBlock = hashBlock;
+        nSaplingNotesBlockKeys = nKeys;
+    }
+    auto it = mapSaplingNotesBlock.find(tx.GetHash());
+    if (it == mapSaplingNotesBlock.end())
+        return FindMySaplingNotes(tx);
+    return it->second;
 }
 
 bool CWallet::IsSproutNullifierFromMe(const uint256& nullifier) const
@@ -2529,7 +2845,7 @@ bool CWallet::LoadCryptedHDSeed(const uint256& seedFp, const std::vector<unsigne
     return CCryptoKeyStore::SetCryptedHDSeed(seedFp, seed);
 }
 
-void CWalletTx::SetSproutNoteData(mapSproutNoteData_t &noteData)
+void CWalletTx::SetSproutNoteData(const mapSproutNoteData_t &noteData)
 {
     mapSproutNoteData.clear();
     for (const std::pair<JSOutPoint, SproutNoteData> nd : noteData) {
@@ -2545,7 +2861,7 @@ void CWalletTx::SetSproutNoteData(mapSproutNoteData_t &noteData)
     }
 }
 
-void CWalletTx::SetSaplingNoteData(mapSaplingNoteData_t &noteData)
+void CWalletTx::SetSaplingNoteData(const mapSaplingNoteData_t &noteData)
 {
     mapSaplingNoteData.clear();
     for (const std::pair<SaplingOutPoint, SaplingNoteData> nd : noteData) {
@@ -2927,10 +3243,60 @@ void CWallet::WitnessNoteCommitment(std::vector<uint256> commitments,
     }
 }
 
+namespace {
+
+/** Blocks handed to the rescan workers at a time, double buffered against the in-order pass */
+const size_t RESCAN_BATCH_BLOCKS = 100;
+
+/** A block read ahead by a rescan worker, with the trial decryption results of each of its transactions */
+struct CRescanBlock
+{
+    CBlockIndex* pindex;
+    CBlock block;
+    std::vector<mapSproutNoteData_t> vSproutNoteData;
+    std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> > vSaplingNoteData;
+
+    explicit CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn) {}
+};
+
+/** The viewing keys a batch is decrypted with, copied so the workers need no keystore lock */
+struct CRescanKeys
+{
+    NoteDecryptorMap noteDecryptors;
+    SaplingFullViewingKeyMap saplingFullViewingKeys;
+    SaplingIncomingViewingKeyMap saplingIncomingViewingKeys;
+};
+
+/**
+ * Read and trial decrypt a batch of blocks on nThreads threads, each block's
+ * results staying in its own slot.
+ */
+void PrepareRescanBatch(const CWallet* pwallet, const CRescanKeys& keys, std::vector<CRescanBlock>& vBatch, int nThreads)
+{
+    ParallelFor(vBatch.size(), nThreads, [&](size_t i) {
+        CRescanBlock& rb = vBatch[i];
+        if (!ReadBlockFromDisk(rb.block, rb.pindex, 1))
+            LogPrintf("Rescanning... failed to read block %s\n", rb.pindex->GetBlockHash().ToString());
+        rb.vSproutNoteData.reserve(rb.block.vtx.size());
+        rb.vSaplingNoteData.reserve(rb.block.vtx.size());
+        for (const CTransaction& tx : rb.block.vtx) {
+            rb.vSproutNoteData.push_back(pwallet->FindMySproutNotes(tx, keys.noteDecryptors));
+            rb.vSaplingNoteData.push_back(pwallet->FindMySaplingNotes(tx, keys.saplingFullViewingKeys, keys.saplingIncomingViewingKeys));
+        }
+    });
+}
+
+} // anon namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Reading blocks and trial decrypting their notes is done by -rescanthreads
+ * workers one batch ahead, while this thread adds what they found to the
+ * wallet and advances the note witnesses in height order, as they depend
+ * on the transactions of every earlier block.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
@@ -2942,50 +3308,85 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 
     std::vector<uint256> myTxHashes;
 
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads += GetNumCores();
+    nThreads = std::max(nThreads, 1);
+
     {
         LOCK2(cs_main, cs_wallet);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
-        while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
-            pindex = chainActive.Next(pindex);
+        if (pindex && nTimeFirstKey && chainActive.Contains(pindex) && pindex->GetBlockTime() < (nTimeFirstKey - 7200)) {
+            CBlockIndex *pindexBirth = chainActive.FindEarliestAtLeast(nTimeFirstKey - 7200);
+            if (pindexBirth == NULL || pindexBirth->GetHeight() > pindex->GetHeight())
+                pindex = pindexBirth;
+        }
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
         double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.LastTip(), false);
-        while (pindex)
+
+        // Keys are only added by this scan for addresses of an ivk already held, so a copy
+        // taken per batch decrypts everything the live keystore would.
+        auto nextBatch = [&](std::vector<CRescanBlock>& vBatch, CRescanKeys& keys) {
+            vBatch.clear();
+            for (; pindex && vBatch.size() < RESCAN_BATCH_BLOCKS; pindex = chainActive.Next(pindex))
+                vBatch.emplace_back(pindex);
+            LOCK(cs_SpendingKeyStore);
+            keys.noteDecryptors = mapNoteDecryptors;
+            keys.saplingFullViewingKeys = mapSaplingFullViewingKeys;
+            keys.saplingIncomingViewingKeys = mapSaplingIncomingViewingKeys;
+        };
+
+        std::vector<CRescanBlock> vBatch, vNextBatch;
+        CRescanKeys keys, nextKeys;
+        nextBatch(vBatch, keys);
+        PrepareRescanBatch(this, keys, vBatch, nThreads);
+        while (!vBatch.empty())
         {
-            if (pindex->GetHeight() % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            nextBatch(vNextBatch, nextKeys);
+            boost::thread prepareThread(boost::bind(PrepareRescanBatch, this, boost::cref(nextKeys), boost::ref(vNextBatch), nThreads));
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex,1);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+            for (CRescanBlock& rb : vBatch)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate)) {
-                    myTxHashes.push_back(tx.GetHash());
-                    ret++;
+                CBlockIndex* pindexBlock = rb.pindex;
+                if (pindexBlock->GetHeight() % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindexBlock, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                const CBlock& block = rb.block;
+                for (size_t i = 0; i < block.vtx.size(); i++)
+                {
+                    const CTransaction& tx = block.vtx[i];
+                    if (AddToWalletIfInvolvingMe(tx, &block, fUpdate, rb.vSproutNoteData[i], rb.vSaplingNoteData[i])) {
+                        myTxHashes.push_back(tx.GetHash());
+                        ret++;
+                    }
                 }
-            }
 
-            SproutMerkleTree sproutTree;
-            SaplingMerkleTree saplingTree;
-            // This should never fail: we should always be able to get the tree
-            // state on the path to the tip of our chain
-            assert(pcoinsTip->GetSproutAnchorAt(pindex->hashSproutAnchor, sproutTree));
-            if (pindex->pprev) {
-                if (NetworkUpgradeActive(pindex->pprev->GetHeight(), Params().GetConsensus(), Consensus::UPGRADE_SAPLING)) {
-                    assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
+                SproutMerkleTree sproutTree;
+                SaplingMerkleTree saplingTree;
+                // This should never fail: we should always be able to get the tree
+                // state on the path to the tip of our chain
+                assert(pcoinsTip->GetSproutAnchorAt(pindexBlock->hashSproutAnchor, sproutTree));
+                if (pindexBlock->pprev) {
+                    if (NetworkUpgradeActive(pindexBlock->pprev->GetHeight(), Params().GetConsensus(), Consensus::UPGRADE_SAPLING)) {
+                        assert(pcoinsTip->GetSaplingAnchorAt(pindexBlock->pprev->hashFinalSaplingRoot, saplingTree));
+                    }
                 }
-            }
-            // Increment note witness caches
-            ChainTip(pindex, &block, sproutTree, saplingTree, true);
+                // Increment note witness caches
+                ChainTip(pindexBlock, &block, sproutTree, saplingTree, true);
 
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->GetHeight(), Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexBlock->GetHeight(), Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindexBlock));
+                }
             }
+
+            prepareThread.join();
+            vBatch.swap(vNextBatch);
+            std::swap(keys, nextKeys);
         }
 
         // After rescanning, persist Sapling note data that might have changed, e.g. nullifiers.
@@ -3357,9 +3758,9 @@ CAmount CWallet::GetBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        BOOST_FOREACH(const uint256& hash, GetUnspentTx())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.find(hash)->second;
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -3373,9 +3774,9 @@ CAmount CWallet::GetUnconfirmedBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        BOOST_FOREACH(const uint256& hash, GetUnspentTx())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.find(hash)->second;
             if (!CheckFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -3388,9 +3789,9 @@ CAmount CWallet::GetImmatureBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        BOOST_FOREACH(const uint256& hash, GetUnspentTx())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.find(hash)->second;
             nTotal += pcoin->GetImmatureCredit();
         }
     }
@@ -3402,9 +3803,9 @@ CAmount CWallet::GetWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        BOOST_FOREACH(const uint256& hash, GetUnspentTx())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.find(hash)->second;
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -3418,9 +3819,9 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        BOOST_FOREACH(const uint256& hash, GetUnspentTx())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.find(hash)->second;
             if (!CheckFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -3433,9 +3834,9 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        BOOST_FOREACH(const uint256& hash, GetUnspentTx())
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.find(hash)->second;
             nTotal += pcoin->GetImmatureWatchOnlyCredit();
         }
     }
@@ -3455,10 +3856,9 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        BOOST_FOREACH(const uint256& wtxid, GetUnspentTx())
         {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = &mapWallet.find(wtxid)->second;
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -3480,8 +3880,8 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             {
                 isminetype mine = IsMine(pcoin->vout[i]);
                 if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    !IsLockedCoin((*it).first, i) && (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
-                    (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected((*it).first, i)))
+                    !IsLockedCoin(wtxid, i) && (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
+                    (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected(wtxid, i)))
                 {
                     if ( SAFECOIN_EXCHANGEWALLET == 0 )
                     {
@@ -3591,6 +3991,43 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
 
     random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
 
+    // Coins adding up to the target with less left over than a change output would
+    // be worth come first: the leftover goes to the fee as dust, and the wallet is
+    // left with no new small output. The fee of the inputs is in nTargetValue already,
+    // CreateTransaction raises it until it covers them, so their full value counts.
+    {
+        CFeeRate feeRate = payTxFee.GetFeePerK() > 0 ? payTxFee : minTxFee;
+        CAmount nInputFee = feeRate.GetFee(P2PKH_INPUT_SIZE);
+        CTxOut changeOut(0, GetScriptForDestination(CKeyID()));
+        CAmount nCostOfChange = std::min(feeRate.GetFee(P2PKH_INPUT_SIZE + P2PKH_OUTPUT_SIZE),
+                                         std::max<CAmount>(0, changeOut.GetDustThreshold(::minRelayTxFee) - 1));
+
+        std::vector<CInputCoin> vInputs;
+        std::vector<const COutput*> vInputOutputs;
+        BOOST_FOREACH(const COutput &output, vCoins)
+        {
+            if (!output.fSpendable)
+                continue;
+            if (output.nDepth < (output.tx->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
+                continue;
+            CAmount n = output.tx->vout[output.i].nValue;
+            // worth less than it costs to spend, or too big to ever be changeless
+            if (n <= nInputFee || n > nTargetValue + nCostOfChange)
+                continue;
+            vInputs.push_back(CInputCoin(n, 0));
+            vInputOutputs.push_back(&output);
+        }
+
+        std::vector<size_t> vSelected;
+        if (SelectCoinsBnB(vInputs, nTargetValue, nCostOfChange, vSelected, nValueRet))
+        {
+            for (size_t i : vSelected)
+                setCoinsRet.insert(make_pair(vInputOutputs[i]->tx, vInputOutputs[i]->i));
+            LogPrint("selectcoins", "SelectCoins() changeless: %u coins, total %s\n", vSelected.size(), FormatMoney(nValueRet));
+            return true;
+        }
+    }
+
     BOOST_FOREACH(const COutput &output, vCoins)
     {
         if (!output.fSpendable)
@@ -4273,6 +4710,124 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
     return true;
 }
 
+/**
+ * Where a dust sweep goes: on staked chains the wallet address of the segid
+ * holding the least of the wallet's other coins, so the stake stays spread over
+ * the segids, otherwise a new key.
+ */
+static CTxDestination GetConsolidateDestination(const std::vector<COutput>& vCoins, const std::vector<COutput>& vDust, const CPubKey& newKey)
+{
+    CTxDestination newDest = newKey.GetID();
+    if (ASSETCHAINS_STAKED == 0)
+        return newDest;
+
+    CAmount nSegidValues[64] = {0};
+    std::map<int32_t, CTxDestination> mapSegidDests;
+    BOOST_FOREACH(const COutput& out, vCoins)
+    {
+        CTxDestination dest;
+        if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, dest) || !boost::get<CKeyID>(&dest))
+            continue;
+        int32_t segid = safecoin_segid32((char *)EncodeDestination(dest).c_str()) & 0x3f;
+        nSegidValues[segid] += out.tx->vout[out.i].nValue;
+        mapSegidDests.insert(std::make_pair(segid, dest));
+    }
+    // the dust is moved wherever the sweep goes
+    BOOST_FOREACH(const COutput& out, vDust)
+    {
+        CTxDestination dest;
+        if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, dest) && boost::get<CKeyID>(&dest))
+            nSegidValues[safecoin_segid32((char *)EncodeDestination(dest).c_str()) & 0x3f] -= out.tx->vout[out.i].nValue;
+    }
+
+    int32_t newSegid = safecoin_segid32((char *)EncodeDestination(newDest).c_str()) & 0x3f;
+    mapSegidDests[newSegid] = newDest;
+    std::pair<int32_t, CTxDestination> best = *mapSegidDests.begin();
+    BOOST_FOREACH(const PAIRTYPE(const int32_t, CTxDestination)& item, mapSegidDests)
+    {
+        if (nSegidValues[item.first] < nSegidValues[best.first])
+            best = item;
+    }
+    return best.second;
+}
+
+bool CWallet::ConsolidateDust(int nHeight)
+{
+    CAmount nThreshold = DEFAULT_CONSOLIDATE_DUST_THRESHOLD;
+    if (mapArgs.count("-consolidatedustthreshold") && !ParseMoney(mapArgs["-consolidatedustthreshold"], nThreshold))
+        return false;
+    CAmount nMaxFee = DEFAULT_CONSOLIDATE_MAX_FEE;
+    if (mapArgs.count("-consolidatemaxfee") && !ParseMoney(mapArgs["-consolidatemaxfee"], nMaxFee))
+        return false;
+
+    CWalletTx wtxNew;
+    CReserveKey reservekey(this);
+    {
+        LOCK2(cs_main, cs_wallet);
+        if (IsLocked())
+            return false;
+
+        std::vector<COutput> vCoins, vDust;
+        AvailableCoins(vCoins, true, NULL, false, false);
+        BOOST_FOREACH(const COutput& out, vCoins)
+        {
+            if (out.fSpendable && out.tx->vout[out.i].nValue < nThreshold)
+                vDust.push_back(out);
+        }
+        if (vDust.size() < CONSOLIDATE_DUST_MIN_INPUTS)
+            return false;
+
+        // the smallest first, those are the most expensive ones to spend later
+        std::sort(vDust.begin(), vDust.end(), [](const COutput& a, const COutput& b) {
+            return a.tx->vout[a.i].nValue < b.tx->vout[b.i].nValue;
+        });
+        if (vDust.size() > CONSOLIDATE_DUST_MAX_INPUTS)
+            vDust.erase(vDust.begin() + CONSOLIDATE_DUST_MAX_INPUTS, vDust.end());
+
+        CCoinControl coinControl;
+        CAmount nTotal = 0;
+        BOOST_FOREACH(const COutput& out, vDust)
+        {
+            coinControl.Select(COutPoint(out.tx->GetHash(), out.i));
+            nTotal += out.tx->vout[out.i].nValue;
+        }
+
+        CPubKey vchPubKey;
+        if (!reservekey.GetReservedKey(vchPubKey))
+            return false;
+        CTxDestination dest = GetConsolidateDestination(vCoins, vDust, vchPubKey);
+        std::vector<CRecipient> vecSend;
+        CRecipient recipient = {GetScriptForDestination(dest), nTotal, true};
+        vecSend.push_back(recipient);
+
+        CAmount nFeeRet; int nChangePosRet = -1; std::string strFailReason;
+        if (!CreateTransaction(vecSend, wtxNew, reservekey, nFeeRet, nChangePosRet, strFailReason, &coinControl))
+        {
+            LogPrintf("ConsolidateDust(): %s\n", strFailReason);
+            return false;
+        }
+        if (nFeeRet > nMaxFee)
+        {
+            LogPrint("selectcoins", "ConsolidateDust(): fee %s is above -consolidatemaxfee\n", FormatMoney(nFeeRet));
+            return false;
+        }
+        // an existing address of the wallet needs none of the keypool
+        if (!(dest == CTxDestination(vchPubKey.GetID())))
+            reservekey.ReturnKey();
+    }
+    if (!CommitTransaction(wtxNew, reservekey))
+        return false;
+    {
+        LOCK(cs_wallet);
+        nConsolidateHeight = nHeight;
+        hashConsolidateTx = wtxNew.GetHash();
+        nConsolidateSweeps++;
+        nConsolidateInputs += wtxNew.vin.size();
+    }
+    LogPrintf("ConsolidateDust(): swept %u utxos below %s in %s\n", wtxNew.vin.size(), FormatMoney(nThreshold), wtxNew.GetHash().ToString());
+    return true;
+}
+
 CAmount CWallet::GetMinimumFee(unsigned int nTxBytes, unsigned int nConfirmTarget, const CTxMemPool& pool)
 {
     // payTxFee is user-set "I want to pay this much"
@@ -5137,7 +5692,7 @@ void CWallet::GetFilteredNotes(
     LOCK2(cs_main, cs_wallet);
 
     for (auto & p : mapWallet) {
-        CWalletTx wtx = p.second;
+        const CWalletTx& wtx = p.second;
 
         // Filter the transactions before checking for notes
         if (!CheckFinalTx(wtx) || wtx.GetBlocksToMaturity() > 0)
@@ -5158,8 +5713,8 @@ void CWallet::GetFilteredNotes(
         }
 
         for (auto & pair : wtx.mapSproutNoteData) {
-            JSOutPoint jsop = pair.first;
-            SproutNoteData nd = pair.second;
+            const JSOutPoint& jsop = pair.first;
+            const SproutNoteData& nd = pair.second;
             SproutPaymentAddress pa = nd.address;
 
             // skip notes which belong to a different payment address in the wallet
@@ -5182,6 +5737,12 @@ void CWallet::GetFilteredNotes(
                 continue;
             }
 
+            auto itPlaintext = mapSproutNotePlaintexts.find(jsop);
+            if (itPlaintext != mapSproutNotePlaintexts.end()) {
+                sproutEntries.push_back(CSproutNotePlaintextEntry{jsop, pa, itPlaintext->second, wtx.GetDepthInMainChain()});
+                continue;
+            }
+
             int i = jsop.js; // Index into CTransaction.vjoinsplit
             int j = jsop.n; // Index into JSDescription.ciphertexts
 
@@ -5202,6 +5763,7 @@ void CWallet::GetFilteredNotes(
                         hSig,
                         (unsigned char) j);
 
+                mapSproutNotePlaintexts.insert(std::make_pair(jsop, plaintext));
                 sproutEntries.push_back(CSproutNotePlaintextEntry{jsop, pa, plaintext, wtx.GetDepthInMainChain()});
 
             } catch (const note_decryption_failed &err) {
@@ -5214,20 +5776,26 @@ void CWallet::GetFilteredNotes(
         }
 
         for (auto & pair : wtx.mapSaplingNoteData) {
-            SaplingOutPoint op = pair.first;
-            SaplingNoteData nd = pair.second;
-
-            auto maybe_pt = SaplingNotePlaintext::decrypt(
-                wtx.vShieldedOutput[op.n].encCiphertext,
-                nd.ivk,
-                wtx.vShieldedOutput[op.n].ephemeralKey,
-                wtx.vShieldedOutput[op.n].cm);
-            assert(static_cast<bool>(maybe_pt));
-            auto notePt = maybe_pt.get();
-
-            auto maybe_pa = nd.ivk.address(notePt.d);
-            assert(static_cast<bool>(maybe_pa));
-            auto pa = maybe_pa.get();
+            const SaplingOutPoint& op = pair.first;
+            const SaplingNoteData& nd = pair.second;
+
+            auto itEntry = mapSaplingNoteEntries.find(op);
+            if (itEntry == mapSaplingNoteEntries.end()) {
+                auto maybe_pt = SaplingNotePlaintext::decrypt(
+                    wtx.vShieldedOutput[op.n].encCiphertext,
+                    nd.ivk,
+                    wtx.vShieldedOutput[op.n].ephemeralKey,
+                    wtx.vShieldedOutput[op.n].cm);
+                assert(static_cast<bool>(maybe_pt));
+                auto notePt = maybe_pt.get();
+
+                auto maybe_pa = nd.ivk.address(notePt.d);
+                assert(static_cast<bool>(maybe_pa));
+
+                itEntry = mapSaplingNoteEntries.insert(std::make_pair(op, SaplingNoteEntry {
+                    op, maybe_pa.get(), notePt.note(nd.ivk).get(), notePt.memo(), 0 })).first;
+            }
+            const auto& pa = itEntry->second.address;
 
             // skip notes which belong to a different payment address in the wallet
             if (!(filterAddresses.empty() || filterAddresses.count(pa))) {
@@ -5255,9 +5823,8 @@ void CWallet::GetFilteredNotes(
                  continue;
              }
 
-            auto note = notePt.note(nd.ivk).get();
-            saplingEntries.push_back(SaplingNoteEntry {
-                op, pa, note, notePt.memo(), wtx.GetDepthInMainChain() });
+            saplingEntries.push_back(itEntry->second);
+            saplingEntries.back().confirmations = wtx.GetDepthInMainChain();
         }
     }
 }
@@ -69,6 +69,19 @@ static const CAmount nHighTransactionFeeWarning = 0.01 * COIN;
 static const CAmount DEFAULT_TRANSACTION_MAXFEE = 0.1 * COIN;
 //! -txconfirmtarget default
 static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 2;
+//! -rescanthreads default, 0 = one per core
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! -saplingdecryptthreads default, 0 = one per core
+static const int DEFAULT_SAPLING_DECRYPT_THREADS = 0;
+//! -consolidatedust default
+static const bool DEFAULT_CONSOLIDATE_DUST = false;
+//! -consolidatedustthreshold default, utxos below it are consolidated
+static const CAmount DEFAULT_CONSOLIDATE_DUST_THRESHOLD = CENT;
+//! -consolidatemaxfee default, a sweep paying more is not sent
+static const CAmount DEFAULT_CONSOLIDATE_MAX_FEE = 0.01 * COIN;
+//! Fewest and most dust utxos swept by one consolidation transaction
+static const unsigned int CONSOLIDATE_DUST_MIN_INPUTS = 50;
+static const unsigned int CONSOLIDATE_DUST_MAX_INPUTS = 200;
 //! -maxtxfee will warn if called with a higher fee than this amount (in satoshis)
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
@@ -564,8 +577,8 @@ public:
         MarkDirty();
     }
 
-    void SetSproutNoteData(mapSproutNoteData_t &noteData);
-    void SetSaplingNoteData(mapSaplingNoteData_t &noteData);
+    void SetSproutNoteData(const mapSproutNoteData_t &noteData);
+    void SetSaplingNoteData(const mapSaplingNoteData_t &noteData);
 
     std::pair<libzcash::SproutNotePlaintext, libzcash::SproutPaymentAddress> DecryptSproutNote(
 	JSOutPoint jsop) const;
@@ -783,6 +796,47 @@ private:
     void AddToSproutSpends(const uint256& nullifier, const uint256& wtxid);
     void AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
+    /** Drop a wallet tx from wtxOrdered, before it is replaced or erased */
+    void EraseFromOrdered(const CWalletTx* pwtx);
+
+    /**
+     * The transactions with an output of ours that no confirmed wallet
+     * transaction spends, a superset of those with unspent coins. The
+     * balances and AvailableCoins() look only at these instead of all of
+     * mapWallet. A confirmed spend never goes away without a tip being
+     * disconnected, and which outputs are ours only changes along with
+     * MarkDirty(), so on either the set is rebuilt on its next use.
+     */
+    mutable std::set<uint256> setUnspentTx;
+    mutable bool fUnspentTxDirty;
+
+    bool HasUnconfirmedSpendOutput(const CWalletTx& wtx) const;
+    void UpdateUnspentTx(const uint256& hash);
+    /** Caller holds cs_main and cs_wallet */
+    const std::set<uint256>& GetUnspentTx() const;
+
+    //! Wallet transactions to write on the next FlushPendingTxWrites
+    std::set<uint256> setPendingTxWrites;
+
+    /**
+     * The Sapling notes of the block SyncTransaction is being called for,
+     * trial decrypted for all of its outputs at once by the first of its
+     * transactions, and the number of full viewing keys they were
+     * decrypted with.
+     */
+    uint256 hashSaplingNotesBlock;
+    size_t nSaplingNotesBlockKeys;
+    std::map<uint256, std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> > mapSaplingNotesBlock;
+
+    std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> FindMySaplingNotesInBlock(const CTransaction& tx, const CBlock& block);
+
+    /**
+     * The decrypted notes GetFilteredNotes has returned before, so repeated
+     * calls only decrypt the notes that arrived since. The plaintext of a
+     * wallet note never changes; the entries go with EraseFromWallet.
+     */
+    std::map<JSOutPoint, libzcash::SproutNotePlaintext> mapSproutNotePlaintexts;
+    std::map<SaplingOutPoint, SaplingNoteEntry> mapSaplingNoteEntries;
 
 public:
     /*
@@ -919,6 +973,12 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         nWitnessCacheSize = 0;
+        fUnspentTxDirty = true;
+        nSaplingNotesBlockKeys = 0;
+        nConsolidateHeight = 0;
+        hashConsolidateTx.SetNull();
+        nConsolidateSweeps = 0;
+        nConsolidateInputs = 0;
     }
 
     /**
@@ -975,7 +1035,14 @@ public:
 
     std::map<uint256, CWalletTx> mapWallet;
 
+    typedef std::pair<CWalletTx*, CAccountingEntry*> TxPair;
+    typedef std::multimap<int64_t, TxPair > TxItems;
+
     int64_t nOrderPosNext;
+    /** The wallet's activity log by nOrderPos, kept up to date as transactions and accounting entries are added */
+    TxItems wtxOrdered;
+    /** Every accounting entry of the wallet, which the entries of wtxOrdered point into */
+    std::list<CAccountingEntry> laccentries;
     std::map<uint256, int> mapRequestCount;
 
     std::map<CTxDestination, CAddressBookData> mapAddressBook;
@@ -1120,26 +1187,32 @@ public:
      */
     int64_t IncOrderPosNext(CWalletDB *pwalletdb = NULL);
 
-    typedef std::pair<CWalletTx*, CAccountingEntry*> TxPair;
-    typedef std::multimap<int64_t, TxPair > TxItems;
-
-    /**
-     * Get the wallet's activity log
-     * @return multimap of ordered transactions and accounting entries
-     * @warning Returned pointers are *only* valid within the scope of passed acentries
-     */
-    TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
+    /** Write an accounting entry and add it to wtxOrdered */
+    bool AddAccountingEntry(const CAccountingEntry& acentry, CWalletDB& walletdb);
+    /** Add an accounting entry read from the wallet file */
+    void LoadAccountingEntry(const CAccountingEntry& acentry);
 
     void MarkDirty();
     bool UpdateNullifierNoteMap();
     void UpdateNullifierNoteMapWithTx(const CWalletTx& wtx);
     void UpdateSaplingNullifierNoteMapWithTx(CWalletTx& wtx);
     void UpdateSaplingNullifierNoteMapForBlock(const CBlock* pblock);
+    /** With no pwalletdb the write is queued, see FlushPendingTxWrites */
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
+    /**
+     * Write out the wallet transactions added or updated by blocks since the
+     * last call, in one database transaction. Runs on the wallet flush thread,
+     * and before the best block locator is written and on shutdown, so the
+     * locator never points past a transaction that is not on disk.
+     */
+    bool FlushPendingTxWrites();
     void EraseFromWallet(const uint256 &hash);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     void RescanWallet();
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate,
+                                  const mapSproutNoteData_t& sproutNoteData,
+                                  const std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>& saplingNoteDataAndAddressesToAdd);
     void WitnessNoteCommitment(
          std::vector<uint256> commitments,
          std::vector<boost::optional<SproutWitness>>& witnesses,
@@ -1158,6 +1231,13 @@ public:
     bool CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, int& nChangePosRet,
                            std::string& strFailReason, const CCoinControl *coinControl = NULL, bool sign = true);
     bool CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey);
+    //! Sweeps the smallest confirmed utxos below -consolidatedustthreshold into one, if there are enough of them
+    bool ConsolidateDust(int nHeight);
+    //! What ConsolidateDust has done since startup, for getconsolidationinfo
+    int nConsolidateHeight;
+    uint256 hashConsolidateTx;
+    uint64_t nConsolidateSweeps;
+    uint64_t nConsolidateInputs;
 
     static CFeeRate minTxFee;
     static CAmount GetMinimumFee(unsigned int nTxBytes, unsigned int nConfirmTarget, const CTxMemPool& pool);
@@ -1183,7 +1263,15 @@ public:
         const uint256& hSig,
         uint8_t n) const;
     mapSproutNoteData_t FindMySproutNotes(const CTransaction& tx) const;
+    mapSproutNoteData_t FindMySproutNotes(const CTransaction& tx, const NoteDecryptorMap& noteDecryptors) const;
     std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> FindMySaplingNotes(const CTransaction& tx) const;
+    std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> FindMySaplingNotes(
+        const CTransaction& tx,
+        const SaplingFullViewingKeyMap& fullViewingKeys,
+        const SaplingIncomingViewingKeyMap& incomingViewingKeys) const;
+    std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> > FindMySaplingNotes(
+        const std::vector<CTransaction>& vtx,
+        int nThreads) const;
     bool IsSproutNullifierFromMe(const uint256& nullifier) const;
     bool IsSaplingNullifierFromMe(const uint256& nullifier) const;
 
@@ -21,6 +21,7 @@
 #include "wallet/walletdb.h"
 
 #include "consensus/validation.h"
+#include "init.h"
 #include "key_io.h"
 #include "main.h"
 #include "protocol.h"
@@ -299,9 +300,10 @@ bool CWalletDB::WriteAccountingEntry(const uint64_t nAccEntryNum, const CAccount
     return Write(std::make_pair(std::string("acentry"), std::make_pair(acentry.strAccount, nAccEntryNum)), acentry);
 }
 
-bool CWalletDB::WriteAccountingEntry(const CAccountingEntry& acentry)
+bool CWalletDB::WriteAccountingEntry(CAccountingEntry& acentry)
 {
-    return WriteAccountingEntry(++nAccountingEntryNumber, acentry);
+    acentry.nEntryNo = ++nAccountingEntryNumber;
+    return WriteAccountingEntry(acentry.nEntryNo, acentry);
 }
 
 CAmount CWalletDB::GetAccountCreditDebit(const string& strAccount)
@@ -375,11 +377,10 @@ DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
         CWalletTx* wtx = &((*it).second);
         txByTime.insert(make_pair(wtx->nTimeReceived, TxPair(wtx, (CAccountingEntry*)0)));
     }
-    list<CAccountingEntry> acentries;
-    ListAccountCreditDebit("", acentries);
-    BOOST_FOREACH(CAccountingEntry& entry, acentries)
+    BOOST_FOREACH(CAccountingEntry& entry, pwallet->laccentries)
     {
-        txByTime.insert(make_pair(entry.nTime, TxPair((CWalletTx*)0, &entry)));
+        if (entry.strAccount == "")
+            txByTime.insert(make_pair(entry.nTime, TxPair((CWalletTx*)0, &entry)));
     }
 
     int64_t& nOrderPosNext = pwallet->nOrderPosNext;
@@ -432,6 +433,13 @@ DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
     }
     WriteOrderPosNext(nOrderPosNext);
 
+    // the positions moved under wtxOrdered's keys, so it is built again
+    pwallet->wtxOrdered.clear();
+    for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it)
+        pwallet->wtxOrdered.insert(make_pair(it->second.nOrderPos, TxPair(&it->second, (CAccountingEntry*)0)));
+    BOOST_FOREACH(CAccountingEntry& entry, pwallet->laccentries)
+        pwallet->wtxOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
+
     return DB_LOAD_OK;
 }
 
@@ -485,7 +493,10 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             CWalletTx wtx;
             ssValue >> wtx;
             CValidationState state;
-            auto verifier = libzcash::ProofVerifier::Strict();
+            // the joinsplit proofs were verified when the transaction got into the chain or was
+            // made by us; the hash check below already catches a damaged record, and verifying
+            // every proof again made loading a wallet of many shielded transactions take minutes
+            auto verifier = libzcash::ProofVerifier::Disabled();
             // ac_public chains set at height like SAFE and ZEX, will force a rescan if we dont ignore this error: bad-txns-acpublic-chain
             // there cannot be any ztx in the wallet on ac_public chains that started from block 1, so this wont affect those. 
             // PIRATE fails this check for notary nodes, need exception. Triggers full rescan without it. 
@@ -531,13 +542,13 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             if (nNumber > nAccountingEntryNumber)
                 nAccountingEntryNumber = nNumber;
 
-            if (!wss.fAnyUnordered)
-            {
-                CAccountingEntry acentry;
-                ssValue >> acentry;
-                if (acentry.nOrderPos == -1)
-                    wss.fAnyUnordered = true;
-            }
+            CAccountingEntry acentry;
+            ssValue >> acentry;
+            acentry.strAccount = strAccount;
+            acentry.nEntryNo = nNumber;
+            if (acentry.nOrderPos == -1)
+                wss.fAnyUnordered = true;
+            pwallet->LoadAccountingEntry(acentry);
         }
         else if (strType == "watchs")
         {
@@ -1131,6 +1142,10 @@ void ThreadFlushWalletDB(const string& strFile)
     {
         MilliSleep(500);
 
+        // Write out the wallet transactions of the blocks connected since
+        if (pwalletMain)
+            pwalletMain->FlushPendingTxWrites();
+
         if (nLastSeen != nWalletDBUpdated)
         {
             nLastSeen = nWalletDBUpdated;
@@ -5,6 +5,7 @@
 #include "zcash/util.h"
 
 #include <memory>
+#include <mutex>
 
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
@@ -287,6 +288,7 @@ public:
             ss2 << inputs[1].witness.path();
             std::vector<unsigned char> auth2(ss2.begin(), ss2.end());
 
+            ZCEnsureParamsLoaded();
             librustzcash_sprout_prove(
                 proof.begin(),
 
@@ -441,3 +443,17 @@ template class JoinSplit<ZC_NUM_JS_INPUTS,
                          ZC_NUM_JS_OUTPUTS>;
 
 }
+
+static std::function<void()> zcParamsLoader;
+static std::once_flag zcParamsOnce;
+
+void ZCSetParamsLoader(std::function<void()> loader)
+{
+    zcParamsLoader = loader;
+}
+
+void ZCEnsureParamsLoaded()
+{
+    if (zcParamsLoader)
+        std::call_once(zcParamsOnce, zcParamsLoader);
+}
@@ -12,6 +12,7 @@
 #include "uint252.h"
 
 #include <array>
+#include <functional>
 
 namespace libzcash {
 
@@ -112,4 +113,10 @@ protected:
 typedef libzcash::JoinSplit<ZC_NUM_JS_INPUTS,
                             ZC_NUM_JS_OUTPUTS> ZCJoinSplit;
 
+// With -lazyzcparams the Sapling and Sprout Groth16 parameters are loaded on first use
+// instead of at startup; the loader is run once by ZCEnsureParamsLoaded().
+void ZCSetParamsLoader(std::function<void()> loader);
+// Call before a Groth16 proof is created or verified, a no-op once the parameters are loaded
+void ZCEnsureParamsLoaded();
+
 #endif // ZC_JOINSPLIT_H_
@@ -19,6 +19,9 @@
 #include "miner.h"
 #include "pow.h"
 #include "rpc/server.h"
+#include "safecoin_defs.h"
+#include "safecoin_structs.h"
+#include "safecoin_nSPV_defs.h"
 #include "script/sign.h"
 #include "sodium.h"
 #include "streams.h"
@@ -630,3 +633,136 @@ double benchmark_verify_sapling_output()
     }
     return timer_stop(tv_start);
 }
+
+
+extern struct safecoin_kv *SAFECOIN_KV;
+extern pthread_mutex_t SAFECOIN_KV_mutex;
+int32_t safecoin_kvsearch(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen);
+int32_t safecoin_eligiblenotary(uint8_t pubkeys[66][33],int32_t *mids,uint32_t blocktimes[66],int32_t *nonzpkeysp,int32_t height);
+int32_t safecoin_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blocktimep,uint32_t *txtimep,uint256 *utxotxidp,int32_t *utxovoutp,uint64_t *utxovaluep,uint8_t *utxosig, uint256 merkleroot);
+std::vector<std::tuple<std::string, uint32_t, std::vector<std::pair<std::string, uint32_t>>>> vt_safecoin_safeids_new(int32_t height, int32_t width);
+int32_t NSPV_getaddressutxos(struct NSPV_utxosresp *ptr,char *coinaddr,bool isCC,int32_t skipcount,uint32_t filter);
+void NSPV_utxosresp_purge(struct NSPV_utxosresp *ptr);
+
+// Looks up every key of the KV table, the beacon registrations on this chain
+double benchmark_kvsearch()
+{
+    std::vector<std::vector<uint8_t> > keys;
+    pthread_mutex_lock(&SAFECOIN_KV_mutex);
+    for (struct safecoin_kv *s = SAFECOIN_KV; s != NULL; s = (struct safecoin_kv *)s->hh.next)
+        keys.push_back(std::vector<uint8_t>(s->key, s->key + s->keylen));
+    pthread_mutex_unlock(&SAFECOIN_KV_mutex);
+
+    int32_t nHeight = chainActive.Height();
+    uint256 refpubkey; uint32_t flags; int32_t height; uint8_t value[IGUANA_MAXSCRIPTSIZE];
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (size_t i = 0; i < keys.size(); i++)
+        safecoin_kvsearch(&refpubkey, nHeight, &flags, &height, value, keys[i].data(), keys[i].size());
+    return timer_stop(tv_start);
+}
+
+extern UniValue getregistrationinfo(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpc/misc.cpp
+extern UniValue getactivenodes(const UniValue& params, bool fHelp, const CPubKey& mypk);
+
+double benchmark_getregistrationinfo(const std::string& safekey)
+{
+    UniValue params(UniValue::VARR);
+    if (!safekey.empty())
+        params.push_back(safekey);
+    struct timeval tv_start;
+    timer_start(tv_start);
+    auto info = getregistrationinfo(params, false, CPubKey());
+    return timer_stop(tv_start);
+}
+
+double benchmark_getactivenodes()
+{
+    UniValue params(UniValue::VARR);
+    struct timeval tv_start;
+    timer_start(tv_start);
+    auto nodes = getactivenodes(params, false, CPubKey());
+    return timer_stop(tv_start);
+}
+
+double benchmark_safeids(int32_t nWidth)
+{
+    struct timeval tv_start;
+    timer_start(tv_start);
+    auto tally = vt_safecoin_safeids_new(chainActive.Height(), nWidth);
+    return timer_stop(tv_start);
+}
+
+double benchmark_eligiblenotary()
+{
+    uint8_t pubkeys[66][33]; int32_t mids[66]; uint32_t blocktimes[66]; int32_t nonzpkeys = 0;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    safecoin_eligiblenotary(pubkeys, mids, blocktimes, &nonzpkeys, chainActive.Height() + 1);
+    return timer_stop(tv_start);
+}
+
+// Searches the wallet for a staking utxo on top of the tip, as the miner does for every block
+double benchmark_staked()
+{
+    CMutableTransaction txStaked;
+    uint32_t blocktime = GetTime(), txtime = 0; uint256 utxotxid; int32_t utxovout; uint64_t utxovalue = 0; uint8_t utxosig[128];
+    uint32_t nBits = chainActive.Tip() != NULL ? chainActive.Tip()->nBits : 0;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    safecoin_staked(txStaked, nBits, &blocktime, &txtime, &utxotxid, &utxovout, &utxovalue, utxosig, uint256());
+    return timer_stop(tv_start);
+}
+
+double benchmark_nspv_getaddressutxos(const std::string& address, bool isCC)
+{
+    struct NSPV_utxosresp U;
+    memset(&U, 0, sizeof(U));
+    struct timeval tv_start;
+    timer_start(tv_start);
+    NSPV_getaddressutxos(&U, (char *)address.c_str(), isCC, 0, 0);
+    double t = timer_stop(tv_start);
+    NSPV_utxosresp_purge(&U);
+    return t;
+}
+
+double benchmark_snapshot()
+{
+    std::map<std::string, CAmount> addressAmounts;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    if (!pblocktree->Snapshot2(addressAmounts, NULL))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Snapshot2 needs -addressindex");
+    return timer_stop(tv_start);
+}
+
+// Replays the last nBlocks blocks of the active chain. They are disconnected from a cache on top of
+// pcoinsTip, which is never flushed, and connected again with fJustCheck, so nothing is written.
+// The per-phase split of each ConnectBlock is logged under -debug=bench.
+double benchmark_replayblocks(int nBlocks)
+{
+    if (nBlocks <= 0 || nBlocks > chainActive.Height())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid number of blocks");
+
+    CCoinsViewCache coins(pcoinsTip);
+    CValidationState state;
+    std::vector<CBlock> blocks(nBlocks);
+    CBlockIndex* pindex = chainActive.Tip();
+    for (int i = nBlocks - 1; i >= 0; i--, pindex = pindex->pprev) {
+        if (!ReadBlockFromDisk(blocks[i], pindex, false))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to read block " + pindex->GetBlockHash().ToString());
+        if (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Not enough -dbcache to disconnect that many blocks");
+        if (!DisconnectBlock(blocks[i], state, pindex, coins))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to disconnect block " + pindex->GetBlockHash().ToString());
+    }
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (int i = 0; i < nBlocks; i++) {
+        pindex = chainActive.Next(pindex);
+        if (!ConnectBlock(blocks[i], state, pindex, coins, true, true))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to connect block " + pindex->GetBlockHash().ToString());
+    }
+    return timer_stop(tv_start);
+}
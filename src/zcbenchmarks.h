@@ -23,5 +23,14 @@ extern double benchmark_create_sapling_spend();
 extern double benchmark_create_sapling_output();
 extern double benchmark_verify_sapling_spend();
 extern double benchmark_verify_sapling_output();
+extern double benchmark_kvsearch();
+extern double benchmark_getregistrationinfo(const std::string& safekey);
+extern double benchmark_getactivenodes();
+extern double benchmark_safeids(int32_t nWidth);
+extern double benchmark_eligiblenotary();
+extern double benchmark_staked();
+extern double benchmark_nspv_getaddressutxos(const std::string& address, bool isCC);
+extern double benchmark_snapshot();
+extern double benchmark_replayblocks(int nBlocks);
 
 #endif
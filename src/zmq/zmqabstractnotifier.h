@@ -35,6 +35,11 @@ public:
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyBlock(const CBlock& pblock);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyBlockConnected(const CBlockIndex *pindex);
+    virtual bool NotifyBlockDisconnected(const CBlockIndex *pindex);
+    virtual bool NotifyTransactionAcceptance(const CTransaction &transaction);
+    virtual bool NotifyTransactionRemoval(const uint256 &hash);
+    virtual bool NotifyAsyncOperationFinished(const std::string &id, const std::string &status);
 
 protected:
     void *psocket;
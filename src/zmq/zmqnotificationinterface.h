@@ -28,6 +28,10 @@ protected:
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
     void BlockChecked(const CBlock& block, const CValidationState& state);
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added);
+    void TransactionAddedToMempool(const CTransaction &tx);
+    void TransactionRemovedFromMempool(const uint256 &hash);
+    void AsyncOperationFinished(const std::string &id, const std::string &status);
 
 private:
     CZMQNotificationInterface();
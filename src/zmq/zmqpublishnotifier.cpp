@@ -13,6 +13,13 @@ static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
 static const char *MSG_CHECKEDBLOCK = "checkedblock";
+static const char *MSG_SEQUENCE = "sequence";
+static const char *MSG_SEQUENCEBATCH = "sequencebatch";
+static const char *MSG_OPSTATUS = "opstatus";
+
+//! a batch is sent early once it holds this many records, so a long gap between blocks stays bounded
+static const size_t MAX_SEQUENCE_BATCH_RECORDS = 10000;
+static const size_t SEQUENCE_RECORD_SIZE = 33;
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -204,3 +211,61 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnected(const CBlockIndex *pindex)
+{
+    LogPrint("zmq", "zmq: Publish sequence block connect %s\n", pindex->GetBlockHash().GetHex());
+    return SendSequence(pindex->GetBlockHash(), 'C');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnected(const CBlockIndex *pindex)
+{
+    LogPrint("zmq", "zmq: Publish sequence block disconnect %s\n", pindex->GetBlockHash().GetHex());
+    return SendSequence(pindex->GetBlockHash(), 'D');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction)
+{
+    LogPrint("zmq", "zmq: Publish sequence mempool accept %s\n", transaction.GetHash().GetHex());
+    return SendSequence(transaction.GetHash(), 'A');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const uint256 &hash)
+{
+    LogPrint("zmq", "zmq: Publish sequence mempool removal %s\n", hash.GetHex());
+    return SendSequence(hash, 'R');
+}
+
+bool CZMQPublishSequenceNotifier::SendSequence(const uint256 &hash, char label)
+{
+    LOCK(cs_sequence);
+    char data[SEQUENCE_RECORD_SIZE];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    data[32] = label;
+    return SendMessage(MSG_SEQUENCE, data, SEQUENCE_RECORD_SIZE);
+}
+
+bool CZMQPublishSequenceBatchNotifier::SendSequence(const uint256 &hash, char label)
+{
+    LOCK(cs_sequence);
+    for (unsigned int i = 0; i < 32; i++)
+        vBatch.push_back(hash.begin()[31 - i]);
+    vBatch.push_back(label);
+
+    bool fTipChanged = (label == 'C' || label == 'D');
+    if (!fTipChanged && vBatch.size() < MAX_SEQUENCE_BATCH_RECORDS * SEQUENCE_RECORD_SIZE)
+        return true;
+
+    LogPrint("zmq", "zmq: Publish sequencebatch of %u events\n", vBatch.size() / SEQUENCE_RECORD_SIZE);
+    bool fSent = SendMessage(MSG_SEQUENCEBATCH, &vBatch[0], vBatch.size());
+    vBatch.clear();
+    return fSent;
+}
+
+bool CZMQPublishOperationStatusNotifier::NotifyAsyncOperationFinished(const std::string &id, const std::string &status)
+{
+    LOCK(cs_opstatus);
+    LogPrint("zmq", "zmq: Publish opstatus %s\n", id);
+    return SendMessage(MSG_OPSTATUS, status.data(), status.size());
+}
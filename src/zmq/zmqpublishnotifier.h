@@ -6,6 +6,9 @@
 #define BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
 
 #include "zmqabstractnotifier.h"
+#include "sync.h"
+
+#include <vector>
 
 class CBlockIndex;
 
@@ -58,4 +61,49 @@ public:
     bool NotifyBlock(const CBlock &block);
 };
 
+/** Every change to the chain tip and the mempool, as the hash and a label:
+ * C block connected, D block disconnected, A transaction added to the mempool
+ * and R transaction removed from it other than by being mined. With the
+ * message sequence number a subscriber notices a gap and resyncs.
+ */
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnected(const CBlockIndex *pindex);
+    bool NotifyBlockDisconnected(const CBlockIndex *pindex);
+    bool NotifyTransactionAcceptance(const CTransaction &transaction);
+    bool NotifyTransactionRemoval(const uint256 &hash);
+
+protected:
+    //! notifications come from the validation and the mempool notify threads
+    CCriticalSection cs_sequence;
+
+    virtual bool SendSequence(const uint256 &hash, char label);
+};
+
+/** The sequence events coalesced per tip: the mempool events since the last
+ * tip change and the block that changes it, as one message of 33 byte records.
+ */
+class CZMQPublishSequenceBatchNotifier : public CZMQPublishSequenceNotifier
+{
+private:
+    std::vector<unsigned char> vBatch;
+
+protected:
+    bool SendSequence(const uint256 &hash, char label);
+};
+
+/** The z_getoperationstatus JSON of each async RPC operation that finishes,
+ * so callers of z_sendmany need not poll for it.
+ */
+class CZMQPublishOperationStatusNotifier : public CZMQAbstractPublishNotifier
+{
+private:
+    //! operations finish on the async RPC workers
+    CCriticalSection cs_opstatus;
+
+public:
+    bool NotifyAsyncOperationFinished(const std::string &id, const std::string &status);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H